@@ -0,0 +1,393 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Throughput of captured frame dumps over the Chamelium stream protocol,
+ * against a stand-in stream server so no Chamelium is needed. Each received
+ * frame is compared to the one sent, like the tests do. Prints the number of
+ * frames received per second, once per repetition.
+ *
+ * With -S, only runs the stand-in server, until killed.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_chamelium_stream.h"
+
+/* Mirrors the definitions of lib/igt_chamelium_stream.c */
+#define STREAM_VERSION_MAJOR 1
+#define STREAM_VERSION_MINOR 0
+
+enum {
+	ERROR_NONE = 0,
+	ERROR_COMMAND = 1,
+	ERROR_ARGUMENT = 2,
+};
+
+enum {
+	KIND_REQUEST = 0,
+	KIND_RESPONSE = 1,
+	KIND_DATA = 2,
+};
+
+enum {
+	TYPE_RESET = 0,
+	TYPE_GET_VERSION = 1,
+	TYPE_VIDEO_STREAM = 2,
+	TYPE_VIDEO_FRAME = 4,
+	TYPE_STOP_DUMP_VIDEO = 6,
+};
+
+struct server {
+	int fd;
+	int width, height;
+	unsigned char *frame;
+};
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static unsigned char pattern(size_t offset)
+{
+	return offset * 7 + (offset >> 12);
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = read(fd, buf, len);
+		if (ret <= 0)
+			return false;
+		buf = (char *) buf + ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = send(fd, buf, len, MSG_NOSIGNAL);
+		if (ret <= 0)
+			return false;
+		buf = (const char *) buf + ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static bool write_header(int fd, int kind, int type, int err, size_t len)
+{
+	char buf[8];
+
+	*(uint16_t *) &buf[0] = htons(kind << 8 | type);
+	*(uint16_t *) &buf[2] = htons(err);
+	*(uint32_t *) &buf[4] = htonl(len);
+
+	return write_all(fd, buf, sizeof(buf));
+}
+
+static bool respond(int fd, int type, int err, const void *buf, size_t len)
+{
+	return write_header(fd, KIND_RESPONSE, type, err, len) &&
+	       write_all(fd, buf, len);
+}
+
+/* Sends frames until done or until the client sends another request. */
+static bool send_frames(struct server *server, unsigned int first,
+			unsigned int count)
+{
+	size_t size = (size_t) server->width * server->height * 3;
+	struct pollfd pfd = { .fd = server->fd, .events = POLLIN };
+	char header[12] = {};
+
+	for (unsigned int n = first; n < first + count; n++) {
+		if (poll(&pfd, 1, 0) == 1)
+			break;
+
+		*(uint32_t *) &header[0] = htonl(n);
+		*(uint16_t *) &header[4] = htons(server->width);
+		*(uint16_t *) &header[6] = htons(server->height);
+
+		if (!write_header(server->fd, KIND_DATA, TYPE_VIDEO_FRAME,
+				  ERROR_NONE, sizeof(header) + size) ||
+		    !write_all(server->fd, header, sizeof(header)) ||
+		    !write_all(server->fd, server->frame, size))
+			return false;
+	}
+
+	return true;
+}
+
+static bool serve_request(struct server *server)
+{
+	static const char version[2] = {
+		STREAM_VERSION_MAJOR, STREAM_VERSION_MINOR
+	};
+	char header[8], body[64];
+	int type;
+	size_t len;
+
+	if (!read_all(server->fd, header, sizeof(header)))
+		return false;
+
+	type = ntohs(*(uint16_t *) &header[0]) & 0xff;
+	len = ntohl(*(uint32_t *) &header[4]);
+	if (len > sizeof(body))
+		return false;
+	if (!read_all(server->fd, body, len))
+		return false;
+
+	switch (type) {
+	case TYPE_RESET:
+	case TYPE_STOP_DUMP_VIDEO:
+		return respond(server->fd, type, ERROR_NONE, NULL, 0);
+	case TYPE_GET_VERSION:
+		return respond(server->fd, type, ERROR_NONE,
+			       version, sizeof(version));
+	case TYPE_VIDEO_STREAM:
+		if (len != 4)
+			return respond(server->fd, type, ERROR_ARGUMENT, NULL, 0);
+
+		server->width = ntohs(*(uint16_t *) &body[0]);
+		server->height = ntohs(*(uint16_t *) &body[2]);
+		free(server->frame);
+		server->frame = malloc((size_t) server->width * server->height * 3);
+		for (size_t i = 0; i < (size_t) server->width * server->height * 3; i++)
+			server->frame[i] = pattern(i);
+
+		return respond(server->fd, type, ERROR_NONE, NULL, 0);
+	case TYPE_VIDEO_FRAME:
+		if (len != 6 || !server->frame)
+			return respond(server->fd, type, ERROR_ARGUMENT, NULL, 0);
+
+		return respond(server->fd, type, ERROR_NONE, NULL, 0) &&
+		       send_frames(server, ntohl(*(uint32_t *) &body[0]),
+				   ntohs(*(uint16_t *) &body[4]));
+	default:
+		return respond(server->fd, type, ERROR_COMMAND, NULL, 0);
+	}
+}
+
+static void serve(int listen_fd)
+{
+	struct server server = {};
+
+	signal(SIGCHLD, SIG_IGN);
+
+	while ((server.fd = accept(listen_fd, NULL, NULL)) >= 0) {
+		if (fork() == 0) {
+			close(listen_fd);
+			while (serve_request(&server))
+				;
+			exit(EXIT_SUCCESS);
+		}
+		close(server.fd);
+	}
+
+	perror("accept");
+	exit(EXIT_FAILURE);
+}
+
+static int listen_on(unsigned int *port)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+		.sin_port = htons(*port),
+	};
+	socklen_t addr_len = sizeof(addr);
+	int fd, one = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+	    listen(fd, 4) ||
+	    getsockname(fd, (struct sockaddr *) &addr, &addr_len)) {
+		close(fd);
+		return -1;
+	}
+
+	*port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+/* Returns the time spent dumping and comparing the frames. */
+static double run_bench(struct chamelium_stream *stream, int width, int height,
+			unsigned int count, const unsigned char *expected)
+{
+	size_t size = (size_t) width * height * 3;
+	const unsigned char *frame;
+	struct timespec start, end;
+	unsigned int number;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (!chamelium_stream_dump_video_frames(stream, width, height, 0, count)) {
+		fprintf(stderr, "Unable to start the video dump\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (unsigned int n = 0; n < count; n++) {
+		frame = chamelium_stream_receive_video_frame(stream, &number);
+		if (!frame || number != n || memcmp(frame, expected, size)) {
+			fprintf(stderr, "Frame %u wasn't received correctly\n", n);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (!chamelium_stream_stop_video_dump(stream)) {
+		fprintf(stderr, "Unable to stop the video dump\n");
+		exit(EXIT_FAILURE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return elapsed(&start, &end);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -W <width>    Width of the frames (default 1920)\n"
+		"  -H <height>   Height of the frames (default 1080)\n"
+		"  -n <frames>   Frames per dump (default 60)\n"
+		"  -r <reps>     Repetitions (default 13)\n"
+		"  -S            Only run the stand-in stream server\n"
+		"  -p <port>     Port of the stand-in server (default any, 9994 with -S)\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	struct chamelium_stream *stream;
+	unsigned int port = 0, count = 60;
+	int width = 1920, height = 1080;
+	bool server_only = false;
+	unsigned char *expected;
+	int reps = 13;
+	int c, fd, status;
+	pid_t server;
+
+	while ((c = getopt(argc, argv, "W:H:n:r:Sp:h")) != -1) {
+		switch (c) {
+		case 'W':
+			width = atoi(optarg);
+			break;
+		case 'H':
+			height = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+		case 'S':
+			server_only = true;
+			if (!port)
+				port = 9994;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (width < 1 || width > UINT16_MAX || height < 1 || height > UINT16_MAX ||
+	    count < 1 || count > UINT16_MAX) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fd = listen_on(&port);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to listen on port %u: %s\n",
+			port, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (server_only)
+		serve(fd);
+
+	server = fork();
+	if (server == 0)
+		serve(fd);
+	close(fd);
+
+	stream = chamelium_stream_init_for_host("127.0.0.1", port);
+	if (!stream) {
+		fprintf(stderr, "Unable to connect to the stand-in server\n");
+		kill(server, SIGKILL);
+		return EXIT_FAILURE;
+	}
+
+	expected = malloc((size_t) width * height * 3);
+	for (size_t i = 0; i < (size_t) width * height * 3; i++)
+		expected[i] = pattern(i);
+
+	for (int n = 0; n < reps; n++)
+		printf("%f\n", count / run_bench(stream, width, height,
+						 count, expected));
+
+	chamelium_stream_deinit(stream);
+	free(expected);
+
+	kill(server, SIGTERM);
+	waitpid(server, &status, 0);
+
+	return 0;
+}
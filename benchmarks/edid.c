@@ -0,0 +1,203 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * Throughput of the EDID helpers: building CEA EDIDs with random data blocks,
+ * validating them and indexing their blocks. A share of the EDIDs can be
+ * randomly corrupted, to also measure how quickly bad EDIDs are rejected.
+ * Prints the number of EDIDs per second of each phase, once per repetition.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_edid.h"
+#include "igt_kms.h"
+
+#define EDID_SIZE (2 * EDID_BLOCK_SIZE)
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+/* Builds a CEA EDID with random SVD, audio and HDMI data blocks. */
+static void build_edid(uint8_t raw_edid[static EDID_SIZE])
+{
+	struct edid *edid = (struct edid *) raw_edid;
+	struct edid_ext *ext = &edid->extensions[0];
+	char *cea_data = ext->data.cea.data;
+	struct edid_cea_data_block *block;
+	struct cea_speaker_alloc speakers = {
+		.speakers = CEA_SPEAKER_FRONT_LEFT_RIGHT,
+	};
+	const struct cea_vsdb *vsdb;
+	uint8_t svds[16];
+	struct cea_sad sad;
+	size_t size = 0, vsdb_size;
+	int n_svds = rand() % ARRAY_SIZE(svds) + 1;
+
+	memcpy(edid, igt_kms_get_base_edid(), sizeof(struct edid));
+	memset(ext, 0, sizeof(*ext));
+	edid->extensions_len = 1;
+
+	for (int i = 0; i < n_svds; i++)
+		svds[i] = rand() % 64 + 1;
+	block = (struct edid_cea_data_block *) &cea_data[size];
+	size += edid_cea_data_block_set_svd(block, svds, n_svds);
+
+	if (rand() % 2) {
+		cea_sad_init_pcm(&sad, 2, CEA_SAD_SAMPLING_RATE_48KHZ,
+				 CEA_SAD_SAMPLE_SIZE_16);
+		block = (struct edid_cea_data_block *) &cea_data[size];
+		size += edid_cea_data_block_set_sad(block, &sad, 1);
+
+		block = (struct edid_cea_data_block *) &cea_data[size];
+		size += edid_cea_data_block_set_speaker_alloc(block, &speakers);
+	}
+
+	if (rand() % 2) {
+		block = (struct edid_cea_data_block *) &cea_data[size];
+		vsdb = cea_vsdb_get_hdmi_default(&vsdb_size);
+		size += edid_cea_data_block_set_vsdb(block, vsdb, vsdb_size);
+	}
+
+	edid_ext_set_cea(ext, size, 0, 0);
+	edid_update_checksum(edid);
+}
+
+static void corrupt_edid(uint8_t raw_edid[static EDID_SIZE])
+{
+	for (int n = rand() % 4 + 1; n; n--)
+		raw_edid[rand() % EDID_SIZE] = rand();
+
+	/* Make half of them get past the checksums, within the buffer */
+	if (rand() % 2 && ((struct edid *) raw_edid)->extensions_len <= 1)
+		edid_update_checksum((struct edid *) raw_edid);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -n <edids>    EDIDs per repetition (default 100000)\n"
+		"  -c <percent>  Share of corrupted EDIDs (default 0)\n"
+		"  -r <reps>     Repetitions (default 13)\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	struct timespec start, end;
+	struct edid_index index;
+	int count = 100000, corrupt = 0, reps = 13;
+	int c, n_valid, n_blocks;
+	uint8_t (*edids)[EDID_SIZE];
+	double build, validate, lookup;
+
+	while ((c = getopt(argc, argv, "n:c:r:h")) != -1) {
+		switch (c) {
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'c':
+			corrupt = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (count < 1 || corrupt < 0 || corrupt > 100) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	edids = calloc(count, sizeof(*edids));
+	if (!edids)
+		return EXIT_FAILURE;
+
+	printf("build validate index (EDIDs/s)\n");
+
+	for (int rep = 0; rep < reps; rep++) {
+		srand(rep);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int n = 0; n < count; n++)
+			build_edid(edids[n]);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		build = elapsed(&start, &end);
+
+		for (int n = 0; n < count; n++)
+			if (rand() % 100 < corrupt)
+				corrupt_edid(edids[n]);
+
+		n_valid = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int n = 0; n < count; n++)
+			n_valid += edid_validate((struct edid *) edids[n],
+						 EDID_SIZE, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		validate = elapsed(&start, &end);
+
+		/* Index and look up what the tests typically look for */
+		n_blocks = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int n = 0; n < count; n++) {
+			edid_index_init(&index, (struct edid *) edids[n],
+					EDID_SIZE);
+			n_blocks += !!edid_index_find(&index, EDID_BLOCK_CEA_DATA,
+						      EDID_CEA_DATA_AUDIO, NULL);
+			n_blocks += !!edid_index_find(&index, EDID_BLOCK_CEA_DATA,
+						      EDID_CEA_DATA_VIDEO, NULL);
+			n_blocks += !!index.hdmi_vsdb;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		lookup = elapsed(&start, &end);
+
+		if (n_valid + n_blocks < 0) /* keep the results alive */
+			return EXIT_FAILURE;
+
+		printf("%f %f %f\n", count / build, count / validate,
+		       count / lookup);
+	}
+
+	free(edids);
+
+	return 0;
+}
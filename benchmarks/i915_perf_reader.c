@@ -0,0 +1,329 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Throughput of the processing of i915-perf recordings, on recordings
+ * synthesized for the requested device so no GPU is needed. Prints the
+ * number of OA reports processed per second, once per repetition.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "i915/perf.h"
+#include "i915/perf_data_reader.h"
+#include "i915/perf_eval.h"
+#include "i915/perf_synth.h"
+
+#define EVAL_BATCH 1024
+
+enum bench {
+	BENCH_OPEN,
+	BENCH_INDEX,
+	BENCH_TIMELINE,
+	BENCH_ACCUMULATE,
+	BENCH_EVAL,
+	BENCH_EXPORT,
+};
+
+static const char *bench_names[] = {
+	[BENCH_OPEN] = "open",
+	[BENCH_INDEX] = "index",
+	[BENCH_TIMELINE] = "timeline",
+	[BENCH_ACCUMULATE] = "accumulate",
+	[BENCH_EVAL] = "eval",
+	[BENCH_EXPORT] = "export",
+};
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static void open_reader(struct intel_perf_data_reader *reader, int fd, bool lazy)
+{
+	if (!(lazy ? intel_perf_data_reader_open(reader, fd) :
+	      intel_perf_data_reader_init(reader, fd))) {
+		fprintf(stderr, "Unable to read recording: %s\n", reader->error_msg);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void eval_reports(struct intel_perf_data_reader *reader)
+{
+	const struct intel_perf_metric_set *metric_set = reader->metric_set;
+	struct intel_perf_accumulator *accs = calloc(EVAL_BATCH, sizeof(*accs));
+	struct intel_perf_eval_program *program;
+	union intel_perf_eval_value **values;
+
+	program = intel_perf_eval_program_new(reader->perf, metric_set, NULL, 0);
+	values = calloc(metric_set->n_counters, sizeof(*values));
+	for (int c = 0; c < metric_set->n_counters; c++)
+		values[c] = calloc(EVAL_BATCH, sizeof(*values[c]));
+
+	for (uint32_t r = 1; r < reader->n_records; r += EVAL_BATCH) {
+		uint32_t n = reader->n_records - r;
+
+		if (n > EVAL_BATCH)
+			n = EVAL_BATCH;
+
+		for (uint32_t i = 0; i < n; i++) {
+			intel_perf_accumulate_reports(&accs[i],
+						      metric_set->perf_oa_format,
+						      reader->records[r + i - 1],
+						      reader->records[r + i]);
+		}
+		intel_perf_eval_program_run(program, accs, n, values);
+	}
+
+	for (int c = 0; c < metric_set->n_counters; c++)
+		free(values[c]);
+	free(values);
+	intel_perf_eval_program_free(program);
+	free(accs);
+}
+
+static bool counter_is_float(const struct intel_perf_logical_counter *counter)
+{
+	return counter->storage == INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE ||
+		counter->storage == INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT;
+}
+
+/*
+ * What i915-perf-reader --format=csv does for each timeline item, on a
+ * single thread: accumulate the item's reports, evaluate all the counters
+ * of the metric set and format them.
+ */
+static void export_timelines(struct intel_perf_data_reader *reader, FILE *f)
+{
+	const struct intel_perf_metric_set *metric_set = reader->metric_set;
+	struct intel_perf_accumulator *accs = calloc(EVAL_BATCH, sizeof(*accs));
+	struct intel_perf_eval_program *program;
+	union intel_perf_eval_value **values;
+
+	program = intel_perf_eval_program_new(reader->perf, metric_set, NULL, 0);
+	values = calloc(metric_set->n_counters, sizeof(*values));
+	for (int c = 0; c < metric_set->n_counters; c++)
+		values[c] = calloc(EVAL_BATCH, sizeof(*values[c]));
+
+	for (uint32_t t = 0; t < reader->n_timelines; t += EVAL_BATCH) {
+		const struct intel_perf_timeline_item *items = &reader->timelines[t];
+		uint32_t n = reader->n_timelines - t;
+
+		if (n > EVAL_BATCH)
+			n = EVAL_BATCH;
+
+		for (uint32_t i = 0; i < n; i++) {
+			intel_perf_accumulate_reports(&accs[i],
+						      metric_set->perf_oa_format,
+						      reader->records[items[i].record_start],
+						      reader->records[items[i].record_end]);
+		}
+		intel_perf_eval_program_run(program, accs, n, values);
+
+		for (uint32_t i = 0; i < n; i++) {
+			fprintf(f, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%u",
+				items[i].cpu_ts_start, items[i].cpu_ts_end,
+				items[i].ts_start, items[i].ts_end, items[i].hw_id);
+
+			for (int c = 0; c < metric_set->n_counters; c++) {
+				if (counter_is_float(&metric_set->counters[c]))
+					fprintf(f, ",%f", values[c][i].f);
+				else
+					fprintf(f, ",%" PRIu64, values[c][i].u64);
+			}
+
+			fputc('\n', f);
+		}
+	}
+
+	for (int c = 0; c < metric_set->n_counters; c++)
+		free(values[c]);
+	free(values);
+	intel_perf_eval_program_free(program);
+	free(accs);
+}
+
+/* Returns the time spent in the benchmarked step. */
+static double run_bench(enum bench bench, int fd)
+{
+	struct intel_perf_data_reader reader;
+	struct intel_perf_accumulator acc;
+	struct timespec start, end;
+	uint64_t duration;
+	FILE *f;
+
+	switch (bench) {
+	case BENCH_OPEN:
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		open_reader(&reader, fd, false);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		break;
+
+	case BENCH_INDEX:
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		open_reader(&reader, fd, true);
+		intel_perf_data_reader_duration(&reader);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		break;
+
+	case BENCH_TIMELINE:
+		open_reader(&reader, fd, true);
+		duration = intel_perf_data_reader_duration(&reader);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		intel_perf_data_reader_load_window(&reader, 0, duration);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		break;
+
+	case BENCH_ACCUMULATE:
+		open_reader(&reader, fd, false);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (uint32_t r = 1; r < reader.n_records; r++) {
+			intel_perf_accumulate_reports(&acc,
+						      reader.metric_set->perf_oa_format,
+						      reader.records[r - 1],
+						      reader.records[r]);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		break;
+
+	case BENCH_EVAL:
+		open_reader(&reader, fd, false);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		eval_reports(&reader);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		break;
+
+	case BENCH_EXPORT:
+		f = fopen("/dev/null", "w");
+		open_reader(&reader, fd, false);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		export_timelines(&reader, f);
+		fflush(f);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		fclose(f);
+		break;
+	}
+
+	intel_perf_data_reader_fini(&reader);
+
+	return elapsed(&start, &end);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -b <bench>    open, index, timeline, accumulate, eval or export\n"
+		"                (default open)\n"
+		"  -d <devid>    PCI ID of the device to synthesize reports for (default 0x9a49)\n"
+		"  -m <name>     Metric set (default RenderBasic)\n"
+		"  -n <samples>  Number of OA reports (default 1000000)\n"
+		"  -s <samples>  Reports between context switches, 0 for none (default 50)\n"
+		"  -r <reps>     Repetitions (default 13)\n"
+		"  -o <file>     Keep the synthesized recording in <file>\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	struct intel_perf_synth_params params;
+	enum bench bench = BENCH_OPEN;
+	const char *output = NULL;
+	char path[] = "/tmp/i915-perf-XXXXXX";
+	int reps = 13;
+	int c, fd;
+
+	intel_perf_synth_default_params(&params);
+	params.n_samples = 1000000;
+
+	while ((c = getopt(argc, argv, "b:d:m:n:s:r:o:h")) != -1) {
+		switch (c) {
+		case 'b':
+			for (bench = 0; bench < ARRAY_SIZE(bench_names); bench++) {
+				if (!strcmp(optarg, bench_names[bench]))
+					break;
+			}
+			if (bench == ARRAY_SIZE(bench_names)) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'd':
+			params.device_id = strtoul(optarg, NULL, 16);
+			break;
+		case 'm':
+			params.metric_set = optarg;
+			break;
+		case 'n':
+			params.n_samples = atoi(optarg);
+			break;
+		case 's':
+			params.context_switch_period = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (output) {
+		fd = open(output, O_CREAT | O_TRUNC | O_RDWR, 0644);
+	} else {
+		fd = mkstemp(path);
+		unlink(path);
+	}
+	if (fd < 0) {
+		fprintf(stderr, "Unable to create recording: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (!intel_perf_synth_write(fd, &params)) {
+		fprintf(stderr, "Unable to synthesize recording: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (int n = 0; n < reps; n++)
+		printf("%f\n", params.n_samples / run_bench(bench, fd));
+
+	close(fd);
+
+	return 0;
+}
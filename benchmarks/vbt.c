@@ -0,0 +1,230 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Throughput of the VBT parsing library: indexing VBTs and decoding what the
+ * tests typically look for. The corpus is made of synthetic VBTs of several
+ * BDB versions, and of any VBT files given as arguments, like dumps of
+ * i915_vbt from debugfs or VBIOS images. A share of the VBTs can be randomly
+ * corrupted, to also measure how quickly bad VBTs are rejected, and to fuzz
+ * the parser over real world VBTs when built with ASan.
+ * Prints the number of VBTs per second of each phase, once per repetition.
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_vbt.h"
+
+struct blob {
+	uint8_t *data;
+	size_t size;
+};
+
+static const uint16_t versions[] = {
+	155, 165, 186, 195, 198, 209, 216, 226,
+};
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static bool read_blob(const char *path, struct blob *blob)
+{
+	struct stat st;
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Couldn't open \"%s\"\n", path);
+		return false;
+	}
+
+	/* debugfs files have no size */
+	blob->size = st.st_size ?: 65536;
+	blob->data = malloc(blob->size);
+	len = read(fd, blob->data, blob->size);
+	close(fd);
+
+	if (len <= 0) {
+		fprintf(stderr, "Couldn't read \"%s\"\n", path);
+		free(blob->data);
+		return false;
+	}
+
+	blob->size = len;
+
+	return true;
+}
+
+static void corrupt_vbt(uint8_t *data, size_t size)
+{
+	for (int n = rand() % 4 + 1; n; n--)
+		data[rand() % size] = rand();
+
+	if (rand() % 4 == 0)
+		data[rand() % size] = 0;
+}
+
+/* Decodes what the tests typically look for */
+static int lookup(const struct igt_vbt *vbt)
+{
+	struct igt_vbt_child_device child;
+	struct igt_vbt_mipi_sequences seqs;
+	struct igt_vbt_edp edp;
+	struct igt_vbt_psr psr;
+	int panel_type, n = 0;
+
+	panel_type = igt_vbt_panel_type(vbt);
+	for (int i = 0; igt_vbt_get_child_device(vbt, i, &child); i++)
+		n += child.device_type != 0;
+
+	n += igt_vbt_get_edp(vbt, panel_type, &edp);
+	n += igt_vbt_get_psr(vbt, panel_type, &psr);
+	n += igt_vbt_get_mipi_sequences(vbt, panel_type, &seqs);
+
+	return n;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [VBT files...]\n"
+		"  -n <vbts>     VBTs per repetition (default 100000)\n"
+		"  -c <percent>  Share of corrupted VBTs (default 0)\n"
+		"  -r <reps>     Repetitions (default 13)\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	struct timespec start, end;
+	struct igt_vbt vbt;
+	int count = 100000, corrupt = 0, reps = 13;
+	int c, n_corpus, n_valid, n_found;
+	struct blob *corpus, *vbts;
+	double init, decode;
+
+	while ((c = getopt(argc, argv, "n:c:r:h")) != -1) {
+		switch (c) {
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'c':
+			corrupt = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (count < 1 || corrupt < 0 || corrupt > 100) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	corpus = calloc(ARRAY_SIZE(versions) + argc - optind, sizeof(*corpus));
+	vbts = calloc(count, sizeof(*vbts));
+	if (!corpus || !vbts)
+		return EXIT_FAILURE;
+
+	n_corpus = 0;
+	for (int i = 0; i < ARRAY_SIZE(versions); i++) {
+		corpus[n_corpus].data = igt_vbt_create(versions[i],
+						       &corpus[n_corpus].size);
+		n_corpus++;
+	}
+	for (int i = optind; i < argc; i++)
+		if (read_blob(argv[i], &corpus[n_corpus]))
+			n_corpus++;
+
+	printf("init decode (VBTs/s)\n");
+
+	for (int rep = 0; rep < reps; rep++) {
+		srand(rep);
+
+		/* exact size copies, for ASan to catch overreads */
+		for (int n = 0; n < count; n++) {
+			const struct blob *src = &corpus[rand() % n_corpus];
+
+			free(vbts[n].data);
+			vbts[n].size = src->size;
+			vbts[n].data = malloc(src->size);
+			memcpy(vbts[n].data, src->data, src->size);
+
+			if (rand() % 100 < corrupt)
+				corrupt_vbt(vbts[n].data, vbts[n].size);
+		}
+
+		n_valid = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int n = 0; n < count; n++) {
+			n_valid += igt_vbt_init(&vbt, vbts[n].data,
+						vbts[n].size) == 0;
+			igt_vbt_fini(&vbt);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		init = elapsed(&start, &end);
+
+		n_found = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int n = 0; n < count; n++) {
+			if (igt_vbt_init(&vbt, vbts[n].data, vbts[n].size) == 0)
+				n_found += lookup(&vbt);
+			igt_vbt_fini(&vbt);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		decode = elapsed(&start, &end);
+
+		if (n_valid + n_found < 0) /* keep the results alive */
+			return EXIT_FAILURE;
+
+		printf("%f %f\n", count / init, count / decode);
+	}
+
+	for (int n = 0; n < count; n++)
+		free(vbts[n].data);
+	for (int i = 0; i < n_corpus; i++)
+		free(corpus[i].data);
+	free(vbts);
+	free(corpus);
+
+	return 0;
+}
@@ -40,42 +40,48 @@ def output_units(unit):
     return unit.replace(' ', '_').upper()
 
 
-def output_counter_report(set, counter):
-    data_type = counter.get('data_type')
-    data_type_uc = data_type.upper()
-    c_type = data_type
-
-    if "uint" in c_type:
-        c_type = c_type + "_t"
-
-    semantic_type = counter.get('semantic_type')
-    if semantic_type in semantic_type_map:
-        semantic_type = semantic_type_map[semantic_type]
-
-    semantic_type_uc = semantic_type.upper()
-
-    c("\n")
-
-    availability = counter.get('availability')
-    if availability:
-        set.gen.output_availability(set, availability, counter.get('name'))
-        c.indent(4)
+class StringPool:
+    def __init__(self):
+        self.strings = []
+        self.offsets = {}
+        self.size = 0
+
+    def add(self, string):
+        if string not in self.offsets:
+            self.offsets[string] = self.size
+            self.strings.append(string)
+            self.size += len(string.encode('utf-8')) + 1
+        return self.offsets[string]
+
+
+def fnv1a(name):
+    h = 0x811c9dc5
+    for b in name.lower().encode('utf-8'):
+        h ^= b
+        h = (h * 0x01000193) & 0xffffffff
+    return h
+
+
+def output_hash_table(gen):
+    size = 1
+    while size < 2 * len(gen.sets):
+        size *= 2
+
+    table = [0] * size
+    for i, set in enumerate(gen.sets):
+        slot = fnv1a(set.symbol_name) & (size - 1)
+        while table[slot]:
+            slot = (slot + 1) & (size - 1)
+        table[slot] = i + 1
+
+    c("\nstatic const uint16_t {0}_metric_set_hash[] = {{".format(gen.chipset))
+    c.indent(4)
+    for i in range(0, size, 16):
+        c(", ".join(str(v) for v in table[i:i + 16]) + ",")
+    c.outdent(4)
+    c("};")
 
-    c("counter = &metric_set->counters[metric_set->n_counters++];\n")
-    c("counter->metric_set = metric_set;\n")
-    c("counter->name = \"{0}\";\n".format(counter.get('name')))
-    c("counter->symbol_name = \"{0}\";\n".format(counter.get('symbol_name')));
-    c("counter->desc = \"{0}\";\n".format(counter.get('description')))
-    c("counter->type = INTEL_PERF_LOGICAL_COUNTER_TYPE_{0};\n".format(semantic_type_uc))
-    c("counter->storage = INTEL_PERF_LOGICAL_COUNTER_STORAGE_{0};\n".format(data_type_uc))
-    c("counter->unit = INTEL_PERF_LOGICAL_COUNTER_UNIT_{0};\n".format(output_units(counter.get('units'))))
-    c("counter->read_{0} = {1};\n".format(data_type, set.read_funcs["$" + counter.get('symbol_name')]))
-    c("counter->max_{0} = {1};\n".format(data_type, set.max_funcs["$" + counter.get('symbol_name')]))
-    c("intel_perf_add_logical_counter(perf, counter, \"{0}\");\n".format(counter.get('mdapi_group')))
-
-    if availability:
-        c.outdent(4)
-        c("}\n")
+    return size - 1
 
 
 def generate_metric_sets(args, gen):
@@ -84,7 +90,6 @@ def generate_metric_sets(args, gen):
         #include <stdint.h>
         #include <stdlib.h>
         #include <stdbool.h>
-        #include <assert.h>
 
         #include "i915_drm.h"
 
@@ -93,77 +98,129 @@ def generate_metric_sets(args, gen):
     c("#include \"{0}\"".format(os.path.basename(args.header)))
     c("#include \"{0}\"".format(os.path.basename(args.equations_include)))
     c("#include \"{0}\"".format(os.path.basename(args.registers_include)))
+    c("#include \"i915/perf_tables.h\"")
 
-    # Print out all set registration functions for each set in each
-    # generation.
-    for set in gen.sets:
-        c("\nstatic void\n")
-        c(gen.chipset + "_add_" + set.underscore_name + "_metric_set(struct intel_perf *perf)")
-        c("{\n")
-        c.indent(4)
-
-        c("struct intel_perf_metric_set *metric_set;\n")
-        c("struct intel_perf_logical_counter *counter;\n\n")
+    strings = StringPool()
+    availabilities = { None: 0 }
+    funcs = {}
+    counter_descs = []
+    set_descs = []
 
+    for set in gen.sets:
         counters = sorted(set.counters, key=lambda k: k.get('symbol_name'))
 
-        c("metric_set = calloc(1, sizeof(*metric_set));\n")
-        c("metric_set->name = \"" + set.name + "\";\n")
-        c("metric_set->symbol_name = \"" + set.symbol_name + "\";\n")
-        c("metric_set->hw_config_guid = \"" + set.hw_config_guid + "\";\n")
-        c("metric_set->counters = calloc({0}, sizeof(struct intel_perf_logical_counter));\n".format(str(len(counters))))
-        c("metric_set->n_counters = 0;\n")
-        c("metric_set->perf_oa_metrics_set = 0; // determined at runtime\n")
-
-        if gen.chipset == "hsw":
-            c(textwrap.dedent("""\
-                metric_set->perf_oa_format = I915_OA_FORMAT_A45_B8_C8;
-
-                metric_set->perf_raw_size = 256;
-                metric_set->gpu_time_offset = 0;
-                metric_set->a_offset = 1;
-                metric_set->b_offset = metric_set->a_offset + 45;
-                metric_set->c_offset = metric_set->b_offset + 8;
-                metric_set->perfcnt_offset = metric_set->c_offset + 8;
-
-            """))
-        else:
-            c(textwrap.dedent("""\
-                metric_set->perf_oa_format = I915_OA_FORMAT_A32u40_A4u32_B8_C8;
-
-                metric_set->perf_raw_size = 256;
-                metric_set->gpu_time_offset = 0;
-                metric_set->gpu_clock_offset = 1;
-                metric_set->a_offset = 2;
-                metric_set->b_offset = metric_set->a_offset + 36;
-                metric_set->c_offset = metric_set->b_offset + 8;
-                metric_set->perfcnt_offset = metric_set->c_offset + 8;
-
-            """))
-
-        c("%s_%s_add_registers(perf, metric_set);" % (gen.chipset, set.underscore_name))
-
-        c("intel_perf_add_metric_set(perf, metric_set);");
-        c("\n")
+        set_descs.append((strings.add(set.name),
+                          strings.add(set.symbol_name),
+                          strings.add(set.hw_config_guid),
+                          len(counter_descs), len(counters)))
 
         for counter in counters:
-            output_counter_report(set, counter)
+            data_type = counter.get('data_type')
+            semantic_type = counter.get('semantic_type')
+            if semantic_type in semantic_type_map:
+                semantic_type = semantic_type_map[semantic_type]
+
+            availability = counter.get('availability')
+            if availability not in availabilities:
+                expression = gen.splice_rpn_expression(set, counter.get('name'),
+                                                       availability)
+                availabilities[availability] = (len(availabilities), expression)
+
+            func = (data_type,
+                    set.max_funcs["$" + counter.get('symbol_name')],
+                    set.read_funcs["$" + counter.get('symbol_name')])
+            if func not in funcs:
+                funcs[func] = len(funcs)
+
+            counter_descs.append((strings.add(counter.get('name')),
+                                  strings.add(counter.get('symbol_name')),
+                                  strings.add(counter.get('description')),
+                                  strings.add(counter.get('mdapi_group')),
+                                  strings.add(counter.get('equation')),
+                                  funcs[func],
+                                  availabilities[availability][0] if availability else 0,
+                                  "INTEL_PERF_LOGICAL_COUNTER_STORAGE_" + data_type.upper(),
+                                  "INTEL_PERF_LOGICAL_COUNTER_TYPE_" + semantic_type.upper(),
+                                  "INTEL_PERF_LOGICAL_COUNTER_UNIT_" + output_units(counter.get('units'))))
+
+    # Availability conditions of the counters, deduplicated.
+    for availability, value in availabilities.items():
+        if availability is None:
+            continue
+        c("\nstatic bool")
+        c("{0}_availability_{1}(const struct intel_perf *perf)".format(gen.chipset, value[0]))
+        c("{")
+        c.indent(4)
+        c("return " + value[1] + ";")
+        c.outdent(4)
+        c("}")
+
+    c("\nstatic bool (* const {0}_availability[])(const struct intel_perf *perf) = {{".format(gen.chipset))
+    c.indent(4)
+    c("NULL,")
+    for availability, value in availabilities.items():
+        if availability is not None:
+            c("{0}_availability_{1},".format(gen.chipset, value[0]))
+    c.outdent(4)
+    c("};")
+
+    c("\nstatic const struct intel_perf_counter_funcs {0}_funcs[] = {{".format(gen.chipset))
+    c.indent(4)
+    for (data_type, max_func, read_func) in funcs:
+        c("{{ .max_{0} = {1}, .read_{0} = {2} }},".format(data_type, max_func, read_func))
+    c.outdent(4)
+    c("};")
 
-        c("\nassert(metric_set->n_counters <= {0});\n".format(len(counters)));
+    c("\nstatic const char {0}_strings[] =".format(gen.chipset))
+    c.indent(4)
+    for string in strings.strings:
+        c("\"{0}\\0\"".format(string))
+    c.outdent(4)
+    c(";")
 
-        c.outdent(4)
-        c("}\n")
+    c("\nstatic const struct intel_perf_counter_desc {0}_counters[] = {{".format(gen.chipset))
+    c.indent(4)
+    for desc in counter_descs:
+        c("{{ {0}, {1}, {2}, {3}, {4}, {5}, {6}, {7}, {8}, {9} }},".format(*desc))
+    c.outdent(4)
+    c("};")
 
-    c("\nvoid")
-    c("intel_perf_load_metrics_" + gen.chipset + "(struct intel_perf *perf)")
-    c("{")
+    c("\nstatic const struct intel_perf_metric_set_desc {0}_metric_sets[] = {{".format(gen.chipset))
     c.indent(4)
+    for desc in set_descs:
+        c("{{ {0}, {1}, {2}, {3}, {4} }},".format(*desc))
+    c.outdent(4)
+    c("};")
 
+    c("\nstatic void (* const {0}_add_registers[])(struct intel_perf *perf,".format(gen.chipset))
+    c("                                           struct intel_perf_metric_set *metric_set) = {")
+    c.indent(4)
     for set in gen.sets:
-        c("{0}_add_{1}_metric_set(perf);".format(gen.chipset, set.underscore_name))
+        c("{0}_{1}_add_registers,".format(gen.chipset, set.underscore_name))
+    c.outdent(4)
+    c("};")
+
+    hash_mask = output_hash_table(gen)
 
+    if gen.chipset == "hsw":
+        oa_format = "I915_OA_FORMAT_A45_B8_C8"
+    else:
+        oa_format = "I915_OA_FORMAT_A32u40_A4u32_B8_C8"
+
+    c("\nconst struct intel_perf_metrics_table intel_perf_metrics_{0} = {{".format(gen.chipset))
+    c.indent(4)
+    c(".oa_format = {0},".format(oa_format))
+    c(".strings = {0}_strings,".format(gen.chipset))
+    c(".sets = {0}_metric_sets,".format(gen.chipset))
+    c(".n_sets = {0},".format(len(gen.sets)))
+    c(".counters = {0}_counters,".format(gen.chipset))
+    c(".funcs = {0}_funcs,".format(gen.chipset))
+    c(".availability = {0}_availability,".format(gen.chipset))
+    c(".add_registers = {0}_add_registers,".format(gen.chipset))
+    c(".hash = {0}_metric_set_hash,".format(gen.chipset))
+    c(".hash_mask = {0},".format(hash_mask))
     c.outdent(4)
-    c("}")
+    c("};")
 
 
 
@@ -225,8 +282,8 @@ def main():
 
         """ % (header_define, header_define)))
 
-    # Print out all set registration functions for each generation.
-    h("void intel_perf_load_metrics_" + gen.chipset + "(struct intel_perf *perf);\n\n")
+    h("struct intel_perf_metrics_table;\n")
+    h("extern const struct intel_perf_metrics_table intel_perf_metrics_" + gen.chipset + ";\n\n")
 
     h(textwrap.dedent("""\
         #endif /* %s */
@@ -37,6 +37,7 @@
 
 #include "intel_chipset.h"
 #include "perf.h"
+#include "perf_tables.h"
 
 #include "i915_perf_metrics_hsw.h"
 #include "i915_perf_metrics_bdw.h"
@@ -107,6 +108,9 @@ intel_perf_logical_counter_group_free(struct intel_perf_logical_counter_group *g
 static void
 intel_perf_metric_set_free(struct intel_perf_metric_set *metric_set)
 {
+	free(metric_set->b_counter_regs);
+	free(metric_set->mux_regs);
+	free(metric_set->flex_regs);
 	free(metric_set->counters);
 	free(metric_set);
 }
@@ -209,81 +213,84 @@ intel_perf_for_devinfo(uint32_t device_id,
 	perf->devinfo.eu_threads_count = 7;
 
 	if (devinfo->is_haswell) {
-		intel_perf_load_metrics_hsw(perf);
+		perf->metrics = &intel_perf_metrics_hsw;
 	} else if (devinfo->is_broadwell) {
-		intel_perf_load_metrics_bdw(perf);
+		perf->metrics = &intel_perf_metrics_bdw;
 	} else if (devinfo->is_cherryview) {
-		intel_perf_load_metrics_chv(perf);
+		perf->metrics = &intel_perf_metrics_chv;
 	} else if (devinfo->is_skylake) {
 		switch (devinfo->gt) {
 		case 2:
-			intel_perf_load_metrics_sklgt2(perf);
+			perf->metrics = &intel_perf_metrics_sklgt2;
 			break;
 		case 3:
-			intel_perf_load_metrics_sklgt3(perf);
+			perf->metrics = &intel_perf_metrics_sklgt3;
 			break;
 		case 4:
-			intel_perf_load_metrics_sklgt4(perf);
+			perf->metrics = &intel_perf_metrics_sklgt4;
 			break;
 		default:
 			return unsupported_i915_perf_platform(perf);
 		}
 	} else if (devinfo->is_broxton) {
 		perf->devinfo.eu_threads_count = 6;
-		intel_perf_load_metrics_bxt(perf);
+		perf->metrics = &intel_perf_metrics_bxt;
 	} else if (devinfo->is_kabylake) {
 		switch (devinfo->gt) {
 		case 2:
-			intel_perf_load_metrics_kblgt2(perf);
+			perf->metrics = &intel_perf_metrics_kblgt2;
 			break;
 		case 3:
-			intel_perf_load_metrics_kblgt3(perf);
+			perf->metrics = &intel_perf_metrics_kblgt3;
 			break;
 		default:
 			return unsupported_i915_perf_platform(perf);
 		}
 	} else if (devinfo->is_geminilake) {
 		perf->devinfo.eu_threads_count = 6;
-		intel_perf_load_metrics_glk(perf);
+		perf->metrics = &intel_perf_metrics_glk;
 	} else if (devinfo->is_coffeelake || devinfo->is_cometlake) {
 		switch (devinfo->gt) {
 		case 2:
-			intel_perf_load_metrics_cflgt2(perf);
+			perf->metrics = &intel_perf_metrics_cflgt2;
 			break;
 		case 3:
-			intel_perf_load_metrics_cflgt3(perf);
+			perf->metrics = &intel_perf_metrics_cflgt3;
 			break;
 		default:
 			return unsupported_i915_perf_platform(perf);
 		}
 	} else if (devinfo->is_cannonlake) {
-		intel_perf_load_metrics_cnl(perf);
+		perf->metrics = &intel_perf_metrics_cnl;
 	} else if (devinfo->is_icelake) {
-		intel_perf_load_metrics_icl(perf);
+		perf->metrics = &intel_perf_metrics_icl;
 	} else if (devinfo->is_elkhartlake || devinfo->is_jasperlake) {
-		intel_perf_load_metrics_ehl(perf);
+		perf->metrics = &intel_perf_metrics_ehl;
 	} else if (devinfo->is_tigerlake) {
 		switch (devinfo->gt) {
 		case 1:
-			intel_perf_load_metrics_tglgt1(perf);
+			perf->metrics = &intel_perf_metrics_tglgt1;
 			break;
 		case 2:
-			intel_perf_load_metrics_tglgt2(perf);
+			perf->metrics = &intel_perf_metrics_tglgt2;
 			break;
 		default:
-			unsupported_i915_perf_platform(perf);
+			return unsupported_i915_perf_platform(perf);
 		}
 	} else if (devinfo->is_rocketlake) {
-		intel_perf_load_metrics_rkl(perf);
+		perf->metrics = &intel_perf_metrics_rkl;
 	} else if (devinfo->is_dg1) {
-		intel_perf_load_metrics_dg1(perf);
+		perf->metrics = &intel_perf_metrics_dg1;
 	} else if (devinfo->is_alderlake_s || devinfo->is_alderlake_p ||
 		   devinfo->is_raptorlake_s || devinfo->is_alderlake_n) {
-		intel_perf_load_metrics_adl(perf);
+		perf->metrics = &intel_perf_metrics_adl;
 	} else {
 		return unsupported_i915_perf_platform(perf);
 	}
 
+	perf->loaded_metric_sets = calloc(perf->metrics->n_sets,
+					  sizeof(*perf->loaded_metric_sets));
+
 	return perf;
 }
 
@@ -461,6 +468,7 @@ intel_perf_free(struct intel_perf *perf)
 		intel_perf_metric_set_free(metric_set);
 	}
 
+	free(perf->loaded_metric_sets);
 	free(perf);
 }
 
@@ -508,6 +516,144 @@ intel_perf_add_metric_set(struct intel_perf *perf,
 	igt_list_add_tail(&metric_set->link, &perf->metric_sets);
 }
 
+static struct intel_perf_metric_set *
+instantiate_metric_set(struct intel_perf *perf, uint32_t idx)
+{
+	const struct intel_perf_metrics_table *metrics = perf->metrics;
+	const struct intel_perf_metric_set_desc *desc = &metrics->sets[idx];
+	struct intel_perf_metric_set *metric_set;
+
+	if (perf->loaded_metric_sets[idx])
+		return perf->loaded_metric_sets[idx];
+
+	metric_set = calloc(1, sizeof(*metric_set));
+	metric_set->name = metrics->strings + desc->name;
+	metric_set->symbol_name = metrics->strings + desc->symbol_name;
+	metric_set->hw_config_guid = metrics->strings + desc->hw_config_guid;
+	metric_set->perf_oa_metrics_set = 0; /* determined at runtime */
+	metric_set->perf_oa_format = metrics->oa_format;
+	metric_set->perf_raw_size = 256;
+	metric_set->gpu_time_offset = 0;
+
+	if (metrics->oa_format == I915_OA_FORMAT_A45_B8_C8) {
+		metric_set->a_offset = 1;
+		metric_set->b_offset = metric_set->a_offset + 45;
+	} else {
+		metric_set->gpu_clock_offset = 1;
+		metric_set->a_offset = 2;
+		metric_set->b_offset = metric_set->a_offset + 36;
+	}
+	metric_set->c_offset = metric_set->b_offset + 8;
+	metric_set->perfcnt_offset = metric_set->c_offset + 8;
+
+	metrics->add_registers[idx](perf, metric_set);
+
+	metric_set->counters = calloc(desc->n_counters, sizeof(*metric_set->counters));
+	for (uint32_t i = 0; i < desc->n_counters; i++) {
+		const struct intel_perf_counter_desc *cdesc =
+			&metrics->counters[desc->first_counter + i];
+		const struct intel_perf_counter_funcs *funcs =
+			&metrics->funcs[cdesc->funcs];
+		struct intel_perf_logical_counter *counter;
+
+		if (cdesc->availability &&
+		    !metrics->availability[cdesc->availability](perf))
+			continue;
+
+		counter = &metric_set->counters[metric_set->n_counters++];
+		counter->metric_set = metric_set;
+		counter->name = metrics->strings + cdesc->name;
+		counter->symbol_name = metrics->strings + cdesc->symbol_name;
+		counter->desc = metrics->strings + cdesc->desc;
+		counter->storage = cdesc->storage;
+		counter->type = cdesc->type;
+		counter->unit = cdesc->unit;
+		/* Both unions alias function pointers of the same size. */
+		counter->max_uint64 = funcs->max_uint64;
+		counter->read_uint64 = funcs->read_uint64;
+
+		intel_perf_add_logical_counter(perf, counter,
+					       metrics->strings + cdesc->group);
+	}
+
+	intel_perf_add_metric_set(perf, metric_set);
+	perf->loaded_metric_sets[idx] = metric_set;
+
+	return metric_set;
+}
+
+/**
+ * intel_perf_find_metric_set:
+ * @perf: the perf context
+ * @symbol_name: symbol name of the metric set, case insensitive
+ *
+ * Looks up a metric set of the platform, instantiating it with its counters
+ * and registers on first use.
+ *
+ * Returns: the metric set or NULL if the platform has no such set.
+ */
+struct intel_perf_metric_set *
+intel_perf_find_metric_set(struct intel_perf *perf, const char *symbol_name)
+{
+	const struct intel_perf_metrics_table *metrics = perf->metrics;
+	uint32_t slot = intel_perf_metric_set_hash(symbol_name) & metrics->hash_mask;
+
+	for (; metrics->hash[slot]; slot = (slot + 1) & metrics->hash_mask) {
+		uint32_t idx = metrics->hash[slot] - 1;
+
+		if (!strcasecmp(metrics->strings + metrics->sets[idx].symbol_name,
+				symbol_name))
+			return instantiate_metric_set(perf, idx);
+	}
+
+	return NULL;
+}
+
+/**
+ * intel_perf_find_metric_set_by_guid:
+ * @perf: the perf context
+ * @hw_config_guid: hardware configuration GUID of the metric set
+ *
+ * Same as intel_perf_find_metric_set(), but matches the GUID the kernel
+ * knows the configuration by.
+ *
+ * Returns: the metric set or NULL if the platform has no such set.
+ */
+struct intel_perf_metric_set *
+intel_perf_find_metric_set_by_guid(struct intel_perf *perf,
+				   const char *hw_config_guid)
+{
+	const struct intel_perf_metrics_table *metrics = perf->metrics;
+
+	for (uint32_t i = 0; i < metrics->n_sets; i++) {
+		if (!strcmp(metrics->strings + metrics->sets[i].hw_config_guid,
+			    hw_config_guid))
+			return instantiate_metric_set(perf, i);
+	}
+
+	return NULL;
+}
+
+/**
+ * intel_perf_load_metric_sets:
+ * @perf: the perf context
+ *
+ * Instantiates all the metric sets of the platform, for users which want to
+ * go through all of them in @perf->metric_sets. The list is left in the
+ * order of the metric set descriptions, whatever was looked up before.
+ */
+void
+intel_perf_load_metric_sets(struct intel_perf *perf)
+{
+	for (uint32_t i = 0; i < perf->metrics->n_sets; i++) {
+		struct intel_perf_metric_set *metric_set =
+			instantiate_metric_set(perf, i);
+
+		igt_list_del(&metric_set->link);
+		igt_list_add_tail(&metric_set->link, &perf->metric_sets);
+	}
+}
+
 static void
 load_metric_set_config(struct intel_perf_metric_set *metric_set, int drm_fd)
 {
@@ -532,6 +678,10 @@ load_metric_set_config(struct intel_perf_metric_set *metric_set, int drm_fd)
 		metric_set->perf_oa_metrics_set = ret;
 }
 
+/*
+ * Only the metric sets instantiated so far get their configuration id, so
+ * this has to come after looking up the metric sets of interest.
+ */
 void
 intel_perf_load_perf_configs(struct intel_perf *perf, int drm_fd)
 {
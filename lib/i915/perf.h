@@ -204,14 +204,25 @@ struct intel_perf_logical_counter_group {
 	struct igt_list_head link;  /* link for intel_perf_logical_counter_group.groups */
 };
 
+struct intel_perf_metrics_table;
+
 struct intel_perf {
 	const char *name;
 
 	struct intel_perf_logical_counter_group *root_group;
 
+	/*
+	 * Metric sets are instantiated lazily, this list only holds the ones
+	 * looked up so far (see intel_perf_find_metric_set() and
+	 * intel_perf_load_metric_sets()).
+	 */
 	struct igt_list_head metric_sets;
 
 	struct intel_perf_devinfo devinfo;
+
+	/* Generated description of all the metric sets of the platform */
+	const struct intel_perf_metrics_table *metrics;
+	struct intel_perf_metric_set **loaded_metric_sets;
 };
 
 struct drm_i915_perf_record_header;
@@ -233,6 +244,13 @@ void intel_perf_add_logical_counter(struct intel_perf *perf,
 void intel_perf_add_metric_set(struct intel_perf *perf,
 			       struct intel_perf_metric_set *metric_set);
 
+struct intel_perf_metric_set *
+intel_perf_find_metric_set(struct intel_perf *perf, const char *symbol_name);
+struct intel_perf_metric_set *
+intel_perf_find_metric_set_by_guid(struct intel_perf *perf,
+				   const char *hw_config_guid);
+void intel_perf_load_metric_sets(struct intel_perf *perf);
+
 void intel_perf_load_perf_configs(struct intel_perf *perf, int drm_fd);
 
 void intel_perf_accumulate_reports(struct intel_perf_accumulator *acc,
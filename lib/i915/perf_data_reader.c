@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,8 +38,47 @@
 #include "perf_data_reader.h"
 
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
+/* Number of samples between two entries of the lazy index. */
+#define INDEX_STRIDE 256
+
+struct intel_perf_data_index_entry {
+	/* Offset of a sample record in the file */
+	uint64_t offset;
+	/* Timestamp of the sample, extended to 64bits */
+	uint64_t gpu_ts;
+};
+
+struct intel_perf_data_index {
+	pthread_t thread;
+	const uint8_t *mmap_data;
+	size_t mmap_size;
+
+	/* Everything below is protected by lock */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	struct intel_perf_data_index_entry *entries;
+	uint32_t n_entries;
+	uint32_t n_allocated_entries;
+
+	const struct intel_perf_record_timestamp_correlation **correlations;
+	/* Timestamp of the last sample preceding each correlation */
+	uint64_t *correlations_gpu_ts;
+	uint32_t n_correlations;
+	uint32_t n_allocated_correlations;
+
+	/* Timestamp of the last sample indexed */
+	uint64_t last_gpu_ts;
+	/* Timestamp of the last sample preceding a correlation record */
+	uint64_t last_correlated_gpu_ts;
+
+	bool done;
+	bool stop;
+};
+
 static inline bool
 oa_report_ctx_is_valid(const struct intel_perf_devinfo *devinfo,
 		       const uint8_t *_report)
@@ -104,24 +144,64 @@ append_timestamp_correlation(struct intel_perf_data_reader *reader,
 	reader->correlations[reader->n_correlations++] = corr;
 }
 
-static struct intel_perf_metric_set *
-find_metric_set(struct intel_perf *perf, const char *symbol_name)
+static bool
+check_version(struct intel_perf_data_reader *reader,
+	      const struct drm_i915_perf_record_header *header)
 {
-	struct intel_perf_metric_set *metric_set;
+	const struct intel_perf_record_version *version =
+		(const struct intel_perf_record_version *) (header + 1);
 
-	igt_list_for_each_entry(metric_set, &perf->metric_sets, link) {
-		if (!strcmp(symbol_name, metric_set->symbol_name))
-			return metric_set;
+	if (version->version != INTEL_PERF_RECORD_VERSION) {
+		snprintf(reader->error_msg, sizeof(reader->error_msg),
+			 "Unsupported recording version (%u, expected %u)",
+			 version->version, INTEL_PERF_RECORD_VERSION);
+		return false;
 	}
 
-	return NULL;
+	return true;
 }
 
 static bool
-parse_data(struct intel_perf_data_reader *reader)
+load_device(struct intel_perf_data_reader *reader)
 {
 	const struct intel_perf_record_device_info *record_info;
 	const struct intel_perf_record_device_topology *record_topology;
+
+	if (!reader->record_info ||
+	    !reader->record_topology) {
+		snprintf(reader->error_msg, sizeof(reader->error_msg),
+			 "Invalid file, missing device or topology info");
+		return false;
+	}
+
+	record_info = reader->record_info;
+	record_topology = reader->record_topology;
+
+	reader->perf = intel_perf_for_devinfo(record_info->device_id,
+					      record_info->device_revision,
+					      record_info->timestamp_frequency,
+					      record_info->gt_min_frequency,
+					      record_info->gt_max_frequency,
+					      &record_topology->topology);
+	if (!reader->perf) {
+		snprintf(reader->error_msg, sizeof(reader->error_msg),
+			 "Recording occured on unsupported device (0x%x)",
+			 record_info->device_id);
+		return false;
+	}
+
+	reader->devinfo = reader->perf->devinfo;
+
+	reader->metric_set_name = record_info->metric_set_name;
+	reader->metric_set_uuid = record_info->metric_set_uuid;
+	reader->metric_set = intel_perf_find_metric_set(reader->perf, record_info->metric_set_name);
+
+	return true;
+}
+
+static bool
+parse_data(struct intel_perf_data_reader *reader)
+{
 	const uint8_t *end = reader->mmap_data + reader->mmap_size;
 	const uint8_t *iter = reader->mmap_data;
 
@@ -139,17 +219,10 @@ parse_data(struct intel_perf_data_reader *reader)
 			assert(header->size == sizeof(*header));
 			break;
 
-		case INTEL_PERF_RECORD_TYPE_VERSION: {
-			struct intel_perf_record_version *version =
-				(struct intel_perf_record_version*) (header + 1);
-			if (version->version != INTEL_PERF_RECORD_VERSION) {
-				snprintf(reader->error_msg, sizeof(reader->error_msg),
-					 "Unsupported recording version (%u, expected %u)",
-					 version->version, INTEL_PERF_RECORD_VERSION);
+		case INTEL_PERF_RECORD_TYPE_VERSION:
+			if (!check_version(reader, header))
 				return false;
-			}
 			break;
-		}
 
 		case INTEL_PERF_RECORD_TYPE_DEVICE_INFO: {
 			reader->record_info = header + 1;
@@ -173,36 +246,7 @@ parse_data(struct intel_perf_data_reader *reader)
 		iter += header->size;
 	}
 
-	if (!reader->record_info ||
-	    !reader->record_topology) {
-		snprintf(reader->error_msg, sizeof(reader->error_msg),
-			 "Invalid file, missing device or topology info");
-		return false;
-	}
-
-	record_info = reader->record_info;
-	record_topology = reader->record_topology;
-
-	reader->perf = intel_perf_for_devinfo(record_info->device_id,
-					      record_info->device_revision,
-					      record_info->timestamp_frequency,
-					      record_info->gt_min_frequency,
-					      record_info->gt_max_frequency,
-					      &record_topology->topology);
-	if (!reader->perf) {
-		snprintf(reader->error_msg, sizeof(reader->error_msg),
-			 "Recording occured on unsupported device (0x%x)",
-			 record_info->device_id);
-		return false;
-	}
-
-	reader->devinfo = reader->perf->devinfo;
-
-	reader->metric_set_name = record_info->metric_set_name;
-	reader->metric_set_uuid = record_info->metric_set_uuid;
-	reader->metric_set = find_metric_set(reader->perf, record_info->metric_set_name);
-
-	return true;
+	return load_device(reader);
 }
 
 static uint64_t
@@ -334,9 +378,8 @@ compute_correlation_chunks(struct intel_perf_data_reader *reader)
 	}
 }
 
-bool
-intel_perf_data_reader_init(struct intel_perf_data_reader *reader,
-			    int perf_file_fd)
+static bool
+map_file(struct intel_perf_data_reader *reader, int perf_file_fd)
 {
         struct stat st;
         if (fstat(perf_file_fd, &st) != 0) {
@@ -357,6 +400,16 @@ intel_perf_data_reader_init(struct intel_perf_data_reader *reader,
 		return false;
 	}
 
+	return true;
+}
+
+bool
+intel_perf_data_reader_init(struct intel_perf_data_reader *reader,
+			    int perf_file_fd)
+{
+	if (!map_file(reader, perf_file_fd))
+		return false;
+
 	if (!parse_data(reader))
 		return false;
 
@@ -366,9 +419,363 @@ intel_perf_data_reader_init(struct intel_perf_data_reader *reader,
 	return true;
 }
 
+/* OA reports only have the lower 32bits of the timestamp, assume samples
+ * are less than a wrap apart.
+ */
+static uint64_t
+extend_timestamp(uint64_t last_gpu_ts, uint32_t gpu_ts)
+{
+	uint64_t ts = (last_gpu_ts & ~0xffffffffull) | gpu_ts;
+
+	if (ts < last_gpu_ts)
+		ts += 1ull << 32;
+
+	return ts;
+}
+
+static uint64_t
+ticks_to_ns(const struct intel_perf_devinfo *devinfo, uint64_t ticks)
+{
+	uint64_t freq = devinfo->timestamp_frequency;
+
+	return ticks / freq * 1000000000ull + (ticks % freq) * 1000000000ull / freq;
+}
+
+static uint64_t
+ns_to_ticks(const struct intel_perf_devinfo *devinfo, uint64_t ns)
+{
+	uint64_t freq = devinfo->timestamp_frequency;
+
+	return ns / 1000000000ull * freq + (ns % 1000000000ull) * freq / 1000000000ull;
+}
+
+static void *
+index_thread(void *data)
+{
+	struct intel_perf_data_index *index = data;
+	const uint8_t *iter = index->mmap_data;
+	const uint8_t *end = index->mmap_data + index->mmap_size;
+	uint64_t gpu_ts = 0;
+	uint32_t n_samples = 0;
+	bool stop = false;
+
+	madvise((void *) index->mmap_data, index->mmap_size, MADV_SEQUENTIAL);
+
+	while (iter < end && !stop) {
+		const struct drm_i915_perf_record_header *header =
+			(const struct drm_i915_perf_record_header *) iter;
+
+		if (header->size < sizeof(*header))
+			break;
+
+		switch (header->type) {
+		case DRM_I915_PERF_RECORD_SAMPLE:
+			gpu_ts = extend_timestamp(gpu_ts,
+						  oa_report_timestamp((const uint8_t *) (header + 1)));
+			if (n_samples++ % INDEX_STRIDE)
+				break;
+
+			pthread_mutex_lock(&index->lock);
+			if (index->n_entries >= index->n_allocated_entries) {
+				index->n_allocated_entries = MAX(100, 2 * index->n_allocated_entries);
+				index->entries = realloc(index->entries,
+							 index->n_allocated_entries *
+							 sizeof(*index->entries));
+				assert(index->entries);
+			}
+			index->entries[index->n_entries].offset = iter - index->mmap_data;
+			index->entries[index->n_entries].gpu_ts = gpu_ts;
+			index->n_entries++;
+			index->last_gpu_ts = gpu_ts;
+			stop = index->stop;
+			pthread_cond_broadcast(&index->cond);
+			pthread_mutex_unlock(&index->lock);
+			break;
+
+		case INTEL_PERF_RECORD_TYPE_TIMESTAMP_CORRELATION:
+			pthread_mutex_lock(&index->lock);
+			if (index->n_correlations >= index->n_allocated_correlations) {
+				index->n_allocated_correlations = MAX(100, 2 * index->n_allocated_correlations);
+				index->correlations = realloc((void *) index->correlations,
+							      index->n_allocated_correlations *
+							      sizeof(*index->correlations));
+				index->correlations_gpu_ts = realloc(index->correlations_gpu_ts,
+								     index->n_allocated_correlations *
+								     sizeof(*index->correlations_gpu_ts));
+				assert(index->correlations && index->correlations_gpu_ts);
+			}
+			index->correlations[index->n_correlations] =
+				(const struct intel_perf_record_timestamp_correlation *) (header + 1);
+			index->correlations_gpu_ts[index->n_correlations] = gpu_ts;
+			index->n_correlations++;
+			index->last_gpu_ts = index->last_correlated_gpu_ts = gpu_ts;
+			pthread_cond_broadcast(&index->cond);
+			pthread_mutex_unlock(&index->lock);
+			break;
+		}
+
+		iter += header->size;
+	}
+
+	pthread_mutex_lock(&index->lock);
+	index->last_gpu_ts = gpu_ts;
+	index->done = true;
+	pthread_cond_broadcast(&index->cond);
+	pthread_mutex_unlock(&index->lock);
+
+	return NULL;
+}
+
+static bool
+parse_headers(struct intel_perf_data_reader *reader)
+{
+	const uint8_t *end = reader->mmap_data + reader->mmap_size;
+	const uint8_t *iter = reader->mmap_data;
+
+	while (iter < end && (!reader->record_info || !reader->record_topology)) {
+		const struct drm_i915_perf_record_header *header =
+			(const struct drm_i915_perf_record_header *) iter;
+
+		if (header->size < sizeof(*header))
+			break;
+
+		switch (header->type) {
+		case INTEL_PERF_RECORD_TYPE_VERSION:
+			if (!check_version(reader, header))
+				return false;
+			break;
+
+		case INTEL_PERF_RECORD_TYPE_DEVICE_INFO:
+			reader->record_info = header + 1;
+			break;
+
+		case INTEL_PERF_RECORD_TYPE_DEVICE_TOPOLOGY:
+			reader->record_topology = header + 1;
+			break;
+		}
+
+		iter += header->size;
+	}
+
+	return load_device(reader);
+}
+
+/**
+ * intel_perf_data_reader_open:
+ * @reader: the reader to initialize
+ * @perf_file_fd: file descriptor of the recording
+ *
+ * Only parses the device description of the recording, the rest of the
+ * file being indexed by a background thread. Records & timelines are
+ * empty until intel_perf_data_reader_load_window() is called.
+ *
+ * Returns: false on error, with @reader->error_msg set.
+ */
+bool
+intel_perf_data_reader_open(struct intel_perf_data_reader *reader,
+			    int perf_file_fd)
+{
+	struct intel_perf_data_index *index;
+	int ret;
+
+	if (!map_file(reader, perf_file_fd))
+		return false;
+
+	if (!parse_headers(reader))
+		return false;
+
+	index = calloc(1, sizeof(*index));
+	index->mmap_data = reader->mmap_data;
+	index->mmap_size = reader->mmap_size;
+	pthread_mutex_init(&index->lock, NULL);
+	pthread_cond_init(&index->cond, NULL);
+	ret = pthread_create(&index->thread, NULL, index_thread, index);
+	if (ret) {
+		snprintf(reader->error_msg, sizeof(reader->error_msg),
+			 "Unable to start indexing (%s)", strerror(ret));
+		free(index);
+		return false;
+	}
+
+	reader->index = index;
+
+	return true;
+}
+
+/**
+ * intel_perf_data_reader_load_window:
+ * @reader: a reader initialized with intel_perf_data_reader_open()
+ * @start_ns: start of the window, relative to the first sample
+ * @end_ns: end of the window, relative to the first sample
+ *
+ * Replaces the records & timelines of @reader with the samples of the
+ * recording between @start_ns and @end_ns, waiting for the index to cover
+ * that window if needed.
+ *
+ * Returns: false if @reader wasn't opened lazily.
+ */
+bool
+intel_perf_data_reader_load_window(struct intel_perf_data_reader *reader,
+				   uint64_t start_ns, uint64_t end_ns)
+{
+	struct intel_perf_data_index *index = reader->index;
+	const uint8_t *iter, *end = reader->mmap_data + reader->mmap_size;
+	uint64_t start_ts, end_ts, gpu_ts, prefetch_end = 0;
+	uint32_t lo, hi;
+
+	if (!index)
+		return false;
+
+	reader->n_records = 0;
+	reader->n_timelines = 0;
+	reader->n_correlation_chunks = 0;
+
+	pthread_mutex_lock(&index->lock);
+
+	while (!index->done && !index->n_entries)
+		pthread_cond_wait(&index->cond, &index->lock);
+	if (!index->n_entries) {
+		pthread_mutex_unlock(&index->lock);
+		return true;
+	}
+
+	start_ts = index->entries[0].gpu_ts + ns_to_ticks(&reader->devinfo, start_ns);
+	end_ts = index->entries[0].gpu_ts + ns_to_ticks(&reader->devinfo, end_ns);
+
+	/* Timelines need correlation points on both sides of the window. */
+	while (!index->done && index->last_correlated_gpu_ts < end_ts)
+		pthread_cond_wait(&index->cond, &index->lock);
+
+	/*
+	 * Only keep the correlation points around the window, with one more
+	 * on each side, which also keeps the number of 32bit timestamp
+	 * wraps to deal with in correlate_gpu_timestamp() low.
+	 */
+	reader->n_correlations = 0;
+	if (index->n_correlations) {
+		uint32_t first = 0, last = index->n_correlations - 1;
+
+		for (uint32_t i = 0; i < index->n_correlations; i++) {
+			if (index->correlations_gpu_ts[i] <= start_ts)
+				first = i;
+		}
+		for (uint32_t i = index->n_correlations; i-- > first;) {
+			if (index->correlations_gpu_ts[i] >= end_ts)
+				last = i;
+		}
+		first = first > 0 ? first - 1 : 0;
+		last = MIN(last + 1, index->n_correlations - 1);
+
+		for (uint32_t i = first; i <= last; i++)
+			append_timestamp_correlation(reader, index->correlations[i]);
+	}
+
+	/* Last entry at or before the start of the window. */
+	lo = 0;
+	hi = index->n_entries;
+	while (hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (index->entries[mid].gpu_ts <= start_ts)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	iter = reader->mmap_data + index->entries[lo].offset;
+	gpu_ts = index->entries[lo].gpu_ts;
+
+	for (hi = lo; hi < index->n_entries; hi++) {
+		if (index->entries[hi].gpu_ts > end_ts) {
+			prefetch_end = index->entries[hi].offset;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&index->lock);
+
+	if (prefetch_end) {
+		uintptr_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+		uintptr_t start = (uintptr_t) iter & ~page_mask;
+
+		madvise((void *) start,
+			(uintptr_t) reader->mmap_data + prefetch_end - start,
+			MADV_WILLNEED);
+	}
+
+	while (iter < end) {
+		const struct drm_i915_perf_record_header *header =
+			(const struct drm_i915_perf_record_header *) iter;
+
+		if (header->size < sizeof(*header))
+			break;
+
+		if (header->type == DRM_I915_PERF_RECORD_SAMPLE) {
+			gpu_ts = extend_timestamp(gpu_ts,
+						  oa_report_timestamp((const uint8_t *) (header + 1)));
+			if (gpu_ts > end_ts)
+				break;
+			if (gpu_ts >= start_ts)
+				append_record(reader, header);
+		}
+
+		iter += header->size;
+	}
+
+	if (reader->n_correlations)
+		compute_correlation_chunks(reader);
+	if (reader->n_records)
+		generate_cpu_events(reader);
+
+	return true;
+}
+
+/**
+ * intel_perf_data_reader_duration:
+ * @reader: a reader initialized with intel_perf_data_reader_open()
+ *
+ * Returns: the time between the first and last samples of the recording
+ * in nanoseconds, waiting for the whole file to be indexed.
+ */
+uint64_t
+intel_perf_data_reader_duration(struct intel_perf_data_reader *reader)
+{
+	struct intel_perf_data_index *index = reader->index;
+	uint64_t duration = 0;
+
+	if (!index)
+		return 0;
+
+	pthread_mutex_lock(&index->lock);
+	while (!index->done)
+		pthread_cond_wait(&index->cond, &index->lock);
+	if (index->n_entries)
+		duration = ticks_to_ns(&reader->devinfo,
+				       index->last_gpu_ts - index->entries[0].gpu_ts);
+	pthread_mutex_unlock(&index->lock);
+
+	return duration;
+}
+
 void
 intel_perf_data_reader_fini(struct intel_perf_data_reader *reader)
 {
+	struct intel_perf_data_index *index = reader->index;
+
+	if (index) {
+		pthread_mutex_lock(&index->lock);
+		index->stop = true;
+		pthread_mutex_unlock(&index->lock);
+		pthread_join(index->thread, NULL);
+
+		pthread_cond_destroy(&index->cond);
+		pthread_mutex_destroy(&index->lock);
+		free(index->entries);
+		free((void *) index->correlations);
+		free(index->correlations_gpu_ts);
+		free(index);
+	}
+
 	intel_perf_free(reader->perf);
 	free(reader->records);
 	free(reader->timelines);
@@ -53,6 +53,8 @@ struct intel_perf_timeline_item {
 	void *user_data;
 };
 
+struct intel_perf_data_index;
+
 struct intel_perf_data_reader {
 	/* Array of pointers into the mmapped i915 perf file. */
 	const struct drm_i915_perf_record_header **records;
@@ -92,10 +94,26 @@ struct intel_perf_data_reader {
 
 	const uint8_t *mmap_data;
 	size_t mmap_size;
+
+	/* Sparse index of the recording, only with
+	 * intel_perf_data_reader_open().
+	 */
+	struct intel_perf_data_index *index;
 };
 
 bool intel_perf_data_reader_init(struct intel_perf_data_reader *reader,
 				 int perf_file_fd);
+
+/* Lazy variant of intel_perf_data_reader_init(), records & timelines are
+ * only filled for the window asked with
+ * intel_perf_data_reader_load_window().
+ */
+bool intel_perf_data_reader_open(struct intel_perf_data_reader *reader,
+				 int perf_file_fd);
+bool intel_perf_data_reader_load_window(struct intel_perf_data_reader *reader,
+					uint64_t start_ns, uint64_t end_ns);
+uint64_t intel_perf_data_reader_duration(struct intel_perf_data_reader *reader);
+
 void intel_perf_data_reader_fini(struct intel_perf_data_reader *reader);
 
 #ifdef __cplusplus
@@ -0,0 +1,737 @@
+/*
+ * Copyright (C) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "perf.h"
+#include "perf_eval.h"
+#include "perf_tables.h"
+
+/*
+ * The equations of the XML files are compiled into a list of instructions
+ * working on registers, each register holding the values of EVAL_BLOCK
+ * accumulations. Registers are either constants (device variables and
+ * literals, folded as much as possible), raw counter deltas gathered from
+ * the accumulators, or the results of instructions.
+ *
+ * The typing follows the C code of perf-equations-codegen.py exactly: U*
+ * operations are computed on uint64_t unless one of their operands is a
+ * double, F* operations store their result in a double, etc... so that the
+ * program gives the same values as the read callbacks.
+ */
+
+#define EVAL_BLOCK 64
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
+
+enum eval_opcode {
+	EVAL_U2F,
+	EVAL_F2U,
+	EVAL_UADD,
+	EVAL_USUB,
+	EVAL_UMUL,
+	EVAL_UDIV,
+	EVAL_UMIN,
+	EVAL_SHL,
+	EVAL_SHR,
+	EVAL_AND,
+	EVAL_FADD,
+	EVAL_FSUB,
+	EVAL_FMUL,
+	EVAL_FDIV,
+	EVAL_FMAX,
+	EVAL_FMIN,
+};
+
+struct eval_insn {
+	uint8_t opcode;
+	uint16_t dst;
+	uint16_t src0;
+	uint16_t src1;
+};
+
+struct eval_const {
+	uint16_t reg;
+	union intel_perf_eval_value value;
+};
+
+struct eval_load {
+	uint16_t reg;
+	uint16_t delta;
+};
+
+struct intel_perf_eval_program {
+	uint32_t n_regs;
+
+	struct eval_const *consts;
+	uint32_t n_consts;
+
+	struct eval_load *loads;
+	uint32_t n_loads;
+
+	struct eval_insn *insns;
+	uint32_t n_insns;
+
+	uint16_t *outputs;
+	uint32_t n_outputs;
+};
+
+enum eval_reg_kind {
+	EVAL_REG_CONST,
+	EVAL_REG_LOAD,
+	EVAL_REG_TEMP,
+	EVAL_REG_RESULT,
+};
+
+struct eval_operand {
+	/* -1 for a constant not loaded into a register yet */
+	int32_t reg;
+	bool is_float;
+	union intel_perf_eval_value value;
+};
+
+struct eval_compiler {
+	const struct intel_perf *perf;
+	const struct intel_perf_metric_set *metric_set;
+	const struct intel_perf_metrics_table *metrics;
+	const struct intel_perf_metric_set_desc *set_desc;
+
+	struct intel_perf_eval_program *program;
+	uint32_t n_allocated_consts;
+	uint32_t n_allocated_loads;
+	uint32_t n_allocated_insns;
+
+	uint8_t *reg_kinds;
+	uint32_t n_allocated_regs;
+	uint16_t *free_regs;
+	uint32_t n_free_regs;
+	uint32_t n_allocated_free_regs;
+
+	int32_t delta_regs[INTEL_PERF_MAX_RAW_OA_COUNTERS];
+
+	/* Indexed like set_desc's counters */
+	struct eval_operand *results;
+	uint8_t *states;
+
+	bool error;
+};
+
+enum {
+	EVAL_COUNTER_NEW,
+	EVAL_COUNTER_COMPILING,
+	EVAL_COUNTER_DONE,
+};
+
+static void
+grow(void *ptr, uint32_t *n_allocated, uint32_t needed, size_t size)
+{
+	void **array = ptr;
+
+	if (needed <= *n_allocated)
+		return;
+
+	*n_allocated = *n_allocated ? *n_allocated * 2 : 16;
+	if (*n_allocated < needed)
+		*n_allocated = needed;
+	*array = realloc(*array, *n_allocated * size);
+}
+
+static void
+execute(uint8_t opcode,
+	union intel_perf_eval_value *d,
+	const union intel_perf_eval_value *a,
+	const union intel_perf_eval_value *b,
+	uint32_t n)
+{
+#define EVAL_LOOP(expr) for (uint32_t i = 0; i < n; i++) { expr; } break
+
+	switch (opcode) {
+	case EVAL_U2F:  EVAL_LOOP(d[i].f = a[i].u64);
+	case EVAL_F2U:  EVAL_LOOP(d[i].u64 = a[i].f);
+	case EVAL_UADD: EVAL_LOOP(d[i].u64 = a[i].u64 + b[i].u64);
+	case EVAL_USUB: EVAL_LOOP(d[i].u64 = a[i].u64 - b[i].u64);
+	case EVAL_UMUL: EVAL_LOOP(d[i].u64 = a[i].u64 * b[i].u64);
+	case EVAL_UDIV: EVAL_LOOP(d[i].u64 = b[i].u64 ? a[i].u64 / b[i].u64 : 0);
+	case EVAL_UMIN: EVAL_LOOP(d[i].u64 = a[i].u64 < b[i].u64 ? a[i].u64 : b[i].u64);
+	case EVAL_SHL:  EVAL_LOOP(d[i].u64 = a[i].u64 << b[i].u64);
+	case EVAL_SHR:  EVAL_LOOP(d[i].u64 = a[i].u64 >> b[i].u64);
+	case EVAL_AND:  EVAL_LOOP(d[i].u64 = a[i].u64 & b[i].u64);
+	case EVAL_FADD: EVAL_LOOP(d[i].f = a[i].f + b[i].f);
+	case EVAL_FSUB: EVAL_LOOP(d[i].f = a[i].f - b[i].f);
+	case EVAL_FMUL: EVAL_LOOP(d[i].f = a[i].f * b[i].f);
+	case EVAL_FDIV: EVAL_LOOP(d[i].f = b[i].f ? a[i].f / b[i].f : 0);
+	case EVAL_FMAX: EVAL_LOOP(d[i].f = a[i].f > b[i].f ? a[i].f : b[i].f);
+	case EVAL_FMIN: EVAL_LOOP(d[i].f = a[i].f < b[i].f ? a[i].f : b[i].f);
+	}
+
+#undef EVAL_LOOP
+}
+
+static int32_t
+alloc_reg(struct eval_compiler *c, enum eval_reg_kind kind)
+{
+	struct intel_perf_eval_program *program = c->program;
+	int32_t reg;
+
+	if (kind == EVAL_REG_TEMP && c->n_free_regs) {
+		reg = c->free_regs[--c->n_free_regs];
+		c->reg_kinds[reg] = kind;
+		return reg;
+	}
+
+	if (program->n_regs > UINT16_MAX) {
+		c->error = true;
+		return 0;
+	}
+
+	reg = program->n_regs++;
+	grow(&c->reg_kinds, &c->n_allocated_regs, program->n_regs,
+	     sizeof(*c->reg_kinds));
+	c->reg_kinds[reg] = kind;
+
+	return reg;
+}
+
+static void
+release(struct eval_compiler *c, const struct eval_operand *op)
+{
+	if (op->reg < 0 || c->reg_kinds[op->reg] != EVAL_REG_TEMP)
+		return;
+
+	grow(&c->free_regs, &c->n_allocated_free_regs, c->n_free_regs + 1,
+	     sizeof(*c->free_regs));
+	c->free_regs[c->n_free_regs++] = op->reg;
+}
+
+static void
+materialize(struct eval_compiler *c, struct eval_operand *op)
+{
+	struct intel_perf_eval_program *program = c->program;
+	struct eval_const *cst;
+
+	if (op->reg >= 0)
+		return;
+
+	for (uint32_t i = 0; i < program->n_consts; i++) {
+		if (program->consts[i].value.u64 == op->value.u64) {
+			op->reg = program->consts[i].reg;
+			return;
+		}
+	}
+
+	grow(&program->consts, &c->n_allocated_consts, program->n_consts + 1,
+	     sizeof(*program->consts));
+	cst = &program->consts[program->n_consts++];
+	cst->reg = op->reg = alloc_reg(c, EVAL_REG_CONST);
+	cst->value = op->value;
+}
+
+/* @b is NULL for unary operations. */
+static struct eval_operand
+emit(struct eval_compiler *c, uint8_t opcode, bool is_float,
+     struct eval_operand a, struct eval_operand *b)
+{
+	struct intel_perf_eval_program *program = c->program;
+	struct eval_operand dst = { .reg = -1, .is_float = is_float };
+	struct eval_insn *insn;
+
+	if (!b)
+		b = &a;
+
+	/* Fold operations on constants at compile time. */
+	if (a.reg < 0 && b->reg < 0) {
+		execute(opcode, &dst.value, &a.value, &b->value, 1);
+		return dst;
+	}
+
+	materialize(c, &a);
+	materialize(c, b);
+	release(c, &a);
+	if (b != &a)
+		release(c, b);
+	dst.reg = alloc_reg(c, EVAL_REG_TEMP);
+
+	grow(&program->insns, &c->n_allocated_insns, program->n_insns + 1,
+	     sizeof(*program->insns));
+	insn = &program->insns[program->n_insns++];
+	insn->opcode = opcode;
+	insn->dst = dst.reg;
+	insn->src0 = a.reg;
+	insn->src1 = b->reg;
+
+	return dst;
+}
+
+static struct eval_operand
+convert(struct eval_compiler *c, struct eval_operand op, bool to_float)
+{
+	if (op.is_float == to_float)
+		return op;
+
+	return emit(c, to_float ? EVAL_U2F : EVAL_F2U, to_float, op, NULL);
+}
+
+enum eval_typing {
+	/* double tmp = a OP b; */
+	EVAL_TO_FLOAT,
+	/* double tmp0 = a, tmp1 = b; tmp0 OP tmp1; */
+	EVAL_FLOAT,
+	/* uint64_t tmp = a OP b; */
+	EVAL_TO_UINT,
+	/* uint64_t tmp0 = a, tmp1 = b; tmp0 OP tmp1; */
+	EVAL_UINT,
+};
+
+static const struct {
+	const char *name;
+	uint8_t uint_opcode;
+	uint8_t float_opcode;
+	enum eval_typing typing;
+} eval_ops[] = {
+	{ "FADD", EVAL_UADD, EVAL_FADD, EVAL_TO_FLOAT },
+	{ "FSUB", EVAL_USUB, EVAL_FSUB, EVAL_TO_FLOAT },
+	{ "FMUL", EVAL_UMUL, EVAL_FMUL, EVAL_TO_FLOAT },
+	{ "FDIV", 0, EVAL_FDIV, EVAL_FLOAT },
+	{ "FMAX", 0, EVAL_FMAX, EVAL_FLOAT },
+	{ "UADD", EVAL_UADD, EVAL_FADD, EVAL_TO_UINT },
+	{ "USUB", EVAL_USUB, EVAL_FSUB, EVAL_TO_UINT },
+	{ "UMUL", EVAL_UMUL, EVAL_FMUL, EVAL_TO_UINT },
+	{ "UMIN", EVAL_UMIN, EVAL_FMIN, EVAL_TO_UINT },
+	{ "UDIV", EVAL_UDIV, 0, EVAL_UINT },
+	{ "<<", EVAL_SHL, 0, EVAL_UINT },
+	{ ">>", EVAL_SHR, 0, EVAL_UINT },
+	{ "AND", EVAL_AND, 0, EVAL_UINT },
+};
+
+static struct eval_operand
+compile_op(struct eval_compiler *c, int op,
+	   struct eval_operand a, struct eval_operand b)
+{
+	bool uint_operands = !a.is_float && !b.is_float;
+
+	switch (eval_ops[op].typing) {
+	case EVAL_TO_FLOAT:
+		if (uint_operands)
+			return convert(c, emit(c, eval_ops[op].uint_opcode, false, a, &b), true);
+		/* fallthrough */
+	case EVAL_FLOAT:
+		a = convert(c, a, true);
+		b = convert(c, b, true);
+		return emit(c, eval_ops[op].float_opcode, true, a, &b);
+	case EVAL_TO_UINT:
+		if (!uint_operands) {
+			a = convert(c, a, true);
+			b = convert(c, b, true);
+			return convert(c, emit(c, eval_ops[op].float_opcode, true, a, &b), false);
+		}
+		/* fallthrough */
+	case EVAL_UINT:
+		a = convert(c, a, false);
+		b = convert(c, b, false);
+		return emit(c, eval_ops[op].uint_opcode, false, a, &b);
+	}
+
+	return a;
+}
+
+static struct eval_operand
+const_uint(uint64_t value)
+{
+	return (struct eval_operand) { .reg = -1, .value.u64 = value };
+}
+
+static bool
+hw_variable(const struct intel_perf *perf, const char *name, uint64_t *value)
+{
+	static const struct {
+		const char *name;
+		size_t offset;
+	} vars[] = {
+#define VAR(n, f) { n, offsetof(struct intel_perf_devinfo, f) }
+		VAR("$EuCoresTotalCount", n_eus),
+		VAR("$EuSlicesTotalCount", n_eu_slices),
+		VAR("$EuSubslicesTotalCount", n_eu_sub_slices),
+		VAR("$EuThreadsCount", eu_threads_count),
+		VAR("$SliceMask", slice_mask),
+		VAR("$DualSubsliceMask", subslice_mask),
+		VAR("$SubsliceMask", subslice_mask),
+		VAR("$GpuTimestampFrequency", timestamp_frequency),
+		VAR("$GpuMinFrequency", gt_min_freq),
+		VAR("$GpuMaxFrequency", gt_max_freq),
+#undef VAR
+	};
+
+	for (uint32_t i = 0; i < ARRAY_SIZE(vars); i++) {
+		if (!strcmp(name, vars[i].name)) {
+			*value = *(const uint64_t *)((const char *)&perf->devinfo +
+						     vars[i].offset);
+			return true;
+		}
+	}
+
+	if (!strcmp(name, "$SkuRevisionId")) {
+		*value = perf->devinfo.revision;
+		return true;
+	}
+	if (!strcmp(name, "$QueryMode")) {
+		*value = perf->devinfo.query_mode;
+		return true;
+	}
+
+	return false;
+}
+
+/* Raw counters evaluate to their offset into the accumulator for READ. */
+static bool
+raw_counter(const struct intel_perf_metric_set *metric_set,
+	    const char *name, uint64_t *value)
+{
+	if (!strcmp(name, "A"))
+		*value = metric_set->a_offset;
+	else if (!strcmp(name, "B"))
+		*value = metric_set->b_offset;
+	else if (!strcmp(name, "C"))
+		*value = metric_set->c_offset;
+	else if (!strcmp(name, "GPU_TIME"))
+		*value = metric_set->gpu_time_offset;
+	else if (!strcmp(name, "GPU_CLOCK"))
+		*value = metric_set->gpu_clock_offset;
+	else if (!strcmp(name, "PERFCNT"))
+		*value = metric_set->perfcnt_offset;
+	else
+		return false;
+
+	return true;
+}
+
+static struct eval_operand
+compile_read(struct eval_compiler *c, struct eval_operand counter,
+	     struct eval_operand index)
+{
+	struct intel_perf_eval_program *program = c->program;
+	uint64_t delta = counter.value.u64 + index.value.u64;
+	struct eval_load *load;
+
+	if (counter.reg >= 0 || index.reg >= 0 ||
+	    delta >= INTEL_PERF_MAX_RAW_OA_COUNTERS) {
+		c->error = true;
+		return const_uint(0);
+	}
+
+	if (c->delta_regs[delta] < 0) {
+		grow(&program->loads, &c->n_allocated_loads, program->n_loads + 1,
+		     sizeof(*program->loads));
+		load = &program->loads[program->n_loads++];
+		load->reg = c->delta_regs[delta] = alloc_reg(c, EVAL_REG_LOAD);
+		load->delta = delta;
+	}
+
+	return (struct eval_operand) { .reg = c->delta_regs[delta] };
+}
+
+static int32_t
+find_counter_desc(struct eval_compiler *c, const char *symbol_name)
+{
+	const struct intel_perf_metrics_table *metrics = c->metrics;
+	uint32_t lo = 0, hi = c->set_desc->n_counters;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		const struct intel_perf_counter_desc *desc =
+			&metrics->counters[c->set_desc->first_counter + mid];
+		int cmp = strcmp(symbol_name, metrics->strings + desc->symbol_name);
+
+		if (cmp == 0)
+			return mid;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return -1;
+}
+
+static struct eval_operand compile_counter(struct eval_compiler *c, int32_t idx);
+
+static struct eval_operand
+compile_token(struct eval_compiler *c, const char *token)
+{
+	uint64_t value;
+	int32_t idx;
+	char *end;
+
+	if (token[0] == '$') {
+		if (hw_variable(c->perf, token, &value))
+			return const_uint(value);
+
+		idx = find_counter_desc(c, token + 1);
+		if (idx < 0) {
+			c->error = true;
+			return const_uint(0);
+		}
+
+		return compile_counter(c, idx);
+	}
+
+	if (raw_counter(c->metric_set, token, &value))
+		return const_uint(value);
+
+	if (strchr(token, '.')) {
+		struct eval_operand op = { .reg = -1, .is_float = true };
+
+		op.value.f = strtod(token, &end);
+		if (*end)
+			c->error = true;
+		return op;
+	}
+
+	value = strtoull(token, &end, 0);
+	if (*end)
+		c->error = true;
+
+	return const_uint(value);
+}
+
+static struct eval_operand
+compile_counter(struct eval_compiler *c, int32_t idx)
+{
+	const struct intel_perf_counter_desc *desc =
+		&c->metrics->counters[c->set_desc->first_counter + idx];
+	const char *equation = c->metrics->strings + desc->equation;
+	struct eval_operand *stack, result;
+	uint32_t depth = 0;
+	char *tokens, *token, *save;
+
+	if (c->states[idx] == EVAL_COUNTER_DONE)
+		return c->results[idx];
+	if (c->states[idx] == EVAL_COUNTER_COMPILING) {
+		c->error = true;
+		return const_uint(0);
+	}
+	c->states[idx] = EVAL_COUNTER_COMPILING;
+
+	tokens = strdup(equation);
+	stack = calloc(strlen(equation) / 2 + 1, sizeof(*stack));
+
+	for (token = strtok_r(tokens, " ", &save);
+	     token && !c->error;
+	     token = strtok_r(NULL, " ", &save)) {
+		int op;
+
+		for (op = 0; op < ARRAY_SIZE(eval_ops); op++) {
+			if (!strcmp(token, eval_ops[op].name))
+				break;
+		}
+
+		if (op < ARRAY_SIZE(eval_ops) || !strcmp(token, "READ")) {
+			if (depth < 2) {
+				c->error = true;
+				break;
+			}
+
+			depth -= 2;
+			stack[depth] = op < ARRAY_SIZE(eval_ops) ?
+				compile_op(c, op, stack[depth], stack[depth + 1]) :
+				compile_read(c, stack[depth], stack[depth + 1]);
+			depth++;
+		} else {
+			stack[depth++] = compile_token(c, token);
+		}
+	}
+
+	if (depth != 1)
+		c->error = true;
+
+	if (c->error) {
+		result = const_uint(0);
+	} else {
+		result = convert(c, stack[0],
+				 desc->storage == INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE ||
+				 desc->storage == INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT);
+		if (result.reg >= 0 && c->reg_kinds[result.reg] == EVAL_REG_TEMP)
+			c->reg_kinds[result.reg] = EVAL_REG_RESULT;
+	}
+
+	free(stack);
+	free(tokens);
+
+	c->results[idx] = result;
+	c->states[idx] = EVAL_COUNTER_DONE;
+
+	return result;
+}
+
+/**
+ * intel_perf_eval_program_new:
+ * @perf: the perf context
+ * @metric_set: metric set of the counters
+ * @counters: counters to evaluate, or NULL for all counters of @metric_set
+ * @n_counters: number of elements in @counters
+ *
+ * Compiles the equations of @counters into a program evaluating all of them
+ * at once for any number of accumulations.
+ *
+ * Returns: the program or NULL if an equation could not be compiled.
+ */
+struct intel_perf_eval_program *
+intel_perf_eval_program_new(const struct intel_perf *perf,
+			    const struct intel_perf_metric_set *metric_set,
+			    struct intel_perf_logical_counter * const *counters,
+			    uint32_t n_counters)
+{
+	struct eval_compiler c = {
+		.perf = perf,
+		.metric_set = metric_set,
+		.metrics = perf->metrics,
+	};
+	struct intel_perf_eval_program *program;
+
+	for (uint32_t i = 0; i < perf->metrics->n_sets; i++) {
+		const struct intel_perf_metric_set_desc *desc = &perf->metrics->sets[i];
+
+		if (!strcmp(perf->metrics->strings + desc->symbol_name,
+			    metric_set->symbol_name)) {
+			c.set_desc = desc;
+			break;
+		}
+	}
+	if (!c.set_desc)
+		return NULL;
+
+	if (!counters)
+		n_counters = metric_set->n_counters;
+
+	program = c.program = calloc(1, sizeof(*program));
+	program->outputs = calloc(n_counters, sizeof(*program->outputs));
+	program->n_outputs = n_counters;
+
+	c.results = calloc(c.set_desc->n_counters, sizeof(*c.results));
+	c.states = calloc(c.set_desc->n_counters, sizeof(*c.states));
+	memset(c.delta_regs, -1, sizeof(c.delta_regs));
+
+	for (uint32_t i = 0; i < n_counters && !c.error; i++) {
+		const struct intel_perf_logical_counter *counter =
+			counters ? counters[i] : &metric_set->counters[i];
+		int32_t idx = find_counter_desc(&c, counter->symbol_name);
+		struct eval_operand result;
+
+		if (idx < 0) {
+			c.error = true;
+			break;
+		}
+
+		result = compile_counter(&c, idx);
+		materialize(&c, &result);
+		program->outputs[i] = result.reg;
+	}
+
+	free(c.results);
+	free(c.states);
+	free(c.reg_kinds);
+	free(c.free_regs);
+
+	if (c.error) {
+		intel_perf_eval_program_free(program);
+		return NULL;
+	}
+
+	return program;
+}
+
+void
+intel_perf_eval_program_free(struct intel_perf_eval_program *program)
+{
+	if (!program)
+		return;
+
+	free(program->consts);
+	free(program->loads);
+	free(program->insns);
+	free(program->outputs);
+	free(program);
+}
+
+/**
+ * intel_perf_eval_program_run:
+ * @program: a compiled program
+ * @accumulators: accumulated deltas
+ * @n_accumulators: number of elements in @accumulators
+ * @values: for each counter of the program, an array of @n_accumulators
+ *          values to write
+ *
+ * Evaluates the counters of @program for all of @accumulators. A program
+ * isn't modified when run, so it can be used from multiple threads.
+ */
+void
+intel_perf_eval_program_run(const struct intel_perf_eval_program *program,
+			    const struct intel_perf_accumulator *accumulators,
+			    uint32_t n_accumulators,
+			    union intel_perf_eval_value **values)
+{
+	union intel_perf_eval_value *regs =
+		malloc(program->n_regs * EVAL_BLOCK * sizeof(*regs));
+
+	for (uint32_t i = 0; i < program->n_consts; i++) {
+		union intel_perf_eval_value *reg =
+			&regs[program->consts[i].reg * EVAL_BLOCK];
+
+		for (uint32_t j = 0; j < EVAL_BLOCK; j++)
+			reg[j] = program->consts[i].value;
+	}
+
+	for (uint32_t base = 0; base < n_accumulators; base += EVAL_BLOCK) {
+		uint32_t n = n_accumulators - base;
+
+		if (n > EVAL_BLOCK)
+			n = EVAL_BLOCK;
+
+		for (uint32_t i = 0; i < program->n_loads; i++) {
+			const struct eval_load *load = &program->loads[i];
+			union intel_perf_eval_value *reg = &regs[load->reg * EVAL_BLOCK];
+
+			for (uint32_t j = 0; j < n; j++)
+				reg[j].u64 = accumulators[base + j].deltas[load->delta];
+		}
+
+		for (uint32_t i = 0; i < program->n_insns; i++) {
+			const struct eval_insn *insn = &program->insns[i];
+
+			execute(insn->opcode,
+				&regs[insn->dst * EVAL_BLOCK],
+				&regs[insn->src0 * EVAL_BLOCK],
+				&regs[insn->src1 * EVAL_BLOCK],
+				n);
+		}
+
+		for (uint32_t i = 0; i < program->n_outputs; i++) {
+			memcpy(&values[i][base],
+			       &regs[program->outputs[i] * EVAL_BLOCK],
+			       n * sizeof(*regs));
+		}
+	}
+
+	free(regs);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PERF_EVAL_H
+#define PERF_EVAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bulk evaluation of logical counters. The equations of the counters are
+ * compiled into a register program which is run over blocks of
+ * accumulations at a time, giving the same values as the read callbacks of
+ * the counters.
+ */
+
+#include <stdint.h>
+
+#include "perf.h"
+
+struct intel_perf_eval_program;
+
+/* Value of a counter, depending on its storage type. */
+union intel_perf_eval_value {
+	uint64_t u64; /* UINT64, UINT32 & BOOL32 */
+	double f; /* DOUBLE & FLOAT */
+};
+
+struct intel_perf_eval_program *
+intel_perf_eval_program_new(const struct intel_perf *perf,
+			    const struct intel_perf_metric_set *metric_set,
+			    struct intel_perf_logical_counter * const *counters,
+			    uint32_t n_counters);
+void intel_perf_eval_program_free(struct intel_perf_eval_program *program);
+
+void intel_perf_eval_program_run(const struct intel_perf_eval_program *program,
+				 const struct intel_perf_accumulator *accumulators,
+				 uint32_t n_accumulators,
+				 union intel_perf_eval_value **values);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* PERF_EVAL_H */
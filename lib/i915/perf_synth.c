@@ -0,0 +1,451 @@
+/*
+ * Copyright (C) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "i915/perf.h"
+#include "i915/perf_data.h"
+#include "i915/perf_synth.h"
+
+#define MAX_COUNTERS (64)
+#define BUFFER_SIZE (64 * 1024)
+
+/* Reasons of the reports, Gen8+ */
+#define REPORT_REASON_SHIFT (19)
+#define REPORT_REASON_TIMER (1 << 0)
+#define REPORT_REASON_CTX_SWITCH (1 << 3)
+
+struct synth_counter {
+	uint64_t value;
+	uint64_t mask;
+	uint32_t increment;
+
+	/* Location of the value in the report */
+	uint32_t dword;
+	int32_t high_byte; /* -1 if the counter is 32bits */
+};
+
+struct synth_context {
+	int fd;
+	uint8_t buffer[BUFFER_SIZE];
+	uint32_t buffer_len;
+
+	const struct intel_perf_synth_params *params;
+	uint32_t graphics_ver;
+	uint32_t raw_size;
+
+	struct synth_counter counters[MAX_COUNTERS];
+	uint32_t n_counters;
+
+	uint32_t random;
+};
+
+static bool
+flush_buffer(struct synth_context *ctx)
+{
+	uint32_t offset = 0;
+
+	while (offset < ctx->buffer_len) {
+		ssize_t ret = write(ctx->fd, ctx->buffer + offset,
+				    ctx->buffer_len - offset);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		offset += ret;
+	}
+
+	ctx->buffer_len = 0;
+	return true;
+}
+
+/* Returns a zeroed record of the given type to fill. */
+static void *
+add_record(struct synth_context *ctx, uint32_t type, uint32_t size)
+{
+	struct drm_i915_perf_record_header *header;
+
+	assert(sizeof(*header) + size <= BUFFER_SIZE);
+
+	if (ctx->buffer_len + sizeof(*header) + size > BUFFER_SIZE &&
+	    !flush_buffer(ctx))
+		return NULL;
+
+	header = (struct drm_i915_perf_record_header *) (ctx->buffer + ctx->buffer_len);
+	memset(header, 0, sizeof(*header) + size);
+	header->type = type;
+	header->size = sizeof(*header) + size;
+	ctx->buffer_len += header->size;
+
+	return header + 1;
+}
+
+static uint32_t
+next_random(struct synth_context *ctx)
+{
+	/* xorshift32 */
+	ctx->random ^= ctx->random << 13;
+	ctx->random ^= ctx->random >> 17;
+	ctx->random ^= ctx->random << 5;
+
+	return ctx->random;
+}
+
+static uint64_t
+ticks_to_ns(const struct intel_perf_synth_params *params, uint64_t ticks)
+{
+	return ticks * 1000000000ull / params->timestamp_frequency;
+}
+
+static void
+add_counter(struct synth_context *ctx, uint32_t dword, int32_t high_byte)
+{
+	const struct intel_perf_synth_params *params = ctx->params;
+	struct synth_counter *counter = &ctx->counters[ctx->n_counters];
+
+	assert(ctx->n_counters < MAX_COUNTERS);
+
+	counter->dword = dword;
+	counter->high_byte = high_byte;
+	counter->mask = high_byte >= 0 ? (1ull << 40) - 1 : 0xffffffff;
+	counter->increment = (ctx->n_counters + 1) * params->counter_growth;
+	counter->value = (counter->mask + 1 - params->counter_headroom) & counter->mask;
+
+	ctx->n_counters++;
+}
+
+static bool
+setup_counters(struct synth_context *ctx, int oa_format)
+{
+	switch (oa_format) {
+	case I915_OA_FORMAT_A32u40_A4u32_B8_C8:
+		/* 32x 40bit A counters with their high bytes after A35 */
+		for (int i = 0; i < 32; i++)
+			add_counter(ctx, 4 + i, 160 + i);
+		/* 4x 32bit A counters */
+		for (int i = 0; i < 4; i++)
+			add_counter(ctx, 36 + i, -1);
+		/* 8x 32bit B counters + 8x 32bit C counters */
+		for (int i = 0; i < 16; i++)
+			add_counter(ctx, 48 + i, -1);
+		return true;
+
+	case I915_OA_FORMAT_A45_B8_C8:
+		/* 45x A counters + 8x B counters + 8x C counters, all 32bit */
+		for (int i = 0; i < 61; i++)
+			add_counter(ctx, 3 + i, -1);
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/* All the slices, subslices & EUs of the parameters enabled. */
+static struct drm_i915_query_topology_info *
+build_topology(const struct intel_perf_synth_params *params, uint32_t *size)
+{
+	struct drm_i915_query_topology_info *topology;
+	uint32_t subslice_stride = (params->n_subslices + 7) / 8;
+	uint32_t eu_stride = (params->n_eus + 7) / 8;
+	uint32_t subslice_offset = (params->n_slices + 7) / 8;
+	uint32_t eu_offset = subslice_offset + params->n_slices * subslice_stride;
+
+	/* Aligned like i915-perf-recorder does. */
+	*size = (sizeof(*topology) + eu_offset +
+		 params->n_slices * params->n_subslices * eu_stride + 7) & ~7u;
+	topology = calloc(1, *size);
+	if (!topology)
+		return NULL;
+
+	topology->max_slices = params->n_slices;
+	topology->max_subslices = params->n_subslices;
+	topology->max_eus_per_subslice = params->n_eus;
+	topology->subslice_offset = subslice_offset;
+	topology->subslice_stride = subslice_stride;
+	topology->eu_offset = eu_offset;
+	topology->eu_stride = eu_stride;
+	for (uint32_t s = 0; s < params->n_slices; s++) {
+		topology->data[s / 8] |= 1 << (s % 8);
+
+		for (uint32_t ss = 0; ss < params->n_subslices; ss++) {
+			uint8_t *eus = &topology->data[eu_offset +
+						       (s * params->n_subslices + ss) * eu_stride];
+
+			topology->data[subslice_offset + s * subslice_stride + ss / 8] |=
+				1 << (ss % 8);
+			for (uint32_t eu = 0; eu < params->n_eus; eu++)
+				eus[eu / 8] |= 1 << (eu % 8);
+		}
+	}
+
+	return topology;
+}
+
+static bool
+write_header(struct synth_context *ctx,
+	     const struct intel_perf_metric_set *metric_set,
+	     const struct drm_i915_query_topology_info *topology,
+	     uint32_t topology_size)
+{
+	const struct intel_perf_synth_params *params = ctx->params;
+	struct intel_perf_record_version *version;
+	struct intel_perf_record_device_info *info;
+	void *record_topology;
+
+	version = add_record(ctx, INTEL_PERF_RECORD_TYPE_VERSION, sizeof(*version));
+	if (!version)
+		return false;
+	version->version = INTEL_PERF_RECORD_VERSION;
+
+	info = add_record(ctx, INTEL_PERF_RECORD_TYPE_DEVICE_INFO, sizeof(*info));
+	if (!info)
+		return false;
+	info->timestamp_frequency = params->timestamp_frequency;
+	info->device_id = params->device_id;
+	info->device_revision = params->revision;
+	info->gt_min_frequency = params->gt_min_frequency;
+	info->gt_max_frequency = params->gt_max_frequency;
+	info->engine_class = I915_ENGINE_CLASS_RENDER;
+	info->engine_instance = 0;
+	info->oa_format = metric_set->perf_oa_format;
+	snprintf(info->metric_set_name, sizeof(info->metric_set_name),
+		 "%s", metric_set->symbol_name);
+	snprintf(info->metric_set_uuid, sizeof(info->metric_set_uuid),
+		 "%s", metric_set->hw_config_guid);
+
+	record_topology = add_record(ctx, INTEL_PERF_RECORD_TYPE_DEVICE_TOPOLOGY,
+				     topology_size);
+	if (!record_topology)
+		return false;
+	memcpy(record_topology, topology, topology_size);
+
+	return true;
+}
+
+static bool
+write_correlation(struct synth_context *ctx, uint64_t gpu_ts)
+{
+	const struct intel_perf_synth_params *params = ctx->params;
+	struct intel_perf_record_timestamp_correlation *corr =
+		add_record(ctx, INTEL_PERF_RECORD_TYPE_TIMESTAMP_CORRELATION,
+			   sizeof(*corr));
+
+	if (!corr)
+		return false;
+
+	/* Pretend the recording started 1s after boot. */
+	corr->cpu_timestamp = 1000000000ull +
+		ticks_to_ns(params, gpu_ts - params->initial_timestamp);
+	corr->gpu_timestamp = gpu_ts;
+
+	return true;
+}
+
+static bool
+write_sample(struct synth_context *ctx, uint32_t sample, uint64_t gpu_ts,
+	     uint32_t gpu_clock)
+{
+	const struct intel_perf_synth_params *params = ctx->params;
+	uint8_t *report = add_record(ctx, DRM_I915_PERF_RECORD_SAMPLE, ctx->raw_size);
+	uint32_t *dws = (uint32_t *) report;
+	uint32_t reason = REPORT_REASON_TIMER;
+	uint32_t ctx_idx = 0;
+
+	if (!report)
+		return false;
+
+	if (params->context_switch_period) {
+		ctx_idx = (sample / params->context_switch_period) % params->n_contexts;
+		if (sample && (sample % params->context_switch_period) == 0)
+			reason = REPORT_REASON_CTX_SWITCH;
+	}
+
+	if (ctx->graphics_ver == 8)
+		dws[0] = (reason << REPORT_REASON_SHIFT) | (1u << 25);
+	else if (ctx->graphics_ver > 8)
+		dws[0] = (reason << REPORT_REASON_SHIFT) | (1u << 16);
+	dws[1] = (uint32_t) gpu_ts;
+	dws[2] = 0x100 + ctx_idx;
+	if (ctx->graphics_ver >= 8)
+		dws[3] = gpu_clock;
+
+	for (uint32_t i = 0; i < ctx->n_counters; i++) {
+		struct synth_counter *counter = &ctx->counters[i];
+
+		dws[counter->dword] = (uint32_t) counter->value;
+		if (counter->high_byte >= 0)
+			report[counter->high_byte] = counter->value >> 32;
+	}
+
+	return true;
+}
+
+static void
+advance_counters(struct synth_context *ctx)
+{
+	const struct intel_perf_synth_params *params = ctx->params;
+
+	for (uint32_t i = 0; i < ctx->n_counters; i++) {
+		struct synth_counter *counter = &ctx->counters[i];
+		uint64_t increment = counter->increment;
+
+		if (params->noise)
+			increment += increment * (next_random(ctx) % (params->noise + 1)) / 100;
+
+		counter->value = (counter->value + increment) & counter->mask;
+	}
+}
+
+void
+intel_perf_synth_default_params(struct intel_perf_synth_params *params)
+{
+	memset(params, 0, sizeof(*params));
+
+	params->device_id = 0x9A49; /* TGL GT2 */
+	params->n_slices = 1;
+	params->n_subslices = 6;
+	params->n_eus = 16;
+	params->timestamp_frequency = 19200000;
+	params->gt_min_frequency = 300;
+	params->gt_max_frequency = 1300;
+	params->metric_set = "RenderBasic";
+	params->n_samples = 100000;
+	/* ~100us, the default period of i915-perf-recorder */
+	params->sample_period = 1920;
+	params->correlation_period = 1000;
+	params->context_switch_period = 50;
+	params->n_contexts = 4;
+	params->counter_growth = 1000;
+	params->noise = 25;
+	params->counter_headroom = 1ull << 30;
+	params->seed = 0xdeadbeef;
+}
+
+/**
+ * intel_perf_synth_write:
+ * @fd: file to write the recording to
+ * @params: description of the recording
+ *
+ * Writes a recording with the records i915-perf-recorder would write for
+ * @params, followed by @params->n_samples OA reports.
+ *
+ * Returns: false with errno set on failure, EINVAL if the device or metric
+ * set isn't supported.
+ */
+bool
+intel_perf_synth_write(int fd, const struct intel_perf_synth_params *params)
+{
+	struct drm_i915_query_topology_info *topology;
+	const struct intel_perf_metric_set *metric_set;
+	struct synth_context *ctx = NULL;
+	struct intel_perf *perf = NULL;
+	uint32_t topology_size;
+	uint64_t gpu_ts = params->initial_timestamp;
+	uint32_t gpu_clock = 0, clock_period;
+	bool ret = false;
+
+	if (!params->n_slices || !params->n_subslices || !params->n_eus ||
+	    !params->timestamp_frequency || !params->sample_period ||
+	    !params->correlation_period ||
+	    (params->context_switch_period && !params->n_contexts)) {
+		errno = EINVAL;
+		return false;
+	}
+
+	topology = build_topology(params, &topology_size);
+	if (!topology) {
+		errno = ENOMEM;
+		return false;
+	}
+
+	perf = intel_perf_for_devinfo(params->device_id, params->revision,
+				      params->timestamp_frequency,
+				      params->gt_min_frequency,
+				      params->gt_max_frequency,
+				      topology);
+	if (!perf) {
+		errno = EINVAL;
+		goto out;
+	}
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		errno = ENOMEM;
+		goto out;
+	}
+
+	ctx->fd = fd;
+	ctx->params = params;
+	ctx->graphics_ver = perf->devinfo.graphics_ver;
+	ctx->random = params->seed ? params->seed : 1;
+
+	metric_set = intel_perf_find_metric_set(perf, params->metric_set);
+	if (!metric_set || !setup_counters(ctx, metric_set->perf_oa_format)) {
+		errno = EINVAL;
+		goto out;
+	}
+	ctx->raw_size = metric_set->perf_raw_size;
+
+	/* GPU clock ticks per sample, running at the max frequency */
+	clock_period = (uint64_t) params->sample_period *
+		params->gt_max_frequency * 1000000ull /
+		params->timestamp_frequency;
+
+	if (!write_header(ctx, metric_set, topology, topology_size))
+		goto out;
+
+	for (uint32_t s = 0; s < params->n_samples; s++) {
+		if ((s % params->correlation_period) == 0 &&
+		    !write_correlation(ctx, gpu_ts - (s ? params->sample_period / 2 : 0)))
+			goto out;
+
+		if (!write_sample(ctx, s, gpu_ts, gpu_clock))
+			goto out;
+
+		advance_counters(ctx);
+		gpu_ts += params->sample_period;
+		gpu_clock += clock_period;
+	}
+
+	/* The recorder always correlates after the last report. */
+	if (!write_correlation(ctx, gpu_ts - params->sample_period / 2))
+		goto out;
+
+	ret = flush_buffer(ctx);
+
+out:
+	free(ctx);
+	if (perf)
+		intel_perf_free(perf);
+	free(topology);
+
+	return ret;
+}
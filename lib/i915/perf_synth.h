@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PERF_SYNTH_H
+#define PERF_SYNTH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Generates i915-perf recordings, in the format written by
+ * i915-perf-recorder, without any hardware. Used to test & benchmark the
+ * tools processing recordings.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct intel_perf_synth_params {
+	/* PCI ID & stepping of the device */
+	uint32_t device_id;
+	uint32_t revision;
+
+	/* Topology */
+	uint32_t n_slices;
+	uint32_t n_subslices; /* per slice */
+	uint32_t n_eus; /* per subslice */
+
+	uint64_t timestamp_frequency;
+	uint32_t gt_min_frequency; /* MHz */
+	uint32_t gt_max_frequency; /* MHz */
+
+	/* Symbol name of the metric set, defines the OA format */
+	const char *metric_set;
+
+	uint32_t n_samples;
+
+	/* Timestamp of the first sample and period in timestamp ticks */
+	uint64_t initial_timestamp;
+	uint32_t sample_period;
+
+	/* Number of samples between 2 timestamp correlation records */
+	uint32_t correlation_period;
+
+	/*
+	 * Number of samples between 2 context switches, the hardware
+	 * contexts are cycled through. 0 for no context switch.
+	 */
+	uint32_t context_switch_period;
+	uint32_t n_contexts;
+
+	/*
+	 * Increment of the Nth A/B/C counter per sample is (N + 1) times
+	 * counter_growth, modulated by a random noise in [0, noise] % of the
+	 * increment. The counters start counter_headroom away from wrapping.
+	 */
+	uint32_t counter_growth;
+	uint32_t noise;
+	uint64_t counter_headroom;
+	uint32_t seed;
+};
+
+void intel_perf_synth_default_params(struct intel_perf_synth_params *params);
+
+bool intel_perf_synth_write(int fd, const struct intel_perf_synth_params *params);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* PERF_SYNTH_H */
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PERF_TABLES_H
+#define PERF_TABLES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "i915/perf.h"
+
+/*
+ * Layout of the per platform metric set descriptions generated by
+ * perf-metricset-codegen.py. Everything is const and refers to strings by
+ * offset into a single pool and to functions by index into a few tables, so
+ * nothing but those tables needs relocating at load time. The metric sets
+ * are only turned into struct intel_perf_metric_set once looked up.
+ */
+
+struct intel_perf_counter_funcs {
+	union {
+		uint64_t (*max_uint64)(const struct intel_perf *perf,
+				       const struct intel_perf_metric_set *metric_set,
+				       uint64_t *deltas);
+		double (*max_float)(const struct intel_perf *perf,
+				    const struct intel_perf_metric_set *metric_set,
+				    uint64_t *deltas);
+	};
+
+	union {
+		uint64_t (*read_uint64)(const struct intel_perf *perf,
+					const struct intel_perf_metric_set *metric_set,
+					uint64_t *deltas);
+		double (*read_float)(const struct intel_perf *perf,
+				     const struct intel_perf_metric_set *metric_set,
+				     uint64_t *deltas);
+	};
+};
+
+struct intel_perf_counter_desc {
+	/* Offsets into intel_perf_metrics_table.strings */
+	uint32_t name;
+	uint32_t symbol_name;
+	uint32_t desc;
+	uint32_t group;
+	/* RPN equation of the read function, used by perf_eval.c */
+	uint32_t equation;
+
+	/* Index into intel_perf_metrics_table.funcs */
+	uint16_t funcs;
+	/* Index into intel_perf_metrics_table.availability, 0 if always */
+	uint16_t availability;
+
+	uint8_t storage; /* intel_perf_logical_counter_storage_t */
+	uint8_t type; /* intel_perf_logical_counter_type_t */
+	uint8_t unit; /* intel_perf_logical_counter_unit_t */
+};
+
+struct intel_perf_metric_set_desc {
+	/* Offsets into intel_perf_metrics_table.strings */
+	uint32_t name;
+	uint32_t symbol_name;
+	uint32_t hw_config_guid;
+
+	/* Range of intel_perf_metrics_table.counters, sorted by symbol name */
+	uint32_t first_counter;
+	uint32_t n_counters;
+};
+
+struct intel_perf_metrics_table {
+	int oa_format;
+
+	const char *strings;
+
+	const struct intel_perf_metric_set_desc *sets;
+	uint32_t n_sets;
+
+	const struct intel_perf_counter_desc *counters;
+	const struct intel_perf_counter_funcs *funcs;
+	bool (* const *availability)(const struct intel_perf *perf);
+	void (* const *add_registers)(struct intel_perf *perf,
+				      struct intel_perf_metric_set *metric_set);
+
+	/*
+	 * Open addressing table of set index + 1, keyed by
+	 * intel_perf_metric_set_hash() of the symbol names, 0 when empty.
+	 */
+	const uint16_t *hash;
+	uint32_t hash_mask;
+};
+
+/* FNV-1a of the lower case name, must match perf-metricset-codegen.py. */
+static inline uint32_t intel_perf_metric_set_hash(const char *name)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	for (; *name; name++) {
+		char c = *name;
+
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+
+		hash ^= (uint8_t)c;
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+#endif /* PERF_TABLES_H */
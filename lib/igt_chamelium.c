@@ -28,6 +28,8 @@
 
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
+#include <unistd.h>
 #include <math.h>
 #include <xmlrpc-c/base.h>
 #include <xmlrpc-c/client.h>
@@ -37,6 +39,7 @@
 #include <cairo.h>
 
 #include "igt_chamelium.h"
+#include "igt_chamelium_stream.h"
 #include "igt_core.h"
 #include "igt_aux.h"
 #include "igt_edid.h"
@@ -44,6 +47,7 @@
 #include "igt_list.h"
 #include "igt_kms.h"
 #include "igt_rc.h"
+#include "igt_stats.h"
 
 /**
  * SECTION:igt_chamelium
@@ -111,22 +115,78 @@ struct chamelium_frame_dump {
 	int width;
 	int height;
 	struct chamelium_port *port;
+	/* bgr belongs to the stream the frame was received from */
+	bool borrowed;
 };
 
+/*
+ * A CRC calculation, split into bands of the frame hashed by the worker pool
+ * (see chamelium_crc_run_band()).
+ */
 struct chamelium_fb_crc_async_data {
 	cairo_surface_t *fb_surface;
+	const unsigned char *buffer;
+	int n_pixels;
+
+	/* Protected by crc_pool.lock */
+	int n_bands;
+	int next_band;
+	int done_bands;
+	struct igt_list_head link; /* in crc_pool.jobs until all bands are claimed */
+
+	struct chamelium_crc_band_sum *bands;
 
-	pthread_t thread_id;
 	igt_crc_t *ret;
 };
 
+/* Latencies of the calls to an XML-RPC method, in nanoseconds */
+struct chamelium_rpc_stats {
+	char *method;
+	igt_stats_t latency;
+};
+
+/*
+ * Independent calls sent in a single request, see chamelium_rpc_batch_run().
+ * The results are in the order the calls were added.
+ */
+struct chamelium_rpc_batch {
+	int count;
+	const char **methods;
+	xmlrpc_value **params;
+	xmlrpc_value **results;
+};
+
+/*
+ * A call in flight, sent with chamelium_rpc_start() and completed by
+ * chamelium_rpc_wait().
+ */
+struct chamelium_rpc_future {
+	struct chamelium *chamelium;
+	const char *method;
+	xmlrpc_value *params;
+	struct timespec start;
+
+	bool done;
+	xmlrpc_env env;
+	xmlrpc_value *result;
+};
+
 struct chamelium {
 	xmlrpc_env env;
 	xmlrpc_client *client;
+	xmlrpc_server_info *server;
 	char *url;
 
+	/* The Chamelium doesn't implement system.multicall */
+	bool no_multicall;
+
+	struct chamelium_rpc_stats *rpc_stats;
+	int rpc_stats_count;
+
 	/* Indicates the last port to have been used for capturing video */
 	struct chamelium_port *capturing_port;
+	/* Resolution of the frames being streamed, see chamelium_stream_captured_frames() */
+	int streamed_width, streamed_height;
 
 	int drm_fd;
 
@@ -360,7 +420,8 @@ chamelium_reset_state(igt_display_t *display,
  */
 void chamelium_destroy_frame_dump(struct chamelium_frame_dump *dump)
 {
-	free(dump->bgr);
+	if (!dump->borrowed)
+		free(dump->bgr);
 	free(dump);
 }
 
@@ -444,11 +505,85 @@ static void *chamelium_fsm_mon(void *data)
 
 #define _RECEIVER_RESPONSIVE_AFTER_RESET_SECONDS 10
 
-static xmlrpc_value *__chamelium_rpc_va(struct chamelium *chamelium,
-					struct chamelium_port *fsm_port,
+static void chamelium_rpc_record(struct chamelium *chamelium,
+				 const char *method_name,
+				 const struct timespec *start)
+{
+	struct chamelium_rpc_stats *stats = NULL;
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (int i = 0; i < chamelium->rpc_stats_count; i++) {
+		if (strcmp(chamelium->rpc_stats[i].method, method_name) == 0) {
+			stats = &chamelium->rpc_stats[i];
+			break;
+		}
+	}
+
+	if (!stats) {
+		chamelium->rpc_stats = realloc(chamelium->rpc_stats,
+					       (chamelium->rpc_stats_count + 1) *
+					       sizeof(*chamelium->rpc_stats));
+		igt_assert(chamelium->rpc_stats);
+		stats = &chamelium->rpc_stats[chamelium->rpc_stats_count++];
+		stats->method = strdup(method_name);
+		igt_stats_init(&stats->latency);
+	}
+
+	igt_stats_push(&stats->latency,
+		       (end.tv_sec - start->tv_sec) * NSEC_PER_SEC +
+		       end.tv_nsec - start->tv_nsec);
+}
+
+static void chamelium_clear_fault(struct chamelium *chamelium)
+{
+	if (chamelium->env.fault_occurred) {
+		xmlrpc_env_clean(&chamelium->env);
+		xmlrpc_env_init(&chamelium->env);
+	}
+}
+
+static xmlrpc_value *chamelium_rpc_params_va(struct chamelium *chamelium,
+					     const char *format_str,
+					     va_list va_args)
+{
+	xmlrpc_value *params = NULL;
+	const char *tail;
+
+	chamelium_clear_fault(chamelium);
+	xmlrpc_build_value_va(&chamelium->env, format_str, va_args,
+			      &params, &tail);
+
+	return params;
+}
+
+static xmlrpc_value *chamelium_rpc_once(struct chamelium *chamelium,
 					const char *method_name,
-					const char *format_str,
-					va_list va_args)
+					xmlrpc_value *params)
+{
+	xmlrpc_value *res = NULL;
+	struct timespec start;
+
+	/* Cleanup the last error, if any */
+	chamelium_clear_fault(chamelium);
+
+	/*
+	 * Synchronous calls all go through the same curl session, so the
+	 * connection is kept open from one call to the next.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	xmlrpc_client_call2(&chamelium->env, chamelium->client,
+			    chamelium->server, method_name, params, &res);
+	chamelium_rpc_record(chamelium, method_name, &start);
+
+	return res;
+}
+
+static xmlrpc_value *__chamelium_rpc_params(struct chamelium *chamelium,
+					    struct chamelium_port *fsm_port,
+					    const char *method_name,
+					    xmlrpc_value *params)
 {
 	xmlrpc_value *res = NULL;
 	struct fsm_monitor_args monitor_args;
@@ -469,15 +604,7 @@ static xmlrpc_value *__chamelium_rpc_va(struct chamelium *chamelium,
 	}
 
 	igt_until_timeout(_RECEIVER_RESPONSIVE_AFTER_RESET_SECONDS) {
-		/* Cleanup the last error, if any */
-		if (chamelium->env.fault_occurred) {
-			xmlrpc_env_clean(&chamelium->env);
-			xmlrpc_env_init(&chamelium->env);
-		}
-
-		xmlrpc_client_call2f_va(&chamelium->env, chamelium->client,
-					chamelium->url, method_name, format_str, &res,
-					va_args);
+		res = chamelium_rpc_once(chamelium, method_name, params);
 
 		if (!chamelium->env.fault_occurred)
 			break;
@@ -497,6 +624,24 @@ static xmlrpc_value *__chamelium_rpc_va(struct chamelium *chamelium,
 	return res;
 }
 
+static xmlrpc_value *__chamelium_rpc_va(struct chamelium *chamelium,
+					struct chamelium_port *fsm_port,
+					const char *method_name,
+					const char *format_str,
+					va_list va_args)
+{
+	xmlrpc_value *params, *res;
+
+	params = chamelium_rpc_params_va(chamelium, format_str, va_args);
+	if (chamelium->env.fault_occurred)
+		return NULL;
+
+	res = __chamelium_rpc_params(chamelium, fsm_port, method_name, params);
+	xmlrpc_DECREF(params);
+
+	return res;
+}
+
 static xmlrpc_value *__chamelium_rpc(struct chamelium *chamelium,
 				     struct chamelium_port *fsm_port,
 				     const char *method_name,
@@ -552,6 +697,334 @@ static xmlrpc_value *chamelium_rpc(struct chamelium *chamelium,
 	return res;
 }
 
+static void chamelium_rpc_batch_add(struct chamelium *chamelium,
+				    struct chamelium_rpc_batch *batch,
+				    const char *method_name,
+				    const char *format_str, ...)
+{
+	va_list va_args;
+	int n = batch->count++;
+
+	batch->methods = realloc(batch->methods,
+				 batch->count * sizeof(*batch->methods));
+	batch->params = realloc(batch->params,
+				batch->count * sizeof(*batch->params));
+	batch->results = realloc(batch->results,
+				 batch->count * sizeof(*batch->results));
+	igt_assert(batch->methods && batch->params && batch->results);
+
+	va_start(va_args, format_str);
+	batch->methods[n] = method_name;
+	batch->params[n] = chamelium_rpc_params_va(chamelium, format_str,
+						   va_args);
+	batch->results[n] = NULL;
+	va_end(va_args);
+
+	igt_assert_f(!chamelium->env.fault_occurred,
+		     "Invalid parameters for %s: %s\n",
+		     method_name, chamelium->env.fault_string);
+}
+
+static void chamelium_rpc_batch_fini(struct chamelium_rpc_batch *batch)
+{
+	for (int i = 0; i < batch->count; i++) {
+		xmlrpc_DECREF(batch->params[i]);
+		if (batch->results[i])
+			xmlrpc_DECREF(batch->results[i]);
+	}
+
+	free(batch->methods);
+	free(batch->params);
+	free(batch->results);
+	memset(batch, 0, sizeof(*batch));
+}
+
+static bool chamelium_rpc_batch_run_one(struct chamelium *chamelium,
+					struct chamelium_rpc_batch *batch,
+					int i)
+{
+	batch->results[i] = __chamelium_rpc_params(chamelium, NULL,
+						   batch->methods[i],
+						   batch->params[i]);
+
+	return !chamelium->env.fault_occurred;
+}
+
+/* Reads the outcome of a call from a system.multicall response. */
+static bool chamelium_rpc_batch_read_result(struct chamelium *chamelium,
+					    struct chamelium_rpc_batch *batch,
+					    xmlrpc_value *res, int i)
+{
+	xmlrpc_value *item, *code_xml, *string_xml;
+	const char *fault_string;
+	int fault_code;
+
+	xmlrpc_array_read_item(&chamelium->env, res, i, &item);
+	if (chamelium->env.fault_occurred)
+		return false;
+
+	if (xmlrpc_value_type(item) == XMLRPC_TYPE_ARRAY) {
+		xmlrpc_array_read_item(&chamelium->env, item, 0,
+				       &batch->results[i]);
+		xmlrpc_DECREF(item);
+		return !chamelium->env.fault_occurred;
+	}
+
+	/* The call failed, the item is a fault struct. */
+	xmlrpc_struct_find_value(&chamelium->env, item, "faultCode", &code_xml);
+	xmlrpc_struct_find_value(&chamelium->env, item, "faultString",
+				 &string_xml);
+	xmlrpc_DECREF(item);
+	if (chamelium->env.fault_occurred || !code_xml || !string_xml)
+		return false;
+
+	xmlrpc_read_int(&chamelium->env, code_xml, &fault_code);
+	xmlrpc_read_string(&chamelium->env, string_xml, &fault_string);
+	xmlrpc_DECREF(code_xml);
+	xmlrpc_DECREF(string_xml);
+	if (chamelium->env.fault_occurred)
+		return false;
+
+	if (strstr(fault_string, "I2C")) {
+		/* i2c error, retry that call on its own */
+		free((void *)fault_string);
+		return chamelium_rpc_batch_run_one(chamelium, batch, i);
+	}
+
+	xmlrpc_env_set_fault_formatted(&chamelium->env, fault_code, "%s: %s",
+				       batch->methods[i], fault_string);
+	free((void *)fault_string);
+
+	return false;
+}
+
+/*
+ * Whether the last call failed because the server doesn't know the method.
+ * The Chamelium doesn't use XMLRPC_NO_SUCH_METHOD_ERROR for that, see
+ * chamelium_supports_method().
+ */
+static bool chamelium_no_such_method(struct chamelium *chamelium)
+{
+	return chamelium->env.fault_code == XMLRPC_NO_SUCH_METHOD_ERROR ||
+	       strstr(chamelium->env.fault_string, "not supported");
+}
+
+/*
+ * Runs all the calls of the batch in a single round trip, using
+ * system.multicall, and falls back to making the calls one by one if the
+ * Chamelium doesn't know system.multicall. The calls are executed in order.
+ * When one fails, the following ones may or may not have been executed.
+ * None of them may need FSM handling.
+ */
+static bool chamelium_rpc_batch_run(struct chamelium *chamelium,
+				    struct chamelium_rpc_batch *batch)
+{
+	xmlrpc_value *calls, *call, *res;
+	bool ret = true;
+
+	if (batch->count <= 1 || chamelium->no_multicall)
+		goto one_by_one;
+
+	chamelium_clear_fault(chamelium);
+	calls = xmlrpc_array_new(&chamelium->env);
+	for (int i = 0; i < batch->count; i++) {
+		call = xmlrpc_build_value(&chamelium->env, "{s:s,s:A}",
+					  "methodName", batch->methods[i],
+					  "params", batch->params[i]);
+		xmlrpc_array_append_item(&chamelium->env, calls, call);
+		xmlrpc_DECREF(call);
+	}
+	igt_assert(!chamelium->env.fault_occurred);
+
+	call = xmlrpc_build_value(&chamelium->env, "(A)", calls);
+	xmlrpc_DECREF(calls);
+	/*
+	 * Not retried on I2C errors like other calls: the batch may have
+	 * partly run, and Reset or Plug must not run twice.
+	 */
+	res = chamelium_rpc_once(chamelium, "system.multicall", call);
+	xmlrpc_DECREF(call);
+
+	if (chamelium->env.fault_occurred) {
+		if (!chamelium_no_such_method(chamelium))
+			return false;
+
+		/* Nothing ran, the Chamelium doesn't know system.multicall */
+		igt_debug("system.multicall failed, not batching calls: %s\n",
+			  chamelium->env.fault_string);
+		chamelium->no_multicall = true;
+		goto one_by_one;
+	}
+
+	if (xmlrpc_array_size(&chamelium->env, res) != batch->count) {
+		xmlrpc_env_set_fault_formatted(&chamelium->env, 0,
+					       "system.multicall returned %d results for %d calls",
+					       xmlrpc_array_size(&chamelium->env, res),
+					       batch->count);
+		xmlrpc_DECREF(res);
+		return false;
+	}
+
+	for (int i = 0; i < batch->count && ret; i++)
+		ret = chamelium_rpc_batch_read_result(chamelium, batch, res, i);
+	xmlrpc_DECREF(res);
+
+	return ret;
+
+one_by_one:
+	for (int i = 0; i < batch->count; i++) {
+		if (!chamelium_rpc_batch_run_one(chamelium, batch, i))
+			return false;
+	}
+
+	return true;
+}
+
+static void chamelium_rpc_response(const char *server_url,
+				   const char *method_name,
+				   xmlrpc_value *params, void *data,
+				   xmlrpc_env *fault, xmlrpc_value *result)
+{
+	struct chamelium_rpc_future *future = data;
+
+	chamelium_rpc_record(future->chamelium, future->method, &future->start);
+
+	if (fault->fault_occurred) {
+		xmlrpc_env_set_fault(&future->env, fault->fault_code,
+				     fault->fault_string);
+	} else {
+		xmlrpc_INCREF(result);
+		future->result = result;
+	}
+
+	future->done = true;
+}
+
+/*
+ * Sends a call without waiting for its result, so that several calls can be
+ * in flight at the same time. The result is collected by chamelium_rpc_wait().
+ * The call may not need FSM handling.
+ */
+static struct chamelium_rpc_future *chamelium_rpc_start(struct chamelium *chamelium,
+							const char *method_name,
+							const char *format_str,
+							...)
+{
+	struct chamelium_rpc_future *future = calloc(1, sizeof(*future));
+	va_list va_args;
+
+	igt_assert(future);
+	future->chamelium = chamelium;
+	future->method = method_name;
+	xmlrpc_env_init(&future->env);
+
+	va_start(va_args, format_str);
+	future->params = chamelium_rpc_params_va(chamelium, format_str,
+						 va_args);
+	va_end(va_args);
+	igt_assert_f(!chamelium->env.fault_occurred,
+		     "Invalid parameters for %s: %s\n",
+		     method_name, chamelium->env.fault_string);
+
+	clock_gettime(CLOCK_MONOTONIC, &future->start);
+	xmlrpc_client_start_rpc(&chamelium->env, chamelium->client,
+				chamelium->server, method_name, future->params,
+				chamelium_rpc_response, future);
+	if (chamelium->env.fault_occurred) {
+		xmlrpc_env_set_fault(&future->env, chamelium->env.fault_code,
+				     chamelium->env.fault_string);
+		chamelium_clear_fault(chamelium);
+		future->done = true;
+	}
+
+	return future;
+}
+
+/*
+ * Waits for the result of a call sent with chamelium_rpc_start(), failing the
+ * test like chamelium_rpc() if the call failed.
+ */
+static xmlrpc_value *chamelium_rpc_wait(struct chamelium_rpc_future *future)
+{
+	struct chamelium *chamelium = future->chamelium;
+	xmlrpc_value *res;
+
+	while (!future->done)
+		xmlrpc_client_event_loop_finish_timeout(chamelium->client, 100);
+
+	res = future->result;
+	if (future->env.fault_occurred &&
+	    strstr(future->env.fault_string, "I2C")) {
+		/* i2c error, retry synchronously */
+		res = __chamelium_rpc_params(chamelium, NULL, future->method,
+					     future->params);
+	} else if (future->env.fault_occurred) {
+		chamelium_clear_fault(chamelium);
+		xmlrpc_env_set_fault(&chamelium->env, future->env.fault_code,
+				     future->env.fault_string);
+	}
+
+	xmlrpc_DECREF(future->params);
+	xmlrpc_env_clean(&future->env);
+	free(future);
+
+	igt_assert_f(!chamelium->env.fault_occurred,
+		     "Chamelium RPC call failed: %s\n",
+		     chamelium->env.fault_string);
+
+	return res;
+}
+
+/**
+ * chamelium_get_rpc_latency:
+ * @chamelium: The Chamelium instance to use
+ * @method: The name of the XML-RPC method
+ *
+ * Returns: the latencies of the calls to @method made so far, in nanoseconds,
+ * or NULL if @method wasn't called. Calls made with the help of
+ * system.multicall are accounted for as a single system.multicall call.
+ */
+igt_stats_t *chamelium_get_rpc_latency(struct chamelium *chamelium,
+				       const char *method)
+{
+	for (int i = 0; i < chamelium->rpc_stats_count; i++) {
+		if (strcmp(chamelium->rpc_stats[i].method, method) == 0)
+			return &chamelium->rpc_stats[i].latency;
+	}
+
+	return NULL;
+}
+
+static void chamelium_log_rpc_stats_level(struct chamelium *chamelium,
+					  enum igt_log_level level)
+{
+	if (!chamelium->rpc_stats_count)
+		return;
+
+	igt_log(IGT_LOG_DOMAIN, level,
+		"Chamelium RPC latencies (calls, median, max in ms):\n");
+	for (int i = 0; i < chamelium->rpc_stats_count; i++) {
+		igt_stats_t *latency = &chamelium->rpc_stats[i].latency;
+
+		igt_log(IGT_LOG_DOMAIN, level, "  %-28s %6u %9.3f %9.3f\n",
+			chamelium->rpc_stats[i].method, latency->n_values,
+			igt_stats_get_median(latency) / 1e6,
+			igt_stats_get_max(latency) / 1e6);
+	}
+}
+
+/**
+ * chamelium_log_rpc_stats:
+ * @chamelium: The Chamelium instance to use
+ *
+ * Logs the number of calls and the latencies of each XML-RPC method called so
+ * far, to find out where the time goes in Chamelium tests.
+ */
+void chamelium_log_rpc_stats(struct chamelium *chamelium)
+{
+	chamelium_log_rpc_stats_level(chamelium, IGT_LOG_INFO);
+}
+
 static bool __chamelium_is_reachable(struct chamelium *chamelium)
 {
 	xmlrpc_value *res;
@@ -1138,12 +1611,10 @@ void chamelium_port_get_video_params(struct chamelium *chamelium,
 	xmlrpc_DECREF(res);
 }
 
-static void chamelium_get_captured_resolution(struct chamelium *chamelium,
-					      int *w, int *h)
+static void captured_resolution_from_xml(struct chamelium *chamelium,
+					 xmlrpc_value *res, int *w, int *h)
 {
-	xmlrpc_value *res, *res_w, *res_h;
-
-	res = chamelium_rpc(chamelium, NULL, "GetCapturedResolution", "()");
+	xmlrpc_value *res_w, *res_h;
 
 	xmlrpc_array_read_item(&chamelium->env, res, 0, &res_w);
 	xmlrpc_array_read_item(&chamelium->env, res, 1, &res_h);
@@ -1152,16 +1623,32 @@ static void chamelium_get_captured_resolution(struct chamelium *chamelium,
 
 	xmlrpc_DECREF(res_w);
 	xmlrpc_DECREF(res_h);
+}
+
+static void chamelium_get_captured_resolution(struct chamelium *chamelium,
+					      int *w, int *h)
+{
+	xmlrpc_value *res;
+
+	res = chamelium_rpc(chamelium, NULL, "GetCapturedResolution", "()");
+	captured_resolution_from_xml(chamelium, res, w, h);
 	xmlrpc_DECREF(res);
 }
 
 static struct chamelium_frame_dump *frame_from_xml(struct chamelium *chamelium,
-						   xmlrpc_value *frame_xml)
+						   xmlrpc_value *frame_xml,
+						   xmlrpc_value *resolution_xml)
 {
 	struct chamelium_frame_dump *ret = malloc(sizeof(*ret));
 
-	chamelium_get_captured_resolution(chamelium, &ret->width, &ret->height);
+	if (resolution_xml)
+		captured_resolution_from_xml(chamelium, resolution_xml,
+					     &ret->width, &ret->height);
+	else
+		chamelium_get_captured_resolution(chamelium, &ret->width,
+						  &ret->height);
 	ret->port = chamelium->capturing_port;
+	ret->borrowed = false;
 	xmlrpc_read_base64(&chamelium->env, frame_xml, &ret->size,
 			   (void*)&ret->bgr);
 
@@ -1211,7 +1698,7 @@ struct chamelium_frame_dump *chamelium_port_dump_pixels(struct chamelium *chamel
 			    port->id, x, y, w, h);
 	chamelium->capturing_port = port;
 
-	frame = frame_from_xml(chamelium, res);
+	frame = frame_from_xml(chamelium, res, NULL);
 	xmlrpc_DECREF(res);
 
 	return frame;
@@ -1410,16 +1897,90 @@ igt_crc_t *chamelium_read_captured_crcs(struct chamelium *chamelium,
 struct chamelium_frame_dump *chamelium_read_captured_frame(struct chamelium *chamelium,
 							   unsigned int index)
 {
-	xmlrpc_value *res;
+	struct chamelium_rpc_future *frame_future, *resolution_future;
+	xmlrpc_value *res, *resolution;
 	struct chamelium_frame_dump *frame;
 
-	res = chamelium_rpc(chamelium, NULL, "ReadCapturedFrame", "(i)", index);
-	frame = frame_from_xml(chamelium, res);
+	/* Don't wait for the frame to ask for its resolution. */
+	frame_future = chamelium_rpc_start(chamelium, "ReadCapturedFrame",
+					   "(i)", index);
+	resolution_future = chamelium_rpc_start(chamelium,
+						"GetCapturedResolution", "()");
+	res = chamelium_rpc_wait(frame_future);
+	resolution = chamelium_rpc_wait(resolution_future);
+
+	frame = frame_from_xml(chamelium, res, resolution);
+	xmlrpc_DECREF(resolution);
 	xmlrpc_DECREF(res);
 
 	return frame;
 }
 
+/**
+ * chamelium_stream_captured_frames:
+ * @chamelium: The Chamelium instance to use
+ * @stream: The stream to receive the frames from
+ * @first: The index of the first captured frame we want to get
+ * @count: The number of captured frames we want to get
+ *
+ * Starts streaming video frames captured during the last video capture on the
+ * Chamelium, rather than transferring them one by one over XML-RPC. The frames
+ * are then retrieved in order with #chamelium_stream_read_captured_frame, and
+ * the transfer is terminated with #chamelium_stream_stop_video_dump.
+ *
+ * Only the stand-in stream server of benchmarks/chamelium_stream can dump
+ * frames this way so far, real Chamelium boards don't implement this request,
+ * see #chamelium_stream_dump_video_frames.
+ *
+ * Returns: false if the stream server can't dump the frames, in which case
+ * they should be read with #chamelium_read_captured_frame instead.
+ */
+bool chamelium_stream_captured_frames(struct chamelium *chamelium,
+				      struct chamelium_stream *stream,
+				      unsigned int first, unsigned int count)
+{
+	chamelium_get_captured_resolution(chamelium, &chamelium->streamed_width,
+					  &chamelium->streamed_height);
+
+	return chamelium_stream_dump_video_frames(stream,
+						  chamelium->streamed_width,
+						  chamelium->streamed_height,
+						  first, count);
+}
+
+/**
+ * chamelium_stream_read_captured_frame:
+ * @chamelium: The Chamelium instance to use
+ * @stream: The stream passed to #chamelium_stream_captured_frames
+ *
+ * Retrieves the next video frame streamed since
+ * #chamelium_stream_captured_frames. The pixels aren't copied out of the
+ * stream: they are only valid until the next frame is read or the stream is
+ * stopped. The frame dump should still be freed using
+ * #chamelium_destroy_frame_dump.
+ *
+ * Returns: a chamelium_frame_dump struct
+ */
+struct chamelium_frame_dump *chamelium_stream_read_captured_frame(struct chamelium *chamelium,
+								  struct chamelium_stream *stream)
+{
+	struct chamelium_frame_dump *frame;
+	const unsigned char *bgr;
+
+	bgr = chamelium_stream_receive_video_frame(stream, NULL);
+	igt_assert_f(bgr, "Failed to receive a captured frame\n");
+
+	frame = malloc(sizeof(*frame));
+	frame->width = chamelium->streamed_width;
+	frame->height = chamelium->streamed_height;
+	frame->size = frame->width * frame->height * 3;
+	frame->port = chamelium->capturing_port;
+	frame->bgr = (unsigned char *) bgr;
+	frame->borrowed = true;
+
+	return frame;
+}
+
 /**
  * chamelium_get_captured_frame_count:
  * @chamelium: The Chamelium instance to use
@@ -2015,10 +2576,13 @@ void chamelium_crop_analog_frame(struct chamelium_frame_dump *dump, int width,
 		memcpy(q, p, width * 3);
 	}
 
-	free(dump->bgr);
+	if (!dump->borrowed)
+		free(dump->bgr);
 	dump->width = width;
 	dump->height = height;
+	dump->size = width * height * 3;
 	dump->bgr = bgr;
+	dump->borrowed = false;
 }
 
 /**
@@ -2054,54 +2618,269 @@ int chamelium_get_frame_limit(struct chamelium *chamelium,
 	return ret;
 }
 
-static uint32_t chamelium_xrgb_hash16(const unsigned char *buffer, int width,
-				      int height, int k, int m)
+/*
+ * The Chamelium hashes the frame as 4 interleaved lanes of pixels: pixel i
+ * goes to lane i % 4, and a lane sums the 0xBBGGRR values of its pixels
+ * weighted by their 1-based position in the lane (mod 2^64).
+ *
+ * The weighted sum over positions 1..n is computed with additions only, as
+ * (n + 1) * T(n) - (T(1) + ... + T(n)) with T(c) the plain sum of the first c
+ * values, so all lanes are computed in a single vectorizable pass. A band
+ * starting at lane position g0 contributes its local weighted sum plus g0
+ * times its plain sum, so bands can be hashed separately and combined
+ * exactly.
+ */
+#define CRC_LANES 4
+/* Pixels per band, a multiple of CRC_LANES */
+#define CRC_BAND_PIXELS (256 * 1024)
+#define CRC_MAX_THREADS 8
+
+struct chamelium_crc_band_sum {
+	uint64_t weighted[CRC_LANES];
+	uint64_t plain[CRC_LANES];
+};
+
+static void chamelium_xrgb_hash_band(const unsigned char *buffer, int n_pixels,
+				     struct chamelium_crc_band_sum *out)
 {
-	unsigned char r, g, b;
-	uint64_t sum = 0;
-	uint64_t count = 0;
-	uint64_t value;
-	uint32_t hash;
-	int index;
-	int i;
+	uint64_t plain[CRC_LANES] = {}, partial[CRC_LANES] = {};
+	int n_groups = n_pixels / CRC_LANES;
+	int tail = n_pixels % CRC_LANES;
+	int g, k;
 
-	for (i=0; i < width * height; i++) {
-		if ((i % m) != k)
-			continue;
+	for (g = 0; g < n_groups; g++) {
+		const unsigned char *group = buffer + g * CRC_LANES * 4;
+
+		for (k = 0; k < CRC_LANES; k++) {
+			const unsigned char *pixel = group + k * 4;
+
+			plain[k] += pixel[2] | (pixel[1] << 8) | (pixel[0] << 16);
+			partial[k] += plain[k];
+		}
+	}
+
+	for (k = 0; k < tail; k++) {
+		const unsigned char *pixel = buffer + (n_groups * CRC_LANES + k) * 4;
+
+		plain[k] += pixel[2] | (pixel[1] << 8) | (pixel[0] << 16);
+		partial[k] += plain[k];
+	}
+
+	for (k = 0; k < CRC_LANES; k++) {
+		uint64_t n = n_groups + (k < tail);
+
+		out->weighted[k] = (n + 1) * plain[k] - partial[k];
+		out->plain[k] = plain[k];
+	}
+}
+
+static void chamelium_crc_job_init(struct chamelium_fb_crc_async_data *job,
+				   cairo_surface_t *fb_surface)
+{
+	job->fb_surface = fb_surface;
+	job->buffer = cairo_image_surface_get_data(fb_surface);
+	job->n_pixels = cairo_image_surface_get_width(fb_surface) *
+		cairo_image_surface_get_height(fb_surface);
+
+	job->n_bands = max(1, (job->n_pixels + CRC_BAND_PIXELS - 1) / CRC_BAND_PIXELS);
+	job->next_band = 0;
+	job->done_bands = 0;
+	job->bands = calloc(job->n_bands, sizeof(*job->bands));
+	igt_assert(job->bands);
+}
+
+static void chamelium_crc_job_result(struct chamelium_fb_crc_async_data *job,
+				     igt_crc_t *out)
+{
+	uint64_t sums[CRC_LANES] = {};
+	int b, k;
+
+	/* Bands are combined in order, although the sum is commutative. */
+	for (b = 0; b < job->n_bands; b++) {
+		uint64_t first_position = (uint64_t)b * CRC_BAND_PIXELS / CRC_LANES;
+
+		for (k = 0; k < CRC_LANES; k++)
+			sums[k] += job->bands[b].weighted[k] +
+				first_position * job->bands[b].plain[k];
+	}
+
+	/* The Chamelium reports the last lane first. */
+	for (k = 0; k < CRC_LANES; k++) {
+		uint64_t sum = sums[CRC_LANES - k - 1];
+
+		out->crc[k] = ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+	}
+	out->n_words = CRC_LANES;
+
+	free(job->bands);
+	job->bands = NULL;
+}
+
+/*
+ * Worker threads shared by all the CRC calculations, started on first use.
+ * Whoever waits for a calculation also hashes its unclaimed bands, so
+ * calculations complete even without workers (e.g. in a forked child).
+ * Forks wait for the bands being hashed, so that a child never waits for a
+ * band claimed by a worker it doesn't have.
+ */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	struct igt_list_head jobs;
+	int running; /* bands being hashed outside of the lock */
+	bool started;
+} crc_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+	.jobs = { &crc_pool.jobs, &crc_pool.jobs },
+};
+
+/* Called with crc_pool.lock held, the job must have unclaimed bands. */
+static void chamelium_crc_run_band(struct chamelium_fb_crc_async_data *job)
+{
+	int band = job->next_band++;
+	int first_pixel = band * CRC_BAND_PIXELS;
+
+	if (job->next_band == job->n_bands)
+		igt_list_del(&job->link);
+
+	crc_pool.running++;
+	pthread_mutex_unlock(&crc_pool.lock);
+	chamelium_xrgb_hash_band(job->buffer + first_pixel * 4,
+				 min(job->n_pixels - first_pixel, CRC_BAND_PIXELS),
+				 &job->bands[band]);
+	pthread_mutex_lock(&crc_pool.lock);
 
-		index = i * 4;
+	crc_pool.running--;
+	if (++job->done_bands == job->n_bands || !crc_pool.running)
+		pthread_cond_broadcast(&crc_pool.done);
+}
+
+static void *chamelium_crc_worker(void *data)
+{
+	pthread_mutex_lock(&crc_pool.lock);
+	for (;;) {
+		struct chamelium_fb_crc_async_data *job;
+
+		while (igt_list_empty(&crc_pool.jobs))
+			pthread_cond_wait(&crc_pool.work, &crc_pool.lock);
+
+		job = igt_list_first_entry(&crc_pool.jobs, job, link);
+		chamelium_crc_run_band(job);
+	}
+
+	return NULL;
+}
+
+static void chamelium_crc_pool_atfork_prepare(void)
+{
+	pthread_mutex_lock(&crc_pool.lock);
+	while (crc_pool.running)
+		pthread_cond_wait(&crc_pool.done, &crc_pool.lock);
+}
+
+static void chamelium_crc_pool_atfork_parent(void)
+{
+	pthread_mutex_unlock(&crc_pool.lock);
+}
+
+/*
+ * Only the forking thread survives in the child. No band is in flight, so
+ * the queued jobs are left for the child's waiters and workers to finish.
+ */
+static void chamelium_crc_pool_atfork_child(void)
+{
+	pthread_mutex_init(&crc_pool.lock, NULL);
+	pthread_cond_init(&crc_pool.work, NULL);
+	pthread_cond_init(&crc_pool.done, NULL);
+	crc_pool.started = false;
+}
+
+/* Called with crc_pool.lock held. */
+static void chamelium_crc_pool_start(void)
+{
+	static bool atfork_registered;
+	int n_threads = min_t(long, sysconf(_SC_NPROCESSORS_ONLN), CRC_MAX_THREADS);
+	sigset_t all, old;
+
+	if (crc_pool.started)
+		return;
+	crc_pool.started = true;
 
-		r = buffer[index + 2];
-		g = buffer[index + 1];
-		b = buffer[index + 0];
+	if (!atfork_registered) {
+		pthread_atfork(chamelium_crc_pool_atfork_prepare,
+			       chamelium_crc_pool_atfork_parent,
+			       chamelium_crc_pool_atfork_child);
+		atfork_registered = true;
+	}
+
+	/* Leave the signals to the test's threads. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (int i = 0; i < n_threads; i++) {
+		pthread_t thread;
 
-		value = r | (g << 8) | (b << 16);
-		sum += ++count * value;
+		if (pthread_create(&thread, NULL, chamelium_crc_worker, NULL))
+			break;
+		pthread_detach(thread);
 	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
 
-	hash = ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+static void chamelium_crc_job_queue(struct chamelium_fb_crc_async_data *job)
+{
+	pthread_mutex_lock(&crc_pool.lock);
+	chamelium_crc_pool_start();
+	igt_list_add_tail(&job->link, &crc_pool.jobs);
+	pthread_cond_broadcast(&crc_pool.work);
+	pthread_mutex_unlock(&crc_pool.lock);
+}
 
-	return hash;
+static void chamelium_crc_job_wait(struct chamelium_fb_crc_async_data *job)
+{
+	pthread_mutex_lock(&crc_pool.lock);
+	while (job->next_band < job->n_bands)
+		chamelium_crc_run_band(job);
+	while (job->done_bands < job->n_bands)
+		pthread_cond_wait(&crc_pool.done, &crc_pool.lock);
+	pthread_mutex_unlock(&crc_pool.lock);
 }
 
 static void chamelium_do_calculate_fb_crc(cairo_surface_t *fb_surface,
 					  igt_crc_t *out)
 {
-	unsigned char *buffer;
-	int n = 4;
-	int w, h;
-	int i, j;
+	struct chamelium_fb_crc_async_data job;
 
-	buffer = cairo_image_surface_get_data(fb_surface);
-	w = cairo_image_surface_get_width(fb_surface);
-	h = cairo_image_surface_get_height(fb_surface);
+	chamelium_crc_job_init(&job, fb_surface);
 
-	for (i = 0; i < n; i++) {
-		j = n - i - 1;
-		out->crc[i] = chamelium_xrgb_hash16(buffer, w, h, j, n);
+	if (job.n_bands == 1) {
+		chamelium_xrgb_hash_band(job.buffer, job.n_pixels, &job.bands[0]);
+	} else {
+		chamelium_crc_job_queue(&job);
+		chamelium_crc_job_wait(&job);
 	}
 
-	out->n_words = n;
+	chamelium_crc_job_result(&job, out);
+}
+
+/**
+ * chamelium_calculate_surface_crc:
+ * @surface: The cairo image surface to calculate the CRC for
+ *
+ * Calculates the CRC for the provided 32bpp image surface, using the
+ * Chamelium's CRC algorithm. This calculates the CRC in a synchronous fashion.
+ *
+ * Returns: The calculated CRC
+ */
+igt_crc_t *chamelium_calculate_surface_crc(cairo_surface_t *surface)
+{
+	igt_crc_t *ret = calloc(1, sizeof(igt_crc_t));
+
+	chamelium_do_calculate_fb_crc(surface, ret);
+
+	return ret;
 }
 
 /**
@@ -2116,30 +2895,19 @@ static void chamelium_do_calculate_fb_crc(cairo_surface_t *fb_surface,
  */
 igt_crc_t *chamelium_calculate_fb_crc(int fd, struct igt_fb *fb)
 {
-	igt_crc_t *ret = calloc(1, sizeof(igt_crc_t));
+	igt_crc_t *ret;
 	cairo_surface_t *fb_surface;
 
 	/* Get the cairo surface for the framebuffer */
 	fb_surface = igt_get_cairo_surface(fd, fb);
 
-	chamelium_do_calculate_fb_crc(fb_surface, ret);
+	ret = chamelium_calculate_surface_crc(fb_surface);
 
 	cairo_surface_destroy(fb_surface);
 
 	return ret;
 }
 
-static void *chamelium_calculate_fb_crc_async_work(void *data)
-{
-	struct chamelium_fb_crc_async_data *fb_crc;
-
-	fb_crc = (struct chamelium_fb_crc_async_data *) data;
-
-	chamelium_do_calculate_fb_crc(fb_crc->fb_surface, fb_crc->ret);
-
-	return NULL;
-}
-
 /**
  * chamelium_calculate_fb_crc_launch:
  * @fd: The drm file descriptor
@@ -2147,7 +2915,7 @@ static void *chamelium_calculate_fb_crc_async_work(void *data)
  *
  * Launches the CRC calculation for the provided framebuffer, using the
  * Chamelium's CRC algorithm. This calculates the CRC in an asynchronous
- * fashion.
+ * fashion, on a pool of worker threads shared with other calculations.
  *
  * The returned structure should be passed to a subsequent call to
  * chamelium_calculate_fb_crc_result. It should not be freed.
@@ -2163,10 +2931,8 @@ struct chamelium_fb_crc_async_data *chamelium_calculate_fb_crc_async_start(int f
 	fb_crc->ret = calloc(1, sizeof(igt_crc_t));
 
 	/* Get the cairo surface for the framebuffer */
-	fb_crc->fb_surface = igt_get_cairo_surface(fd, fb);
-
-	pthread_create(&fb_crc->thread_id, NULL,
-		       chamelium_calculate_fb_crc_async_work, fb_crc);
+	chamelium_crc_job_init(fb_crc, igt_get_cairo_surface(fd, fb));
+	chamelium_crc_job_queue(fb_crc);
 
 	return fb_crc;
 }
@@ -2184,7 +2950,9 @@ igt_crc_t *chamelium_calculate_fb_crc_async_finish(struct chamelium_fb_crc_async
 {
 	igt_crc_t *ret;
 
-	pthread_join(fb_crc->thread_id, NULL);
+	chamelium_crc_job_wait(fb_crc);
+	chamelium_crc_job_result(fb_crc, fb_crc->ret);
+	cairo_surface_destroy(fb_crc->fb_surface);
 
 	ret = fb_crc->ret;
 	free(fb_crc);
@@ -2220,19 +2988,6 @@ static unsigned int chamelium_get_port_type(struct chamelium *chamelium,
 	return port_type;
 }
 
-static bool chamelium_has_video_support(struct chamelium *chamelium,
-					int port_id)
-{
-	xmlrpc_value *res;
-	int has_video_support;
-
-	res = chamelium_rpc(chamelium, NULL, "HasVideoSupport", "(i)", port_id);
-	xmlrpc_read_bool(&chamelium->env, res, &has_video_support);
-	xmlrpc_DECREF(res);
-
-	return has_video_support;
-}
-
 /**
  * chamelium_get_video_ports: retrieve a list of video port IDs
  *
@@ -2242,8 +2997,9 @@ static size_t chamelium_get_video_ports(struct chamelium *chamelium,
 					int port_ids[static CHAMELIUM_MAX_PORTS])
 {
 	xmlrpc_value *res, *res_port;
-	int res_len, i, port_id;
+	int res_len, i, port_id, has_video_support;
 	size_t port_ids_len = 0;
+	struct chamelium_rpc_batch batch = {};
 
 	res = __chamelium_rpc(chamelium, NULL, "GetSupportedInputs", "()");
 	if (chamelium->env.fault_occurred) {
@@ -2258,14 +3014,32 @@ static size_t chamelium_get_video_ports(struct chamelium *chamelium,
 		xmlrpc_read_int(&chamelium->env, res_port, &port_id);
 		xmlrpc_DECREF(res_port);
 
-		if (!chamelium_has_video_support(chamelium, port_id))
+		chamelium_rpc_batch_add(chamelium, &batch, "HasVideoSupport",
+					"(i)", port_id);
+	}
+	xmlrpc_DECREF(res);
+
+	igt_assert_f(chamelium_rpc_batch_run(chamelium, &batch),
+		     "Chamelium RPC call failed: %s\n",
+		     chamelium->env.fault_string);
+
+	for (i = 0; i < batch.count; i++) {
+		xmlrpc_read_bool(&chamelium->env, batch.results[i],
+				 &has_video_support);
+		if (!has_video_support)
 			continue;
 
+		/* The port ID is the only parameter of the call. */
+		xmlrpc_array_read_item(&chamelium->env, batch.params[i], 0,
+				       &res_port);
+		xmlrpc_read_int(&chamelium->env, res_port, &port_id);
+		xmlrpc_DECREF(res_port);
+
 		igt_assert(port_ids_len < CHAMELIUM_MAX_PORTS);
 		port_ids[port_ids_len] = port_id;
 		port_ids_len++;
 	}
-	xmlrpc_DECREF(res);
+	chamelium_rpc_batch_fini(&batch);
 
 	return port_ids_len;
 }
@@ -2623,6 +3397,18 @@ static void chamelium_exit_handler(int sig)
  */
 void chamelium_deinit_rpc_only(struct chamelium *chamelium)
 {
+	chamelium_log_rpc_stats_level(chamelium, IGT_LOG_DEBUG);
+	for (int i = 0; i < chamelium->rpc_stats_count; i++) {
+		free(chamelium->rpc_stats[i].method);
+		igt_stats_fini(&chamelium->rpc_stats[i].latency);
+	}
+	free(chamelium->rpc_stats);
+
+	if (chamelium->server)
+		xmlrpc_server_info_free(chamelium->server);
+	if (chamelium->client)
+		xmlrpc_client_destroy(chamelium->client);
+	free(chamelium->url);
 	xmlrpc_env_clean(&chamelium->env);
 	free(chamelium);
 }
@@ -2677,6 +3463,14 @@ struct chamelium *chamelium_init_rpc_only(void)
 	if (!chamelium_read_config(chamelium))
 		goto error;
 
+	chamelium->server = xmlrpc_server_info_new(&chamelium->env,
+						   chamelium->url);
+	if (chamelium->env.fault_occurred) {
+		igt_debug("Invalid chamelium URL %s: %s\n", chamelium->url,
+			  chamelium->env.fault_string);
+		goto error;
+	}
+
 	return chamelium;
 error:
 	chamelium_deinit_rpc_only(chamelium);
@@ -2760,14 +3554,24 @@ void chamelium_deinit(struct chamelium *chamelium)
 {
 	int i;
 	struct chamelium_edid *pos, *tmp;
+	struct chamelium_rpc_batch batch = {};
 
 	/* We want to make sure we leave all of the ports plugged in, since
 	 * testing setups requiring multiple monitors are probably using the
 	 * chamelium to provide said monitors
 	 */
-	chamelium_reset(chamelium);
-	for (i = 0; i < chamelium->port_count; i++)
-		chamelium_plug(chamelium, &chamelium->ports[i]);
+	igt_debug("Resetting the chamelium\n");
+	chamelium_rpc_batch_add(chamelium, &batch, "Reset", "()");
+	for (i = 0; i < chamelium->port_count; i++) {
+		igt_debug("Plugging %s (Chamelium port ID %d)\n",
+			  chamelium->ports[i].name, chamelium->ports[i].id);
+		chamelium_rpc_batch_add(chamelium, &batch, "Plug", "(i)",
+					chamelium->ports[i].id);
+	}
+	igt_assert_f(chamelium_rpc_batch_run(chamelium, &batch),
+		     "Chamelium RPC call failed: %s\n",
+		     chamelium->env.fault_string);
+	chamelium_rpc_batch_fini(&batch);
 
 	igt_assert(chamelium->drm_fd != -1);
 	for (i = 0; i < chamelium->port_count; i++)
@@ -2787,8 +3591,6 @@ void chamelium_deinit(struct chamelium *chamelium)
 
 	close(chamelium->drm_fd);
 
-	xmlrpc_client_destroy(chamelium->client);
-
 	for (i = 0; i < chamelium->port_count; i++)
 		free(chamelium->ports[i].name);
 
@@ -2799,27 +3601,24 @@ bool chamelium_plug_all(struct chamelium *chamelium)
 {
 	size_t port_count;
 	int port_ids[CHAMELIUM_MAX_PORTS];
-	xmlrpc_value *v;
+	struct chamelium_rpc_batch batch = {};
+	bool ret;
 
 	port_count = chamelium_get_video_ports(chamelium, port_ids);
 	if (port_count <= 0)
 		return false;
 
-	for (int i = 0; i < port_count; ++i) {
-		v = __chamelium_rpc(chamelium, NULL, "Plug", "(i)", port_ids[i]);
-
-		if (v != NULL)
-			xmlrpc_DECREF(v);
+	for (int i = 0; i < port_count; ++i)
+		chamelium_rpc_batch_add(chamelium, &batch, "Plug", "(i)",
+					port_ids[i]);
 
-		if (chamelium->env.fault_occurred) {
-			igt_debug("Chamelium RPC call failed: %s\n",
-			     chamelium->env.fault_string);
-
-			return false;
-		}
-	}
+	ret = chamelium_rpc_batch_run(chamelium, &batch);
+	if (!ret)
+		igt_debug("Chamelium RPC call failed: %s\n",
+			  chamelium->env.fault_string);
+	chamelium_rpc_batch_fini(&batch);
 
-	return true;
+	return ret;
 }
 
 bool chamelium_wait_all_configured_ports_connected(struct chamelium *chamelium, int drm_fd)
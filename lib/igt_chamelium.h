@@ -33,6 +33,7 @@
 
 #include "igt_debugfs.h"
 #include "igt_kms.h"
+#include "igt_stats.h"
 
 struct igt_fb;
 struct edid;
@@ -41,6 +42,7 @@ struct chamelium;
 struct chamelium_port;
 struct chamelium_frame_dump;
 struct chamelium_fb_crc_async_data;
+struct chamelium_stream;
 
 /**
  * chamelium_check:
@@ -210,10 +212,16 @@ igt_crc_t *chamelium_read_captured_crcs(struct chamelium *chamelium,
 					int *frame_count);
 struct chamelium_frame_dump *chamelium_read_captured_frame(struct chamelium *chamelium,
 							   unsigned int index);
+bool chamelium_stream_captured_frames(struct chamelium *chamelium,
+				      struct chamelium_stream *stream,
+				      unsigned int first, unsigned int count);
+struct chamelium_frame_dump *chamelium_stream_read_captured_frame(struct chamelium *chamelium,
+								  struct chamelium_stream *stream);
 struct chamelium_frame_dump *chamelium_port_dump_pixels(struct chamelium *chamelium,
 							struct chamelium_port *port,
 							int x, int y,
 							int w, int h);
+igt_crc_t *chamelium_calculate_surface_crc(cairo_surface_t *surface);
 igt_crc_t *chamelium_calculate_fb_crc(int fd, struct igt_fb *fb);
 struct chamelium_fb_crc_async_data *chamelium_calculate_fb_crc_async_start(int fd,
 									   struct igt_fb *fb);
@@ -242,6 +250,9 @@ bool chamelium_frame_match_or_dump(struct chamelium *chamelium,
 void chamelium_crop_analog_frame(struct chamelium_frame_dump *dump, int width,
 				 int height);
 void chamelium_destroy_frame_dump(struct chamelium_frame_dump *dump);
+void chamelium_log_rpc_stats(struct chamelium *chamelium);
+igt_stats_t *chamelium_get_rpc_latency(struct chamelium *chamelium,
+				       const char *method);
 void chamelium_destroy_audio_file(struct chamelium_audio_file *audio_file);
 void chamelium_infoframe_destroy(struct chamelium_infoframe *infoframe);
 bool chamelium_plug_all(struct chamelium *chamelium);
@@ -28,6 +28,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netdb.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -41,6 +42,11 @@
 #define STREAM_VERSION_MAJOR 1
 #define STREAM_VERSION_MINOR 0
 
+/* Frames being received or waiting to be consumed during a video dump */
+#define STREAM_VIDEO_BUFFERS 2
+/* frame number (4), width (2), height (2), channel (1), padding (3) */
+#define STREAM_VIDEO_FRAME_HEADER_SIZE 12
+
 enum stream_error {
 	STREAM_ERROR_NONE = 0,
 	STREAM_ERROR_COMMAND = 1,
@@ -71,11 +77,37 @@ enum stream_message_type {
 	STREAM_MESSAGE_STOP_DUMP_AUDIO = 8,
 };
 
+/*
+ * A video dump in progress. The frames are received by a thread, straight
+ * into preallocated buffers, while the caller looks at the previous ones.
+ */
+struct chamelium_stream_video {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	int width, height;
+	size_t frame_size;
+	unsigned int count;
+
+	unsigned char *buffers[STREAM_VIDEO_BUFFERS];
+	unsigned int frame_numbers[STREAM_VIDEO_BUFFERS];
+
+	/* Protected by lock */
+	unsigned int received;
+	unsigned int released;
+	bool consuming;
+	bool stop;
+	bool error;
+};
+
 struct chamelium_stream {
 	char *host;
 	unsigned int port;
 
 	int fd;
+
+	struct chamelium_stream_video *video;
 };
 
 static const char *stream_error_str(enum stream_error err)
@@ -537,19 +569,286 @@ bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client)
 	return true;
 }
 
+/* Reads the next video frame into its buffer. */
+static bool chamelium_stream_read_video_frame(struct chamelium_stream *client,
+					      unsigned int slot)
+{
+	struct chamelium_stream_video *video = client->video;
+	enum stream_message_kind kind;
+	enum stream_message_type type;
+	enum stream_error err;
+	size_t len;
+	char header[STREAM_VIDEO_FRAME_HEADER_SIZE];
+
+	if (!chamelium_stream_read_header(client, &kind, &type, &err, &len))
+		return false;
+
+	if (kind != STREAM_MESSAGE_DATA || type != STREAM_MESSAGE_VIDEO_FRAME) {
+		igt_warn("Expected a video frame, got kind %d type %d\n",
+			 kind, type);
+		return false;
+	}
+	if (err != STREAM_ERROR_NONE) {
+		igt_warn("Received error: %s (%d)\n", stream_error_str(err), err);
+		return false;
+	}
+	if (len != sizeof(header) + video->frame_size) {
+		igt_warn("Received invalid video frame size "
+			 "(got %zu bytes, want %zu bytes)\n",
+			 len, sizeof(header) + video->frame_size);
+		return false;
+	}
+
+	if (!read_whole(client->fd, header, sizeof(header)))
+		return false;
+
+	if (ntohs(*(uint16_t *) &header[4]) != video->width ||
+	    ntohs(*(uint16_t *) &header[6]) != video->height) {
+		igt_warn("Received a %dx%d video frame, want %dx%d\n",
+			 ntohs(*(uint16_t *) &header[4]),
+			 ntohs(*(uint16_t *) &header[6]),
+			 video->width, video->height);
+		return false;
+	}
+	video->frame_numbers[slot] = ntohl(*(uint32_t *) &header[0]);
+
+	return read_whole(client->fd, video->buffers[slot], video->frame_size);
+}
+
+static void *chamelium_stream_video_thread(void *data)
+{
+	struct chamelium_stream *client = data;
+	struct chamelium_stream_video *video = client->video;
+	unsigned int received;
+
+	pthread_mutex_lock(&video->lock);
+	while (video->received < video->count) {
+		while (video->received - video->released == STREAM_VIDEO_BUFFERS &&
+		       !video->stop)
+			pthread_cond_wait(&video->cond, &video->lock);
+		if (video->stop)
+			break;
+
+		received = video->received;
+		pthread_mutex_unlock(&video->lock);
+
+		/* Nobody else touches the socket or that buffer meanwhile. */
+		if (!chamelium_stream_read_video_frame(client,
+						       received % STREAM_VIDEO_BUFFERS)) {
+			pthread_mutex_lock(&video->lock);
+			video->error = true;
+			pthread_cond_broadcast(&video->cond);
+			break;
+		}
+
+		pthread_mutex_lock(&video->lock);
+		video->received++;
+		pthread_cond_broadcast(&video->cond);
+	}
+	pthread_mutex_unlock(&video->lock);
+
+	return NULL;
+}
+
+static void chamelium_stream_video_free(struct chamelium_stream *client)
+{
+	struct chamelium_stream_video *video = client->video;
+
+	for (int i = 0; i < STREAM_VIDEO_BUFFERS; i++)
+		free(video->buffers[i]);
+	pthread_mutex_destroy(&video->lock);
+	pthread_cond_destroy(&video->cond);
+	free(video);
+	client->video = NULL;
+}
+
+/**
+ * chamelium_stream_dump_video_frames:
+ * @width: width of the captured frames
+ * @height: height of the captured frames
+ * @first: index of the first captured frame to dump
+ * @count: number of frames to dump
+ *
+ * Starts dumping frames of the last video capture. The caller can then call
+ * #chamelium_stream_receive_video_frame to receive them, the next frame is
+ * received in the background while the caller processes the current one.
+ * The dump must be terminated with #chamelium_stream_stop_video_dump.
+ *
+ * The dump request carries a frame index and count. That is the layout of
+ * the stand-in server of benchmarks/chamelium_stream, not the one of the
+ * stream server of real Chamelium boards, which takes video memory
+ * addresses. Real boards are not expected to dump frames this way: callers
+ * must read the frames over XML-RPC when this fails.
+ *
+ * Returns false if the dump couldn't be started, for instance if the stream
+ * server doesn't support dumping video frames.
+ */
+bool chamelium_stream_dump_video_frames(struct chamelium_stream *client,
+					int width, int height,
+					unsigned int first, unsigned int count)
+{
+	struct chamelium_stream_video *video;
+	char config_req[4], dump_req[6];
+
+	igt_assert(!client->video);
+	igt_assert(count <= UINT16_MAX);
+
+	igt_debug("Dumping %u %dx%d video frames from frame %u\n",
+		  count, width, height, first);
+
+	*(uint16_t *) &config_req[0] = htons(width);
+	*(uint16_t *) &config_req[2] = htons(height);
+	if (!chamelium_stream_call(client, STREAM_MESSAGE_VIDEO_STREAM,
+				   config_req, sizeof(config_req), NULL, 0))
+		return false;
+
+	video = calloc(1, sizeof(*video));
+	video->width = width;
+	video->height = height;
+	video->frame_size = (size_t) width * height * 3;
+	video->count = count;
+	for (int i = 0; i < STREAM_VIDEO_BUFFERS; i++) {
+		video->buffers[i] = malloc(video->frame_size);
+		igt_assert(video->buffers[i]);
+	}
+	pthread_mutex_init(&video->lock, NULL);
+	pthread_cond_init(&video->cond, NULL);
+	client->video = video;
+
+	/* Stand-in layout only, see above */
+	*(uint32_t *) &dump_req[0] = htonl(first);
+	*(uint16_t *) &dump_req[4] = htons(count);
+	if (!chamelium_stream_call(client, STREAM_MESSAGE_VIDEO_FRAME,
+				   dump_req, sizeof(dump_req), NULL, 0)) {
+		chamelium_stream_video_free(client);
+		return false;
+	}
+
+	if (pthread_create(&video->thread, NULL,
+			   chamelium_stream_video_thread, client)) {
+		igt_warn("Failed to start the video thread: %s\n", strerror(errno));
+		chamelium_stream_video_free(client);
+		return false;
+	}
+
+	return true;
+}
+
 /**
- * chamelium_stream_init:
+ * chamelium_stream_receive_video_frame:
+ * @frame_number: if non-NULL, will be set to the dumped frame number
  *
- * Connects to the Chamelium streaming server.
+ * Receives the next frame of the video dump started with
+ * #chamelium_stream_dump_video_frames, as width * height BGR pixels.
+ *
+ * Returns: the pixels, owned by the stream and valid until the next call, or
+ * NULL on error or once all the frames were received.
  */
-struct chamelium_stream *chamelium_stream_init(void)
+const unsigned char *chamelium_stream_receive_video_frame(struct chamelium_stream *client,
+							  unsigned int *frame_number)
 {
-	struct chamelium_stream *client;
+	struct chamelium_stream_video *video = client->video;
+	const unsigned char *frame = NULL;
+	unsigned int slot;
 
-	client = calloc(1, sizeof(*client));
+	igt_assert(video);
 
-	if (!chamelium_stream_read_config(client))
-		goto error_client;
+	pthread_mutex_lock(&video->lock);
+
+	/* Hand the buffer of the previous frame back to the thread. */
+	if (video->consuming) {
+		video->released++;
+		video->consuming = false;
+		pthread_cond_broadcast(&video->cond);
+	}
+
+	if (video->released == video->count)
+		goto out;
+
+	while (video->received == video->released && !video->error)
+		pthread_cond_wait(&video->cond, &video->lock);
+	if (video->received == video->released)
+		goto out;
+
+	slot = video->released % STREAM_VIDEO_BUFFERS;
+	if (frame_number)
+		*frame_number = video->frame_numbers[slot];
+	frame = video->buffers[slot];
+	video->consuming = true;
+
+out:
+	pthread_mutex_unlock(&video->lock);
+	return frame;
+}
+
+/**
+ * chamelium_stream_stop_video_dump:
+ *
+ * Terminates the video dump started with #chamelium_stream_dump_video_frames,
+ * whether all the frames were received or not. The frames not received yet
+ * are dropped.
+ */
+bool chamelium_stream_stop_video_dump(struct chamelium_stream *client)
+{
+	struct chamelium_stream_video *video = client->video;
+	enum stream_message_kind kind;
+	enum stream_message_type type;
+	enum stream_error err;
+	bool error;
+	size_t len;
+
+	igt_assert(video);
+
+	pthread_mutex_lock(&video->lock);
+	video->stop = true;
+	pthread_cond_broadcast(&video->cond);
+	pthread_mutex_unlock(&video->lock);
+	pthread_join(video->thread, NULL);
+
+	error = video->error;
+	chamelium_stream_video_free(client);
+	if (error)
+		return false;
+
+	igt_debug("Stopping video dump\n");
+
+	if (!chamelium_stream_write_request(client,
+					    STREAM_MESSAGE_STOP_DUMP_VIDEO,
+					    NULL, 0))
+		return false;
+
+	/* Drop the frames sent before the server got the request. */
+	while (true) {
+		if (!chamelium_stream_read_header(client, &kind, &type,
+						  &err, &len))
+			return false;
+
+		if (kind == STREAM_MESSAGE_RESPONSE)
+			break;
+
+		if (!read_and_discard(client->fd, len))
+			return false;
+	}
+
+	if (type != STREAM_MESSAGE_STOP_DUMP_VIDEO) {
+		igt_warn("Unexpected response type %d\n", type);
+		return false;
+	}
+	if (err != STREAM_ERROR_NONE) {
+		igt_warn("Received error: %s (%d)\n",
+			 stream_error_str(err), err);
+		return false;
+	}
+	if (len != 0) {
+		igt_warn("Expected an empty response, got %zu bytes\n", len);
+		return false;
+	}
+
+	return true;
+}
+
+static struct chamelium_stream *chamelium_stream_start(struct chamelium_stream *client)
+{
 	if (!chamelium_stream_connect(client))
 		goto error_client;
 	if (!chamelium_stream_check_version(client))
@@ -560,13 +859,58 @@ struct chamelium_stream *chamelium_stream_init(void)
 error_fd:
 	close(client->fd);
 error_client:
+	free(client->host);
 	free(client);
 	return NULL;
 }
 
+/**
+ * chamelium_stream_init:
+ *
+ * Connects to the Chamelium streaming server.
+ */
+struct chamelium_stream *chamelium_stream_init(void)
+{
+	struct chamelium_stream *client;
+
+	client = calloc(1, sizeof(*client));
+
+	if (!chamelium_stream_read_config(client)) {
+		free(client->host);
+		free(client);
+		return NULL;
+	}
+
+	return chamelium_stream_start(client);
+}
+
+/**
+ * chamelium_stream_init_for_host:
+ * @host: host name or address of the streaming server
+ * @port: TCP port of the streaming server
+ *
+ * Connects to a streaming server at the given address rather than the one of
+ * the Chamelium from the configuration file, e.g. a stand-in server.
+ */
+struct chamelium_stream *chamelium_stream_init_for_host(const char *host,
+							unsigned int port)
+{
+	struct chamelium_stream *client;
+
+	client = calloc(1, sizeof(*client));
+	client->host = strdup(host);
+	client->port = port;
+
+	return chamelium_stream_start(client);
+}
+
 void chamelium_stream_deinit(struct chamelium_stream *client)
 {
+	if (client->video)
+		chamelium_stream_stop_video_dump(client);
+
 	if (close(client->fd) != 0)
 		igt_warn("close failed: %s\n", strerror(errno));
+	free(client->host);
 	free(client);
 }
@@ -39,6 +39,8 @@ enum chamelium_stream_realtime_mode {
 struct chamelium_stream;
 
 struct chamelium_stream *chamelium_stream_init(void);
+struct chamelium_stream *chamelium_stream_init_for_host(const char *host,
+							unsigned int port);
 void chamelium_stream_deinit(struct chamelium_stream *client);
 bool chamelium_stream_dump_realtime_audio(struct chamelium_stream *client,
 					  enum chamelium_stream_realtime_mode mode);
@@ -46,5 +48,11 @@ bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
 					     size_t *page_count,
 					     int32_t **buf, size_t *buf_len);
 bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client);
+bool chamelium_stream_dump_video_frames(struct chamelium_stream *client,
+					int width, int height,
+					unsigned int first, unsigned int count);
+const unsigned char *chamelium_stream_receive_video_frame(struct chamelium_stream *client,
+							  unsigned int *frame_number);
+bool chamelium_stream_stop_video_dump(struct chamelium_stream *client);
 
 #endif
@@ -36,6 +36,7 @@
 #include <unistd.h>
 #include <i915_drm.h>
 #include <poll.h>
+#include <byteswap.h>
 
 #include "drmtest.h"
 #include "igt_aux.h"
@@ -71,6 +72,11 @@
  * igt_assert_crc_equal() to inspect CRC values captured by the same
  * #igt_pipe_crc_t object.
  *
+ * Tests capturing CRCs every frame, possibly on several pipes at once, can use
+ * an #igt_crc_collector_t instead of reading each CRC in turn: it waits for
+ * all of its pipes in a single poll loop, reads all the entries available at
+ * once and keeps the most recent CRCs of each pipe.
+ *
  * # Other debugfs interface wrappers
  *
  * This covers the miscellaneous debugfs interface wrappers:
@@ -561,6 +567,14 @@ char *igt_crc_to_string(igt_crc_t *crc)
 #define MAX_CRC_ENTRIES 10
 #define MAX_LINE_LEN (10 + 11 * MAX_CRC_ENTRIES + 1)
 
+#define CRC_READ_BUF_SIZE (64 * MAX_LINE_LEN)
+
+/* CRC entries read from a CRC data file, but not parsed yet */
+struct crc_reader {
+	char buf[CRC_READ_BUF_SIZE];
+	int start, end;
+};
+
 struct _igt_pipe_crc {
 	int fd;
 	int dir;
@@ -570,6 +584,26 @@ struct _igt_pipe_crc {
 
 	enum pipe pipe;
 	char *source;
+
+	struct crc_reader reader;
+};
+
+struct crc_source {
+	int fd;
+	bool eof;
+	struct crc_reader *reader;
+	igt_pipe_crc_t *pipe_crc; /* NULL if the collector owns the reader */
+
+	igt_crc_t *ring;
+	unsigned int count; /* CRCs received so far */
+};
+
+struct _igt_crc_collector {
+	unsigned int ring_size;
+	int n_sources;
+	struct crc_source *sources;
+	struct pollfd *pfd;
+	int *pfd_source;
 };
 
 /**
@@ -797,52 +831,190 @@ void igt_pipe_crc_free(igt_pipe_crc_t *pipe_crc)
 	free(pipe_crc);
 }
 
-static bool pipe_crc_init_from_string(igt_pipe_crc_t *pipe_crc, igt_crc_t *crc,
-				      const char *line)
+#define BYTES(x) (0x0101010101010101ull * (x))
+
+/* Sets the top bit of each byte of @x in [@lo, @hi], for bytes below 0x80. */
+#define BYTES_IN_RANGE(x, lo, hi) \
+	(((x) + BYTES(0x80 - (lo))) & ~((x) + BYTES(0x7f - (hi))) & BYTES(0x80))
+
+/* Parses 8 hex digits at once. */
+static bool parse_hex8(const char *str, uint32_t *out)
+{
+	uint64_t x, digits, letters;
+
+	memcpy(&x, str, sizeof(x));
+	if (x & BYTES(0x80))
+		return false;
+
+	digits = BYTES_IN_RANGE(x, '0', '9');
+	letters = BYTES_IN_RANGE(x | BYTES(0x20), 'a', 'f');
+	if ((digits | letters) != BYTES(0x80))
+		return false;
+
+	/* Nibble values, first digit in the lowest byte */
+	x = (x & BYTES(0x0f)) + (letters >> 7) * 9;
+
+	/* Pack them into bytes, then bytes into 32 bits */
+	x = ((x << 4) | (x >> 8)) & 0x00ff00ff00ff00ffull;
+	x = (x | (x >> 8)) & 0x0000ffff0000ffffull;
+	x = (x | (x >> 16)) & 0xffffffffull;
+
+	*out = bswap_32(x);
+
+	return true;
+}
+
+static bool crc_parse_line_slow(const char *line, size_t len, igt_crc_t *crc)
 {
+	const char *end = line + len;
+	char *next;
 	int i;
-	const char *buf;
 
-	if (strncmp(line, "XXXXXXXXXX", 10) == 0)
+	if (len >= 10 && strncmp(line, "XXXXXXXXXX", 10) == 0) {
 		crc->has_valid_frame = false;
-	else {
+		line += 10;
+	} else {
 		crc->has_valid_frame = true;
-		crc->frame = strtoul(line, NULL, 16);
+		crc->frame = strtoul(line, &next, 16);
+		if (next == line || next > end)
+			return false;
+		line = next;
 	}
 
-	buf = line + 10;
-	for (i = 0; *buf != '\n'; i++, buf += 11)
-		crc->crc[i] = strtoul(buf, NULL, 16);
+	for (i = 0; ; i++) {
+		while (line < end && *line == ' ')
+			line++;
+		if (line == end)
+			break;
+
+		if (i == DRM_MAX_CRC_NR)
+			return false;
+
+		crc->crc[i] = strtoul(line, &next, 16);
+		if (next == line || next > end)
+			return false;
+		line = next;
+	}
 
 	crc->n_words = i;
 
 	return true;
 }
 
-static int read_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out)
+/*
+ * Parses a CRC entry, without its newline. The kernel formats them as the frame
+ * number ("0x%08x" or "XXXXXXXXXX") followed by the CRC words (" 0x%08x").
+ */
+static bool crc_parse_line(const char *line, size_t len, igt_crc_t *crc)
 {
-	ssize_t bytes_read;
-	char buf[MAX_LINE_LEN + 1];
+	int i, n_words = (len - 10) / 11;
 
-	igt_set_timeout(5, "CRC reading");
-	bytes_read = read(pipe_crc->crc_fd, &buf, MAX_LINE_LEN);
-	igt_reset_timeout();
+	if (len < 10 || (len - 10) % 11 || n_words > DRM_MAX_CRC_NR)
+		return crc_parse_line_slow(line, len, crc);
 
-	if (bytes_read < 0)
-		bytes_read = -errno;
-	else
-		buf[bytes_read] = '\0';
+	if (strncmp(line, "XXXXXXXXXX", 10) == 0) {
+		crc->has_valid_frame = false;
+	} else {
+		if (line[0] != '0' || line[1] != 'x' ||
+		    !parse_hex8(line + 2, &crc->frame))
+			return crc_parse_line_slow(line, len, crc);
+		crc->has_valid_frame = true;
+	}
+
+	for (i = 0; i < n_words; i++) {
+		const char *word = line + 10 + 11 * i;
+
+		if (word[0] != ' ' || word[1] != '0' || word[2] != 'x' ||
+		    !parse_hex8(word + 3, &crc->crc[i]))
+			return crc_parse_line_slow(line, len, crc);
+	}
+
+	crc->n_words = n_words;
+
+	return true;
+}
+
+static void crc_reader_reset(struct crc_reader *reader)
+{
+	reader->start = 0;
+	reader->end = 0;
+}
+
+/*
+ * Reads as many entries as available in one go. The kernel returns one entry
+ * per read, but other CRC files may return many, or partial ones.
+ */
+static int crc_reader_fill(struct crc_reader *reader, int fd)
+{
+	ssize_t ret;
+
+	if (reader->start) {
+		memmove(reader->buf, reader->buf + reader->start,
+			reader->end - reader->start);
+		reader->end -= reader->start;
+		reader->start = 0;
+	}
+
+	ret = read(fd, reader->buf + reader->end,
+		   sizeof(reader->buf) - reader->end);
+	if (ret < 0)
+		return -errno;
+
+	reader->end += ret;
+
+	return ret;
+}
+
+/*
+ * Returns 1 if a buffered entry was parsed into @crc, 0 if there is no complete
+ * entry buffered and -EINVAL if the next entry is malformed.
+ */
+static int crc_reader_next(struct crc_reader *reader, igt_crc_t *crc)
+{
+	char *line = reader->buf + reader->start;
+	char *newline = memchr(line, '\n', reader->end - reader->start);
+
+	if (!newline) {
+		/* Entries don't get that long, give up on this one */
+		if (reader->end - reader->start == sizeof(reader->buf)) {
+			crc_reader_reset(reader);
+			return -EINVAL;
+		}
+
+		return 0;
+	}
+
+	reader->start = newline + 1 - reader->buf;
+	if (reader->start == reader->end)
+		crc_reader_reset(reader);
+
+	return crc_parse_line(line, newline - line, crc) ? 1 : -EINVAL;
+}
+
+static int read_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out)
+{
+	int ret;
 
-	if (bytes_read > 0 && !pipe_crc_init_from_string(pipe_crc, out, buf))
-		return -EINVAL;
+	while ((ret = crc_reader_next(&pipe_crc->reader, out)) == 0) {
+		igt_set_timeout(5, "CRC reading");
+		ret = crc_reader_fill(&pipe_crc->reader, pipe_crc->crc_fd);
+		igt_reset_timeout();
 
-	return bytes_read;
+		if (ret <= 0)
+			return ret;
+	}
+
+	return ret;
 }
 
 static void read_one_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out)
 {
 	int ret;
 
+	/* No need to switch to blocking reads for an already read entry */
+	if (crc_reader_next(&pipe_crc->reader, out) > 0)
+		return;
+
 	fcntl(pipe_crc->crc_fd, F_SETFL, pipe_crc->flags & ~O_NONBLOCK);
 
 	do {
@@ -896,6 +1068,7 @@ void igt_pipe_crc_stop(igt_pipe_crc_t *pipe_crc)
 {
 	close(pipe_crc->crc_fd);
 	pipe_crc->crc_fd = -1;
+	crc_reader_reset(&pipe_crc->reader);
 }
 
 /**
@@ -979,6 +1152,8 @@ void igt_pipe_crc_drain(igt_pipe_crc_t *pipe_crc)
 	int ret;
 	igt_crc_t crc;
 
+	crc_reader_reset(&pipe_crc->reader);
+
 	fcntl(pipe_crc->crc_fd, F_SETFL, pipe_crc->flags | O_NONBLOCK);
 
 	do {
@@ -1084,6 +1259,297 @@ void igt_pipe_crc_collect_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out_crc)
 	igt_pipe_crc_stop(pipe_crc);
 }
 
+/**
+ * igt_crc_collector_new:
+ * @ring_size: number of CRCs to keep per source
+ *
+ * Creates a CRC collector, which reads the CRCs of several sources, added with
+ * igt_crc_collector_add() or igt_crc_collector_add_fd(), from a single poll
+ * loop, and keeps the last @ring_size CRCs of each source.
+ *
+ * Returns: the new collector, to be freed with igt_crc_collector_free().
+ */
+igt_crc_collector_t *igt_crc_collector_new(int ring_size)
+{
+	igt_crc_collector_t *collector;
+
+	igt_assert(ring_size > 0);
+
+	collector = calloc(1, sizeof(*collector));
+	igt_assert(collector);
+	collector->ring_size = ring_size;
+
+	return collector;
+}
+
+/**
+ * igt_crc_collector_free:
+ * @collector: CRC collector
+ *
+ * Frees @collector. The pipe CRC objects and file descriptors added to it
+ * still need to be freed, respectively closed, by the caller.
+ */
+void igt_crc_collector_free(igt_crc_collector_t *collector)
+{
+	if (!collector)
+		return;
+
+	for (int i = 0; i < collector->n_sources; i++) {
+		struct crc_source *source = &collector->sources[i];
+
+		if (!source->pipe_crc)
+			free(source->reader);
+		free(source->ring);
+	}
+
+	free(collector->sources);
+	free(collector->pfd);
+	free(collector->pfd_source);
+	free(collector);
+}
+
+/* Moves the complete entries read from @source to its ring. */
+static void crc_source_push(igt_crc_collector_t *collector,
+			    struct crc_source *source)
+{
+	igt_crc_t *crc = &source->ring[source->count % collector->ring_size];
+	int ret;
+
+	while ((ret = crc_reader_next(source->reader, crc))) {
+		if (ret < 0)
+			continue;
+
+		source->count++;
+		crc = &source->ring[source->count % collector->ring_size];
+	}
+}
+
+static int add_source(igt_crc_collector_t *collector, int fd,
+		      igt_pipe_crc_t *pipe_crc)
+{
+	struct crc_source *source;
+	int n = collector->n_sources++;
+
+	collector->sources = realloc(collector->sources,
+				     collector->n_sources * sizeof(*source));
+	collector->pfd = realloc(collector->pfd,
+				 collector->n_sources * sizeof(*collector->pfd));
+	collector->pfd_source =
+		realloc(collector->pfd_source,
+			collector->n_sources * sizeof(*collector->pfd_source));
+	igt_assert(collector->sources && collector->pfd &&
+		   collector->pfd_source);
+
+	source = &collector->sources[n];
+	memset(source, 0, sizeof(*source));
+	source->fd = fd;
+	source->pipe_crc = pipe_crc;
+	if (pipe_crc) {
+		source->reader = &pipe_crc->reader;
+	} else {
+		source->reader = calloc(1, sizeof(*source->reader));
+		igt_assert(source->reader);
+	}
+
+	source->ring = calloc(collector->ring_size, sizeof(*source->ring));
+	igt_assert(source->ring);
+
+	/* Don't lose what the pipe CRC object already read */
+	crc_source_push(collector, source);
+
+	return n;
+}
+
+/**
+ * igt_crc_collector_add:
+ * @collector: CRC collector
+ * @pipe_crc: pipe CRC object, already started with igt_pipe_crc_start()
+ *
+ * Adds the CRCs of @pipe_crc to @collector. @pipe_crc must not be read from
+ * directly while it's part of @collector.
+ *
+ * Returns: the index of the source, to retrieve its CRCs with.
+ */
+int igt_crc_collector_add(igt_crc_collector_t *collector,
+			  igt_pipe_crc_t *pipe_crc)
+{
+	igt_assert(pipe_crc->crc_fd != -1);
+
+	return add_source(collector, pipe_crc->crc_fd, pipe_crc);
+}
+
+/**
+ * igt_crc_collector_add_fd:
+ * @collector: CRC collector
+ * @fd: file descriptor to read CRC entries from
+ *
+ * Adds a file in the format of the CRC debugfs files to @collector, which is
+ * mostly useful to test the collector, and the tests using it, without a
+ * display.
+ *
+ * Returns: the index of the source, to retrieve its CRCs with.
+ */
+int igt_crc_collector_add_fd(igt_crc_collector_t *collector, int fd)
+{
+	return add_source(collector, fd, NULL);
+}
+
+/**
+ * igt_crc_collector_poll:
+ * @collector: CRC collector
+ * @timeout_ms: how long to wait for CRCs, in milliseconds, or -1 to block
+ *
+ * Waits up to @timeout_ms for any of the sources of @collector to have CRCs,
+ * then reads all of the CRCs available on all of them.
+ *
+ * Returns: the number of CRCs read, or a negative error code.
+ */
+int igt_crc_collector_poll(igt_crc_collector_t *collector, int timeout_ms)
+{
+	unsigned int before = 0, after = 0;
+	bool progress;
+	int n_fds, ret;
+
+	for (int i = 0; i < collector->n_sources; i++)
+		before += collector->sources[i].count;
+
+	do {
+		progress = false;
+
+		n_fds = 0;
+		for (int i = 0; i < collector->n_sources; i++) {
+			if (collector->sources[i].eof)
+				continue;
+
+			collector->pfd[n_fds].fd = collector->sources[i].fd;
+			collector->pfd[n_fds].events = POLLIN;
+			collector->pfd_source[n_fds++] = i;
+		}
+		if (!n_fds)
+			break;
+
+		ret = poll(collector->pfd, n_fds, timeout_ms);
+		if (ret < 0)
+			return errno == EINTR ? 0 : -errno;
+
+		for (int i = 0; i < n_fds; i++) {
+			struct crc_source *source =
+				&collector->sources[collector->pfd_source[i]];
+
+			if (!collector->pfd[i].revents)
+				continue;
+
+			ret = crc_reader_fill(source->reader, source->fd);
+			if (ret > 0) {
+				crc_source_push(collector, source);
+				progress = true;
+			} else if (ret != -EAGAIN && ret != -EINTR) {
+				source->eof = true;
+			}
+		}
+
+		/* Only wait for the first CRCs, then take what's left */
+		timeout_ms = 0;
+	} while (progress);
+
+	for (int i = 0; i < collector->n_sources; i++)
+		after += collector->sources[i].count;
+
+	return after - before;
+}
+
+static const igt_crc_t *crc_source_get(igt_crc_collector_t *collector,
+				       struct crc_source *source,
+				       unsigned int i)
+{
+	return &source->ring[i % collector->ring_size];
+}
+
+/* Returns the number of the oldest CRC still in the ring. */
+static unsigned int crc_source_first(igt_crc_collector_t *collector,
+				     struct crc_source *source)
+{
+	return source->count > collector->ring_size ?
+		source->count - collector->ring_size : 0;
+}
+
+/**
+ * igt_crc_collector_get_crcs:
+ * @collector: CRC collector
+ * @source: index of the source
+ * @n_crcs: maximum number of CRCs to return
+ * @out_crcs: buffer for the CRCs, of at least @n_crcs entries
+ *
+ * Copies the last @n_crcs CRCs read from @source, oldest first, without
+ * waiting for new ones; see igt_crc_collector_poll().
+ *
+ * Returns: the number of CRCs copied.
+ */
+int igt_crc_collector_get_crcs(igt_crc_collector_t *collector, int source,
+			       int n_crcs, igt_crc_t *out_crcs)
+{
+	struct crc_source *src = &collector->sources[source];
+	unsigned int first = crc_source_first(collector, src);
+	int n;
+
+	if (src->count - first > n_crcs)
+		first = src->count - n_crcs;
+
+	for (n = 0; first + n < src->count; n++)
+		out_crcs[n] = *crc_source_get(collector, src, first + n);
+
+	return n;
+}
+
+/**
+ * igt_crc_collector_wait_for_frame:
+ * @collector: CRC collector
+ * @source: index of the source
+ * @frame: frame number of the CRC to wait for
+ * @crc: buffer for the CRC
+ * @timeout_ms: how long to wait, in milliseconds
+ *
+ * Waits until @source has a CRC for @frame, or a later one if the CRC for
+ * @frame was missed, reading the CRCs of all sources of @collector in the
+ * meantime. CRCs without a valid frame counter are ignored.
+ *
+ * Returns: true if a CRC was found before the timeout.
+ */
+bool igt_crc_collector_wait_for_frame(igt_crc_collector_t *collector,
+				      int source, uint32_t frame,
+				      igt_crc_t *crc, int timeout_ms)
+{
+	struct crc_source *src = &collector->sources[source];
+	struct timespec start = {};
+	int64_t remaining;
+	unsigned int i;
+
+	igt_nsec_elapsed(&start);
+
+	for (i = 0; ; ) {
+		/* Skip what was dropped from the ring since the last look */
+		if (i < crc_source_first(collector, src))
+			i = crc_source_first(collector, src);
+
+		for (; i < src->count; i++) {
+			const igt_crc_t *c = crc_source_get(collector, src, i);
+
+			if (c->has_valid_frame &&
+			    !igt_vblank_before(c->frame, frame)) {
+				*crc = *c;
+				return true;
+			}
+		}
+
+		remaining = timeout_ms - igt_nsec_elapsed(&start) / 1000000;
+		if (remaining <= 0 || src->eof)
+			return false;
+
+		if (igt_crc_collector_poll(collector, remaining) < 0)
+			return false;
+	}
+}
+
 /**
  * igt_reset_fifo_underrun_reporting:
  * @drm_fd: drm device file descriptor
@@ -125,6 +125,25 @@ void igt_pipe_crc_get_for_frame(int drm_fd, igt_pipe_crc_t *pipe_crc,
 
 void igt_pipe_crc_collect_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out_crc);
 
+/**
+ * igt_crc_collector_t:
+ *
+ * Collects the CRCs of several pipes at once, see igt_crc_collector_new().
+ */
+typedef struct _igt_crc_collector igt_crc_collector_t;
+
+igt_crc_collector_t *igt_crc_collector_new(int ring_size);
+void igt_crc_collector_free(igt_crc_collector_t *collector);
+int igt_crc_collector_add(igt_crc_collector_t *collector,
+			  igt_pipe_crc_t *pipe_crc);
+int igt_crc_collector_add_fd(igt_crc_collector_t *collector, int fd);
+int igt_crc_collector_poll(igt_crc_collector_t *collector, int timeout_ms);
+int igt_crc_collector_get_crcs(igt_crc_collector_t *collector, int source,
+			       int n_crcs, igt_crc_t *out_crcs);
+bool igt_crc_collector_wait_for_frame(igt_crc_collector_t *collector,
+				      int source, uint32_t frame,
+				      igt_crc_t *crc, int timeout_ms);
+
 void igt_hpd_storm_set_threshold(int fd, unsigned int threshold);
 void igt_hpd_storm_reset(int fd);
 bool igt_hpd_storm_detected(int fd);
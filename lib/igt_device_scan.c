@@ -160,6 +160,7 @@ struct igt_device {
 	/* Properties / sysattrs rewriten from udev lists */
 	GHashTable *props_ht;
 	GHashTable *attrs_ht;
+	bool attrs_loaded; /* sysattrs are only read on demand */
 
 	/* Most usable variables from udev device */
 	char *subsystem;
@@ -184,6 +185,10 @@ static struct {
 	struct igt_list_head all;
 	struct igt_list_head filtered;
 	bool devs_scanned;
+
+	/* Kept across rescans and for the lazy sysattr reads */
+	struct udev *udev;
+	struct udev_monitor *monitor;
 } igt_devs;
 
 typedef char *(*devname_fn)(uint16_t, uint16_t);
@@ -412,6 +417,26 @@ static void get_attrs(struct udev_device *dev, struct igt_device *idev)
 	}
 }
 
+/* Reading all sysattrs of every scanned device takes a long time and
+ * allocates a lot, while only the detailed listing ever looks at them.
+ * So read them the first time they are needed.
+ */
+static void load_attrs(struct igt_device *idev)
+{
+	struct udev_device *dev;
+
+	if (idev->attrs_loaded)
+		return;
+
+	dev = udev_device_new_from_syspath(igt_devs.udev, idev->syspath);
+	if (dev) {
+		get_attrs(dev, idev);
+		udev_device_unref(dev);
+	}
+
+	idev->attrs_loaded = true;
+}
+
 #define get_prop(dev, prop) ((char *) g_hash_table_lookup(dev->props_ht, prop))
 #define get_attr(dev, attr) ((char *) g_hash_table_lookup(dev->attrs_ht, attr))
 #define get_prop_subsystem(dev) get_prop(dev, "SUBSYSTEM")
@@ -464,8 +489,8 @@ static char* strdup_nullsafe(const char* str)
 }
 
 /* Create new igt_device from udev device.
- * Fills structure with most usable udev device variables, properties
- * and sysattrs.
+ * Fills structure with most usable udev device variables and properties,
+ * sysattrs are left for load_attrs().
  */
 static struct igt_device *igt_device_new_from_udev(struct udev_device *dev)
 {
@@ -482,7 +507,6 @@ static struct igt_device *igt_device_new_from_udev(struct udev_device *dev)
 		idev->drm_render = strdup(idev->devnode);
 
 	get_props(dev, idev);
-	get_attrs(dev, idev);
 
 	return idev;
 }
@@ -609,6 +633,41 @@ bool igt_device_find_integrated_card(struct igt_device_card *card)
 	return __find_first_i915_card(card, false);
 }
 
+/**
+ * igt_device_find_all_i915_cards
+ * @cards: pointer to an array of cards, allocated by the function
+ *
+ * Iterate over all scanned devices and collect every Intel GPU, integrated
+ * and discrete, in bus order.
+ *
+ * Returns: number of cards found. On success *@cards must be freed by the
+ * caller, when no card is found *@cards is set to NULL.
+ */
+int igt_device_find_all_i915_cards(struct igt_device_card **cards)
+{
+	struct igt_device *dev;
+	int num = 0;
+
+	igt_assert(cards);
+	*cards = NULL;
+
+	igt_list_for_each_entry(dev, &igt_devs.all, link) {
+		struct igt_device_card *card;
+
+		if (!is_pci_subsystem(dev) || !is_vendor_matched(dev, "intel"))
+			continue;
+
+		*cards = realloc(*cards, (num + 1) * sizeof(**cards));
+		igt_assert(*cards);
+
+		card = &(*cards)[num++];
+		memset(card, 0, sizeof(*card));
+		__copy_dev_to_card(dev, card);
+	}
+
+	return num;
+}
+
 static struct igt_device *igt_device_from_syspath(const char *syspath)
 {
 	struct igt_device *dev;
@@ -701,6 +760,31 @@ static void sort_all_devices(void)
 	free(devs);
 }
 
+/* The filtered list holds shallow copies, so it must be emptied before
+ * any device it points to is freed.
+ */
+static void clear_filtered_devices(void)
+{
+	struct igt_device *dev, *tmp;
+
+	igt_list_for_each_entry_safe(dev, tmp, &igt_devs.filtered, link) {
+		igt_list_del(&dev->link);
+		free(dev);
+	}
+}
+
+static void reset_filtered_devices(void)
+{
+	struct igt_device *dev;
+
+	clear_filtered_devices();
+
+	igt_list_for_each_entry(dev, &igt_devs.all, link) {
+		struct igt_device *dev_dup = duplicate_device(dev);
+		igt_list_add_tail(&dev_dup->link, &igt_devs.filtered);
+	}
+}
+
 static void index_pci_devices(void)
 {
 	struct igt_device *dev;
@@ -744,10 +828,11 @@ static void scan_drm_devices(void)
 	struct udev *udev;
 	struct udev_enumerate *enumerate;
 	struct udev_list_entry *devices, *dev_list_entry;
-	struct igt_device *dev;
 	int ret;
 
-	udev = udev_new();
+	if (!igt_devs.udev)
+		igt_devs.udev = udev_new();
+	udev = igt_devs.udev;
 	igt_assert(udev);
 
 	enumerate = udev_enumerate_new(udev);
@@ -764,8 +849,10 @@ static void scan_drm_devices(void)
 	igt_assert(!ret);
 
 	devices = udev_enumerate_get_list_entry(enumerate);
-	if (!devices)
+	if (!devices) {
+		udev_enumerate_unref(enumerate);
 		return;
+	}
 
 	udev_list_entry_foreach(dev_list_entry, devices) {
 		const char *path;
@@ -781,15 +868,10 @@ static void scan_drm_devices(void)
 		udev_device_unref(udev_dev);
 	}
 	udev_enumerate_unref(enumerate);
-	udev_unref(udev);
 
 	sort_all_devices();
 	index_pci_devices();
-
-	igt_list_for_each_entry(dev, &igt_devs.all, link) {
-		struct igt_device *dev_dup = duplicate_device(dev);
-		igt_list_add_tail(&dev_dup->link, &igt_devs.filtered);
-	}
+	reset_filtered_devices();
 }
 
 static void igt_device_free(struct igt_device *dev)
@@ -814,6 +896,16 @@ void igt_devices_free(void)
 		igt_device_free(dev);
 		free(dev);
 	}
+
+	if (igt_devs.monitor) {
+		udev_monitor_unref(igt_devs.monitor);
+		igt_devs.monitor = NULL;
+	}
+
+	if (igt_devs.udev) {
+		udev_unref(igt_devs.udev);
+		igt_devs.udev = NULL;
+	}
 }
 
 /**
@@ -830,11 +922,7 @@ void igt_devices_scan(bool force)
 	if (force && igt_devs.devs_scanned) {
 		struct igt_device *dev, *tmp;
 
-		igt_list_for_each_entry_safe(dev, tmp, &igt_devs.filtered,
-					     link) {
-			igt_list_del(&dev->link);
-			free(dev);
-		}
+		clear_filtered_devices();
 		igt_list_for_each_entry_safe(dev, tmp, &igt_devs.all, link) {
 			igt_list_del(&dev->link);
 			igt_device_free(dev);
@@ -853,6 +941,145 @@ void igt_devices_scan(bool force)
 	igt_devs.devs_scanned = true;
 }
 
+/**
+ * igt_devices_monitor
+ *
+ * Start listening for drm devices coming and going, so long running tools
+ * can keep the device array current with igt_devices_update() instead of
+ * rescanning everything with igt_devices_scan(true).
+ *
+ * Returns: a file descriptor which becomes readable when there are updates
+ * to apply, or a negative error code. The descriptor is owned by the device
+ * array and is released by igt_devices_free().
+ */
+int igt_devices_monitor(void)
+{
+	struct udev_monitor *mon;
+
+	igt_devices_scan(false);
+
+	if (igt_devs.monitor)
+		return udev_monitor_get_fd(igt_devs.monitor);
+
+	mon = udev_monitor_new_from_netlink(igt_devs.udev, "udev");
+	if (!mon)
+		return -ENOMEM;
+
+	if (udev_monitor_filter_add_match_subsystem_devtype(mon, "drm", NULL) ||
+	    udev_monitor_enable_receiving(mon)) {
+		udev_monitor_unref(mon);
+		return -EINVAL;
+	}
+
+	igt_devs.monitor = mon;
+
+	return udev_monitor_get_fd(mon);
+}
+
+static bool is_drm_node(struct udev_device *dev)
+{
+	const char *devnode = udev_device_get_devnode(dev);
+
+	return devnode && !strncmp(devnode, "/dev/dri/", 9);
+}
+
+static bool add_drm_device(struct udev_device *dev)
+{
+	struct igt_device *idev;
+
+	if (igt_device_find("drm", udev_device_get_syspath(dev)))
+		return false;
+
+	clear_filtered_devices();
+
+	idev = igt_device_new_from_udev(dev);
+	update_or_add_parent(dev, idev);
+	igt_list_add_tail(&idev->link, &igt_devs.all);
+
+	return true;
+}
+
+static bool remove_drm_device(struct udev_device *dev)
+{
+	struct igt_device *idev, *parent, *other;
+
+	idev = igt_device_find("drm", udev_device_get_syspath(dev));
+	if (!idev)
+		return false;
+
+	clear_filtered_devices();
+
+	parent = idev->parent;
+	igt_list_del(&idev->link);
+
+	if (parent && strequal(parent->drm_card, idev->devnode)) {
+		free(parent->drm_card);
+		parent->drm_card = NULL;
+	}
+	if (parent && strequal(parent->drm_render, idev->devnode)) {
+		free(parent->drm_render);
+		parent->drm_render = NULL;
+	}
+
+	igt_device_free(idev);
+	free(idev);
+
+	/* Drop the bus device together with its last drm node. */
+	igt_list_for_each_entry(other, &igt_devs.all, link) {
+		if (other->parent == parent)
+			return true;
+	}
+
+	if (parent) {
+		igt_list_del(&parent->link);
+		igt_device_free(parent);
+		free(parent);
+	}
+
+	return true;
+}
+
+/**
+ * igt_devices_update
+ *
+ * Apply the device additions and removals collected since the last call
+ * by the monitor started with igt_devices_monitor(). Never blocks. Note the
+ * filtered view is reset to all devices when anything changed.
+ *
+ * Returns: true if the device array changed.
+ */
+bool igt_devices_update(void)
+{
+	struct udev_device *dev;
+	bool changed = false;
+
+	if (!igt_devs.monitor)
+		return false;
+
+	while ((dev = udev_monitor_receive_device(igt_devs.monitor))) {
+		const char *action = udev_device_get_action(dev);
+
+		if (is_drm_node(dev) && action) {
+			DBG("%s: %s\n", action, udev_device_get_syspath(dev));
+
+			if (!strcmp(action, "add"))
+				changed |= add_drm_device(dev);
+			else if (!strcmp(action, "remove"))
+				changed |= remove_drm_device(dev);
+		}
+
+		udev_device_unref(dev);
+	}
+
+	if (changed) {
+		sort_all_devices();
+		index_pci_devices();
+		reset_filtered_devices();
+	}
+
+	return changed;
+}
+
 static inline void _pr_simple(const char *k, const char *v)
 {
 	printf("    %-16s: %s\n", k, v);
@@ -1076,6 +1303,7 @@ igt_devs_print_detail(struct igt_list_head *view,
 		printf("\n[properties]\n");
 		print_ht(dev->props_ht);
 		printf("\n[attributes]\n");
+		load_attrs(dev);
 		print_ht(dev->attrs_ht);
 		printf("\n");
 	}
@@ -1148,6 +1376,10 @@ struct filter {
 		char *drm;
 		char *driver;
 	} data;
+
+	/* Resolved once at parse time rather than on every match */
+	const char *vendor_id;
+	int card;
 };
 
 static void fill_filter_data(struct filter *filter, const char *key, const char *value)
@@ -1185,6 +1417,22 @@ static void split_filter_data(struct filter *filter)
 
 static struct filter_class *get_filter_class(const char *class_name, const struct filter *filter);
 
+/* Resolve the vendor name and card index up front, so matching against
+ * the device array is plain comparisons.
+ */
+static void compile_filter_data(struct filter *filter)
+{
+	if (filter->data.vendor) {
+		filter->vendor_id = get_pci_vendor_id_by_name(filter->data.vendor);
+		if (!filter->vendor_id)
+			filter->vendor_id = filter->data.vendor;
+	}
+
+	filter->card = 0;
+	if (filter->data.card && sscanf(filter->data.card, "%d", &filter->card) != 1)
+		filter->card = -1;
+}
+
 static bool parse_filter(const char *fstr, struct filter *filter)
 {
 	char class_name[32];
@@ -1196,12 +1444,24 @@ static bool parse_filter(const char *fstr, struct filter *filter)
 	if (sscanf(fstr, "%31[^:]:%255s", class_name, filter->raw_data) >= 1) {
 		filter->class = get_filter_class(class_name, filter);
 		split_filter_data(filter);
+		compile_filter_data(filter);
 		return true;
 	}
 
 	return false;
 }
 
+static void free_filter(struct filter *filter)
+{
+	free(filter->data.vendor);
+	free(filter->data.device);
+	free(filter->data.card);
+	free(filter->data.slot);
+	free(filter->data.drm);
+	free(filter->data.driver);
+	memset(&filter->data, 0, sizeof(filter->data));
+}
+
 /* Filter which matches subsystem:/sys/... path.
  * Used as first filter in chain.
  */
@@ -1261,7 +1521,7 @@ static struct igt_list_head *filter_pci(const struct filter_class *fcls,
 					const struct filter *filter)
 {
 	struct igt_device *dev;
-	int card = -1;
+	int card = filter->card;
 	(void) fcls;
 
 	DBG("filter pci\n");
@@ -1271,14 +1531,8 @@ static struct igt_list_head *filter_pci(const struct filter_class *fcls,
 		exit(EXIT_FAILURE);
 	}
 
-	if (filter->data.card) {
-		sscanf(filter->data.card, "%d", &card);
-		if (card < 0) {
-			return &igt_devs.filtered;
-		}
-	} else {
-		card = 0;
-	}
+	if (card < 0)
+		return &igt_devs.filtered;
 
 	igt_list_for_each_entry(dev, &igt_devs.all, link) {
 		if (!is_pci_subsystem(dev))
@@ -1289,7 +1543,8 @@ static struct igt_list_head *filter_pci(const struct filter_class *fcls,
 			continue;
 
 		/* Skip if 'vendor' doesn't match (hex or name) */
-		if (filter->data.vendor && !is_vendor_matched(dev, filter->data.vendor))
+		if (filter->vendor_id &&
+		    (!dev->vendor || strcasecmp(dev->vendor, filter->vendor_id)))
 			continue;
 
 		/* Skip if 'device' doesn't match */
@@ -1384,6 +1639,7 @@ void igt_device_print_filter_types(void)
 
 struct device_filter {
 	char filter[NAME_MAX];
+	struct filter parsed;
 	struct igt_list_head link;
 };
 
@@ -1403,23 +1659,22 @@ int igt_device_filter_count(void)
  * 1. /sys/... path first
  * 2. filter name from filter definition
  */
-static bool is_filter_valid(const char *fstr)
+static bool is_filter_valid(const char *fstr, struct filter *filter)
 {
-	struct filter filter;
 	int ret;
 
-	ret = parse_filter(fstr, &filter);
+	ret = parse_filter(fstr, filter);
 	if (!ret)
 		return false;
 
-	if (filter.class == NULL) {
+	if (filter->class == NULL) {
 		igt_warn("No filter class matching [%s]\n", fstr);
 		return false;
 	}
 
-	if (filter.class->is_valid != NULL && !filter.class->is_valid(filter.class, &filter))
+	if (filter->class->is_valid != NULL && !filter->class->is_valid(filter->class, filter))
 	{
-		igt_warn("Filter not valid [%s:%s]\n", filter.class->name, filter.raw_data);
+		igt_warn("Filter not valid [%s:%s]\n", filter->class->name, filter->raw_data);
 		return false;
 	}
 
@@ -1447,13 +1702,19 @@ int igt_device_filter_add(const char *filters)
 	dup_orig = dup;
 
 	while ((filter = strsep(&dup, ";"))) {
-		bool is_valid = is_filter_valid(filter);
+		struct device_filter *df = calloc(1, sizeof(*df));
+		bool is_valid;
+
+		igt_assert(df);
+		is_valid = is_filter_valid(filter, &df->parsed);
 		igt_warn_on(!is_valid);
 		if (is_valid) {
-			struct device_filter *df = malloc(sizeof(*df));
 			strncpy(df->filter, filter, sizeof(df->filter)-1);
 			igt_list_add_tail(&df->link, &device_filters);
 			count++;
+		} else {
+			free_filter(&df->parsed);
+			free(df);
 		}
 	}
 
@@ -1473,6 +1734,7 @@ void igt_device_filter_free_all(void)
 
 	igt_list_for_each_entry_safe(filter, tmp, &device_filters, link) {
 		igt_list_del(&filter->link);
+		free_filter(&filter->parsed);
 		free(filter);
 	}
 }
@@ -1502,38 +1764,55 @@ const char *igt_device_filter_get(int num)
 	return NULL;
 }
 
+/* Filters added with igt_device_filter_add() are parsed only once. */
+static const struct filter *find_parsed_filter(const char *fstr)
+{
+	struct device_filter *df;
+
+	igt_list_for_each_entry(df, &device_filters, link) {
+		if (!strcmp(df->filter, fstr))
+			return &df->parsed;
+	}
+
+	return NULL;
+}
+
 static bool igt_device_filter_apply(const char *fstr)
 {
-	struct igt_device *dev, *tmp;
-	struct filter filter;
-	bool ret;
+	const struct filter *filter;
+	struct filter parsed;
+	bool ret = true;
 
 	if (!fstr)
 		return false;
 
-	ret = parse_filter(fstr, &filter);
-	if (!ret) {
-		igt_warn("Can't split filter [%s]\n", fstr);
-		return false;
+	filter = find_parsed_filter(fstr);
+	if (!filter) {
+		if (!parse_filter(fstr, &parsed)) {
+			igt_warn("Can't split filter [%s]\n", fstr);
+			return false;
+		}
+		filter = &parsed;
 	}
 
 	/* Clean the filtered list */
-	igt_list_for_each_entry_safe(dev, tmp, &igt_devs.filtered, link) {
-		igt_list_del(&dev->link);
-		free(dev);
-	}
+	clear_filtered_devices();
 
 	/* If filter.data contains "/sys" use direct path instead
 	 * contextual filter.
 	 */
 
-	if (!filter.class) {
+	if (!filter->class) {
 		igt_warn("No filter class matching [%s]\n", fstr);
-		return false;
+		ret = false;
+	} else {
+		filter->class->filter_function(filter->class, filter);
 	}
-	filter.class->filter_function(filter.class, &filter);
 
-	return true;
+	if (filter == &parsed)
+		free_filter(&parsed);
+
+	return ret;
 }
 
 
@@ -63,6 +63,8 @@ struct igt_device_card {
 };
 
 void igt_devices_scan(bool force);
+int igt_devices_monitor(void);
+bool igt_devices_update(void);
 
 void igt_devices_print(const struct igt_devices_print_format *fmt);
 void igt_devices_print_vendors(void);
@@ -86,6 +88,7 @@ bool igt_device_card_match_pci(const char *filter,
 	struct igt_device_card *card);
 bool igt_device_find_first_i915_discrete_card(struct igt_device_card *card);
 bool igt_device_find_integrated_card(struct igt_device_card *card);
+int igt_device_find_all_i915_cards(struct igt_device_card **cards);
 char *igt_device_get_pretty_name(struct igt_device_card *card, bool numeric);
 int igt_open_card(struct igt_device_card *card);
 int igt_open_render(struct igt_device_card *card);
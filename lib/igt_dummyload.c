@@ -26,7 +26,6 @@
 #include <signal.h>
 #include <pthread.h>
 #include <sys/poll.h>
-#include <sys/timerfd.h>
 
 #include <i915_drm.h>
 
@@ -425,6 +424,13 @@ emit_recursive_batch(igt_spin_t *spin,
 	return fence_fd;
 }
 
+static void spin_timeout(struct igt_timer *timer)
+{
+	igt_spin_t *spin = igt_container_of(timer, spin, timer);
+
+	igt_spin_end(spin);
+}
+
 static igt_spin_t *
 spin_create(int fd, const struct igt_spin_factory *opts)
 {
@@ -433,7 +439,7 @@ spin_create(int fd, const struct igt_spin_factory *opts)
 	spin = calloc(1, sizeof(struct igt_spin));
 	igt_assert(spin);
 
-	spin->timerfd = -1;
+	igt_timer_init(&spin->timer, spin_timeout);
 	spin->out_fence = emit_recursive_batch(spin, fd, opts);
 
 	pthread_mutex_lock(&list_lock);
@@ -498,20 +504,6 @@ igt_spin_factory(int fd, const struct igt_spin_factory *opts)
 	return spin;
 }
 
-static void *timer_thread(void *data)
-{
-	igt_spin_t *spin = data;
-	uint64_t overruns = 0;
-
-	/* Wait until we see the timer fire, or we get cancelled */
-	do {
-		read(spin->timerfd, &overruns, sizeof(overruns));
-	} while (!overruns);
-
-	igt_spin_end(spin);
-	return NULL;
-}
-
 /**
  * igt_spin_set_timeout:
  * @spin: spin state from igt_spin_new()
@@ -519,41 +511,21 @@ static void *timer_thread(void *data)
  *      before finishing.
  *
  * Specify a timeout. This ends the recursive batch associated with @spin after
- * the timeout has elapsed.
+ * the timeout has elapsed, replacing any earlier timeout. The timeouts of all
+ * spinners are handled by a single timer thread, see igt_timer_arm().
  */
 void igt_spin_set_timeout(igt_spin_t *spin, int64_t ns)
 {
-	struct sched_param param = { .sched_priority = 99 };
-	struct itimerspec its;
-	pthread_attr_t attr;
-	int timerfd;
-
 	if (!spin)
 		return;
 
 	if (ns <= 0) {
+		igt_timer_cancel(&spin->timer);
 		igt_spin_end(spin);
 		return;
 	}
 
-	igt_assert(spin->timerfd == -1);
-	timerfd = timerfd_create(CLOCK_MONOTONIC, 0);
-	igt_assert(timerfd >= 0);
-	spin->timerfd = timerfd;
-
-	pthread_attr_init(&attr);
-	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
-	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
-	pthread_attr_setschedparam(&attr, &param);
-
-	igt_assert(pthread_create(&spin->timer_thread, &attr,
-				  timer_thread, spin) == 0);
-	pthread_attr_destroy(&attr);
-
-	memset(&its, 0, sizeof(its));
-	its.it_value.tv_sec = ns / NSEC_PER_SEC;
-	its.it_value.tv_nsec = ns % NSEC_PER_SEC;
-	igt_assert(timerfd_settime(timerfd, 0, &its, NULL) == 0);
+	igt_timer_arm(&spin->timer, ns);
 }
 
 static void sync_write(igt_spin_t *spin, uint32_t value)
@@ -568,10 +540,13 @@ static void sync_write(igt_spin_t *spin, uint32_t value)
  * igt_spin_reset:
  * @spin: spin state from igt_spin_new()
  *
- * Reset the state of spin, allowing its reuse.
+ * Reset the state of spin, allowing its reuse. Any pending timeout is
+ * cancelled.
  */
 void igt_spin_reset(igt_spin_t *spin)
 {
+	igt_timer_cancel(&spin->timer);
+
 	if (igt_spin_has_poll(spin))
 		spin->poll[SPIN_POLL_START_IDX] = 0;
 
@@ -596,12 +571,7 @@ void igt_spin_end(igt_spin_t *spin)
 
 static void __igt_spin_free(int fd, igt_spin_t *spin)
 {
-	if (spin->timerfd >= 0) {
-		pthread_cancel(spin->timer_thread);
-		igt_assert(pthread_join(spin->timer_thread, NULL) == 0);
-		close(spin->timerfd);
-	}
-
+	igt_timer_cancel(&spin->timer);
 	igt_spin_end(spin);
 
 	if (spin->poll)
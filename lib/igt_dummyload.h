@@ -30,6 +30,7 @@
 
 #include "igt_core.h"
 #include "igt_list.h"
+#include "igt_timer_wheel.h"
 #include "i915_drm.h"
 #include "intel_ctx.h"
 
@@ -70,8 +71,7 @@ typedef struct igt_spin {
 #define SPIN_POLL_START_IDX 0
 
 	struct timespec last_signal;
-	pthread_t timer_thread;
-	int timerfd;
+	struct igt_timer timer;
 
 	int out_fence;
 	struct drm_i915_gem_exec_object2 obj[2];
@@ -26,6 +26,7 @@
 #include "config.h"
 
 #include <assert.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
@@ -41,7 +42,8 @@
  * @title: EDID
  * @include: igt_edid.h
  *
- * This library contains helpers to generate custom EDIDs.
+ * This library contains helpers to generate custom EDIDs, and to validate and
+ * index existing ones (see #edid_validate and #edid_index_init).
 
  * The E-EDID specification is available at:
  * https://glenwing.github.io/docs/VESA-EEDID-A2.pdf
@@ -287,17 +289,35 @@ void edid_init_with_mode(struct edid *edid, drmModeModeInfo *mode)
 				   EDID_DETAIL_MONITOR_NAME, "IGT");
 }
 
-static uint8_t compute_checksum(const uint8_t *buf, size_t size)
+/* Sums the bytes of @buf, eight at a time, modulo 256. */
+static uint8_t edid_sum(const uint8_t *buf, size_t size)
 {
+	const uint64_t mask = 0x00ff00ff00ff00ffull;
+	uint64_t lanes = 0, word;
+	uint8_t sum;
 	size_t i;
-	uint8_t sum = 0;
 
-	assert(size > 0);
-	for (i = 0; i < size - 1; i++) {
-		sum += buf[i];
+	/* Four 16-bit lanes, which can't overflow for an EDID block. */
+	assert(size <= 2 * EDID_BLOCK_SIZE);
+	for (i = 0; i + sizeof(word) <= size; i += sizeof(word)) {
+		memcpy(&word, buf + i, sizeof(word));
+		lanes += (word & mask) + ((word >> 8) & mask);
 	}
 
-	return 256 - sum;
+	sum = (lanes & 0xffff) + ((lanes >> 16) & 0xffff) +
+	      ((lanes >> 32) & 0xffff) + (lanes >> 48);
+	for (; i < size; i++)
+		sum += buf[i];
+
+	return sum;
+}
+
+/* Returns the last byte of @buf that makes all of its bytes sum to zero. */
+static uint8_t compute_checksum(const uint8_t *buf, size_t size)
+{
+	assert(size > 0);
+
+	return -edid_sum(buf, size - 1);
 }
 
 /**
@@ -319,9 +339,10 @@ void edid_update_checksum(struct edid *edid)
 				compute_checksum((uint8_t *) ext,
 						 sizeof(struct edid_ext));
 		else if (ext->tag == EDID_EXT_DISPLAYID) {
+			/* The DisplayID section ends with its own checksum */
 			ext->data.tile.extension_checksum =
 				compute_checksum((uint8_t *) &ext->data.tile,
-						 sizeof(struct edid_ext));
+						 sizeof(struct edid_tile) - 1);
 			ext->data.tile.checksum =
 				compute_checksum((uint8_t *) ext,
 						 sizeof(struct edid_ext));
@@ -349,54 +370,307 @@ size_t edid_get_size(const struct edid *edid)
 	       edid->extensions_len * sizeof(struct edid_ext);
 }
 
-static int ieee_oui(uint8_t oui[CEA_VSDB_HEADER_SIZE])
+static int ieee_oui(const uint8_t oui[CEA_VSDB_HEADER_SIZE])
 {
          return (oui[2] << 16) | (oui[1] << 8) | oui[0];
 }
 
+static bool edid_error(const char **reason, const char *msg)
+{
+	if (reason)
+		*reason = msg;
+
+	return false;
+}
+
+static bool edid_index_add(struct edid_index *index,
+			   enum edid_block_kind kind, int ext, int tag,
+			   const uint8_t *data, size_t len, const char **reason)
+{
+	struct edid_block_ref *ref;
+
+	if (!index)
+		return true;
+
+	if (index->n_blocks == EDID_INDEX_MAX_BLOCKS)
+		return edid_error(reason, "too many blocks to index");
+
+	ref = &index->blocks[index->n_blocks++];
+	ref->kind = kind;
+	ref->ext = ext;
+	ref->tag = tag;
+	ref->len = len;
+	ref->data = data;
+
+	return true;
+}
+
+static bool dtd_is_valid(const uint8_t *dtd)
+{
+	int hactive = dtd[2] | (dtd[4] & 0xf0) << 4;
+	int vactive = dtd[5] | (dtd[7] & 0xf0) << 4;
+
+	return hactive && vactive;
+}
+
+/* Records the HDMI VSDB like edid_get_deep_color_from_vsdb() looks for it. */
+static void edid_index_vsdb(struct edid_index *index, const uint8_t *data,
+			    size_t len)
+{
+	const struct cea_vsdb *vsdb = (const struct cea_vsdb *) data;
+
+	if (len < CEA_VSDB_HDMI_MIN_SIZE || ieee_oui(vsdb->ieee_oui) != 0x000C03)
+		return;
+
+	if (!index->hdmi_vsdb) {
+		index->hdmi_vsdb = &vsdb->data.hdmi;
+		index->hdmi_vsdb_size = len - CEA_VSDB_HEADER_SIZE;
+	}
+
+	if (len > CEA_VSDB_HDMI_MIN_SIZE && !index->deep_color &&
+	    vsdb->data.hdmi.flags1 & (7 << 4))
+		index->deep_color = vsdb->data.hdmi.flags1;
+}
+
+static bool edid_walk_cea(const struct edid_ext *ext, int ext_index,
+			  struct edid_index *index, const char **reason)
+{
+	const uint8_t *raw = (const uint8_t *) ext;
+	const struct edid_cea *cea = &ext->data.cea;
+	int offset, len, tag;
+
+	if (cea->revision < 1 || cea->revision > 3)
+		return edid_error(reason, "unsupported CEA extension revision");
+
+	if (cea->dtd_start == 0)
+		return true; /* neither data blocks nor DTDs */
+
+	if (cea->dtd_start < 4 || cea->dtd_start >= EDID_BLOCK_SIZE - 1)
+		return edid_error(reason, "invalid CEA DTD offset");
+
+	/* The Data Block Collection only exists since revision 3 */
+	for (offset = 4; cea->revision == 3 && offset < cea->dtd_start;
+	     offset += len + 1) {
+		tag = raw[offset] >> 5;
+		len = raw[offset] & 0x1f;
+
+		if (offset + 1 + len > cea->dtd_start)
+			return edid_error(reason, "CEA data block overflows the data block collection");
+
+		if (!edid_index_add(index, EDID_BLOCK_CEA_DATA, ext_index, tag,
+				    &raw[offset + 1], len, reason))
+			return false;
+
+		if (index && tag == EDID_CEA_DATA_VENDOR_SPECIFIC)
+			edid_index_vsdb(index, &raw[offset + 1], len);
+	}
+
+	for (offset = cea->dtd_start;
+	     offset + sizeof(struct detailed_timing) < EDID_BLOCK_SIZE;
+	     offset += sizeof(struct detailed_timing)) {
+		if (raw[offset] == 0 && raw[offset + 1] == 0)
+			break; /* padding */
+
+		if (!dtd_is_valid(&raw[offset]))
+			return edid_error(reason, "CEA DTD without an active area");
+
+		if (!edid_index_add(index, EDID_BLOCK_CEA_DTD, ext_index, 0,
+				    &raw[offset], sizeof(struct detailed_timing),
+				    reason))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * A DisplayID section: version, length of the data blocks, product type,
+ * extension count, data blocks and checksum.
+ */
+#define DISPLAYID_HEADER_SIZE 4
+#define DISPLAYID_MAX_SECTION_SIZE \
+	(EDID_BLOCK_SIZE - 1 - DISPLAYID_HEADER_SIZE - 1 - 1)
+
+static bool edid_walk_displayid(const struct edid_ext *ext, int ext_index,
+				struct edid_index *index, const char **reason)
+{
+	const uint8_t *section = (const uint8_t *) ext + 1;
+	const uint8_t *blocks = section + DISPLAYID_HEADER_SIZE;
+	int size = section[1];
+	int offset, len;
+
+	if (size > DISPLAYID_MAX_SECTION_SIZE)
+		return edid_error(reason, "DisplayID section overflows its extension block");
+
+	for (offset = 0; offset + 3 <= size; offset += 3 + len) {
+		len = blocks[offset + 2];
+
+		if (blocks[offset] == 0 && len == 0)
+			break; /* padding */
+
+		if (offset + 3 + len > size)
+			return edid_error(reason, "DisplayID data block overflows its section");
+
+		if (!edid_index_add(index, EDID_BLOCK_DISPLAYID, ext_index,
+				    blocks[offset], &blocks[offset + 3], len,
+				    reason))
+			return false;
+	}
+
+	return true;
+}
+
+/* Walks the blocks of the extensions present in the first @size bytes. */
+static bool edid_walk(const struct edid *edid, size_t size,
+		      struct edid_index *index, const char **reason)
+{
+	int n_extensions = size / EDID_BLOCK_SIZE - 1;
+	const struct edid_ext *ext;
+	bool ret = true;
+
+	if (edid->extensions_len < n_extensions)
+		n_extensions = edid->extensions_len;
+
+	for (int i = 0; i < n_extensions && ret; i++) {
+		ext = &edid->extensions[i];
+
+		if (ext->tag == EDID_EXT_CEA)
+			ret = edid_walk_cea(ext, i, index, reason);
+		else if (ext->tag == EDID_EXT_DISPLAYID)
+			ret = edid_walk_displayid(ext, i, index, reason);
+	}
+
+	if (ret && edid_get_size(edid) > size)
+		return edid_error(reason, "EDID is smaller than its extension count");
+
+	return ret;
+}
+
 /**
- * edid_get_deep_color_from_vsdb: return the Deep Color info from Vendor
- * Specific Data Block (VSDB), if VSDB not found then return zero.
+ * edid_index_init:
+ * @index: the index to initialize
+ * @edid: the EDID to index, which must outlive @index
+ * @size: the size of @edid in bytes, e.g. the size of a connector EDID blob
+ *
+ * Indexes the data blocks of the CEA and DisplayID extensions, and the DTDs of
+ * the CEA extensions, in a single pass. Lookups with #edid_index_find then
+ * don't need to walk the extensions again. Nothing past @size is read.
+ *
+ * Returns: false if the EDID is malformed, in which case only the blocks
+ * preceding the problem are indexed.
  */
-uint8_t edid_get_deep_color_from_vsdb(const struct edid *edid)
+bool edid_index_init(struct edid_index *index, const struct edid *edid,
+		     size_t size)
 {
-	const struct edid_ext *edid_ext;
-	const struct edid_cea *edid_cea;
-	const char *cea_data;
-	uint8_t deep_color = 0;
-	int offset, i, j;
+	memset(index, 0, sizeof(*index));
+	index->edid = edid;
+	index->size = size;
 
-	/*
-	 * Read from vendor specific data block first, if vsdb not found
-	 * return 0.
-	 */
-	for (i = 0; i < edid->extensions_len; i++) {
-		edid_ext = &edid->extensions[i];
-		edid_cea = &edid_ext->data.cea;
+	if (size < EDID_BLOCK_SIZE)
+		return false;
+
+	return edid_walk(edid, size, index, NULL);
+}
+
+/**
+ * edid_index_find:
+ * @index: an index initialized by #edid_index_init
+ * @kind: the kind of block to look for
+ * @tag: the tag of the block, or -1 for any
+ * @prev: the previously found block to continue the search after, or NULL
+ *
+ * Returns: the next block of the given kind and tag, in EDID order, or NULL.
+ */
+const struct edid_block_ref *edid_index_find(const struct edid_index *index,
+					     enum edid_block_kind kind, int tag,
+					     const struct edid_block_ref *prev)
+{
+	int i = prev ? prev - index->blocks + 1 : 0;
 
-		if ((edid_ext->tag != EDID_EXT_CEA) ||
-		    (edid_cea->revision != 3))
-			continue;
+	for (; i < index->n_blocks; i++) {
+		const struct edid_block_ref *ref = &index->blocks[i];
 
-		offset = edid_cea->dtd_start;
-		cea_data = edid_cea->data;
+		if (ref->kind == kind && (tag < 0 || ref->tag == tag))
+			return ref;
+	}
 
-		for (j = 0; j < offset; j += (cea_data[j] & 0x1F) + 1) {
-			struct edid_cea_data_block *vsdb =
-				(struct edid_cea_data_block *)(cea_data + j);
+	return NULL;
+}
 
-			if (((vsdb->type_len & 0xE0) >> 5) != EDID_CEA_DATA_VENDOR_SPECIFIC)
-				continue;
+/**
+ * edid_validate:
+ * @edid: the EDID to validate
+ * @size: the size of @edid in bytes
+ * @reason: if non-NULL, set to a description of the first problem found
+ *
+ * Checks the base block (header, version, checksum and detailed timings) and
+ * the structure and checksums of the CEA and DisplayID extensions. Nothing
+ * past @size is read.
+ *
+ * Returns: true if the EDID is valid.
+ */
+bool edid_validate(const struct edid *edid, size_t size, const char **reason)
+{
+	const uint8_t *raw = (const uint8_t *) edid;
+	const struct edid_ext *ext;
 
-			if (ieee_oui(vsdb->data.vsdbs->ieee_oui) == 0x000C03)
-				deep_color = vsdb->data.vsdbs->data.hdmi.flags1;
+	if (size < EDID_BLOCK_SIZE || size % EDID_BLOCK_SIZE)
+		return edid_error(reason, "EDID size isn't a multiple of the block size");
 
-			if (deep_color & (7 << 4))
-				return deep_color;
+	if (memcmp(edid->header, edid_header, sizeof(edid_header)))
+		return edid_error(reason, "invalid EDID header");
+
+	if (edid->version != 1)
+		return edid_error(reason, "unsupported EDID version");
+
+	if (size != edid_get_size(edid))
+		return edid_error(reason, "EDID size doesn't match its extension count");
+
+	if (edid_sum(raw, EDID_BLOCK_SIZE))
+		return edid_error(reason, "invalid base block checksum");
+
+	for (int i = 0; i < DETAILED_TIMINGS_LEN; i++) {
+		const struct detailed_timing *dt = &edid->detailed_timings[i];
+
+		if (dt->pixel_clock[0] || dt->pixel_clock[1]) {
+			if (!dtd_is_valid((const uint8_t *) dt))
+				return edid_error(reason, "DTD without an active area");
+		} else if (dt->data.other_data.pad1) {
+			return edid_error(reason, "invalid display descriptor");
 		}
 	}
 
-	return 0;
+	for (int i = 0; i < edid->extensions_len; i++) {
+		ext = &edid->extensions[i];
+
+		if (edid_sum((const uint8_t *) ext, EDID_BLOCK_SIZE))
+			return edid_error(reason, "invalid extension block checksum");
+
+		/* The section checksum covers the header and the data blocks */
+		if (ext->tag == EDID_EXT_DISPLAYID &&
+		    ext->data.tile.header[1] <= DISPLAYID_MAX_SECTION_SIZE &&
+		    edid_sum((const uint8_t *) ext + 1,
+			     DISPLAYID_HEADER_SIZE + ext->data.tile.header[1] + 1))
+			return edid_error(reason, "invalid DisplayID section checksum");
+	}
+
+	return edid_walk(edid, size, NULL, reason);
+}
+
+/**
+ * edid_get_deep_color_from_vsdb: return the Deep Color info from Vendor
+ * Specific Data Block (VSDB), if VSDB not found then return zero.
+ *
+ * This walks the extensions on each call, see #edid_index_init to only do it
+ * once.
+ */
+uint8_t edid_get_deep_color_from_vsdb(const struct edid *edid)
+{
+	struct edid_index index;
+
+	edid_index_init(&index, edid, edid_get_size(edid));
+
+	return index.deep_color;
 }
 
 /**
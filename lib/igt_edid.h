@@ -28,6 +28,7 @@
 
 #include "config.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <xf86drmMode.h>
@@ -371,6 +372,42 @@ struct edid {
 	struct edid_ext extensions[];
 } __attribute__((packed));
 
+enum edid_block_kind {
+	EDID_BLOCK_CEA_DATA, /* tag is from enum edid_cea_data_type */
+	EDID_BLOCK_CEA_DTD, /* struct detailed_timing */
+	EDID_BLOCK_DISPLAYID, /* tag is the DisplayID data block tag */
+};
+
+/**
+ * edid_block_ref: a block found in an EDID extension
+ */
+struct edid_block_ref {
+	uint8_t kind; /* enum edid_block_kind */
+	uint8_t ext; /* index of the extension block */
+	uint8_t tag;
+	uint8_t len; /* length of the payload */
+	const uint8_t *data; /* payload, without the block header */
+};
+
+#define EDID_INDEX_MAX_BLOCKS 256
+
+/**
+ * edid_index: the blocks of an EDID's extensions, see edid_index_init()
+ */
+struct edid_index {
+	const struct edid *edid;
+	size_t size;
+
+	int n_blocks;
+	struct edid_block_ref blocks[EDID_INDEX_MAX_BLOCKS];
+
+	/* First HDMI VSDB, NULL if none */
+	const struct hdmi_vsdb *hdmi_vsdb;
+	size_t hdmi_vsdb_size;
+	/* As returned by edid_get_deep_color_from_vsdb() */
+	uint8_t deep_color;
+};
+
 void edid_init(struct edid *edid);
 void edid_init_with_mode(struct edid *edid, drmModeModeInfo *mode);
 void edid_update_checksum(struct edid *edid);
@@ -379,6 +416,12 @@ size_t edid_get_size(const struct edid *edid);
 void edid_get_mfg(const struct edid *edid, char out[static 3]);
 uint8_t edid_get_deep_color_from_vsdb(const struct edid *edid);
 uint8_t edid_get_bit_depth_from_vid(const struct edid *edid);
+bool edid_validate(const struct edid *edid, size_t size, const char **reason);
+bool edid_index_init(struct edid_index *index, const struct edid *edid,
+		     size_t size);
+const struct edid_block_ref *edid_index_find(const struct edid_index *index,
+					     enum edid_block_kind kind, int tag,
+					     const struct edid_block_ref *prev);
 void detailed_timing_set_mode(struct detailed_timing *dt, drmModeModeInfo *mode,
 			      int width_mm, int height_mm);
 void detailed_timing_set_monitor_range_mode(struct detailed_timing *dt,
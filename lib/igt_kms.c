@@ -363,6 +363,8 @@ struct edid **igt_kms_get_tiled_edid(uint8_t htile, uint8_t vtile)
 		edid_tile->topology_id[6] = 0x00;
 		edid_tile->topology_id[7] = 0x00;
 		edid_tile->topology_id[8] = 0x00;
+
+		edid_update_checksum(edid[i]);
 	}
 	return edid;
 }
@@ -1211,6 +1213,12 @@ void kmstest_set_vt_text_mode(void)
 	igt_assert(set_vt_mode(KD_TEXT) >= 0);
 }
 
+/*
+ * Connector changes seen by this process, stale property snapshots of all
+ * displays are dropped when it moves.
+ */
+static unsigned int kms_hotplugs;
+
 static void reset_connectors_at_exit(int sig)
 {
 	igt_reset_connectors();
@@ -1380,6 +1388,7 @@ bool kmstest_force_connector(int drm_fd, drmModeConnector *connector,
 	if (!force_connector(drm_fd, connector, value))
 		return false;
 
+	kms_hotplugs++;
 	dump_forced_connectors();
 
 	igt_install_exit_handler(reset_connectors_at_exit);
@@ -1422,6 +1431,7 @@ void kmstest_force_edid(int drm_fd, drmModeConnector *connector,
 		ret = write(debugfs_fd, edid,
 			    edid_get_size(edid));
 	close(debugfs_fd);
+	kms_hotplugs++;
 
 	/* To allow callers to always use GetConnectorCurrent we need to force a
 	 * redetection here. */
@@ -1921,6 +1931,7 @@ void igt_output_refresh(igt_output_t *output)
 	_kmstest_connector_config(display->drm_fd, output->id, crtc_idx_mask,
 				  &output->config, output->force_reprobe);
 	output->force_reprobe = false;
+	igt_display_invalidate_props(display);
 
 	if (!output->name && output->config.connector) {
 		drmModeConnector *c = output->config.connector;
@@ -3292,6 +3303,23 @@ static int igt_output_commit(igt_output_t *output,
 	return 0;
 }
 
+static drmModeObjectPropertiesPtr
+igt_mode_object_get_props(igt_display_t *display, uint32_t object_type,
+			  uint32_t object_id)
+{
+	drmModeObjectPropertiesPtr proplist;
+
+	if (display->get_object_props)
+		proplist = display->get_object_props(display->drm_fd, object_id,
+						     object_type);
+	else
+		proplist = drmModeObjectGetProperties(display->drm_fd, object_id,
+						      object_type);
+	igt_assert(proplist);
+
+	return proplist;
+}
+
 static uint64_t igt_mode_object_get_prop(igt_display_t *display,
 					 uint32_t object_type,
 					 uint32_t object_id,
@@ -3302,7 +3330,7 @@ static uint64_t igt_mode_object_get_prop(igt_display_t *display,
 	int i;
 	uint64_t ret;
 
-	proplist = drmModeObjectGetProperties(display->drm_fd, object_id, object_type);
+	proplist = igt_mode_object_get_props(display, object_type, object_id);
 	for (i = 0; i < proplist->count_props; i++) {
 		if (proplist->props[i] != prop)
 			continue;
@@ -3319,6 +3347,281 @@ static uint64_t igt_mode_object_get_prop(igt_display_t *display,
 	return ret;
 }
 
+/*
+ * Reads back all the properties in @props of one object with a single
+ * ioctl, @snapshot is indexed like @props.
+ */
+static void igt_mode_object_snapshot(igt_display_t *display,
+				     uint32_t object_type, uint32_t object_id,
+				     const uint32_t *props, int num_props,
+				     uint64_t *snapshot)
+{
+	drmModeObjectPropertiesPtr proplist;
+	int i, j;
+
+	proplist = igt_mode_object_get_props(display, object_type, object_id);
+
+	for (i = 0; i < num_props; i++) {
+		if (!props[i])
+			continue;
+
+		for (j = 0; j < proplist->count_props; j++)
+			if (proplist->props[j] == props[i])
+				break;
+
+		igt_assert(j < proplist->count_props);
+		snapshot[i] = proplist->prop_values[j];
+	}
+
+	drmModeFreeObjectProperties(proplist);
+}
+
+static bool igt_display_has_snapshot(igt_display_t *display)
+{
+	if (!display->props_snapshot)
+		return false;
+
+	if (display->props_hotplugs != kms_hotplugs) {
+		display->props_hotplugs = kms_hotplugs;
+		display->props_seq++;
+	}
+
+	return true;
+}
+
+/*
+ * A plane that can go on several pipes has one snapshot, kept in the
+ * global plane and shared by all its per-pipe copies.
+ */
+static const uint64_t *igt_plane_snapshot(igt_plane_t *plane)
+{
+	igt_display_t *display = plane->pipe->display;
+	igt_plane_t *global = plane->ref;
+
+	if (global->snapshot_seq != display->props_seq) {
+		igt_mode_object_snapshot(display, DRM_MODE_OBJECT_PLANE,
+					 plane->drm_plane->plane_id,
+					 plane->props, IGT_NUM_PLANE_PROPS,
+					 global->snapshot);
+		global->snapshot_seq = display->props_seq;
+	}
+
+	return global->snapshot;
+}
+
+static const uint64_t *igt_pipe_snapshot(igt_pipe_t *pipe)
+{
+	igt_display_t *display = pipe->display;
+
+	if (pipe->snapshot_seq != display->props_seq) {
+		igt_mode_object_snapshot(display, DRM_MODE_OBJECT_CRTC,
+					 pipe->crtc_id, pipe->props,
+					 IGT_NUM_CRTC_PROPS, pipe->snapshot);
+		pipe->snapshot_seq = display->props_seq;
+	}
+
+	return pipe->snapshot;
+}
+
+static const uint64_t *igt_output_snapshot(igt_output_t *output)
+{
+	igt_display_t *display = output->display;
+
+	if (output->snapshot_seq != display->props_seq) {
+		igt_mode_object_snapshot(display, DRM_MODE_OBJECT_CONNECTOR,
+					 output->id, output->props,
+					 IGT_NUM_CONNECTOR_PROPS,
+					 output->snapshot);
+		output->snapshot_seq = display->props_seq;
+	}
+
+	return output->snapshot;
+}
+
+static bool output_has_props(igt_output_t *output)
+{
+	for (int i = 0; i < IGT_NUM_CONNECTOR_PROPS; i++)
+		if (output->props[i])
+			return true;
+
+	return false;
+}
+
+/**
+ * igt_display_snapshot_props:
+ * @display: a pointer to an #igt_display_t structure
+ *
+ * Reads back the properties of every plane, CRTC and connector of @display,
+ * with one ioctl per object. From then on igt_plane_get_prop(),
+ * igt_pipe_obj_get_prop() and igt_output_get_prop() answer from the
+ * snapshot instead of asking the kernel for every property.
+ *
+ * The snapshot is dropped by commits, by forcing connectors and by
+ * igt_hotplug_detected() seeing a hotplug, after which each object is read
+ * back again the next time one of its properties is asked for. Tests that
+ * change the state behind the back of @display, with drmModeAtomicCommit()
+ * or drmModeSetCrtc() for instance, need to call
+ * igt_display_invalidate_props() themselves.
+ *
+ * Connector properties the kernel updates on its own, "Content Protection"
+ * and "link-status", are always read from the kernel.
+ *
+ * Getters keep using snapshots until igt_display_drop_snapshot().
+ */
+void igt_display_snapshot_props(igt_display_t *display)
+{
+	enum pipe pipe;
+	int i;
+
+	display->props_snapshot = true;
+	display->props_hotplugs = kms_hotplugs;
+	display->props_seq++;
+
+	for_each_pipe(display, pipe) {
+		igt_pipe_t *pipe_obj = &display->pipes[pipe];
+		igt_plane_t *plane;
+
+		igt_pipe_snapshot(pipe_obj);
+
+		for_each_plane_on_pipe(display, pipe, plane)
+			if (plane->drm_plane)
+				igt_plane_snapshot(plane);
+	}
+
+	for (i = 0; i < display->n_outputs; i++)
+		if (output_has_props(&display->outputs[i]))
+			igt_output_snapshot(&display->outputs[i]);
+}
+
+/**
+ * igt_display_invalidate_props:
+ * @display: a pointer to an #igt_display_t structure
+ *
+ * Drops the property snapshot of @display taken by
+ * igt_display_snapshot_props(), so the next property getters read the
+ * values from the kernel again.
+ */
+void igt_display_invalidate_props(igt_display_t *display)
+{
+	display->props_seq++;
+}
+
+/**
+ * igt_display_drop_snapshot:
+ * @display: a pointer to an #igt_display_t structure
+ *
+ * Drops the property snapshot of @display and stops taking new ones, so the
+ * property getters ask the kernel for every property again, like before
+ * igt_display_snapshot_props().
+ */
+void igt_display_drop_snapshot(igt_display_t *display)
+{
+	display->props_snapshot = false;
+	display->props_seq++;
+}
+
+/* Properties the kernel changes by itself, never answered from a snapshot */
+#define CONNECTOR_ASYNC_MASK \
+	((1ULL << IGT_CONNECTOR_CONTENT_PROTECTION) | \
+	 (1ULL << IGT_CONNECTOR_LINK_STATUS))
+
+/* Properties that can't be read back as they were set */
+#define PLANE_DIFF_SKIP_MASK \
+	((1ULL << IGT_PLANE_IN_FENCE_FD) | \
+	 (1ULL << IGT_PLANE_FB_DAMAGE_CLIPS))
+#define CRTC_DIFF_SKIP_MASK \
+	(1ULL << IGT_CRTC_OUT_FENCE_PTR)
+#define CONNECTOR_DIFF_SKIP_MASK \
+	((1ULL << IGT_CONNECTOR_WRITEBACK_FB_ID) | \
+	 (1ULL << IGT_CONNECTOR_WRITEBACK_OUT_FENCE_PTR) | \
+	 CONNECTOR_ASYNC_MASK)
+
+static int diff_props(const char *object, uint64_t mask,
+		      const char * const prop_names[], const uint64_t *values,
+		      const uint64_t *snapshot, int num_props)
+{
+	int i, diffs = 0;
+
+	for (i = 0; i < num_props; i++) {
+		if (!(mask & (1ULL << i)) || values[i] == snapshot[i])
+			continue;
+
+		igt_info("%s %s: committed 0x%"PRIx64", kernel has 0x%"PRIx64"\n",
+			 object, prop_names[i], values[i], snapshot[i]);
+		diffs++;
+	}
+
+	return diffs;
+}
+
+/**
+ * igt_display_diff_props:
+ * @display: a pointer to an #igt_display_t structure
+ *
+ * Compares the properties committed through @display with the values the
+ * kernel reports for them, logging the ones that differ. Only properties
+ * that were part of a successful commit are compared, other properties
+ * keep whatever value the kernel picked. Blob properties are compared by
+ * blob id. This reads back a new snapshot with igt_display_snapshot_props(),
+ * the getters only keep using it if @display already had one.
+ *
+ * Returns: The number of properties that differ.
+ */
+int igt_display_diff_props(igt_display_t *display)
+{
+	bool had_snapshot = display->props_snapshot;
+	enum pipe pipe;
+	char object[64];
+	int i, diffs = 0;
+
+	igt_display_snapshot_props(display);
+
+	for_each_pipe(display, pipe) {
+		igt_pipe_t *pipe_obj = &display->pipes[pipe];
+		igt_plane_t *plane;
+
+		snprintf(object, sizeof(object), "pipe %s",
+			 kmstest_pipe_name(pipe));
+		diffs += diff_props(object,
+				    pipe_obj->committed & ~CRTC_DIFF_SKIP_MASK,
+				    igt_crtc_prop_names, pipe_obj->values,
+				    igt_pipe_snapshot(pipe_obj),
+				    IGT_NUM_CRTC_PROPS);
+
+		for_each_plane_on_pipe(display, pipe, plane) {
+			/* skip planes that are handled by another pipe */
+			if (!plane->drm_plane || plane->ref->pipe != pipe_obj)
+				continue;
+
+			snprintf(object, sizeof(object), "plane %s.%d",
+				 kmstest_pipe_name(pipe), plane->index);
+			diffs += diff_props(object,
+					    plane->committed & ~PLANE_DIFF_SKIP_MASK,
+					    igt_plane_prop_names, plane->values,
+					    igt_plane_snapshot(plane),
+					    IGT_NUM_PLANE_PROPS);
+		}
+	}
+
+	for (i = 0; i < display->n_outputs; i++) {
+		igt_output_t *output = &display->outputs[i];
+
+		if (!output_has_props(output))
+			continue;
+
+		diffs += diff_props(igt_output_name(output),
+				    output->committed & ~CONNECTOR_DIFF_SKIP_MASK,
+				    igt_connector_prop_names, output->values,
+				    igt_output_snapshot(output),
+				    IGT_NUM_CONNECTOR_PROPS);
+	}
+
+	if (!had_snapshot)
+		igt_display_drop_snapshot(display);
+
+	return diffs;
+}
+
 /**
  * igt_plane_get_prop:
  * @plane: Target plane.
@@ -3334,6 +3637,9 @@ uint64_t igt_plane_get_prop(igt_plane_t *plane, enum igt_atomic_plane_properties
 {
 	igt_assert(igt_plane_has_prop(plane, prop));
 
+	if (igt_display_has_snapshot(plane->pipe->display))
+		return igt_plane_snapshot(plane)[prop];
+
 	return igt_mode_object_get_prop(plane->pipe->display, DRM_MODE_OBJECT_PLANE,
 					plane->drm_plane->plane_id, plane->props[prop]);
 }
@@ -3427,6 +3733,10 @@ uint64_t igt_output_get_prop(igt_output_t *output, enum igt_atomic_connector_pro
 {
 	igt_assert(igt_output_has_prop(output, prop));
 
+	if (!(CONNECTOR_ASYNC_MASK & (1ULL << prop)) &&
+	    igt_display_has_snapshot(output->display))
+		return igt_output_snapshot(output)[prop];
+
 	return igt_mode_object_get_prop(output->display, DRM_MODE_OBJECT_CONNECTOR,
 					output->id, output->props[prop]);
 }
@@ -3502,6 +3812,9 @@ uint64_t igt_pipe_obj_get_prop(igt_pipe_t *pipe, enum igt_atomic_crtc_properties
 {
 	igt_assert(igt_pipe_obj_has_prop(pipe, prop));
 
+	if (igt_display_has_snapshot(pipe->display))
+		return igt_pipe_snapshot(pipe)[prop];
+
 	return igt_mode_object_get_prop(pipe->display, DRM_MODE_OBJECT_CRTC,
 					pipe->crtc_id, pipe->props[prop]);
 }
@@ -3666,6 +3979,8 @@ static int igt_atomic_commit(igt_display_t *display, uint32_t flags, void *user_
 	}
 
 	ret = drmModeAtomicCommit(display->drm_fd, req, flags, user_data);
+	if (!(flags & DRM_MODE_ATOMIC_TEST_ONLY))
+		igt_display_invalidate_props(display);
 
 	drmModeAtomicFree(req);
 	return ret;
@@ -3680,6 +3995,7 @@ display_commit_changed(igt_display_t *display, enum igt_commit_style s)
 
 	for_each_pipe(display, pipe) {
 		igt_pipe_t *pipe_obj = &display->pipes[pipe];
+		uint64_t changed = pipe_obj->changed;
 		igt_plane_t *plane;
 
 		if (s == COMMIT_ATOMIC) {
@@ -3697,9 +4013,15 @@ display_commit_changed(igt_display_t *display, enum igt_commit_style s)
 				igt_pipe_obj_clear_prop_changed(pipe_obj, IGT_CRTC_MODE_ID);
 				igt_pipe_obj_clear_prop_changed(pipe_obj, IGT_CRTC_ACTIVE);
 			}
+
+			/* the kernel makes its own blob for legacy modesets */
+			changed &= ~(1ULL << IGT_CRTC_MODE_ID);
 		}
+		pipe_obj->committed |= changed & ~pipe_obj->changed;
 
 		for_each_plane_on_pipe(display, pipe, plane) {
+			changed = plane->changed;
+
 			if (s == COMMIT_ATOMIC) {
 				int fd;
 				plane->changed = 0;
@@ -3724,11 +4046,13 @@ display_commit_changed(igt_display_t *display, enum igt_commit_style s)
 				if (display->first_commit)
 					igt_plane_clear_prop_changed(plane, IGT_PLANE_ROTATION);
 			}
+			plane->committed |= changed & ~plane->changed;
 		}
 	}
 
 	for (i = 0; i < display->n_outputs; i++) {
 		igt_output_t *output = &display->outputs[i];
+		uint64_t changed = output->changed;
 
 		if (s != COMMIT_UNIVERSAL)
 			output->changed = 0;
@@ -3745,6 +4069,7 @@ display_commit_changed(igt_display_t *display, enum igt_commit_style s)
 			igt_output_clear_prop_changed(output, IGT_CONNECTOR_WRITEBACK_FB_ID);
 			igt_output_clear_prop_changed(output, IGT_CONNECTOR_WRITEBACK_OUT_FENCE_PTR);
 		}
+		output->committed |= changed & ~output->changed;
 	}
 
 	if (display->first_commit) {
@@ -3791,6 +4116,8 @@ static int do_display_commit(igt_display_t *display,
 
 		for (i = 0; !ret && i < display->n_outputs; i++)
 			ret = igt_output_commit(&display->outputs[i], s, fail_on_error);
+
+		igt_display_invalidate_props(display);
 	}
 
 	LOG_UNINDENT(display);
@@ -4754,8 +5081,12 @@ bool igt_hotplug_detected(struct udev_monitor *mon, int timeout_secs)
 	const char *props[1] = {"HOTPLUG"};
 	int expected_val = 1;
 
-	return event_detected(mon, timeout_secs, props, &expected_val,
-			      ARRAY_SIZE(props));
+	if (!event_detected(mon, timeout_secs, props, &expected_val,
+			    ARRAY_SIZE(props)))
+		return false;
+
+	kms_hotplugs++;
+	return true;
 }
 
 /**
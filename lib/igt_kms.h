@@ -364,6 +364,11 @@ typedef struct igt_plane {
 	uint32_t props[IGT_NUM_PLANE_PROPS];
 	uint64_t values[IGT_NUM_PLANE_PROPS];
 
+	/* properties committed so far, and values read back from the kernel */
+	uint64_t committed;
+	uint64_t snapshot[IGT_NUM_PLANE_PROPS];
+	unsigned int snapshot_seq;
+
 	uint64_t *modifiers;
 	uint32_t *formats;
 	int format_mod_count;
@@ -391,6 +396,10 @@ struct igt_pipe {
 	uint32_t props[IGT_NUM_CRTC_PROPS];
 	uint64_t values[IGT_NUM_CRTC_PROPS];
 
+	uint64_t committed;
+	uint64_t snapshot[IGT_NUM_CRTC_PROPS];
+	unsigned int snapshot_seq;
+
 	/* ID of KMS CRTC object */
 	uint32_t crtc_id;
 	/* offset of a pipe in drmModeRes.crtcs */
@@ -417,6 +426,10 @@ typedef struct {
 
 	uint32_t props[IGT_NUM_CONNECTOR_PROPS];
 	uint64_t values[IGT_NUM_CONNECTOR_PROPS];
+
+	uint64_t committed;
+	uint64_t snapshot[IGT_NUM_CONNECTOR_PROPS];
+	unsigned int snapshot_seq;
 } igt_output_t;
 
 struct igt_display {
@@ -435,6 +448,16 @@ struct igt_display {
 	uint64_t *modifiers;
 	uint32_t *formats;
 	int format_mod_count;
+
+	/*
+	 * property readback, see igt_display_snapshot_props(), objects are
+	 * read with drmModeObjectGetProperties() unless get_object_props is set
+	 */
+	drmModeObjectPropertiesPtr (*get_object_props)(int fd, uint32_t object_id,
+						       uint32_t object_type);
+	bool props_snapshot;
+	unsigned int props_seq;
+	unsigned int props_hotplugs;
 };
 
 typedef struct {
@@ -448,6 +471,10 @@ typedef struct {
 void igt_display_require(igt_display_t *display, int drm_fd);
 void igt_display_fini(igt_display_t *display);
 void igt_display_reset(igt_display_t *display);
+void igt_display_snapshot_props(igt_display_t *display);
+void igt_display_invalidate_props(igt_display_t *display);
+void igt_display_drop_snapshot(igt_display_t *display);
+int igt_display_diff_props(igt_display_t *display);
 int  igt_display_commit2(igt_display_t *display, enum igt_commit_style s);
 int  igt_display_commit(igt_display_t *display);
 int  igt_display_try_commit_atomic(igt_display_t *display, uint32_t flags, void *user_data);
@@ -479,6 +479,37 @@ double igt_stats_get_median(igt_stats_t *stats)
 					     NULL, NULL);
 }
 
+/**
+ * igt_stats_get_percentile:
+ * @stats: An #igt_stats_t instance
+ * @percentile: The percentile to retrieve, between 0 and 100
+ *
+ * Retrieves the @percentile-th percentile of the @stats dataset, linearly
+ * interpolated between the two closest ranks. The 0th and 100th percentiles
+ * are the minimum and maximum, the 50th is the median.
+ */
+double igt_stats_get_percentile(igt_stats_t *stats, double percentile)
+{
+	unsigned int lower;
+	double rank;
+
+	if (!stats->n_values)
+		return 0.;
+
+	igt_stats_ensure_sorted_values(stats);
+
+	rank = percentile / 100. * (stats->n_values - 1);
+	if (rank <= 0.)
+		return sorted_value(stats, 0);
+	if (rank >= stats->n_values - 1)
+		return sorted_value(stats, stats->n_values - 1);
+
+	lower = rank;
+	return sorted_value(stats, lower) +
+		(rank - lower) * (sorted_value(stats, lower + 1) -
+				  sorted_value(stats, lower));
+}
+
 /*
  * Algorithm popularised by Knuth in:
  *
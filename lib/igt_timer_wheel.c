@@ -0,0 +1,502 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_timer_wheel.h"
+
+/**
+ * SECTION:igt_timer_wheel
+ * @short_description: Process-wide timers for test helpers
+ * @title: Timer wheel
+ * @include: igt_timer_wheel.h
+ *
+ * Helpers like the spinners of igt_dummyload need to do something after a
+ * timeout, without the test waiting for it. Instead of a thread per timer,
+ * all the timers of the process are kept in a hierarchical timer wheel and
+ * expired by a single realtime thread sleeping on a timerfd, armed for the
+ * exact expiry time of the next timer.
+ *
+ * The wheel has levels of 64 slots. A slot of level 0 holds the timers
+ * expiring within one tick of about a millisecond, a slot of level n holds
+ * 64^n ticks. Timers move down a level as their expiry approaches, so
+ * arming and cancelling a timer are O(1) whatever the number of timers.
+ *
+ * The timer callbacks run in the timer thread, in order of expiry. The
+ * timers don't survive igt_fork(), the children start with an empty wheel.
+ */
+
+#define TICK_SHIFT 20
+#define LVL_BITS 6
+#define LVL_SIZE (1 << LVL_BITS)
+#define LVL_MASK (LVL_SIZE - 1)
+#define LVL_DEPTH 6
+#define MAX_DELTA ((1ull << (LVL_BITS * LVL_DEPTH)) - 1)
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	struct igt_list_head slots[LVL_DEPTH][LVL_SIZE];
+	unsigned int count[LVL_DEPTH];
+	/* Expired timers waiting for their callback, in order of expiry */
+	struct igt_list_head expired;
+	struct igt_timer *running;
+	/* The tick being expired, all before it are done */
+	uint64_t clk;
+	/* What the timerfd is armed for, 0 if not armed */
+	uint64_t next_wake;
+	pthread_t thread;
+	int timerfd;
+	bool started;
+} wheel = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+	.timerfd = -1,
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static bool wheel_empty(void)
+{
+	for (int lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		if (wheel.count[lvl])
+			return false;
+	}
+
+	return true;
+}
+
+static void enqueue(struct igt_timer *timer)
+{
+	uint64_t tick = timer->expires >> TICK_SHIFT;
+	uint64_t delta;
+	int lvl;
+
+	if (tick < wheel.clk)
+		tick = wheel.clk;
+
+	delta = tick - wheel.clk;
+	if (delta > MAX_DELTA) {
+		delta = MAX_DELTA;
+		tick = wheel.clk + delta;
+	}
+
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++) {
+		if (delta < 1ull << (LVL_BITS * (lvl + 1)))
+			break;
+	}
+
+	igt_list_add_tail(&timer->link,
+			  &wheel.slots[lvl][(tick >> (LVL_BITS * lvl)) & LVL_MASK]);
+	wheel.count[lvl]++;
+	timer->level = lvl;
+	timer->pending = true;
+}
+
+static void dequeue(struct igt_timer *timer)
+{
+	igt_list_del_init(&timer->link);
+	if (timer->level >= 0)
+		wheel.count[timer->level]--;
+	timer->level = -1;
+	timer->pending = false;
+}
+
+/*
+ * When the clock reaches a multiple of 64^n ticks, the timers in the slot
+ * of level n for the next 64^n ticks are moved to the lower levels.
+ */
+static void cascade(void)
+{
+	for (int lvl = 1; lvl < LVL_DEPTH; lvl++) {
+		int idx = (wheel.clk >> (LVL_BITS * lvl)) & LVL_MASK;
+		struct igt_list_head *slot = &wheel.slots[lvl][idx];
+		struct igt_timer *timer, *tmp;
+		IGT_LIST_HEAD(list);
+
+		/* Timers may go back to the same slot, a full turn ahead */
+		igt_list_for_each_entry_safe(timer, tmp, slot, link)
+			igt_list_move_tail(&timer->link, &list);
+
+		igt_list_for_each_entry_safe(timer, tmp, &list, link) {
+			igt_list_del(&timer->link);
+			wheel.count[lvl]--;
+			enqueue(timer);
+		}
+
+		if (idx)
+			break;
+	}
+}
+
+static void expire_slot(struct igt_list_head *slot, uint64_t now)
+{
+	struct igt_timer *timer, *tmp, *pos;
+
+	igt_list_for_each_entry_safe(timer, tmp, slot, link) {
+		if (timer->expires > now)
+			continue;
+
+		igt_list_del(&timer->link);
+		wheel.count[0]--;
+		timer->level = -1;
+
+		/* Mostly in order already, look for the place from the end */
+		igt_list_for_each_entry_reverse(pos, &wheel.expired, link) {
+			if (pos->expires <= timer->expires)
+				break;
+		}
+		igt_list_add(&timer->link, &pos->link);
+	}
+}
+
+static void advance(uint64_t now)
+{
+	uint64_t now_tick = now >> TICK_SHIFT;
+
+	if (wheel_empty()) {
+		if (wheel.clk < now_tick)
+			wheel.clk = now_tick;
+		return;
+	}
+
+	for (;;) {
+		expire_slot(&wheel.slots[0][wheel.clk & LVL_MASK], now);
+		if (wheel.clk >= now_tick)
+			break;
+
+		/* Nothing to expire until the next cascade */
+		if (!wheel.count[0]) {
+			uint64_t next = (wheel.clk | LVL_MASK) + 1;
+
+			if (next > now_tick) {
+				wheel.clk = now_tick;
+				continue;
+			}
+
+			wheel.clk = next;
+		} else {
+			wheel.clk++;
+		}
+
+		if (!(wheel.clk & LVL_MASK))
+			cascade();
+	}
+}
+
+/*
+ * The first non-empty slot of a level after the current one holds its
+ * earliest timers. The current slot of the higher levels has already been
+ * cascaded, anything left there is a full turn ahead and comes last.
+ */
+static uint64_t level_expiry(int lvl)
+{
+	uint64_t clk = wheel.clk >> (LVL_BITS * lvl);
+	uint64_t next = UINT64_MAX;
+	struct igt_timer *timer;
+
+	for (int i = lvl ? 1 : 0; i <= LVL_SIZE; i++) {
+		struct igt_list_head *slot =
+			&wheel.slots[lvl][(clk + i) & LVL_MASK];
+
+		if (igt_list_empty(slot))
+			continue;
+
+		igt_list_for_each_entry(timer, slot, link)
+			next = min(next, timer->expires);
+		break;
+	}
+
+	return next;
+}
+
+/*
+ * The exact expiry of the next timer, whatever its level. The timers of
+ * the higher levels are cascaded down when the timer thread wakes up for
+ * them, so they don't need a wakeup at every cascade boundary.
+ */
+static uint64_t next_expiry(void)
+{
+	uint64_t next = UINT64_MAX;
+
+	for (int lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		if (wheel.count[lvl])
+			next = min(next, level_expiry(lvl));
+	}
+
+	return next;
+}
+
+static void program(void)
+{
+	uint64_t next = next_expiry();
+	struct itimerspec its = {};
+
+	if (next == wheel.next_wake)
+		return;
+
+	if (next != UINT64_MAX) {
+		its.it_value.tv_sec = next / NSEC_PER_SEC;
+		its.it_value.tv_nsec = next % NSEC_PER_SEC;
+	}
+
+	igt_assert(timerfd_settime(wheel.timerfd, TFD_TIMER_ABSTIME, &its, NULL) == 0);
+	wheel.next_wake = next == UINT64_MAX ? 0 : next;
+}
+
+static void *timer_thread(void *data)
+{
+	struct igt_timer *timer;
+	uint64_t overruns;
+
+	for (;;) {
+		if (read(wheel.timerfd, &overruns, sizeof(overruns)) < 0 &&
+		    errno != EINTR)
+			break;
+
+		pthread_mutex_lock(&wheel.lock);
+		wheel.next_wake = 0;
+		advance(now_ns());
+
+		while (!igt_list_empty(&wheel.expired)) {
+			timer = igt_list_first_entry(&wheel.expired, timer, link);
+			dequeue(timer);
+
+			wheel.running = timer;
+			pthread_mutex_unlock(&wheel.lock);
+
+			timer->func(timer);
+
+			pthread_mutex_lock(&wheel.lock);
+			wheel.running = NULL;
+			pthread_cond_broadcast(&wheel.done);
+		}
+
+		program();
+		pthread_mutex_unlock(&wheel.lock);
+	}
+
+	return NULL;
+}
+
+static void wheel_reset(void)
+{
+	struct igt_timer *timer, *tmp;
+
+	for (int lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		for (int i = 0; i < LVL_SIZE; i++) {
+			igt_list_for_each_entry_safe(timer, tmp, &wheel.slots[lvl][i], link)
+				dequeue(timer);
+		}
+	}
+
+	igt_list_for_each_entry_safe(timer, tmp, &wheel.expired, link)
+		dequeue(timer);
+}
+
+static void wheel_atfork_prepare(void)
+{
+	pthread_mutex_lock(&wheel.lock);
+}
+
+static void wheel_atfork_parent(void)
+{
+	pthread_mutex_unlock(&wheel.lock);
+}
+
+/* Only the forking thread survives in the child, and none of the timers. */
+static void wheel_atfork_child(void)
+{
+	pthread_mutex_init(&wheel.lock, NULL);
+	pthread_cond_init(&wheel.done, NULL);
+
+	if (!wheel.started)
+		return;
+
+	wheel_reset();
+	wheel.running = NULL;
+	wheel.next_wake = 0;
+	close(wheel.timerfd);
+	wheel.timerfd = -1;
+	wheel.started = false;
+}
+
+/* Called with wheel.lock held. */
+static void wheel_start(void)
+{
+	struct sched_param param = { .sched_priority = 99 };
+	static bool atfork_registered;
+	pthread_attr_t attr;
+	sigset_t all, old;
+	int err;
+
+	if (wheel.started)
+		return;
+
+	if (!atfork_registered) {
+		pthread_atfork(wheel_atfork_prepare, wheel_atfork_parent,
+			       wheel_atfork_child);
+		atfork_registered = true;
+	}
+
+	for (int lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		for (int i = 0; i < LVL_SIZE; i++)
+			IGT_INIT_LIST_HEAD(&wheel.slots[lvl][i]);
+		wheel.count[lvl] = 0;
+	}
+	IGT_INIT_LIST_HEAD(&wheel.expired);
+	wheel.clk = now_ns() >> TICK_SHIFT;
+
+	wheel.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	igt_assert(wheel.timerfd >= 0);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+
+	/* Leave the signals to the test's threads. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	err = pthread_create(&wheel.thread, &attr, timer_thread, NULL);
+	if (err == EPERM) {
+		/* Without the privileges for realtime, do without */
+		err = pthread_create(&wheel.thread, NULL, timer_thread, NULL);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+
+	igt_assert_eq(err, 0);
+	pthread_detach(wheel.thread);
+	wheel.started = true;
+}
+
+/**
+ * igt_timer_init:
+ * @timer: timer to initialize
+ * @func: function to call when @timer expires
+ *
+ * Initializes @timer, not armed. @func is called from the timer thread,
+ * and must not block for long as the other timers wait for it.
+ */
+void igt_timer_init(struct igt_timer *timer,
+		    void (*func)(struct igt_timer *timer))
+{
+	memset(timer, 0, sizeof(*timer));
+	IGT_INIT_LIST_HEAD(&timer->link);
+	timer->func = func;
+	timer->level = -1;
+}
+
+/**
+ * igt_timer_arm:
+ * @timer: timer initialized with igt_timer_init()
+ * @ns: time in nanoseconds after which @timer expires
+ *
+ * Arms @timer to expire @ns from now, replacing any earlier expiry time
+ * it was armed for.
+ */
+void igt_timer_arm(struct igt_timer *timer, int64_t ns)
+{
+	uint64_t now = now_ns();
+
+	pthread_mutex_lock(&wheel.lock);
+	wheel_start();
+
+	if (timer->pending)
+		dequeue(timer);
+
+	/* Nothing was pending to keep the clock going */
+	if (wheel_empty() && wheel.clk < now >> TICK_SHIFT)
+		wheel.clk = now >> TICK_SHIFT;
+
+	timer->expires = now + max_t(int64_t, ns, 0);
+	enqueue(timer);
+
+	if (!wheel.next_wake || timer->expires < wheel.next_wake)
+		program();
+
+	pthread_mutex_unlock(&wheel.lock);
+}
+
+/**
+ * igt_timer_cancel:
+ * @timer: timer initialized with igt_timer_init()
+ *
+ * Disarms @timer. If the callback of @timer is running, waits for it to
+ * return, so @timer can be freed afterwards.
+ *
+ * Returns: true if @timer was armed and had not expired yet.
+ */
+bool igt_timer_cancel(struct igt_timer *timer)
+{
+	bool pending;
+
+	pthread_mutex_lock(&wheel.lock);
+
+	pending = timer->pending;
+	if (pending)
+		dequeue(timer);
+
+	while (wheel.running == timer &&
+	       !pthread_equal(pthread_self(), wheel.thread))
+		pthread_cond_wait(&wheel.done, &wheel.lock);
+
+	pthread_mutex_unlock(&wheel.lock);
+
+	return pending;
+}
+
+/**
+ * igt_timer_pending:
+ * @timer: timer initialized with igt_timer_init()
+ *
+ * Returns: true if @timer is armed and its callback has not been called yet.
+ */
+bool igt_timer_pending(struct igt_timer *timer)
+{
+	bool pending;
+
+	pthread_mutex_lock(&wheel.lock);
+	pending = timer->pending;
+	pthread_mutex_unlock(&wheel.lock);
+
+	return pending;
+}
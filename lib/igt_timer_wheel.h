@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_TIMER_WHEEL_H__
+#define __IGT_TIMER_WHEEL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "igt_list.h"
+
+struct igt_timer {
+	struct igt_list_head link;
+	/* CLOCK_MONOTONIC nanoseconds */
+	uint64_t expires;
+	void (*func)(struct igt_timer *timer);
+	/* Wheel level holding the timer, -1 when it's about to be called */
+	int level;
+	bool pending;
+};
+
+void igt_timer_init(struct igt_timer *timer,
+		    void (*func)(struct igt_timer *timer));
+void igt_timer_arm(struct igt_timer *timer, int64_t ns);
+bool igt_timer_cancel(struct igt_timer *timer);
+bool igt_timer_pending(struct igt_timer *timer);
+
+#endif /* __IGT_TIMER_WHEEL_H__ */
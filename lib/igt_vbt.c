@@ -0,0 +1,962 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_vbt.h"
+#include "igt_vbt_defs.h"
+
+/**
+ * SECTION:igt_vbt
+ * @short_description: VBT parsing library
+ * @title: VBT
+ * @include: igt_vbt.h
+ *
+ * This library parses the Video BIOS Table of Intel GPUs, as found in a
+ * VBIOS image, in the OpRegion or in debugfs i915_vbt.
+ *
+ * igt_vbt_init() walks the BDB once, indexing every block by id. Each block
+ * is copied and zero padded up to the size of the structure describing it,
+ * the way the kernel does, so a block shorter than its structure can be
+ * read without reading past the VBT. Blocks whose contents can't be parsed,
+ * like child devices of size zero or a MIPI sequence block of an unknown
+ * version, are marked invalid and aren't handed out.
+ *
+ * The typed accessors decode the parts of the VBT tests care about, taking
+ * the BDB version into account: the panel type, child devices, eDP and PSR
+ * parameters, and MIPI sequences.
+ *
+ * igt_vbt_create() builds a synthetic VBT, to exercise the parsing without
+ * a VBIOS at hand.
+ */
+
+/* Blocks with fixed size structures, to pad them up to */
+static const struct {
+	uint8_t id;
+	uint16_t min_size;
+} bdb_blocks[] = {
+	{ BDB_GENERAL_FEATURES, sizeof(struct bdb_general_features) },
+	{ BDB_GENERAL_DEFINITIONS, sizeof(struct bdb_general_definitions) },
+	{ BDB_PSR, sizeof(struct bdb_psr) },
+	{ BDB_CHILD_DEVICE_TABLE, sizeof(struct bdb_legacy_child_devices) },
+	{ BDB_DRIVER_FEATURES, sizeof(struct bdb_driver_features) },
+	{ BDB_SDVO_LVDS_OPTIONS, sizeof(struct bdb_sdvo_lvds_options) },
+	{ BDB_SDVO_PANEL_DTDS, sizeof(struct bdb_sdvo_panel_dtds) },
+	{ BDB_EDP, sizeof(struct bdb_edp) },
+	{ BDB_LVDS_OPTIONS, sizeof(struct bdb_lvds_options) },
+	{ BDB_LVDS_LFP_DATA_PTRS, sizeof(struct bdb_lvds_lfp_data_ptrs) },
+	{ BDB_LVDS_LFP_DATA, sizeof(struct bdb_lvds_lfp_data) },
+	{ BDB_LVDS_BACKLIGHT, sizeof(struct bdb_lfp_backlight_data) },
+	{ BDB_MIPI_CONFIG, sizeof(struct bdb_mipi_config) },
+	{ BDB_MIPI_SEQUENCE, sizeof(struct bdb_mipi_sequence) },
+	{ BDB_COMPRESSION_PARAMETERS, sizeof(struct bdb_compression_parameters) },
+};
+
+static uint32_t block_min_size(uint8_t id)
+{
+	for (int i = 0; i < ARRAY_SIZE(bdb_blocks); i++)
+		if (bdb_blocks[i].id == id)
+			return bdb_blocks[i].min_size;
+
+	return 0;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/*
+ * Size of the block at @index of the BDB. The MIPI Sequence Block v3+ has a
+ * separate size field.
+ */
+static bool get_block_size(const uint8_t *base, uint32_t index,
+			   uint32_t total, uint32_t *size)
+{
+	if (base[index] == BDB_MIPI_SEQUENCE && index + 3 < total &&
+	    base[index + 3] >= 3) {
+		if (index + 8 > total)
+			return false;
+
+		*size = get_u32(base + index + 4);
+	} else {
+		*size = get_u16(base + index + 1);
+	}
+
+	return true;
+}
+
+static void validate_blocks(struct igt_vbt *vbt)
+{
+	struct igt_vbt_block *block;
+
+	block = &vbt->blocks[BDB_GENERAL_DEFINITIONS];
+	if (block->status) {
+		const struct bdb_general_definitions *defs = block->data;
+
+		if (block->size < sizeof(*defs) || !defs->child_dev_size)
+			block->status = IGT_VBT_BLOCK_INVALID;
+	}
+
+	block = &vbt->blocks[BDB_CHILD_DEVICE_TABLE];
+	if (block->status) {
+		const struct bdb_legacy_child_devices *defs = block->data;
+
+		if (block->size < sizeof(*defs) || !defs->child_dev_size)
+			block->status = IGT_VBT_BLOCK_INVALID;
+	}
+
+	/* The same block id was used for something else before */
+	block = &vbt->blocks[BDB_PSR];
+	if (block->status && vbt->version < 165)
+		block->status = IGT_VBT_BLOCK_INVALID;
+
+	block = &vbt->blocks[BDB_MIPI_SEQUENCE];
+	if (block->status) {
+		const struct bdb_mipi_sequence *sequence = block->data;
+
+		if (block->size < 1 || sequence->version >= 4 ||
+		    (sequence->version >= 3 && block->size < 5))
+			block->status = IGT_VBT_BLOCK_INVALID;
+	}
+}
+
+/**
+ * igt_vbt_init:
+ * @vbt: #igt_vbt to initialize
+ * @data: VBT, or VBIOS image containing one
+ * @size: size of @data
+ *
+ * Looks for the VBT signature in @data and indexes all the blocks of the
+ * BDB. @data must outlive @vbt, but the block contents are copied, see
+ * #igt_vbt_block. Nothing is read past @size.
+ *
+ * Returns: 0 on success, -ENOENT if there is no VBT, -EINVAL if the VBT
+ * headers are invalid, or -ENOMEM.
+ */
+int igt_vbt_init(struct igt_vbt *vbt, const void *data, size_t size)
+{
+	const uint8_t *start, *base;
+	uint32_t bdb_offset, total, index, copies_size = 0;
+	uint8_t *copy;
+
+	memset(vbt, 0, sizeof(*vbt));
+
+	/* The VBT can be anywhere in a VBIOS image */
+	start = memmem(data, size, "$VBT", 4);
+	if (!start)
+		return -ENOENT;
+
+	size -= start - (const uint8_t *)data;
+	if (size < sizeof(struct vbt_header))
+		return -EINVAL;
+
+	vbt->vbt = (const struct vbt_header *)start;
+	bdb_offset = vbt->vbt->bdb_offset;
+	if (bdb_offset > size - sizeof(struct bdb_header))
+		return -EINVAL;
+
+	vbt->bdb = (const struct bdb_header *)(start + bdb_offset);
+	vbt->size = size;
+	vbt->version = vbt->bdb->version;
+
+	base = (const uint8_t *)vbt->bdb;
+	total = min_t(size_t, vbt->bdb->bdb_size, size - bdb_offset);
+	index = vbt->bdb->header_size;
+	if (index > total)
+		return -EINVAL;
+
+	while (index + 3 <= total) {
+		uint8_t id = base[index];
+		uint32_t block_size;
+
+		if (!get_block_size(base, index, total, &block_size) ||
+		    block_size > total - index - 3) {
+			vbt->truncated = true;
+			break;
+		}
+
+		/* The first block of an id is the one used */
+		if (!vbt->blocks[id].status) {
+			vbt->blocks[id].data = base + index + 3;
+			vbt->blocks[id].size = block_size;
+			vbt->blocks[id].offset = base + index - start;
+			vbt->blocks[id].status = IGT_VBT_BLOCK_OK;
+			vbt->order[vbt->num_blocks++] = id;
+
+			copies_size += ALIGN(max(block_size, block_min_size(id)), 8);
+		}
+
+		index += 3 + block_size;
+	}
+
+	vbt->copies = calloc(1, copies_size ?: 1);
+	if (!vbt->copies)
+		return -ENOMEM;
+
+	copy = vbt->copies;
+	for (int i = 0; i < vbt->num_blocks; i++) {
+		struct igt_vbt_block *block = &vbt->blocks[vbt->order[i]];
+		uint32_t min_size = block_min_size(vbt->order[i]);
+
+		memcpy(copy, block->data, block->size);
+		block->data = copy;
+		if (block->size < min_size)
+			block->status = IGT_VBT_BLOCK_SHORT;
+
+		copy += ALIGN(max(block->size, min_size), 8);
+	}
+
+	validate_blocks(vbt);
+
+	return 0;
+}
+
+/**
+ * igt_vbt_fini:
+ * @vbt: #igt_vbt to release
+ *
+ * Frees the block copies of @vbt.
+ */
+void igt_vbt_fini(struct igt_vbt *vbt)
+{
+	free(vbt->copies);
+	vbt->copies = NULL;
+}
+
+/**
+ * igt_vbt_get_block:
+ * @vbt: #igt_vbt to look in
+ * @id: block id
+ * @size: optional return location for the size of the block
+ *
+ * Returns: The zero padded copy of block @id, or NULL if the block is
+ * missing or invalid.
+ */
+const void *igt_vbt_get_block(const struct igt_vbt *vbt, int id,
+			      uint32_t *size)
+{
+	const struct igt_vbt_block *block;
+
+	if (id < 0 || id >= IGT_VBT_NUM_BLOCKS)
+		return NULL;
+
+	block = &vbt->blocks[id];
+	if (block->status != IGT_VBT_BLOCK_OK &&
+	    block->status != IGT_VBT_BLOCK_SHORT)
+		return NULL;
+
+	if (size)
+		*size = block->size;
+
+	return block->data;
+}
+
+/**
+ * igt_vbt_panel_type:
+ * @vbt: #igt_vbt to look in
+ *
+ * Returns: The panel type from the LVDS options block, or -1 if there is no
+ * such block or the panel type is out of range.
+ */
+int igt_vbt_panel_type(const struct igt_vbt *vbt)
+{
+	const struct bdb_lvds_options *options;
+
+	options = igt_vbt_get_block(vbt, BDB_LVDS_OPTIONS, NULL);
+	if (!options || options->panel_type >= IGT_VBT_NUM_PANELS)
+		return -1;
+
+	return options->panel_type;
+}
+
+/**
+ * igt_vbt_num_child_devices:
+ * @vbt: #igt_vbt to look in
+ *
+ * Returns: The number of child devices in the general definitions block,
+ * including unused ones of device type zero.
+ */
+int igt_vbt_num_child_devices(const struct igt_vbt *vbt)
+{
+	const struct bdb_general_definitions *defs;
+	uint32_t size;
+
+	defs = igt_vbt_get_block(vbt, BDB_GENERAL_DEFINITIONS, &size);
+	if (!defs)
+		return 0;
+
+	return (size - sizeof(*defs)) / defs->child_dev_size;
+}
+
+/**
+ * igt_vbt_get_child_device:
+ * @vbt: #igt_vbt to look in
+ * @n: index of the child device
+ * @child: return location for the child device
+ *
+ * Returns: True if there is a child device @n.
+ */
+bool igt_vbt_get_child_device(const struct igt_vbt *vbt, int n,
+			      struct igt_vbt_child_device *child)
+{
+	const struct bdb_general_definitions *defs;
+	struct child_device_config config = {};
+	const uint8_t *raw;
+
+	if (n < 0 || n >= igt_vbt_num_child_devices(vbt))
+		return false;
+
+	defs = igt_vbt_get_block(vbt, BDB_GENERAL_DEFINITIONS, NULL);
+	raw = defs->devices + n * defs->child_dev_size;
+
+	/* The tail of shorter, older, child devices reads as zeroes */
+	memcpy(&config, raw, min_t(size_t, sizeof(config), defs->child_dev_size));
+
+	memset(child, 0, sizeof(*child));
+	child->handle = config.handle;
+	child->device_type = config.device_type;
+	child->dvo_port = config.dvo_port;
+	child->i2c_pin = config.i2c_pin;
+	child->ddc_pin = config.ddc_pin;
+
+	if (vbt->version >= 155)
+		child->aux_channel = config.aux_channel;
+
+	if (vbt->version >= 158) {
+		child->hdmi_support = config.hdmi_support;
+		child->dp_support = config.dp_support;
+		child->tmds_support = config.tmds_support;
+	}
+
+	if (vbt->version >= 184)
+		child->lane_reversal = config.lane_reversal;
+	if (vbt->version >= 192)
+		child->lspcon = config.lspcon;
+	if (vbt->version >= 195)
+		child->usb_type_c = config.dp_usb_type_c;
+	if (vbt->version >= 204)
+		child->hdmi_max_data_rate = config.hdmi_max_data_rate;
+	if (vbt->version >= 209)
+		child->tbt = config.tbt;
+	if (vbt->version >= 216)
+		child->dp_max_link_rate = config.dp_max_link_rate;
+
+	child->raw = raw;
+	child->raw_size = defs->child_dev_size;
+
+	return true;
+}
+
+/**
+ * igt_vbt_get_edp:
+ * @vbt: #igt_vbt to look in
+ * @panel_type: panel type, see igt_vbt_panel_type()
+ * @edp: return location for the eDP parameters
+ *
+ * Returns: True if @vbt has an eDP block and @panel_type is valid.
+ */
+bool igt_vbt_get_edp(const struct igt_vbt *vbt, int panel_type,
+		     struct igt_vbt_edp *edp)
+{
+	const struct bdb_edp *block;
+	int i = panel_type;
+
+	block = igt_vbt_get_block(vbt, BDB_EDP, NULL);
+	if (!block || i < 0 || i >= IGT_VBT_NUM_PANELS)
+		return false;
+
+	memset(edp, 0, sizeof(*edp));
+	edp->t3 = block->power_seqs[i].t3;
+	edp->t7 = block->power_seqs[i].t7;
+	edp->t9 = block->power_seqs[i].t9;
+	edp->t10 = block->power_seqs[i].t10;
+	edp->t12 = block->power_seqs[i].t12;
+
+	switch ((block->color_depth >> (i * 2)) & 3) {
+	case EDP_18BPP:
+		edp->bpp = 18;
+		break;
+	case EDP_24BPP:
+		edp->bpp = 24;
+		break;
+	case EDP_30BPP:
+		edp->bpp = 30;
+		break;
+	}
+
+	edp->msa_timing_delay = (block->sdrrs_msa_timing_delay >> (i * 2)) & 3;
+
+	edp->rate = block->fast_link_params[i].rate;
+	edp->lanes = block->fast_link_params[i].lanes;
+	edp->preemphasis = block->fast_link_params[i].preemphasis;
+	edp->vswing = block->fast_link_params[i].vswing;
+
+	if (vbt->version >= 162)
+		edp->s3d = (block->edp_s3d_feature >> i) & 1;
+	if (vbt->version >= 165)
+		edp->t3_optimization = (block->edp_t3_optimization >> i) & 1;
+	if (vbt->version >= 173)
+		edp->vswing_preemph_table = (block->edp_vswing_preemph >> (i * 4)) & 0xf;
+	if (vbt->version >= 182)
+		edp->fast_link_training = (block->fast_link_training >> i) & 1;
+	if (vbt->version >= 185)
+		edp->dpcd_600h_write_required = (block->dpcd_600h_write_required >> i) & 1;
+
+	if (vbt->version >= 186) {
+		edp->pwm_on_to_backlight_enable =
+			block->pwm_delays[i].pwm_on_to_backlight_enable;
+		edp->backlight_disable_to_pwm_off =
+			block->pwm_delays[i].backlight_disable_to_pwm_off;
+	}
+
+	if (vbt->version >= 199) {
+		edp->full_link_params_provided = (block->full_link_params_provided >> i) & 1;
+		edp->full_link_preemphasis = block->full_link_params[i].preemphasis;
+		edp->full_link_vswing = block->full_link_params[i].vswing;
+	}
+
+	return true;
+}
+
+/**
+ * igt_vbt_get_psr:
+ * @vbt: #igt_vbt to look in
+ * @panel_type: panel type, see igt_vbt_panel_type()
+ * @psr: return location for the PSR parameters
+ *
+ * @psr->lines_to_wait is -1 if the VBT value is unknown.
+ *
+ * Returns: True if @vbt has a PSR block and @panel_type is valid.
+ */
+bool igt_vbt_get_psr(const struct igt_vbt *vbt, int panel_type,
+		     struct igt_vbt_psr *psr)
+{
+	static const int psr2_tp_times[] = { 500, 100, 2500, 5 };
+	const struct bdb_psr *block;
+	const struct psr_table *table;
+
+	block = igt_vbt_get_block(vbt, BDB_PSR, NULL);
+	if (!block || panel_type < 0 || panel_type >= IGT_VBT_NUM_PANELS)
+		return false;
+
+	table = &block->psr_table[panel_type];
+
+	psr->full_link = table->full_link;
+	psr->require_aux_to_wakeup = table->require_aux_to_wakeup;
+	psr->idle_frames = table->idle_frames;
+
+	switch (table->lines_to_wait) {
+	case 0:
+	case 1:
+		psr->lines_to_wait = table->lines_to_wait;
+		break;
+	case 2:
+	case 3:
+		psr->lines_to_wait = 1 << table->lines_to_wait;
+		break;
+	default:
+		psr->lines_to_wait = -1;
+		break;
+	}
+
+	psr->tp1_wakeup_time = table->tp1_wakeup_time * 100;
+	psr->tp2_tp3_wakeup_time = table->tp2_tp3_wakeup_time * 100;
+
+	if (vbt->version >= 226)
+		psr->psr2_tp2_tp3_wakeup_time =
+			psr2_tp_times[(block->psr2_tp2_tp3_wakeup_time >> (panel_type * 2)) & 3];
+	else
+		psr->psr2_tp2_tp3_wakeup_time = -1;
+
+	return true;
+}
+
+/* Returns the index after the sequence at @index, or 0 if it is malformed. */
+static uint32_t next_sequence(const uint8_t *data, uint32_t index,
+			      uint32_t total)
+{
+	uint32_t len;
+
+	/* Skip Sequence Byte. */
+	for (index = index + 1; index < total; index += len) {
+		uint8_t operation_byte = data[index++];
+
+		switch (operation_byte) {
+		case MIPI_SEQ_ELEM_END:
+			return index;
+		case MIPI_SEQ_ELEM_SEND_PKT:
+			if (index + 4 > total)
+				return 0;
+			len = get_u16(data + index + 2) + 4;
+			break;
+		case MIPI_SEQ_ELEM_DELAY:
+			len = 4;
+			break;
+		case MIPI_SEQ_ELEM_GPIO:
+			len = 2;
+			break;
+		case MIPI_SEQ_ELEM_I2C:
+			if (index + 7 > total)
+				return 0;
+			len = data[index + 6] + 7;
+			break;
+		default:
+			igt_debug("Unknown MIPI operation byte %u\n",
+				  operation_byte);
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+/* Whether the v3 element @op of size @len holds what its header says */
+static bool element_fits(uint8_t op, const uint8_t *data, uint8_t len)
+{
+	switch (op) {
+	case MIPI_SEQ_ELEM_SEND_PKT:
+		return len >= 4 && get_u16(data + 2) + 4 <= len;
+	case MIPI_SEQ_ELEM_DELAY:
+		return len >= 4;
+	case MIPI_SEQ_ELEM_GPIO:
+		return len >= 3;
+	case MIPI_SEQ_ELEM_I2C:
+		return len >= 7 && data[6] + 7 <= len;
+	default:
+		/* skipped by size */
+		return true;
+	}
+}
+
+static uint32_t next_sequence_v3(const uint8_t *data, uint32_t index,
+				 uint32_t total)
+{
+	uint32_t seq_end, size_of_sequence;
+
+	if (total - index < 5)
+		return 0;
+
+	/* Skip Sequence Byte. */
+	index++;
+
+	/*
+	 * Size of Sequence. Excludes the Sequence Byte and the size itself,
+	 * includes MIPI_SEQ_ELEM_END byte, excludes the final MIPI_SEQ_END
+	 * byte.
+	 */
+	size_of_sequence = get_u32(data + index);
+	index += 4;
+
+	if (size_of_sequence > total - index)
+		return 0;
+	seq_end = index + size_of_sequence;
+
+	while (index < seq_end) {
+		uint8_t operation_byte = data[index++];
+		uint8_t len;
+
+		if (operation_byte == MIPI_SEQ_ELEM_END)
+			return index == seq_end ? index : 0;
+
+		if (index == seq_end)
+			return 0;
+
+		len = data[index++];
+		if (len > seq_end - index ||
+		    !element_fits(operation_byte, data + index, len))
+			return 0;
+
+		index += len;
+	}
+
+	return 0;
+}
+
+/* Finds the sequences of @panel_id in the MIPI sequence block. */
+static const uint8_t *find_panel_sequences(const uint8_t *data, uint32_t total,
+					   uint8_t version, int panel_id,
+					   uint32_t *seq_size)
+{
+	uint32_t header_size = version >= 3 ? 5 : 3;
+	uint32_t index = 0, current_size;
+	uint8_t current_id;
+
+	for (int i = 0; i < MAX_MIPI_CONFIGURATIONS && index < total; i++) {
+		if (header_size > total - index)
+			return NULL;
+
+		current_id = data[index];
+		if (version >= 3)
+			current_size = get_u32(data + index + 1);
+		else
+			current_size = get_u16(data + index + 1);
+
+		index += header_size;
+
+		if (current_size > total - index)
+			return NULL;
+
+		if (current_id == panel_id) {
+			*seq_size = current_size;
+			return data + index;
+		}
+
+		index += current_size;
+	}
+
+	return NULL;
+}
+
+/**
+ * igt_vbt_get_mipi_sequences:
+ * @vbt: #igt_vbt to look in
+ * @panel_type: panel type, see igt_vbt_panel_type()
+ * @seqs: return location for the sequences
+ *
+ * Finds the MIPI sequences of @panel_type and checks their structure, like
+ * the kernel does before running them.
+ *
+ * Returns: True if the sequences of @panel_type were found and are well
+ * formed.
+ */
+bool igt_vbt_get_mipi_sequences(const struct igt_vbt *vbt, int panel_type,
+				struct igt_vbt_mipi_sequences *seqs)
+{
+	const struct bdb_mipi_sequence *sequence;
+	const uint8_t *data;
+	uint32_t size, total, index = 0;
+
+	sequence = igt_vbt_get_block(vbt, BDB_MIPI_SEQUENCE, &size);
+	if (!sequence)
+		return false;
+
+	memset(seqs, 0, sizeof(*seqs));
+	seqs->version = sequence->version;
+
+	/* skip the version, and the new block size */
+	data = sequence->data;
+	total = size - 1;
+	if (sequence->version >= 3) {
+		data += 4;
+		total -= 4;
+	}
+
+	data = find_panel_sequences(data, total, sequence->version,
+				    panel_type, &total);
+	if (!data)
+		return false;
+
+	for (;;) {
+		uint8_t seq_id;
+		uint32_t next;
+
+		if (index >= total)
+			return false;
+
+		seq_id = data[index];
+		if (seq_id == MIPI_SEQ_END)
+			return true;
+
+		if (seq_id >= MIPI_SEQ_MAX) {
+			igt_debug("Unknown MIPI sequence %u\n", seq_id);
+			return false;
+		}
+
+		if (sequence->version >= 3)
+			next = next_sequence_v3(data, index, total);
+		else
+			next = next_sequence(data, index, total);
+		if (!next)
+			return false;
+
+		seqs->data[seq_id] = data + index;
+		seqs->size[seq_id] = next - index;
+		index = next;
+	}
+}
+
+/* Size of child devices the kernel expects for BDB @version */
+static uint8_t expected_child_dev_size(uint16_t version)
+{
+	uint8_t size;
+
+	if (version < 106)
+		size = 22;
+	else if (version < 111)
+		size = 27;
+	else if (version < 195)
+		size = LEGACY_CHILD_DEVICE_CONFIG_SIZE;
+	else if (version == 195)
+		size = 37;
+	else if (version <= 215)
+		size = 38;
+	else
+		size = 39;
+
+	return min_t(size_t, size, sizeof(struct child_device_config));
+}
+
+static uint8_t *add_block(uint8_t *bdb, uint32_t *index, uint8_t id,
+			  uint32_t size)
+{
+	uint8_t *block = bdb + *index;
+
+	/* MIPI sequences are built in place, their version is known */
+	block[0] = id;
+	if (id == BDB_MIPI_SEQUENCE && block[3] >= 3) {
+		/* v3+, only the u32 size after the version is used */
+		block[1] = 0xff;
+		block[2] = 0xff;
+	} else {
+		block[1] = size & 0xff;
+		block[2] = size >> 8;
+	}
+
+	*index += 3 + size;
+
+	return block + 3;
+}
+
+static uint32_t add_mipi_sequences(uint8_t *data, uint16_t version)
+{
+	bool v3 = version >= 198;
+	uint32_t index = 0, panel_start, panel_size;
+
+	data[index++] = v3 ? 3 : 1;
+	if (v3)
+		index += 4; /* block size */
+
+	/* panel id, size */
+	data[index++] = 2;
+	panel_start = index;
+	index += v3 ? 4 : 2;
+
+#define SEQ(seq_id, elems) do { \
+	data[index++] = seq_id; \
+	if (v3) { \
+		uint32_t len = sizeof(elems) + 1; \
+		memcpy(data + index, &len, 4); \
+		index += 4; \
+	} \
+	memcpy(data + index, elems, sizeof(elems)); \
+	index += sizeof(elems); \
+	data[index++] = MIPI_SEQ_ELEM_END; \
+} while (0)
+
+	if (v3) {
+		/* elements have a length byte, gpios a gpio number */
+		static const uint8_t gpio[] = { MIPI_SEQ_ELEM_GPIO, 3, 1, 1, 1 };
+		static const uint8_t gpio_low[] = { MIPI_SEQ_ELEM_GPIO, 3, 1, 1, 0 };
+		static const uint8_t init_otp[] = {
+			/* generic short write, no parameters */
+			MIPI_SEQ_ELEM_SEND_PKT, 4, 0x03, 0x00, 0x00, 0x00,
+			MIPI_SEQ_ELEM_DELAY, 4, 0x10, 0x27, 0x00, 0x00,
+		};
+		static const uint8_t on[] = { MIPI_SEQ_ELEM_DELAY, 4, 0x64, 0, 0, 0 };
+
+		SEQ(MIPI_SEQ_ASSERT_RESET, gpio);
+		SEQ(MIPI_SEQ_INIT_OTP, init_otp);
+		SEQ(MIPI_SEQ_DISPLAY_ON, on);
+		SEQ(MIPI_SEQ_DEASSERT_RESET, gpio_low);
+	} else {
+		static const uint8_t gpio[] = { MIPI_SEQ_ELEM_GPIO, 1, 1 };
+		static const uint8_t gpio_low[] = { MIPI_SEQ_ELEM_GPIO, 1, 0 };
+		static const uint8_t init_otp[] = {
+			/* generic short write, no parameters */
+			MIPI_SEQ_ELEM_SEND_PKT, 0x03, 0x00, 0x00, 0x00,
+			MIPI_SEQ_ELEM_DELAY, 0x10, 0x27, 0x00, 0x00,
+		};
+		static const uint8_t on[] = { MIPI_SEQ_ELEM_DELAY, 0x64, 0, 0, 0 };
+
+		SEQ(MIPI_SEQ_ASSERT_RESET, gpio);
+		SEQ(MIPI_SEQ_INIT_OTP, init_otp);
+		SEQ(MIPI_SEQ_DISPLAY_ON, on);
+		SEQ(MIPI_SEQ_DEASSERT_RESET, gpio_low);
+	}
+#undef SEQ
+
+	data[index++] = MIPI_SEQ_END;
+
+	panel_size = index - panel_start - (v3 ? 4 : 2);
+	if (v3) {
+		memcpy(data + panel_start, &panel_size, 4);
+		/* the block size, from the version on */
+		memcpy(data + 1, &index, 4);
+	} else {
+		uint16_t size = panel_size;
+
+		memcpy(data + panel_start, &size, 2);
+	}
+
+	return index;
+}
+
+/**
+ * igt_vbt_create:
+ * @version: BDB version
+ * @size: return location for the size of the VBT
+ *
+ * Builds a synthetic VBT for BDB @version, with the blocks and fields that
+ * version has: general features and definitions, with an eDP, an HDMI, a DP
+ * and a type-C DP child device, LVDS options selecting panel type 2, eDP
+ * parameters, PSR parameters from version 165, MIPI sequences and, from
+ * version 198, compression parameters.
+ *
+ * Returns: The VBT, to be freed with free().
+ */
+void *igt_vbt_create(uint16_t version, size_t *size)
+{
+	static const struct {
+		uint16_t device_type;
+		uint8_t dvo_port;
+		uint8_t aux_channel;
+	} children[] = {
+		{ DEVICE_TYPE_eDP, DVO_PORT_DPA, DP_AUX_A },
+		{ DEVICE_TYPE_HDMI, DVO_PORT_HDMIB, 0 },
+		{ DEVICE_TYPE_DP, DVO_PORT_DPC, DP_AUX_C },
+		{ DEVICE_TYPE_DP, DVO_PORT_DPD, DP_AUX_D },
+	};
+	uint8_t child_dev_size = expected_child_dev_size(version);
+	struct vbt_header *vbt;
+	struct bdb_header *bdb;
+	struct bdb_general_definitions *defs;
+	struct bdb_lvds_options *options;
+	struct bdb_edp *edp;
+	uint8_t *data, *block, checksum = 0;
+	uint32_t index, len;
+
+	data = calloc(1, 8192);
+	igt_assert(data);
+
+	vbt = (struct vbt_header *)data;
+	memcpy(vbt->signature, "$VBT SYNTHETIC", 14);
+	vbt->version = 100;
+	vbt->header_size = sizeof(*vbt);
+	vbt->bdb_offset = sizeof(*vbt);
+
+	bdb = (struct bdb_header *)(data + vbt->bdb_offset);
+	memcpy(bdb->signature, "BIOS_DATA_BLOCK ", 16);
+	bdb->version = version;
+	bdb->header_size = sizeof(*bdb);
+
+	index = sizeof(*bdb);
+
+	add_block((uint8_t *)bdb, &index, BDB_GENERAL_FEATURES,
+		  sizeof(struct bdb_general_features));
+
+	len = sizeof(*defs) + ARRAY_SIZE(children) * child_dev_size;
+	defs = (void *)add_block((uint8_t *)bdb, &index,
+				 BDB_GENERAL_DEFINITIONS, len);
+	defs->child_dev_size = child_dev_size;
+	for (int i = 0; i < ARRAY_SIZE(children); i++) {
+		struct child_device_config child = {};
+
+		child.handle = 1 << i;
+		child.device_type = children[i].device_type;
+		child.dvo_port = children[i].dvo_port;
+		if (version >= 155)
+			child.aux_channel = children[i].aux_channel;
+		if (version >= 158) {
+			child.hdmi_support = child.device_type == DEVICE_TYPE_HDMI;
+			child.dp_support = child.device_type != DEVICE_TYPE_HDMI;
+		}
+		if (version >= 195 && child.dvo_port == DVO_PORT_DPD)
+			child.dp_usb_type_c = 1;
+
+		memcpy(defs->devices + i * child_dev_size, &child, child_dev_size);
+	}
+
+	options = (void *)add_block((uint8_t *)bdb, &index, BDB_LVDS_OPTIONS,
+				    sizeof(*options));
+	options->panel_type = 2;
+
+	edp = (void *)add_block((uint8_t *)bdb, &index, BDB_EDP, sizeof(*edp));
+	edp->power_seqs[2].t3 = 2000;
+	edp->power_seqs[2].t7 = 10;
+	edp->power_seqs[2].t9 = 2000;
+	edp->power_seqs[2].t10 = 500;
+	edp->power_seqs[2].t12 = 5000;
+	edp->color_depth = EDP_24BPP << 4;
+	edp->fast_link_params[2].rate = EDP_RATE_2_7;
+	edp->fast_link_params[2].lanes = EDP_LANE_4;
+	if (version >= 182)
+		edp->fast_link_training = 1 << 2;
+	if (version >= 186)
+		edp->pwm_delays[2].pwm_on_to_backlight_enable = 100;
+
+	if (version >= 165) {
+		struct bdb_psr *psr;
+
+		psr = (void *)add_block((uint8_t *)bdb, &index, BDB_PSR,
+					sizeof(*psr));
+		psr->psr_table[2].full_link = 1;
+		psr->psr_table[2].idle_frames = 2;
+		psr->psr_table[2].lines_to_wait = 2;
+		psr->psr_table[2].tp1_wakeup_time = 5;
+		psr->psr_table[2].tp2_tp3_wakeup_time = 5;
+		psr->psr2_tp2_tp3_wakeup_time = 1 << 4;
+	}
+
+	block = (uint8_t *)bdb + index;
+	len = add_mipi_sequences(block + 3, version);
+	add_block((uint8_t *)bdb, &index, BDB_MIPI_SEQUENCE, len);
+
+	if (version >= 198) {
+		struct bdb_compression_parameters *dsc;
+
+		dsc = (void *)add_block((uint8_t *)bdb, &index,
+					BDB_COMPRESSION_PARAMETERS,
+					sizeof(*dsc));
+		dsc->entry_size = sizeof(dsc->data[0]);
+	}
+
+	bdb->bdb_size = index;
+	vbt->vbt_size = vbt->bdb_offset + index;
+
+	for (int i = 0; i < vbt->vbt_size; i++)
+		checksum += data[i];
+	vbt->vbt_checksum = -checksum;
+
+	*size = vbt->vbt_size;
+
+	return data;
+}
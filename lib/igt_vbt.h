@@ -0,0 +1,198 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef IGT_VBT_H
+#define IGT_VBT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "intel_bios.h"
+
+struct vbt_header;
+struct bdb_header;
+
+#define IGT_VBT_NUM_BLOCKS	256
+#define IGT_VBT_NUM_PANELS	16
+
+enum igt_vbt_block_status {
+	IGT_VBT_BLOCK_MISSING = 0,
+	IGT_VBT_BLOCK_OK,
+	/* shorter than its structure, the missing tail reads as zeroes */
+	IGT_VBT_BLOCK_SHORT,
+	/* present, but its contents can't be parsed */
+	IGT_VBT_BLOCK_INVALID,
+};
+
+/**
+ * igt_vbt_block:
+ * @data: copy of the block contents, zero padded up to the size of the
+ * structure describing the block so it can be read without further checks
+ * @size: size of the block in the VBT
+ * @offset: offset of the block header from the start of the VBT
+ * @status: #igt_vbt_block_status of the block
+ */
+struct igt_vbt_block {
+	const void *data;
+	uint32_t size;
+	uint32_t offset;
+	enum igt_vbt_block_status status;
+};
+
+/**
+ * igt_vbt:
+ * @vbt: VBT header, within the data given to igt_vbt_init()
+ * @bdb: BDB header, within the data given to igt_vbt_init()
+ * @size: size of the data from @vbt on
+ * @version: BDB version
+ * @num_blocks: number of blocks in @order
+ * @order: ids of the blocks, in the order they appear in the BDB
+ * @blocks: blocks, indexed by id
+ * @truncated: a block overran the BDB, it and the blocks after it are
+ * missing
+ */
+struct igt_vbt {
+	const struct vbt_header *vbt;
+	const struct bdb_header *bdb;
+	size_t size;
+	uint16_t version;
+
+	int num_blocks;
+	uint8_t order[IGT_VBT_NUM_BLOCKS];
+	struct igt_vbt_block blocks[IGT_VBT_NUM_BLOCKS];
+	bool truncated;
+
+	/*< private >*/
+	void *copies;
+};
+
+/**
+ * igt_vbt_child_device:
+ * @raw: the child device config in the VBT, @raw_size bytes
+ *
+ * The fields that were added to child devices after a given BDB version,
+ * noted next to them, are zero for older VBTs.
+ */
+struct igt_vbt_child_device {
+	uint16_t handle;
+	uint16_t device_type;
+	uint8_t dvo_port;
+	uint8_t i2c_pin;
+	uint8_t ddc_pin;
+	uint8_t aux_channel;		/* 155 */
+	bool hdmi_support;		/* 158 */
+	bool dp_support;		/* 158 */
+	bool tmds_support;		/* 158 */
+	bool lane_reversal;		/* 184 */
+	bool lspcon;			/* 192 */
+	bool usb_type_c;		/* 195 */
+	uint8_t hdmi_max_data_rate;	/* 204 */
+	bool tbt;			/* 209 */
+	uint8_t dp_max_link_rate;	/* 216 */
+
+	const void *raw;
+	uint8_t raw_size;
+};
+
+/**
+ * igt_vbt_edp:
+ *
+ * The eDP parameters of a panel. Power sequencing delays are in 100us
+ * units, @bpp is 18, 24 or 30, or 0 if unknown. Link parameters are the
+ * raw EDP_* values of the VBT. Fields are noted with the BDB version that
+ * introduced them, they are zero for older VBTs.
+ */
+struct igt_vbt_edp {
+	uint16_t t3, t7, t9, t10, t12;
+	int bpp;
+	uint8_t msa_timing_delay;
+
+	uint8_t rate;
+	uint8_t lanes;
+	uint8_t preemphasis;
+	uint8_t vswing;
+
+	bool s3d;			/* 162 */
+	bool t3_optimization;		/* 165 */
+	uint8_t vswing_preemph_table;	/* 173 */
+	bool fast_link_training;	/* 182 */
+	bool dpcd_600h_write_required;	/* 185 */
+	uint16_t pwm_on_to_backlight_enable;	/* 186 */
+	uint16_t backlight_disable_to_pwm_off;	/* 186 */
+	bool full_link_params_provided;	/* 199 */
+	uint8_t full_link_preemphasis;	/* 199 */
+	uint8_t full_link_vswing;	/* 199 */
+};
+
+/**
+ * igt_vbt_psr:
+ *
+ * The PSR parameters of a panel, with the wakeup times in microseconds.
+ * @psr2_tp2_tp3_wakeup_time is -1 before BDB version 226.
+ */
+struct igt_vbt_psr {
+	bool full_link;
+	bool require_aux_to_wakeup;
+	int idle_frames;
+	int lines_to_wait;
+	int tp1_wakeup_time;
+	int tp2_tp3_wakeup_time;
+	int psr2_tp2_tp3_wakeup_time;
+};
+
+/**
+ * igt_vbt_mipi_sequences:
+ * @version: version of the MIPI sequence block
+ * @data: each sequence, from its sequence byte, or NULL if it is missing
+ * @size: size of each sequence
+ *
+ * The sequences have been checked to be well formed: their elements don't
+ * overrun them and they end with MIPI_SEQ_ELEM_END.
+ */
+struct igt_vbt_mipi_sequences {
+	uint8_t version;
+	const uint8_t *data[MIPI_SEQ_MAX];
+	uint32_t size[MIPI_SEQ_MAX];
+};
+
+int igt_vbt_init(struct igt_vbt *vbt, const void *data, size_t size);
+void igt_vbt_fini(struct igt_vbt *vbt);
+
+const void *igt_vbt_get_block(const struct igt_vbt *vbt, int id,
+			      uint32_t *size);
+int igt_vbt_panel_type(const struct igt_vbt *vbt);
+
+int igt_vbt_num_child_devices(const struct igt_vbt *vbt);
+bool igt_vbt_get_child_device(const struct igt_vbt *vbt, int n,
+			      struct igt_vbt_child_device *child);
+bool igt_vbt_get_edp(const struct igt_vbt *vbt, int panel_type,
+		     struct igt_vbt_edp *edp);
+bool igt_vbt_get_psr(const struct igt_vbt *vbt, int panel_type,
+		     struct igt_vbt_psr *psr);
+bool igt_vbt_get_mipi_sequences(const struct igt_vbt *vbt, int panel_type,
+				struct igt_vbt_mipi_sequences *seqs);
+
+void *igt_vbt_create(uint16_t version, size_t *size);
+
+#endif /* IGT_VBT_H */
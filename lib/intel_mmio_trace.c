@@ -0,0 +1,785 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "intel_chipset.h"
+#include "intel_io.h"
+#include "intel_reg.h"
+#include "intel_mmio_trace.h"
+
+/**
+ * SECTION:intel_mmio_trace
+ * @short_description: Record, replay and model register accesses
+ * @title: MMIO trace
+ * @include: intel_mmio_trace.h
+ *
+ * Tools that poll registers in a tight loop, like intel_display_poller,
+ * can route their accesses through an #intel_mmio_trace. Live accesses go
+ * to the hardware and can be recorded, with their timestamps, into a
+ * trace. The trace can then be replayed without the hardware: reads return
+ * the recorded values for as long as the tool issues the same accesses.
+ * Instead of the hardware, the accesses can also be served by
+ * #intel_display_model, a synthetic display with deterministic timings,
+ * to test the logic of such tools on any machine.
+ */
+
+/* records buffered between writes to the trace */
+#define TRACE_BUFFER_RECORDS	65536
+
+/**
+ * intel_mmio_trace_init:
+ * @trace: trace to initialize
+ *
+ * Initializes @trace for live accesses to the hardware mapped by
+ * intel_register_access_init(), without recording.
+ */
+void intel_mmio_trace_init(struct intel_mmio_trace *trace)
+{
+	memset(trace, 0, sizeof(*trace));
+	trace->mode = INTEL_MMIO_TRACE_LIVE;
+}
+
+/**
+ * intel_mmio_trace_model:
+ * @trace: trace to set up
+ * @devid: PCI device id to model
+ *
+ * Serves the accesses of @trace from a synthetic display, a 1920x1080@60
+ * one by default. Its parameters in @trace->model can be adjusted before
+ * the first access.
+ */
+void intel_mmio_trace_model(struct intel_mmio_trace *trace, uint32_t devid)
+{
+	struct intel_display_model *m = &trace->model;
+
+	trace->mode = INTEL_MMIO_TRACE_MODEL;
+	trace->devid = devid;
+	trace->timed = true;
+
+	memset(m, 0, sizeof(*m));
+	m->devid = devid;
+	for (int pipe = 0; pipe < ARRAY_SIZE(m->pipe_offset); pipe++)
+		m->pipe_offset[pipe] = pipe * 0x1000;
+	m->htotal = 2200;
+	m->vtotal = 1125;
+	m->vblank_start = 1080;
+	m->line_ns = 14815;
+	m->read_ns = 300;
+	m->write_ns = 100;
+	m->jitter_ns = 200;
+	m->rand = 1;
+}
+
+/**
+ * intel_mmio_trace_record:
+ * @trace: live or model trace
+ * @path: file to write the trace to
+ * @devid: PCI device id of the traced device
+ * @args: arguments to store in the trace, for the replaying tool
+ * @args_size: size of @args
+ *
+ * Starts writing the accesses of @trace to @path.
+ *
+ * Returns: 0 on success, or a negative error code.
+ */
+int intel_mmio_trace_record(struct intel_mmio_trace *trace, const char *path,
+			    uint32_t devid, const void *args, size_t args_size)
+{
+	struct intel_mmio_trace_header header = {
+		.magic = INTEL_MMIO_TRACE_MAGIC,
+		.version = INTEL_MMIO_TRACE_VERSION,
+		.devid = devid,
+		.args_size = args_size,
+	};
+	static const uint8_t zero[4];
+	size_t pad = ALIGN(args_size, 4) - args_size;
+	struct timespec ts;
+	int err;
+
+	trace->buf = calloc(TRACE_BUFFER_RECORDS, sizeof(*trace->buf));
+	if (!trace->buf)
+		return -ENOMEM;
+
+	trace->file = fopen(path, "w");
+	if (!trace->file) {
+		err = -errno;
+		goto err_buf;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, trace->file) != 1 ||
+	    (args_size && fwrite(args, args_size, 1, trace->file) != 1) ||
+	    (pad && fwrite(zero, pad, 1, trace->file) != 1)) {
+		err = -errno;
+		goto err_file;
+	}
+
+	trace->devid = devid;
+	trace->recording = true;
+	trace->timed = true;
+	trace->buf_size = TRACE_BUFFER_RECORDS;
+
+	if (trace->mode == INTEL_MMIO_TRACE_MODEL) {
+		trace->last_ns = trace->model.now_ns;
+	} else {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		trace->last_ns = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+
+	return 0;
+
+err_file:
+	fclose(trace->file);
+	trace->file = NULL;
+err_buf:
+	free(trace->buf);
+	trace->buf = NULL;
+	return err;
+}
+
+/**
+ * intel_mmio_trace_replay:
+ * @trace: trace to set up
+ * @path: trace written by intel_mmio_trace_record()
+ *
+ * Serves the accesses of @trace from the recording in @path. The device id
+ * and the arguments of the recording are loaded into @trace->devid and
+ * @trace->args.
+ *
+ * Returns: 0 on success, or a negative error code, -EINVAL if @path isn't
+ * a trace.
+ */
+int intel_mmio_trace_replay(struct intel_mmio_trace *trace, const char *path)
+{
+	const struct intel_mmio_trace_header *header;
+	size_t records_size;
+	struct stat st;
+	FILE *file;
+	int err = 0;
+
+	file = fopen(path, "r");
+	if (!file)
+		return -errno;
+
+	if (fstat(fileno(file), &st)) {
+		err = -errno;
+		goto out;
+	}
+
+	if (st.st_size < sizeof(*header)) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	trace->data = malloc(st.st_size);
+	if (!trace->data) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	if (fread(trace->data, st.st_size, 1, file) != 1) {
+		err = -EIO;
+		goto out;
+	}
+
+	header = trace->data;
+	records_size = st.st_size - sizeof(*header);
+	if (memcmp(header->magic, INTEL_MMIO_TRACE_MAGIC, 4) ||
+	    header->version != INTEL_MMIO_TRACE_VERSION ||
+	    ALIGN(header->args_size, 4) > records_size ||
+	    (records_size - ALIGN(header->args_size, 4)) % sizeof(*trace->buf)) {
+		err = -EINVAL;
+		goto out;
+	}
+	records_size -= ALIGN(header->args_size, 4);
+
+	trace->mode = INTEL_MMIO_TRACE_REPLAY;
+	trace->devid = header->devid;
+	trace->timed = true;
+	trace->args = (void *)(header + 1);
+	trace->args_size = header->args_size;
+	trace->buf = trace->args + ALIGN(header->args_size, 4);
+	trace->buf_size = records_size / sizeof(*trace->buf);
+	trace->buf_count = 0;
+
+out:
+	if (err) {
+		free(trace->data);
+		trace->data = NULL;
+	}
+	fclose(file);
+	return err;
+}
+
+static void trace_flush(struct intel_mmio_trace *trace)
+{
+	if (!trace->error && trace->buf_count &&
+	    fwrite(trace->buf, sizeof(*trace->buf), trace->buf_count,
+		   trace->file) != trace->buf_count)
+		trace->error = -errno ?: -EIO;
+
+	trace->buf_count = 0;
+}
+
+static void trace_emit(struct intel_mmio_trace *trace,
+		       const struct intel_mmio_trace_record *r)
+{
+	if (trace->buf_count == trace->buf_size)
+		trace_flush(trace);
+
+	trace->buf[trace->buf_count++] = *r;
+}
+
+static void trace_end_run(struct intel_mmio_trace *trace)
+{
+	if (trace->run.val) {
+		trace_emit(trace, &trace->run);
+		/* a new pattern can't reach over the repeat record */
+		trace->num_literals = 0;
+	}
+
+	memset(&trace->run, 0, sizeof(trace->run));
+}
+
+static bool same_access(const struct intel_mmio_trace_record *a,
+			const struct intel_mmio_trace_record *b)
+{
+	return a->reg == b->reg && a->val == b->val;
+}
+
+static void trace_append(struct intel_mmio_trace *trace,
+			 uint32_t reg, uint32_t val, uint64_t delta_ns)
+{
+	struct intel_mmio_trace_record r = {
+		.reg = reg,
+		.val = val,
+		.delta_ns = min_t(uint64_t, delta_ns, UINT32_MAX),
+	};
+	int period = trace->run.reg & INTEL_MMIO_TRACE_REG_MASK;
+	int n;
+
+	if (period) {
+		const struct intel_mmio_trace_record *next =
+			&trace->literals[trace->num_literals - period +
+					 trace->run.val % period];
+
+		if (same_access(&r, next) && trace->run.val < UINT32_MAX) {
+			trace->run.val++;
+			trace->run.delta_ns = min_t(uint64_t,
+						    trace->run.delta_ns + delta_ns,
+						    UINT32_MAX);
+			return;
+		}
+
+		trace_end_run(trace);
+	}
+
+	trace_emit(trace, &r);
+
+	if (trace->num_literals == ARRAY_SIZE(trace->literals)) {
+		memmove(&trace->literals[0], &trace->literals[1],
+			sizeof(trace->literals) - sizeof(trace->literals[0]));
+		trace->num_literals--;
+	}
+	trace->literals[trace->num_literals++] = r;
+	n = trace->num_literals;
+
+	/* repeat the last accesses once they show up twice in a row */
+	for (period = 1; period <= INTEL_MMIO_TRACE_MAX_PERIOD; period++) {
+		int i;
+
+		if (n < 2 * period)
+			break;
+
+		for (i = 0; i < period; i++)
+			if (!same_access(&trace->literals[n - 1 - i],
+					 &trace->literals[n - 1 - i - period]))
+				break;
+
+		if (i == period) {
+			trace->run.reg = INTEL_MMIO_TRACE_REPEAT | period;
+			break;
+		}
+	}
+}
+
+static void trace_account(struct intel_mmio_trace *trace,
+			  uint32_t reg, uint32_t val, uint64_t delta_ns)
+{
+	int bucket = delta_ns ? 63 - __builtin_clzll(delta_ns) : 0;
+
+	trace->interval_hist[min(bucket, INTEL_MMIO_TRACE_LOG2_BUCKETS - 1)]++;
+	trace->num_records++;
+
+	if (trace->recording)
+		trace_append(trace, reg, val, delta_ns);
+}
+
+/**
+ * intel_mmio_trace_fini:
+ * @trace: trace to finish
+ *
+ * Flushes the recording of @trace and releases its resources.
+ *
+ * Returns: 0 on success, or the first error writing the trace.
+ */
+int intel_mmio_trace_fini(struct intel_mmio_trace *trace)
+{
+	int err;
+
+	if (trace->recording) {
+		trace_end_run(trace);
+		trace_flush(trace);
+		if (fclose(trace->file) && !trace->error)
+			trace->error = -errno;
+		free(trace->buf);
+	}
+	free(trace->data);
+
+	err = trace->error;
+	intel_mmio_trace_init(trace);
+
+	return err;
+}
+
+/* synthetic display */
+
+static bool model_g4x_plus(const struct intel_display_model *m)
+{
+	return intel_gen(m->devid) >= 5 || IS_G4X(m->devid);
+}
+
+static uint64_t model_frame_ns(const struct intel_display_model *m)
+{
+	return (uint64_t)m->vtotal * m->line_ns;
+}
+
+static uint32_t model_timestamp(const struct intel_display_model *m)
+{
+	return m->now_ns / 1000;
+}
+
+static void model_vblank(struct intel_display_model *m, uint64_t count)
+{
+	for (int pipe = 0; pipe < ARRAY_SIZE(m->pipes); pipe++) {
+		typeof(m->pipes[0]) *p = &m->pipes[pipe];
+
+		p->frame += count;
+		p->frame_timestamp = model_timestamp(m);
+
+		if (p->pending) {
+			p->surflive = p->surf;
+			p->flips++;
+			p->pending = false;
+		}
+
+		p->push &= ~(1 << 30);
+		p->stat |= 0xffff;
+		p->iir = ~0u;
+	}
+
+	m->iir = ~0u;
+}
+
+/* Advances the clock by the cost of an access, returns the time it took */
+static uint32_t model_advance(struct intel_display_model *m, uint32_t cost)
+{
+	uint64_t vblanks;
+
+	if (m->jitter_ns) {
+		m->rand = m->rand * 1103515245 + 12345;
+		cost += (m->rand >> 16) % (m->jitter_ns + 1);
+	}
+	m->now_ns += cost;
+
+	/* frames are counted from the start of vblank */
+	vblanks = (m->now_ns + (uint64_t)(m->vtotal - m->vblank_start) *
+		   m->line_ns) / model_frame_ns(m);
+	if (vblanks != m->vblanks) {
+		model_vblank(m, vblanks - m->vblanks);
+		m->vblanks = vblanks;
+	}
+
+	return cost;
+}
+
+static bool model_pipe_reg(uint32_t reg)
+{
+	switch (reg) {
+	case PIPEA_DSL:
+	case PIPEACONF:
+	case PIPEASTAT:
+	case PIPEAFRMCOUNT_G4X:
+	case PIPEAFLIPCOUNT_G4X:
+	case PIPEAFRMTMSMTP:
+	case DSPACNTR:
+	case DSPAADDR_VLV:
+	case DSPASURF:
+	case DSPASURFLIVE:
+	case TRANS_PUSH_A:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Finds the pipe of @reg, and turns @reg into the pipe A register */
+static int model_pipe(const struct intel_display_model *m, uint32_t *reg)
+{
+	for (int pipe = ARRAY_SIZE(m->pipe_offset) - 1; pipe >= 0; pipe--) {
+		if (*reg < m->pipe_offset[pipe] ||
+		    !model_pipe_reg(*reg - m->pipe_offset[pipe]))
+			continue;
+
+		*reg -= m->pipe_offset[pipe];
+		return pipe;
+	}
+
+	return -1;
+}
+
+/* The interrupt registers, @status is set for the write 1 to clear IIRs */
+static uint32_t *model_irq_reg(struct intel_display_model *m, uint32_t reg,
+			       bool *status)
+{
+	int pipe = (reg - GEN8_DE_PIPE_IMR(0)) / 0x10;
+
+	*status = reg == IIR || reg == DEIIR;
+	if (*status)
+		return &m->iir;
+	if (reg == IMR || reg == DEIMR)
+		return &m->imr;
+	if (reg == IER || reg == DEIER)
+		return &m->ier;
+
+	if (reg < GEN8_DE_PIPE_IMR(0) || reg > GEN8_DE_PIPE_IER(3))
+		return NULL;
+
+	switch ((reg - GEN8_DE_PIPE_IMR(0)) % 0x10) {
+	case 0:
+		return &m->pipes[pipe].imr;
+	case 4:
+		*status = true;
+		return &m->pipes[pipe].iir;
+	case 8:
+		return &m->pipes[pipe].ier;
+	default:
+		return NULL;
+	}
+}
+
+static uint32_t *model_other_reg(struct intel_display_model *m, uint32_t reg)
+{
+	for (int i = 0; i < m->num_regs; i++)
+		if (m->regs[i].reg == reg)
+			return &m->regs[i].val;
+
+	if (m->num_regs == ARRAY_SIZE(m->regs))
+		return NULL;
+
+	m->regs[m->num_regs].reg = reg;
+	m->regs[m->num_regs].val = 0;
+	return &m->regs[m->num_regs++].val;
+}
+
+static uint32_t model_read(struct intel_display_model *m, uint32_t reg)
+{
+	uint64_t frame_ns = m->now_ns % model_frame_ns(m);
+	uint32_t *val;
+	bool status;
+	int pipe;
+
+	reg -= m->mmio_base;
+
+	if (reg == IVB_TIMESTAMP_CTR || reg == ILK_TIMESTAMP_HI ||
+	    reg == TIMESTAMP_QW + 4)
+		return model_timestamp(m);
+
+	val = model_irq_reg(m, reg, &status);
+	if (val)
+		return *val;
+
+	pipe = model_pipe(m, &reg);
+	if (pipe < 0) {
+		val = model_other_reg(m, reg);
+		return val ? *val : 0;
+	}
+
+	switch (reg) {
+	case PIPEA_DSL:
+		return frame_ns / m->line_ns;
+	case PIPEACONF:
+		return PIPEACONF_ENABLE;
+	case PIPEASTAT:
+		return m->pipes[pipe].stat;
+	case PIPEAFRMCOUNT_G4X:
+		return m->pipes[pipe].frame;
+	case PIPEAFLIPCOUNT_G4X:
+		/* PIPEAFRAMEPIXEL before g4x */
+		if (model_g4x_plus(m))
+			return m->pipes[pipe].flips;
+		return m->pipes[pipe].frame << 24 |
+		       ((frame_ns * m->htotal / m->line_ns) & PIPE_PIXEL_MASK);
+	case PIPEAFRMTMSMTP:
+		return m->pipes[pipe].frame_timestamp;
+	case DSPACNTR:
+		return m->pipes[pipe].cntr;
+	case DSPAADDR_VLV:
+	case DSPASURF:
+		return m->pipes[pipe].surf;
+	case DSPASURFLIVE:
+		return m->pipes[pipe].surflive;
+	case TRANS_PUSH_A:
+		return m->pipes[pipe].push;
+	default:
+		return 0;
+	}
+}
+
+static void model_write(struct intel_display_model *m, uint32_t reg,
+			uint32_t val)
+{
+	typeof(m->pipes[0]) *p;
+	uint32_t *ptr;
+	bool status;
+	int pipe;
+
+	reg -= m->mmio_base;
+
+	ptr = model_irq_reg(m, reg, &status);
+	if (ptr) {
+		if (status)
+			*ptr &= ~val;
+		else
+			*ptr = val;
+		return;
+	}
+
+	pipe = model_pipe(m, &reg);
+	if (pipe < 0) {
+		ptr = model_other_reg(m, reg);
+		if (ptr)
+			*ptr = val;
+		return;
+	}
+
+	p = &m->pipes[pipe];
+	switch (reg) {
+	case PIPEASTAT:
+		/* enables in the high half, write 1 to clear the status */
+		p->stat = (val & 0xffff0000) | (p->stat & 0xffff & ~val);
+		break;
+	case DSPACNTR:
+		p->cntr = val;
+		break;
+	case DSPASURF:
+		p->surf = val;
+		p->pending = !(p->cntr & (1 << 9));
+		if (!p->pending) {
+			p->surflive = val;
+			p->flips++;
+		}
+		break;
+	case DSPAADDR_VLV:
+		p->surf = val;
+		p->surflive = val;
+		p->flips++;
+		break;
+	case TRANS_PUSH_A:
+		p->push = val;
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct intel_mmio_trace_record *
+replay_next(struct intel_mmio_trace *trace, uint32_t reg)
+{
+	const struct intel_mmio_trace_record *r, *pattern;
+	uint32_t delta_ns, period;
+
+	if (intel_mmio_trace_done(trace))
+		return NULL;
+
+	r = &trace->buf[trace->buf_count];
+	if (r->reg & INTEL_MMIO_TRACE_REPEAT) {
+		period = r->reg & INTEL_MMIO_TRACE_REG_MASK;
+		if (!period || period > trace->buf_count || !r->val) {
+			trace->diverged = true;
+			return NULL;
+		}
+
+		/* the accesses of a repeat record share its time */
+		delta_ns = r->delta_ns / r->val;
+		pattern = &trace->buf[trace->buf_count - period +
+				      trace->repeat % period];
+		if (++trace->repeat == r->val) {
+			trace->repeat = 0;
+			trace->buf_count++;
+		}
+		r = pattern;
+	} else {
+		delta_ns = r->delta_ns;
+		trace->buf_count++;
+	}
+
+	if (r->reg != reg) {
+		trace->diverged = true;
+		return NULL;
+	}
+
+	trace_account(trace, reg, r->val, delta_ns);
+
+	return r;
+}
+
+static uint64_t live_delta_ns(struct intel_mmio_trace *trace)
+{
+	struct timespec ts;
+	uint64_t now, delta;
+
+	if (!trace->timed)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	delta = now - trace->last_ns;
+	trace->last_ns = now;
+
+	return delta;
+}
+
+/**
+ * intel_mmio_trace_read:
+ * @trace: trace to read through
+ * @reg: register offset
+ * @is_16bit: 16 bit access
+ *
+ * Reads @reg from the hardware, the recording or the model of @trace.
+ *
+ * Returns: The value of @reg, 0 once a replay is done.
+ */
+uint32_t intel_mmio_trace_read(struct intel_mmio_trace *trace,
+			       uint32_t reg, bool is_16bit)
+{
+	uint32_t flags = is_16bit ? INTEL_MMIO_TRACE_16BIT : 0;
+	const struct intel_mmio_trace_record *r;
+	uint32_t val, delta_ns;
+
+	switch (trace->mode) {
+	case INTEL_MMIO_TRACE_REPLAY:
+		r = replay_next(trace, reg | flags);
+		return r ? r->val : 0;
+	case INTEL_MMIO_TRACE_MODEL:
+		delta_ns = model_advance(&trace->model, trace->model.read_ns);
+		val = model_read(&trace->model, reg);
+		if (is_16bit)
+			val &= 0xffff;
+		trace_account(trace, reg | flags, val, delta_ns);
+		return val;
+	default:
+		val = is_16bit ? INREG16(reg) : INREG(reg);
+		if (trace->timed)
+			trace_account(trace, reg | flags, val,
+				      live_delta_ns(trace));
+		return val;
+	}
+}
+
+/**
+ * intel_mmio_trace_write:
+ * @trace: trace to write through
+ * @reg: register offset
+ * @val: value to write
+ * @is_16bit: 16 bit access
+ *
+ * Writes @val to @reg of the hardware or the model of @trace. When
+ * replaying, @val has to match the recording.
+ */
+void intel_mmio_trace_write(struct intel_mmio_trace *trace,
+			    uint32_t reg, uint32_t val, bool is_16bit)
+{
+	uint32_t flags = INTEL_MMIO_TRACE_WRITE |
+			 (is_16bit ? INTEL_MMIO_TRACE_16BIT : 0);
+	const struct intel_mmio_trace_record *r;
+	uint32_t delta_ns;
+
+	if (is_16bit)
+		val &= 0xffff;
+
+	switch (trace->mode) {
+	case INTEL_MMIO_TRACE_REPLAY:
+		r = replay_next(trace, reg | flags);
+		if (r && r->val != val)
+			trace->diverged = true;
+		break;
+	case INTEL_MMIO_TRACE_MODEL:
+		delta_ns = model_advance(&trace->model, trace->model.write_ns);
+		model_write(&trace->model, reg, val);
+		trace_account(trace, reg | flags, val, delta_ns);
+		break;
+	default:
+		if (is_16bit)
+			OUTREG16(reg, val);
+		else
+			OUTREG(reg, val);
+		if (trace->timed)
+			trace_account(trace, reg | flags, val,
+				      live_delta_ns(trace));
+		break;
+	}
+}
+
+/**
+ * intel_mmio_trace_done:
+ * @trace: trace to check
+ *
+ * Returns: True once a replay is over, because all the recorded accesses
+ * were issued or because it diverged.
+ */
+bool intel_mmio_trace_done(const struct intel_mmio_trace *trace)
+{
+	return trace->mode == INTEL_MMIO_TRACE_REPLAY &&
+	       (trace->diverged || trace->buf_count == trace->buf_size);
+}
+
+/**
+ * intel_mmio_trace_diverged:
+ * @trace: trace to check
+ *
+ * Returns: True if a replay stopped at an access that doesn't match the
+ * recording.
+ */
+bool intel_mmio_trace_diverged(const struct intel_mmio_trace *trace)
+{
+	return trace->diverged;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef INTEL_MMIO_TRACE_H
+#define INTEL_MMIO_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define INTEL_MMIO_TRACE_MAGIC		"IMTR"
+#define INTEL_MMIO_TRACE_VERSION	1
+
+/* flags in the top bits of intel_mmio_trace_record.reg */
+#define INTEL_MMIO_TRACE_WRITE		(1u << 31)
+#define INTEL_MMIO_TRACE_16BIT		(1u << 30)
+#define INTEL_MMIO_TRACE_REPEAT		(1u << 29)
+#define INTEL_MMIO_TRACE_REG_MASK	(INTEL_MMIO_TRACE_REPEAT - 1)
+
+/* longest access pattern a repeat record can stand for */
+#define INTEL_MMIO_TRACE_MAX_PERIOD	4
+
+/**
+ * intel_mmio_trace_header:
+ * @magic: #INTEL_MMIO_TRACE_MAGIC
+ * @version: #INTEL_MMIO_TRACE_VERSION
+ * @devid: PCI device id of the traced device
+ * @args_size: size of the tool arguments following the header
+ *
+ * A trace is this header, @args_size bytes of arguments the recording tool
+ * needs to replay the trace padded to 4 bytes, then #intel_mmio_trace_record
+ * entries up to the end of the file, all in host byte order.
+ */
+struct intel_mmio_trace_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t devid;
+	uint32_t args_size;
+};
+
+/**
+ * intel_mmio_trace_record:
+ * @reg: register offset, or'ed with #INTEL_MMIO_TRACE_WRITE and
+ * #INTEL_MMIO_TRACE_16BIT
+ * @val: value read or written
+ * @delta_ns: time since the previous record, saturated at UINT32_MAX
+ *
+ * Polling loops issue the same few accesses over and over. A record with
+ * #INTEL_MMIO_TRACE_REPEAT stands for @val accesses repeating the pattern
+ * of the (@reg & #INTEL_MMIO_TRACE_REG_MASK) records before it, and
+ * @delta_ns is the time they took.
+ */
+struct intel_mmio_trace_record {
+	uint32_t reg;
+	uint32_t val;
+	uint32_t delta_ns;
+};
+
+enum intel_mmio_trace_mode {
+	INTEL_MMIO_TRACE_LIVE,
+	INTEL_MMIO_TRACE_REPLAY,
+	INTEL_MMIO_TRACE_MODEL,
+};
+
+/**
+ * intel_display_model:
+ * @devid: PCI device id of the modelled device
+ * @mmio_base: offset of the display registers, 0x180000 on vlv/chv
+ * @pipe_offset: offset of the registers of each pipe from those of pipe A
+ * @htotal: total pixels per line
+ * @vtotal: total lines per frame
+ * @vblank_start: first line of the vertical blank
+ * @line_ns: duration of a line
+ * @read_ns: cost of a register read
+ * @write_ns: cost of a register write
+ * @jitter_ns: maximum extra cost of an access, drawn from a fixed
+ * pseudo-random sequence
+ *
+ * A synthetic display: every pipe scans out the same timings, from time 0
+ * of a virtual clock that each access advances by its cost. The scanline,
+ * pixel and frame counters follow the clock. At the start of vblank the
+ * pending flips land, VRR pushes complete and every interrupt status bit
+ * fires; async flips land at once. Other registers read back what was
+ * last written.
+ */
+struct intel_display_model {
+	uint32_t devid;
+	uint32_t mmio_base;
+	uint32_t pipe_offset[4];
+	uint32_t htotal, vtotal, vblank_start;
+	uint32_t line_ns;
+	uint32_t read_ns, write_ns, jitter_ns;
+
+	/*< private >*/
+	uint64_t now_ns, vblanks;
+	uint32_t rand;
+	struct {
+		uint32_t frame, flips, frame_timestamp;
+		uint32_t cntr, surf, surflive, stat, push;
+		uint32_t iir, imr, ier;
+		bool pending;
+	} pipes[4];
+	uint32_t iir, imr, ier;
+	struct {
+		uint32_t reg, val;
+	} regs[64];
+	int num_regs;
+};
+
+#define INTEL_MMIO_TRACE_LOG2_BUCKETS	32
+
+/**
+ * intel_mmio_trace:
+ * @mode: #intel_mmio_trace_mode
+ * @devid: PCI device id, from the trace when replaying
+ * @recording: the accesses are written to a trace
+ * @args: tool arguments of the trace being replayed
+ * @args_size: size of @args
+ * @model: the synthetic display of #INTEL_MMIO_TRACE_MODEL
+ * @timed: @interval_hist is collected
+ * @interval_hist: number of accesses by log2 of the ns since the previous
+ * one
+ * @num_records: number of accesses so far
+ */
+struct intel_mmio_trace {
+	enum intel_mmio_trace_mode mode;
+	uint32_t devid;
+	bool recording;
+	void *args;
+	size_t args_size;
+	struct intel_display_model model;
+	bool timed;
+	uint64_t interval_hist[INTEL_MMIO_TRACE_LOG2_BUCKETS];
+	uint64_t num_records;
+
+	/*< private >*/
+	FILE *file;
+	struct intel_mmio_trace_record *buf;
+	size_t buf_count, buf_size;
+	struct intel_mmio_trace_record literals[2 * INTEL_MMIO_TRACE_MAX_PERIOD];
+	int num_literals;
+	struct intel_mmio_trace_record run;
+	uint32_t repeat;
+	uint64_t last_ns;
+	void *data;
+	bool diverged;
+	int error;
+};
+
+void intel_mmio_trace_init(struct intel_mmio_trace *trace);
+int intel_mmio_trace_record(struct intel_mmio_trace *trace, const char *path,
+			    uint32_t devid, const void *args, size_t args_size);
+int intel_mmio_trace_replay(struct intel_mmio_trace *trace, const char *path);
+void intel_mmio_trace_model(struct intel_mmio_trace *trace, uint32_t devid);
+int intel_mmio_trace_fini(struct intel_mmio_trace *trace);
+
+uint32_t intel_mmio_trace_read(struct intel_mmio_trace *trace,
+			       uint32_t reg, bool is_16bit);
+void intel_mmio_trace_write(struct intel_mmio_trace *trace,
+			    uint32_t reg, uint32_t val, bool is_16bit);
+
+bool intel_mmio_trace_done(const struct intel_mmio_trace *trace);
+bool intel_mmio_trace_diverged(const struct intel_mmio_trace *trace);
+
+#endif /* INTEL_MMIO_TRACE_H */
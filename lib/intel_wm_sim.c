@@ -0,0 +1,1023 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drm_fourcc.h"
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "intel_wm_sim.h"
+
+/**
+ * SECTION:intel_wm_sim
+ * @short_description: DDB and watermark simulator
+ * @title: Watermark simulator
+ * @include: intel_wm_sim.h
+ *
+ * This library models how i915 splits the Display Data Buffer between
+ * pipes and planes on gen9+, and which watermark levels each plane can then
+ * enable, following skl_compute_plane_wm() and skl_allocate_plane_ddb() of
+ * the kernel. It runs on any host: the platform is described by
+ * #intel_wm_sim_platform and the display configuration by
+ * #intel_wm_sim_config.
+ *
+ * A configuration fails when the level 0 watermarks of a pipe don't fit in
+ * its share of the DDB, which the kernel rejects, or when the planes fetch
+ * more than the memory bandwidth, which underruns. Otherwise the highest
+ * watermark level enabled on every plane tells how deep the package
+ * C-states can go.
+ *
+ * intel_wm_sim_run() simulates every configuration of an
+ * #intel_wm_sim_space on a number of threads. The results are indexed by
+ * configuration, so they don't depend on the number of threads.
+ */
+
+#define U16_MAX		0xffff
+
+/* Typical latencies and bandwidths, override them to match a machine */
+const struct intel_wm_sim_platform intel_wm_sim_platforms[] = {
+	{
+		.name = "skl", .display_ver = 9,
+		.num_pipes = 3, .num_planes = 3,
+		.num_slices = 1, .slice_size = 896,
+		.latency = { 2, 19, 28, 32, 63, 77, 83, 99 },
+		.max_bw = 30720,
+		.no_planar = true,
+	},
+	{
+		.name = "bxt", .display_ver = 9,
+		.num_pipes = 3, .num_planes = 3,
+		.num_slices = 1, .slice_size = 512,
+		.latency = { 3, 21, 23, 33, 57, 0, 0, 0 },
+		.max_bw = 17280,
+		.no_planar = true,
+	},
+	{
+		.name = "glk", .display_ver = 10,
+		.num_pipes = 3, .num_planes = 4,
+		.num_slices = 1, .slice_size = 1024,
+		.latency = { 3, 21, 23, 33, 57, 0, 0, 0 },
+		.max_bw = 17280,
+	},
+	{
+		.name = "icl", .display_ver = 11,
+		.num_pipes = 3, .num_planes = 7,
+		.num_slices = 2, .slice_size = 1024,
+		.latency = { 3, 9, 15, 26, 40, 61, 92, 0 },
+		.max_bw = 26880,
+	},
+	{
+		.name = "tgl", .display_ver = 12,
+		.num_pipes = 4, .num_planes = 7,
+		.num_slices = 2, .slice_size = 1024,
+		.latency = { 3, 6, 16, 33, 47, 60, 93, 0 },
+		.max_bw = 30720,
+	},
+	{
+		.name = "adlp", .display_ver = 13,
+		.num_pipes = 4, .num_planes = 5,
+		.num_slices = 4, .slice_size = 1024,
+		.latency = { 4, 8, 20, 33, 56, 72, 102, 0 },
+		.max_bw = 34560,
+	},
+};
+
+const int intel_wm_sim_num_platforms = ARRAY_SIZE(intel_wm_sim_platforms);
+
+/**
+ * intel_wm_sim_find_platform:
+ * @name: platform name
+ *
+ * Returns: The built-in platform called @name, or NULL.
+ */
+const struct intel_wm_sim_platform *intel_wm_sim_find_platform(const char *name)
+{
+	for (int i = 0; i < intel_wm_sim_num_platforms; i++)
+		if (!strcmp(intel_wm_sim_platforms[i].name, name))
+			return &intel_wm_sim_platforms[i];
+
+	return NULL;
+}
+
+/* 16.16 fixed point, with the rounding of the kernel helpers */
+typedef uint32_t fixed16;
+
+#define FIXED16_MAX	0xffffffffu
+
+static fixed16 clamp_fixed16(uint64_t v)
+{
+	return min_t(uint64_t, v, FIXED16_MAX);
+}
+
+static fixed16 u32_to_fixed16(uint32_t v)
+{
+	return clamp_fixed16((uint64_t)v << 16);
+}
+
+static fixed16 div_fixed16(uint64_t v, uint64_t d)
+{
+	return clamp_fixed16(DIV_ROUND_UP(v << 16, d));
+}
+
+static fixed16 mul_u32_fixed16(uint32_t v, fixed16 mul)
+{
+	return clamp_fixed16((uint64_t)v * mul);
+}
+
+static uint32_t fixed16_to_u32_round_up(fixed16 v)
+{
+	return DIV_ROUND_UP((uint64_t)v, 1 << 16);
+}
+
+static uint32_t div_round_up_fixed16(fixed16 v, fixed16 d)
+{
+	return DIV_ROUND_UP((uint64_t)v, d);
+}
+
+static uint32_t mul_round_up_u32_fixed16(uint32_t v, fixed16 mul)
+{
+	return min_t(uint64_t, DIV_ROUND_UP((uint64_t)v * mul, 1 << 16),
+		     UINT32_MAX);
+}
+
+struct wm_params {
+	bool x_tiled, y_tiled, rc_surface;
+	int cpp;
+	uint32_t width, height;
+	uint32_t pixel_rate, htotal;
+	uint32_t dbuf_block_size;
+	uint32_t y_min_scanlines;
+	uint32_t plane_bytes_per_line;
+	fixed16 plane_blocks_per_line;
+	fixed16 y_tile_minimum;
+	uint32_t linetime_us;
+};
+
+/* Bytes per pixel of @color_plane, 0 if the format isn't supported */
+static int format_cpp(uint32_t format, int color_plane)
+{
+	switch (format) {
+	case DRM_FORMAT_C8:
+		return 1;
+	case DRM_FORMAT_RGB565:
+		return 2;
+	case DRM_FORMAT_XRGB8888:
+	case DRM_FORMAT_ARGB8888:
+	case DRM_FORMAT_XRGB2101010:
+		return 4;
+	case DRM_FORMAT_XRGB16161616F:
+		return 8;
+	case DRM_FORMAT_NV12:
+		return color_plane ? 2 : 1;
+	default:
+		return 0;
+	}
+}
+
+static bool format_is_planar(uint32_t format)
+{
+	return format == DRM_FORMAT_NV12;
+}
+
+static void compute_wm_params(const struct intel_wm_sim_platform *platform,
+			      const struct intel_wm_sim_mode *mode,
+			      uint32_t format, uint64_t modifier,
+			      int color_plane, uint32_t width, uint32_t height,
+			      struct wm_params *wp)
+{
+	uint32_t interm_pbpl;
+
+	memset(wp, 0, sizeof(*wp));
+	wp->y_tiled = modifier == I915_FORMAT_MOD_Y_TILED ||
+		      modifier == I915_FORMAT_MOD_Yf_TILED ||
+		      modifier == I915_FORMAT_MOD_Y_TILED_CCS ||
+		      modifier == I915_FORMAT_MOD_Yf_TILED_CCS;
+	wp->x_tiled = modifier == I915_FORMAT_MOD_X_TILED;
+	wp->rc_surface = modifier == I915_FORMAT_MOD_Y_TILED_CCS ||
+			 modifier == I915_FORMAT_MOD_Yf_TILED_CCS;
+
+	/* the uv plane does 1/2 pixel sub-sampling */
+	wp->width = color_plane ? width / 2 : width;
+	wp->height = color_plane ? height / 2 : height;
+	wp->cpp = format_cpp(format, color_plane);
+	wp->pixel_rate = mode->clock;
+	wp->htotal = mode->htotal;
+
+	if (platform->display_ver >= 11 &&
+	    modifier == I915_FORMAT_MOD_Yf_TILED && wp->cpp == 1)
+		wp->dbuf_block_size = 256;
+	else
+		wp->dbuf_block_size = 512;
+
+	wp->y_min_scanlines = 4;
+	/* memory bandwidth workaround of skl and bxt */
+	if (platform->display_ver == 9)
+		wp->y_min_scanlines *= 2;
+
+	wp->plane_bytes_per_line = wp->width * wp->cpp;
+	if (wp->y_tiled) {
+		interm_pbpl = DIV_ROUND_UP(wp->plane_bytes_per_line *
+					   wp->y_min_scanlines,
+					   wp->dbuf_block_size);
+		if (platform->display_ver >= 10)
+			interm_pbpl++;
+
+		wp->plane_blocks_per_line = div_fixed16(interm_pbpl,
+							wp->y_min_scanlines);
+	} else {
+		interm_pbpl = DIV_ROUND_UP(wp->plane_bytes_per_line,
+					   wp->dbuf_block_size);
+		if (!wp->x_tiled || platform->display_ver >= 10)
+			interm_pbpl++;
+
+		wp->plane_blocks_per_line = u32_to_fixed16(interm_pbpl);
+	}
+
+	wp->y_tile_minimum = mul_u32_fixed16(wp->y_min_scanlines,
+					     wp->plane_blocks_per_line);
+	wp->linetime_us = fixed16_to_u32_round_up(div_fixed16(mode->htotal * 1000,
+								mode->clock));
+}
+
+static void compute_plane_wm(const struct intel_wm_sim_platform *platform,
+			     int level, const struct wm_params *wp,
+			     const struct intel_wm_sim_level *prev,
+			     struct intel_wm_sim_level *result)
+{
+	uint32_t latency = platform->latency[level];
+	uint32_t blocks, lines, min_ddb_alloc = 0;
+	fixed16 method1, method2, selected;
+
+	result->blocks = 0;
+	result->lines = 0;
+	result->min_ddb_alloc = U16_MAX;
+
+	if (latency == 0)
+		return;
+
+	if (platform->display_ver == 9 && wp->x_tiled)
+		latency += 15;
+
+	method1 = div_fixed16((uint64_t)latency * wp->pixel_rate * wp->cpp,
+			      1000 * wp->dbuf_block_size);
+	if (platform->display_ver >= 10)
+		method1 = clamp_fixed16((uint64_t)method1 + (1 << 16));
+
+	method2 = mul_u32_fixed16(DIV_ROUND_UP(latency * wp->pixel_rate,
+					       wp->htotal * 1000),
+				  wp->plane_blocks_per_line);
+
+	if (wp->y_tiled) {
+		selected = max(method2, wp->y_tile_minimum);
+	} else if (wp->cpp * wp->htotal / wp->dbuf_block_size < 1 &&
+		   wp->plane_bytes_per_line / wp->dbuf_block_size < 1) {
+		selected = method2;
+	} else if (latency >= wp->linetime_us) {
+		if (platform->display_ver == 9)
+			selected = min(method1, method2);
+		else
+			selected = method2;
+	} else {
+		selected = method1;
+	}
+
+	blocks = fixed16_to_u32_round_up(selected) + 1;
+	lines = div_round_up_fixed16(selected, wp->plane_blocks_per_line);
+
+	if (platform->display_ver == 9) {
+		if (level == 0 && wp->rc_surface)
+			blocks += fixed16_to_u32_round_up(wp->y_tile_minimum);
+
+		if (level >= 1) {
+			if (wp->y_tiled) {
+				blocks += fixed16_to_u32_round_up(wp->y_tile_minimum);
+				lines += wp->y_min_scanlines;
+			} else {
+				blocks++;
+			}
+
+			if (prev->blocks > blocks)
+				blocks = prev->blocks;
+		}
+	}
+
+	if (platform->display_ver >= 11) {
+		if (wp->y_tiled) {
+			uint32_t extra_lines;
+
+			if (lines % wp->y_min_scanlines == 0)
+				extra_lines = wp->y_min_scanlines;
+			else
+				extra_lines = wp->y_min_scanlines * 2 -
+					      lines % wp->y_min_scanlines;
+
+			min_ddb_alloc = mul_round_up_u32_fixed16(lines + extra_lines,
+								 wp->plane_blocks_per_line);
+		} else {
+			min_ddb_alloc = blocks + DIV_ROUND_UP(blocks, 10);
+		}
+	}
+
+	/* the lines of level 0 are ignored before gen10 */
+	if (platform->display_ver < 10 && level == 0)
+		lines = 0;
+
+	if (lines > (platform->display_ver >= 13 ? 255 : 31))
+		return;
+
+	/* a value >= the plane allocation is invalid, hence the +1 */
+	min_ddb_alloc = max(min_ddb_alloc, blocks) + 1;
+	if (min_ddb_alloc >= U16_MAX)
+		return;
+
+	result->blocks = blocks;
+	result->lines = lines;
+	result->min_ddb_alloc = min_ddb_alloc;
+}
+
+static void compute_wm(const struct intel_wm_sim_platform *platform,
+		       const struct wm_params *wp,
+		       struct intel_wm_sim_alloc *alloc)
+{
+	static const struct intel_wm_sim_level none;
+
+	for (int level = 0; level < INTEL_WM_SIM_MAX_LEVELS; level++)
+		compute_plane_wm(platform, level, wp,
+				 level ? &alloc->wm[level - 1] : &none,
+				 &alloc->wm[level]);
+}
+
+/* Highest level whose min_ddb_alloc, and those of the levels below, fit */
+static int max_level(const struct intel_wm_sim_alloc *alloc, uint16_t size)
+{
+	int level;
+
+	for (level = 0; level < INTEL_WM_SIM_MAX_LEVELS; level++)
+		if (alloc->wm[level].min_ddb_alloc > size)
+			break;
+
+	return level - 1;
+}
+
+/*
+ * The DBuf slices each pipe may use for a given set of active pipes, copied
+ * from the *_allowed_dbufs tables of the kernel.
+ */
+struct dbuf_slice_conf_entry {
+	uint8_t active_pipes;
+	uint8_t dbuf_mask[INTEL_WM_SIM_MAX_PIPES];
+};
+
+enum { PIPE_A, PIPE_B, PIPE_C, PIPE_D };
+
+#define P(x) (1 << PIPE_##x)
+#define S(x) (1 << ((x) - 1))
+
+static const struct dbuf_slice_conf_entry icl_allowed_dbufs[] = {
+	{ .active_pipes = P(A),
+	  .dbuf_mask = { [PIPE_A] = S(1) } },
+	{ .active_pipes = P(B),
+	  .dbuf_mask = { [PIPE_B] = S(1) } },
+	{ .active_pipes = P(A) | P(B),
+	  .dbuf_mask = { [PIPE_A] = S(1), [PIPE_B] = S(2) } },
+	{ .active_pipes = P(C),
+	  .dbuf_mask = { [PIPE_C] = S(2) } },
+	{ .active_pipes = P(A) | P(C),
+	  .dbuf_mask = { [PIPE_A] = S(1), [PIPE_C] = S(2) } },
+	{ .active_pipes = P(B) | P(C),
+	  .dbuf_mask = { [PIPE_B] = S(1), [PIPE_C] = S(2) } },
+	{ .active_pipes = P(A) | P(B) | P(C),
+	  .dbuf_mask = { [PIPE_A] = S(1), [PIPE_B] = S(1), [PIPE_C] = S(2) } },
+	{}
+};
+
+static const struct dbuf_slice_conf_entry tgl_allowed_dbufs[] = {
+	{ .active_pipes = P(A),
+	  .dbuf_mask = { [PIPE_A] = S(1) | S(2) } },
+	{ .active_pipes = P(B),
+	  .dbuf_mask = { [PIPE_B] = S(1) | S(2) } },
+	{ .active_pipes = P(A) | P(B),
+	  .dbuf_mask = { [PIPE_A] = S(2), [PIPE_B] = S(1) } },
+	{ .active_pipes = P(C),
+	  .dbuf_mask = { [PIPE_C] = S(1) | S(2) } },
+	{ .active_pipes = P(A) | P(C),
+	  .dbuf_mask = { [PIPE_A] = S(1), [PIPE_C] = S(2) } },
+	{ .active_pipes = P(B) | P(C),
+	  .dbuf_mask = { [PIPE_B] = S(1), [PIPE_C] = S(2) } },
+	{ .active_pipes = P(A) | P(B) | P(C),
+	  .dbuf_mask = { [PIPE_A] = S(1), [PIPE_B] = S(1), [PIPE_C] = S(2) } },
+	{ .active_pipes = P(D),
+	  .dbuf_mask = { [PIPE_D] = S(1) | S(2) } },
+	{ .active_pipes = P(A) | P(D),
+	  .dbuf_mask = { [PIPE_A] = S(1), [PIPE_D] = S(2) } },
+	{ .active_pipes = P(B) | P(D),
+	  .dbuf_mask = { [PIPE_B] = S(1), [PIPE_D] = S(2) } },
+	{ .active_pipes = P(A) | P(B) | P(D),
+	  .dbuf_mask = { [PIPE_A] = S(1), [PIPE_B] = S(1), [PIPE_D] = S(2) } },
+	{ .active_pipes = P(C) | P(D),
+	  .dbuf_mask = { [PIPE_C] = S(1), [PIPE_D] = S(2) } },
+	{ .active_pipes = P(A) | P(C) | P(D),
+	  .dbuf_mask = { [PIPE_A] = S(1), [PIPE_C] = S(2), [PIPE_D] = S(2) } },
+	{ .active_pipes = P(B) | P(C) | P(D),
+	  .dbuf_mask = { [PIPE_B] = S(1), [PIPE_C] = S(2), [PIPE_D] = S(2) } },
+	{ .active_pipes = P(A) | P(B) | P(C) | P(D),
+	  .dbuf_mask = { [PIPE_A] = S(1),
+			 [PIPE_B] = S(1),
+			 [PIPE_C] = S(2),
+			 [PIPE_D] = S(2) } },
+	{}
+};
+
+static const struct dbuf_slice_conf_entry adlp_allowed_dbufs[] = {
+	{ .active_pipes = P(A),
+	  .dbuf_mask = { [PIPE_A] = S(1) | S(2) } },
+	{ .active_pipes = P(B),
+	  .dbuf_mask = { [PIPE_B] = S(3) | S(4) } },
+	{ .active_pipes = P(A) | P(B),
+	  .dbuf_mask = { [PIPE_A] = S(1) | S(2), [PIPE_B] = S(3) | S(4) } },
+	{ .active_pipes = P(C),
+	  .dbuf_mask = { [PIPE_C] = S(3) | S(4) } },
+	{ .active_pipes = P(A) | P(C),
+	  .dbuf_mask = { [PIPE_A] = S(1) | S(2), [PIPE_C] = S(3) | S(4) } },
+	{ .active_pipes = P(B) | P(C),
+	  .dbuf_mask = { [PIPE_B] = S(1) | S(2), [PIPE_C] = S(3) | S(4) } },
+	{ .active_pipes = P(A) | P(B) | P(C),
+	  .dbuf_mask = { [PIPE_A] = S(1) | S(2),
+			 [PIPE_B] = S(3) | S(4),
+			 [PIPE_C] = S(3) | S(4) } },
+	{ .active_pipes = P(D),
+	  .dbuf_mask = { [PIPE_D] = S(1) | S(2) } },
+	{ .active_pipes = P(A) | P(D),
+	  .dbuf_mask = { [PIPE_A] = S(1) | S(2), [PIPE_D] = S(1) | S(2) } },
+	{ .active_pipes = P(B) | P(D),
+	  .dbuf_mask = { [PIPE_B] = S(3) | S(4), [PIPE_D] = S(1) | S(2) } },
+	{ .active_pipes = P(A) | P(B) | P(D),
+	  .dbuf_mask = { [PIPE_A] = S(1) | S(2),
+			 [PIPE_B] = S(3) | S(4),
+			 [PIPE_D] = S(1) | S(2) } },
+	{ .active_pipes = P(C) | P(D),
+	  .dbuf_mask = { [PIPE_C] = S(3) | S(4), [PIPE_D] = S(1) | S(2) } },
+	{ .active_pipes = P(A) | P(C) | P(D),
+	  .dbuf_mask = { [PIPE_A] = S(1) | S(2),
+			 [PIPE_C] = S(3) | S(4),
+			 [PIPE_D] = S(1) | S(2) } },
+	{ .active_pipes = P(B) | P(C) | P(D),
+	  .dbuf_mask = { [PIPE_B] = S(3) | S(4),
+			 [PIPE_C] = S(3) | S(4),
+			 [PIPE_D] = S(1) | S(2) } },
+	{ .active_pipes = P(A) | P(B) | P(C) | P(D),
+	  .dbuf_mask = { [PIPE_A] = S(1) | S(2),
+			 [PIPE_B] = S(3) | S(4),
+			 [PIPE_C] = S(3) | S(4),
+			 [PIPE_D] = S(1) | S(2) } },
+	{}
+};
+
+#undef S
+#undef P
+
+static uint8_t pipe_slices(const struct intel_wm_sim_platform *platform,
+			   unsigned int active_pipes, int pipe)
+{
+	const struct dbuf_slice_conf_entry *entry;
+
+	switch (platform->display_ver) {
+	case 11:
+		entry = icl_allowed_dbufs;
+		break;
+	case 12:
+		entry = tgl_allowed_dbufs;
+		break;
+	case 13:
+		entry = adlp_allowed_dbufs;
+		break;
+	default:
+		/* a single slice before gen11 */
+		return 1;
+	}
+
+	for (; entry->active_pipes; entry++)
+		if (entry->active_pipes == active_pipes)
+			return entry->dbuf_mask[pipe];
+
+	return 0;
+}
+
+static void allocate_pipe_ddb(const struct intel_wm_sim_platform *platform,
+			      const struct intel_wm_sim_config *config,
+			      unsigned int active_pipes,
+			      struct intel_wm_sim_state *state)
+{
+	for (int pipe = 0; pipe < platform->num_pipes; pipe++) {
+		struct intel_wm_sim_pipe_state *ps = &state->pipes[pipe];
+		uint32_t weight_start = 0, weight_end = 0, total_weight = 0;
+		uint32_t range, first;
+
+		if (!(active_pipes & (1 << pipe)))
+			continue;
+
+		ps->slices = pipe_slices(platform, active_pipes, pipe);
+
+		/* pipes sharing slices split them by width */
+		for (int i = 0; i < platform->num_pipes; i++) {
+			uint32_t weight;
+
+			if (!(active_pipes & (1 << i)) ||
+			    pipe_slices(platform, active_pipes, i) != ps->slices)
+				continue;
+
+			weight = config->pipes[i].mode->hdisplay;
+			total_weight += weight;
+			if (i < pipe)
+				weight_start += weight;
+			else if (i == pipe)
+				weight_end = weight_start + weight;
+		}
+
+		range = __builtin_popcount(ps->slices) * platform->slice_size;
+		/* 4 blocks for the bypass path before gen11 */
+		if (platform->display_ver < 11)
+			range -= 4;
+		first = (__builtin_ffs(ps->slices) - 1) * platform->slice_size;
+
+		ps->start = first + range * weight_start / total_weight;
+		ps->end = first + range * weight_end / total_weight;
+	}
+}
+
+/* Lists the hw planes of @pipe, returns false if it isn't supported */
+static bool pipe_allocs(const struct intel_wm_sim_platform *platform,
+			const struct intel_wm_sim_pipe *pipe, int pipe_index,
+			struct intel_wm_sim_pipe_state *ps, uint64_t *rates)
+{
+	int max_width = platform->display_ver >= 11 ? 5120 : 4096;
+	int num_planar = 0, n = 0;
+
+	if (pipe->num_planes > platform->num_planes)
+		return false;
+
+	for (int i = 0; i < pipe->num_planes; i++) {
+		const struct intel_wm_sim_plane *plane = &pipe->planes[i];
+		bool planar = format_is_planar(plane->format);
+
+		if (!format_cpp(plane->format, 0) || plane->width > max_width ||
+		    !plane->width || !plane->height)
+			return false;
+
+		/* Yf is gone from gen12 */
+		if (platform->display_ver >= 12 &&
+		    (plane->modifier == I915_FORMAT_MOD_Yf_TILED ||
+		     plane->modifier == I915_FORMAT_MOD_Yf_TILED_CCS))
+			return false;
+
+		if (planar) {
+			num_planar++;
+
+			/*
+			 * Before gen11 only the first two planes are planar,
+			 * not on pipe C of gen9, from gen11 a planar plane
+			 * links one of two Y planes of the pipe.
+			 */
+			if (platform->no_planar)
+				return false;
+			if (platform->display_ver < 11 && i >= 2)
+				return false;
+			if (platform->display_ver == 9 && pipe_index >= 2)
+				return false;
+			if (platform->display_ver >= 11 &&
+			    (num_planar > 2 ||
+			     pipe->num_planes + num_planar > platform->num_planes))
+				return false;
+		}
+
+		ps->allocs[n].plane = i;
+		ps->allocs[n].uv = false;
+		n++;
+
+		/* the uv plane before gen11, the linked Y plane from gen11 */
+		if (planar) {
+			ps->allocs[n].plane = i;
+			ps->allocs[n].uv = true;
+			n++;
+		}
+	}
+
+	ps->num_allocs = n;
+	for (int i = 0; i < n; i++) {
+		const struct intel_wm_sim_plane *plane =
+			&pipe->planes[ps->allocs[i].plane];
+		struct wm_params wp;
+
+		compute_wm_params(platform, pipe->mode, plane->format,
+				  plane->modifier, ps->allocs[i].uv,
+				  plane->width, plane->height, &wp);
+		compute_wm(platform, &wp, &ps->allocs[i]);
+
+		rates[i] = (uint64_t)wp.width * wp.height * wp.cpp;
+	}
+
+	return true;
+}
+
+/* The cursor gets enough blocks for the highest level a 256 wide one can reach */
+static uint16_t cursor_allocation(const struct intel_wm_sim_platform *platform,
+				  const struct intel_wm_sim_mode *mode,
+				  int num_active, struct intel_wm_sim_alloc *cursor)
+{
+	uint16_t min_ddb_alloc = 0;
+	struct wm_params wp;
+
+	compute_wm_params(platform, mode, DRM_FORMAT_ARGB8888,
+			  DRM_FORMAT_MOD_LINEAR, 0, 256, 256, &wp);
+	compute_wm(platform, &wp, cursor);
+
+	for (int level = 0; level < INTEL_WM_SIM_MAX_LEVELS; level++) {
+		if (cursor->wm[level].min_ddb_alloc == U16_MAX)
+			break;
+
+		/* method1 and method2 needn't grow with the latency */
+		min_ddb_alloc = max(min_ddb_alloc,
+				    cursor->wm[level].min_ddb_alloc);
+	}
+
+	return max_t(uint16_t, (num_active == 1 ? 32 : 8), min_ddb_alloc);
+}
+
+static bool allocate_plane_ddb(const struct intel_wm_sim_platform *platform,
+			       const struct intel_wm_sim_pipe *pipe,
+			       int num_active, const uint64_t *rates,
+			       struct intel_wm_sim_pipe_state *ps)
+{
+	struct intel_wm_sim_alloc *cursor = &ps->allocs[ps->num_allocs];
+	uint16_t total[INTEL_WM_SIM_MAX_ALLOCS];
+	uint32_t alloc_size = ps->end - ps->start;
+	uint64_t total_rate = 0;
+	uint16_t cursor_blocks, start;
+	int level;
+
+	cursor->plane = -1;
+	cursor->uv = false;
+	cursor_blocks = cursor_allocation(platform, pipe->mode, num_active,
+					  cursor);
+	if (cursor_blocks > alloc_size)
+		return false;
+
+	cursor->start = ps->end - cursor_blocks;
+	cursor->end = ps->end;
+	cursor->max_level = max_level(cursor, cursor_blocks);
+	alloc_size -= cursor_blocks;
+
+	for (int i = 0; i < ps->num_allocs; i++)
+		total_rate += rates[i];
+
+	/* the highest level the requirements of all planes fit at */
+	for (level = INTEL_WM_SIM_MAX_LEVELS - 1; level >= 0; level--) {
+		uint32_t blocks = 0;
+
+		if (cursor->wm[level].min_ddb_alloc > cursor_blocks)
+			continue;
+
+		for (int i = 0; i < ps->num_allocs; i++)
+			blocks += ps->allocs[i].wm[level].min_ddb_alloc;
+
+		if (blocks <= alloc_size) {
+			alloc_size -= blocks;
+			break;
+		}
+	}
+
+	if (level < 0)
+		return false;
+
+	/* plus a share of the leftover blocks, by relative data rate */
+	for (int i = 0; i < ps->num_allocs; i++) {
+		uint32_t extra = 0;
+
+		if (total_rate)
+			extra = min_t(uint64_t, alloc_size,
+				      DIV_ROUND_UP((uint64_t)alloc_size * rates[i],
+						   total_rate));
+
+		total[i] = ps->allocs[i].wm[level].min_ddb_alloc + extra;
+		alloc_size -= extra;
+		total_rate -= rates[i];
+	}
+
+	start = ps->start;
+	for (int i = 0; i < ps->num_allocs; i++) {
+		ps->allocs[i].start = start;
+		start += total[i];
+		ps->allocs[i].end = start;
+		ps->allocs[i].max_level = max_level(&ps->allocs[i], total[i]);
+	}
+
+	return true;
+}
+
+/* Memory bandwidth of the planes of @pipe, in MB/s */
+static uint32_t pipe_bw(const struct intel_wm_sim_pipe *pipe)
+{
+	const struct intel_wm_sim_mode *mode = pipe->mode;
+	uint64_t bw;
+
+	/* the cursor */
+	bw = (uint64_t)mode->clock * 256 * 4 / mode->hdisplay;
+
+	for (int i = 0; i < pipe->num_planes; i++) {
+		const struct intel_wm_sim_plane *plane = &pipe->planes[i];
+		uint64_t bytes = (uint64_t)plane->width * plane->height *
+				 format_cpp(plane->format, 0);
+
+		if (format_is_planar(plane->format))
+			bytes += (uint64_t)(plane->width / 2) *
+				 (plane->height / 2) *
+				 format_cpp(plane->format, 1);
+
+		/* the plane is fetched within the active area */
+		bw += (uint64_t)mode->clock * bytes /
+		      ((uint64_t)mode->hdisplay * mode->vdisplay);
+	}
+
+	return DIV_ROUND_UP(bw, 1000);
+}
+
+/**
+ * intel_wm_sim_compute:
+ * @platform: platform to simulate
+ * @config: display configuration
+ * @state: optional return location for the DDB allocations and watermarks
+ * @result: return location for the outcome
+ *
+ * Simulates the DDB allocation and watermarks of @config on @platform.
+ *
+ * Returns: The status of @config, also stored in @result.
+ */
+enum intel_wm_sim_status
+intel_wm_sim_compute(const struct intel_wm_sim_platform *platform,
+		     const struct intel_wm_sim_config *config,
+		     struct intel_wm_sim_state *state,
+		     struct intel_wm_sim_result *result)
+{
+	struct intel_wm_sim_state local;
+	unsigned int active_pipes = 0;
+	int num_active;
+
+	if (!state)
+		state = &local;
+	memset(state, 0, sizeof(*state));
+
+	result->status = INTEL_WM_SIM_OK;
+	result->level = INTEL_WM_SIM_MAX_LEVELS - 1;
+	result->bw = 0;
+
+	for (int pipe = 0; pipe < INTEL_WM_SIM_MAX_PIPES; pipe++) {
+		if (!config->pipes[pipe].mode)
+			continue;
+
+		if (pipe >= platform->num_pipes) {
+			result->status = INTEL_WM_SIM_UNSUPPORTED;
+			result->level = -1;
+			return result->status;
+		}
+
+		active_pipes |= 1 << pipe;
+		result->bw += pipe_bw(&config->pipes[pipe]);
+	}
+	num_active = __builtin_popcount(active_pipes);
+
+	allocate_pipe_ddb(platform, config, active_pipes, state);
+
+	for (int pipe = 0; pipe < platform->num_pipes; pipe++) {
+		struct intel_wm_sim_pipe_state *ps = &state->pipes[pipe];
+		const struct intel_wm_sim_pipe *p = &config->pipes[pipe];
+		uint64_t rates[INTEL_WM_SIM_MAX_ALLOCS];
+
+		if (!(active_pipes & (1 << pipe)))
+			continue;
+
+		if (!pipe_allocs(platform, p, pipe, ps, rates)) {
+			result->status = INTEL_WM_SIM_UNSUPPORTED;
+			result->level = -1;
+			return result->status;
+		}
+
+		if (!allocate_plane_ddb(platform, p, num_active, rates, ps)) {
+			result->status = INTEL_WM_SIM_DDB;
+			result->level = -1;
+			continue;
+		}
+
+		for (int i = 0; i <= ps->num_allocs; i++)
+			result->level = min_t(int, result->level,
+					      ps->allocs[i].max_level);
+	}
+
+	/* level 0 of every plane has to fit */
+	if (result->status == INTEL_WM_SIM_OK && result->level < 0)
+		result->status = INTEL_WM_SIM_DDB;
+
+	if (result->status == INTEL_WM_SIM_OK && result->bw > platform->max_bw)
+		result->status = INTEL_WM_SIM_BW;
+
+	return result->status;
+}
+
+static int space_max_planes(const struct intel_wm_sim_platform *platform,
+			    const struct intel_wm_sim_space *space)
+{
+	if (space->max_planes <= 0 || space->max_planes > platform->num_planes)
+		return platform->num_planes;
+
+	return space->max_planes;
+}
+
+static uint64_t ipow(uint64_t base, int exp)
+{
+	uint64_t v = 1;
+
+	while (exp--)
+		v *= base;
+
+	return v;
+}
+
+/* Number of configurations of the pipes, for a format and modifier */
+static uint64_t pipes_size(const struct intel_wm_sim_platform *platform,
+			   const struct intel_wm_sim_space *space)
+{
+	uint64_t choices = space->num_modes * space_max_planes(platform, space);
+	uint64_t size = 0;
+
+	for (unsigned int mask = 1; mask < 1 << platform->num_pipes; mask++)
+		size += ipow(choices, __builtin_popcount(mask));
+
+	return size;
+}
+
+/**
+ * intel_wm_sim_space_size:
+ * @platform: platform to simulate
+ * @space: configurations to enumerate
+ *
+ * Returns: The number of configurations in @space.
+ */
+uint64_t intel_wm_sim_space_size(const struct intel_wm_sim_platform *platform,
+				 const struct intel_wm_sim_space *space)
+{
+	return pipes_size(platform, space) * space->num_formats *
+	       space->num_modifiers;
+}
+
+/**
+ * intel_wm_sim_space_get:
+ * @platform: platform to simulate
+ * @space: configurations to enumerate
+ * @n: index of the configuration, below intel_wm_sim_space_size()
+ * @config: return location for the configuration
+ *
+ * Configurations are ordered by format, then modifier, then set of active
+ * pipes, then the mode and number of planes of each pipe, from pipe A.
+ */
+void intel_wm_sim_space_get(const struct intel_wm_sim_platform *platform,
+			    const struct intel_wm_sim_space *space,
+			    uint64_t n, struct intel_wm_sim_config *config)
+{
+	uint64_t choices = space->num_modes * space_max_planes(platform, space);
+	uint64_t size = pipes_size(platform, space);
+	uint64_t fmt_mod = n / size;
+	uint32_t format = space->formats[fmt_mod / space->num_modifiers];
+	uint64_t modifier = space->modifiers[fmt_mod % space->num_modifiers];
+	unsigned int mask;
+
+	memset(config, 0, sizeof(*config));
+
+	n %= size;
+	for (mask = 1; mask < 1 << platform->num_pipes; mask++) {
+		size = ipow(choices, __builtin_popcount(mask));
+		if (n < size)
+			break;
+
+		n -= size;
+	}
+
+	for (int pipe = 0; pipe < platform->num_pipes; pipe++) {
+		struct intel_wm_sim_pipe *p = &config->pipes[pipe];
+		int choice;
+
+		if (!(mask & (1 << pipe)))
+			continue;
+
+		choice = n % choices;
+		n /= choices;
+
+		p->mode = &space->modes[choice % space->num_modes];
+		p->num_planes = choice / space->num_modes + 1;
+		for (int i = 0; i < p->num_planes; i++) {
+			p->planes[i].format = format;
+			p->planes[i].modifier = modifier;
+			p->planes[i].width = p->mode->hdisplay;
+			p->planes[i].height = p->mode->vdisplay;
+		}
+	}
+}
+
+struct sim_thread {
+	pthread_t thread;
+	const struct intel_wm_sim_platform *platform;
+	const struct intel_wm_sim_space *space;
+	struct intel_wm_sim_result *results;
+	uint64_t first, stride, size;
+};
+
+static void *sim_thread(void *data)
+{
+	struct sim_thread *t = data;
+	struct intel_wm_sim_config config;
+
+	for (uint64_t n = t->first; n < t->size; n += t->stride) {
+		intel_wm_sim_space_get(t->platform, t->space, n, &config);
+		intel_wm_sim_compute(t->platform, &config, NULL,
+				     &t->results[n]);
+	}
+
+	return NULL;
+}
+
+/**
+ * intel_wm_sim_run:
+ * @platform: platform to simulate
+ * @space: configurations to enumerate
+ * @num_threads: number of threads, or 0 for one per CPU
+ * @results: return location for the intel_wm_sim_space_size() results
+ *
+ * Simulates every configuration of @space. The result of configuration n,
+ * as returned by intel_wm_sim_space_get(), is stored in @results[n].
+ *
+ * Returns: 0 on success, or -ENOMEM.
+ */
+int intel_wm_sim_run(const struct intel_wm_sim_platform *platform,
+		     const struct intel_wm_sim_space *space,
+		     int num_threads, struct intel_wm_sim_result *results)
+{
+	uint64_t size = intel_wm_sim_space_size(platform, space);
+	struct sim_thread *threads;
+	int started;
+
+	if (num_threads <= 0)
+		num_threads = max_t(long, sysconf(_SC_NPROCESSORS_ONLN), 1);
+
+	threads = calloc(num_threads, sizeof(*threads));
+	if (!threads)
+		return -ENOMEM;
+
+	for (int i = 0; i < num_threads; i++) {
+		threads[i].platform = platform;
+		threads[i].space = space;
+		threads[i].results = results;
+		threads[i].first = i;
+		threads[i].stride = num_threads;
+		threads[i].size = size;
+	}
+
+	for (started = 0; started < num_threads; started++)
+		if (pthread_create(&threads[started].thread, NULL, sim_thread,
+				   &threads[started]))
+			break;
+
+	/* do the share of the threads that couldn't be created */
+	for (int i = started; i < num_threads; i++)
+		sim_thread(&threads[i]);
+
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	free(threads);
+
+	return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef INTEL_WM_SIM_H
+#define INTEL_WM_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define INTEL_WM_SIM_MAX_PIPES		4
+#define INTEL_WM_SIM_MAX_PLANES		7
+#define INTEL_WM_SIM_MAX_LEVELS		8
+/* hw planes of a pipe, with the uv planes of planar formats before gen11 */
+#define INTEL_WM_SIM_MAX_ALLOCS		(2 * INTEL_WM_SIM_MAX_PLANES)
+
+/**
+ * intel_wm_sim_platform:
+ * @name: short platform name
+ * @display_ver: display version
+ * @num_pipes: number of pipes
+ * @num_planes: universal planes per pipe, not counting the cursor
+ * @num_slices: number of DBuf slices
+ * @slice_size: DDB blocks per DBuf slice
+ * @latency: memory latency of each watermark level, in us, as read from
+ * pcode; a zero latency disables the level, and the levels above it
+ * @max_bw: memory bandwidth available to the display engine, in MB/s
+ * @no_planar: planar formats are disabled (Display WA #0870)
+ *
+ * The latencies and bandwidths of the built-in platforms are typical
+ * values, the ones of a given machine can be read from
+ * i915_display_info/i915_pri_wm_latency in debugfs.
+ */
+struct intel_wm_sim_platform {
+	const char *name;
+	int display_ver;
+	int num_pipes;
+	int num_planes;
+	int num_slices;
+	int slice_size;
+	uint16_t latency[INTEL_WM_SIM_MAX_LEVELS];
+	unsigned int max_bw;
+	bool no_planar;
+};
+
+/**
+ * intel_wm_sim_mode:
+ * @name: name used in reports
+ * @clock: pixel clock, in kHz
+ * @hdisplay: active width
+ * @vdisplay: active height
+ * @htotal: total width
+ */
+struct intel_wm_sim_mode {
+	const char *name;
+	int clock;
+	uint16_t hdisplay, vdisplay;
+	uint16_t htotal;
+};
+
+/**
+ * intel_wm_sim_plane:
+ * @format: DRM fourcc format
+ * @modifier: DRM format modifier
+ * @width: source width
+ * @height: source height
+ */
+struct intel_wm_sim_plane {
+	uint32_t format;
+	uint64_t modifier;
+	uint16_t width, height;
+};
+
+/**
+ * intel_wm_sim_pipe:
+ * @mode: mode of the pipe, or NULL if the pipe is off
+ * @num_planes: number of enabled universal planes
+ * @planes: the enabled universal planes, the cursor is always on
+ */
+struct intel_wm_sim_pipe {
+	const struct intel_wm_sim_mode *mode;
+	int num_planes;
+	struct intel_wm_sim_plane planes[INTEL_WM_SIM_MAX_PLANES];
+};
+
+struct intel_wm_sim_config {
+	struct intel_wm_sim_pipe pipes[INTEL_WM_SIM_MAX_PIPES];
+};
+
+/**
+ * intel_wm_sim_level:
+ * @blocks: watermark blocks
+ * @lines: watermark lines
+ * @min_ddb_alloc: DDB blocks the level needs, 0xffff if it can't be enabled
+ */
+struct intel_wm_sim_level {
+	uint16_t blocks;
+	uint8_t lines;
+	uint16_t min_ddb_alloc;
+};
+
+/**
+ * intel_wm_sim_alloc:
+ * @plane: index of the universal plane this allocation feeds, -1 for the
+ * cursor
+ * @uv: the allocation is for the uv plane of a planar format
+ * @start: first DDB block
+ * @end: last DDB block, exclusive
+ * @max_level: highest enabled watermark level, -1 if none
+ * @wm: watermark levels
+ */
+struct intel_wm_sim_alloc {
+	int8_t plane;
+	bool uv;
+	uint16_t start, end;
+	int8_t max_level;
+	struct intel_wm_sim_level wm[INTEL_WM_SIM_MAX_LEVELS];
+};
+
+enum intel_wm_sim_status {
+	INTEL_WM_SIM_OK,
+	/* a plane or format the hardware doesn't have */
+	INTEL_WM_SIM_UNSUPPORTED,
+	/* level 0 watermarks don't fit in the DDB of a pipe */
+	INTEL_WM_SIM_DDB,
+	/* the planes fetch more than the memory bandwidth */
+	INTEL_WM_SIM_BW,
+};
+
+/**
+ * intel_wm_sim_result:
+ * @status: #intel_wm_sim_status
+ * @level: highest watermark level enabled on every plane, -1 if the
+ * allocation failed
+ * @bw: memory bandwidth used by the planes, in MB/s
+ */
+struct intel_wm_sim_result {
+	uint8_t status;
+	int8_t level;
+	uint32_t bw;
+};
+
+/**
+ * intel_wm_sim_pipe_state:
+ * @slices: mask of the DBuf slices the pipe draws from
+ * @start: first DDB block of the pipe
+ * @end: last DDB block of the pipe, exclusive
+ * @num_allocs: number of entries in @allocs, the cursor is last
+ * @allocs: DDB allocations and watermarks
+ */
+struct intel_wm_sim_pipe_state {
+	uint8_t slices;
+	uint16_t start, end;
+	int num_allocs;
+	struct intel_wm_sim_alloc allocs[INTEL_WM_SIM_MAX_ALLOCS + 1];
+};
+
+struct intel_wm_sim_state {
+	struct intel_wm_sim_pipe_state pipes[INTEL_WM_SIM_MAX_PIPES];
+};
+
+/**
+ * intel_wm_sim_space:
+ * @modes: modes each active pipe can take
+ * @num_modes: number of entries in @modes
+ * @formats: formats of the planes
+ * @num_formats: number of entries in @formats
+ * @modifiers: modifiers of the planes
+ * @num_modifiers: number of entries in @modifiers
+ * @max_planes: maximum number of universal planes per pipe, capped by the
+ * platform
+ *
+ * The configurations to enumerate: every set of active pipes, each with
+ * any of @modes and from 1 to @max_planes full screen planes. All the
+ * planes of a configuration share one of @formats and @modifiers.
+ *
+ * Mixing formats or modifiers between planes or pipes, and planes smaller
+ * than the mode, are not enumerated as they would multiply the size of the
+ * space by the number of choices per plane. Describe such configurations
+ * with #intel_wm_sim_config and pass them to intel_wm_sim_compute() instead.
+ */
+struct intel_wm_sim_space {
+	const struct intel_wm_sim_mode *modes;
+	int num_modes;
+	const uint32_t *formats;
+	int num_formats;
+	const uint64_t *modifiers;
+	int num_modifiers;
+	int max_planes;
+};
+
+extern const struct intel_wm_sim_platform intel_wm_sim_platforms[];
+extern const int intel_wm_sim_num_platforms;
+
+const struct intel_wm_sim_platform *intel_wm_sim_find_platform(const char *name);
+
+enum intel_wm_sim_status
+intel_wm_sim_compute(const struct intel_wm_sim_platform *platform,
+		     const struct intel_wm_sim_config *config,
+		     struct intel_wm_sim_state *state,
+		     struct intel_wm_sim_result *result);
+
+uint64_t intel_wm_sim_space_size(const struct intel_wm_sim_platform *platform,
+				 const struct intel_wm_sim_space *space);
+void intel_wm_sim_space_get(const struct intel_wm_sim_platform *platform,
+			    const struct intel_wm_sim_space *space,
+			    uint64_t n, struct intel_wm_sim_config *config);
+int intel_wm_sim_run(const struct intel_wm_sim_platform *platform,
+		     const struct intel_wm_sim_space *space,
+		     int num_threads, struct intel_wm_sim_result *results);
+
+#endif /* INTEL_WM_SIM_H */
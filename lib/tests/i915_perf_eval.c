@@ -0,0 +1,153 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+
+#include "i915_drm.h"
+#include "i915/perf.h"
+#include "i915/perf_eval.h"
+
+#define N_ACCUMULATORS 200
+
+static struct drm_i915_query_topology_info *
+fake_topology(void)
+{
+	struct drm_i915_query_topology_info *topo =
+		calloc(1, sizeof(*topo) + 16);
+
+	/* 1 slice, 6 subslices of 8 EUs */
+	topo->max_slices = 1;
+	topo->max_subslices = 6;
+	topo->max_eus_per_subslice = 8;
+	topo->subslice_offset = 1;
+	topo->subslice_stride = 1;
+	topo->eu_offset = 2;
+	topo->eu_stride = 1;
+	topo->data[0] = 0x1;
+	topo->data[1] = 0x3f;
+	memset(&topo->data[2], 0xff, 6);
+
+	return topo;
+}
+
+static void
+check_metric_set(struct intel_perf *perf,
+		 const struct intel_perf_metric_set *metric_set,
+		 const struct intel_perf_accumulator *accumulators)
+{
+	struct intel_perf_eval_program *program;
+	union intel_perf_eval_value **values;
+
+	program = intel_perf_eval_program_new(perf, metric_set, NULL, 0);
+	igt_assert_f(program, "Failed to compile %s\n", metric_set->symbol_name);
+
+	values = calloc(metric_set->n_counters, sizeof(*values));
+	for (uint32_t c = 0; c < metric_set->n_counters; c++)
+		values[c] = calloc(N_ACCUMULATORS, sizeof(*values[c]));
+
+	intel_perf_eval_program_run(program, accumulators, N_ACCUMULATORS, values);
+
+	for (uint32_t c = 0; c < metric_set->n_counters; c++) {
+		const struct intel_perf_logical_counter *counter =
+			&metric_set->counters[c];
+
+		for (uint32_t i = 0; i < N_ACCUMULATORS; i++) {
+			uint64_t *deltas = (uint64_t *) accumulators[i].deltas;
+
+			switch (counter->storage) {
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT64:
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT32:
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_BOOL32:
+				igt_assert_f(values[c][i].u64 ==
+					     counter->read_uint64(perf, metric_set, deltas),
+					     "%s/%s differs\n",
+					     metric_set->symbol_name, counter->symbol_name);
+				break;
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE:
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT:
+				igt_assert_f(values[c][i].f ==
+					     counter->read_float(perf, metric_set, deltas),
+					     "%s/%s differs\n",
+					     metric_set->symbol_name, counter->symbol_name);
+				break;
+			}
+		}
+
+		free(values[c]);
+	}
+
+	free(values);
+	intel_perf_eval_program_free(program);
+}
+
+igt_main
+{
+	static const struct {
+		const char *name;
+		uint32_t devid;
+	} platforms[] = {
+		{ "hsw", 0x0412 },
+		{ "skl", 0x1916 },
+		{ "icl", 0x8a52 },
+		{ "tgl", 0x9a49 },
+	};
+	struct drm_i915_query_topology_info *topology = fake_topology();
+	struct intel_perf_accumulator *accumulators;
+
+	accumulators = calloc(N_ACCUMULATORS, sizeof(*accumulators));
+	srand(0xc0ffee);
+	for (uint32_t i = 0; i < N_ACCUMULATORS; i++) {
+		/* Include empty deltas to go through the divisions by 0. */
+		if (i % 16 == 0)
+			continue;
+
+		for (uint32_t j = 0; j < INTEL_PERF_MAX_RAW_OA_COUNTERS; j++)
+			accumulators[i].deltas[j] = rand() % (j & 1 ? 1000 : 100000000);
+	}
+
+	for (int p = 0; p < ARRAY_SIZE(platforms); p++) {
+		igt_subtest_f("compare-read-callbacks-%s", platforms[p].name) {
+			struct intel_perf *perf =
+				intel_perf_for_devinfo(platforms[p].devid, 0,
+						       12000000, 300, 1000,
+						       topology);
+			struct intel_perf_metric_set *metric_set;
+
+			igt_assert(perf);
+
+			intel_perf_load_metric_sets(perf);
+			igt_list_for_each_entry(metric_set, &perf->metric_sets, link)
+				check_metric_set(perf, metric_set, accumulators);
+
+			intel_perf_free(perf);
+		}
+	}
+
+	free(accumulators);
+	free(topology);
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+
+#include "i915/perf.h"
+#include "i915/perf_data_reader.h"
+#include "i915/perf_synth.h"
+
+static int
+temp_file(void)
+{
+	char path[] = "/tmp/i915-perf-synth-XXXXXX";
+	int fd = mkstemp(path);
+
+	igt_assert(fd >= 0);
+	unlink(path);
+
+	return fd;
+}
+
+static void
+check_reports(const struct intel_perf_synth_params *params,
+	      const struct intel_perf_data_reader *reader)
+{
+	const struct intel_perf_metric_set *metric_set = reader->metric_set;
+	/* A, B & C counters are laid out in order in the accumulator. */
+	uint32_t n_counters = metric_set->perf_oa_format == I915_OA_FORMAT_A45_B8_C8 ? 61 : 52;
+
+	for (uint32_t r = 1; r < reader->n_records; r++) {
+		struct intel_perf_accumulator acc;
+
+		intel_perf_accumulate_reports(&acc, metric_set->perf_oa_format,
+					      reader->records[r - 1],
+					      reader->records[r]);
+
+		igt_assert_eq_u64(acc.deltas[metric_set->gpu_time_offset],
+				  params->sample_period);
+		for (uint32_t c = 0; c < n_counters; c++)
+			igt_assert_eq_u64(acc.deltas[metric_set->a_offset + c],
+					  (c + 1) * params->counter_growth);
+	}
+}
+
+static void
+check_timelines(const struct intel_perf_synth_params *params,
+		const struct intel_perf_data_reader *reader,
+		bool has_ctx_id)
+{
+	uint32_t n_switches = (params->n_samples - 1) / params->context_switch_period;
+
+	if (!has_ctx_id) {
+		igt_assert_eq(reader->n_timelines, 1);
+		return;
+	}
+
+	igt_assert_eq(reader->n_timelines, n_switches + 1);
+	for (uint32_t t = 0; t < reader->n_timelines; t++) {
+		const struct intel_perf_timeline_item *item = &reader->timelines[t];
+
+		igt_assert_eq(item->hw_id, 0x100 + t % params->n_contexts);
+		igt_assert_eq(item->record_start, t * params->context_switch_period);
+		igt_assert_lte(item->cpu_ts_start, item->cpu_ts_end);
+	}
+
+	/* The recording starts 1s into CLOCK_MONOTONIC. */
+	igt_assert_eq_u64(reader->timelines[0].cpu_ts_start, 1000000000ull);
+}
+
+static void
+check_lazy_reader(int fd, const struct intel_perf_data_reader *eager)
+{
+	struct intel_perf_data_reader reader;
+
+	igt_assert(intel_perf_data_reader_open(&reader, fd));
+	igt_assert(intel_perf_data_reader_load_window(&reader, 0,
+						      intel_perf_data_reader_duration(&reader)));
+
+	igt_assert_eq(reader.n_records, eager->n_records);
+	igt_assert_eq(reader.n_timelines, eager->n_timelines);
+	for (uint32_t t = 0; t < eager->n_timelines; t++) {
+		const struct intel_perf_timeline_item *a = &reader.timelines[t];
+		const struct intel_perf_timeline_item *b = &eager->timelines[t];
+
+		igt_assert_eq_u64(a->ts_start, b->ts_start);
+		igt_assert_eq_u64(a->ts_end, b->ts_end);
+		igt_assert_eq_u64(a->cpu_ts_start, b->cpu_ts_start);
+		igt_assert_eq_u64(a->cpu_ts_end, b->cpu_ts_end);
+		igt_assert_eq_u32(a->record_start, b->record_start);
+		igt_assert_eq_u32(a->record_end, b->record_end);
+		igt_assert_eq_u32(a->hw_id, b->hw_id);
+	}
+
+	intel_perf_data_reader_fini(&reader);
+}
+
+igt_main
+{
+	static const struct {
+		const char *name;
+		uint32_t devid;
+		bool has_ctx_id;
+	} platforms[] = {
+		{ "hsw", 0x0412, false }, /* A45_B8_C8 */
+		{ "skl", 0x1916, true }, /* A32u40_A4u32_B8_C8 */
+		{ "tgl", 0x9a49, true },
+	};
+
+	for (int p = 0; p < ARRAY_SIZE(platforms); p++) {
+		igt_subtest_f("read-back-%s", platforms[p].name) {
+			struct intel_perf_synth_params params;
+			struct intel_perf_data_reader reader;
+			int fd;
+
+			intel_perf_synth_default_params(&params);
+			params.device_id = platforms[p].devid;
+			params.n_samples = 10010;
+			params.noise = 0;
+			/* Have all counters wrap a few times. */
+			params.counter_headroom = 64 * params.counter_growth;
+
+			fd = temp_file();
+			igt_assert(intel_perf_synth_write(fd, &params));
+
+			igt_assert(intel_perf_data_reader_init(&reader, fd));
+			igt_assert_eq(reader.n_records, params.n_samples);
+			igt_assert(strcmp(reader.metric_set_name, params.metric_set) == 0);
+
+			check_reports(&params, &reader);
+			check_timelines(&params, &reader, platforms[p].has_ctx_id);
+			check_lazy_reader(fd, &reader);
+
+			intel_perf_data_reader_fini(&reader);
+			close(fd);
+		}
+	}
+
+	igt_subtest("invalid-params") {
+		struct intel_perf_synth_params params;
+		int fd = temp_file();
+
+		intel_perf_synth_default_params(&params);
+		params.metric_set = "NotAMetricSet";
+		igt_assert(!intel_perf_synth_write(fd, &params));
+		igt_assert_eq(errno, EINVAL);
+
+		intel_perf_synth_default_params(&params);
+		params.device_id = 0xffff;
+		igt_assert(!intel_perf_synth_write(fd, &params));
+		igt_assert_eq(errno, EINVAL);
+
+		close(fd);
+	}
+}
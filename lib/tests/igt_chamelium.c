@@ -0,0 +1,568 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "config.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cairo.h>
+#include <glib.h>
+#include <xmlrpc-c/base.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_chamelium.h"
+#include "igt_rc.h"
+
+#define STAND_IN_PORTS 5 /* the last one doesn't support video */
+#define STAND_IN_FRAME_WIDTH 64
+#define STAND_IN_FRAME_HEIGHT 48
+
+/* State of the stand-in Chamelium, shared by all of its processes */
+struct stand_in {
+	int connections;
+	int requests;
+	int multicalls;
+
+	bool multicall;
+	bool plug_busy;
+	int i2c_failures;
+	bool plugged[STAND_IN_PORTS + 1];
+};
+
+static struct stand_in *stand_in;
+
+/* The hash as the Chamelium describes it, one pass per lane. */
+static uint32_t reference_hash16(const unsigned char *buffer, int width,
+				 int height, int k, int m)
+{
+	uint64_t sum = 0;
+	uint64_t count = 0;
+	uint64_t value;
+
+	for (int i = 0; i < width * height; i++) {
+		if ((i % m) != k)
+			continue;
+
+		value = buffer[i * 4 + 2] | (buffer[i * 4 + 1] << 8) |
+			(buffer[i * 4 + 0] << 16);
+		sum += ++count * value;
+	}
+
+	return ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+}
+
+static cairo_surface_t *create_surface(int width, int height, bool noise)
+{
+	cairo_surface_t *surface =
+		cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+	unsigned char *data = cairo_image_surface_get_data(surface);
+
+	for (int i = 0; i < width * height * 4; i++)
+		data[i] = noise ? rand() : 0xff - i % 3;
+	cairo_surface_mark_dirty(surface);
+
+	return surface;
+}
+
+static void check_surface_crc(cairo_surface_t *surface)
+{
+	const unsigned char *data = cairo_image_surface_get_data(surface);
+	int width = cairo_image_surface_get_width(surface);
+	int height = cairo_image_surface_get_height(surface);
+	igt_crc_t *crc = chamelium_calculate_surface_crc(surface);
+
+	igt_assert_eq(crc->n_words, 4);
+	for (int i = 0; i < 4; i++)
+		igt_assert_eq(crc->crc[i],
+			      reference_hash16(data, width, height, 4 - i - 1, 4));
+
+	free(crc);
+}
+
+static void *crc_thread(void *data)
+{
+	for (int i = 0; i < 4; i++)
+		check_surface_crc(data);
+
+	return NULL;
+}
+
+static xmlrpc_value *stand_in_call(xmlrpc_env *env, const char *method,
+				   xmlrpc_value *params);
+
+static xmlrpc_value *stand_in_multicall(xmlrpc_env *env, xmlrpc_value *params)
+{
+	xmlrpc_value *calls, *call, *call_params, *res, *ret;
+	const char *method;
+
+	__atomic_fetch_add(&stand_in->multicalls, 1, __ATOMIC_SEQ_CST);
+
+	xmlrpc_decompose_value(env, params, "(A)", &calls);
+	if (env->fault_occurred)
+		return NULL;
+
+	ret = xmlrpc_array_new(env);
+	for (int i = 0; i < xmlrpc_array_size(env, calls); i++) {
+		xmlrpc_env call_env;
+
+		xmlrpc_array_read_item(env, calls, i, &call);
+		xmlrpc_decompose_value(env, call, "{s:s,s:A,*}",
+				       "methodName", &method,
+				       "params", &call_params);
+		xmlrpc_DECREF(call);
+		if (env->fault_occurred)
+			break;
+
+		/* fails the whole request */
+		if (stand_in->plug_busy && !strcmp(method, "Plug")) {
+			xmlrpc_env_set_fault(env, 1, "Server busy");
+			xmlrpc_DECREF(call_params);
+			free((void *)method);
+			break;
+		}
+
+		xmlrpc_env_init(&call_env);
+		res = stand_in_call(&call_env, method, call_params);
+		if (call_env.fault_occurred) {
+			call = xmlrpc_build_value(env, "{s:i,s:s}",
+						  "faultCode", call_env.fault_code,
+						  "faultString", call_env.fault_string);
+		} else {
+			call = xmlrpc_build_value(env, "(V)", res);
+			xmlrpc_DECREF(res);
+		}
+		xmlrpc_array_append_item(env, ret, call);
+		xmlrpc_DECREF(call);
+
+		xmlrpc_env_clean(&call_env);
+		xmlrpc_DECREF(call_params);
+		free((void *)method);
+	}
+	xmlrpc_DECREF(calls);
+
+	if (env->fault_occurred) {
+		xmlrpc_DECREF(ret);
+		return NULL;
+	}
+
+	return ret;
+}
+
+static xmlrpc_value *stand_in_call(xmlrpc_env *env, const char *method,
+				   xmlrpc_value *params)
+{
+	int port = 0;
+
+	if (!strcmp(method, "system.multicall")) {
+		if (stand_in->multicall)
+			return stand_in_multicall(env, params);
+
+		xmlrpc_env_set_fault_formatted(env, XMLRPC_NO_SUCH_METHOD_ERROR,
+					       "Unknown method %s", method);
+		return NULL;
+	}
+
+	if (!strcmp(method, "Reset")) {
+		memset(stand_in->plugged, 0, sizeof(stand_in->plugged));
+		return xmlrpc_nil_new(env);
+	}
+
+	if (!strcmp(method, "GetSupportedInputs")) {
+		xmlrpc_value *ports = xmlrpc_array_new(env);
+
+		for (port = 1; port <= STAND_IN_PORTS; port++) {
+			xmlrpc_value *id = xmlrpc_int_new(env, port);
+
+			xmlrpc_array_append_item(env, ports, id);
+			xmlrpc_DECREF(id);
+		}
+
+		return ports;
+	}
+
+	if (!strcmp(method, "GetCapturedResolution"))
+		return xmlrpc_build_value(env, "(ii)", STAND_IN_FRAME_WIDTH,
+					  STAND_IN_FRAME_HEIGHT);
+
+	/* Takes a frame index, not a port */
+	if (!strcmp(method, "ReadCapturedFrame")) {
+		size_t size = STAND_IN_FRAME_WIDTH * STAND_IN_FRAME_HEIGHT * 3;
+		unsigned char *frame;
+		xmlrpc_value *ret;
+		int index;
+
+		xmlrpc_decompose_value(env, params, "(i)", &index);
+		if (env->fault_occurred)
+			return NULL;
+
+		frame = malloc(size);
+		for (size_t i = 0; i < size; i++)
+			frame[i] = index + i;
+		ret = xmlrpc_base64_new(env, size, frame);
+		free(frame);
+
+		return ret;
+	}
+
+	xmlrpc_decompose_value(env, params, "(i)", &port);
+	if (env->fault_occurred)
+		return NULL;
+
+	if (port < 1 || port > STAND_IN_PORTS) {
+		xmlrpc_env_set_fault_formatted(env, 1, "Invalid port %d", port);
+		return NULL;
+	}
+
+	if (!strcmp(method, "HasVideoSupport"))
+		return xmlrpc_bool_new(env, port != STAND_IN_PORTS);
+
+	if (!strcmp(method, "Plug")) {
+		if (__atomic_fetch_sub(&stand_in->i2c_failures, 1,
+				       __ATOMIC_SEQ_CST) > 0) {
+			xmlrpc_env_set_fault(env, 1, "I2C transfer failed");
+			return NULL;
+		}
+
+		stand_in->plugged[port] = true;
+		return xmlrpc_nil_new(env);
+	}
+
+	xmlrpc_env_set_fault_formatted(env, XMLRPC_NO_SUCH_METHOD_ERROR,
+				       "Unknown method %s", method);
+	return NULL;
+}
+
+/* Reads one HTTP request, returns its body or NULL at the end of the stream. */
+static char *stand_in_read_request(int fd, size_t *len)
+{
+	char header[4096];
+	size_t n = 0;
+	char *body, *value;
+
+	/* Read the header byte by byte, not to eat into the body. */
+	while (n < 4 || memcmp(&header[n - 4], "\r\n\r\n", 4)) {
+		igt_assert(n < sizeof(header) - 1);
+		if (read(fd, &header[n], 1) != 1)
+			return NULL;
+		n++;
+	}
+	header[n] = '\0';
+
+	value = strcasestr(header, "\r\nContent-Length:");
+	igt_assert(value);
+	*len = strtoul(value + strlen("\r\nContent-Length:"), NULL, 10);
+
+	if (strcasestr(header, "\r\nExpect: 100-continue")) {
+		static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+		igt_assert(write(fd, cont, strlen(cont)) == strlen(cont));
+	}
+
+	body = malloc(*len);
+	for (n = 0; n < *len; ) {
+		ssize_t ret = read(fd, body + n, *len - n);
+
+		igt_assert(ret > 0);
+		n += ret;
+	}
+
+	return body;
+}
+
+static void stand_in_serve(int fd)
+{
+	xmlrpc_value *params, *res;
+	xmlrpc_mem_block *output;
+	const char *method;
+	char header[128];
+	char *body;
+	size_t len;
+	xmlrpc_env env, fault;
+
+	xmlrpc_env_init(&env);
+
+	while ((body = stand_in_read_request(fd, &len))) {
+		__atomic_fetch_add(&stand_in->requests, 1, __ATOMIC_SEQ_CST);
+
+		xmlrpc_env_init(&fault);
+		xmlrpc_parse_call(&env, body, len, &method, &params);
+		igt_assert(!env.fault_occurred);
+		res = stand_in_call(&fault, method, params);
+
+		output = xmlrpc_mem_block_new(&env, 0);
+		if (fault.fault_occurred)
+			xmlrpc_serialize_fault(&env, output, &fault);
+		else
+			xmlrpc_serialize_response(&env, output, res);
+		igt_assert(!env.fault_occurred);
+
+		/* Keep the connection open, like HTTP/1.1 does by default. */
+		len = snprintf(header, sizeof(header),
+			       "HTTP/1.1 200 OK\r\n"
+			       "Content-Type: text/xml\r\n"
+			       "Content-Length: %zu\r\n\r\n",
+			       xmlrpc_mem_block_size(output));
+		igt_assert(write(fd, header, len) == len);
+		igt_assert(write(fd, xmlrpc_mem_block_contents(output),
+				 xmlrpc_mem_block_size(output)) ==
+			   xmlrpc_mem_block_size(output));
+
+		xmlrpc_mem_block_free(output);
+		if (res)
+			xmlrpc_DECREF(res);
+		xmlrpc_DECREF(params);
+		free((void *)method);
+		xmlrpc_env_clean(&fault);
+		free(body);
+	}
+}
+
+/* Returns the port of a stand-in Chamelium XML-RPC server. */
+static int stand_in_start(struct igt_helper_process *proc)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t addr_len = sizeof(addr);
+	int fd;
+
+	stand_in = mmap(NULL, sizeof(*stand_in), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	igt_assert(stand_in != MAP_FAILED);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	igt_assert(fd >= 0);
+	igt_assert(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+	igt_assert(listen(fd, 8) == 0);
+	igt_assert(getsockname(fd, (struct sockaddr *) &addr, &addr_len) == 0);
+
+	igt_fork_helper(proc) {
+		int conn;
+
+		signal(SIGCHLD, SIG_IGN);
+		while ((conn = accept(fd, NULL, NULL)) >= 0) {
+			__atomic_fetch_add(&stand_in->connections, 1,
+					   __ATOMIC_SEQ_CST);
+			if (fork() == 0) {
+				close(fd);
+				stand_in_serve(conn);
+				_exit(0);
+			}
+			close(conn);
+		}
+	}
+	close(fd);
+
+	return ntohs(addr.sin_port);
+}
+
+/* Each subtest starts from a fresh stand-in, with no ports plugged. */
+static struct chamelium *stand_in_connect(int port)
+{
+	struct chamelium *chamelium;
+	char *url;
+
+	memset(stand_in, 0, sizeof(*stand_in));
+
+	if (!igt_key_file)
+		igt_key_file = g_key_file_new();
+	url = g_strdup_printf("http://127.0.0.1:%d/RPC2", port);
+	g_key_file_set_string(igt_key_file, "Chamelium", "URL", url);
+	g_free(url);
+
+	chamelium = chamelium_init_rpc_only();
+	igt_assert(chamelium);
+
+	return chamelium;
+}
+
+static void check_plugged(void)
+{
+	for (int port = 1; port <= STAND_IN_PORTS; port++)
+		igt_assert_eq(stand_in->plugged[port], port != STAND_IN_PORTS);
+}
+
+static int rpc_calls(struct chamelium *chamelium, const char *method)
+{
+	igt_stats_t *latency = chamelium_get_rpc_latency(chamelium, method);
+
+	return latency ? latency->n_values : 0;
+}
+
+igt_main
+{
+	static const struct {
+		int width, height;
+	} sizes[] = {
+		{ 1, 1 },
+		{ 3, 1 },
+		{ 7, 5 },
+		{ 640, 480 },
+		{ 1023, 767 },
+		{ 1920, 1080 },
+		{ 3840, 2160 },
+	};
+
+	srand(0xc0ffee);
+
+	for (int s = 0; s < ARRAY_SIZE(sizes); s++) {
+		igt_subtest_f("crc-%dx%d", sizes[s].width, sizes[s].height) {
+			for (int noise = 0; noise < 2; noise++) {
+				cairo_surface_t *surface =
+					create_surface(sizes[s].width,
+						       sizes[s].height, noise);
+
+				check_surface_crc(surface);
+				cairo_surface_destroy(surface);
+			}
+		}
+	}
+
+	igt_subtest("crc-concurrent") {
+		cairo_surface_t *surface = create_surface(1920, 1080, true);
+		pthread_t threads[4];
+
+		for (int i = 0; i < ARRAY_SIZE(threads); i++)
+			pthread_create(&threads[i], NULL, crc_thread, surface);
+		for (int i = 0; i < ARRAY_SIZE(threads); i++)
+			pthread_join(threads[i], NULL);
+
+		cairo_surface_destroy(surface);
+	}
+
+	igt_subtest_group {
+		struct igt_helper_process server = {};
+		struct chamelium *chamelium;
+		int port, requests;
+
+		igt_fixture
+			port = stand_in_start(&server);
+
+		igt_subtest("rpc-persistent-connection") {
+			chamelium = stand_in_connect(port);
+
+			for (int i = 0; i < 20; i++)
+				chamelium_reset(chamelium);
+
+			igt_assert_eq(stand_in->connections, 1);
+			igt_assert_eq(rpc_calls(chamelium, "Reset"), 20);
+
+			chamelium_deinit_rpc_only(chamelium);
+		}
+
+		igt_subtest("rpc-multicall") {
+			chamelium = stand_in_connect(port);
+			stand_in->multicall = true;
+			requests = stand_in->requests;
+
+			igt_assert(chamelium_plug_all(chamelium));
+
+			/* GetSupportedInputs, then HasVideoSupport and Plug batches */
+			check_plugged();
+			igt_assert_eq(stand_in->requests - requests, 3);
+			igt_assert_eq(rpc_calls(chamelium, "system.multicall"), 2);
+
+			chamelium_deinit_rpc_only(chamelium);
+		}
+
+		igt_subtest("rpc-multicall-fallback") {
+			chamelium = stand_in_connect(port);
+
+			igt_assert(chamelium_plug_all(chamelium));
+
+			/* Only one attempt at using system.multicall */
+			check_plugged();
+			igt_assert_eq(rpc_calls(chamelium, "system.multicall"), 1);
+			igt_assert_eq(rpc_calls(chamelium, "HasVideoSupport"),
+				      STAND_IN_PORTS);
+			igt_assert_eq(rpc_calls(chamelium, "Plug"),
+				      STAND_IN_PORTS - 1);
+
+			chamelium_deinit_rpc_only(chamelium);
+		}
+
+		igt_subtest("rpc-multicall-fault") {
+			chamelium = stand_in_connect(port);
+			stand_in->multicall = true;
+
+			igt_assert(chamelium_plug_all(chamelium));
+			stand_in->plug_busy = true;
+			memset(stand_in->plugged, 0, sizeof(stand_in->plugged));
+
+			/*
+			 * Any other fault than an unknown system.multicall
+			 * fails the batch, which isn't sent again call by
+			 * call, nor stops later batches.
+			 */
+			igt_assert(!chamelium_plug_all(chamelium));
+			igt_assert_eq(rpc_calls(chamelium, "Plug"), 0);
+			igt_assert_eq(rpc_calls(chamelium, "HasVideoSupport"), 0);
+
+			stand_in->plug_busy = false;
+			igt_assert(chamelium_plug_all(chamelium));
+			check_plugged();
+			igt_assert_eq(rpc_calls(chamelium, "Plug"), 0);
+
+			chamelium_deinit_rpc_only(chamelium);
+		}
+
+		igt_subtest("rpc-multicall-i2c-retry") {
+			chamelium = stand_in_connect(port);
+			stand_in->multicall = true;
+			stand_in->i2c_failures = 2;
+
+			igt_assert(chamelium_plug_all(chamelium));
+
+			check_plugged();
+			igt_assert_lte(stand_in->i2c_failures, 0);
+
+			chamelium_deinit_rpc_only(chamelium);
+		}
+
+		igt_subtest("rpc-async") {
+			chamelium = stand_in_connect(port);
+
+			for (int i = 0; i < 4; i++)
+				chamelium_destroy_frame_dump(chamelium_read_captured_frame(chamelium, i));
+
+			igt_assert_eq(rpc_calls(chamelium, "ReadCapturedFrame"), 4);
+			igt_assert_eq(rpc_calls(chamelium, "GetCapturedResolution"), 4);
+
+			chamelium_deinit_rpc_only(chamelium);
+		}
+
+		igt_fixture
+			igt_stop_helper(&server);
+	}
+}
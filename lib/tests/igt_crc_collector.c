@@ -0,0 +1,320 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_debugfs.h"
+#include "drmtest.h"
+
+/* Formats a CRC entry like the kernel does. */
+static int format_crc(char *buf, const igt_crc_t *crc)
+{
+	int len;
+
+	if (crc->has_valid_frame)
+		len = sprintf(buf, "0x%08x", crc->frame);
+	else
+		len = sprintf(buf, "XXXXXXXXXX");
+
+	for (int i = 0; i < crc->n_words; i++)
+		len += sprintf(buf + len, " 0x%08x", crc->crc[i]);
+
+	buf[len++] = '\n';
+
+	return len;
+}
+
+static void random_crc(igt_crc_t *crc, uint32_t frame)
+{
+	crc->frame = frame;
+	crc->has_valid_frame = true;
+	crc->n_words = rand() % DRM_MAX_CRC_NR + 1;
+	for (int i = 0; i < crc->n_words; i++)
+		crc->crc[i] = (uint32_t) rand() << 16 ^ rand();
+}
+
+static void write_crc(int fd, const igt_crc_t *crc)
+{
+	char buf[128];
+	int len = format_crc(buf, crc);
+
+	igt_assert_eq(write(fd, buf, len), len);
+}
+
+static void assert_crc_eq(const igt_crc_t *a, const igt_crc_t *b)
+{
+	igt_assert_eq(a->has_valid_frame, b->has_valid_frame);
+	if (a->has_valid_frame)
+		igt_assert_eq_u32(a->frame, b->frame);
+	igt_assert_eq(a->n_words, b->n_words);
+	igt_assert(!memcmp(a->crc, b->crc, a->n_words * sizeof(a->crc[0])));
+}
+
+static void make_pipe(int fds[2])
+{
+	igt_assert_eq(pipe(fds), 0);
+	igt_assert_eq(fcntl(fds[0], F_SETFL, O_NONBLOCK), 0);
+}
+
+#define N_CRCS 1000
+
+igt_main
+{
+	igt_crc_t crcs[N_CRCS], out[N_CRCS], crc;
+	igt_crc_collector_t *collector;
+	int fds[2];
+
+	igt_subtest("parse") {
+		static const char entries[] =
+			"0x0000002a 0xdeadbeef 0x00000000 0x12345678\n"
+			"XXXXXXXXXX 0x00000001\n"
+			"0x0000002B 0xABCDEF01\n"
+			"not a crc\n"
+			"0x2c 0x1 0x2\n"
+			"0x0000002d 0x0000000g\n";
+		int n;
+
+		collector = igt_crc_collector_new(16);
+		make_pipe(fds);
+		igt_crc_collector_add_fd(collector, fds[0]);
+		igt_assert_eq(write(fds[1], entries, strlen(entries)),
+			      strlen(entries));
+
+		/* The malformed entries are skipped */
+		igt_assert_eq(igt_crc_collector_poll(collector, 0), 4);
+		n = igt_crc_collector_get_crcs(collector, 0, 16, out);
+		igt_assert_eq(n, 4);
+
+		igt_assert(out[0].has_valid_frame);
+		igt_assert_eq_u32(out[0].frame, 0x2a);
+		igt_assert_eq(out[0].n_words, 3);
+		igt_assert_eq_u32(out[0].crc[0], 0xdeadbeef);
+		igt_assert_eq_u32(out[0].crc[1], 0);
+		igt_assert_eq_u32(out[0].crc[2], 0x12345678);
+
+		igt_assert(!out[1].has_valid_frame);
+		igt_assert_eq(out[1].n_words, 1);
+		igt_assert_eq_u32(out[1].crc[0], 1);
+
+		igt_assert_eq_u32(out[2].frame, 0x2b);
+		igt_assert_eq_u32(out[2].crc[0], 0xabcdef01);
+
+		/* Not laid out like the kernel does, but still valid */
+		igt_assert_eq_u32(out[3].frame, 0x2c);
+		igt_assert_eq(out[3].n_words, 2);
+		igt_assert_eq_u32(out[3].crc[1], 2);
+
+		close(fds[0]);
+		close(fds[1]);
+		igt_crc_collector_free(collector);
+	}
+
+	igt_subtest("batched") {
+		srand(1);
+		collector = igt_crc_collector_new(N_CRCS);
+		make_pipe(fds);
+		igt_crc_collector_add_fd(collector, fds[0]);
+
+		/* More than fits in one read */
+		for (int i = 0; i < N_CRCS; i++) {
+			random_crc(&crcs[i], i);
+			write_crc(fds[1], &crcs[i]);
+			if (i % 300 == 299)
+				igt_assert_eq(igt_crc_collector_poll(collector, 0),
+					      300);
+		}
+		igt_assert_eq(igt_crc_collector_poll(collector, 0),
+			      N_CRCS % 300);
+
+		igt_assert_eq(igt_crc_collector_get_crcs(collector, 0, N_CRCS,
+							 out), N_CRCS);
+		for (int i = 0; i < N_CRCS; i++)
+			assert_crc_eq(&out[i], &crcs[i]);
+
+		close(fds[0]);
+		close(fds[1]);
+		igt_crc_collector_free(collector);
+	}
+
+	igt_subtest("partial-entries") {
+		char buf[128];
+		int len;
+
+		collector = igt_crc_collector_new(4);
+		make_pipe(fds);
+		igt_crc_collector_add_fd(collector, fds[0]);
+
+		random_crc(&crcs[0], 7);
+		len = format_crc(buf, &crcs[0]);
+		for (int i = 0; i < len - 1; i++) {
+			igt_assert_eq(write(fds[1], &buf[i], 1), 1);
+			igt_assert_eq(igt_crc_collector_poll(collector, 0), 0);
+		}
+		igt_assert_eq(write(fds[1], &buf[len - 1], 1), 1);
+		igt_assert_eq(igt_crc_collector_poll(collector, 0), 1);
+
+		igt_assert_eq(igt_crc_collector_get_crcs(collector, 0, 4, out), 1);
+		assert_crc_eq(&out[0], &crcs[0]);
+
+		close(fds[0]);
+		close(fds[1]);
+		igt_crc_collector_free(collector);
+	}
+
+	igt_subtest("ring") {
+		collector = igt_crc_collector_new(8);
+		make_pipe(fds);
+		igt_crc_collector_add_fd(collector, fds[0]);
+
+		for (int i = 0; i < 20; i++) {
+			random_crc(&crcs[i], i);
+			write_crc(fds[1], &crcs[i]);
+		}
+		igt_assert_eq(igt_crc_collector_poll(collector, 0), 20);
+
+		/* Only the most recent ones are kept, oldest first */
+		igt_assert_eq(igt_crc_collector_get_crcs(collector, 0, 16, out), 8);
+		for (int i = 0; i < 8; i++)
+			assert_crc_eq(&out[i], &crcs[12 + i]);
+
+		igt_assert_eq(igt_crc_collector_get_crcs(collector, 0, 3, out), 3);
+		for (int i = 0; i < 3; i++)
+			assert_crc_eq(&out[i], &crcs[17 + i]);
+
+		close(fds[0]);
+		close(fds[1]);
+		igt_crc_collector_free(collector);
+	}
+
+	igt_subtest("multiple-sources") {
+		int pipes[3][2], sources[3];
+
+		collector = igt_crc_collector_new(N_CRCS);
+		for (int p = 0; p < 3; p++) {
+			make_pipe(pipes[p]);
+			sources[p] = igt_crc_collector_add_fd(collector,
+							      pipes[p][0]);
+		}
+
+		for (int i = 0; i < 30; i++) {
+			random_crc(&crcs[i], i / 3);
+			write_crc(pipes[i % 3][1], &crcs[i]);
+		}
+		igt_assert_eq(igt_crc_collector_poll(collector, 0), 30);
+
+		for (int p = 0; p < 3; p++) {
+			igt_assert_eq(igt_crc_collector_get_crcs(collector,
+								 sources[p],
+								 N_CRCS, out),
+				      10);
+			for (int i = 0; i < 10; i++)
+				assert_crc_eq(&out[i], &crcs[3 * i + p]);
+
+			close(pipes[p][0]);
+			close(pipes[p][1]);
+		}
+
+		igt_crc_collector_free(collector);
+	}
+
+	igt_subtest("wait-for-frame") {
+		struct timespec start = {};
+
+		collector = igt_crc_collector_new(4);
+		make_pipe(fds);
+		igt_crc_collector_add_fd(collector, fds[0]);
+
+		for (int i = 0; i < 10; i++)
+			random_crc(&crcs[i], i * 2);
+
+		igt_fork(child, 1) {
+			close(fds[0]);
+			for (int i = 0; i < 10; i++) {
+				usleep(10000);
+				write_crc(fds[1], &crcs[i]);
+			}
+		}
+		close(fds[1]);
+
+		igt_assert(igt_crc_collector_wait_for_frame(collector, 0, 6,
+							    &crc, 1000));
+		assert_crc_eq(&crc, &crcs[3]);
+
+		/* Frame 9 is skipped, the next one will do */
+		igt_assert(igt_crc_collector_wait_for_frame(collector, 0, 9,
+							    &crc, 1000));
+		assert_crc_eq(&crc, &crcs[5]);
+
+		/* The writer is gone before frame 100 */
+		igt_assert(!igt_crc_collector_wait_for_frame(collector, 0, 100,
+							     &crc, 5000));
+		igt_waitchildren();
+
+		close(fds[0]);
+		igt_crc_collector_free(collector);
+
+		/* No CRC at all */
+		collector = igt_crc_collector_new(4);
+		make_pipe(fds);
+		igt_crc_collector_add_fd(collector, fds[0]);
+
+		igt_nsec_elapsed(&start);
+		igt_assert(!igt_crc_collector_wait_for_frame(collector, 0, 0,
+							     &crc, 50));
+		igt_assert_lte(50, igt_nsec_elapsed(&start) / 1000000);
+
+		close(fds[0]);
+		close(fds[1]);
+		igt_crc_collector_free(collector);
+	}
+
+	igt_subtest("file") {
+		FILE *file = tmpfile();
+
+		igt_assert(file);
+		for (int i = 0; i < N_CRCS; i++) {
+			random_crc(&crcs[i], i);
+			write_crc(fileno(file), &crcs[i]);
+		}
+		lseek(fileno(file), 0, SEEK_SET);
+
+		collector = igt_crc_collector_new(N_CRCS);
+		igt_crc_collector_add_fd(collector, fileno(file));
+
+		igt_assert_eq(igt_crc_collector_poll(collector, -1), N_CRCS);
+		igt_assert_eq(igt_crc_collector_poll(collector, -1), 0);
+		igt_assert_eq(igt_crc_collector_get_crcs(collector, 0, N_CRCS,
+							 out), N_CRCS);
+		for (int i = 0; i < N_CRCS; i++)
+			assert_crc_eq(&out[i], &crcs[i]);
+
+		igt_crc_collector_free(collector);
+		fclose(file);
+	}
+}
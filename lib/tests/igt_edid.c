@@ -26,8 +26,11 @@
 #include "config.h"
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "igt_core.h"
+#include "drmtest.h"
 #include "igt_kms.h"
 #include "igt_edid.h"
 
@@ -66,42 +69,286 @@ static bool edid_block_checksum(const unsigned char *raw_edid)
 
 typedef const struct edid *(*get_edid_func)(void);
 
-igt_simple_main
+static const struct {
+	const char *desc;
+	get_edid_func f;
+	size_t exts;
+} funcs[] = {
+	{ "base", igt_kms_get_base_edid, 0 },
+	{ "alt", igt_kms_get_alt_edid, 0 },
+	{ "hdmi_audio", igt_kms_get_hdmi_audio_edid, 1 },
+	{ "dp_audio", igt_kms_get_dp_audio_edid, 1 },
+	{ "4k", igt_kms_get_4k_edid, 1 },
+	{ "3d", igt_kms_get_3d_edid, 1 },
+	{ "aspect_ratio", igt_kms_get_aspect_ratio_edid, 1 },
+	{0},
+};
+
+static void checksum_blocks(const struct edid *edid)
+{
+	uint8_t *raw_edid = (uint8_t *) edid;
+	/* The EDIDs under test have at most one extension */
+	int i, n_blocks = edid->extensions_len ? 2 : 1;
+
+	for (i = 0; i < n_blocks; i++) {
+		uint8_t *block = raw_edid + i * EDID_BLOCK_SIZE;
+		uint8_t sum = 0;
+		int j;
+
+		if (block[0] == EDID_EXT_DISPLAYID) {
+			/* The DisplayID section checksum */
+			for (j = 1; j < 126; j++)
+				sum += block[j];
+			block[126] = -sum;
+			sum = 0;
+		}
+
+		for (j = 0; j < EDID_BLOCK_SIZE - 1; j++)
+			sum += block[j];
+		block[EDID_BLOCK_SIZE - 1] = -sum;
+	}
+}
+
+/* Copies @edid to @raw_edid and corrupts it with @corrupt. */
+static void assert_invalid(const struct edid *edid,
+			   void (*corrupt)(uint8_t *raw_edid),
+			   const char *desc)
+{
+	uint8_t raw_edid[2 * EDID_BLOCK_SIZE];
+	struct edid_index index;
+	const char *reason = NULL;
+
+	memcpy(raw_edid, edid, edid_get_size(edid));
+	corrupt(raw_edid);
+
+	igt_assert_f(!edid_validate((struct edid *) raw_edid,
+				    edid_get_size(edid), &reason),
+		     "%s EDID was deemed valid\n", desc);
+	igt_assert(reason);
+	igt_debug("%s: %s\n", desc, reason);
+
+	/* The index must cope with anything the validator rejects */
+	edid_index_init(&index, (struct edid *) raw_edid, edid_get_size(edid));
+}
+
+static void corrupt_header(uint8_t *raw_edid)
+{
+	raw_edid[1] = 0;
+	checksum_blocks((struct edid *) raw_edid);
+}
+
+static void corrupt_base_checksum(uint8_t *raw_edid)
+{
+	raw_edid[EDID_BLOCK_SIZE - 1]++;
+}
+
+static void corrupt_ext_checksum(uint8_t *raw_edid)
+{
+	raw_edid[2 * EDID_BLOCK_SIZE - 1]++;
+}
+
+static void corrupt_ext_count(uint8_t *raw_edid)
+{
+	raw_edid[126] = 2;
+	checksum_blocks((struct edid *) raw_edid);
+}
+
+static void corrupt_cea_revision(uint8_t *raw_edid)
+{
+	raw_edid[EDID_BLOCK_SIZE + 1] = 4;
+	checksum_blocks((struct edid *) raw_edid);
+}
+
+static void corrupt_cea_block_len(uint8_t *raw_edid)
+{
+	/* The first data block now overflows the data block collection */
+	raw_edid[EDID_BLOCK_SIZE + 4] |= 0x1f;
+	checksum_blocks((struct edid *) raw_edid);
+}
+
+static void corrupt_cea_dtd_start(uint8_t *raw_edid)
+{
+	raw_edid[EDID_BLOCK_SIZE + 2] = 2;
+	checksum_blocks((struct edid *) raw_edid);
+}
+
+static void corrupt_displayid_block_len(uint8_t *raw_edid)
+{
+	raw_edid[EDID_BLOCK_SIZE + 7] = 0xff;
+	checksum_blocks((struct edid *) raw_edid);
+}
+
+static void corrupt_displayid_section_checksum(uint8_t *raw_edid)
+{
+	/* Keeps the block checksum right, but not the section one */
+	raw_edid[EDID_BLOCK_SIZE + 126]++;
+	raw_edid[EDID_BLOCK_SIZE + 127]--;
+}
+
+igt_main
 {
-	const struct {
-		const char *desc;
-		get_edid_func f;
-		size_t exts;
-	} funcs[] = {
-		{ "base", igt_kms_get_base_edid, 0 },
-		{ "alt", igt_kms_get_alt_edid, 0 },
-		{ "hdmi_audio", igt_kms_get_hdmi_audio_edid, 1 },
-		{ "4k", igt_kms_get_4k_edid, 1 },
-		{ "3d", igt_kms_get_3d_edid, 1 },
-		{0},
-	}, *f;
 	const struct edid *edid;
 	const uint8_t *raw_edid, *raw_block;
+	struct edid_index index;
+	const char *reason;
 	size_t i;
 
-	for (f = funcs; f->f; f++) {
-		edid = f->f();
-		raw_edid = (uint8_t *) edid;
-
-		igt_assert_f(edid_header_is_valid(raw_edid),
-			     "invalid header on %s EDID", f->desc);
-		/* check base edid block */
-		igt_assert_f(edid_block_checksum(raw_edid),
-			     "checksum failed on %s EDID", f->desc);
-		/* check extension blocks, if any */
-		igt_assert_f(raw_edid[126] == f->exts,
-			     "unexpected number of extensions on %s EDID",
-			     f->desc);
-		for (i = 0; i < f->exts; i++) {
-			raw_block = raw_edid + (i + 1) * EDID_BLOCK_SIZE;
-			igt_assert_f(edid_block_checksum(raw_block),
-				     "CEA block checksum failed on %s EDID",
+	igt_subtest("builtin") {
+		for (typeof(*funcs) *f = funcs; f->f; f++) {
+			edid = f->f();
+			raw_edid = (uint8_t *) edid;
+
+			igt_assert_f(edid_header_is_valid(raw_edid),
+				     "invalid header on %s EDID", f->desc);
+			/* check base edid block */
+			igt_assert_f(edid_block_checksum(raw_edid),
+				     "checksum failed on %s EDID", f->desc);
+			/* check extension blocks, if any */
+			igt_assert_f(raw_edid[126] == f->exts,
+				     "unexpected number of extensions on %s EDID",
 				     f->desc);
+			for (i = 0; i < f->exts; i++) {
+				raw_block = raw_edid + (i + 1) * EDID_BLOCK_SIZE;
+				igt_assert_f(edid_block_checksum(raw_block),
+					     "CEA block checksum failed on %s EDID",
+					     f->desc);
+			}
+
+			reason = NULL;
+			igt_assert_f(edid_validate(edid, edid_get_size(edid),
+						   &reason),
+				     "%s EDID is invalid: %s\n", f->desc, reason);
+			igt_assert(edid_index_init(&index, edid,
+						   edid_get_size(edid)));
+		}
+	}
+
+	igt_subtest("tiled") {
+		struct edid **tiles = igt_kms_get_tiled_edid(1, 0);
+		const struct edid_block_ref *ref;
+
+		for (i = 0; i < 2; i++) {
+			reason = NULL;
+			igt_assert_f(edid_validate(tiles[i],
+						   edid_get_size(tiles[i]),
+						   &reason),
+				     "tile %zu EDID is invalid: %s\n", i, reason);
+
+			igt_assert(edid_index_init(&index, tiles[i],
+						   edid_get_size(tiles[i])));
+			ref = edid_index_find(&index, EDID_BLOCK_DISPLAYID, 0x12,
+					      NULL);
+			igt_assert(ref);
+			igt_assert_eq(ref->len, 0x16);
+			igt_assert(ref->data == tiles[i]->extensions[0].data.tile.header + 7);
+			igt_assert(!edid_index_find(&index, EDID_BLOCK_DISPLAYID,
+						    -1, ref));
+		}
+	}
+
+	igt_subtest("index") {
+		static const int audio_tags[] = {
+			EDID_CEA_DATA_AUDIO,
+			EDID_CEA_DATA_VENDOR_SPECIFIC,
+			EDID_CEA_DATA_SPEAKER_ALLOC,
+		};
+		const struct edid_block_ref *ref = NULL;
+
+		edid = igt_kms_get_hdmi_audio_edid();
+		igt_assert(edid_index_init(&index, edid, edid_get_size(edid)));
+		igt_assert_eq(index.n_blocks, ARRAY_SIZE(audio_tags));
+		for (i = 0; i < ARRAY_SIZE(audio_tags); i++) {
+			ref = edid_index_find(&index, EDID_BLOCK_CEA_DATA, -1, ref);
+			igt_assert(ref);
+			igt_assert_eq(ref->tag, audio_tags[i]);
+			igt_assert_eq(ref->ext, 0);
 		}
+		igt_assert(!edid_index_find(&index, EDID_BLOCK_CEA_DATA, -1, ref));
+
+		/* No VSDB for DisplayPort */
+		edid = igt_kms_get_dp_audio_edid();
+		igt_assert(edid_index_init(&index, edid, edid_get_size(edid)));
+		igt_assert(!index.hdmi_vsdb);
+		igt_assert(!edid_index_find(&index, EDID_BLOCK_CEA_DATA,
+					    EDID_CEA_DATA_VENDOR_SPECIFIC, NULL));
+
+		edid = igt_kms_get_4k_edid();
+		igt_assert(edid_index_init(&index, edid, edid_get_size(edid)));
+		ref = edid_index_find(&index, EDID_BLOCK_CEA_DATA,
+				      EDID_CEA_DATA_VIDEO, NULL);
+		igt_assert(ref);
+		igt_assert_eq(ref->len, 5);
+		igt_assert(index.hdmi_vsdb);
+		igt_assert_eq(index.hdmi_vsdb->src_phy_addr[0], 0x10);
+		igt_assert(!edid_index_find(&index, EDID_BLOCK_DISPLAYID, -1, NULL));
+
+		/* Truncated blobs are only indexed up to their size */
+		igt_assert(!edid_index_init(&index, edid, EDID_BLOCK_SIZE));
+		igt_assert_eq(index.n_blocks, 0);
+	}
+
+	igt_subtest("deep-color") {
+		for (typeof(*funcs) *f = funcs; f->f; f++) {
+			edid = f->f();
+			edid_index_init(&index, edid, edid_get_size(edid));
+			igt_assert_eq(index.deep_color,
+				      edid_get_deep_color_from_vsdb(edid));
+		}
+
+		edid = igt_kms_get_hdmi_audio_edid();
+		igt_assert_eq(edid_get_deep_color_from_vsdb(edid), 0x38);
+		edid = igt_kms_get_4k_edid();
+		igt_assert_eq(edid_get_deep_color_from_vsdb(edid), 0);
+	}
+
+	igt_subtest("invalid") {
+		edid = igt_kms_get_4k_edid();
+		assert_invalid(edid, corrupt_header, "bad header");
+		assert_invalid(edid, corrupt_base_checksum, "bad base checksum");
+		assert_invalid(edid, corrupt_ext_checksum, "bad CEA checksum");
+		assert_invalid(edid, corrupt_ext_count, "bad extension count");
+		assert_invalid(edid, corrupt_cea_revision, "bad CEA revision");
+		assert_invalid(edid, corrupt_cea_block_len, "bad CEA block length");
+		assert_invalid(edid, corrupt_cea_dtd_start, "bad CEA DTD offset");
+
+		edid = igt_kms_get_tiled_edid(1, 0)[0];
+		assert_invalid(edid, corrupt_displayid_block_len,
+			       "bad DisplayID block length");
+		assert_invalid(edid, corrupt_displayid_section_checksum,
+			       "bad DisplayID section checksum");
+	}
+
+	igt_subtest("fuzz") {
+		uint8_t buf[2 * EDID_BLOCK_SIZE];
+		int n_valid = 0;
+
+		srand(0xed1d);
+		for (int n = 0; n < 100000; n++) {
+			typeof(*funcs) *f = &funcs[rand() % (ARRAY_SIZE(funcs) - 1)];
+			size_t size;
+
+			edid = rand() % 8 ? f->f() : igt_kms_get_tiled_edid(1, 0)[1];
+			size = edid_get_size(edid);
+			memcpy(buf, edid, size);
+
+			for (int m = rand() % 4 + 1; m; m--)
+				buf[rand() % size] = rand();
+			if (rand() % 2)
+				checksum_blocks((struct edid *) buf);
+
+			/* Mustn't read past the blob, as checked by ASan */
+			if (edid_validate((struct edid *) buf, size, NULL)) {
+				n_valid++;
+				igt_assert(edid_index_init(&index,
+							   (struct edid *) buf,
+							   size));
+			} else {
+				edid_index_init(&index, (struct edid *) buf,
+						size);
+			}
+		}
+
+		igt_debug("%d mutated EDIDs were valid\n", n_valid);
+		igt_assert(n_valid > 0);
 	}
 }
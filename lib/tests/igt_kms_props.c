@@ -0,0 +1,269 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "igt_kms.h"
+
+/*
+ * A userspace stand-in for the DRM property ioctls: every object has the
+ * same property ids, offset by the object id, and the kernel state is the
+ * values array below.
+ */
+#define N_PLANES 2
+#define PLANE_ID(i) (10 + (i))
+#define CRTC_ID 20
+#define CONNECTOR_ID 30
+
+/* "Content Protection" values, as in kms_content_protection */
+#define CP_DESIRED 1
+#define CP_ENABLED 2
+
+static uint64_t kernel_values[64][IGT_NUM_PLANE_PROPS];
+static int get_props_calls;
+
+static uint32_t prop_id(uint32_t object_id, int prop)
+{
+	return object_id * 100 + prop + 1;
+}
+
+static drmModeObjectPropertiesPtr
+fake_get_object_props(int fd, uint32_t object_id, uint32_t object_type)
+{
+	drmModeObjectPropertiesPtr props = calloc(1, sizeof(*props));
+	int num_props = object_type == DRM_MODE_OBJECT_PLANE ? IGT_NUM_PLANE_PROPS :
+			object_type == DRM_MODE_OBJECT_CRTC ? IGT_NUM_CRTC_PROPS :
+			IGT_NUM_CONNECTOR_PROPS;
+
+	get_props_calls++;
+
+	/* in reverse, the getters mustn't rely on the kernel order */
+	props->count_props = num_props;
+	props->props = calloc(num_props, sizeof(*props->props));
+	props->prop_values = calloc(num_props, sizeof(*props->prop_values));
+	for (int i = 0; i < num_props; i++) {
+		props->props[num_props - 1 - i] = prop_id(object_id, i);
+		props->prop_values[num_props - 1 - i] = kernel_values[object_id][i];
+	}
+
+	return props;
+}
+
+static void fake_display_init(igt_display_t *display)
+{
+	igt_pipe_t *pipe;
+	igt_output_t *output;
+
+	memset(display, 0, sizeof(*display));
+	memset(kernel_values, 0, sizeof(kernel_values));
+
+	display->drm_fd = -1;
+	display->is_atomic = true;
+	display->get_object_props = fake_get_object_props;
+
+	display->n_pipes = IGT_MAX_PIPES;
+	display->pipes = calloc(IGT_MAX_PIPES, sizeof(*display->pipes));
+	pipe = &display->pipes[PIPE_A];
+	pipe->display = display;
+	pipe->pipe = PIPE_A;
+	pipe->enabled = true;
+	pipe->crtc_id = CRTC_ID;
+	for (int i = 0; i < IGT_NUM_CRTC_PROPS; i++)
+		pipe->props[i] = prop_id(CRTC_ID, i);
+
+	display->n_planes = N_PLANES;
+	display->planes = calloc(N_PLANES, sizeof(*display->planes));
+	pipe->n_planes = N_PLANES;
+	pipe->planes = calloc(N_PLANES, sizeof(*pipe->planes));
+	for (int p = 0; p < N_PLANES; p++) {
+		igt_plane_t *global = &display->planes[p];
+		igt_plane_t *plane = &pipe->planes[p];
+
+		global->drm_plane = calloc(1, sizeof(*global->drm_plane));
+		global->drm_plane->plane_id = PLANE_ID(p);
+		global->ref = plane;
+		global->pipe = pipe;
+
+		plane->index = p;
+		plane->pipe = pipe;
+		plane->ref = global;
+		plane->drm_plane = global->drm_plane;
+		plane->values[IGT_PLANE_IN_FENCE_FD] = ~0ULL;
+		for (int i = 0; i < IGT_NUM_PLANE_PROPS; i++)
+			plane->props[i] = prop_id(PLANE_ID(p), i);
+	}
+
+	display->n_outputs = 1;
+	display->outputs = calloc(1, sizeof(*display->outputs));
+	output = &display->outputs[0];
+	output->display = display;
+	output->id = CONNECTOR_ID;
+	output->name = strdup("DP-1");
+	output->pending_pipe = PIPE_NONE;
+	for (int i = 0; i < IGT_NUM_CONNECTOR_PROPS; i++)
+		output->props[i] = prop_id(CONNECTOR_ID, i);
+}
+
+static void fake_display_fini(igt_display_t *display)
+{
+	for (int p = 0; p < N_PLANES; p++)
+		free(display->planes[p].drm_plane);
+	free(display->pipes[PIPE_A].planes);
+	free(display->planes);
+	free(display->pipes);
+	free(display->outputs[0].name);
+	free(display->outputs);
+}
+
+igt_main
+{
+	igt_display_t display;
+	igt_pipe_t *pipe;
+	igt_plane_t *plane;
+	igt_output_t *output;
+
+	igt_fixture {
+		fake_display_init(&display);
+		pipe = &display.pipes[PIPE_A];
+		plane = &pipe->planes[1];
+		output = &display.outputs[0];
+	}
+
+	igt_subtest("getters") {
+		kernel_values[PLANE_ID(1)][IGT_PLANE_FB_ID] = 42;
+		kernel_values[CRTC_ID][IGT_CRTC_ACTIVE] = 1;
+		kernel_values[CONNECTOR_ID][IGT_CONNECTOR_CRTC_ID] = CRTC_ID;
+
+		/* without a snapshot, every getter asks the kernel */
+		get_props_calls = 0;
+		igt_assert_eq_u64(igt_plane_get_prop(plane, IGT_PLANE_FB_ID), 42);
+		igt_assert_eq_u64(igt_pipe_obj_get_prop(pipe, IGT_CRTC_ACTIVE), 1);
+		igt_assert_eq_u64(igt_plane_get_prop(plane, IGT_PLANE_FB_ID), 42);
+		igt_assert_eq(get_props_calls, 3);
+
+		/* one read per object, then none */
+		get_props_calls = 0;
+		igt_display_snapshot_props(&display);
+		igt_assert_eq(get_props_calls, N_PLANES + 2);
+
+		for (int i = 0; i < 100; i++) {
+			igt_assert_eq_u64(igt_plane_get_prop(plane, IGT_PLANE_FB_ID), 42);
+			igt_assert_eq_u64(igt_plane_get_prop(&pipe->planes[0], IGT_PLANE_FB_ID), 0);
+			igt_assert_eq_u64(igt_pipe_obj_get_prop(pipe, IGT_CRTC_ACTIVE), 1);
+			igt_assert_eq_u64(igt_output_get_prop(output, IGT_CONNECTOR_CRTC_ID),
+					  CRTC_ID);
+		}
+		igt_assert_eq(get_props_calls, N_PLANES + 2);
+	}
+
+	igt_subtest("invalidate") {
+		igt_display_snapshot_props(&display);
+		kernel_values[PLANE_ID(1)][IGT_PLANE_CRTC_X] = 64;
+		igt_assert_eq_u64(igt_plane_get_prop(plane, IGT_PLANE_CRTC_X), 0);
+
+		/* only the objects asked about are read again */
+		get_props_calls = 0;
+		igt_display_invalidate_props(&display);
+		igt_assert_eq_u64(igt_plane_get_prop(plane, IGT_PLANE_CRTC_X), 64);
+		igt_assert_eq_u64(igt_plane_get_prop(plane, IGT_PLANE_CRTC_Y), 0);
+		igt_assert_eq(get_props_calls, 1);
+	}
+
+	igt_subtest("commit") {
+		igt_display_snapshot_props(&display);
+		kernel_values[CRTC_ID][IGT_CRTC_VRR_ENABLED] = 1;
+
+		/* test-only commits don't change the state */
+		get_props_calls = 0;
+		igt_display_try_commit_atomic(&display, DRM_MODE_ATOMIC_TEST_ONLY, NULL);
+		igt_assert_eq_u64(igt_pipe_obj_get_prop(pipe, IGT_CRTC_VRR_ENABLED), 0);
+		igt_assert_eq(get_props_calls, 0);
+
+		/* even a failed commit may have changed some */
+		igt_display_try_commit_atomic(&display, 0, NULL);
+		igt_assert_eq_u64(igt_pipe_obj_get_prop(pipe, IGT_CRTC_VRR_ENABLED), 1);
+		igt_assert_eq(get_props_calls, 1);
+	}
+
+	igt_subtest("diff") {
+		plane->values[IGT_PLANE_FB_ID] = 42;
+		plane->values[IGT_PLANE_IN_FENCE_FD] = 7;
+		plane->committed = 1ULL << IGT_PLANE_FB_ID | 1ULL << IGT_PLANE_IN_FENCE_FD;
+		pipe->values[IGT_CRTC_ACTIVE] = 1;
+		pipe->committed = 1ULL << IGT_CRTC_ACTIVE;
+
+		kernel_values[PLANE_ID(1)][IGT_PLANE_FB_ID] = 42;
+		kernel_values[PLANE_ID(1)][IGT_PLANE_ZPOS] = 3;
+		kernel_values[CRTC_ID][IGT_CRTC_ACTIVE] = 1;
+		igt_assert_eq(igt_display_diff_props(&display), 0);
+
+		kernel_values[PLANE_ID(1)][IGT_PLANE_FB_ID] = 43;
+		kernel_values[CRTC_ID][IGT_CRTC_ACTIVE] = 0;
+		igt_assert_eq(igt_display_diff_props(&display), 2);
+	}
+
+	igt_subtest("drop") {
+		kernel_values[CRTC_ID][IGT_CRTC_ACTIVE] = 1;
+		igt_display_snapshot_props(&display);
+		igt_display_drop_snapshot(&display);
+
+		/* every getter asks the kernel again */
+		get_props_calls = 0;
+		igt_assert_eq_u64(igt_pipe_obj_get_prop(pipe, IGT_CRTC_ACTIVE), 1);
+		igt_assert_eq_u64(igt_pipe_obj_get_prop(pipe, IGT_CRTC_ACTIVE), 1);
+		igt_assert_eq(get_props_calls, 2);
+
+		/* and diffing doesn't leave a snapshot behind */
+		igt_display_diff_props(&display);
+		kernel_values[CRTC_ID][IGT_CRTC_ACTIVE] = 0;
+		get_props_calls = 0;
+		igt_assert_eq_u64(igt_pipe_obj_get_prop(pipe, IGT_CRTC_ACTIVE), 0);
+		igt_assert_eq(get_props_calls, 1);
+	}
+
+	igt_subtest("async") {
+		int diffs;
+
+		output->values[IGT_CONNECTOR_CONTENT_PROTECTION] = CP_DESIRED;
+		output->committed = 1ULL << IGT_CONNECTOR_CONTENT_PROTECTION;
+		kernel_values[CONNECTOR_ID][IGT_CONNECTOR_CONTENT_PROTECTION] =
+			CP_DESIRED;
+		igt_display_snapshot_props(&display);
+		diffs = igt_display_diff_props(&display);
+
+		/* the kernel enables content protection on its own */
+		kernel_values[CONNECTOR_ID][IGT_CONNECTOR_CONTENT_PROTECTION] =
+			CP_ENABLED;
+		igt_assert_eq_u64(igt_output_get_prop(output,
+						      IGT_CONNECTOR_CONTENT_PROTECTION),
+				  CP_ENABLED);
+		igt_assert_eq(igt_display_diff_props(&display), diffs);
+
+		igt_display_drop_snapshot(&display);
+	}
+
+	igt_fixture
+		fake_display_fini(&display);
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_timer_wheel.h"
+
+#define NUM_TIMERS 10000
+
+/* Stands in for a spinner, recording when and in which order it ended. */
+struct fake_spin {
+	struct igt_timer timer;
+	uint64_t deadline;
+	uint64_t ended;
+	int seq;
+};
+
+static atomic_int seq, ended;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void fake_spin_end(struct igt_timer *timer)
+{
+	struct fake_spin *spin = igt_container_of(timer, spin, timer);
+
+	spin->ended = now_ns();
+	spin->seq = atomic_fetch_add(&seq, 1);
+	atomic_fetch_add(&ended, 1);
+}
+
+static struct fake_spin *create_spins(int count)
+{
+	struct fake_spin *spins = calloc(count, sizeof(*spins));
+
+	igt_assert(spins);
+	for (int i = 0; i < count; i++) {
+		igt_timer_init(&spins[i].timer, fake_spin_end);
+		spins[i].seq = -1;
+	}
+
+	atomic_store(&seq, 0);
+	atomic_store(&ended, 0);
+
+	return spins;
+}
+
+static void arm(struct fake_spin *spin, int64_t ns)
+{
+	uint64_t before = now_ns();
+
+	igt_timer_arm(&spin->timer, ns);
+
+	spin->deadline = spin->timer.expires;
+	igt_assert(spin->deadline >= before + ns);
+}
+
+static void wait_for_ended(int count, int timeout_ms)
+{
+	while (atomic_load(&ended) < count && timeout_ms--)
+		usleep(1000);
+
+	igt_assert_eq(atomic_load(&ended), count);
+}
+
+static int cmp_seq(const void *a, const void *b)
+{
+	const struct fake_spin *x = *(const struct fake_spin **)a;
+	const struct fake_spin *y = *(const struct fake_spin **)b;
+
+	return x->seq - y->seq;
+}
+
+static void check_ended(struct fake_spin *spins, int count)
+{
+	struct fake_spin **order = calloc(count, sizeof(*order));
+	uint64_t late, max_late = 0, total_late = 0;
+	int n = 0;
+
+	for (int i = 0; i < count; i++) {
+		if (spins[i].seq < 0)
+			continue;
+
+		igt_assert_f(spins[i].ended >= spins[i].deadline,
+			     "timer %d ended %"PRIu64"ns early\n",
+			     i, spins[i].deadline - spins[i].ended);
+
+		late = spins[i].ended - spins[i].deadline;
+		max_late = max(max_late, late);
+		total_late += late;
+		order[n++] = &spins[i];
+	}
+
+	igt_info("%d timers ended, %.3fms late on average, %.3fms at most\n",
+		 n, n ? total_late / n / 1e6 : 0., max_late / 1e6);
+	igt_assert_f(n == 0 || total_late / n < 10000000,
+		     "timers ended too late on average\n");
+
+	/* The callbacks are called in order of expiry */
+	qsort(order, n, sizeof(*order), cmp_seq);
+	for (int i = 1; i < n; i++)
+		igt_assert_lte_u64(order[i - 1]->deadline, order[i]->deadline);
+
+	free(order);
+}
+
+static void test_expiry(void)
+{
+	struct fake_spin *spins = create_spins(NUM_TIMERS);
+
+	/* All armed before the first expires, to be able to check the order */
+	for (int i = 0; i < NUM_TIMERS; i++)
+		arm(&spins[i], 100000000 + rand() % 400000000);
+
+	wait_for_ended(NUM_TIMERS, 5000);
+	check_ended(spins, NUM_TIMERS);
+
+	for (int i = 0; i < NUM_TIMERS; i++)
+		igt_assert(!igt_timer_pending(&spins[i].timer));
+
+	free(spins);
+}
+
+static void test_cancel(void)
+{
+	struct fake_spin *spins = create_spins(NUM_TIMERS);
+	int expected = 0;
+
+	for (int i = 0; i < NUM_TIMERS; i++)
+		arm(&spins[i], 100000000 + rand() % 400000000);
+
+	/* Cancel half, re-arm some of them earlier, some later */
+	for (int i = 0; i < NUM_TIMERS; i++) {
+		switch (i % 4) {
+		case 0:
+			igt_assert(igt_timer_cancel(&spins[i].timer));
+			igt_assert(!igt_timer_pending(&spins[i].timer));
+			break;
+		case 1:
+			arm(&spins[i], 50000000 + rand() % 100000000);
+			expected++;
+			break;
+		case 2:
+			igt_assert(igt_timer_cancel(&spins[i].timer));
+			arm(&spins[i], 500000000 + rand() % 100000000);
+			expected++;
+			break;
+		default:
+			expected++;
+			break;
+		}
+	}
+
+	wait_for_ended(expected, 5000);
+	/* The cancelled timers don't end later either */
+	usleep(100000);
+	igt_assert_eq(atomic_load(&ended), expected);
+
+	for (int i = 0; i < NUM_TIMERS; i += 4) {
+		igt_assert_eq(spins[i].seq, -1);
+		igt_assert(!igt_timer_cancel(&spins[i].timer));
+	}
+
+	check_ended(spins, NUM_TIMERS);
+	free(spins);
+}
+
+static void test_rearm(void)
+{
+	struct fake_spin *spins = create_spins(2);
+
+	/* Like igt_spin_reset() followed by a new timeout */
+	arm(&spins[0], 10000000000ll);
+	arm(&spins[0], 20000000);
+	arm(&spins[1], 10000000);
+
+	wait_for_ended(2, 1000);
+	igt_assert_eq(spins[1].seq, 0);
+	igt_assert_eq(spins[0].seq, 1);
+	check_ended(spins, 2);
+
+	/* And again, once it has ended */
+	spins[0].seq = -1;
+	arm(&spins[0], 10000000);
+	wait_for_ended(3, 1000);
+	igt_assert_eq(spins[0].seq, 2);
+
+	usleep(20000);
+	igt_assert_eq(atomic_load(&ended), 3);
+
+	free(spins);
+}
+
+static void test_fork(void)
+{
+	struct fake_spin *spins = create_spins(2);
+
+	arm(&spins[0], 200000000);
+
+	igt_fork(child, 1) {
+		struct fake_spin *child_spins = create_spins(NUM_TIMERS / 10);
+
+		/* The timers of the parent are left behind */
+		igt_assert(!igt_timer_pending(&spins[0].timer));
+		igt_assert(!igt_timer_cancel(&spins[0].timer));
+
+		for (int i = 0; i < NUM_TIMERS / 10; i++)
+			arm(&child_spins[i], 10000000 + rand() % 100000000);
+
+		wait_for_ended(NUM_TIMERS / 10, 5000);
+		check_ended(child_spins, NUM_TIMERS / 10);
+		usleep(200000);
+		igt_assert_eq(spins[0].seq, -1);
+	}
+	igt_waitchildren();
+
+	/* And still run in the parent */
+	arm(&spins[1], 10000000);
+	wait_for_ended(2, 1000);
+	check_ended(spins, 2);
+
+	free(spins);
+}
+
+igt_main
+{
+	srand(time(NULL));
+
+	igt_subtest("expiry")
+		test_expiry();
+
+	igt_subtest("cancel")
+		test_cancel();
+
+	igt_subtest("rearm")
+		test_rearm();
+
+	igt_subtest("fork")
+		test_fork();
+}
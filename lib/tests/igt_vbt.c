@@ -0,0 +1,229 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "drmtest.h"
+#include "igt_vbt.h"
+#include "igt_vbt_defs.h"
+
+static const uint16_t versions[] = {
+	155, 165, 186, 195, 198, 209, 216, 226,
+};
+
+/* Calls every accessor, for ASan to check nothing is read out of bounds */
+static int exercise(const struct igt_vbt *vbt)
+{
+	struct igt_vbt_child_device child;
+	struct igt_vbt_mipi_sequences seqs;
+	struct igt_vbt_edp edp;
+	struct igt_vbt_psr psr;
+	int panel_type = igt_vbt_panel_type(vbt);
+	int n = 0;
+
+	for (int i = 0; i < IGT_VBT_NUM_BLOCKS; i++) {
+		const uint8_t *data;
+		uint32_t size;
+
+		data = igt_vbt_get_block(vbt, i, &size);
+		if (data && size)
+			n += data[size - 1];
+	}
+
+	for (int i = 0; igt_vbt_get_child_device(vbt, i, &child); i++) {
+		const uint8_t *raw = child.raw;
+
+		n += child.device_type + raw[child.raw_size - 1];
+	}
+
+	for (int i = -1; i <= IGT_VBT_NUM_PANELS; i++) {
+		n += igt_vbt_get_edp(vbt, i, &edp);
+		n += igt_vbt_get_psr(vbt, i, &psr);
+
+		if (igt_vbt_get_mipi_sequences(vbt, i, &seqs)) {
+			for (int j = 0; j < MIPI_SEQ_MAX; j++)
+				if (seqs.data[j])
+					n += seqs.data[j][seqs.size[j] - 1];
+		}
+	}
+
+	return n + panel_type;
+}
+
+static void check_vbt(const struct igt_vbt *vbt, uint16_t version)
+{
+	struct igt_vbt_child_device child;
+	struct igt_vbt_mipi_sequences seqs;
+	struct igt_vbt_edp edp;
+	struct igt_vbt_psr psr;
+
+	igt_assert_eq(vbt->version, version);
+	igt_assert(!vbt->truncated);
+	igt_assert_eq(igt_vbt_panel_type(vbt), 2);
+
+	igt_assert_eq(igt_vbt_num_child_devices(vbt), 4);
+	igt_assert(igt_vbt_get_child_device(vbt, 0, &child));
+	igt_assert_eq(child.device_type, DEVICE_TYPE_eDP);
+	igt_assert_eq(child.dvo_port, DVO_PORT_DPA);
+	igt_assert_eq(child.aux_channel, DP_AUX_A);
+	igt_assert_eq(child.dp_support, version >= 158);
+	igt_assert(!child.hdmi_support);
+	igt_assert(igt_vbt_get_child_device(vbt, 3, &child));
+	igt_assert_eq(child.dvo_port, DVO_PORT_DPD);
+	igt_assert_eq(child.usb_type_c, version >= 195);
+	igt_assert(!igt_vbt_get_child_device(vbt, 4, &child));
+
+	igt_assert(igt_vbt_get_edp(vbt, 2, &edp));
+	igt_assert_eq(edp.t3, 2000);
+	igt_assert_eq(edp.t12, 5000);
+	igt_assert_eq(edp.bpp, 24);
+	igt_assert_eq(edp.rate, EDP_RATE_2_7);
+	igt_assert_eq(edp.lanes, EDP_LANE_4);
+	igt_assert_eq(edp.fast_link_training, version >= 182);
+	igt_assert_eq(edp.pwm_on_to_backlight_enable, version >= 186 ? 100 : 0);
+	igt_assert(!igt_vbt_get_edp(vbt, IGT_VBT_NUM_PANELS, &edp));
+
+	igt_assert_eq(igt_vbt_get_psr(vbt, 2, &psr), version >= 165);
+	if (version >= 165) {
+		igt_assert(psr.full_link);
+		igt_assert_eq(psr.idle_frames, 2);
+		igt_assert_eq(psr.lines_to_wait, 4);
+		igt_assert_eq(psr.tp1_wakeup_time, 500);
+		igt_assert_eq(psr.psr2_tp2_tp3_wakeup_time,
+			      version >= 226 ? 100 : -1);
+	}
+
+	igt_assert(igt_vbt_get_mipi_sequences(vbt, 2, &seqs));
+	igt_assert_eq(seqs.version, version >= 198 ? 3 : 1);
+	for (int i = 0; i < MIPI_SEQ_MAX; i++)
+		igt_assert_eq(!!seqs.data[i],
+			      i == MIPI_SEQ_ASSERT_RESET ||
+			      i == MIPI_SEQ_INIT_OTP ||
+			      i == MIPI_SEQ_DISPLAY_ON ||
+			      i == MIPI_SEQ_DEASSERT_RESET);
+	igt_assert_eq(seqs.data[MIPI_SEQ_INIT_OTP][0], MIPI_SEQ_INIT_OTP);
+	igt_assert(!igt_vbt_get_mipi_sequences(vbt, 0, &seqs));
+
+	igt_assert_eq(!!igt_vbt_get_block(vbt, BDB_COMPRESSION_PARAMETERS, NULL),
+		      version >= 198);
+}
+
+igt_main
+{
+	struct igt_vbt vbt;
+	void *blob, *buf;
+	size_t size;
+
+	igt_subtest("parse") {
+		for (int i = 0; i < ARRAY_SIZE(versions); i++) {
+			blob = igt_vbt_create(versions[i], &size);
+
+			igt_assert_eq(igt_vbt_init(&vbt, blob, size), 0);
+			check_vbt(&vbt, versions[i]);
+			igt_vbt_fini(&vbt);
+
+			/* A VBT within a VBIOS image */
+			buf = calloc(1, size + 4096);
+			memcpy(buf + 1234, blob, size);
+			igt_assert_eq(igt_vbt_init(&vbt, buf, size + 4096), 0);
+			check_vbt(&vbt, versions[i]);
+			igt_vbt_fini(&vbt);
+
+			free(buf);
+			free(blob);
+		}
+
+		igt_assert_eq(igt_vbt_init(&vbt, "no vbt here", 11), -ENOENT);
+	}
+
+	igt_subtest("truncate") {
+		for (int i = 0; i < ARRAY_SIZE(versions); i++) {
+			int num_blocks;
+
+			blob = igt_vbt_create(versions[i], &size);
+			igt_assert_eq(igt_vbt_init(&vbt, blob, size), 0);
+			num_blocks = vbt.num_blocks;
+			igt_vbt_fini(&vbt);
+
+			for (size_t len = 0; len < size; len++) {
+				/* exact size, for ASan to catch overreads */
+				buf = malloc(len);
+				memcpy(buf, blob, len);
+
+				if (igt_vbt_init(&vbt, buf, len) == 0) {
+					igt_assert(vbt.truncated ||
+						   vbt.num_blocks < num_blocks);
+					exercise(&vbt);
+				}
+				igt_vbt_fini(&vbt);
+
+				free(buf);
+			}
+
+			free(blob);
+		}
+	}
+
+	igt_subtest("fuzz") {
+		void *blobs[ARRAY_SIZE(versions)];
+		size_t sizes[ARRAY_SIZE(versions)];
+		int n_valid = 0;
+
+		for (int i = 0; i < ARRAY_SIZE(versions); i++)
+			blobs[i] = igt_vbt_create(versions[i], &sizes[i]);
+
+		srand(0x5b7);
+		for (int n = 0; n < 100000; n++) {
+			int i = rand() % ARRAY_SIZE(versions);
+			struct igt_vbt_mipi_sequences seqs;
+
+			size = sizes[i];
+			buf = malloc(size);
+			memcpy(buf, blobs[i], size);
+
+			for (int m = rand() % 4 + 1; m; m--)
+				((uint8_t *)buf)[rand() % size] = rand();
+
+			/* Mustn't read past the blob, as checked by ASan */
+			if (igt_vbt_init(&vbt, buf, size) == 0) {
+				exercise(&vbt);
+				n_valid += igt_vbt_get_mipi_sequences(&vbt, 2,
+								      &seqs);
+			}
+			igt_vbt_fini(&vbt);
+
+			free(buf);
+		}
+
+		for (int i = 0; i < ARRAY_SIZE(versions); i++)
+			free(blobs[i]);
+
+		igt_debug("%d mutated VBTs had valid MIPI sequences\n", n_valid);
+		igt_assert(n_valid > 0);
+	}
+}
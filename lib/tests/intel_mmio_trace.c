@@ -0,0 +1,202 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "intel_reg.h"
+#include "intel_mmio_trace.h"
+
+/* tgl */
+#define DEVID	0x9a49
+
+#define DSL		PIPEA_DSL
+#define IIR_A		GEN8_DE_PIPE_IIR(0)
+
+static uint32_t read32(struct intel_mmio_trace *trace, uint32_t reg)
+{
+	return intel_mmio_trace_read(trace, reg, false);
+}
+
+static void write32(struct intel_mmio_trace *trace, uint32_t reg, uint32_t val)
+{
+	intel_mmio_trace_write(trace, reg, val, false);
+}
+
+/* A poll loop like intel_display_poller's, returns a checksum of the reads */
+static uint32_t poll_vblanks(struct intel_mmio_trace *trace, int count)
+{
+	uint32_t sum = 0;
+
+	write32(trace, IIR_A, 1);
+
+	for (int i = 0; i < count && !intel_mmio_trace_done(trace); ) {
+		uint32_t dsl1 = read32(trace, DSL);
+		uint32_t iir1 = read32(trace, IIR_A);
+		uint32_t iir2 = read32(trace, IIR_A);
+		uint32_t dsl2 = read32(trace, DSL);
+
+		sum = sum * 31 + dsl1 + iir1 + iir2 + dsl2;
+
+		if (!(iir2 & 1))
+			continue;
+
+		write32(trace, IIR_A, 1);
+		if (!(iir1 & 1))
+			i++;
+	}
+
+	return sum;
+}
+
+static void test_model(void)
+{
+	struct intel_mmio_trace trace;
+	uint32_t dsl, prev = 0, frame, surf;
+	int wraps = 0;
+
+	intel_mmio_trace_init(&trace);
+	intel_mmio_trace_model(&trace, DEVID);
+	trace.model.jitter_ns = 0;
+
+	/* the scanline advances every line_ns, and wraps at vtotal */
+	while (wraps < 2) {
+		dsl = read32(&trace, DSL);
+		igt_assert_lt(dsl, trace.model.vtotal);
+		if (dsl < prev)
+			wraps++;
+		else
+			igt_assert_lte(dsl, prev + 1);
+		prev = dsl;
+	}
+
+	/* interrupts fire at the start of vblank, and are cleared by 1s */
+	write32(&trace, IIR_A, ~0u);
+	igt_assert_eq_u32(read32(&trace, IIR_A), 0);
+	while (!(read32(&trace, IIR_A) & 1))
+		;
+	dsl = read32(&trace, DSL);
+	igt_assert_lte(trace.model.vblank_start, dsl);
+	igt_assert_lt(dsl, trace.model.vblank_start + 2);
+	write32(&trace, IIR_A, 1);
+	igt_assert_eq_u32(read32(&trace, IIR_A) & 1, 0);
+
+	/* flips land at the start of the next vblank */
+	frame = read32(&trace, PIPEAFRMCOUNT_G4X);
+	surf = read32(&trace, DSPASURFLIVE);
+	write32(&trace, DSPASURF, surf + 0x40000);
+	igt_assert_eq_u32(read32(&trace, DSPASURF), surf + 0x40000);
+	igt_assert_eq_u32(read32(&trace, DSPASURFLIVE), surf);
+	while (read32(&trace, PIPEAFRMCOUNT_G4X) == frame)
+		igt_assert_eq_u32(read32(&trace, DSPASURFLIVE), surf);
+	igt_assert_eq_u32(read32(&trace, DSPASURFLIVE), surf + 0x40000);
+	igt_assert_eq_u32(read32(&trace, PIPEAFRMCOUNT_G4X), frame + 1);
+	igt_assert_eq_u32(read32(&trace, PIPEAFLIPCOUNT_G4X), 1);
+
+	/* other registers read back what was written */
+	write32(&trace, DEIMR, 0x1234);
+	igt_assert_eq_u32(read32(&trace, DEIMR), 0x1234);
+	write32(&trace, 0x12340, 0xabcd);
+	igt_assert_eq_u32(read32(&trace, 0x12340), 0xabcd);
+
+	igt_assert_eq(intel_mmio_trace_fini(&trace), 0);
+}
+
+static void test_replay(void)
+{
+	static const uint8_t args[] = { 1, 2, 3 };
+	char path[] = "/tmp/igt-mmio-trace-XXXXXX";
+	struct intel_mmio_trace trace;
+	uint64_t accesses;
+	uint32_t sum;
+	int fd;
+
+	fd = mkstemp(path);
+	igt_require(fd >= 0);
+	close(fd);
+
+	intel_mmio_trace_init(&trace);
+	intel_mmio_trace_model(&trace, DEVID);
+	igt_assert_eq(intel_mmio_trace_record(&trace, path, DEVID,
+					      args, sizeof(args)), 0);
+	sum = poll_vblanks(&trace, 5);
+	accesses = trace.num_records;
+	igt_assert_eq(intel_mmio_trace_fini(&trace), 0);
+
+	/* the same accesses get the same values */
+	igt_assert_eq(intel_mmio_trace_replay(&trace, path), 0);
+	igt_assert_eq_u32(trace.devid, DEVID);
+	igt_assert_eq(trace.args_size, sizeof(args));
+	igt_assert(!memcmp(trace.args, args, sizeof(args)));
+
+	igt_assert_eq_u32(poll_vblanks(&trace, 5), sum);
+	igt_assert_eq_u64(trace.num_records, accesses);
+	igt_assert(intel_mmio_trace_done(&trace));
+	igt_assert(!intel_mmio_trace_diverged(&trace));
+	igt_assert_eq(intel_mmio_trace_fini(&trace), 0);
+
+	/* running out of the recording ends the loop early */
+	igt_assert_eq(intel_mmio_trace_replay(&trace, path), 0);
+	poll_vblanks(&trace, 10);
+	igt_assert_eq_u64(trace.num_records, accesses);
+	igt_assert(!intel_mmio_trace_diverged(&trace));
+	igt_assert_eq(intel_mmio_trace_fini(&trace), 0);
+
+	/* other accesses diverge */
+	igt_assert_eq(intel_mmio_trace_replay(&trace, path), 0);
+	write32(&trace, IIR_A, 1);
+	read32(&trace, IIR_A);
+	igt_assert(intel_mmio_trace_diverged(&trace));
+	igt_assert(intel_mmio_trace_done(&trace));
+	igt_assert_eq(intel_mmio_trace_fini(&trace), 0);
+
+	igt_assert_eq(intel_mmio_trace_replay(&trace, path), 0);
+	write32(&trace, IIR_A, 2);
+	igt_assert(intel_mmio_trace_diverged(&trace));
+	igt_assert_eq(intel_mmio_trace_fini(&trace), 0);
+
+	/* not a trace */
+	fd = open(path, O_WRONLY | O_TRUNC);
+	igt_assert(fd >= 0);
+	igt_assert_eq(write(fd, "not a trace", 11), 11);
+	close(fd);
+	igt_assert_eq(intel_mmio_trace_replay(&trace, path), -EINVAL);
+
+	unlink(path);
+	igt_assert_eq(intel_mmio_trace_replay(&trace, path), -ENOENT);
+}
+
+igt_main
+{
+	igt_subtest("model")
+		test_model();
+
+	igt_subtest("replay")
+		test_replay();
+}
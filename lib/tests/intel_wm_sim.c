@@ -0,0 +1,316 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "drm_fourcc.h"
+#include "igt_core.h"
+#include "drmtest.h"
+#include "intel_wm_sim.h"
+
+static const struct intel_wm_sim_mode modes[] = {
+	{ "1920x1080@60", 148500, 1920, 1080, 2200 },
+	{ "3840x2160@60", 594000, 3840, 2160, 4400 },
+};
+
+static const uint32_t formats[] = {
+	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_NV12,
+};
+
+static const uint64_t modifiers[] = {
+	DRM_FORMAT_MOD_LINEAR,
+	I915_FORMAT_MOD_Y_TILED,
+};
+
+static const struct intel_wm_sim_space space = {
+	.modes = modes,
+	.num_modes = ARRAY_SIZE(modes),
+	.formats = formats,
+	.num_formats = ARRAY_SIZE(formats),
+	.modifiers = modifiers,
+	.num_modifiers = ARRAY_SIZE(modifiers),
+	.max_planes = 3,
+};
+
+static void set_pipe(struct intel_wm_sim_config *config, int pipe,
+		     const struct intel_wm_sim_mode *mode, int num_planes,
+		     uint32_t format, uint64_t modifier)
+{
+	struct intel_wm_sim_pipe *p = &config->pipes[pipe];
+
+	p->mode = mode;
+	p->num_planes = num_planes;
+	for (int i = 0; i < num_planes; i++) {
+		p->planes[i].format = format;
+		p->planes[i].modifier = modifier;
+		p->planes[i].width = mode->hdisplay;
+		p->planes[i].height = mode->vdisplay;
+	}
+}
+
+static int fls(unsigned int v)
+{
+	return v ? 32 - __builtin_clz(v) : 0;
+}
+
+static void check_state(const struct intel_wm_sim_platform *platform,
+			const struct intel_wm_sim_config *config,
+			const struct intel_wm_sim_state *state,
+			const struct intel_wm_sim_result *result)
+{
+	for (int pipe = 0; pipe < platform->num_pipes; pipe++) {
+		const struct intel_wm_sim_pipe_state *ps = &state->pipes[pipe];
+		int first = ffs(ps->slices) - 1;
+		int last = fls(ps->slices);
+		uint16_t start = ps->start;
+
+		if (!config->pipes[pipe].mode)
+			continue;
+
+		/* pipes stay within their slices and don't overlap */
+		igt_assert_lte(first * platform->slice_size, ps->start);
+		igt_assert_lte(ps->end, last * platform->slice_size);
+		for (int i = 0; i < pipe; i++) {
+			const struct intel_wm_sim_pipe_state *other =
+				&state->pipes[i];
+
+			if (config->pipes[i].mode)
+				igt_assert(ps->end <= other->start ||
+					   other->end <= ps->start);
+		}
+
+		for (int i = 0; i <= ps->num_allocs; i++) {
+			const struct intel_wm_sim_alloc *alloc = &ps->allocs[i];
+			int level = alloc->max_level;
+
+			igt_assert_lte(start, alloc->start);
+			igt_assert_lt(alloc->start, alloc->end);
+			start = alloc->end;
+
+			igt_assert_lte(result->level, level);
+			igt_assert(level >= 0);
+			igt_assert_lte(alloc->wm[level].min_ddb_alloc,
+				       alloc->end - alloc->start);
+			if (level + 1 < INTEL_WM_SIM_MAX_LEVELS)
+				igt_assert_lt(alloc->end - alloc->start,
+					      alloc->wm[level + 1].min_ddb_alloc);
+		}
+		igt_assert_lte(start, ps->end);
+
+		/* the cursor goes last */
+		igt_assert_eq(ps->allocs[ps->num_allocs].plane, -1);
+		igt_assert_eq(ps->allocs[ps->num_allocs].end, ps->end);
+	}
+}
+
+igt_main
+{
+	const struct intel_wm_sim_platform *platform;
+	struct intel_wm_sim_config config;
+	struct intel_wm_sim_state state;
+	struct intel_wm_sim_result result;
+
+	igt_subtest("skl") {
+		platform = intel_wm_sim_find_platform("skl");
+		igt_assert(platform);
+
+		/* a lone 1080p plane has all of the DDB but the cursor's */
+		memset(&config, 0, sizeof(config));
+		set_pipe(&config, 0, &modes[0], 1, DRM_FORMAT_XRGB8888,
+			 DRM_FORMAT_MOD_LINEAR);
+		igt_assert_eq(intel_wm_sim_compute(platform, &config, &state,
+						   &result), INTEL_WM_SIM_OK);
+		check_state(platform, &config, &state, &result);
+		igt_assert_eq(result.level, 7);
+		igt_assert_eq(state.pipes[0].num_allocs, 1);
+		igt_assert_eq(state.pipes[0].allocs[0].start, 0);
+		igt_assert_eq(state.pipes[0].allocs[0].end, 860);
+		igt_assert_eq(state.pipes[0].allocs[1].start, 860);
+		igt_assert_eq(state.pipes[0].allocs[1].end, 892);
+
+		/* no NV12 on skl */
+		set_pipe(&config, 0, &modes[0], 1, DRM_FORMAT_NV12,
+			 I915_FORMAT_MOD_Y_TILED);
+		igt_assert_eq(intel_wm_sim_compute(platform, &config, NULL,
+						   &result),
+			      INTEL_WM_SIM_UNSUPPORTED);
+
+		memset(&config, 0, sizeof(config));
+
+		/* three 4k pipes of three planes run out of DDB */
+		for (int pipe = 0; pipe < 3; pipe++)
+			set_pipe(&config, pipe, &modes[1], 3,
+				 DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_Y_TILED);
+		igt_assert_eq(intel_wm_sim_compute(platform, &config, NULL,
+						   &result), INTEL_WM_SIM_DDB);
+		igt_assert_eq(result.level, -1);
+	}
+
+	igt_subtest("planar") {
+		/* no NV12 on bxt either */
+		platform = intel_wm_sim_find_platform("bxt");
+		igt_assert(platform);
+
+		memset(&config, 0, sizeof(config));
+		set_pipe(&config, 0, &modes[0], 1, DRM_FORMAT_NV12,
+			 I915_FORMAT_MOD_Y_TILED);
+		igt_assert_eq(intel_wm_sim_compute(platform, &config, NULL,
+						   &result),
+			      INTEL_WM_SIM_UNSUPPORTED);
+
+		platform = intel_wm_sim_find_platform("glk");
+		igt_assert(platform);
+
+		/* NV12 has its uv plane before gen11, on the first two planes */
+		for (int pipe = 0; pipe < 3; pipe++) {
+			memset(&config, 0, sizeof(config));
+			set_pipe(&config, pipe, &modes[0], 1, DRM_FORMAT_NV12,
+				 I915_FORMAT_MOD_Y_TILED);
+			igt_assert_eq(intel_wm_sim_compute(platform, &config,
+							   &state, &result),
+				      INTEL_WM_SIM_OK);
+			check_state(platform, &config, &state, &result);
+			igt_assert_eq(state.pipes[pipe].num_allocs, 2);
+			igt_assert(state.pipes[pipe].allocs[1].uv);
+		}
+
+		memset(&config, 0, sizeof(config));
+		set_pipe(&config, 0, &modes[0], 3, DRM_FORMAT_NV12,
+			 I915_FORMAT_MOD_Y_TILED);
+		igt_assert_eq(intel_wm_sim_compute(platform, &config, NULL,
+						   &result),
+			      INTEL_WM_SIM_UNSUPPORTED);
+	}
+
+	igt_subtest("dbuf-slices") {
+		/* pipes A and B get a slice each on icl and tgl */
+		platform = intel_wm_sim_find_platform("icl");
+		igt_assert(platform);
+
+		memset(&config, 0, sizeof(config));
+		for (int pipe = 0; pipe < 2; pipe++)
+			set_pipe(&config, pipe, &modes[1], 1,
+				 DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_Y_TILED);
+		igt_assert_eq(intel_wm_sim_compute(platform, &config, &state,
+						   &result), INTEL_WM_SIM_OK);
+		check_state(platform, &config, &state, &result);
+		igt_assert_eq(state.pipes[0].slices, 0x1);
+		igt_assert_eq(state.pipes[1].slices, 0x2);
+		igt_assert_eq(result.level, 6);
+
+		platform = intel_wm_sim_find_platform("tgl");
+		igt_assert(platform);
+
+		igt_assert_eq(intel_wm_sim_compute(platform, &config, &state,
+						   &result), INTEL_WM_SIM_OK);
+		check_state(platform, &config, &state, &result);
+		igt_assert_eq(state.pipes[0].slices, 0x2);
+		igt_assert_eq(state.pipes[1].slices, 0x1);
+
+		/* any lone pipe has both slices on tgl */
+		memset(&config, 0, sizeof(config));
+		set_pipe(&config, 3, &modes[1], 1, DRM_FORMAT_XRGB8888,
+			 I915_FORMAT_MOD_Y_TILED);
+		igt_assert_eq(intel_wm_sim_compute(platform, &config, &state,
+						   &result), INTEL_WM_SIM_OK);
+		igt_assert_eq(state.pipes[3].slices, 0x3);
+
+		/* pipe B has the upper two slices on adlp */
+		platform = intel_wm_sim_find_platform("adlp");
+		igt_assert(platform);
+
+		memset(&config, 0, sizeof(config));
+		set_pipe(&config, 1, &modes[1], 1, DRM_FORMAT_XRGB8888,
+			 I915_FORMAT_MOD_Y_TILED);
+		igt_assert_eq(intel_wm_sim_compute(platform, &config, &state,
+						   &result), INTEL_WM_SIM_OK);
+		check_state(platform, &config, &state, &result);
+		igt_assert_eq(state.pipes[1].slices, 0xc);
+	}
+
+	igt_subtest("bandwidth") {
+		struct intel_wm_sim_platform slow;
+
+		platform = intel_wm_sim_find_platform("tgl");
+		igt_assert(platform);
+
+		memset(&config, 0, sizeof(config));
+		set_pipe(&config, 0, &modes[1], 2, DRM_FORMAT_XRGB8888,
+			 DRM_FORMAT_MOD_LINEAR);
+		igt_assert_eq(intel_wm_sim_compute(platform, &config, NULL,
+						   &result), INTEL_WM_SIM_OK);
+
+		slow = *platform;
+		slow.max_bw = result.bw - 1;
+		igt_assert_eq(intel_wm_sim_compute(&slow, &config, NULL,
+						   &result), INTEL_WM_SIM_BW);
+	}
+
+	igt_subtest("invariants") {
+		for (int i = 0; i < intel_wm_sim_num_platforms; i++) {
+			platform = &intel_wm_sim_platforms[i];
+
+			for (uint64_t n = 0;
+			     n < intel_wm_sim_space_size(platform, &space); n++) {
+				intel_wm_sim_space_get(platform, &space, n,
+						       &config);
+				intel_wm_sim_compute(platform, &config, &state,
+						     &result);
+
+				if (result.status == INTEL_WM_SIM_OK ||
+				    result.status == INTEL_WM_SIM_BW)
+					check_state(platform, &config, &state,
+						    &result);
+			}
+		}
+	}
+
+	igt_subtest("deterministic") {
+		for (int i = 0; i < intel_wm_sim_num_platforms; i++) {
+			struct intel_wm_sim_result *serial, *parallel;
+			uint64_t size;
+
+			platform = &intel_wm_sim_platforms[i];
+			size = intel_wm_sim_space_size(platform, &space);
+
+			serial = calloc(size, sizeof(*serial));
+			parallel = calloc(size, sizeof(*parallel));
+			igt_assert(serial && parallel);
+
+			igt_assert_eq(intel_wm_sim_run(platform, &space, 1,
+						       serial), 0);
+			igt_assert_eq(intel_wm_sim_run(platform, &space, 4,
+						       parallel), 0);
+			igt_assert(!memcmp(serial, parallel,
+					   size * sizeof(*serial)));
+
+			free(parallel);
+			free(serial);
+		}
+	}
+}
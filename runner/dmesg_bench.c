@@ -0,0 +1,272 @@
+/*
+ * Throughput of the dmesg handling of resultgen on a synthetic kmsg dump:
+ * parsing and formatting the records, classifying them, and generating
+ * the results of a test with the dump as its dmesg.txt. The dump is
+ * mostly informational records, with some warnings, whitelisted warnings,
+ * continuations and escapes mixed in, like a dmesg storm.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <json.h>
+
+#include "dmesg_classifier.h"
+#include "resultgen.h"
+
+static const char *messages[] = {
+	"i915 0000:00:02.0: [drm:intel_dp_detect [i915]] [CONNECTOR:%u:DP-1] disconnected\n",
+	"[IGT] kms_bench: starting subtest subtest-%u\n",
+	"i915 0000:00:02.0: [drm] *ERROR* Atomic update failure on pipe A (start=%u end=0)\n",
+	"usb usb%u: root hub lost power or was reset\n",
+	"Setting dangerous option reset - tainting kernel %u\n",
+	"perf: interrupt took too long (%u > 2500), lowering rate\\x0a\\x09\\x01\n",
+};
+
+/* Level of each message, informational ones repeated to make them common */
+static const struct {
+	unsigned int level;
+	unsigned int message;
+	char continuation;
+} mix[] = {
+	{ 6, 0, '-' }, { 7, 0, '-' }, { 6, 0, '-' }, { 6, 5, '-' },
+	{ 6, 0, '-' }, { 7, 0, '-' }, { 6, 0, '-' }, { 4, 0, 'c' },
+	{ 6, 0, '-' }, { 7, 0, '-' }, { 6, 0, '-' }, { 4, 4, '-' },
+	{ 6, 0, '-' }, { 7, 0, '-' }, { 6, 0, '-' }, { 4, 3, '-' },
+	{ 6, 0, '-' }, { 7, 0, '-' }, { 6, 0, '-' }, { 3, 2, '-' },
+};
+
+static void write_file(int dirfd, const char *name, const char *buf, size_t len)
+{
+	int fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if (fd < 0 || write(fd, buf, len) != (ssize_t)len) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+
+	close(fd);
+}
+
+static char *create_dump(unsigned int records, unsigned int subtests, size_t *len)
+{
+	size_t size = (size_t)records * 128 + 1;
+	char *buf = malloc(size);
+	unsigned int i, m;
+
+	*len = 0;
+	for (i = 0; i < records; i++) {
+		m = mix[i % (sizeof(mix) / sizeof(mix[0]))].message;
+		if (subtests && i % (records / subtests) == 0)
+			m = 1;
+
+		*len += sprintf(buf + *len, "%u,%u,%llu,%c;",
+				mix[i % (sizeof(mix) / sizeof(mix[0]))].level, i,
+				3216186095083ull + i * 17ull,
+				mix[i % (sizeof(mix) / sizeof(mix[0]))].continuation);
+		*len += sprintf(buf + *len, messages[m],
+				m == 1 ? i / (records / subtests) : i & 0xff);
+	}
+
+	return buf;
+}
+
+static char *create_results(const char *dump, size_t len, unsigned int subtests)
+{
+	char *path = strdup("/tmp/dmesg-bench-XXXXXX");
+	char out[4096];
+	size_t outlen = 0;
+	int dirfd, testfd;
+
+	if (!mkdtemp(path)) {
+		perror("mkdtemp");
+		exit(EXIT_FAILURE);
+	}
+
+	dirfd = open(path, O_RDONLY | O_DIRECTORY);
+	write_file(dirfd, "metadata.txt", "name : dmesg-bench\n", 19);
+	write_file(dirfd, "joblist.txt", "kms_bench\n", 10);
+	mkdirat(dirfd, "0", 0777);
+	testfd = openat(dirfd, "0", O_RDONLY | O_DIRECTORY);
+	write_file(testfd, "journal.txt", "exit:0 (0.010s)\n", 16);
+	for (unsigned int i = 0; i < subtests && outlen < sizeof(out) - 32; i++)
+		outlen += sprintf(out + outlen, "Starting subtest: subtest-%u\n", i);
+	write_file(testfd, "out.txt", out, outlen);
+	write_file(testfd, "err.txt", "", 0);
+	write_file(testfd, "dmesg.txt", dump, len);
+	close(testfd);
+	close(dirfd);
+
+	return path;
+}
+
+static void remove_results(const char *path)
+{
+	int dirfd = open(path, O_RDONLY | O_DIRECTORY);
+	int testfd = openat(dirfd, "0", O_RDONLY | O_DIRECTORY);
+
+	unlinkat(testfd, "journal.txt", 0);
+	unlinkat(testfd, "out.txt", 0);
+	unlinkat(testfd, "err.txt", 0);
+	unlinkat(testfd, "dmesg.txt", 0);
+	close(testfd);
+	unlinkat(dirfd, "0", AT_REMOVEDIR);
+	unlinkat(dirfd, "metadata.txt", 0);
+	unlinkat(dirfd, "joblist.txt", 0);
+	close(dirfd);
+	rmdir(path);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static void report(const char *stage, double secs, unsigned int records, size_t len)
+{
+	printf("%-12s %8.3fs %10.0f records/s %8.1f MB/s\n", stage, secs,
+	       records / secs, len / secs / (1 << 20));
+}
+
+static void run_records(const struct dmesg_classifier *classifier,
+			char *dump, unsigned int records, size_t len)
+{
+	struct dmesg_record record;
+	char *formatted = malloc(4096);
+	unsigned int warnings = 0;
+	double start;
+	char *line, *end;
+
+	for (int classify = 0; classify < 2; classify++) {
+		start = now();
+		for (line = dump; *line; line = end + 1) {
+			end = strchr(line, '\n');
+			*end = '\0';
+
+			if (dmesg_parse_record(line, &record)) {
+				dmesg_format_record(&record, formatted);
+				if (classify && dmesg_is_warning(classifier, &record))
+					warnings++;
+			}
+
+			*end = '\n';
+		}
+		report(classify ? "classify" : "parse", now() - start, records, len);
+	}
+
+	printf("%u warnings\n", warnings);
+	free(formatted);
+}
+
+static void run_resultgen(const char *path, unsigned int records, size_t len)
+{
+	int dirfd = open(path, O_RDONLY | O_DIRECTORY);
+	struct json_object *obj;
+	double start;
+
+	start = now();
+	obj = generate_results_json(dirfd);
+	if (!obj) {
+		fprintf(stderr, "generating the results failed\n");
+		exit(EXIT_FAILURE);
+	}
+	report("resultgen", now() - start, records, len);
+
+	json_object_put(obj);
+	close(dirfd);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -n <records>      Number of kmsg records (default 2000000)\n"
+		"  -t <subtests>     Number of subtests in the dump (default 4)\n"
+		"  -s <filename>     Dmesg suppressions file\n"
+		"  -p                Piglit-style dmesg filtering\n"
+		"  -r <reps>         Repetitions (default 3)\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int records = 2000000, subtests = 4;
+	struct dmesg_classifier classifier;
+	struct settings settings;
+	int reps = 3, c;
+	char *dump, *path;
+	size_t len;
+
+	init_settings(&settings);
+	settings.dmesg_warn_level = 4;
+
+	while ((c = getopt(argc, argv, "n:t:s:pr:h")) != -1) {
+		switch (c) {
+		case 'n':
+			records = atoi(optarg);
+			break;
+		case 't':
+			subtests = atoi(optarg);
+			break;
+		case 's':
+			settings.dmesg_suppressions = strdup(optarg);
+			break;
+		case 'p':
+			settings.piglit_style_dmesg = true;
+			settings.dmesg_warn_level = 5;
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (records == 0 || subtests > records) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!dmesg_classifier_init(&classifier, &settings))
+		return EXIT_FAILURE;
+
+	dump = create_dump(records, subtests, &len);
+	path = create_results(dump, len, subtests);
+
+	/* resultgen reads the filtering settings from the results */
+	if (settings.dmesg_suppressions || settings.piglit_style_dmesg) {
+		int dirfd = open(path, O_RDONLY | O_DIRECTORY);
+		FILE *f = fdopen(openat(dirfd, "metadata.txt", O_WRONLY | O_APPEND), "a");
+
+		fprintf(f, "piglit_style_dmesg : %d\n", settings.piglit_style_dmesg);
+		if (settings.dmesg_suppressions)
+			fprintf(f, "dmesg_suppressions : %s\n", settings.dmesg_suppressions);
+		fclose(f);
+		close(dirfd);
+	}
+
+	printf("%u records, %.1f MB\n", records, len / (double)(1 << 20));
+	for (int i = 0; i < reps; i++) {
+		run_records(&classifier, dump, records, len);
+		run_resultgen(path, records, len);
+	}
+
+	remove_results(path);
+	dmesg_classifier_fini(&classifier);
+	free_settings(&settings);
+	free(path);
+	free(dump);
+
+	return 0;
+}
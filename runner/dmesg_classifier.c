@@ -0,0 +1,297 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dmesg_classifier.h"
+
+/*
+ * This regexp controls the kmsg handling. All kernel log records that
+ * have log level of warning or higher convert the result to
+ * dmesg-warn/dmesg-fail unless they match this regexp, or one of the
+ * suppressions given with --dmesg-suppressions.
+ */
+
+#define _ "|"
+static const char igt_dmesg_whitelist[] =
+	"ACPI: button: The lid device is not compliant to SW_LID" _
+	"ACPI: .*: Unable to dock!" _
+	"IRQ [0-9]+: no longer affine to CPU[0-9]+" _
+	"IRQ fixup: irq [0-9]+ move in progress, old vector [0-9]+" _
+	/* i915 tests set module options, expected message */
+	"Setting dangerous option [a-z_]+ - tainting kernel" _
+	/* Raw printk() call, uses default log level (warn) */
+	"Suspending console\\(s\\) \\(use no_console_suspend to debug\\)" _
+	"atkbd serio[0-9]+: Failed to (deactivate|enable) keyboard on isa[0-9]+/serio[0-9]+" _
+	"cache: parent cpu[0-9]+ should not be sleeping" _
+	"hpet[0-9]+: lost [0-9]+ rtc interrupts" _
+	/* i915 selftests terminate normally with ENODEV from the
+	 * module load after the testing finishes, which produces this
+	 * message.
+	 */
+	"i915: probe of [0-9a-fA-F:.]+ failed with error -25" _
+	/* swiotbl warns even when asked not to */
+	"mock: DMA: Out of SW-IOMMU space for [0-9]+ bytes" _
+	"usb usb[0-9]+: root hub lost power or was reset"
+	;
+#undef _
+
+static const char igt_piglit_style_dmesg_blacklist[] =
+	"(\\[drm:|drm_|intel_|i915_|\\[drm\\])";
+
+static bool parse_number(const char **p, unsigned long long *val)
+{
+	const char *s = *p;
+	unsigned long long v = 0;
+
+	if (!isdigit(*s))
+		return false;
+
+	while (isdigit(*s))
+		v = v * 10 + (*s++ - '0');
+
+	*val = v;
+	*p = s;
+
+	return true;
+}
+
+bool dmesg_parse_record(const char *line, struct dmesg_record *record)
+{
+	unsigned long long flags, seq, ts_usec;
+	const char *p = line;
+	const char *message;
+
+	/* The usual "flags,seq,ts,cont;" without going through sscanf() */
+	if (parse_number(&p, &flags) && *p++ == ',' &&
+	    parse_number(&p, &seq) && *p++ == ',' &&
+	    parse_number(&p, &ts_usec) && *p++ == ',' && *p) {
+		record->flags = flags;
+		record->ts_usec = ts_usec;
+		record->continuation = *p;
+	} else if (sscanf(line, "%u,%llu,%llu,%c;", &record->flags, &seq,
+			  &record->ts_usec, &record->continuation) != 4) {
+		/*
+		 * Machine readable key/value pairs begin with
+		 * a space. We ignore them.
+		 */
+		if (line[0] != ' ') {
+			fprintf(stderr, "Cannot parse kmsg record: %s\n", line);
+		}
+		return false;
+	}
+
+	message = strchr(line, ';');
+	if (!message) {
+		fprintf(stderr, "No ; found in kmsg record, this shouldn't happen\n");
+		return false;
+	}
+	message++;
+
+	record->message = message;
+	record->message_len = strlen(message);
+
+	return true;
+}
+
+static int hex_value(char c)
+{
+	return isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+}
+
+static bool decode_hex_escape(const char *p, int *c)
+{
+	if (isxdigit(p[2]) && isxdigit(p[3])) {
+		*c = hex_value(p[2]) << 4 | hex_value(p[3]);
+		return true;
+	}
+
+	return sscanf(p, "\\x%2x", c) == 1;
+}
+
+size_t dmesg_format_record(const struct dmesg_record *record, char *buf)
+{
+	const char *message = record->message;
+	size_t messagelen = record->message_len;
+	size_t i;
+	char *f;
+
+	f = buf + snprintf(buf, DMESG_PREFIX_MAX,
+			   "<%u> [%llu.%06llu] ",
+			   record->flags & 0x07,
+			   record->ts_usec / 1000000,
+			   record->ts_usec % 1000000);
+
+	/* Decoding the hex escapes only makes the string shorter */
+	for (i = 0; i < messagelen; i++, f++) {
+		const char *p = message + i;
+
+		if (i + 4 < messagelen && p[0] == '\\' && p[1] == 'x') {
+			int c = 0;
+			/* newline and tab are not isprint(), but they are isspace() */
+			if (decode_hex_escape(p, &c) &&
+			    (isprint(c) || isspace(c))) {
+				*f = c;
+				i += 3;
+				continue;
+			}
+		}
+		*f = *p;
+	}
+	*f = '\0';
+
+	return f - buf;
+}
+
+static bool append_pattern(char **pattern, const char *regex)
+{
+	size_t len = *pattern ? strlen(*pattern) : 0;
+	char *new;
+
+	new = realloc(*pattern, len + strlen(regex) + sizeof("|(?:)"));
+	if (!new)
+		return false;
+
+	sprintf(new + len, "%s(?:%s)", len ? "|" : "", regex);
+	*pattern = new;
+
+	return true;
+}
+
+/*
+ * Reads the suppressions file, one regex per line with # starting a
+ * comment like in blacklists, into an alternation of all of them.
+ */
+static bool read_suppressions(const char *filename, char **pattern)
+{
+	char *line = NULL;
+	size_t line_len = 0;
+	bool status = true;
+	FILE *f;
+
+	if ((f = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, "Cannot open dmesg suppressions file %s\n", filename);
+		return false;
+	}
+
+	while (status) {
+		size_t str_size = 0, idx = 0;
+		GError *err = NULL;
+		GRegex *re;
+
+		if (getline(&line, &line_len, f) == -1) {
+			if (errno == EINTR)
+				continue;
+			else
+				break;
+		}
+
+		while (line[idx] != '\n' && line[idx] != '\0' && line[idx] != '#') {
+			if (!isspace(line[idx]))
+				str_size = idx + 1;
+			idx++;
+		}
+		if (str_size == 0)
+			continue;
+		line[str_size] = '\0';
+
+		/* Compiled alone first, to point out the broken one */
+		re = g_regex_new(line, 0, 0, &err);
+		if (err) {
+			fprintf(stderr, "Invalid dmesg suppression '%s' in %s: %s\n",
+				line, filename, err->message);
+			g_error_free(err);
+			status = false;
+			break;
+		}
+		g_regex_unref(re);
+
+		status = append_pattern(pattern, line);
+	}
+
+	free(line);
+	fclose(f);
+
+	return status;
+}
+
+static GRegex *compile(const char *pattern)
+{
+	GError *err = NULL;
+	GRegex *re;
+
+	re = g_regex_new(pattern, G_REGEX_OPTIMIZE, 0, &err);
+	if (err) {
+		fprintf(stderr, "Cannot compile dmesg regexp\n");
+		g_error_free(err);
+		return NULL;
+	}
+
+	return re;
+}
+
+bool dmesg_classifier_init(struct dmesg_classifier *classifier,
+			   const struct settings *settings)
+{
+	char *pattern = NULL, *suppressions = NULL;
+	bool ok = false;
+
+	memset(classifier, 0, sizeof(*classifier));
+	classifier->warn_level = settings->dmesg_warn_level;
+	classifier->piglit_style = settings->piglit_style_dmesg;
+
+	if (!classifier->piglit_style && !append_pattern(&pattern, igt_dmesg_whitelist))
+		goto out;
+
+	if (settings->dmesg_suppressions &&
+	    !read_suppressions(settings->dmesg_suppressions,
+			       classifier->piglit_style ? &suppressions : &pattern))
+		goto out;
+
+	classifier->re = compile(classifier->piglit_style ?
+				 igt_piglit_style_dmesg_blacklist : pattern);
+	if (!classifier->re)
+		goto out;
+
+	if (suppressions) {
+		classifier->suppressions = compile(suppressions);
+		if (!classifier->suppressions)
+			goto out;
+	}
+
+	ok = true;
+
+out:
+	if (!ok)
+		dmesg_classifier_fini(classifier);
+	free(pattern);
+	free(suppressions);
+
+	return ok;
+}
+
+void dmesg_classifier_fini(struct dmesg_classifier *classifier)
+{
+	if (classifier->re)
+		g_regex_unref(classifier->re);
+	if (classifier->suppressions)
+		g_regex_unref(classifier->suppressions);
+
+	classifier->re = classifier->suppressions = NULL;
+}
+
+bool dmesg_is_warning(const struct dmesg_classifier *classifier,
+		      const struct dmesg_record *record)
+{
+	if ((int)(record->flags & 0x07) > classifier->warn_level ||
+	    record->continuation == 'c')
+		return false;
+
+	if (classifier->piglit_style)
+		return g_regex_match(classifier->re, record->message, 0, NULL) &&
+			!(classifier->suppressions &&
+			  g_regex_match(classifier->suppressions, record->message, 0, NULL));
+
+	return !g_regex_match(classifier->re, record->message, 0, NULL);
+}
@@ -0,0 +1,70 @@
+#ifndef RUNNER_DMESG_CLASSIFIER_H
+#define RUNNER_DMESG_CLASSIFIER_H
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "settings.h"
+
+/* A kmsg record, as read from /dev/kmsg into dmesg.txt */
+struct dmesg_record {
+	unsigned flags;
+	unsigned long long ts_usec;
+	char continuation;
+	/* Points into the parsed line, up to and including its newline */
+	const char *message;
+	size_t message_len;
+};
+
+/* Room needed for the "<level> [seconds.usec] " prefix of a formatted record */
+#define DMESG_PREFIX_MAX 48
+
+/*
+ * Parses a line of dmesg.txt. Lines that aren't records are complained
+ * about, except for the machine readable key/value lines that follow
+ * records.
+ *
+ * Returns: True if @line is a record.
+ */
+bool dmesg_parse_record(const char *line, struct dmesg_record *record);
+
+/*
+ * Formats @record like dmesg does, with the printable \xNN escapes of the
+ * message decoded, into @buf that needs room for DMESG_PREFIX_MAX +
+ * @record->message_len + 1 bytes.
+ *
+ * Returns: The length of the formatted record.
+ */
+size_t dmesg_format_record(const struct dmesg_record *record, char *buf);
+
+/*
+ * Decides which records are warnings that change test results. Records
+ * above the warning level, and continuations, are never warnings and are
+ * told apart without any regex matching. The rest are matched against
+ * one pattern combined from the built-in list and the suppressions,
+ * compiled once for all the results.
+ */
+struct dmesg_classifier {
+	int warn_level;
+	bool piglit_style;
+	/* The whitelist and suppressions, or the piglit-style blacklist */
+	GRegex *re;
+	/* Suppressions in piglit-style mode, NULL if there are none */
+	GRegex *suppressions;
+};
+
+/*
+ * Sets up @classifier for @settings, reading the suppressions file if
+ * one is set. Errors are reported to stderr.
+ *
+ * Returns: True on success.
+ */
+bool dmesg_classifier_init(struct dmesg_classifier *classifier,
+			   const struct settings *settings);
+void dmesg_classifier_fini(struct dmesg_classifier *classifier);
+
+bool dmesg_is_warning(const struct dmesg_classifier *classifier,
+		      const struct dmesg_record *record);
+
+#endif
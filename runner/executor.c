@@ -28,6 +28,7 @@
 #include "igt_core.h"
 #include "igt_taints.h"
 #include "executor.h"
+#include "logfile.h"
 #include "output_strings.h"
 
 #define KMSG_HEADER "[IGT] "
@@ -393,10 +394,9 @@ static void prune_subtest(struct job_list_entry *entry, char *subtest)
 	entry->subtests[entry->subtest_count - 1] = excl;
 }
 
-static bool prune_from_journal(struct job_list_entry *entry, int fd)
+static bool prune_from_journal_file(struct job_list_entry *entry, FILE *f)
 {
 	char *subtest;
-	FILE *f;
 	size_t pruned = 0;
 	size_t old_count = entry->subtest_count;
 
@@ -405,10 +405,6 @@ static bool prune_from_journal(struct job_list_entry *entry, int fd)
 	 * the line 'exit:$exitcode (time)', or 'timeout:$exitcode (time)'.
 	 */
 
-	f = fdopen(fd, "r");
-	if (!f)
-		return false;
-
 	while (fscanf(f, "%ms", &subtest) == 1) {
 		if (!strncmp(subtest, EXECUTOR_EXIT, strlen(EXECUTOR_EXIT))) {
 			/* Fully done. Mark that by making the binary name invalid. */
@@ -430,8 +426,6 @@ static bool prune_from_journal(struct job_list_entry *entry, int fd)
 		pruned++;
 	}
 
-	fclose(f);
-
 	/*
 	 * If we know the subtests we originally wanted to run, check
 	 * if we got an equal amount already.
@@ -442,6 +436,240 @@ static bool prune_from_journal(struct job_list_entry *entry, int fd)
 	return pruned > 0;
 }
 
+static bool prune_from_journal(struct job_list_entry *entry, int fd)
+{
+	FILE *f;
+	bool ret;
+
+	f = fdopen(fd, "r");
+	if (!f)
+		return false;
+
+	ret = prune_from_journal_file(entry, f);
+	fclose(f);
+
+	return ret;
+}
+
+/*
+ * The progress ledger is an append-only file in the results directory
+ * mirroring the journals of all tests, with the subtest results added.
+ * Each line is prefixed with the index of the job list entry:
+ *
+ *   '$idx B' when the entry begins, after its journal is created
+ *   '$idx S $subtest' when a subtest is journaled as started
+ *   '$idx R $subtest $result' when a subtest finishes
+ *   '$idx E $exitline' for the exit or timeout line of the journal
+ *
+ * Results and exits are synced right away, so after a crash the ledger
+ * knows at least as much as the journals. Resuming reads the ledger
+ * backwards to the lines of the last entry begun, instead of looking
+ * for the last result directory and reading its journal. Results
+ * directories without a ledger, or with one that doesn't match the
+ * result directories, are resumed from the journals.
+ */
+static const char progress_ledger[] = "progress.txt";
+
+static struct {
+	int fd;
+	size_t idx;
+} ledger = { .fd = -1 };
+
+static void open_ledger(int resdirfd)
+{
+	ledger.fd = openat(resdirfd, progress_ledger,
+			   O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+	if (ledger.fd < 0) {
+		errf("Warning: Cannot open %s, resuming will use the journals: %m\n",
+		     progress_ledger);
+		return;
+	}
+
+	fsync(resdirfd);
+}
+
+static void close_ledger(void)
+{
+	if (ledger.fd >= 0)
+		close(ledger.fd);
+	ledger.fd = -1;
+}
+
+__attribute__((format(printf, 2, 3)))
+static void ledger_printf(bool sync, const char *fmt, ...)
+{
+	char *line;
+	va_list ap;
+	int len;
+
+	if (ledger.fd < 0)
+		return;
+
+	va_start(ap, fmt);
+	len = vasprintf(&line, fmt, ap);
+	va_end(ap);
+
+	if (len < 0)
+		return;
+
+	/* One write per record, a crash can only tear the last line */
+	if (write(ledger.fd, line, len) != len) {
+		errf("Warning: Cannot write to %s, resuming will use the journals: %m\n",
+		     progress_ledger);
+		close_ledger();
+	} else if (sync) {
+		fdatasync(ledger.fd);
+	}
+
+	free(line);
+}
+
+/*
+ * Finds the lines of the last entry in the ledger, reading it backwards
+ * in blocks. An entry re-run after a timeout begins again right after
+ * its earlier lines, so they are all part of the last run of lines with
+ * the same index. The returned buffer holds the ledger from the first
+ * of those lines on.
+ */
+static char *read_ledger_tail(int fd, size_t *len)
+{
+	const size_t blocksize = 4096;
+	char *buf = NULL, *first, *line, *next, *run = NULL;
+	size_t idx, runidx = 0;
+	struct stat st;
+	off_t off;
+
+	if (fstat(fd, &st))
+		return NULL;
+
+	off = st.st_size;
+	*len = 0;
+
+	while (off > 0) {
+		size_t n = off < (off_t)blocksize ? (size_t)off : blocksize;
+		char *newbuf = malloc(n + *len + 1);
+
+		off -= n;
+		if (pread(fd, newbuf, n, off) != (ssize_t)n) {
+			free(newbuf);
+			break;
+		}
+
+		memcpy(newbuf + n, buf, *len);
+		*len += n;
+		newbuf[*len] = '\0';
+		free(buf);
+		buf = newbuf;
+
+		/* The first line is whole only at the start of the file */
+		first = buf;
+		if (off > 0 && (first = strchr(buf, '\n')) != NULL)
+			first++;
+
+		run = NULL;
+		for (line = first; line && (next = strchr(line, '\n')) != NULL; line = next + 1) {
+			if (sscanf(line, "%zu", &idx) != 1)
+				idx = -1;
+
+			if (!run || idx != runidx) {
+				run = line;
+				runidx = idx;
+			}
+		}
+
+		/* Done when a line of another entry precedes the run */
+		if (run && (off == 0 || run != first))
+			break;
+
+		run = NULL;
+	}
+
+	if (!run) {
+		free(buf);
+		return NULL;
+	}
+
+	*len -= run - buf;
+	memmove(buf, run, *len + 1);
+
+	return buf;
+}
+
+/*
+ * Reads the index of the last entry begun from the ledger, and rebuilds
+ * its journal from the ledger lines of that entry.
+ *
+ * Returns: True if the ledger could be used.
+ */
+static bool read_ledger(int dirfd, size_t size, size_t *idx,
+			char **journal, size_t *journallen)
+{
+	char *buf, *line, *next, *last_started = NULL;
+	size_t len, lineidx;
+	FILE *f;
+	int fd, pos;
+	char type = 0;
+	bool ok = true;
+
+	if ((fd = openat(dirfd, progress_ledger, O_RDONLY)) < 0)
+		return false;
+
+	buf = read_ledger_tail(fd, &len);
+	close(fd);
+	if (!buf)
+		return false;
+
+	*journal = NULL;
+	*journallen = 0;
+	f = open_memstream(journal, journallen);
+
+	if (sscanf(buf, "%zu %c", idx, &type) != 2 || type != 'B' || *idx >= size)
+		ok = false;
+
+	/* A torn last line without a newline is ignored */
+	for (line = buf; ok && (next = strchr(line, '\n')) != NULL; line = next + 1) {
+		*next = '\0';
+
+		if (sscanf(line, "%zu %c %n", &lineidx, &type, &pos) != 2 ||
+		    lineidx != *idx) {
+			ok = false;
+			break;
+		}
+
+		switch (type) {
+		case 'B':
+			break;
+		case 'S':
+			fprintf(f, "%s\n", line + pos);
+			last_started = line + pos;
+			break;
+		case 'R':
+			/* Journaled if the start of the subtest wasn't */
+			*strchrnul(line + pos, ' ') = '\0';
+			if (!last_started || strcmp(last_started, line + pos))
+				fprintf(f, "%s\n", line + pos);
+			last_started = NULL;
+			break;
+		case 'E':
+			fprintf(f, "%s\n", line + pos);
+			break;
+		default:
+			ok = false;
+			break;
+		}
+	}
+
+	fclose(f);
+	free(buf);
+
+	if (!ok) {
+		free(*journal);
+		*journal = NULL;
+	}
+
+	return ok;
+}
+
 static const char *filenames[_F_LAST] = {
 	[_F_JOURNAL] = "journal.txt",
 	[_F_OUT] = "out.txt",
@@ -449,37 +677,45 @@ static const char *filenames[_F_LAST] = {
 	[_F_DMESG] = "dmesg.txt",
 };
 
-static int open_at_end(int dirfd, const char *name)
+bool open_output_files(int dirfd, int *fds)
 {
-	int fd = openat(dirfd, name, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
-	char last;
+	int i;
 
-	if (fd >= 0) {
-		if (lseek(fd, -1, SEEK_END) >= 0 &&
-		    read(fd, &last, 1) == 1 &&
-		    last != '\n') {
-			write(fd, "\n", 1);
+	for (i = 0; i < _F_LAST; i++) {
+		if ((fds[i] = logfile_open_for_reading(dirfd, filenames[i])) < 0) {
+			while (--i >= 0)
+				close(fds[i]);
+			return false;
 		}
-		lseek(fd, 0, SEEK_END);
 	}
 
-	return fd;
+	return true;
 }
 
-static int open_for_reading(int dirfd, const char *name)
+void close_outputs(int *fds)
 {
-	return openat(dirfd, name, O_RDONLY);
+	int i;
+
+	for (i = 0; i < _F_LAST; i++) {
+		close(fds[i]);
+	}
 }
 
-bool open_output_files(int dirfd, int *fds, bool write)
+/*
+ * The journal is never compressed: it's tiny, and resuming needs to read
+ * it and append to it as is.
+ */
+static bool open_output_logs(int dirfd, struct logfile *logs,
+			     struct settings *settings)
 {
 	int i;
-	int (*openfunc)(int, const char*) = write ? open_at_end : open_for_reading;
 
 	for (i = 0; i < _F_LAST; i++) {
-		if ((fds[i] = openfunc(dirfd, filenames[i])) < 0) {
+		bool compress = settings->compress_logs && i != _F_JOURNAL;
+
+		if (!logfile_open(&logs[i], dirfd, filenames[i], compress)) {
 			while (--i >= 0)
-				close(fds[i]);
+				logfile_close(&logs[i]);
 			return false;
 		}
 	}
@@ -487,17 +723,24 @@ bool open_output_files(int dirfd, int *fds, bool write)
 	return true;
 }
 
-void close_outputs(int *fds)
+static void flush_output_logs(struct logfile *logs)
 {
 	int i;
 
-	for (i = 0; i < _F_LAST; i++) {
-		close(fds[i]);
-	}
+	for (i = 0; i < _F_LAST; i++)
+		logfile_flush(&logs[i]);
+}
+
+static void close_output_logs(struct logfile *logs)
+{
+	int i;
+
+	for (i = 0; i < _F_LAST; i++)
+		logfile_close(&logs[i]);
 }
 
 /* Returns the number of bytes written to disk, or a negative number on error */
-static long dump_dmesg(int kmsgfd, int outfd)
+static long dump_dmesg(int kmsgfd, struct logfile *log)
 {
 	/*
 	 * Write kernel messages to the log file until we reach
@@ -566,8 +809,7 @@ static long dump_dmesg(int kmsgfd, int outfd)
 			return written;
 		}
 
-		write(outfd, buf, r);
-		written += r;
+		written += logfile_write(log, buf, r);
 
 		if (comparefd < 0 && sscanf(buf, "%u,%llu,%llu,%c;",
 					    &flags, &seq, &usec, &cont) == 4) {
@@ -766,7 +1008,7 @@ static int next_kill_signal(int killed)
  */
 static int monitor_output(pid_t child,
 			  int outfd, int errfd, int kmsgfd, int sigfd,
-			  int *outputs,
+			  struct logfile *outputs,
 			  double *time_spent,
 			  struct settings *settings,
 			  char **abortreason)
@@ -844,6 +1086,10 @@ static int monitor_output(pid_t child,
 			return -1;
 		}
 
+		/* Nothing to log for a while, get the logs on disk */
+		if (n == 0)
+			flush_output_logs(outputs);
+
 		igt_gettime(&time_now);
 
 		/* TODO: Refactor these handlers to their own functions */
@@ -863,10 +1109,9 @@ static int monitor_output(pid_t child,
 				goto out_end;
 			}
 
-			write(outputs[_F_OUT], buf, s);
-			disk_usage += s;
+			disk_usage += logfile_write(&outputs[_F_OUT], buf, s);
 			if (settings->sync) {
-				fdatasync(outputs[_F_OUT]);
+				logfile_sync(&outputs[_F_OUT]);
 			}
 
 			outbuf = realloc(outbuf, outbufsize + s);
@@ -878,11 +1123,14 @@ static int monitor_output(pid_t child,
 
 				if (linelen > strlen(STARTING_SUBTEST) &&
 				    !memcmp(outbuf, STARTING_SUBTEST, strlen(STARTING_SUBTEST))) {
-					write(outputs[_F_JOURNAL], outbuf + strlen(STARTING_SUBTEST),
-					      linelen - strlen(STARTING_SUBTEST));
+					logfile_write(&outputs[_F_JOURNAL], outbuf + strlen(STARTING_SUBTEST),
+						      linelen - strlen(STARTING_SUBTEST));
 					if (settings->sync) {
-						fdatasync(outputs[_F_JOURNAL]);
+						logfile_sync(&outputs[_F_JOURNAL]);
 					}
+					ledger_printf(settings->sync, "%zu S %.*s", ledger.idx,
+						      (int)(linelen - strlen(STARTING_SUBTEST)),
+						      outbuf + strlen(STARTING_SUBTEST));
 					memcpy(current_subtest, outbuf + strlen(STARTING_SUBTEST),
 					       linelen - strlen(STARTING_SUBTEST));
 					current_subtest[linelen - strlen(STARTING_SUBTEST)] = '\0';
@@ -900,19 +1148,33 @@ static int monitor_output(pid_t child,
 
 					if (delim != NULL) {
 						size_t subtestlen = delim - outbuf - strlen(SUBTEST_RESULT);
+						const char *result;
+						size_t resultlen;
+
 						if (memcmp(current_subtest, outbuf + strlen(SUBTEST_RESULT),
 							   subtestlen)) {
 							/* Result for a test that didn't ever start */
-							write(outputs[_F_JOURNAL],
-							      outbuf + strlen(SUBTEST_RESULT),
-							      subtestlen);
-							write(outputs[_F_JOURNAL], "\n", 1);
+							logfile_write(&outputs[_F_JOURNAL],
+								      outbuf + strlen(SUBTEST_RESULT),
+								      subtestlen);
+							logfile_write(&outputs[_F_JOURNAL], "\n", 1);
 							if (settings->sync) {
-								fdatasync(outputs[_F_JOURNAL]);
+								logfile_sync(&outputs[_F_JOURNAL]);
 							}
 							current_subtest[0] = '\0';
 						}
 
+						/* The result word, followed by the time */
+						result = delim + 1;
+						while (result < newline && *result == ' ')
+							result++;
+						resultlen = 0;
+						while (result + resultlen < newline && result[resultlen] != ' ')
+							resultlen++;
+						ledger_printf(true, "%zu R %.*s %.*s\n", ledger.idx,
+							      (int)subtestlen, outbuf + strlen(SUBTEST_RESULT),
+							      (int)resultlen, result);
+
 						if (settings->log_level >= LOG_LEVEL_VERBOSE) {
 							fwrite(outbuf, 1, linelen, stdout);
 						}
@@ -955,10 +1217,9 @@ static int monitor_output(pid_t child,
 				close(errfd);
 				errfd = -1;
 			} else {
-				write(outputs[_F_ERR], buf, s);
-				disk_usage += s;
+				disk_usage += logfile_write(&outputs[_F_ERR], buf, s);
 				if (settings->sync) {
-					fdatasync(outputs[_F_ERR]);
+					logfile_sync(&outputs[_F_ERR]);
 				}
 			}
 		}
@@ -968,9 +1229,9 @@ static int monitor_output(pid_t child,
 
 			time_last_activity = time_now;
 
-			dmesgwritten = dump_dmesg(kmsgfd, outputs[_F_DMESG]);
+			dmesgwritten = dump_dmesg(kmsgfd, &outputs[_F_DMESG]);
 			if (settings->sync)
-				fdatasync(outputs[_F_DMESG]);
+				logfile_sync(&outputs[_F_DMESG]);
 
 			if (dmesgwritten < 0) {
 				close(kmsgfd);
@@ -1032,11 +1293,13 @@ static int monitor_output(pid_t child,
 					if (settings->log_level >= LOG_LEVEL_NORMAL)
 						outf("Exiting gracefully, currently running test will have a 'notrun' result\n");
 
-					dprintf(outputs[_F_JOURNAL], "%s%d (%.3fs)\n",
-						EXECUTOR_EXIT,
-						-SIGHUP, 0.0);
+					logfile_printf(&outputs[_F_JOURNAL], "%s%d (%.3fs)\n",
+						       EXECUTOR_EXIT,
+						       -SIGHUP, 0.0);
 					if (settings->sync)
-						fdatasync(outputs[_F_JOURNAL]);
+						logfile_sync(&outputs[_F_JOURNAL]);
+					ledger_printf(true, "%zu E %s%d (%.3fs)\n", ledger.idx,
+						      EXECUTOR_EXIT, -SIGHUP, 0.0);
 				}
 
 				aborting = true;
@@ -1082,11 +1345,11 @@ static int monitor_output(pid_t child,
 					 * have newlines on both ends
 					 * of this injection though.
 					 */
-					dprintf(outputs[_F_OUT],
-						"\nrunner: This test was killed due to a kernel taint (0x%lx).\n",
-						taints);
+					logfile_printf(&outputs[_F_OUT],
+						       "\nrunner: This test was killed due to a kernel taint (0x%lx).\n",
+						       taints);
 					if (settings->sync)
-						fdatasync(outputs[_F_OUT]);
+						logfile_sync(&outputs[_F_OUT]);
 				}
 
 				/*
@@ -1095,21 +1358,23 @@ static int monitor_output(pid_t child,
 				 */
 				if (killed && disk_usage_limit_exceeded(settings, disk_usage)) {
 					exitline = EXECUTOR_EXIT;
-					dprintf(outputs[_F_OUT],
-						"\nrunner: This test was killed due to exceeding disk usage limit. "
-						"(Used %zd bytes, limit %zd)\n",
-						disk_usage,
-						settings->disk_usage_limit);
+					logfile_printf(&outputs[_F_OUT],
+						       "\nrunner: This test was killed due to exceeding disk usage limit. "
+						       "(Used %zd bytes, limit %zd)\n",
+						       disk_usage,
+						       settings->disk_usage_limit);
 					if (settings->sync)
-						fdatasync(outputs[_F_OUT]);
+						logfile_sync(&outputs[_F_OUT]);
 				}
 
-				dprintf(outputs[_F_JOURNAL], "%s%d (%.3fs)\n",
-					exitline,
-					status, time);
+				logfile_printf(&outputs[_F_JOURNAL], "%s%d (%.3fs)\n",
+					       exitline,
+					       status, time);
 				if (settings->sync) {
-					fdatasync(outputs[_F_JOURNAL]);
+					logfile_sync(&outputs[_F_JOURNAL]);
 				}
+				ledger_printf(true, "%zu E %s%d (%.3fs)\n", ledger.idx,
+					      exitline, status, time);
 
 				if (status == IGT_EXIT_ABORT) {
 					errf("Test exited with IGT_EXIT_ABORT, aborting.\n");
@@ -1145,9 +1410,9 @@ static int monitor_output(pid_t child,
 					asprintf(abortreason, "Child refuses to die, tainted 0x%lx.", taints);
 				}
 
-				dump_dmesg(kmsgfd, outputs[_F_DMESG]);
+				dump_dmesg(kmsgfd, &outputs[_F_DMESG]);
 				if (settings->sync)
-					fdatasync(outputs[_F_DMESG]);
+					logfile_sync(&outputs[_F_DMESG]);
 
 				close_watchdogs(settings);
 				free(outbuf);
@@ -1169,9 +1434,9 @@ static int monitor_output(pid_t child,
 		}
 	}
 
-	dump_dmesg(kmsgfd, outputs[_F_DMESG]);
+	dump_dmesg(kmsgfd, &outputs[_F_DMESG]);
 	if (settings->sync)
-		fdatasync(outputs[_F_DMESG]);
+		logfile_sync(&outputs[_F_DMESG]);
 
 	free(outbuf);
 	close(outfd);
@@ -1314,7 +1579,7 @@ static int execute_next_entry(struct execute_state *state,
 			      char **abortreason)
 {
 	int dirfd;
-	int outputs[_F_LAST];
+	struct logfile outputs[_F_LAST];
 	int kmsgfd;
 	int outpipe[2] = { -1, -1 };
 	int errpipe[2] = { -1, -1 };
@@ -1331,7 +1596,7 @@ static int execute_next_entry(struct execute_state *state,
 		return -1;
 	}
 
-	if (!open_output_files(dirfd, outputs, true)) {
+	if (!open_output_logs(dirfd, outputs, settings)) {
 		errf("Error opening output files\n");
 		result = -1;
 		goto out_dirfd;
@@ -1342,6 +1607,9 @@ static int execute_next_entry(struct execute_state *state,
 		fsync(resdirfd);
 	}
 
+	ledger.idx = idx;
+	ledger_printf(true, "%zu B\n", idx);
+
 	if (pipe(outpipe) || pipe(errpipe)) {
 		errf("Error creating pipes: %m\n");
 		result = -1;
@@ -1413,12 +1681,12 @@ static int execute_next_entry(struct execute_state *state,
 out_kmsgfd:
 	close(kmsgfd);
 out_pipe:
-	close_outputs(outputs);
+	close_output_logs(outputs);
 	close(outpipe[0]);
 	close(outpipe[1]);
 	close(errpipe[0]);
 	close(errpipe[1]);
-	close_outputs(outputs);
+	close_output_logs(outputs);
 out_dirfd:
 	close(dirfd);
 
@@ -1435,7 +1703,7 @@ static bool clear_test_result_directory(int dirfd)
 	int i;
 
 	for (i = 0; i < _F_LAST; i++) {
-		if (remove_file(dirfd, filenames[i])) {
+		if (logfile_unlink(dirfd, filenames[i])) {
 			errf("Error deleting %s from test result directory: %m\n",
 			     filenames[i]);
 			return false;
@@ -1466,7 +1734,8 @@ static bool clear_old_results(char *path)
 	if (remove_file(dirfd, "uname.txt") ||
 	    remove_file(dirfd, "starttime.txt") ||
 	    remove_file(dirfd, "endtime.txt") ||
-	    remove_file(dirfd, "aborted.txt")) {
+	    remove_file(dirfd, "aborted.txt") ||
+	    remove_file(dirfd, progress_ledger)) {
 		close(dirfd);
 		errf("Error clearing old results: %m\n");
 		return false;
@@ -1539,13 +1808,66 @@ static void init_time_left(struct execute_state *state,
 		state->time_left = settings->overall_timeout;
 }
 
+static bool result_directory_exists(int dirfd, size_t idx)
+{
+	char name[32];
+	int fd;
+
+	snprintf(name, sizeof(name), "%zu", idx);
+	if ((fd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) < 0)
+		return false;
+
+	close(fd);
+	return true;
+}
+
+/*
+ * The ledger is only trusted if the entry it last began is the last one
+ * with a result directory. A runner without the ledger might have
+ * continued the run, or the crash came between creating the result
+ * directory and beginning the entry in the ledger.
+ */
+static bool resume_from_ledger(int dirfd, struct execute_state *state,
+			       struct job_list *list)
+{
+	struct job_list_entry *entry;
+	char *journal;
+	size_t idx, journallen;
+	bool pruned = false;
+	FILE *f;
+
+	if (!read_ledger(dirfd, list->size, &idx, &journal, &journallen))
+		return false;
+
+	if (!result_directory_exists(dirfd, idx) ||
+	    result_directory_exists(dirfd, idx + 1)) {
+		free(journal);
+		return false;
+	}
+
+	entry = &list->entries[idx];
+	if (journallen > 0 && (f = fmemopen(journal, journallen, "r")) != NULL) {
+		pruned = prune_from_journal_file(entry, f);
+		fclose(f);
+	}
+	free(journal);
+
+	/* Same as resuming from the journal of the entry */
+	if (!pruned || entry->binary[0] == '\0')
+		state->next = idx + 1;
+	else
+		state->next = idx;
+
+	return true;
+}
+
 bool initialize_execute_state_from_resume(int dirfd,
 					  struct execute_state *state,
 					  struct settings *settings,
 					  struct job_list *list)
 {
 	struct job_list_entry *entry;
-	int resdirfd, fd, i;
+	int resdirfd = -1, fd, i;
 
 	free_settings(settings);
 	free_job_list(list);
@@ -1566,6 +1888,9 @@ bool initialize_execute_state_from_resume(int dirfd,
 
 	init_time_left(state, settings);
 
+	if (resume_from_ledger(dirfd, state, list))
+		goto success;
+
 	for (i = list->size; i >= 0; i--) {
 		char name[32];
 
@@ -1971,6 +2296,8 @@ bool execute(struct execute_state *state,
 		}
 	}
 
+	open_ledger(resdirfd);
+
 	for (; state->next < job_list->size;
 	     state->next++) {
 		char *reason = NULL;
@@ -2043,6 +2370,7 @@ bool execute(struct execute_state *state,
 			}
 			close(sigfd);
 			close(testdirfd);
+			close_ledger();
 			if (!initialize_execute_state_from_resume(resdirfd, state, settings, job_list))
 				return false;
 			state->time_left = time_left;
@@ -2073,6 +2401,7 @@ bool execute(struct execute_state *state,
 	if (should_die_because_signal(sigfd))
 		status = false;
  end_post_signal_restore:
+	close_ledger();
 	close(sigfd);
 	close(testdirfd);
 	close(resdirfd);
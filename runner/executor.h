@@ -25,7 +25,11 @@ enum {
 	_F_LAST,
 };
 
-bool open_output_files(int dirfd, int *fds, bool write);
+/*
+ * Opens the output files of a test for reading. Compressed logs are
+ * decompressed.
+ */
+bool open_output_files(int dirfd, int *fds);
 void close_outputs(int *fds);
 
 /*
@@ -0,0 +1,383 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "logfile.h"
+
+/*
+ * Compressed logs are written as one deflate stream per gzip member,
+ * flushed with Z_SYNC_FLUSH so that everything up to the last flush can
+ * be decompressed even if the member never gets finished, like when the
+ * machine dies mid-test. Members are finished every LOGFILE_MEMBER_SIZE
+ * bytes of input to bound how much a damaged member can take with it.
+ */
+#define LOGFILE_MEMBER_SIZE (1 << 20)
+#define LOGFILE_FLUSH_INTERVAL 1.0
+#define LOGFILE_COMPRESSION_LEVEL 3
+#define CHUNK_SIZE (64 << 10)
+
+static double elapsed_since(const struct timespec *then)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - then->tv_sec) + 1e-9 * (now.tv_nsec - then->tv_nsec);
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, buf, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+
+		buf = (const char *)buf + ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static void compressed_name(char *buf, size_t size, const char *name)
+{
+	snprintf(buf, size, "%s%s", name, LOGFILE_COMPRESSED_SUFFIX);
+}
+
+/*
+ * Decompresses the gzip members of @fd to @outfd, up to the end of the
+ * file or the first damaged data. *@complete_out is set to the amount
+ * of decompressed data from complete members.
+ *
+ * Returns: The size of the complete members in @fd, or -1 on error.
+ */
+static off_t inflate_members(int fd, int outfd, off_t *complete_out)
+{
+	unsigned char *in, *out;
+	off_t offset = 0, complete = 0, written = 0;
+	z_stream zs = {};
+	size_t have;
+	ssize_t r;
+	int ret;
+
+	*complete_out = 0;
+
+	if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+		return -1;
+
+	in = malloc(CHUNK_SIZE);
+	out = malloc(CHUNK_SIZE);
+	if (!in || !out) {
+		complete = -1;
+		goto out;
+	}
+
+	for (;;) {
+		if (zs.avail_in == 0) {
+			r = pread(fd, in, CHUNK_SIZE, offset);
+			if (r <= 0)
+				break;
+
+			offset += r;
+			zs.next_in = in;
+			zs.avail_in = r;
+		}
+
+		zs.next_out = out;
+		zs.avail_out = CHUNK_SIZE;
+		ret = inflate(&zs, Z_NO_FLUSH);
+		if (ret != Z_OK && ret != Z_STREAM_END)
+			break;
+
+		have = CHUNK_SIZE - zs.avail_out;
+		if (have && !write_all(outfd, out, have)) {
+			complete = -1;
+			break;
+		}
+		written += have;
+
+		if (ret == Z_STREAM_END) {
+			complete = offset - zs.avail_in;
+			*complete_out = written;
+			inflateReset(&zs);
+		}
+	}
+
+out:
+	inflateEnd(&zs);
+	free(in);
+	free(out);
+
+	return complete;
+}
+
+static size_t deflate_out(struct logfile *log, int flush)
+{
+	unsigned char out[16384];
+	size_t written = 0, have;
+	int ret;
+
+	do {
+		log->zs->next_out = out;
+		log->zs->avail_out = sizeof(out);
+		ret = deflate(log->zs, flush);
+
+		have = sizeof(out) - log->zs->avail_out;
+		if (have && !write_all(log->fd, out, have))
+			break;
+		written += have;
+	} while (log->zs->avail_out == 0 && ret != Z_STREAM_END);
+
+	return written;
+}
+
+static size_t finish_member(struct logfile *log)
+{
+	size_t written = deflate_out(log, Z_FINISH);
+
+	deflateReset(log->zs);
+	log->member_size = 0;
+	log->pending = false;
+	clock_gettime(CLOCK_MONOTONIC, &log->last_flush);
+
+	return written;
+}
+
+static bool open_plain(struct logfile *log, int dirfd, const char *name)
+{
+	char last;
+
+	log->fd = openat(dirfd, name, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (log->fd < 0)
+		return false;
+
+	if (lseek(log->fd, -1, SEEK_END) >= 0 &&
+	    read(log->fd, &last, 1) == 1 &&
+	    last != '\n') {
+		write(log->fd, "\n", 1);
+	}
+	lseek(log->fd, 0, SEEK_END);
+
+	return true;
+}
+
+/*
+ * Appending to a compressed log that wasn't closed properly would leave
+ * its unfinished member in the middle of the file, where gzip readers
+ * stop. The unfinished member is cut off and its contents compressed
+ * again as the start of the new one.
+ */
+static void recover_unfinished_member(struct logfile *log)
+{
+	off_t complete, uncompressed, size;
+	char *tail;
+	int scratch;
+
+	scratch = memfd_create("logfile", MFD_CLOEXEC);
+	if (scratch < 0)
+		return;
+
+	complete = inflate_members(log->fd, scratch, &uncompressed);
+	size = lseek(scratch, 0, SEEK_END);
+	if (complete < 0 || ftruncate(log->fd, complete)) {
+		close(scratch);
+		return;
+	}
+	lseek(log->fd, 0, SEEK_END);
+
+	if (size > uncompressed) {
+		tail = malloc(size - uncompressed);
+		if (tail && pread(scratch, tail, size - uncompressed, uncompressed) ==
+		    size - uncompressed)
+			logfile_write(log, tail, size - uncompressed);
+		free(tail);
+	}
+
+	if (size > 0) {
+		char last;
+
+		if (pread(scratch, &last, 1, size - 1) == 1 && last != '\n')
+			logfile_write(log, "\n", 1);
+	}
+
+	close(scratch);
+}
+
+static bool open_compressed(struct logfile *log, int dirfd, const char *name)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	compressed_name(path, sizeof(path), name);
+	log->fd = openat(dirfd, path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (log->fd < 0)
+		return false;
+
+	log->zs = calloc(1, sizeof(*log->zs));
+	if (!log->zs ||
+	    deflateInit2(log->zs, LOGFILE_COMPRESSION_LEVEL, Z_DEFLATED,
+			 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		free(log->zs);
+		log->zs = NULL;
+		close(log->fd);
+		log->fd = -1;
+		return false;
+	}
+
+	if (fstat(log->fd, &st) == 0 && st.st_size > 0)
+		recover_unfinished_member(log);
+	else
+		lseek(log->fd, 0, SEEK_END);
+
+	return true;
+}
+
+bool logfile_open(struct logfile *log, int dirfd, const char *name,
+		  bool compress)
+{
+	memset(log, 0, sizeof(*log));
+	log->fd = -1;
+	clock_gettime(CLOCK_MONOTONIC, &log->last_flush);
+
+	if (compress)
+		return open_compressed(log, dirfd, name);
+
+	return open_plain(log, dirfd, name);
+}
+
+size_t logfile_write(struct logfile *log, const void *buf, size_t len)
+{
+	size_t written;
+	ssize_t ret;
+
+	if (!log->zs) {
+		ret = write(log->fd, buf, len);
+		return ret > 0 ? ret : 0;
+	}
+
+	log->zs->next_in = (unsigned char *)buf;
+	log->zs->avail_in = len;
+	written = deflate_out(log, Z_NO_FLUSH);
+
+	log->member_size += len;
+	log->pending = true;
+
+	if (log->member_size >= LOGFILE_MEMBER_SIZE)
+		written += finish_member(log);
+	else if (elapsed_since(&log->last_flush) >= LOGFILE_FLUSH_INTERVAL)
+		written += logfile_flush(log);
+
+	return written;
+}
+
+size_t logfile_printf(struct logfile *log, const char *fmt, ...)
+{
+	char *str = NULL;
+	size_t written;
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vasprintf(&str, fmt, ap);
+	va_end(ap);
+
+	if (len < 0)
+		return 0;
+
+	written = logfile_write(log, str, len);
+	free(str);
+
+	return written;
+}
+
+size_t logfile_flush(struct logfile *log)
+{
+	size_t written;
+
+	if (!log->zs || !log->pending)
+		return 0;
+
+	written = deflate_out(log, Z_SYNC_FLUSH);
+	log->pending = false;
+	clock_gettime(CLOCK_MONOTONIC, &log->last_flush);
+
+	return written;
+}
+
+void logfile_sync(struct logfile *log)
+{
+	logfile_flush(log);
+	fdatasync(log->fd);
+}
+
+void logfile_close(struct logfile *log)
+{
+	if (log->fd < 0)
+		return;
+
+	if (log->zs) {
+		if (log->member_size)
+			finish_member(log);
+
+		deflateEnd(log->zs);
+		free(log->zs);
+		log->zs = NULL;
+	}
+
+	close(log->fd);
+	log->fd = -1;
+}
+
+int logfile_open_for_reading(int dirfd, const char *name)
+{
+	char path[PATH_MAX];
+	off_t complete;
+	int fd, gzfd;
+
+	fd = openat(dirfd, name, O_RDONLY);
+	if (fd >= 0 || errno != ENOENT)
+		return fd;
+
+	compressed_name(path, sizeof(path), name);
+	gzfd = openat(dirfd, path, O_RDONLY);
+	if (gzfd < 0)
+		return -1;
+
+	fd = memfd_create(name, MFD_CLOEXEC);
+	if (fd >= 0 && inflate_members(gzfd, fd, &complete) < 0) {
+		close(fd);
+		fd = -1;
+	}
+	close(gzfd);
+
+	if (fd >= 0)
+		lseek(fd, 0, SEEK_SET);
+
+	return fd;
+}
+
+int logfile_unlink(int dirfd, const char *name)
+{
+	char path[PATH_MAX];
+
+	if (unlinkat(dirfd, name, 0) && errno != ENOENT)
+		return -1;
+
+	compressed_name(path, sizeof(path), name);
+	if (unlinkat(dirfd, path, 0) && errno != ENOENT)
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef RUNNER_LOGFILE_H
+#define RUNNER_LOGFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/*
+ * Compressed logs are stored next to where the plain ones would be,
+ * with this suffix appended to the name. They are a series of gzip
+ * members, so zcat and friends can read them.
+ */
+#define LOGFILE_COMPRESSED_SUFFIX ".gz"
+
+struct z_stream_s;
+
+struct logfile {
+	int fd;
+
+	/* NULL if the log isn't compressed */
+	struct z_stream_s *zs;
+	/* Uncompressed bytes in the current gzip member */
+	size_t member_size;
+	/* Input that deflate still holds on to */
+	bool pending;
+	struct timespec last_flush;
+};
+
+/*
+ * Opens the log file @name in @dirfd for appending, creating it if
+ * needed. With @compress, the compressed log is opened instead. When
+ * appending to a log that doesn't end in a newline, a newline is added
+ * first.
+ *
+ * Returns: True on success.
+ */
+bool logfile_open(struct logfile *log, int dirfd, const char *name,
+		  bool compress);
+
+/*
+ * Appends @len bytes from @buf to the log.
+ *
+ * Returns: The number of bytes written to the file. For compressed
+ * logs this lags behind the data given, and is smaller.
+ */
+size_t logfile_write(struct logfile *log, const void *buf, size_t len);
+
+__attribute__((format(printf, 2, 3)))
+size_t logfile_printf(struct logfile *log, const char *fmt, ...);
+
+/*
+ * Writes out all data given so far, so that it can be read back even
+ * if the log is never closed. Compressed logs are flushed this way at
+ * least once a second as they get written to.
+ *
+ * Returns: The number of bytes written to the file.
+ */
+size_t logfile_flush(struct logfile *log);
+
+/* Flushes the log and syncs it to disk. */
+void logfile_sync(struct logfile *log);
+
+/* Flushes and closes the log. Closing an already closed log is a no-op. */
+void logfile_close(struct logfile *log);
+
+/*
+ * Opens the log file @name in @dirfd for reading, or if it doesn't
+ * exist, the compressed log decompressed to an anonymous file. A
+ * compressed log that wasn't closed properly is read up to its last
+ * flush.
+ *
+ * Returns: A file descriptor for reading, or -1 on error.
+ */
+int logfile_open_for_reading(int dirfd, const char *name);
+
+/*
+ * Removes both the plain and compressed log file @name in @dirfd.
+ *
+ * Returns: 0 on success or if neither exist.
+ */
+int logfile_unlink(int dirfd, const char *name);
+
+#endif
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
@@ -9,10 +10,13 @@
 #include <unistd.h>
 
 #include <json.h>
+#include <printbuf.h>
 
 #include "igt_aux.h"
 #include "igt_core.h"
+#include "dmesg_classifier.h"
 #include "resultgen.h"
+#include "results_bin.h"
 #include "settings.h"
 #include "executor.h"
 #include "output_strings.h"
@@ -38,11 +42,51 @@ struct subtest_list
 	size_t size;
 };
 
+/*
+ * When writing results.json, the large text fields (test output and dmesg)
+ * aren't copied into json-c strings. They are kept where they were read or
+ * formatted, and their json objects are placeholders referring to them. The
+ * placeholders serialize as themselves, and get replaced by the escaped text
+ * as the file is written; see write_results(). json-c escapes control
+ * characters in every other string, so the marker can't appear elsewhere.
+ */
+#define DEFERRED_TEXT_MARKER '\001'
+
+struct deferred_text
+{
+	struct json_object *obj;
+	const char *buf;
+	size_t len;
+};
+
+struct mapping
+{
+	void *addr;
+	size_t len;
+};
+
+struct text_arena
+{
+	struct deferred_text *texts;
+	size_t size, capacity;
+
+	/* Released once the results are written */
+	char **buffers;
+	size_t num_buffers;
+	struct mapping *mappings;
+	size_t num_mappings;
+};
+
 struct results
 {
 	struct json_object *tests;
 	struct json_object *totals;
 	struct json_object *runtimes;
+
+	/* NULL if text fields are plain json-c strings */
+	struct text_arena *texts;
+
+	struct dmesg_classifier dmesg;
 };
 
 static void add_dynamic_subtest(struct subtest *subtest, char *dynamic)
@@ -147,12 +191,32 @@ static const char *next_line(const char *line, const char *bufend)
 		return NULL;
 }
 
-static void append_line(char **buf, size_t *buflen, char *line)
+/*
+ * Buffers grown by append_line() are sized to the next power of two of
+ * their length, so that the allocated size needn't be tracked separately.
+ */
+static size_t line_buffer_size(size_t len)
 {
-	size_t linelen = strlen(line);
+	size_t size = 64;
 
-	*buf = realloc(*buf, *buflen + linelen + 1);
-	strcpy(*buf + *buflen, line);
+	while (size < len)
+		size *= 2;
+
+	return size;
+}
+
+static void append_line(char **buf, size_t *buflen, const char *line,
+			size_t linelen)
+{
+	size_t needed = *buflen + linelen + 1;
+
+	if (*buf == NULL || needed > line_buffer_size(*buflen + 1)) {
+		*buf = realloc(*buf, line_buffer_size(needed));
+		assert(*buf);
+	}
+
+	memcpy(*buf + *buflen, line, linelen);
+	(*buf)[*buflen + linelen] = '\0';
 	*buflen += linelen;
 }
 
@@ -407,22 +471,17 @@ static void free_matches(struct matches *matches)
 	free(matches->items);
 }
 
-static struct json_object *new_escaped_json_string(const char *buf, size_t len)
+/*
+ * Test output may be garbage; strings passed to json-c need to be UTF-8
+ * encoded so any non-ASCII characters are converted to their UTF-8
+ * representation, which requires 2 bytes per character. @str needs room
+ * for @len * 2 bytes.
+ */
+static size_t convert_to_utf8(char *str, const char *buf, size_t len)
 {
-	struct json_object *obj;
-	char *str = NULL;
 	size_t strsize = 0;
 	size_t i;
 
-	/*
-	 * Test output may be garbage; strings passed to json-c need to be
-	 * UTF-8 encoded so any non-ASCII characters are converted to their
-	 * UTF-8 representation, which requires 2 bytes per character.
-	 */
-	str = malloc(len * 2);
-	if (!str)
-		return NULL;
-
 	for (i = 0; i < len; i++) {
 		if (buf[i] > 0 && buf[i] < 128) {
 			str[strsize] = buf[i];
@@ -435,12 +494,153 @@ static struct json_object *new_escaped_json_string(const char *buf, size_t len)
 		}
 	}
 
+	return strsize;
+}
+
+static struct json_object *new_escaped_json_string(const char *buf, size_t len)
+{
+	struct json_object *obj;
+	char *str = NULL;
+	size_t strsize;
+
+	str = malloc(len * 2);
+	if (!str)
+		return NULL;
+
+	strsize = convert_to_utf8(str, buf, len);
+
 	obj = json_object_new_string_len(str, strsize);
 	free(str);
 
 	return obj;
 }
 
+static int serialize_deferred_text(struct json_object *obj,
+				   struct printbuf *pb,
+				   int level,
+				   int flags)
+{
+	/* The placeholder, as is, for write_results() to find */
+	return printbuf_memappend(pb, json_object_get_string(obj),
+				  json_object_get_string_len(obj));
+}
+
+static struct json_object *new_text_field(struct results *results,
+					  const char *buf, size_t len)
+{
+	struct text_arena *arena = results->texts;
+	struct deferred_text *text;
+	struct json_object *obj;
+	char placeholder[32];
+
+	if (!arena || len == 0)
+		return new_escaped_json_string(buf, len);
+
+	if (arena->size == arena->capacity) {
+		arena->capacity = arena->capacity ? arena->capacity * 2 : 256;
+		arena->texts = realloc(arena->texts,
+				       arena->capacity * sizeof(*arena->texts));
+		assert(arena->texts);
+	}
+
+	snprintf(placeholder, sizeof(placeholder), "%c%zu%c",
+		 DEFERRED_TEXT_MARKER, arena->size, DEFERRED_TEXT_MARKER);
+	obj = json_object_new_string(placeholder);
+	json_object_set_serializer(obj, serialize_deferred_text, NULL, NULL);
+
+	text = &arena->texts[arena->size++];
+	text->obj = obj;
+	text->buf = buf;
+	text->len = len;
+
+	return obj;
+}
+
+static struct deferred_text *find_deferred_text(struct text_arena *arena,
+						struct json_object *obj)
+{
+	const char *str = json_object_get_string(obj);
+
+	if (arena && str[0] == DEFERRED_TEXT_MARKER) {
+		size_t idx = strtoul(str + 1, NULL, 10);
+
+		if (idx < arena->size && arena->texts[idx].obj == obj)
+			return &arena->texts[idx];
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns the text of a field created by new_text_field(). Deferred texts
+ * are returned as read, without the UTF-8 conversion.
+ */
+static const char *get_text_field(struct results *results,
+				  struct json_object *obj,
+				  size_t *len)
+{
+	struct deferred_text *text = find_deferred_text(results->texts, obj);
+
+	if (text) {
+		*len = text->len;
+		return text->buf;
+	}
+
+	*len = json_object_get_string_len(obj);
+	return json_object_get_string(obj);
+}
+
+/* Frees @buf, or keeps it until written if text fields refer to it. */
+static void release_text(struct results *results, char *buf)
+{
+	struct text_arena *arena = results->texts;
+
+	if (!arena || !buf) {
+		free(buf);
+		return;
+	}
+
+	arena->buffers = realloc(arena->buffers,
+				 (arena->num_buffers + 1) * sizeof(*arena->buffers));
+	assert(arena->buffers);
+	arena->buffers[arena->num_buffers++] = buf;
+}
+
+static void release_mapping(struct results *results, void *addr, size_t len)
+{
+	struct text_arena *arena = results->texts;
+
+	if (!addr)
+		return;
+
+	if (!arena) {
+		munmap(addr, len);
+		return;
+	}
+
+	arena->mappings = realloc(arena->mappings,
+				  (arena->num_mappings + 1) * sizeof(*arena->mappings));
+	assert(arena->mappings);
+	arena->mappings[arena->num_mappings].addr = addr;
+	arena->mappings[arena->num_mappings].len = len;
+	arena->num_mappings++;
+}
+
+static void free_text_arena(struct text_arena *arena)
+{
+	size_t i;
+
+	for (i = 0; i < arena->num_buffers; i++)
+		free(arena->buffers[i]);
+	for (i = 0; i < arena->num_mappings; i++)
+		munmap(arena->mappings[i].addr, arena->mappings[i].len);
+
+	free(arena->buffers);
+	free(arena->mappings);
+	free(arena->texts);
+	memset(arena, 0, sizeof(*arena));
+}
+
 static void add_igt_version(struct json_object *testobj,
 			    const char *igt_version,
 			    size_t igt_version_len)
@@ -603,9 +803,10 @@ static void process_dynamic_subtest_output(const char *piglit_name,
 					   const char *beg,
 					   const char *end,
 					   const char *key,
-					   struct json_object *tests,
+					   struct results *results,
 					   struct subtest *subtest)
 {
+	struct json_object *tests = results->tests;
 	size_t k;
 
 	if (result_idx < 0) {
@@ -645,7 +846,7 @@ static void process_dynamic_subtest_output(const char *piglit_name,
 		current_dynamic_test = get_or_create_json_object(tests, dynamic_piglit_name);
 
 		json_object_object_add(current_dynamic_test, key,
-				       new_escaped_json_string(dynbeg, dynend - dynbeg));
+				       new_text_field(results, dynbeg, dynend - dynbeg));
 		add_igt_version(current_dynamic_test, igt_version, igt_version_len);
 
 		if (!json_object_object_get_ex(current_dynamic_test, "result", NULL)) {
@@ -687,10 +888,12 @@ static void process_dynamic_subtest_output(const char *piglit_name,
 
 static bool fill_from_output(int fd, const char *binary, const char *key,
 			     struct subtest_list *subtests,
-			     struct json_object *tests)
+			     struct results *results)
 {
+	struct json_object *tests = results->tests;
 	char *buf, *bufend, *nullchr;
 	struct stat statbuf;
+	size_t mapsize;
 	char piglit_name[256];
 	char *igt_version = NULL;
 	size_t igt_version_len = 0;
@@ -708,6 +911,7 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 	if (fstat(fd, &statbuf))
 		return false;
 
+	mapsize = statbuf.st_size;
 	if (statbuf.st_size != 0) {
 		buf = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
 		if (buf == MAP_FAILED)
@@ -739,9 +943,10 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 		current_test = get_or_create_json_object(tests, piglit_name);
 
 		json_object_object_add(current_test, key,
-				       new_escaped_json_string(buf, statbuf.st_size));
+				       new_text_field(results, buf, statbuf.st_size));
 		add_igt_version(current_test, igt_version, igt_version_len);
 
+		release_mapping(results, buf, mapsize);
 		return true;
 	}
 
@@ -763,7 +968,7 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 		end = find_subtest_end_limit(matches, begin_idx, result_idx, buf, bufend);
 
 		json_object_object_add(current_test, key,
-				       new_escaped_json_string(beg, end - beg));
+				       new_text_field(results, beg, end - beg));
 
 		add_igt_version(current_test, igt_version, igt_version_len);
 
@@ -783,157 +988,34 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 					       begin_idx, result_idx,
 					       beg, end,
 					       key,
-					       tests,
+					       results,
 					       &subtests->subs[i]);
 	}
 
 	free_matches(&matches);
+	release_mapping(results, buf, mapsize);
 	return true;
 }
 
-/*
- * This regexp controls the kmsg handling. All kernel log records that
- * have log level of warning or higher convert the result to
- * dmesg-warn/dmesg-fail unless they match this regexp.
- *
- * TODO: Move this to external files, i915-suppressions.txt,
- * general-suppressions.txt et al.
- */
-
-#define _ "|"
-static const char igt_dmesg_whitelist[] =
-	"ACPI: button: The lid device is not compliant to SW_LID" _
-	"ACPI: .*: Unable to dock!" _
-	"IRQ [0-9]+: no longer affine to CPU[0-9]+" _
-	"IRQ fixup: irq [0-9]+ move in progress, old vector [0-9]+" _
-	/* i915 tests set module options, expected message */
-	"Setting dangerous option [a-z_]+ - tainting kernel" _
-	/* Raw printk() call, uses default log level (warn) */
-	"Suspending console\\(s\\) \\(use no_console_suspend to debug\\)" _
-	"atkbd serio[0-9]+: Failed to (deactivate|enable) keyboard on isa[0-9]+/serio[0-9]+" _
-	"cache: parent cpu[0-9]+ should not be sleeping" _
-	"hpet[0-9]+: lost [0-9]+ rtc interrupts" _
-	/* i915 selftests terminate normally with ENODEV from the
-	 * module load after the testing finishes, which produces this
-	 * message.
-	 */
-	"i915: probe of [0-9a-fA-F:.]+ failed with error -25" _
-	/* swiotbl warns even when asked not to */
-	"mock: DMA: Out of SW-IOMMU space for [0-9]+ bytes" _
-	"usb usb[0-9]+: root hub lost power or was reset"
-	;
-#undef _
-
-static const char igt_piglit_style_dmesg_blacklist[] =
-	"(\\[drm:|drm_|intel_|i915_|\\[drm\\])";
-
-static bool init_regex_whitelist(struct settings* settings, GRegex **re)
-{
-	GError *err = NULL;
-	const char *regex = settings->piglit_style_dmesg ?
-		igt_piglit_style_dmesg_blacklist :
-		igt_dmesg_whitelist;
-
-	*re = g_regex_new(regex, G_REGEX_OPTIMIZE, 0, &err);
-	if (err) {
-		fprintf(stderr, "Cannot compile dmesg regexp\n");
-		g_error_free(err);
-		return false;
-	}
-
-	return true;
-}
-
-static bool parse_dmesg_line(char* line,
-			     unsigned *flags, unsigned long long *ts_usec,
-			     char *continuation, char **message)
-{
-	unsigned long long seq;
-	int s;
-
-	s = sscanf(line, "%u,%llu,%llu,%c;", flags, &seq, ts_usec, continuation);
-	if (s != 4) {
-		/*
-		 * Machine readable key/value pairs begin with
-		 * a space. We ignore them.
-		 */
-		if (line[0] != ' ') {
-			fprintf(stderr, "Cannot parse kmsg record: %s\n", line);
-		}
-		return false;
-	}
-
-	*message = strchr(line, ';');
-	if (!message) {
-		fprintf(stderr, "No ; found in kmsg record, this shouldn't happen\n");
-		return false;
-	}
-	(*message)++;
-
-	return true;
-}
-
-static void generate_formatted_dmesg_line(char *message,
-					  unsigned flags,
-					  unsigned long long ts_usec,
-					  char **formatted)
-{
-	char prefix[512];
-	size_t messagelen;
-	size_t prefixlen;
-	char *p, *f;
-
-	snprintf(prefix, sizeof(prefix),
-		 "<%u> [%llu.%06llu] ",
-		 flags & 0x07,
-		 ts_usec / 1000000,
-		 ts_usec % 1000000);
-
-	messagelen = strlen(message);
-	prefixlen = strlen(prefix);
-
-	/*
-	 * Decoding the hex escapes only makes the string shorter, so
-	 * we can use the original length
-	 */
-	*formatted = malloc(strlen(prefix) + messagelen + 1);
-	strcpy(*formatted, prefix);
-
-	f = *formatted + prefixlen;
-	for (p = message; *p; p++, f++) {
-		if (p - message + 4 < messagelen &&
-		    p[0] == '\\' && p[1] == 'x') {
-			int c = 0;
-			/* newline and tab are not isprint(), but they are isspace() */
-			if (sscanf(p, "\\x%2x", &c) == 1 &&
-			    (isprint(c) || isspace(c))) {
-				*f = c;
-				p += 3;
-				continue;
-			}
-		}
-		*f = *p;
-	}
-	*f = '\0';
-}
-
-static void add_dmesg(struct json_object *obj,
+static void add_dmesg(struct results *results,
+		      struct json_object *obj,
 		      const char *dmesg, size_t dmesglen,
 		      const char *warnings, size_t warningslen)
 {
 	json_object_object_add(obj, "dmesg",
-			       new_escaped_json_string(dmesg, dmesglen));
+			       new_text_field(results, dmesg, dmesglen));
 
 	if (warnings) {
 		json_object_object_add(obj, "dmesg-warnings",
-				       new_escaped_json_string(warnings, warningslen));
+				       new_text_field(results, warnings, warningslen));
 	}
 }
 
-static void add_empty_dmesgs_where_missing(struct json_object *tests,
+static void add_empty_dmesgs_where_missing(struct results *results,
 					   char *binary,
 					   struct subtest_list *subtests)
 {
+	struct json_object *tests = results->tests;
 	struct json_object *current_test;
 	char piglit_name[256];
 	char dynamic_piglit_name[256];
@@ -943,7 +1025,7 @@ static void add_empty_dmesgs_where_missing(struct json_object *tests,
 		generate_piglit_name(binary, subtests->subs[i].name, piglit_name, sizeof(piglit_name));
 		current_test = get_or_create_json_object(tests, piglit_name);
 		if (!json_object_object_get_ex(current_test, "dmesg", NULL)) {
-			add_dmesg(current_test, "", 0, NULL, 0);
+			add_dmesg(results, current_test, "", 0, NULL, 0);
 		}
 
 		for (k = 0; k < subtests->subs[i].dynamic_size; k++) {
@@ -951,7 +1033,7 @@ static void add_empty_dmesgs_where_missing(struct json_object *tests,
 							 dynamic_piglit_name, sizeof(dynamic_piglit_name));
 			current_test = get_or_create_json_object(tests, dynamic_piglit_name);
 			if (!json_object_object_get_ex(current_test, "dmesg", NULL)) {
-				add_dmesg(current_test, "", 0, NULL, 0);
+				add_dmesg(results, current_test, "", 0, NULL, 0);
 			}
 		}
 	}
@@ -959,11 +1041,11 @@ static void add_empty_dmesgs_where_missing(struct json_object *tests,
 }
 
 static bool fill_from_dmesg(int fd,
-			    struct settings *settings,
 			    char *binary,
 			    struct subtest_list *subtests,
-			    struct json_object *tests)
+			    struct results *results)
 {
+	struct json_object *tests = results->tests;
 	char *line = NULL;
 	char *warnings = NULL, *dynamic_warnings = NULL;
 	char *dmesg = NULL, *dynamic_dmesg = NULL;
@@ -975,46 +1057,48 @@ static bool fill_from_dmesg(int fd,
 	FILE *f = fdopen(fd, "r");
 	char piglit_name[256];
 	char dynamic_piglit_name[256];
+	char *formatted = NULL;
+	size_t formatted_size = 0, formattedlen;
 	ssize_t read;
 	size_t i;
-	GRegex *re;
 
 	if (!f) {
 		return false;
 	}
 
-	if (!init_regex_whitelist(settings, &re)) {
-		fclose(f);
-		return false;
-	}
-
 	while ((read = getline(&line, &linelen, f)) > 0) {
-		char *formatted;
-		unsigned flags;
-		unsigned long long ts_usec;
-		char continuation;
-		char *message, *subtest, *dynamic_subtest;
+		struct dmesg_record record;
+		char *subtest, *dynamic_subtest;
+		bool marker;
 
-		if (!parse_dmesg_line(line, &flags, &ts_usec, &continuation, &message))
+		if (!dmesg_parse_record(line, &record))
 			continue;
 
-		generate_formatted_dmesg_line(message, flags, ts_usec, &formatted);
+		if (DMESG_PREFIX_MAX + record.message_len + 1 > formatted_size) {
+			formatted_size = DMESG_PREFIX_MAX + record.message_len + 1;
+			formatted = realloc(formatted, formatted_size);
+			assert(formatted);
+		}
+		formattedlen = dmesg_format_record(&record, formatted);
+
+		/* Both subtest markers start alike, and most records have neither */
+		marker = strstr(record.message, ": starting ") != NULL;
 
-		if ((subtest = strstr(message, STARTING_SUBTEST_DMESG)) != NULL) {
+		if (marker && (subtest = strstr(record.message, STARTING_SUBTEST_DMESG)) != NULL) {
 			if (current_test != NULL) {
 				/* Done with the previous subtest, file up */
-				add_dmesg(current_test, dmesg, dmesglen, warnings, warningslen);
+				add_dmesg(results, current_test, dmesg, dmesglen, warnings, warningslen);
 
-				free(dmesg);
-				free(warnings);
+				release_text(results, dmesg);
+				release_text(results, warnings);
 				dmesg = warnings = NULL;
 				dmesglen = warningslen = 0;
 
 				if (current_dynamic_test != NULL)
-					add_dmesg(current_dynamic_test, dynamic_dmesg, dynamic_dmesg_len, dynamic_warnings, dynamic_warnings_len);
+					add_dmesg(results, current_dynamic_test, dynamic_dmesg, dynamic_dmesg_len, dynamic_warnings, dynamic_warnings_len);
 
-				free(dynamic_dmesg);
-				free(dynamic_warnings);
+				release_text(results, dynamic_dmesg);
+				release_text(results, dynamic_warnings);
 				dynamic_dmesg = dynamic_warnings = NULL;
 				dynamic_dmesg_len = dynamic_warnings_len = 0;
 				current_dynamic_test = NULL;
@@ -1025,14 +1109,14 @@ static bool fill_from_dmesg(int fd,
 			current_test = get_or_create_json_object(tests, piglit_name);
 		}
 
-		if (current_test != NULL &&
-		    (dynamic_subtest = strstr(message, STARTING_DYNAMIC_SUBTEST_DMESG)) != NULL) {
+		if (marker && current_test != NULL &&
+		    (dynamic_subtest = strstr(record.message, STARTING_DYNAMIC_SUBTEST_DMESG)) != NULL) {
 			if (current_dynamic_test != NULL) {
 				/* Done with the previous dynamic subtest, file up */
-				add_dmesg(current_dynamic_test, dynamic_dmesg, dynamic_dmesg_len, dynamic_warnings, dynamic_warnings_len);
+				add_dmesg(results, current_dynamic_test, dynamic_dmesg, dynamic_dmesg_len, dynamic_warnings, dynamic_warnings_len);
 
-				free(dynamic_dmesg);
-				free(dynamic_warnings);
+				release_text(results, dynamic_dmesg);
+				release_text(results, dynamic_warnings);
 				dynamic_dmesg = dynamic_warnings = NULL;
 				dynamic_dmesg_len = dynamic_warnings_len = 0;
 			}
@@ -1042,31 +1126,21 @@ static bool fill_from_dmesg(int fd,
 			current_dynamic_test = get_or_create_json_object(tests, dynamic_piglit_name);
 		}
 
-		if (settings->piglit_style_dmesg) {
-			if ((flags & 0x07) <= settings->dmesg_warn_level && continuation != 'c' &&
-			    g_regex_match(re, message, 0, NULL)) {
-				append_line(&warnings, &warningslen, formatted);
-				if (current_test != NULL)
-					append_line(&dynamic_warnings, &dynamic_warnings_len, formatted);
-			}
-		} else {
-			if ((flags & 0x07) <= settings->dmesg_warn_level && continuation != 'c' &&
-			    !g_regex_match(re, message, 0, NULL)) {
-				append_line(&warnings, &warningslen, formatted);
-				if (current_test != NULL)
-					append_line(&dynamic_warnings, &dynamic_warnings_len, formatted);
-			}
+		if (dmesg_is_warning(&results->dmesg, &record)) {
+			append_line(&warnings, &warningslen, formatted, formattedlen);
+			if (current_test != NULL)
+				append_line(&dynamic_warnings, &dynamic_warnings_len, formatted, formattedlen);
 		}
-		append_line(&dmesg, &dmesglen, formatted);
-		append_line(&dynamic_dmesg, &dynamic_dmesg_len, formatted);
-		free(formatted);
+		append_line(&dmesg, &dmesglen, formatted, formattedlen);
+		append_line(&dynamic_dmesg, &dynamic_dmesg_len, formatted, formattedlen);
 	}
+	free(formatted);
 	free(line);
 
 	if (current_test != NULL) {
-		add_dmesg(current_test, dmesg, dmesglen, warnings, warningslen);
+		add_dmesg(results, current_test, dmesg, dmesglen, warnings, warningslen);
 		if (current_dynamic_test != NULL) {
-			add_dmesg(current_dynamic_test, dynamic_dmesg, dynamic_dmesg_len, dynamic_warnings, dynamic_warnings_len);
+			add_dmesg(results, current_dynamic_test, dynamic_dmesg, dynamic_dmesg_len, dynamic_warnings, dynamic_warnings_len);
 		}
 	} else {
 		/*
@@ -1082,23 +1156,22 @@ static bool fill_from_dmesg(int fd,
 			 * there are would have skip as their result
 			 * anyway.
 			 */
-			add_dmesg(current_test, dmesg, dmesglen, NULL, 0);
+			add_dmesg(results, current_test, dmesg, dmesglen, NULL, 0);
 		}
 
 		if (subtests->size == 0) {
 			generate_piglit_name(binary, NULL, piglit_name, sizeof(piglit_name));
 			current_test = get_or_create_json_object(tests, piglit_name);
-			add_dmesg(current_test, dmesg, dmesglen, warnings, warningslen);
+			add_dmesg(results, current_test, dmesg, dmesglen, warnings, warningslen);
 		}
 	}
 
-	add_empty_dmesgs_where_missing(tests, binary, subtests);
+	add_empty_dmesgs_where_missing(results, binary, subtests);
 
-	free(dmesg);
-	free(dynamic_dmesg);
-	free(warnings);
-	free(dynamic_warnings);
-	g_regex_unref(re);
+	release_text(results, dmesg);
+	release_text(results, dynamic_dmesg);
+	release_text(results, warnings);
+	release_text(results, dynamic_warnings);
 	fclose(f);
 	return true;
 }
@@ -1314,21 +1387,24 @@ static bool stderr_contains_warnings(const char *beg, const char *end)
 	return false;
 }
 
-static bool json_field_has_data(struct json_object *obj, const char *key)
+static bool json_field_has_data(struct results *results,
+				struct json_object *obj, const char *key)
 {
 	struct json_object *field;
+	size_t len;
 
 	if (json_object_object_get_ex(obj, key, &field))
-		return strcmp(json_object_get_string(field), "");
+		return get_text_field(results, field, &len) && len;
 
 	return false;
 }
 
-static void override_completely_empty_results(struct json_object *obj)
+static void override_completely_empty_results(struct results *results,
+					      struct json_object *obj)
 {
-	if (json_field_has_data(obj, "out") ||
-	    json_field_has_data(obj, "err") ||
-	    json_field_has_data(obj, "dmesg"))
+	if (json_field_has_data(results, obj, "out") ||
+	    json_field_has_data(results, obj, "err") ||
+	    json_field_has_data(results, obj, "dmesg"))
 		return;
 
 	json_object_object_add(obj, "out",
@@ -1337,21 +1413,23 @@ static void override_completely_empty_results(struct json_object *obj)
 	set_result(obj, "incomplete");
 }
 
-static void override_result_single(struct json_object *obj)
+static void override_result_single(struct results *results,
+				   struct json_object *obj)
 {
 	const char *errtext = "", *result = "";
 	struct json_object *textobj;
 	bool dmesgwarns = false;
+	size_t errlen = 0;
 
 	if (json_object_object_get_ex(obj, "err", &textobj))
-		errtext = json_object_get_string(textobj);
+		errtext = get_text_field(results, textobj, &errlen);
 	if (json_object_object_get_ex(obj, "result", &textobj))
 		result = json_object_get_string(textobj);
 	if (json_object_object_get_ex(obj, "dmesg-warnings", &textobj))
 		dmesgwarns = true;
 
 	if (!strcmp(result, "pass") &&
-	    stderr_contains_warnings(errtext, errtext + strlen(errtext))) {
+	    stderr_contains_warnings(errtext, errtext + errlen)) {
 		set_result(obj, "warn");
 		result = "warn";
 	}
@@ -1364,13 +1442,14 @@ static void override_result_single(struct json_object *obj)
 		}
 	}
 
-	override_completely_empty_results(obj);
+	override_completely_empty_results(results, obj);
 }
 
 static void override_results(char *binary,
 			     struct subtest_list *subtests,
-			     struct json_object *tests)
+			     struct results *results)
 {
+	struct json_object *tests = results->tests;
 	struct json_object *obj;
 	char piglit_name[256];
 	char dynamic_piglit_name[256];
@@ -1379,20 +1458,20 @@ static void override_results(char *binary,
 	if (subtests->size == 0) {
 		generate_piglit_name(binary, NULL, piglit_name, sizeof(piglit_name));
 		obj = get_or_create_json_object(tests, piglit_name);
-		override_result_single(obj);
+		override_result_single(results, obj);
 		return;
 	}
 
 	for (i = 0; i < subtests->size; i++) {
 		generate_piglit_name(binary, subtests->subs[i].name, piglit_name, sizeof(piglit_name));
 		obj = get_or_create_json_object(tests, piglit_name);
-		override_result_single(obj);
+		override_result_single(results, obj);
 
 		for (k = 0; k < subtests->subs[i].dynamic_size; k++) {
 			generate_piglit_name_for_dynamic(piglit_name, subtests->subs[i].dynamic_names[k],
 							 dynamic_piglit_name, sizeof(dynamic_piglit_name));
 			obj = get_or_create_json_object(tests, dynamic_piglit_name);
-			override_result_single(obj);
+			override_result_single(results, obj);
 		}
 	}
 }
@@ -1507,7 +1586,7 @@ static bool parse_test_directory(int dirfd,
 	struct subtest_list subtests = {};
 	bool status = true;
 
-	if (!open_output_files(dirfd, fds, false)) {
+	if (!open_output_files(dirfd, fds)) {
 		fprintf(stderr, "Error opening output files\n");
 		return false;
 	}
@@ -1518,15 +1597,15 @@ static bool parse_test_directory(int dirfd,
 	 */
 	fill_from_journal(fds[_F_JOURNAL], entry, &subtests, results);
 
-	if (!fill_from_output(fds[_F_OUT], entry->binary, "out", &subtests, results->tests) ||
-	    !fill_from_output(fds[_F_ERR], entry->binary, "err", &subtests, results->tests) ||
-	    !fill_from_dmesg(fds[_F_DMESG], settings, entry->binary, &subtests, results->tests)) {
+	if (!fill_from_output(fds[_F_OUT], entry->binary, "out", &subtests, results) ||
+	    !fill_from_output(fds[_F_ERR], entry->binary, "err", &subtests, results) ||
+	    !fill_from_dmesg(fds[_F_DMESG], entry->binary, &subtests, results)) {
 		fprintf(stderr, "Error parsing output files\n");
 		status = false;
 		goto parse_output_end;
 	}
 
-	override_results(entry->binary, &subtests, results->tests);
+	override_results(entry->binary, &subtests, results);
 	prune_subtests(settings, entry, &subtests, results->tests);
 
 	add_to_totals(entry->binary, &subtests, results);
@@ -1587,12 +1666,13 @@ static void create_result_root_nodes(struct json_object *root,
 	json_object_object_add(root, "runtimes", results->runtimes);
 }
 
-struct json_object *generate_results_json(int dirfd)
+static struct json_object *generate_results_tree(int dirfd,
+						 struct text_arena *texts)
 {
 	struct settings settings;
 	struct job_list job_list;
 	struct json_object *obj, *elapsed;
-	struct results results;
+	struct results results = { .texts = texts };
 	int testdirfd, fd;
 	size_t i;
 
@@ -1609,6 +1689,25 @@ struct json_object *generate_results_json(int dirfd)
 		return NULL;
 	}
 
+	/*
+	 * The suppressions file may be gone since the run, results without
+	 * it beat no results at all.
+	 */
+	if (settings.dmesg_suppressions &&
+	    access(settings.dmesg_suppressions, R_OK)) {
+		fprintf(stderr, "resultgen: Cannot read dmesg suppressions %s: %s, "
+			"continuing without them\n",
+			settings.dmesg_suppressions, strerror(errno));
+		free(settings.dmesg_suppressions);
+		settings.dmesg_suppressions = NULL;
+	}
+
+	/* Compiled once here, instead of for each test */
+	if (!dmesg_classifier_init(&results.dmesg, &settings)) {
+		fprintf(stderr, "resultgen: Cannot set up dmesg filtering\n");
+		return NULL;
+	}
+
 	obj = json_object_new_object();
 	json_object_object_add(obj, "__type__", json_object_new_string("TestrunResult"));
 	json_object_object_add(obj, "results_version", json_object_new_int(10));
@@ -1671,6 +1770,7 @@ struct json_object *generate_results_json(int dirfd)
 
 		if (!parse_test_directory(testdirfd, &job_list.entries[i], &settings, &results)) {
 			close(testdirfd);
+			dmesg_classifier_fini(&results.dmesg);
 			return NULL;
 		}
 		close(testdirfd);
@@ -1702,44 +1802,333 @@ struct json_object *generate_results_json(int dirfd)
 		close(fd);
 	}
 
+	dmesg_classifier_fini(&results.dmesg);
 	free_settings(&settings);
 	free_job_list(&job_list);
 
 	return obj;
 }
 
-bool generate_results(int dirfd)
+struct json_object *generate_results_json(int dirfd)
 {
-	struct json_object *obj = generate_results_json(dirfd);
-	const char *json_string;
-	int resultsfd;
+	return generate_results_tree(dirfd, NULL);
+}
 
-	if (obj == NULL)
-		return false;
+struct results_writer
+{
+	int fd;
+	bool failed;
+	size_t len;
+	char buf[64 << 10];
+};
 
-	/* TODO: settings.overwrite */
-	if ((resultsfd = openat(dirfd, "results.json", O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
-		fprintf(stderr, "resultgen: Cannot create results file\n");
-		return false;
+static void writer_flush(struct results_writer *writer)
+{
+	size_t written = 0;
+	ssize_t ret;
+
+	while (!writer->failed && written < writer->len) {
+		ret = write(writer->fd, writer->buf + written, writer->len - written);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			writer->failed = true;
+		else
+			written += ret;
+	}
+
+	writer->len = 0;
+}
+
+static void writer_write(struct results_writer *writer,
+			 const void *buf, size_t len)
+{
+	ssize_t ret;
+
+	if (len > sizeof(writer->buf) - writer->len) {
+		writer_flush(writer);
+
+		/* Large runs go straight from the source to the file */
+		while (!writer->failed && len >= sizeof(writer->buf)) {
+			ret = write(writer->fd, buf, len);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret <= 0) {
+				writer->failed = true;
+				return;
+			}
+			buf = (const char *)buf + ret;
+			len -= ret;
+		}
+	}
+
+	memcpy(writer->buf + writer->len, buf, len);
+	writer->len += len;
+}
+
+/*
+ * How each byte of a text field ends up in results.json: the UTF-8
+ * conversion of new_escaped_json_string(), then escaped by json-c. Built
+ * from json-c itself so that deferred texts are written exactly like json-c
+ * would have written them.
+ */
+static char json_escapes[256][8];
+static uint8_t json_escapes_len[256];
+
+static void init_json_escapes(void)
+{
+	struct json_object *obj;
+	const char *str;
+	size_t len;
+	int c;
+
+	if (json_escapes_len[0])
+		return;
+
+	for (c = 0; c < 256; c++) {
+		char byte = c;
+
+		obj = new_escaped_json_string(&byte, 1);
+		str = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY);
+		len = strlen(str) - 2; /* without the quotes */
+		assert(str[0] == '"' && len > 0 && len < sizeof(json_escapes[c]));
+
+		memcpy(json_escapes[c], str + 1, len);
+		json_escapes_len[c] = len;
+		json_object_put(obj);
+	}
+}
+
+static bool json_escape_is_plain(unsigned char c)
+{
+	return json_escapes_len[c] == 1 && json_escapes[c][0] == (char)c;
+}
+
+static void write_escaped(struct results_writer *writer,
+			  const char *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+	const unsigned char *end = p + len, *run;
+
+	while (p < end) {
+		for (run = p; p < end && json_escape_is_plain(*p); p++)
+			;
+		writer_write(writer, run, p - run);
+
+		if (p < end) {
+			writer_write(writer, json_escapes[*p], json_escapes_len[*p]);
+			p++;
+		}
 	}
+}
 
-	json_string = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY);
+/* Writes @obj like json-c would, streaming the deferred texts. */
+static bool write_results(int fd, struct json_object *obj,
+			  struct text_arena *texts)
+{
+	struct results_writer *writer;
+	const char *json, *marker;
+	char *next;
+	bool ok;
 
-	if (json_string == NULL) {
+	json = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY);
+	if (json == NULL) {
 		fprintf(stderr, "resultgen: Failed to create json representation of the results.\n");
 		fprintf(stderr, "           This usually means that the results are too big\n");
 		fprintf(stderr, "           to fit in the memory as the text representation\n");
 		fprintf(stderr, "           is being created.\n\n");
 		fprintf(stderr, "           Either something was spamming the logs or your\n");
 		fprintf(stderr, "           system is very low on free mem.\n");
+		return false;
+	}
 
-		close(resultsfd);
+	init_json_escapes();
+
+	writer = calloc(1, sizeof(*writer));
+	if (!writer)
 		return false;
+	writer->fd = fd;
+	errno = 0;
+
+	while ((marker = strchr(json, DEFERRED_TEXT_MARKER)) != NULL) {
+		size_t idx = strtoul(marker + 1, &next, 10);
+
+		assert(idx < texts->size && *next == DEFERRED_TEXT_MARKER);
+
+		writer_write(writer, json, marker - json);
+		writer_write(writer, "\"", 1);
+		write_escaped(writer, texts->texts[idx].buf, texts->texts[idx].len);
+		writer_write(writer, "\"", 1);
+
+		json = next + 1;
 	}
 
-	write(resultsfd, json_string, strlen(json_string));
-	close(resultsfd);
-	return true;
+	writer_write(writer, json, strlen(json));
+	writer_flush(writer);
+
+	ok = !writer->failed;
+	if (!ok)
+		fprintf(stderr, "resultgen: Failed to write the results: %s\n",
+			strerror(errno ?: ENOSPC));
+	free(writer);
+
+	return ok;
+}
+
+struct binary_texts
+{
+	struct text_arena *arena;
+	char *buf;
+	size_t size;
+};
+
+/* Gives the binary results the deferred texts as they'd be in results.json */
+static const char *get_binary_text(void *data, struct json_object *field,
+				   size_t *len)
+{
+	struct binary_texts *texts = data;
+	struct deferred_text *text = find_deferred_text(texts->arena, field);
+
+	if (!text) {
+		*len = json_object_get_string_len(field);
+		return json_object_get_string(field);
+	}
+
+	if (text->len * 2 > texts->size) {
+		free(texts->buf);
+		texts->size = text->len * 2;
+		texts->buf = malloc(texts->size);
+		if (!texts->buf) {
+			texts->size = 0;
+			return NULL;
+		}
+	}
+
+	*len = convert_to_utf8(texts->buf, text->buf, text->len);
+	return texts->buf;
+}
+
+static bool write_binary_results(int fd, struct json_object *obj,
+				 struct text_arena *arena)
+{
+	struct binary_texts texts = { .arena = arena };
+	bool ok;
+
+	ok = results_bin_write(fd, obj, get_binary_text, &texts);
+	if (!ok)
+		fprintf(stderr, "resultgen: Failed to write the binary results\n");
+	free(texts.buf);
+
+	return ok;
+}
+
+/* Writes the results to @resultsfd as JSON and/or to @binfd, if not -1 */
+static bool write_results_files(int dirfd, int resultsfd, int binfd)
+{
+	struct text_arena texts = {};
+	struct json_object *obj;
+	bool ok = true;
+
+	obj = generate_results_tree(dirfd, &texts);
+	if (obj == NULL) {
+		free_text_arena(&texts);
+		return false;
+	}
+
+	if (resultsfd >= 0)
+		ok = write_results(resultsfd, obj, &texts);
+	if (ok && binfd >= 0)
+		ok = write_binary_results(binfd, obj, &texts);
+
+	json_object_put(obj);
+	free_text_arena(&texts);
+
+	return ok;
+}
+
+bool generate_results_to_fd(int dirfd, int resultsfd)
+{
+	return write_results_files(dirfd, resultsfd, -1);
+}
+
+#define RESULTS_TMP_SUFFIX ".tmp"
+
+/*
+ * Results files are written under a temporary name and only replace the
+ * previous ones once complete, see finish_results_file().
+ */
+static int create_results_file(int dirfd, const char *name)
+{
+	char tmpname[256];
+	int fd;
+
+	snprintf(tmpname, sizeof(tmpname), "%s" RESULTS_TMP_SUFFIX, name);
+
+	/* TODO: settings.overwrite */
+	if ((fd = openat(dirfd, tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+		fprintf(stderr, "resultgen: Cannot create results file %s\n", name);
+
+	return fd;
+}
+
+static bool finish_results_file(int dirfd, const char *name, int fd, bool ok)
+{
+	char tmpname[256];
+
+	if (fd < 0)
+		return ok;
+
+	snprintf(tmpname, sizeof(tmpname), "%s" RESULTS_TMP_SUFFIX, name);
+	close(fd);
+
+	if (ok && renameat(dirfd, tmpname, dirfd, name)) {
+		fprintf(stderr, "resultgen: Cannot replace results file %s: %s\n",
+			name, strerror(errno));
+		ok = false;
+	}
+
+	if (!ok)
+		unlinkat(dirfd, tmpname, 0);
+
+	return ok;
+}
+
+bool generate_results(int dirfd)
+{
+	struct settings settings;
+	int resultsfd, binfd = -1;
+	bool binary, ok;
+
+	init_settings(&settings);
+	binary = read_settings_from_dir(&settings, dirfd) && settings.binary_results;
+	free_settings(&settings);
+
+	if ((resultsfd = create_results_file(dirfd, "results.json")) < 0)
+		return false;
+
+	if (binary && (binfd = create_results_file(dirfd, RESULTS_BIN_FILENAME)) < 0) {
+		finish_results_file(dirfd, "results.json", resultsfd, false);
+		return false;
+	}
+
+	ok = write_results_files(dirfd, resultsfd, binfd);
+	ok = finish_results_file(dirfd, "results.json", resultsfd, ok);
+	ok = finish_results_file(dirfd, RESULTS_BIN_FILENAME, binfd, ok);
+
+	return ok;
+}
+
+bool generate_binary_results(int dirfd)
+{
+	int binfd;
+	bool ok;
+
+	if ((binfd = create_results_file(dirfd, RESULTS_BIN_FILENAME)) < 0)
+		return false;
+
+	ok = write_results_files(dirfd, -1, binfd);
+
+	return finish_results_file(dirfd, RESULTS_BIN_FILENAME, binfd, ok);
 }
 
 bool generate_results_path(char *resultspath)
@@ -4,8 +4,12 @@
 #include <stdbool.h>
 
 bool generate_results(int dirfd);
+bool generate_results_to_fd(int dirfd, int resultsfd);
 bool generate_results_path(char *resultspath);
 
+/* Writes only the binary results file, see results_bin.h */
+bool generate_binary_results(int dirfd);
+
 struct json_object *generate_results_json(int dirfd);
 
 #endif
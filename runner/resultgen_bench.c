@@ -0,0 +1,248 @@
+/*
+ * Time and peak memory of generating results.json for a synthetic results
+ * directory with large outputs and dmesg, written by streaming the text
+ * fields as generate_results() does and by materializing the whole json-c
+ * representation as generate_results_json() users do. Each run happens in
+ * its own process so the peak memory use is its own.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <json.h>
+
+#include "resultgen.h"
+
+static const char *lines[] = {
+	"Starting the \"frobnicate\" loop, pass\t%u\n",
+	"Checking pipe A, connector HDMI-A-1 (%u/32)\n",
+	"(kms_frob:1234) igt_kms-DEBUG: display: A.0: plane_set_fb(%u)\n",
+	"Stack trace: \\x%02x\\xff garbage \xe9\xff follows\n",
+};
+
+static void write_file(int dirfd, const char *name, const char *buf, size_t len)
+{
+	int fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if (fd < 0 || write(fd, buf, len) != (ssize_t)len) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+
+	close(fd);
+}
+
+static char *fill_text(size_t size, bool dmesg, size_t *len)
+{
+	char *buf = malloc(size + 256);
+	unsigned int n = 0;
+
+	*len = 0;
+	if (!dmesg)
+		*len = sprintf(buf, "IGT-Version: 1.26-bench (x86_64) (Linux: 5.10.0 x86_64)\n");
+
+	while (*len < size) {
+		if (dmesg)
+			*len += sprintf(buf + *len, "6,%u,%llu,-;", n,
+					3216186095083ull + n * 1000ull);
+		*len += sprintf(buf + *len, lines[n % 4], n & 0xff);
+		n++;
+	}
+
+	if (!dmesg)
+		*len += sprintf(buf + *len, "SUCCESS (0.000s)\n");
+
+	return buf;
+}
+
+static char *create_results(unsigned int tests, size_t outsize, size_t dmesgsize)
+{
+	char *path = strdup("/tmp/resultgen-bench-XXXXXX");
+	char *out, *dmesg, name[64];
+	size_t outlen, dmesglen;
+	int dirfd, testfd;
+	FILE *joblist;
+
+	if (!mkdtemp(path)) {
+		perror("mkdtemp");
+		exit(EXIT_FAILURE);
+	}
+
+	dirfd = open(path, O_RDONLY | O_DIRECTORY);
+	out = fill_text(outsize, false, &outlen);
+	dmesg = fill_text(dmesgsize, true, &dmesglen);
+
+	write_file(dirfd, "metadata.txt", "name : resultgen-bench\n", 23);
+	write_file(dirfd, "starttime.txt", "1539953735.111039\n", 18);
+	write_file(dirfd, "endtime.txt", "1539953735.172373\n", 18);
+	write_file(dirfd, "uname.txt", "Linux bench 5.10.0\n", 19);
+
+	joblist = fdopen(openat(dirfd, "joblist.txt", O_WRONLY | O_CREAT | O_TRUNC, 0666), "w");
+	for (unsigned int i = 0; i < tests; i++) {
+		fprintf(joblist, "bench-%u\n", i);
+
+		snprintf(name, sizeof(name), "%u", i);
+		mkdirat(dirfd, name, 0777);
+		testfd = openat(dirfd, name, O_RDONLY | O_DIRECTORY);
+		write_file(testfd, "journal.txt", "exit:0 (0.010s)\n", 16);
+		write_file(testfd, "out.txt", out, outlen);
+		write_file(testfd, "err.txt", out, outlen / 4);
+		write_file(testfd, "dmesg.txt", dmesg, dmesglen);
+		close(testfd);
+	}
+	fclose(joblist);
+
+	free(out);
+	free(dmesg);
+	close(dirfd);
+
+	return path;
+}
+
+static void remove_results(const char *path, unsigned int tests)
+{
+	static const char *files[] = {
+		"journal.txt", "out.txt", "err.txt", "dmesg.txt",
+	};
+	int dirfd = open(path, O_RDONLY | O_DIRECTORY);
+	char name[64];
+
+	for (unsigned int i = 0; i < tests; i++) {
+		int testfd;
+
+		snprintf(name, sizeof(name), "%u", i);
+		testfd = openat(dirfd, name, O_RDONLY | O_DIRECTORY);
+		for (unsigned int f = 0; f < sizeof(files) / sizeof(files[0]); f++)
+			unlinkat(testfd, files[f], 0);
+		close(testfd);
+		unlinkat(dirfd, name, AT_REMOVEDIR);
+	}
+
+	unlinkat(dirfd, "metadata.txt", 0);
+	unlinkat(dirfd, "starttime.txt", 0);
+	unlinkat(dirfd, "endtime.txt", 0);
+	unlinkat(dirfd, "uname.txt", 0);
+	unlinkat(dirfd, "joblist.txt", 0);
+	unlinkat(dirfd, "results.json", 0);
+	close(dirfd);
+	rmdir(path);
+}
+
+static bool generate_materialized(int dirfd)
+{
+	struct json_object *obj = generate_results_json(dirfd);
+	const char *json;
+	size_t len;
+	int fd;
+
+	if (!obj)
+		return false;
+
+	json = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY);
+	if (!json)
+		return false;
+
+	fd = openat(dirfd, "results.json", O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	len = strlen(json);
+	if (fd < 0 || write(fd, json, len) != (ssize_t)len)
+		return false;
+
+	close(fd);
+	json_object_put(obj);
+
+	return true;
+}
+
+static void run(const char *path, const char *mode, bool streamed)
+{
+	struct timespec start, end;
+	struct rusage usage;
+	struct stat st;
+	double secs;
+	int status, dirfd;
+	pid_t child;
+
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	child = fork();
+	if (child == 0) {
+		dirfd = open(path, O_RDONLY | O_DIRECTORY);
+		exit((streamed ? generate_results(dirfd) :
+		      generate_materialized(dirfd)) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	wait4(child, &status, 0, &usage);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+		fprintf(stderr, "%s: generating the results failed\n", mode);
+		exit(EXIT_FAILURE);
+	}
+
+	dirfd = open(path, O_RDONLY | O_DIRECTORY);
+	fstatat(dirfd, "results.json", &st, 0);
+	close(dirfd);
+
+	secs = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+	printf("%-12s %8.3fs %9.1f MB/s %8ld MB peak\n", mode, secs,
+	       st.st_size / secs / (1 << 20), usage.ru_maxrss >> 10);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -n <tests>   Number of test directories (default 16)\n"
+		"  -o <MB>      Size of each out.txt (default 16)\n"
+		"  -d <MB>      Size of each dmesg.txt (default 16)\n"
+		"  -r <reps>    Repetitions (default 3)\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int tests = 16, outsize = 16, dmesgsize = 16;
+	int reps = 3, c;
+	char *path;
+
+	while ((c = getopt(argc, argv, "n:o:d:r:h")) != -1) {
+		switch (c) {
+		case 'n':
+			tests = atoi(optarg);
+			break;
+		case 'o':
+			outsize = atoi(optarg);
+			break;
+		case 'd':
+			dmesgsize = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	path = create_results(tests, (size_t)outsize << 20, (size_t)dmesgsize << 20);
+
+	for (int i = 0; i < reps; i++) {
+		run(path, "streamed", true);
+		run(path, "json-c", false);
+	}
+
+	remove_results(path, tests);
+	free(path);
+
+	return 0;
+}
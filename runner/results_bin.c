@@ -0,0 +1,532 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <json.h>
+
+#include "results_bin.h"
+
+static const char *key_names[RESULTS_BIN_NUM_KEYS] = {
+	[RESULTS_BIN_KEY_OUT] = "out",
+	[RESULTS_BIN_KEY_ERR] = "err",
+	[RESULTS_BIN_KEY_DMESG] = "dmesg",
+	[RESULTS_BIN_KEY_DMESG_WARNINGS] = "dmesg-warnings",
+	[RESULTS_BIN_KEY_IGT_VERSION] = "igt-version",
+	[RESULTS_BIN_KEY_RESULT] = "result",
+	[RESULTS_BIN_KEY_TIME] = "time",
+};
+
+struct string_table {
+	char *buf;
+	size_t size, capacity;
+	/* String to its offset + 1 */
+	GHashTable *offsets;
+};
+
+static uint32_t intern_string(struct string_table *strings, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	gpointer offset;
+
+	offset = g_hash_table_lookup(strings->offsets, str);
+	if (offset)
+		return GPOINTER_TO_UINT(offset) - 1;
+
+	if (strings->size + len > strings->capacity) {
+		strings->capacity = (strings->size + len) * 2;
+		strings->buf = realloc(strings->buf, strings->capacity);
+		if (!strings->buf)
+			return RESULTS_BIN_NONE;
+	}
+
+	memcpy(strings->buf + strings->size, str, len);
+	g_hash_table_insert(strings->offsets, strdup(str),
+			    GUINT_TO_POINTER(strings->size + 1));
+	strings->size += len;
+
+	return strings->size - len;
+}
+
+static int key_from_name(const char *name)
+{
+	int k;
+
+	for (k = 0; k < RESULTS_BIN_NUM_KEYS; k++) {
+		if (!strcmp(name, key_names[k]))
+			return k;
+	}
+
+	return -1;
+}
+
+static bool fill_record(struct results_bin_record *record,
+			struct string_table *strings,
+			const char *name,
+			struct json_object *test)
+{
+	struct json_object *val;
+	int n = 0;
+
+	record->name = intern_string(strings, name);
+	record->result = RESULTS_BIN_NONE;
+	record->igt_version = RESULTS_BIN_NONE;
+	memset(record->keys, RESULTS_BIN_KEY_END, sizeof(record->keys));
+
+	json_object_object_foreach(test, key, field) {
+		int k = key_from_name(key);
+
+		if (k < 0) {
+			fprintf(stderr, "resultgen: Cannot store field %s of %s in binary results\n",
+				key, name);
+			return false;
+		}
+
+		switch (k) {
+		case RESULTS_BIN_KEY_IGT_VERSION:
+			record->igt_version = intern_string(strings, json_object_get_string(field));
+			break;
+		case RESULTS_BIN_KEY_RESULT:
+			record->result = intern_string(strings, json_object_get_string(field));
+			break;
+		case RESULTS_BIN_KEY_TIME:
+			if (json_object_object_get_ex(field, "start", &val))
+				record->start = json_object_get_double(val);
+			if (json_object_object_get_ex(field, "end", &val))
+				record->end = json_object_get_double(val);
+			break;
+		}
+
+		record->keys[n++] = k;
+	}
+
+	return record->name != RESULTS_BIN_NONE;
+}
+
+static bool pwrite_all(int fd, const void *buf, size_t len, off_t offset)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = pwrite(fd, buf, len, offset);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+
+		buf = (const char *)buf + ret;
+		len -= ret;
+		offset += ret;
+	}
+
+	return true;
+}
+
+static bool write_blob(int fd, uint64_t *offset, const char *buf, size_t len,
+		       struct results_bin_blob *blob)
+{
+	uLongf size = compressBound(len);
+	Bytef *compressed;
+	bool ok;
+
+	memset(blob, 0, sizeof(*blob));
+	if (len == 0)
+		return true;
+
+	if (len > UINT32_MAX)
+		return false;
+
+	compressed = malloc(size);
+	if (!compressed)
+		return false;
+
+	ok = compress2(compressed, &size, (const Bytef *)buf, len,
+		       Z_DEFAULT_COMPRESSION) == Z_OK &&
+		pwrite_all(fd, compressed, size, *offset);
+	free(compressed);
+
+	if (!ok)
+		return false;
+
+	blob->offset = *offset;
+	blob->size = size;
+	blob->uncompressed_size = len;
+	*offset += size;
+
+	return true;
+}
+
+static int compare_index(const void *a, const void *b, void *strings)
+{
+	const struct results_bin_index_entry *ea = a, *eb = b;
+
+	return strcmp((const char *)strings + ea->name,
+		      (const char *)strings + eb->name);
+}
+
+static bool write_metadata(int fd, uint64_t *offset, struct json_object *results,
+			   struct results_bin_blob *blob)
+{
+	struct json_object *metadata = json_object_new_object();
+	const char *str;
+	bool ok;
+
+	/* "tests" stays, as null, to keep the key order */
+	json_object_object_foreach(results, key, val) {
+		json_object_object_add(metadata, key,
+				       strcmp(key, "tests") ? json_object_get(val) : NULL);
+	}
+
+	str = json_object_to_json_string_ext(metadata, JSON_C_TO_STRING_PLAIN);
+	ok = str && write_blob(fd, offset, str, strlen(str), blob);
+	json_object_put(metadata);
+
+	return ok;
+}
+
+bool results_bin_write(int fd, struct json_object *results,
+		       results_bin_text_fn text, void *data)
+{
+	struct results_bin_header header = {};
+	struct string_table strings = {};
+	struct results_bin_record *records = NULL;
+	struct results_bin_index_entry *index = NULL;
+	struct json_object *tests;
+	uint64_t offset;
+	bool ok = false;
+	size_t n, i;
+
+	if (!json_object_object_get_ex(results, "tests", &tests))
+		return false;
+
+	n = json_object_object_length(tests);
+	records = calloc(n ?: 1, sizeof(*records));
+	index = calloc(n ?: 1, sizeof(*index));
+	strings.offsets = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+	if (!records || !index)
+		goto out;
+
+	/* Blobs go last, placed by the size of everything else */
+	i = 0;
+	json_object_object_foreach(tests, name, test) {
+		if (!fill_record(&records[i], &strings, name, test))
+			goto out;
+
+		index[i].name = records[i].name;
+		index[i].record = i;
+		i++;
+	}
+
+	header.strings_offset = sizeof(header);
+	header.strings_size = strings.size;
+	header.records_offset = (header.strings_offset + strings.size + 7) & ~7ull;
+	header.index_offset = header.records_offset + n * sizeof(*records);
+	offset = header.index_offset + n * sizeof(*index);
+
+	if (!write_metadata(fd, &offset, results, &header.metadata))
+		goto out;
+
+	i = 0;
+	json_object_object_foreach(tests, testname, testobj) {
+		for (int k = 0; k < RESULTS_BIN_NUM_TEXTS; k++) {
+			struct json_object *field;
+			const char *buf;
+			size_t len;
+
+			if (!json_object_object_get_ex(testobj, key_names[k], &field))
+				continue;
+
+			if (text) {
+				buf = text(data, field, &len);
+			} else {
+				buf = json_object_get_string(field);
+				len = json_object_get_string_len(field);
+			}
+
+			if (!buf || !write_blob(fd, &offset, buf, len, &records[i].texts[k])) {
+				fprintf(stderr, "resultgen: Cannot store %s of %s in binary results\n",
+					key_names[k], testname);
+				goto out;
+			}
+		}
+		i++;
+	}
+
+	qsort_r(index, n, sizeof(*index), compare_index, strings.buf);
+
+	memcpy(header.magic, RESULTS_BIN_MAGIC, sizeof(header.magic));
+	header.version = RESULTS_BIN_VERSION;
+	header.num_tests = n;
+
+	ok = pwrite_all(fd, strings.buf, strings.size, header.strings_offset) &&
+		pwrite_all(fd, records, n * sizeof(*records), header.records_offset) &&
+		pwrite_all(fd, index, n * sizeof(*index), header.index_offset) &&
+		pwrite_all(fd, &header, sizeof(header), 0);
+
+out:
+	g_hash_table_destroy(strings.offsets);
+	free(strings.buf);
+	free(records);
+	free(index);
+
+	return ok;
+}
+
+struct results_bin {
+	const char *map;
+	size_t size;
+	const struct results_bin_header *header;
+	const char *strings;
+	const struct results_bin_record *records;
+	const struct results_bin_index_entry *index;
+};
+
+static bool in_file(struct results_bin *bin, uint64_t offset, uint64_t len)
+{
+	return offset <= bin->size && len <= bin->size - offset;
+}
+
+struct results_bin *results_bin_open(int fd)
+{
+	const struct results_bin_header *header;
+	struct results_bin *bin;
+	struct stat st;
+	void *map;
+
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*header))
+		return NULL;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	bin = calloc(1, sizeof(*bin));
+	if (!bin) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	bin->map = map;
+	bin->size = st.st_size;
+	bin->header = header = map;
+
+	if (memcmp(header->magic, RESULTS_BIN_MAGIC, sizeof(header->magic)) ||
+	    header->version != RESULTS_BIN_VERSION ||
+	    !in_file(bin, header->strings_offset, header->strings_size) ||
+	    (header->strings_size &&
+	     bin->map[header->strings_offset + header->strings_size - 1] != '\0') ||
+	    !in_file(bin, header->records_offset,
+		     (uint64_t)header->num_tests * sizeof(*bin->records)) ||
+	    header->records_offset % 8 ||
+	    !in_file(bin, header->index_offset,
+		     (uint64_t)header->num_tests * sizeof(*bin->index)) ||
+	    header->index_offset % 4) {
+		results_bin_close(bin);
+		return NULL;
+	}
+
+	bin->strings = bin->map + header->strings_offset;
+	bin->records = (const void *)(bin->map + header->records_offset);
+	bin->index = (const void *)(bin->map + header->index_offset);
+
+	return bin;
+}
+
+void results_bin_close(struct results_bin *bin)
+{
+	munmap((void *)bin->map, bin->size);
+	free(bin);
+}
+
+size_t results_bin_num_tests(struct results_bin *bin)
+{
+	return bin->header->num_tests;
+}
+
+const char *results_bin_string(struct results_bin *bin, uint32_t offset)
+{
+	if (offset >= bin->header->strings_size)
+		return NULL;
+
+	return bin->strings + offset;
+}
+
+const struct results_bin_record *results_bin_get(struct results_bin *bin,
+						 size_t idx)
+{
+	if (idx >= bin->header->num_tests)
+		return NULL;
+
+	return &bin->records[idx];
+}
+
+const struct results_bin_record *results_bin_find(struct results_bin *bin,
+						  const char *name)
+{
+	size_t lo = 0, hi = bin->header->num_tests;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const char *midname = results_bin_string(bin, bin->index[mid].name);
+		int cmp;
+
+		if (!midname)
+			return NULL;
+
+		cmp = strcmp(name, midname);
+		if (cmp == 0)
+			return results_bin_get(bin, bin->index[mid].record);
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+static bool has_key(const struct results_bin_record *record, int key)
+{
+	for (int i = 0; i < RESULTS_BIN_NUM_KEYS && record->keys[i] != RESULTS_BIN_KEY_END; i++) {
+		if (record->keys[i] == key)
+			return true;
+	}
+
+	return false;
+}
+
+static char *inflate_blob(struct results_bin *bin,
+			  const struct results_bin_blob *blob, size_t *len)
+{
+	uLongf size = blob->uncompressed_size;
+	char *buf;
+
+	if (!in_file(bin, blob->offset, blob->size))
+		return NULL;
+
+	buf = malloc(size + 1);
+	if (!buf)
+		return NULL;
+
+	if (size && (uncompress((Bytef *)buf, &size,
+				(const Bytef *)bin->map + blob->offset,
+				blob->size) != Z_OK ||
+		     size != blob->uncompressed_size)) {
+		free(buf);
+		return NULL;
+	}
+
+	buf[size] = '\0';
+	if (len)
+		*len = size;
+
+	return buf;
+}
+
+char *results_bin_text(struct results_bin *bin,
+		       const struct results_bin_record *record,
+		       enum results_bin_text text, size_t *len)
+{
+	if (text >= RESULTS_BIN_NUM_TEXTS || !has_key(record, text))
+		return NULL;
+
+	return inflate_blob(bin, &record->texts[text], len);
+}
+
+static struct json_object *new_string_or_empty(const char *str)
+{
+	return json_object_new_string(str ?: "");
+}
+
+struct json_object *results_bin_test_json(struct results_bin *bin,
+					  const struct results_bin_record *record)
+{
+	struct json_object *test = json_object_new_object();
+	struct json_object *time;
+	char *text;
+	size_t len;
+
+	for (int i = 0; i < RESULTS_BIN_NUM_KEYS && record->keys[i] != RESULTS_BIN_KEY_END; i++) {
+		int k = record->keys[i];
+
+		switch (k) {
+		case RESULTS_BIN_KEY_OUT:
+		case RESULTS_BIN_KEY_ERR:
+		case RESULTS_BIN_KEY_DMESG:
+		case RESULTS_BIN_KEY_DMESG_WARNINGS:
+			text = results_bin_text(bin, record, k, &len);
+			if (!text) {
+				json_object_put(test);
+				return NULL;
+			}
+			json_object_object_add(test, key_names[k],
+					       json_object_new_string_len(text, len));
+			free(text);
+			break;
+		case RESULTS_BIN_KEY_IGT_VERSION:
+			json_object_object_add(test, key_names[k],
+					       new_string_or_empty(results_bin_string(bin, record->igt_version)));
+			break;
+		case RESULTS_BIN_KEY_RESULT:
+			json_object_object_add(test, key_names[k],
+					       new_string_or_empty(results_bin_string(bin, record->result)));
+			break;
+		case RESULTS_BIN_KEY_TIME:
+			time = json_object_new_object();
+			json_object_object_add(time, "__type__",
+					       json_object_new_string("TimeAttribute"));
+			json_object_object_add(time, "start",
+					       json_object_new_double(record->start));
+			json_object_object_add(time, "end",
+					       json_object_new_double(record->end));
+			json_object_object_add(test, key_names[k], time);
+			break;
+		default:
+			json_object_put(test);
+			return NULL;
+		}
+	}
+
+	return test;
+}
+
+struct json_object *results_bin_to_json(struct results_bin *bin)
+{
+	struct json_object *results, *tests, *test;
+	const struct results_bin_record *record;
+	char *metadata;
+	size_t i;
+
+	metadata = inflate_blob(bin, &bin->header->metadata, NULL);
+	if (!metadata)
+		return NULL;
+
+	results = json_tokener_parse(metadata);
+	free(metadata);
+	if (!results)
+		return NULL;
+
+	tests = json_object_new_object();
+	for (i = 0; i < results_bin_num_tests(bin); i++) {
+		record = results_bin_get(bin, i);
+		test = results_bin_test_json(bin, record);
+		if (!test || !results_bin_string(bin, record->name)) {
+			json_object_put(test);
+			json_object_put(tests);
+			json_object_put(results);
+			return NULL;
+		}
+
+		json_object_object_add(tests, results_bin_string(bin, record->name), test);
+	}
+
+	json_object_object_add(results, "tests", tests);
+
+	return results;
+}
@@ -0,0 +1,134 @@
+#ifndef RUNNER_RESULTS_BIN_H
+#define RUNNER_RESULTS_BIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct json_object;
+
+/*
+ * A compact binary alternative to results.json, for looking up a few
+ * tests without parsing everything:
+ *
+ *   header
+ *   string table: test names, results and IGT versions, NUL-terminated
+ *   records: one fixed-size record per test, in results.json order
+ *   index: (name, record) pairs sorted by name, for binary search
+ *   blobs: the zlib-compressed top-level metadata and test logs
+ *
+ * The file is in the byte order of the machine that wrote it. Readers
+ * mmap it, so a lookup touches the header, about log2(n) index entries
+ * and names, and the record found.
+ */
+#define RESULTS_BIN_FILENAME "results.bin"
+#define RESULTS_BIN_MAGIC "IGTRBIN"
+#define RESULTS_BIN_VERSION 1
+#define RESULTS_BIN_NONE UINT32_MAX
+
+enum results_bin_text {
+	RESULTS_BIN_OUT,
+	RESULTS_BIN_ERR,
+	RESULTS_BIN_DMESG,
+	RESULTS_BIN_DMESG_WARNINGS,
+	RESULTS_BIN_NUM_TEXTS,
+};
+
+/* The fields of a test, as they are stored in a record's key order */
+enum results_bin_key {
+	RESULTS_BIN_KEY_OUT = RESULTS_BIN_OUT,
+	RESULTS_BIN_KEY_ERR = RESULTS_BIN_ERR,
+	RESULTS_BIN_KEY_DMESG = RESULTS_BIN_DMESG,
+	RESULTS_BIN_KEY_DMESG_WARNINGS = RESULTS_BIN_DMESG_WARNINGS,
+	RESULTS_BIN_KEY_IGT_VERSION,
+	RESULTS_BIN_KEY_RESULT,
+	RESULTS_BIN_KEY_TIME,
+	RESULTS_BIN_NUM_KEYS,
+	RESULTS_BIN_KEY_END = 0xff,
+};
+
+struct results_bin_blob {
+	uint64_t offset;
+	uint32_t size;
+	uint32_t uncompressed_size;
+};
+
+struct results_bin_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_tests;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint64_t records_offset;
+	uint64_t index_offset;
+	/* JSON of the results, with "tests" set to null */
+	struct results_bin_blob metadata;
+};
+
+struct results_bin_record {
+	/* String table offsets, or RESULTS_BIN_NONE */
+	uint32_t name;
+	uint32_t result;
+	uint32_t igt_version;
+	/* The fields present, in their results.json order */
+	uint8_t keys[RESULTS_BIN_NUM_KEYS + 1];
+	double start, end;
+	struct results_bin_blob texts[RESULTS_BIN_NUM_TEXTS];
+};
+
+struct results_bin_index_entry {
+	uint32_t name;
+	uint32_t record;
+};
+
+/*
+ * Returns the text of a string field of a test, valid until the next
+ * call. Lets the writer get at texts that aren't stored in the json-c
+ * objects themselves.
+ */
+typedef const char *(*results_bin_text_fn)(void *data,
+					   struct json_object *field,
+					   size_t *len);
+
+/*
+ * Writes the results in @results, as built by resultgen, to @fd. With
+ * @text NULL, the string fields are taken as they are.
+ *
+ * Returns: True on success.
+ */
+bool results_bin_write(int fd, struct json_object *results,
+		       results_bin_text_fn text, void *data);
+
+struct results_bin;
+
+/* Maps a binary results file for reading. Returns NULL if it's invalid. */
+struct results_bin *results_bin_open(int fd);
+void results_bin_close(struct results_bin *bin);
+
+size_t results_bin_num_tests(struct results_bin *bin);
+
+/* Returns the record of the test @name, or NULL if there's none. */
+const struct results_bin_record *results_bin_find(struct results_bin *bin,
+						  const char *name);
+const struct results_bin_record *results_bin_get(struct results_bin *bin,
+						 size_t idx);
+
+/* Returns a string of the string table, or NULL for RESULTS_BIN_NONE. */
+const char *results_bin_string(struct results_bin *bin, uint32_t offset);
+
+/*
+ * Returns a text field of a test, decompressed into a NUL-terminated
+ * buffer to be freed by the caller, or NULL if the test doesn't have it.
+ */
+char *results_bin_text(struct results_bin *bin,
+		       const struct results_bin_record *record,
+		       enum results_bin_text text, size_t *len);
+
+/* Returns the test as its results.json object. */
+struct json_object *results_bin_test_json(struct results_bin *bin,
+					  const struct results_bin_record *record);
+
+/* Returns the whole results.json object. */
+struct json_object *results_bin_to_json(struct results_bin *bin);
+
+#endif
@@ -0,0 +1,205 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <json.h>
+
+#include "resultgen.h"
+#include "results_bin.h"
+
+static const char *text_names[RESULTS_BIN_NUM_TEXTS] = {
+	[RESULTS_BIN_OUT] = "out",
+	[RESULTS_BIN_ERR] = "err",
+	[RESULTS_BIN_DMESG] = "dmesg",
+	[RESULTS_BIN_DMESG_WARNINGS] = "dmesg-warnings",
+};
+
+static void usage(const char *name, FILE *f)
+{
+	fprintf(f,
+		"Usage: %s generate <results-directory>\n"
+		"       %s list <results>\n"
+		"       %s show <results> <test> [out|err|dmesg|dmesg-warnings]\n"
+		"       %s json <results>\n"
+		"\n"
+		"<results> is a %s file, or a results directory with one.\n"
+		"generate writes %s for an existing results directory.\n"
+		"json prints the results as they would be in results.json.\n",
+		name, name, name, name, RESULTS_BIN_FILENAME, RESULTS_BIN_FILENAME);
+}
+
+static struct results_bin *open_results(const char *path)
+{
+	struct results_bin *bin;
+	struct stat st;
+	int fd;
+
+	if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+		int dirfd = open(path, O_DIRECTORY | O_RDONLY);
+
+		fd = dirfd < 0 ? -1 : openat(dirfd, RESULTS_BIN_FILENAME, O_RDONLY);
+		if (dirfd >= 0)
+			close(dirfd);
+	} else {
+		fd = open(path, O_RDONLY);
+	}
+
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open binary results in %s\n", path);
+		return NULL;
+	}
+
+	bin = results_bin_open(fd);
+	close(fd);
+
+	if (!bin)
+		fprintf(stderr, "%s is not a valid binary results file\n", path);
+
+	return bin;
+}
+
+static void print_json(struct json_object *obj)
+{
+	puts(json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY));
+	json_object_put(obj);
+}
+
+static int list(struct results_bin *bin)
+{
+	const struct results_bin_record *record;
+	const char *result;
+	size_t i;
+
+	for (i = 0; i < results_bin_num_tests(bin); i++) {
+		record = results_bin_get(bin, i);
+		result = results_bin_string(bin, record->result);
+
+		printf("%s: %s\n", results_bin_string(bin, record->name) ?: "",
+		       result ?: "(none)");
+	}
+
+	return 0;
+}
+
+static int show(struct results_bin *bin, const char *name, const char *field)
+{
+	const struct results_bin_record *record;
+	struct json_object *obj;
+	char *text;
+	size_t len;
+	int t;
+
+	record = results_bin_find(bin, name);
+	if (!record) {
+		fprintf(stderr, "No test %s in the results\n", name);
+		return 1;
+	}
+
+	if (!field) {
+		obj = results_bin_test_json(bin, record);
+		if (!obj) {
+			fprintf(stderr, "Cannot read the results of %s\n", name);
+			return 1;
+		}
+
+		print_json(obj);
+		return 0;
+	}
+
+	for (t = 0; t < RESULTS_BIN_NUM_TEXTS; t++) {
+		if (!strcmp(field, text_names[t]))
+			break;
+	}
+
+	if (t == RESULTS_BIN_NUM_TEXTS) {
+		fprintf(stderr, "Unknown field %s\n", field);
+		return 1;
+	}
+
+	text = results_bin_text(bin, record, t, &len);
+	if (!text) {
+		fprintf(stderr, "No %s for %s\n", field, name);
+		return 1;
+	}
+
+	fwrite(text, 1, len, stdout);
+	free(text);
+
+	return 0;
+}
+
+static int json(struct results_bin *bin)
+{
+	struct json_object *obj = results_bin_to_json(bin);
+
+	if (!obj) {
+		fprintf(stderr, "Cannot read the results\n");
+		return 1;
+	}
+
+	print_json(obj);
+	return 0;
+}
+
+static int generate(const char *path)
+{
+	int dirfd = open(path, O_DIRECTORY | O_RDONLY);
+	bool ok;
+
+	if (dirfd < 0) {
+		fprintf(stderr, "Cannot open results directory %s\n", path);
+		return 1;
+	}
+
+	ok = generate_binary_results(dirfd);
+	close(dirfd);
+
+	if (!ok)
+		return 1;
+
+	printf("Binary results generated\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct results_bin *bin;
+	const char *cmd;
+	int ret;
+
+	if (argc < 3) {
+		usage(argv[0], stderr);
+		return 1;
+	}
+
+	cmd = argv[1];
+
+	if (!strcmp(cmd, "generate") && argc == 3)
+		return generate(argv[2]);
+
+	if (!((!strcmp(cmd, "list") && argc == 3) ||
+	      (!strcmp(cmd, "show") && (argc == 4 || argc == 5)) ||
+	      (!strcmp(cmd, "json") && argc == 3))) {
+		usage(argv[0], stderr);
+		return 1;
+	}
+
+	bin = open_results(argv[2]);
+	if (!bin)
+		return 1;
+
+	if (!strcmp(cmd, "list"))
+		ret = list(bin);
+	else if (!strcmp(cmd, "show"))
+		ret = show(bin, argv[3], argc == 5 ? argv[4] : NULL);
+	else
+		ret = json(bin);
+
+	results_bin_close(bin);
+
+	return ret;
+}
@@ -6,6 +6,7 @@
 
 #include "igt.h"
 #include "resultgen.h"
+#include "results_bin.h"
 
 static char testdatadir[] = JSON_TESTS_DIRECTORY;
 
@@ -147,6 +148,91 @@ static void run_results_and_compare(int dirfd, const char *dirname)
 	igt_assert_eq(json_object_put(referenceobj), 1);
 }
 
+/*
+ * The streamed results.json must be what json-c would have written for the
+ * same results, byte for byte.
+ */
+static void run_streamed_and_compare(int dirfd, const char *dirname)
+{
+	int testdirfd = openat(dirfd, dirname, O_RDONLY | O_DIRECTORY);
+	struct json_object *resultsobj, *streamedobj;
+	const char *expected;
+	char *streamed;
+	size_t len;
+	FILE *f;
+
+	igt_assert_fd(testdirfd);
+
+	f = tmpfile();
+	igt_assert(f);
+	igt_assert(generate_results_to_fd(testdirfd, fileno(f)));
+
+	igt_assert((resultsobj = generate_results_json(testdirfd)) != NULL);
+	close(testdirfd);
+
+	expected = json_object_to_json_string_ext(resultsobj, JSON_C_TO_STRING_PRETTY);
+	len = strlen(expected);
+	streamed = calloc(1, len + 1);
+	igt_assert(streamed);
+
+	igt_assert_eq(pread(fileno(f), streamed, len + 1, 0), len);
+	igt_assert(!memcmp(streamed, expected, len));
+
+	lseek(fileno(f), 0, SEEK_SET);
+	streamedobj = read_json(fileno(f));
+	igt_assert(streamedobj != NULL);
+	compare(streamedobj, resultsobj);
+
+	igt_assert_eq(json_object_put(resultsobj), 1);
+	igt_assert_eq(json_object_put(streamedobj), 1);
+	free(streamed);
+	fclose(f);
+}
+
+/*
+ * The binary results must convert back to the same results.json, and find
+ * every test by name.
+ */
+static void run_binary_and_compare(int dirfd, const char *dirname)
+{
+	int testdirfd = openat(dirfd, dirname, O_RDONLY | O_DIRECTORY);
+	struct json_object *resultsobj, *binobj, *tests;
+	const struct results_bin_record *record;
+	struct results_bin *bin;
+	FILE *f;
+
+	igt_assert_fd(testdirfd);
+	igt_assert((resultsobj = generate_results_json(testdirfd)) != NULL);
+	close(testdirfd);
+
+	f = tmpfile();
+	igt_assert(f);
+	igt_assert(results_bin_write(fileno(f), resultsobj, NULL, NULL));
+
+	bin = results_bin_open(fileno(f));
+	igt_assert(bin);
+
+	igt_assert(json_object_object_get_ex(resultsobj, "tests", &tests));
+	igt_assert_eq(results_bin_num_tests(bin), json_object_object_length(tests));
+
+	json_object_object_foreach(tests, name, test) {
+		igt_debug("Test %s\n", name);
+		record = results_bin_find(bin, name);
+		igt_assert(record);
+		igt_assert_eqstr(results_bin_string(bin, record->name), name);
+	}
+	igt_assert(results_bin_find(bin, "igt@no@such-test") == NULL);
+
+	igt_assert((binobj = results_bin_to_json(bin)) != NULL);
+	igt_assert_eqstr(json_object_to_json_string_ext(binobj, JSON_C_TO_STRING_PRETTY),
+			 json_object_to_json_string_ext(resultsobj, JSON_C_TO_STRING_PRETTY));
+
+	igt_assert_eq(json_object_put(resultsobj), 1);
+	igt_assert_eq(json_object_put(binobj), 1);
+	results_bin_close(bin);
+	fclose(f);
+}
+
 static const char *dirnames[] = {
 	"normal-run",
 	"warnings",
@@ -183,5 +269,13 @@ igt_main
 		igt_subtest(dirnames[i]) {
 			run_results_and_compare(dirfd, dirnames[i]);
 		}
+
+		igt_subtest_f("%s-streamed", dirnames[i]) {
+			run_streamed_and_compare(dirfd, dirnames[i]);
+		}
+
+		igt_subtest_f("%s-binary", dirnames[i]) {
+			run_binary_and_compare(dirfd, dirnames[i]);
+		}
 	}
 }
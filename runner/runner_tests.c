@@ -9,8 +9,10 @@
 #include "igt.h"
 
 #include "settings.h"
+#include "dmesg_classifier.h"
 #include "job_list.h"
 #include "executor.h"
+#include "logfile.h"
 #include "resultgen.h"
 
 /*
@@ -186,10 +188,13 @@ static void assert_settings_equal(struct settings *one, struct settings *two)
 	igt_assert_eq(one->abort_mask, two->abort_mask);
 	igt_assert_eq_u64(one->disk_usage_limit, two->disk_usage_limit);
 	igt_assert_eqstr(one->test_list, two->test_list);
+	igt_assert_eqstr(one->dmesg_suppressions, two->dmesg_suppressions);
 	igt_assert_eqstr(one->name, two->name);
 	igt_assert_eq(one->dry_run, two->dry_run);
 	igt_assert_eq(one->allow_non_root, two->allow_non_root);
 	igt_assert_eq(one->sync, two->sync);
+	igt_assert_eq(one->compress_logs, two->compress_logs);
+	igt_assert_eq(one->binary_results, two->binary_results);
 	igt_assert_eq(one->log_level, two->log_level);
 	igt_assert_eq(one->overwrite, two->overwrite);
 	igt_assert_eq(one->multiple_mode, two->multiple_mode);
@@ -277,11 +282,14 @@ igt_main
 		igt_assert_eq(settings->abort_mask, 0);
 		igt_assert_eq_u64(settings->disk_usage_limit, 0UL);
 		igt_assert(!settings->test_list);
+		igt_assert(!settings->dmesg_suppressions);
 		igt_assert_eqstr(settings->name, "path-to-results");
 		igt_assert(!settings->dry_run);
 		igt_assert_eq(settings->include_regexes.size, 0);
 		igt_assert_eq(settings->exclude_regexes.size, 0);
 		igt_assert(!settings->sync);
+		igt_assert(!settings->compress_logs);
+		igt_assert(!settings->binary_results);
 		igt_assert_eq(settings->log_level, LOG_LEVEL_NORMAL);
 		igt_assert(!settings->overwrite);
 		igt_assert(!settings->multiple_mode);
@@ -398,6 +406,7 @@ igt_main
 
 		igt_assert_eq(settings->abort_mask, 0);
 		igt_assert(!settings->test_list);
+		igt_assert(!settings->dmesg_suppressions);
 		igt_assert_eqstr(settings->name, "path-to-results");
 		igt_assert(!settings->dry_run);
 		igt_assert_eq(settings->include_regexes.size, 0);
@@ -436,6 +445,8 @@ igt_main
 				       "-b", blacklist_name,
 				       "--blacklist", blacklist2_name,
 				       "-s",
+				       "--compress-logs",
+				       "--binary-results",
 				       "-l", "verbose",
 				       "--overwrite",
 				       "--multiple-mode",
@@ -445,6 +456,7 @@ igt_main
 				       "--use-watchdog",
 				       "--piglit-style-dmesg",
 				       "--dmesg-warn-level=3",
+				       "--dmesg-suppressions", "path-to-suppressions",
 				       "--collect-code-cov",
 				       "--coverage-per-test",
 				       "--collect-script", "/usr/bin/true",
@@ -473,6 +485,8 @@ igt_main
 		igt_assert_eqstr(settings->exclude_regexes.regex_strings[2], "xpattern3"); /* From blacklist */
 		igt_assert_eqstr(settings->exclude_regexes.regex_strings[3], "xpattern4"); /* From blacklist2 */
 		igt_assert(settings->sync);
+		igt_assert(settings->compress_logs);
+		igt_assert(settings->binary_results);
 		igt_assert_eq(settings->log_level, LOG_LEVEL_VERBOSE);
 		igt_assert(settings->overwrite);
 		igt_assert(settings->multiple_mode);
@@ -486,6 +500,7 @@ igt_main
 
 		igt_assert(settings->piglit_style_dmesg);
 		igt_assert_eq(settings->dmesg_warn_level, 3);
+		igt_assert(strstr(settings->dmesg_suppressions, "path-to-suppressions") != NULL);
 	}
 	igt_subtest("parse-list-all") {
 		const char *argv[] = { "runner",
@@ -732,6 +747,76 @@ igt_main
 		igt_assert(!validate_settings(settings));
 	}
 
+	igt_subtest("dmesg-classifier") {
+		char suppressions[PATH_MAX];
+		const char *argv[] = { "runner",
+				       "--dmesg-suppressions", suppressions,
+				       testdatadir,
+				       "path-to-results",
+		};
+		static const struct {
+			const char *line;
+			bool warning;
+		} records[] = {
+			{ "4,1,3216186101159,-;Warning from kernel\n", true },
+			{ "3,2,3216186101160,-;Lid device missing (ACPI)\n", false },
+			{ "3,3,3216186101161,-;i915 0000:00:02.0: [drm] GuC firmware i915/guc.bin not found\n", false },
+			{ "4,4,3216186101162,-;usb usb1: root hub lost power or was reset\n", false },
+			{ "6,5,3216186101163,-;Warning from kernel\n", false },
+			{ "4,6,3216186101164,c;Warning from kernel\n", false },
+		};
+		struct dmesg_classifier classifier;
+		struct dmesg_record record;
+		char formatted[256];
+		size_t i;
+
+		sprintf(suppressions, "%s/test-dmesg-suppressions.txt", testdatadir);
+		igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+		igt_assert(dmesg_classifier_init(&classifier, settings));
+
+		for (i = 0; i < ARRAY_SIZE(records); i++) {
+			igt_assert(dmesg_parse_record(records[i].line, &record));
+			igt_assert_f(dmesg_is_warning(&classifier, &record) == records[i].warning,
+				     "Misclassified %s", records[i].line);
+		}
+
+		igt_assert(!dmesg_parse_record(" SUBSYSTEM=pci\n", &record));
+
+		igt_assert(dmesg_parse_record("6,7,3216186101165,-;tab\\x09and \\x01 kept\n", &record));
+		igt_assert_eq(dmesg_format_record(&record, formatted), strlen(formatted));
+		igt_assert_eqstr(formatted, "<6> [3216186.101165] tab\tand \\x01 kept\n");
+
+		dmesg_classifier_fini(&classifier);
+	}
+
+	igt_subtest_group {
+		char filename[] = "tmpsuppressionsXXXXXX";
+
+		igt_fixture {
+			int fd;
+			igt_require((fd = mkstemp(filename)) >= 0);
+			igt_require(write(fd, "broken (regex\n", 14) == 14);
+			close(fd);
+		}
+
+		igt_subtest("validate-invalid-dmesg-suppressions") {
+			const char *argv[] = { "runner",
+					       "--allow-non-root",
+					       "--dmesg-suppressions", filename,
+					       testdatadir,
+					       "path-to-results",
+			};
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+
+			igt_assert(!validate_settings(settings));
+		}
+
+		igt_fixture {
+			unlink(filename);
+		}
+	}
+
 	igt_subtest_group {
 		char dirname[] = "tmpdirXXXXXX";
 		struct job_list *list = malloc(sizeof(*list));
@@ -1311,6 +1396,136 @@ igt_main
 		}
 	}
 
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1, subdirfd = -1, fd = -1;
+
+		igt_fixture {
+			init_job_list(list);
+			igt_require(mkdtemp(dirname) != NULL);
+		}
+
+		igt_subtest("execute-initialize-from-ledger") {
+			struct execute_state state;
+			const char *argv[] = { "runner",
+					       "--allow-non-root",
+					       "--multiple-mode",
+					       "-t", "successtest",
+					       testdatadir,
+					       dirname,
+			};
+			/* The start of second-subtest is torn, and the journal lost */
+			const char ledgertext[] = "0 B\n0 S first-subtest\n0 R first-subtest pass\n0 S second";
+			const char excludestring[] = "!first-subtest";
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert(list->size == 1);
+			igt_assert(list->entries[0].subtest_count == 0);
+
+			igt_assert(serialize_settings(settings));
+			igt_assert(serialize_job_list(list, settings));
+
+			igt_assert((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert(mkdirat(dirfd, "0", 0770) == 0);
+			igt_assert((subdirfd = openat(dirfd, "0", O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert((fd = openat(dirfd, "progress.txt", O_CREAT | O_WRONLY | O_EXCL, 0660)) >= 0);
+			igt_assert(write(fd, ledgertext, strlen(ledgertext)) == strlen(ledgertext));
+
+			free_job_list(list);
+			free_settings(settings);
+			igt_assert(initialize_execute_state_from_resume(dirfd, &state, settings, list));
+
+			igt_assert_eq(state.next, 0);
+			igt_assert_eq(list->size, 1);
+			igt_assert_eq(list->entries[0].subtest_count, 2);
+			igt_assert_eqstr(list->entries[0].subtests[0], "*");
+			igt_assert_eqstr(list->entries[0].subtests[1], excludestring);
+		}
+
+		igt_fixture {
+			close(fd);
+			close(subdirfd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1, subdirfd = -1, fd = -1;
+
+		igt_fixture {
+			init_job_list(list);
+			igt_require(mkdtemp(dirname) != NULL);
+		}
+
+		igt_subtest("execute-initialize-stale-ledger") {
+			struct execute_state state;
+			struct job_list_entry tmp;
+			size_t i;
+			const char *argv[] = { "runner",
+					       "--allow-non-root",
+					       "--multiple-mode",
+					       testdatadir,
+					       dirname,
+			};
+			/* Entry 1 was run without updating the ledger */
+			const char ledgertext[] = "0 B\n0 E exit:0 (0.010s)\n";
+			const char journaltext[] = "first-subtest\n";
+			const char excludestring[] = "!first-subtest";
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert(list->size == NUM_TESTDATA_BINARIES);
+
+			for (i = 0; strcmp(list->entries[i].binary, "successtest"); i++)
+				;
+			tmp = list->entries[1];
+			list->entries[1] = list->entries[i];
+			list->entries[i] = tmp;
+
+			igt_assert(list->entries[1].subtest_count == 0);
+
+			igt_assert(serialize_settings(settings));
+			igt_assert(serialize_job_list(list, settings));
+
+			igt_assert_lte(0, dirfd = open(dirname, O_DIRECTORY | O_RDONLY));
+			igt_assert_eq(mkdirat(dirfd, "0", 0770), 0);
+			igt_assert_eq(mkdirat(dirfd, "1", 0770), 0);
+			igt_assert((subdirfd = openat(dirfd, "1", O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert_lte(0, fd = openat(subdirfd, "journal.txt", O_CREAT | O_WRONLY | O_EXCL, 0660));
+			igt_assert_eq(write(fd, journaltext, strlen(journaltext)), strlen(journaltext));
+			close(fd);
+			igt_assert_lte(0, fd = openat(dirfd, "progress.txt", O_CREAT | O_WRONLY | O_EXCL, 0660));
+			igt_assert_eq(write(fd, ledgertext, strlen(ledgertext)), strlen(ledgertext));
+
+			free_job_list(list);
+			free_settings(settings);
+			igt_assert(initialize_execute_state_from_resume(dirfd, &state, settings, list));
+
+			/* Resumed from the journal of entry 1 */
+			igt_assert_eq(state.next, 1);
+			igt_assert_eq(list->size, NUM_TESTDATA_BINARIES);
+			igt_assert_eq(list->entries[1].subtest_count, 2);
+			igt_assert_eqstr(list->entries[1].subtests[0], "*");
+			igt_assert_eqstr(list->entries[1].subtests[1], excludestring);
+		}
+
+		igt_fixture {
+			close(fd);
+			close(subdirfd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
 	igt_subtest_group {
 		struct job_list *list = malloc(sizeof(*list));
 		volatile int dirfd = -1, subdirfd = -1, fd = -1;
@@ -1640,6 +1855,116 @@ igt_main
 		}
 	}
 
+	igt_subtest_group {
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1, subdirfd = -1;
+		char dirname[] = "tmpdirXXXXXX";
+
+		igt_fixture {
+			igt_require(mkdtemp(dirname) != NULL);
+			rmdir(dirname);
+
+			init_job_list(list);
+		}
+
+		igt_subtest("execute-compressed-logs") {
+			struct execute_state state;
+			struct json_object *results, *tests, *test, *out;
+			const char *argv[] = { "runner",
+					       "--allow-non-root",
+					       "--compress-logs",
+					       "-t", "successtest.*-subtest",
+					       testdatadir,
+					       dirname,
+			};
+			int fd;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert(initialize_execute_state(&state, settings, list));
+			igt_assert(execute(&state, settings, list));
+
+			igt_assert_f((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create the results directory\n");
+			igt_assert_f((subdirfd = openat(dirfd, "0", O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create result directory '0'\n");
+
+			assert_execution_created(subdirfd, "journal.txt");
+			assert_execution_created(subdirfd, "out.txt.gz");
+			assert_execution_created(subdirfd, "err.txt.gz");
+			assert_execution_created(subdirfd, "dmesg.txt.gz");
+			igt_assert_f((fd = openat(subdirfd, "out.txt", O_RDONLY)) < 0,
+				     "Execute created an uncompressed out.txt\n");
+
+			igt_assert_f((results = generate_results_json(dirfd)) != NULL,
+				     "Results parsing failed\n");
+			igt_assert(json_object_object_get_ex(results, "tests", &tests));
+
+			igt_assert_eqstr(igt_get_result(tests, "igt@successtest@first-subtest"), "pass");
+			igt_assert(json_object_object_get_ex(tests, "igt@successtest@first-subtest", &test));
+			igt_assert(json_object_object_get_ex(test, "out", &out));
+			igt_assert(strstr(json_object_get_string(out), "Starting subtest: first-subtest"));
+
+			igt_assert_eq(json_object_put(results), 1);
+		}
+
+		igt_fixture {
+			close(subdirfd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+		}
+	}
+
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		volatile int dirfd = -1, fd = -1;
+
+		igt_fixture {
+			igt_require(mkdtemp(dirname) != NULL);
+			igt_require((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+		}
+
+		igt_subtest("compressed-log-unfinished") {
+			struct logfile log;
+			char buf[64];
+			ssize_t s;
+
+			/* A log that never gets closed, like after a crash */
+			igt_fork(child, 1) {
+				igt_assert(logfile_open(&log, dirfd, "out.txt", true));
+				logfile_write(&log, "first line\n", 11);
+				logfile_write(&log, "unterminated", 12);
+				logfile_flush(&log);
+				logfile_write(&log, " lost", 5);
+			}
+			igt_waitchildren();
+
+			igt_assert((fd = logfile_open_for_reading(dirfd, "out.txt")) >= 0);
+			igt_assert((s = read(fd, buf, sizeof(buf) - 1)) >= 0);
+			buf[s] = '\0';
+			igt_assert_eqstr(buf, "first line\nunterminated");
+			close(fd);
+			fd = -1;
+
+			/* Appending to it must leave a well-formed file behind */
+			igt_assert(logfile_open(&log, dirfd, "out.txt", true));
+			logfile_write(&log, "resumed\n", 8);
+			logfile_close(&log);
+
+			igt_assert((fd = logfile_open_for_reading(dirfd, "out.txt")) >= 0);
+			igt_assert((s = read(fd, buf, sizeof(buf) - 1)) >= 0);
+			buf[s] = '\0';
+			igt_assert_eqstr(buf, "first line\nunterminated\nresumed\n");
+		}
+
+		igt_fixture {
+			close(fd);
+			close(dirfd);
+			clear_directory(dirname);
+		}
+	}
+
 	igt_subtest_group {
 		struct job_list *list = malloc(sizeof(*list));
 		volatile int dirfd = -1;
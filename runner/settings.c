@@ -1,3 +1,4 @@
+#include "dmesg_classifier.h"
 #include "settings.h"
 #include "version.h"
 
@@ -30,6 +31,9 @@ enum {
 	OPT_COV_RESULTS_PER_TEST,
 	OPT_VERSION,
 	OPT_PRUNE_MODE,
+	OPT_COMPRESS_LOGS,
+	OPT_BINARY_RESULTS,
+	OPT_DMESG_SUPPRESSIONS,
 	OPT_HELP = 'h',
 	OPT_NAME = 'n',
 	OPT_DRY_RUN = 'd',
@@ -251,6 +255,14 @@ static const char *usage_str =
 	"                        kernel logs, exceed the given limit in bytes. The limit\n"
 	"                        parameter can use suffixes k, M and G for kilo/mega/gigabytes,\n"
 	"                        respectively. Limit of 0 (default) disables the limit.\n"
+	"                        With --compress-logs, compressed bytes are counted.\n"
+	"  --compress-logs       Store the test's stdout, stderr and kernel logs gzip\n"
+	"                        compressed, as out.txt.gz, err.txt.gz and dmesg.txt.gz.\n"
+	"                        Logs are flushed at least once a second, and remain\n"
+	"                        readable up to the last flush if the run is cut short.\n"
+	"  --binary-results      Write results.bin next to results.json, an indexed\n"
+	"                        binary form of the results for looking up single\n"
+	"                        tests, see igt_results_query.\n"
 	"  --use-watchdog        Use hardware watchdog for lethal enforcement of the\n"
 	"                        above timeout. Killing the test process is still\n"
 	"                        attempted at timeout trigger.\n"
@@ -266,6 +278,9 @@ static const char *usage_str =
 	"                        (longer) filter list means the test result should\n"
 	"                        change. KERN_NOTICE dmesg level is treated as warn,\n"
 	"                        unless overridden with --dmesg-warn-level.\n"
+	"  --dmesg-suppressions FILENAME\n"
+	"                        Don't treat kernel log records matching any of the\n"
+	"                        regexes in FILENAME, one per line, as warnings.\n"
 	"  --prune-mode <mode>   Control reporting of dynamic subtests by selecting test\n"
 	"                        results that are removed from the final results set.\n"
 	"                        Possible options:\n"
@@ -489,6 +504,7 @@ void init_settings(struct settings *settings)
 void free_settings(struct settings *settings)
 {
 	free(settings->test_list);
+	free(settings->dmesg_suppressions);
 	free(settings->name);
 	free(settings->test_root);
 	free(settings->results_path);
@@ -516,6 +532,8 @@ bool parse_options(int argc, char **argv,
 		{"abort-on-monitored-error", optional_argument, NULL, OPT_ABORT_ON_ERROR},
 		{"disk-usage-limit", required_argument, NULL, OPT_DISK_USAGE_LIMIT},
 		{"sync", no_argument, NULL, OPT_SYNC},
+		{"compress-logs", no_argument, NULL, OPT_COMPRESS_LOGS},
+		{"binary-results", no_argument, NULL, OPT_BINARY_RESULTS},
 		{"log-level", required_argument, NULL, OPT_LOG_LEVEL},
 		{"test-list", required_argument, NULL, OPT_TEST_LIST},
 		{"overwrite", no_argument, NULL, OPT_OVERWRITE},
@@ -530,6 +548,7 @@ bool parse_options(int argc, char **argv,
 		{"use-watchdog", no_argument, NULL, OPT_WATCHDOG},
 		{"piglit-style-dmesg", no_argument, NULL, OPT_PIGLIT_DMESG},
 		{"dmesg-warn-level", required_argument, NULL, OPT_DMESG_WARN_LEVEL},
+		{"dmesg-suppressions", required_argument, NULL, OPT_DMESG_SUPPRESSIONS},
 		{"prune-mode", required_argument, NULL, OPT_PRUNE_MODE},
 		{"blacklist", required_argument, NULL, OPT_BLACKLIST},
 		{"list-all", no_argument, NULL, OPT_LIST_ALL},
@@ -581,6 +600,12 @@ bool parse_options(int argc, char **argv,
 		case OPT_SYNC:
 			settings->sync = true;
 			break;
+		case OPT_COMPRESS_LOGS:
+			settings->compress_logs = true;
+			break;
+		case OPT_BINARY_RESULTS:
+			settings->binary_results = true;
+			break;
 		case OPT_LOG_LEVEL:
 			if (!set_log_level(settings, optarg)) {
 				usage("Cannot parse log level", stderr);
@@ -629,6 +654,10 @@ bool parse_options(int argc, char **argv,
 		case OPT_DMESG_WARN_LEVEL:
 			settings->dmesg_warn_level = atoi(optarg);
 			break;
+		case OPT_DMESG_SUPPRESSIONS:
+			free(settings->dmesg_suppressions);
+			settings->dmesg_suppressions = absolute_path(optarg);
+			break;
 		case OPT_PRUNE_MODE:
 			if (!set_prune_mode(settings, optarg)) {
 				usage("Cannot parse prune mode", stderr);
@@ -718,6 +747,14 @@ bool validate_settings(struct settings *settings)
 		return false;
 	}
 
+	if (settings->dmesg_suppressions) {
+		struct dmesg_classifier classifier;
+
+		if (!dmesg_classifier_init(&classifier, settings))
+			return false;
+		dmesg_classifier_fini(&classifier);
+	}
+
 	if (!settings->results_path) {
 		usage("No results-path set; this shouldn't happen", stderr);
 		return false;
@@ -844,6 +881,8 @@ bool serialize_settings(struct settings *settings)
 	SERIALIZE_LINE(f, settings, dry_run, "%d");
 	SERIALIZE_LINE(f, settings, allow_non_root, "%d");
 	SERIALIZE_LINE(f, settings, sync, "%d");
+	SERIALIZE_LINE(f, settings, compress_logs, "%d");
+	SERIALIZE_LINE(f, settings, binary_results, "%d");
 	SERIALIZE_LINE(f, settings, log_level, "%d");
 	SERIALIZE_LINE(f, settings, overwrite, "%d");
 	SERIALIZE_LINE(f, settings, multiple_mode, "%d");
@@ -853,6 +892,8 @@ bool serialize_settings(struct settings *settings)
 	SERIALIZE_LINE(f, settings, use_watchdog, "%d");
 	SERIALIZE_LINE(f, settings, piglit_style_dmesg, "%d");
 	SERIALIZE_LINE(f, settings, dmesg_warn_level, "%d");
+	if (settings->dmesg_suppressions)
+		SERIALIZE_LINE(f, settings, dmesg_suppressions, "%s");
 	SERIALIZE_LINE(f, settings, prune_mode, "%d");
 	SERIALIZE_LINE(f, settings, test_root, "%s");
 	SERIALIZE_LINE(f, settings, results_path, "%s");
@@ -896,6 +937,8 @@ bool read_settings_from_file(struct settings *settings, FILE *f)
 		PARSE_LINE(settings, name, val, dry_run, numval);
 		PARSE_LINE(settings, name, val, allow_non_root, numval);
 		PARSE_LINE(settings, name, val, sync, numval);
+		PARSE_LINE(settings, name, val, compress_logs, numval);
+		PARSE_LINE(settings, name, val, binary_results, numval);
 		PARSE_LINE(settings, name, val, log_level, numval);
 		PARSE_LINE(settings, name, val, overwrite, numval);
 		PARSE_LINE(settings, name, val, multiple_mode, numval);
@@ -905,6 +948,7 @@ bool read_settings_from_file(struct settings *settings, FILE *f)
 		PARSE_LINE(settings, name, val, use_watchdog, numval);
 		PARSE_LINE(settings, name, val, piglit_style_dmesg, numval);
 		PARSE_LINE(settings, name, val, dmesg_warn_level, numval);
+		PARSE_LINE(settings, name, val, dmesg_suppressions, val ? strdup(val) : NULL);
 		PARSE_LINE(settings, name, val, prune_mode, numval);
 		PARSE_LINE(settings, name, val, test_root, val ? strdup(val) : NULL);
 		PARSE_LINE(settings, name, val, results_path, val ? strdup(val) : NULL);
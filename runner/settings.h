@@ -47,6 +47,8 @@ struct settings {
 	struct regex_list include_regexes;
 	struct regex_list exclude_regexes;
 	bool sync;
+	bool compress_logs;
+	bool binary_results;
 	int log_level;
 	bool overwrite;
 	bool multiple_mode;
@@ -58,6 +60,7 @@ struct settings {
 	char *results_path;
 	bool piglit_style_dmesg;
 	int dmesg_warn_level;
+	char *dmesg_suppressions;
 	int prune_mode;
 	bool list_all;
 	char *code_coverage_script;
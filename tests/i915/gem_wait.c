@@ -25,8 +25,6 @@
  *
  */
 
-#include <sys/poll.h>
-
 #include "i915/gem.h"
 #include "i915/gem_create.h"
 #include "igt.h"
@@ -118,7 +116,7 @@ static void basic(int fd, const intel_ctx_t *ctx, unsigned engine,
 
 		if ((flags & HANG) == 0 && !timespec_isset(&spin->last_signal))
 			igt_warn("spinner not terminated, expired? %d!\n",
-				 poll(&(struct pollfd){ spin->timerfd, POLLIN }, 1, 0));
+				 !igt_timer_pending(&spin->timer));
 
 		igt_assert_eq(__gem_wait(fd, &wait), 0);
 	} else {
@@ -889,7 +889,6 @@ static bool
 init_sys_info(void)
 {
 	const char *test_set_name = NULL;
-	struct intel_perf_metric_set *metric_set_iter;
 
 	igt_assert_neq(devid, 0);
 
@@ -918,13 +917,7 @@ init_sys_info(void)
 		undefined_a_counters = gen8_undefined_a_counters;
 	}
 
-	igt_list_for_each_entry(metric_set_iter, &intel_perf->metric_sets, link) {
-		if (strcmp(metric_set_iter->symbol_name, test_set_name) == 0) {
-			test_set = metric_set_iter;
-			break;
-		}
-	}
-
+	test_set = intel_perf_find_metric_set(intel_perf, test_set_name);
 	if (!test_set)
 		return false;
 
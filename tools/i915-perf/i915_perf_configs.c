@@ -161,14 +161,10 @@ perf_ioctl(int fd, unsigned long request, void *arg)
 static const char *
 metric_name(struct intel_perf *perf, const char *hw_config_guid)
 {
-	struct intel_perf_metric_set *metric_set;
+	struct intel_perf_metric_set *metric_set =
+		intel_perf_find_metric_set_by_guid(perf, hw_config_guid);
 
-	igt_list_for_each_entry(metric_set, &perf->metric_sets, link) {
-		if (!strcmp(metric_set->hw_config_guid, hw_config_guid))
-			return metric_set->symbol_name;
-	}
-
-	return "Unknown";
+	return metric_set ? metric_set->symbol_name : "Unknown";
 }
 
 static void
@@ -25,6 +25,7 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -40,9 +41,59 @@
 #include "intel_chipset.h"
 #include "i915/perf.h"
 #include "i915/perf_data_reader.h"
+#include "i915/perf_eval.h"
 
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
 #define MIN(a,b) ((a) > (b) ? (b) : (a))
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+/*
+ * Number of timeline items for which counters are evaluated at once, this
+ * is also the unit of work of the export threads.
+ */
+#define CHUNK_SIZE 1024
+
+enum output_format {
+	OUTPUT_TEXT,
+	OUTPUT_CSV,
+	OUTPUT_BINARY,
+};
+
+/*
+ * Binary output: a header, the description of the columns and then row
+ * groups of up to CHUNK_SIZE rows, each storing the values of its columns
+ * one column after the other (8 bytes per value, native endianness), so
+ * that columns can be loaded straight into arrays by analysis tools.
+ */
+#define EXPORT_MAGIC "I915COL"
+#define EXPORT_VERSION 1
+
+enum export_column_type {
+	EXPORT_COLUMN_UINT64,
+	EXPORT_COLUMN_DOUBLE,
+};
+
+struct export_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_columns;
+	uint64_t n_rows;
+};
+
+struct export_column {
+	char name[56];
+	uint32_t type; /* enum export_column_type */
+	uint32_t pad;
+};
+
+struct export_row_group {
+	uint32_t n_rows;
+	uint32_t pad;
+};
+
+static const char *export_item_columns[] = {
+	"cpu_ts_start", "cpu_ts_end", "gpu_ts_start", "gpu_ts_end", "hw_id",
+};
 
 static void
 usage(void)
@@ -53,7 +104,15 @@ usage(void)
 	       "     --help,    -h             Print this screen\n"
 	       "     --counters, -c c1,c2,...  List of counters to display values for.\n"
 	       "                               Use 'all' to display all counters.\n"
-	       "                               Use 'list' to list available counters.\n");
+	       "                               Use 'list' to list available counters.\n"
+	       "     --format,  -f format      Output format: text (default), csv or\n"
+	       "                               binary (columnar, see i915_perf_reader.c)\n"
+	       "     --output,  -o file        Write the timeline to file instead of stdout\n"
+	       "     --jobs,    -j n           Number of threads to use (default: number\n"
+	       "                               of CPUs)\n"
+	       "     --window,  -w start,end   Only read the samples between start and end,\n"
+	       "                               in milliseconds from the first sample, without\n"
+	       "                               loading the whole recording\n");
 }
 
 static struct intel_perf_logical_counter *
@@ -165,22 +224,337 @@ get_logical_counters(struct intel_perf_metric_set *metric_set,
 	return counters;
 }
 
+struct export_chunk {
+	char *data;
+	size_t size;
+	bool done;
+};
+
+struct export {
+	const struct intel_perf_data_reader *reader;
+	const struct intel_perf_eval_program *program;
+	struct intel_perf_logical_counter **counters;
+	uint32_t n_counters;
+	enum output_format format;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint32_t n_chunks;
+	uint32_t next_chunk;
+	uint32_t next_write;
+
+	/* Chunks formatted ahead of the writer, indexed by chunk % window */
+	struct export_chunk *window;
+	uint32_t window_size;
+};
+
+struct export_worker {
+	struct export *exp;
+	pthread_t thread;
+
+	struct intel_perf_accumulator *accumulators;
+	union intel_perf_eval_value **values;
+	uint64_t *column;
+};
+
+static bool
+counter_is_float(const struct intel_perf_logical_counter *counter)
+{
+	return counter->storage == INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE ||
+		counter->storage == INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT;
+}
+
+static void
+format_text(struct export_worker *worker, FILE *f,
+	    const struct intel_perf_timeline_item *items, uint32_t n_items)
+{
+	struct export *exp = worker->exp;
+
+	for (uint32_t i = 0; i < n_items; i++) {
+		const struct intel_perf_timeline_item *item = &items[i];
+
+		fprintf(f, "Time: CPU=0x%016" PRIx64 "-0x%016" PRIx64
+			" GPU=0x%016" PRIx64 "-0x%016" PRIx64"\n",
+			item->cpu_ts_start, item->cpu_ts_end,
+			item->ts_start, item->ts_end);
+		fprintf(f, "hw_id=0x%x %s\n",
+			item->hw_id, item->hw_id == 0xffffffff ? "(idle)" : "");
+
+		for (uint32_t c = 0; c < exp->n_counters; c++) {
+			const struct intel_perf_logical_counter *counter =
+				exp->counters[c];
+
+			if (counter_is_float(counter))
+				fprintf(f, "   %s: %f\n", counter->symbol_name,
+					worker->values[c][i].f);
+			else
+				fprintf(f, "   %s: %" PRIu64 "\n", counter->symbol_name,
+					worker->values[c][i].u64);
+		}
+	}
+}
+
+static void
+format_csv(struct export_worker *worker, FILE *f,
+	   const struct intel_perf_timeline_item *items, uint32_t n_items)
+{
+	struct export *exp = worker->exp;
+
+	for (uint32_t i = 0; i < n_items; i++) {
+		const struct intel_perf_timeline_item *item = &items[i];
+
+		fprintf(f, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%u",
+			item->cpu_ts_start, item->cpu_ts_end,
+			item->ts_start, item->ts_end, item->hw_id);
+
+		for (uint32_t c = 0; c < exp->n_counters; c++) {
+			if (counter_is_float(exp->counters[c]))
+				fprintf(f, ",%f", worker->values[c][i].f);
+			else
+				fprintf(f, ",%" PRIu64, worker->values[c][i].u64);
+		}
+
+		fputc('\n', f);
+	}
+}
+
+static void
+format_binary(struct export_worker *worker, FILE *f,
+	      const struct intel_perf_timeline_item *items, uint32_t n_items)
+{
+	struct export *exp = worker->exp;
+	struct export_row_group group = { .n_rows = n_items };
+
+	fwrite(&group, sizeof(group), 1, f);
+
+	for (uint32_t col = 0; col < ARRAY_SIZE(export_item_columns); col++) {
+		for (uint32_t i = 0; i < n_items; i++) {
+			const struct intel_perf_timeline_item *item = &items[i];
+			const uint64_t item_values[] = {
+				item->cpu_ts_start, item->cpu_ts_end,
+				item->ts_start, item->ts_end, item->hw_id,
+			};
+
+			worker->column[i] = item_values[col];
+		}
+		fwrite(worker->column, sizeof(*worker->column), n_items, f);
+	}
+
+	for (uint32_t c = 0; c < exp->n_counters; c++)
+		fwrite(worker->values[c], sizeof(*worker->values[c]), n_items, f);
+}
+
+static void
+format_chunk(struct export_worker *worker, uint32_t chunk,
+	     struct export_chunk *out)
+{
+	struct export *exp = worker->exp;
+	const struct intel_perf_data_reader *reader = exp->reader;
+	const struct intel_perf_timeline_item *items =
+		&reader->timelines[chunk * CHUNK_SIZE];
+	uint32_t n_items = MIN(CHUNK_SIZE, reader->n_timelines - chunk * CHUNK_SIZE);
+	FILE *f = open_memstream(&out->data, &out->size);
+
+	if (exp->program) {
+		for (uint32_t i = 0; i < n_items; i++) {
+			intel_perf_accumulate_reports(&worker->accumulators[i],
+						      reader->metric_set->perf_oa_format,
+						      reader->records[items[i].record_start],
+						      reader->records[items[i].record_end]);
+		}
+
+		intel_perf_eval_program_run(exp->program, worker->accumulators,
+					    n_items, worker->values);
+	}
+
+	switch (exp->format) {
+	case OUTPUT_TEXT:
+		format_text(worker, f, items, n_items);
+		break;
+	case OUTPUT_CSV:
+		format_csv(worker, f, items, n_items);
+		break;
+	case OUTPUT_BINARY:
+		format_binary(worker, f, items, n_items);
+		break;
+	}
+
+	fclose(f);
+}
+
+static void *
+export_thread(void *data)
+{
+	struct export_worker *worker = data;
+	struct export *exp = worker->exp;
+
+	while (true) {
+		struct export_chunk chunk = { .done = true };
+		uint32_t idx;
+
+		pthread_mutex_lock(&exp->lock);
+		while (exp->next_chunk < exp->n_chunks &&
+		       exp->next_chunk >= exp->next_write + exp->window_size)
+			pthread_cond_wait(&exp->cond, &exp->lock);
+		idx = exp->next_chunk;
+		if (idx < exp->n_chunks)
+			exp->next_chunk++;
+		pthread_mutex_unlock(&exp->lock);
+
+		if (idx >= exp->n_chunks)
+			break;
+
+		format_chunk(worker, idx, &chunk);
+
+		pthread_mutex_lock(&exp->lock);
+		exp->window[idx % exp->window_size] = chunk;
+		pthread_cond_broadcast(&exp->cond);
+		pthread_mutex_unlock(&exp->lock);
+	}
+
+	return NULL;
+}
+
+static void
+write_header(struct export *exp, FILE *out)
+{
+	struct export_header header = {
+		.magic = EXPORT_MAGIC,
+		.version = EXPORT_VERSION,
+		.n_columns = ARRAY_SIZE(export_item_columns) + exp->n_counters,
+		.n_rows = exp->reader->n_timelines,
+	};
+
+	switch (exp->format) {
+	case OUTPUT_TEXT:
+		break;
+	case OUTPUT_CSV:
+		for (uint32_t i = 0; i < ARRAY_SIZE(export_item_columns); i++)
+			fprintf(out, "%s%s", i ? "," : "", export_item_columns[i]);
+		for (uint32_t c = 0; c < exp->n_counters; c++)
+			fprintf(out, ",%s", exp->counters[c]->symbol_name);
+		fputc('\n', out);
+		break;
+	case OUTPUT_BINARY:
+		fwrite(&header, sizeof(header), 1, out);
+		for (uint32_t i = 0; i < header.n_columns; i++) {
+			struct export_column column = {};
+
+			if (i < ARRAY_SIZE(export_item_columns)) {
+				snprintf(column.name, sizeof(column.name), "%s",
+					 export_item_columns[i]);
+				column.type = EXPORT_COLUMN_UINT64;
+			} else {
+				const struct intel_perf_logical_counter *counter =
+					exp->counters[i - ARRAY_SIZE(export_item_columns)];
+
+				snprintf(column.name, sizeof(column.name), "%s",
+					 counter->symbol_name);
+				column.type = counter_is_float(counter) ?
+					EXPORT_COLUMN_DOUBLE : EXPORT_COLUMN_UINT64;
+			}
+			fwrite(&column, sizeof(column), 1, out);
+		}
+		break;
+	}
+}
+
+/*
+ * Chunks of the timeline are formatted by worker threads, each with their
+ * own accumulators and output buffer, while this thread writes the
+ * buffers out in order. Workers stay at most a window of chunks ahead of
+ * the writer to bound memory usage.
+ */
+static bool
+export_timeline(struct export *exp, FILE *out, uint32_t n_threads)
+{
+	struct export_worker *workers;
+	bool ok = true;
+
+	exp->n_chunks = (exp->reader->n_timelines + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	exp->window_size = 4 * n_threads;
+	exp->window = calloc(exp->window_size, sizeof(*exp->window));
+	pthread_mutex_init(&exp->lock, NULL);
+	pthread_cond_init(&exp->cond, NULL);
+
+	write_header(exp, out);
+
+	workers = calloc(n_threads, sizeof(*workers));
+	for (uint32_t t = 0; t < n_threads; t++) {
+		struct export_worker *worker = &workers[t];
+
+		worker->exp = exp;
+		worker->accumulators = calloc(CHUNK_SIZE, sizeof(*worker->accumulators));
+		worker->column = calloc(CHUNK_SIZE, sizeof(*worker->column));
+		worker->values = calloc(exp->n_counters, sizeof(*worker->values));
+		for (uint32_t c = 0; c < exp->n_counters; c++)
+			worker->values[c] = calloc(CHUNK_SIZE, sizeof(*worker->values[c]));
+
+		pthread_create(&worker->thread, NULL, export_thread, worker);
+	}
+
+	for (uint32_t idx = 0; idx < exp->n_chunks; idx++) {
+		struct export_chunk *slot = &exp->window[idx % exp->window_size];
+		struct export_chunk chunk;
+
+		pthread_mutex_lock(&exp->lock);
+		while (!slot->done)
+			pthread_cond_wait(&exp->cond, &exp->lock);
+		chunk = *slot;
+		slot->done = false;
+		exp->next_write++;
+		pthread_cond_broadcast(&exp->cond);
+		pthread_mutex_unlock(&exp->lock);
+
+		if (ok && fwrite(chunk.data, 1, chunk.size, out) != chunk.size)
+			ok = false;
+		free(chunk.data);
+	}
+
+	for (uint32_t t = 0; t < n_threads; t++) {
+		struct export_worker *worker = &workers[t];
+
+		pthread_join(worker->thread, NULL);
+		for (uint32_t c = 0; c < exp->n_counters; c++)
+			free(worker->values[c]);
+		free(worker->values);
+		free(worker->column);
+		free(worker->accumulators);
+	}
+	free(workers);
+
+	pthread_cond_destroy(&exp->cond);
+	pthread_mutex_destroy(&exp->lock);
+	free(exp->window);
+
+	return ok;
+}
+
 int
 main(int argc, char *argv[])
 {
 	const struct option long_options[] = {
 		{"help",             no_argument, 0, 'h'},
 		{"counters",   required_argument, 0, 'c'},
+		{"format",     required_argument, 0, 'f'},
+		{"output",     required_argument, 0, 'o'},
+		{"jobs",       required_argument, 0, 'j'},
+		{"window",     required_argument, 0, 'w'},
 		{0, 0, 0, 0}
 	};
 	struct intel_perf_data_reader reader;
 	struct intel_perf_logical_counter **counters;
+	struct export exp = {};
 	const struct intel_device_info *devinfo;
-	const char *counter_names = NULL;
+	const char *counter_names = NULL, *output_file = NULL;
+	enum output_format format = OUTPUT_TEXT;
+	long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	double window_start = -1, window_end = -1;
 	int32_t n_counters;
-	int fd, opt;
+	FILE *out = stdout, *info;
+	int fd, opt, ret = EXIT_FAILURE;
 
-	while ((opt = getopt_long(argc, argv, "hc:", long_options, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "hc:f:o:j:w:", long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'h':
 			usage();
@@ -188,6 +562,33 @@ main(int argc, char *argv[])
 		case 'c':
 			counter_names = optarg;
 			break;
+		case 'f':
+			if (!strcmp(optarg, "text")) {
+				format = OUTPUT_TEXT;
+			} else if (!strcmp(optarg, "csv")) {
+				format = OUTPUT_CSV;
+			} else if (!strcmp(optarg, "binary")) {
+				format = OUTPUT_BINARY;
+			} else {
+				fprintf(stderr, "Unknown output format '%s'.\n", optarg);
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'o':
+			output_file = optarg;
+			break;
+		case 'j':
+			n_threads = atoi(optarg);
+			break;
+		case 'w':
+			if (sscanf(optarg, "%lf,%lf", &window_start, &window_end) != 2 ||
+			    window_start < 0 || window_end < window_start) {
+				fprintf(stderr, "Invalid window '%s'.\n", optarg);
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
 		default:
 			fprintf(stderr, "Internal error: "
 				"unexpected getopt value: %d\n", opt);
@@ -196,6 +597,9 @@ main(int argc, char *argv[])
 		}
 	}
 
+	if (n_threads < 1)
+		n_threads = 1;
+
 	if (optind >= argc) {
 		fprintf(stderr, "No recording file specified.\n");
 		return EXIT_FAILURE;
@@ -208,78 +612,87 @@ main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	if (!intel_perf_data_reader_init(&reader, fd)) {
+	if (window_start >= 0) {
+		if (!intel_perf_data_reader_open(&reader, fd) ||
+		    !intel_perf_data_reader_load_window(&reader,
+							window_start * 1000000,
+							window_end * 1000000)) {
+			fprintf(stderr, "Unable to parse '%s': %s.\n",
+				argv[optind], reader.error_msg);
+			return EXIT_FAILURE;
+		}
+	} else if (!intel_perf_data_reader_init(&reader, fd)) {
 		fprintf(stderr, "Unable to parse '%s': %s.\n",
 			argv[optind], reader.error_msg);
 		return EXIT_FAILURE;
 	}
 
 	counters = get_logical_counters(reader.metric_set, counter_names, &n_counters);
-	if (n_counters < 0)
+	if (n_counters < 0) {
+		ret = EXIT_SUCCESS;
 		goto exit;
+	}
+
+	if (output_file) {
+		out = fopen(output_file, "w");
+		if (!out) {
+			fprintf(stderr, "Cannot open '%s': %s.\n",
+				output_file, strerror(errno));
+			goto exit;
+		}
+	}
+
+	/* Keep the recording details out of machine readable output. */
+	info = out == stdout && format != OUTPUT_TEXT ? stderr : stdout;
 
 	devinfo = intel_get_device_info(reader.devinfo.devid);
 
-	fprintf(stdout, "Recorded on device=0x%x(%s) graphics_ver=%i\n",
+	fprintf(info, "Recorded on device=0x%x(%s) graphics_ver=%i\n",
 		reader.devinfo.devid, devinfo->codename,
 		reader.devinfo.graphics_ver);
-	fprintf(stdout, "Metric used : %s (%s) uuid=%s\n",
+	fprintf(info, "Metric used : %s (%s) uuid=%s\n",
 		reader.metric_set->symbol_name, reader.metric_set->name,
 		reader.metric_set->hw_config_guid);
-	fprintf(stdout, "Reports: %u\n", reader.n_records);
-	fprintf(stdout, "Context switches: %u\n", reader.n_timelines);
-	fprintf(stdout, "Timestamp correlation points: %u\n", reader.n_correlations);
+	fprintf(info, "Reports: %u\n", reader.n_records);
+	fprintf(info, "Context switches: %u\n", reader.n_timelines);
+	fprintf(info, "Timestamp correlation points: %u\n", reader.n_correlations);
 
 	if (strcmp(reader.metric_set_uuid, reader.metric_set->hw_config_guid)) {
-		fprintf(stdout,
+		fprintf(info,
 			"WARNING: Recording used a different HW configuration.\n"
 			"WARNING: This could lead to inconsistent counter values.\n");
 	}
 
-	for (uint32_t i = 0; i < reader.n_timelines; i++) {
-		const struct intel_perf_timeline_item *item = &reader.timelines[i];
-		const struct drm_i915_perf_record_header *i915_report0 =
-			reader.records[item->record_start];
-		const struct drm_i915_perf_record_header *i915_report1 =
-			reader.records[item->record_end];
-		struct intel_perf_accumulator accu;
-
-		fprintf(stdout, "Time: CPU=0x%016" PRIx64 "-0x%016" PRIx64
-			" GPU=0x%016" PRIx64 "-0x%016" PRIx64"\n",
-			item->cpu_ts_start, item->cpu_ts_end,
-			item->ts_start, item->ts_end);
-		fprintf(stdout, "hw_id=0x%x %s\n",
-			item->hw_id, item->hw_id == 0xffffffff ? "(idle)" : "");
-
-		intel_perf_accumulate_reports(&accu, reader.metric_set->perf_oa_format,
-					      i915_report0, i915_report1);
-
-		for (uint32_t c = 0; c < n_counters; c++) {
-			struct intel_perf_logical_counter *counter = counters[c];
-
-			switch (counter->storage) {
-			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT64:
-			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT32:
-			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_BOOL32:
-				fprintf(stdout, "   %s: %" PRIu64 "\n",
-					counter->symbol_name, counter->read_uint64(reader.perf,
-										   reader.metric_set,
-										   accu.deltas));
-				break;
-			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE:
-			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT:
-				fprintf(stdout, "   %s: %f\n",
-					counter->symbol_name, counter->read_float(reader.perf,
-										  reader.metric_set,
-										  accu.deltas));
-				break;
-			}
+	exp.reader = &reader;
+	exp.counters = counters;
+	exp.n_counters = n_counters;
+	exp.format = format;
+
+	if (n_counters > 0) {
+		exp.program = intel_perf_eval_program_new(reader.perf,
+							  reader.metric_set,
+							  counters, n_counters);
+		if (!exp.program) {
+			fprintf(stderr, "Unable to compile counter equations.\n");
+			goto exit;
 		}
 	}
 
+	fflush(info);
+	if (!export_timeline(&exp, out, n_threads)) {
+		fprintf(stderr, "Failed to write output: %s.\n", strerror(errno));
+		goto exit;
+	}
+
+	ret = EXIT_SUCCESS;
+
  exit:
+	if (out != stdout && fclose(out))
+		ret = EXIT_FAILURE;
+	intel_perf_eval_program_free((struct intel_perf_eval_program *) exp.program);
+	free(counters);
 	intel_perf_data_reader_fini(&reader);
 	close(fd);
 
-	return EXIT_SUCCESS;
+	return ret;
 }
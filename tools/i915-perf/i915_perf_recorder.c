@@ -793,7 +793,6 @@ main(int argc, char *argv[])
 	};
 	double corr_period = 1.0, perf_period = 0.001;
 	const char *metric_name = NULL, *output_file = "i915_perf.record";
-	struct intel_perf_metric_set *metric_set;
 	struct intel_perf_record_timestamp_correlation initial_correlation;
 	struct timespec now;
 	uint64_t corr_period_ns, poll_time_ns;
@@ -892,27 +891,23 @@ main(int argc, char *argv[])
 		goto fail;
 	}
 
-	intel_perf_load_perf_configs(ctx.perf, ctx.drm_fd);
-
 	if (metric_name) {
 		if (!strcmp(metric_name, "list")) {
+			intel_perf_load_metric_sets(ctx.perf);
 			print_metric_sets(ctx.perf);
 			return EXIT_SUCCESS;
 		}
 
-		igt_list_for_each_entry(metric_set, &ctx.perf->metric_sets, link) {
-			if (!strcasecmp(metric_set->symbol_name, metric_name)) {
-				ctx.metric_set = metric_set;
-				break;
-			}
-		}
+		ctx.metric_set = intel_perf_find_metric_set(ctx.perf, metric_name);
 	}
 
 	if (list_counters) {
-		if (!ctx.metric_set)
+		if (!ctx.metric_set) {
+			intel_perf_load_metric_sets(ctx.perf);
 			print_metric_sets_counters(ctx.perf);
-		else
+		} else {
 			print_metric_set_counters(ctx.metric_set);
+		}
 		teardown_recording_context(&ctx);
 		return EXIT_SUCCESS;
 	}
@@ -922,6 +917,7 @@ main(int argc, char *argv[])
 			fprintf(stderr, "No metric set specified.\n");
 		else
 			fprintf(stderr, "Unknown metric set '%s'.\n", metric_name);
+		intel_perf_load_metric_sets(ctx.perf);
 		print_metric_sets(ctx.perf);
 		goto fail;
 	}
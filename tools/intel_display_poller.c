@@ -25,6 +25,7 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -38,6 +39,8 @@
 #include "igt_debugfs.h"
 #include "drmtest.h"
 #include "igt_aux.h"
+#include "igt_stats.h"
+#include "intel_mmio_trace.h"
 
 enum test {
 	TEST_INVALID,
@@ -63,6 +66,14 @@ enum test {
 	TEST_VRR_PUSH,
 };
 
+/* the options a trace needs to be replayed */
+struct poller_args {
+	int32_t test, pipe, bit;
+	int32_t target_scanline, target_fuzz, vrr_push_scanline;
+	uint8_t pixelcount, async_flip, pad[2];
+};
+
+static struct intel_mmio_trace trace;
 static uint32_t vlv_offset;
 static uint16_t pipe_offset[4] = { 0, 0x1000, 0x2000, 0x3000, };
 
@@ -75,24 +86,45 @@ static void sighandler(int x)
 	quit = true;
 }
 
+/* a replay ends like an interrupted run once the recording is exhausted */
+static bool trace_done(void)
+{
+	if (intel_mmio_trace_done(&trace))
+		quit = true;
+
+	return quit && trace.mode == INTEL_MMIO_TRACE_REPLAY;
+}
+
 static uint16_t read_reg_16(uint32_t reg)
 {
-	return INREG16(vlv_offset + reg);
+	if (trace_done())
+		return 0;
+
+	return intel_mmio_trace_read(&trace, vlv_offset + reg, true);
 }
 
 static uint32_t read_reg(uint32_t reg)
 {
-	return INREG(vlv_offset + reg);
+	if (trace_done())
+		return 0;
+
+	return intel_mmio_trace_read(&trace, vlv_offset + reg, false);
 }
 
 static void write_reg_16(uint32_t reg, uint16_t val)
 {
-	OUTREG16(vlv_offset + reg, val);
+	if (trace_done())
+		return;
+
+	intel_mmio_trace_write(&trace, vlv_offset + reg, val, true);
 }
 
 static void write_reg(uint32_t reg, uint32_t val)
 {
-	OUTREG(vlv_offset + reg, val);
+	if (trace_done())
+		return;
+
+	intel_mmio_trace_write(&trace, vlv_offset + reg, val, false);
 }
 
 static char pipe_name(int pipe)
@@ -1320,6 +1352,87 @@ static const char *test_name(enum test test, int pipe, int bit, bool test_pixel_
 	}
 }
 
+static void print_percentiles(const char *name, igt_stats_t *stats)
+{
+	printf("  %-4s %8.0f %8.0f %8.0f %8.0f %8.0f\n", name,
+	       igt_stats_get_percentile(stats, 0),
+	       igt_stats_get_percentile(stats, 50),
+	       igt_stats_get_percentile(stats, 90),
+	       igt_stats_get_percentile(stats, 99),
+	       igt_stats_get_percentile(stats, 100));
+}
+
+#define HISTOGRAM_BUCKETS 16
+#define HISTOGRAM_WIDTH 50
+
+static void print_distribution(const char *name, int field,
+			       const uint32_t *min, const uint32_t *max,
+			       const int count)
+{
+	unsigned int hist[HISTOGRAM_BUCKETS] = {}, peak = 0;
+	igt_stats_t first, last, mid;
+	uint64_t lo, range;
+	int i, n;
+
+	for (n = 0; n < count; n++)
+		if (min[n] == 0 && max[n] == 0)
+			break;
+	if (!n)
+		return;
+
+	igt_stats_init_with_size(&first, n);
+	igt_stats_init_with_size(&last, n);
+	igt_stats_init_with_size(&mid, n);
+	for (i = 0; i < n; i++) {
+		igt_stats_push(&first, min[i]);
+		igt_stats_push(&last, max[i]);
+		igt_stats_push(&mid, (min[i] + max[i] + 1) >> 1);
+	}
+
+	printf("%s: [%u] %d samples\n", name, field, n);
+	printf("  %-4s %8s %8s %8s %8s %8s\n", "", "min", "p50", "p90", "p99", "max");
+	print_percentiles("min", &first);
+	print_percentiles("max", &last);
+
+	/* the midpoints, as the best estimate of the position of the event */
+	lo = igt_stats_get_min(&mid);
+	range = igt_stats_get_range(&mid) / HISTOGRAM_BUCKETS + 1;
+	for (i = 0; i < n; i++) {
+		int bucket = (mid.values_u64[i] - lo) / range;
+
+		peak = max(peak, ++hist[bucket]);
+	}
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+
+		printf("  %6" PRIu64 " - %6" PRIu64 " %5u %.*s\n",
+		       lo + i * range, lo + (i + 1) * range - 1, hist[i],
+		       (hist[i] * HISTOGRAM_WIDTH + peak - 1) / peak,
+		       "##################################################");
+	}
+
+	igt_stats_fini(&mid);
+	igt_stats_fini(&last);
+	igt_stats_fini(&first);
+}
+
+static void print_access_intervals(void)
+{
+	printf("MMIO access intervals, %" PRIu64 " accesses\n",
+	       trace.num_records);
+
+	for (int i = 0; i < INTEL_MMIO_TRACE_LOG2_BUCKETS; i++) {
+		if (!trace.interval_hist[i])
+			continue;
+
+		printf("  %10" PRIu64 " - %10" PRIu64 " ns %10" PRIu64 "\n",
+		       i ? (uint64_t)1 << i : 0, ((uint64_t)2 << i) - 1,
+		       trace.interval_hist[i]);
+	}
+}
+
 static void __attribute__((noreturn)) usage(const char *name)
 {
 	fprintf(stderr, "Usage: %s [options]\n"
@@ -1330,7 +1443,10 @@ static void __attribute__((noreturn)) usage(const char *name)
 		" -f,--fuzz <target fuzz>\n"
 		" -x,--pixel\n"
 		" -a,--async\n"
-		" -v,--vrr-push <push scanline>\n",
+		" -v,--vrr-push <push scanline>\n"
+		" -o,--record <trace file>\n"
+		" -r,--replay <trace file>\n"
+		" -m,--model <pci device id>\n",
 		name);
 	exit(1);
 }
@@ -1343,7 +1459,11 @@ int main(int argc, char *argv[])
 	bool test_pixelcount = false;
 	bool test_async_flip = false;
 	int vrr_push_scanline = -1;
-	uint32_t devid;
+	const char *record = NULL, *replay = NULL;
+	struct poller_args args = {};
+	uint32_t devid = 0;
+	bool model = false;
+	int err;
 	uint32_t min[2*128] = {};
 	uint32_t max[2*128] = {};
 	uint32_t a, b;
@@ -1360,10 +1480,13 @@ int main(int argc, char *argv[])
 			{ .name = "pixel", .has_arg = no_argument, },
 			{ .name = "async", .has_arg = no_argument, },
 			{ .name = "vrr-push", .has_arg = required_argument, },
+			{ .name = "record", .has_arg = required_argument, },
+			{ .name = "replay", .has_arg = required_argument, },
+			{ .name = "model", .has_arg = required_argument, },
 			{ },
 		};
 
-		int opt = getopt_long(argc, argv, "t:p:b:l:f:xav:", long_options, NULL);
+		int opt = getopt_long(argc, argv, "t:p:b:l:f:xav:o:r:m:", long_options, NULL);
 		if (opt == -1)
 			break;
 
@@ -1439,10 +1562,53 @@ int main(int argc, char *argv[])
 			if (vrr_push_scanline < 0)
 				usage(argv[0]);
 			break;
+		case 'o':
+			record = optarg;
+			break;
+		case 'r':
+			replay = optarg;
+			break;
+		case 'm':
+			devid = strtoul(optarg, NULL, 16);
+			model = true;
+			break;
 		}
 	}
 
-	devid = intel_get_pci_device()->device_id;
+	intel_mmio_trace_init(&trace);
+
+	if (replay) {
+		/* the recording decides the device and the test */
+		err = intel_mmio_trace_replay(&trace, replay);
+		if (err)
+			errx(1, "%s: %s", replay, strerror(-err));
+		if (trace.args_size != sizeof(args))
+			errx(1, "%s: not a trace of %s", replay, argv[0]);
+
+		memcpy(&args, trace.args, sizeof(args));
+		test = args.test;
+		pipe = args.pipe;
+		bit = args.bit;
+		target_scanline = args.target_scanline;
+		target_fuzz = args.target_fuzz;
+		vrr_push_scanline = args.vrr_push_scanline;
+		test_pixelcount = args.pixelcount;
+		test_async_flip = args.async_flip;
+		devid = trace.devid;
+	} else if (model) {
+		intel_mmio_trace_model(&trace, devid);
+	} else {
+		devid = intel_get_pci_device()->device_id;
+	}
+
+	args.test = test;
+	args.pipe = pipe;
+	args.bit = bit;
+	args.target_scanline = target_scanline;
+	args.target_fuzz = target_fuzz;
+	args.vrr_push_scanline = vrr_push_scanline;
+	args.pixelcount = test_pixelcount;
+	args.async_flip = test_async_flip;
 
 	/*
 	 * check if the requires registers are
@@ -1607,7 +1773,19 @@ int main(int argc, char *argv[])
 		break;
 	}
 
-	intel_register_access_init(&mmio_data ,intel_get_pci_device(), 0, -1);
+	trace.model.mmio_base = vlv_offset;
+	for (i = 0; i < ARRAY_SIZE(pipe_offset); i++)
+		trace.model.pipe_offset[i] = pipe_offset[i];
+
+	if (record) {
+		err = intel_mmio_trace_record(&trace, record, devid,
+					      &args, sizeof(args));
+		if (err)
+			errx(1, "%s: %s", record, strerror(-err));
+	}
+
+	if (trace.mode == INTEL_MMIO_TRACE_LIVE)
+		intel_register_access_init(&mmio_data ,intel_get_pci_device(), 0, -1);
 
 	printf("%s?\n", test_name(test, pipe, bit, test_pixelcount));
 
@@ -1701,10 +1879,20 @@ int main(int argc, char *argv[])
 		assert(0);
 	}
 
-	intel_register_access_fini(&mmio_data);
+	if (trace.mode == INTEL_MMIO_TRACE_LIVE)
+		intel_register_access_fini(&mmio_data);
 
-	if (quit)
+	if (intel_mmio_trace_diverged(&trace))
+		errx(1, "%s: diverges from the replay after %" PRIu64 " accesses",
+		     replay, trace.num_records);
+
+	/* print what was gathered before the end of a replay */
+	if (quit && trace.mode != INTEL_MMIO_TRACE_REPLAY) {
+		err = intel_mmio_trace_fini(&trace);
+		if (err)
+			errx(1, "%s: %s", record, strerror(-err));
 		return 0;
+	}
 
 	for (i = 0; i < count; i++) {
 		if (min[0*count+i] == 0 && max[0*count+i] == 0)
@@ -1741,5 +1929,17 @@ int main(int argc, char *argv[])
 
 	printf("%s: [%u] %6u - %6u\n", test_name(test, pipe, bit, test_pixelcount), 1, a, b);
 
+	print_distribution(test_name(test, pipe, bit, test_pixelcount), 0,
+			   &min[0*count], &max[0*count], count);
+	print_distribution(test_name(test, pipe, bit, test_pixelcount), 1,
+			   &min[1*count], &max[1*count], count);
+
+	if (trace.timed)
+		print_access_intervals();
+
+	err = intel_mmio_trace_fini(&trace);
+	if (err)
+		errx(1, "%s: %s", record, strerror(-err));
+
 	return 0;
 }
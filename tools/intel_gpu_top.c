@@ -38,7 +38,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -59,6 +61,7 @@ struct pmu_counter {
 	uint64_t type;
 	uint64_t config;
 	unsigned int idx;
+	int fd;
 	struct pmu_pair val;
 	double scale;
 	const char *units;
@@ -112,6 +115,9 @@ struct engines {
 	bool discrete;
 	char *device;
 
+	/* Per engine class aggregated view, see update_class_engines(). */
+	struct engines *class_engines;
+
 	/* Do not edit below this line.
 	 * This structure is reallocated every time a new engine is
 	 * found and size is increased by sizeof (engine).
@@ -226,6 +232,7 @@ rapl_open(struct pmu_counter *pmu,
 	if (engines->rapl_fd == -1)
 		engines->rapl_fd = fd;
 
+	pmu->fd = fd;
 	pmu->idx = engines->num_rapl++;
 	pmu->present = true;
 }
@@ -437,14 +444,15 @@ static struct engines *discover_engines(char *device)
 	return engines;
 }
 
-#define _open_pmu(type, cnt, pmu, fd) \
+#define _open_pmu(type, cnt, pmu, group) \
 ({ \
 	int fd__; \
 \
-	fd__ = igt_perf_open_group((type), (pmu)->config, (fd)); \
+	fd__ = igt_perf_open_group((type), (pmu)->config, (group)); \
 	if (fd__ >= 0) { \
-		if ((fd) == -1) \
-			(fd) = fd__; \
+		if ((group) == -1) \
+			(group) = fd__; \
+		(pmu)->fd = fd__; \
 		(pmu)->present = true; \
 		(pmu)->idx = (cnt)++; \
 	} \
@@ -474,6 +482,7 @@ imc_open(struct pmu_counter *pmu,
 	if (engines->imc_fd == -1)
 		engines->imc_fd = fd;
 
+	pmu->fd = fd;
 	pmu->idx = engines->num_imc++;
 	pmu->present = true;
 }
@@ -549,6 +558,35 @@ static int pmu_init(struct engines *engines)
 	return 0;
 }
 
+static void pmu_close(struct pmu_counter *pmu)
+{
+	if (pmu->present)
+		close(pmu->fd);
+	pmu->present = false;
+}
+
+static void pmu_fini(struct engines *engines)
+{
+	unsigned int i;
+
+	for (i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+
+		pmu_close(&engine->busy);
+		pmu_close(&engine->wait);
+		pmu_close(&engine->sema);
+	}
+
+	pmu_close(&engines->irq);
+	pmu_close(&engines->freq_req);
+	pmu_close(&engines->freq_act);
+	pmu_close(&engines->rc6);
+	pmu_close(&engines->r_gpu);
+	pmu_close(&engines->r_pkg);
+	pmu_close(&engines->imc_reads);
+	pmu_close(&engines->imc_writes);
+}
+
 static uint64_t pmu_read_multi(int fd, unsigned int num, uint64_t *val)
 {
 	uint64_t buf[2 + num];
@@ -597,20 +635,37 @@ static void __update_sample(struct pmu_counter *counter, uint64_t val)
 	counter->val.cur = val;
 }
 
-static void update_sample(struct pmu_counter *counter, uint64_t *val)
+static void update_sample(struct pmu_counter *counter, const uint64_t *val)
 {
 	if (counter->present)
 		__update_sample(counter, val[counter->idx]);
 }
 
-static void pmu_sample(struct engines *engines)
+static uint64_t
+pmu_read_all(struct engines *engines, uint64_t *val, uint64_t *rapl,
+	     uint64_t *imc)
+{
+	uint64_t ts;
+
+	ts = pmu_read_multi(engines->fd, engines->num_counters, val);
+
+	if (engines->num_rapl)
+		pmu_read_multi(engines->rapl_fd, engines->num_rapl, rapl);
+
+	if (engines->num_imc)
+		pmu_read_multi(engines->imc_fd, engines->num_imc, imc);
+
+	return ts;
+}
+
+static void
+pmu_update(struct engines *engines, uint64_t ts, const uint64_t *val,
+	   const uint64_t *rapl, const uint64_t *imc)
 {
-	const int num_val = engines->num_counters;
-	uint64_t val[2 + num_val];
 	unsigned int i;
 
 	engines->ts.prev = engines->ts.cur;
-	engines->ts.cur = pmu_read_multi(engines->fd, num_val, val);
+	engines->ts.cur = ts;
 
 	update_sample(&engines->freq_req, val);
 	update_sample(&engines->freq_act, val);
@@ -626,18 +681,27 @@ static void pmu_sample(struct engines *engines)
 	}
 
 	if (engines->num_rapl) {
-		pmu_read_multi(engines->rapl_fd, engines->num_rapl, val);
-		update_sample(&engines->r_gpu, val);
-		update_sample(&engines->r_pkg, val);
+		update_sample(&engines->r_gpu, rapl);
+		update_sample(&engines->r_pkg, rapl);
 	}
 
 	if (engines->num_imc) {
-		pmu_read_multi(engines->imc_fd, engines->num_imc, val);
-		update_sample(&engines->imc_reads, val);
-		update_sample(&engines->imc_writes, val);
+		update_sample(&engines->imc_reads, imc);
+		update_sample(&engines->imc_writes, imc);
 	}
 }
 
+static void pmu_sample(struct engines *engines)
+{
+	uint64_t val[2 + engines->num_counters];
+	uint64_t rapl[2 + engines->num_rapl];
+	uint64_t imc[2 + engines->num_imc];
+	uint64_t ts;
+
+	ts = pmu_read_all(engines, val, rapl, imc);
+	pmu_update(engines, ts, val, rapl, imc);
+}
+
 enum client_status {
 	FREE = 0, /* mbz */
 	ALIVE,
@@ -1073,16 +1137,11 @@ static size_t freadat2buf(char *buf, const size_t sz, DIR *at, const char *name)
 	return count;
 }
 
-static struct clients *scan_clients(struct clients *clients)
+static void begin_client_scan(struct clients *clients)
 {
-	struct dirent *proc_dent;
 	struct client *c;
-	DIR *proc_dir;
 	int tmp;
 
-	if (!clients)
-		return clients;
-
 	for_each_client(clients, c, tmp) {
 		assert(c->status != PROBE);
 		if (c->status == ALIVE)
@@ -1090,10 +1149,55 @@ static struct clients *scan_clients(struct clients *clients)
 		else
 			break; /* Free block at the end of array. */
 	}
+}
+
+static void
+client_found(struct clients *clients, const struct drm_client_fdinfo *info,
+	     unsigned int pid, char *name)
+{
+	struct client *c;
+
+	if (find_client(clients, ALIVE, info->id))
+		return; /* Skip duplicate fds. */
+
+	c = find_client(clients, PROBE, info->id);
+	if (!c)
+		add_client(clients, info, pid, name);
+	else
+		update_client(c, pid, name, info);
+}
+
+static void end_client_scan(struct clients *clients)
+{
+	struct client *c;
+	int tmp;
+
+	for_each_client(clients, c, tmp) {
+		if (c->status == PROBE)
+			free_client(c);
+		else if (c->status == FREE)
+			break;
+	}
+}
+
+/*
+ * Walk /proc once and hand each i915 client over to the clients list of the
+ * device it belongs to, as identified by the PCI slot in fdinfo.
+ */
+static void scan_all_clients(struct clients **clients, unsigned int num)
+{
+	struct dirent *proc_dent;
+	DIR *proc_dir;
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		if (clients[i])
+			begin_client_scan(clients[i]);
+	}
 
 	proc_dir = opendir("/proc");
 	if (!proc_dir)
-		return clients;
+		return;
 
 	while ((proc_dent = readdir(proc_dir)) != NULL) {
 		DIR *pid_dir = NULL, *fd_dir = NULL, *fdinfo_dir = NULL;
@@ -1149,18 +1253,16 @@ static struct clients *scan_clients(struct clients *clients)
 
 			if (strcmp(info.driver, "i915"))
 				continue;
-			if (strcmp(info.pdev, clients->pci_slot))
-				continue;
-			if (find_client(clients, ALIVE, info.id))
-				continue; /* Skip duplicate fds. */
 
-			c = find_client(clients, PROBE, info.id);
-			if (!c)
-				add_client(clients, &info, client_pid,
-					   client_name);
-			else
-				update_client(c, client_pid, client_name,
-					      &info);
+			for (i = 0; i < num; i++) {
+				if (!clients[i] ||
+				    strcmp(info.pdev, clients[i]->pci_slot))
+					continue;
+
+				client_found(clients[i], &info, client_pid,
+					     client_name);
+				break;
+			}
 		}
 
 next:
@@ -1174,14 +1276,26 @@ next:
 
 	closedir(proc_dir);
 
-	for_each_client(clients, c, tmp) {
-		if (c->status == PROBE)
-			free_client(c);
-		else if (c->status == FREE)
-			break;
+	for (i = 0; i < num; i++) {
+		if (clients[i])
+			end_client_scan(clients[i]);
 	}
+}
 
-	return display_clients(clients);
+static struct clients *__scan_clients(struct clients *clients)
+{
+	if (clients)
+		scan_all_clients(&clients, 1);
+
+	return clients;
+}
+
+static struct clients *scan_clients(struct clients *clients)
+{
+	if (!clients)
+		return clients;
+
+	return display_clients(__scan_clients(clients));
 }
 
 static const char *bars[] = { " ", "▏", "▎", "▍", "▌", "▋", "▊", "▉", "█" };
@@ -1230,6 +1344,8 @@ print_percentage_bar(double percent, int max_len, bool numeric)
 }
 
 #define DEFAULT_PERIOD_MS (1000)
+#define RECORD_DEFAULT_SAMPLES (1 << 16)
+#define RECORD_MAX_SAMPLES (1 << 24)
 
 static void
 usage(const char *appname)
@@ -1245,9 +1361,15 @@ usage(const char *appname)
 		"\t[-o <file|->]   Output to specified file or '-' for standard out.\n"
 		"\t[-s <ms>]       Refresh period in milliseconds (default %ums).\n"
 		"\t[-L]            List all cards.\n"
+		"\t[-A]            Monitor all cards, with a combined total view.\n"
 		"\t[-d <device>]   Device filter, please check manual page for more details.\n"
+		"\t[-R <file>]     Record raw samples into a binary ring file.\n"
+		"\t[-N <samples>]  Number of samples in the recording ring (default %u, at most %u).\n"
+		"\t[-P <file>]     Play back a recording in text or JSON format.\n"
+		"\t[-w <s>[:<s>]]  Time window of the recording to play back, in seconds.\n"
 		"\n",
-		appname, DEFAULT_PERIOD_MS);
+		appname, DEFAULT_PERIOD_MS, RECORD_DEFAULT_SAMPLES,
+		RECORD_MAX_SAMPLES);
 	igt_device_print_filter_types();
 }
 
@@ -1286,6 +1408,7 @@ static const char *json_indent[] = {
 	"\t\t\t",
 	"\t\t\t\t",
 	"\t\t\t\t\t",
+	"\t\t\t\t\t\t",
 };
 
 static unsigned int json_prev_struct_members;
@@ -1681,7 +1804,8 @@ print_header(const struct igt_device_card *card,
 	if (output_mode == INTERACTIVE) {
 		int rem = con_w;
 
-		printf("\033[H\033[J");
+		if (!lines)
+			printf("\033[H\033[J");
 
 		lines = print_header_token(NULL, lines, con_w, con_h, &rem,
 					   "intel-gpu-top:");
@@ -2007,11 +2131,12 @@ static struct engines *init_class_engines(struct engines *engines)
 
 static struct engines *update_class_engines(struct engines *engines)
 {
-	static struct engines *classes;
+	struct engines *classes;
 	unsigned int i, j;
 
-	if (!classes)
-		classes = init_class_engines(engines);
+	if (!engines->class_engines)
+		engines->class_engines = init_class_engines(engines);
+	classes = engines->class_engines;
 
 	for (i = 0; i < classes->num_engines; i++) {
 		struct engine *engine = engine_ptr(classes, i);
@@ -2403,233 +2528,1310 @@ static void show_help_screen(void)
 "\n");
 }
 
-int main(int argc, char **argv)
+static int
+print_device(const char *name, const struct igt_device_card *card,
+	     const char *codename, struct engines *engines,
+	     struct clients *disp_clients, double t, int lines,
+	     int con_w, int con_h, unsigned int period_us, bool *consumed)
 {
-	unsigned int period_us = DEFAULT_PERIOD_MS * 1000;
-	struct clients *clients = NULL;
-	int con_w = -1, con_h = -1;
-	char *output_path = NULL;
-	struct engines *engines;
-	int ret = 0, ch;
-	bool list_device = false;
-	char *pmu_device, *opt_device = NULL;
-	struct igt_device_card card;
-	char *codename = NULL;
+	struct client *c;
+	int j;
 
-	/* Parse options */
-	while ((ch = getopt(argc, argv, "o:s:d:JLlh")) != -1) {
-		switch (ch) {
-		case 'o':
-			output_path = optarg;
-			break;
-		case 's':
-			period_us = atoi(optarg) * 1000;
-			break;
-		case 'd':
-			opt_device = strdup(optarg);
-			break;
-		case 'J':
-			output_mode = JSON;
-			break;
-		case 'L':
-			list_device = true;
-			break;
-		case 'l':
-			output_mode = STDOUT;
-			break;
-		case 'h':
-			usage(argv[0]);
-			exit(0);
-		default:
-			fprintf(stderr, "Invalid option %c!\n", (char)optopt);
-			usage(argv[0]);
-			exit(1);
+	if (name)
+		pops->open_struct(name);
+
+	lines = print_header(card, codename, engines,
+			     t, lines, con_w, con_h,
+			     consumed);
+
+	if (in_help)
+		return lines;
+
+	lines = print_imc(engines, t, lines, con_w, con_h);
+
+	lines = print_engines(engines, t, lines, con_w, con_h);
+
+	if (disp_clients) {
+		int class_w;
+
+		lines = print_clients_header(disp_clients, lines,
+					     con_w, con_h,
+					     &class_w);
+
+		for_each_client(disp_clients, c, j) {
+			assert(c->status != PROBE);
+			if (c->status != ALIVE)
+				break; /* Active clients are first in the array. */
+
+			if (lines >= con_h)
+				break;
+
+			lines = print_client(c, engines, t,
+					     lines, con_w,
+					     con_h, period_us,
+					     &class_w);
 		}
+
+		lines = print_clients_footer(disp_clients, t,
+					     lines, con_w,
+					     con_h);
 	}
 
-	if (output_mode == INTERACTIVE && (output_path || isatty(1) != 1))
-		output_mode = STDOUT;
+	if (name)
+		pops->close_struct();
 
-	if (output_path && strcmp(output_path, "-")) {
-		out = fopen(output_path, "w");
+	return lines;
+}
 
-		if (!out) {
-			fprintf(stderr, "Failed to open output file - '%s'!\n",
-				strerror(errno));
-			exit(1);
+static void
+print_sample(const struct igt_device_card *card, const char *codename,
+	     struct engines *engines, struct clients *disp_clients, double t,
+	     int con_w, int con_h, unsigned int period_us)
+{
+	bool consumed = false;
+
+	while (!consumed) {
+		pops->open_struct(NULL);
+
+		print_device(NULL, card, codename, engines, disp_clients, t, 0,
+			     con_w, con_h, period_us, &consumed);
+
+		if (in_help) {
+			show_help_screen();
+			break;
 		}
-	} else {
-		out = stdout;
+
+		pops->close_struct();
 	}
+}
 
-	if (signal(SIGINT, sigint_handler) == SIG_ERR)
-		fprintf(stderr, "Failed to install signal handler!\n");
+/*
+ * Multi-device monitoring
+ *
+ * All Intel GPUs found by the device scan are sampled from one process,
+ * sharing a single walk of /proc for the clients of every device. Next to
+ * the per device data a "total" view is shown, where engine busyness is
+ * averaged per engine class across all devices, interrupts are summed and
+ * frequency and RC6 are averaged. System wide counters (RAPL and IMC) are
+ * shown as read via the first device which exposes them.
+ */
 
-	switch (output_mode) {
-	case INTERACTIVE:
-		pops = &term_pops;
-		interactive_stdin();
-		class_view = true;
-		break;
-	case STDOUT:
-		pops = &stdout_pops;
-		break;
-	case JSON:
-		pops = &json_pops;
-		break;
-	default:
-		assert(0);
-		break;
-	};
+struct gpu {
+	struct igt_device_card card;
+	char *pmu_device;
+	char *codename;
+	char name[64];
+	struct engines *engines;
+	struct clients *clients;
+	struct clients *disp_clients;
+};
 
-	igt_devices_scan(false);
+static void copy_pmu_meta(struct pmu_counter *dst, const struct pmu_counter *src)
+{
+	if (dst->present || !src->present)
+		return;
 
-	if (list_device) {
-		struct igt_devices_print_format fmt = {
-			.type = IGT_PRINT_USER,
-			.option = IGT_PRINT_PCI,
-		};
+	*dst = *src;
+	memset(&dst->val, 0, sizeof(dst->val));
+}
 
-		igt_devices_print(&fmt);
-		goto exit;
-	}
+static struct engines *init_total_engines(struct gpu *gpus, unsigned int num)
+{
+	struct engines *total;
+	unsigned int num_classes = 0, num_present = 0;
+	unsigned int i, j, k;
+	bool *present;
 
-	if (opt_device != NULL) {
-		ret = igt_device_card_match_pci(opt_device, &card);
-		if (!ret)
-			fprintf(stderr, "Requested device %s not found!\n", opt_device);
-		free(opt_device);
-	} else {
-		ret = igt_device_find_first_i915_discrete_card(&card);
-		if (!ret)
-			ret = igt_device_find_integrated_card(&card);
-		if (!ret)
-			fprintf(stderr, "No device filter specified and no discrete/integrated i915 devices found\n");
+	for (i = 0; i < num; i++) {
+		init_engine_classes(gpus[i].engines);
+		if (gpus[i].engines->num_classes > num_classes)
+			num_classes = gpus[i].engines->num_classes;
 	}
 
-	if (!ret) {
-		ret = EXIT_FAILURE;
-		goto exit;
-	}
+	present = calloc(num_classes, sizeof(*present));
+	assert(present);
 
-	if (card.pci_slot_name[0] && !is_igpu_pci(card.pci_slot_name))
-		pmu_device = tr_pmu_name(&card);
-	else
-		pmu_device = strdup("i915");
+	for (i = 0; i < num; i++) {
+		struct engines *engines = gpus[i].engines;
 
-	engines = discover_engines(pmu_device);
-	if (!engines) {
-		fprintf(stderr,
-			"Failed to detect engines! (%s)\n(Kernel 4.16 or newer is required for i915 PMU support.)\n",
-			strerror(errno));
-		ret = EXIT_FAILURE;
-		goto err;
+		for (j = 0; j < engines->num_engines; j++)
+			present[engine_ptr(engines, j)->class] = true;
 	}
 
-	ret = pmu_init(engines);
-	if (ret) {
-		fprintf(stderr,
-			"Failed to initialize PMU! (%s)\n", strerror(errno));
-		if (errno == EACCES && geteuid())
-			fprintf(stderr,
-"\n"
-"When running as a normal user CAP_PERFMON is required to access performance\n"
-"monitoring. See \"man 7 capabilities\", \"man 8 setcap\", or contact your\n"
-"distribution vendor for assistance.\n"
-"\n"
-"More information can be found at 'Perf events and tool security' document:\n"
-"https://www.kernel.org/doc/html/latest/admin-guide/perf-security.html\n");
-		ret = EXIT_FAILURE;
-		goto err;
+	for (i = 0; i < num_classes; i++)
+		num_present += present[i];
+
+	total = calloc(1, sizeof(struct engines) +
+			  num_present * sizeof(struct engine));
+	assert(total);
+
+	total->num_engines = num_present;
+	total->device = strdup("total");
+	assert(total->device);
+
+	for (i = 0; i < num; i++) {
+		struct engines *engines = gpus[i].engines;
+
+		copy_pmu_meta(&total->freq_req, &engines->freq_req);
+		copy_pmu_meta(&total->freq_act, &engines->freq_act);
+		copy_pmu_meta(&total->irq, &engines->irq);
+		copy_pmu_meta(&total->rc6, &engines->rc6);
+		copy_pmu_meta(&total->r_gpu, &engines->r_gpu);
+		copy_pmu_meta(&total->r_pkg, &engines->r_pkg);
+		copy_pmu_meta(&total->imc_reads, &engines->imc_reads);
+		copy_pmu_meta(&total->imc_writes, &engines->imc_writes);
+
+		if (!total->num_imc)
+			total->num_imc = engines->num_imc;
 	}
 
-	ret = EXIT_SUCCESS;
+	k = 0;
+	for (i = 0; i < num_classes; i++) {
+		struct engine *engine;
 
-	clients = init_clients(card.pci_slot_name[0] ?
-			       card.pci_slot_name : IGPU_PCI);
+		if (!present[i])
+			continue;
+
+		engine = engine_ptr(total, k++);
+		engine->class = i;
+		engine->instance = -1;
+		engine->display_name = strdup(class_display_name(i));
+		engine->short_name = strdup(class_short_name(i));
+		assert(engine->display_name && engine->short_name);
+
+		/* Counter metadata from the first engine of the same class. */
+		for (j = 0; j < num && !engine->num_counters; j++) {
+			struct engines *engines = gpus[j].engines;
+			unsigned int e;
+
+			for (e = 0; e < engines->num_engines; e++) {
+				struct engine *src = engine_ptr(engines, e);
+
+				if (src->class != i)
+					continue;
+
+				engine->num_counters = src->num_counters;
+				engine->busy = src->busy;
+				engine->sema = src->sema;
+				engine->wait = src->wait;
+				break;
+			}
+		}
+	}
+
+	free(present);
+
+	return total;
+}
+
+/* Returns whether this call did the copy, only the first present one does. */
+static bool __pmu_copy(struct pmu_counter *dst, const struct pmu_counter *src,
+		       bool *copied)
+{
+	if (*copied || !src->present)
+		return false;
+
+	dst->val = src->val;
+	*copied = true;
+
+	return true;
+}
+
+static void
+update_total_engines(struct engines *total, struct gpu *gpus, unsigned int num)
+{
+	unsigned int num_freq = 0, num_rc6 = 0;
+	bool rapl = false, imc = false;
+	unsigned int i, j, k;
+
+	memset(&total->freq_req.val, 0, sizeof(total->freq_req.val));
+	memset(&total->freq_act.val, 0, sizeof(total->freq_act.val));
+	memset(&total->irq.val, 0, sizeof(total->irq.val));
+	memset(&total->rc6.val, 0, sizeof(total->rc6.val));
+
+	for (i = 0; i < num; i++) {
+		struct engines *engines = gpus[i].engines;
+
+		if (engines->freq_act.present) {
+			__pmu_sum(&total->freq_req.val, &engines->freq_req.val);
+			__pmu_sum(&total->freq_act.val, &engines->freq_act.val);
+			num_freq++;
+		}
+
+		if (engines->rc6.present) {
+			__pmu_sum(&total->rc6.val, &engines->rc6.val);
+			num_rc6++;
+		}
+
+		__pmu_sum(&total->irq.val, &engines->irq.val);
+
+		/* Package power & IMC writes from the same GPU as r_gpu & imc_reads */
+		if (__pmu_copy(&total->r_gpu, &engines->r_gpu, &rapl))
+			total->r_pkg.val = engines->r_pkg.val;
+
+		if (__pmu_copy(&total->imc_reads, &engines->imc_reads, &imc))
+			total->imc_writes.val = engines->imc_writes.val;
+	}
+
+	if (num_freq) {
+		__pmu_normalize(&total->freq_req.val, num_freq);
+		__pmu_normalize(&total->freq_act.val, num_freq);
+	}
+
+	if (num_rc6)
+		__pmu_normalize(&total->rc6.val, num_rc6);
+
+	for (k = 0; k < total->num_engines; k++) {
+		struct engine *engine = engine_ptr(total, k);
+		unsigned int num_engines = 0;
+
+		memset(&engine->busy.val, 0, sizeof(engine->busy.val));
+		memset(&engine->sema.val, 0, sizeof(engine->sema.val));
+		memset(&engine->wait.val, 0, sizeof(engine->wait.val));
+
+		for (i = 0; i < num; i++) {
+			struct engines *engines = gpus[i].engines;
+
+			for (j = 0; j < engines->num_engines; j++) {
+				struct engine *e = engine_ptr(engines, j);
+
+				if (e->class != engine->class)
+					continue;
+
+				__pmu_sum(&engine->busy.val, &e->busy.val);
+				__pmu_sum(&engine->sema.val, &e->sema.val);
+				__pmu_sum(&engine->wait.val, &e->wait.val);
+				num_engines++;
+			}
+		}
+
+		assert(num_engines);
+
+		__pmu_normalize(&engine->busy.val, num_engines);
+		__pmu_normalize(&engine->sema.val, num_engines);
+		__pmu_normalize(&engine->wait.val, num_engines);
+	}
+
+	total->ts = gpus[0].engines->ts;
+}
+
+static bool init_gpu(struct gpu *gpu)
+{
+	struct igt_device_card *card = &gpu->card;
+
+	if (card->pci_slot_name[0] && !is_igpu_pci(card->pci_slot_name))
+		gpu->pmu_device = tr_pmu_name(card);
+	else
+		gpu->pmu_device = strdup("i915");
+
+	gpu->engines = discover_engines(gpu->pmu_device);
+	if (!gpu->engines) {
+		fprintf(stderr, "Failed to detect engines on %s! (%s)\n",
+			card->pci_slot_name, strerror(errno));
+		return false;
+	}
+
+	if (pmu_init(gpu->engines)) {
+		fprintf(stderr, "Failed to initialize PMU on %s! (%s)\n",
+			card->pci_slot_name, strerror(errno));
+		return false;
+	}
+
+	gpu->clients = init_clients(card->pci_slot_name[0] ?
+				    card->pci_slot_name : IGPU_PCI);
+	init_engine_classes(gpu->engines);
+	if (gpu->clients) {
+		gpu->clients->num_classes = gpu->engines->num_classes;
+		gpu->clients->class = gpu->engines->class;
+	}
+
+	gpu->codename = igt_device_get_pretty_name(card, false);
+	snprintf(gpu->name, sizeof(gpu->name), "%s",
+		 card->pci_slot_name[0] ? card->pci_slot_name : IGPU_PCI);
+
+	return true;
+}
+
+static void free_gpu(struct gpu *gpu)
+{
+	if (gpu->clients)
+		free_clients(gpu->clients);
+
+	if (gpu->engines) {
+		pmu_fini(gpu->engines);
+		if (gpu->engines->root)
+			closedir(gpu->engines->root);
+		free(gpu->engines);
+	}
+
+	free(gpu->codename);
+	free(gpu->pmu_device);
+	memset(gpu, 0, sizeof(*gpu));
+}
+
+static void update_console_size(int *con_w, int *con_h)
+{
+	struct winsize ws;
+
+	if (output_mode != INTERACTIVE) {
+		*con_w = *con_h = INT_MAX;
+	} else if (ioctl(0, TIOCGWINSZ, &ws) != -1) {
+		*con_w = ws.ws_col;
+		*con_h = ws.ws_row;
+		if (*con_w == 0 && *con_h == 0) {
+			/* Serial console. */
+			*con_w = 80;
+			*con_h = 24;
+		}
+	}
+}
+
+static int monitor_all(unsigned int period_us)
+{
+	struct igt_device_card *cards, total_card = { };
+	struct clients **clients;
+	struct engines *total;
+	unsigned int i, num = 0;
+	struct gpu *gpus;
+	char total_name[32];
+	int num_cards;
+
+	num_cards = igt_device_find_all_i915_cards(&cards);
+	if (!num_cards) {
+		fprintf(stderr, "No i915 devices found!\n");
+		return EXIT_FAILURE;
+	}
+
+	gpus = calloc(num_cards, sizeof(*gpus));
+	clients = calloc(num_cards, sizeof(*clients));
+	assert(gpus && clients);
+
+	for (i = 0; i < num_cards; i++) {
+		struct gpu *gpu = &gpus[num];
+
+		gpu->card = cards[i];
+		if (!init_gpu(gpu)) {
+			free_gpu(gpu);
+			continue;
+		}
+
+		clients[num++] = gpu->clients;
+	}
+	free(cards);
+
+	if (!num) {
+		free(gpus);
+		free(clients);
+		return EXIT_FAILURE;
+	}
+
+	total = init_total_engines(gpus, num);
+	snprintf(total_name, sizeof(total_name), "%u GPUs", num);
+	strcpy(total_card.card, "all");
+
+	for (i = 0; i < num; i++)
+		pmu_sample(gpus[i].engines);
+	scan_all_clients(clients, num);
+
+	while (!stop_top) {
+		int con_w = -1, con_h = -1;
+		bool consumed = false;
+		double t;
+
+		update_console_size(&con_w, &con_h);
+
+		for (i = 0; i < num; i++)
+			pmu_sample(gpus[i].engines);
+		update_total_engines(total, gpus, num);
+		t = (double)(total->ts.cur - total->ts.prev) / 1e9;
+
+		scan_all_clients(clients, num);
+		for (i = 0; i < num; i++)
+			gpus[i].disp_clients = display_clients(gpus[i].clients);
+
+		if (stop_top)
+			break;
+
+		while (!consumed) {
+			int lines = 0;
+
+			pops->open_struct(NULL);
+
+			lines = print_device("total", &total_card, total_name,
+					     total, NULL, t, lines,
+					     con_w, con_h, period_us,
+					     &consumed);
+
+			if (in_help) {
+				show_help_screen();
+				break;
+			}
+
+			for (i = 0; i < num; i++) {
+				struct gpu *gpu = &gpus[i];
+				struct engines *engines = gpu->engines;
+				bool ignore;
+
+				lines = print_device(gpu->name, &gpu->card,
+						     gpu->codename, engines,
+						     gpu->disp_clients,
+						     (double)(engines->ts.cur -
+							      engines->ts.prev) / 1e9,
+						     lines, con_w, con_h,
+						     period_us, &ignore);
+			}
+
+			pops->close_struct();
+		}
+
+		for (i = 0; i < num; i++) {
+			if (gpus[i].disp_clients != gpus[i].clients)
+				free_clients(gpus[i].disp_clients);
+		}
+
+		if (stop_top)
+			break;
+
+		if (output_mode == INTERACTIVE)
+			process_stdin(period_us);
+		else
+			usleep(period_us);
+	}
+
+	for (i = 0; i < num; i++)
+		free_gpu(&gpus[i]);
+	free(total->device);
+	free(total);
+	free(clients);
+	free(gpus);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Recording format
+ *
+ * The recording file is preallocated up front and memory mapped. It starts
+ * with a page aligned header describing the engines and counters which were
+ * present at the time of recording, followed by a ring of fixed size sample
+ * records. Each record stores the raw PMU counter values exactly as read by
+ * pmu_read_all(), plus a snapshot of the cumulative per-client runtimes, so
+ * any two records can later be turned into a sampling period by the same
+ * code which renders live data.
+ *
+ * Records are published by writing their sequence number last, which lets a
+ * reader detect slots which were torn or overwritten by the ring wrapping.
+ */
+
+#define RECORD_MAGIC "IGTTOP"
+#define RECORD_VERSION 1
+#define RECORD_MAX_CLIENTS 16
+#define RECORD_CLIENT_PERIOD_US (100 * 1000)
+
+struct record_counter {
+	uint32_t present;
+	uint32_t idx;
+	double scale;
+	char units[16];
+};
+
+struct record_engine {
+	char name[32];
+	uint32_t class;
+	uint32_t instance;
+	struct record_counter busy;
+	struct record_counter wait;
+	struct record_counter sema;
+};
+
+struct record_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t sample_size;
+	uint32_t client_size;
+	uint32_t num_samples;
+	uint32_t num_engines;
+	uint32_t num_classes;
+	uint32_t num_counters;
+	uint32_t num_rapl;
+	uint32_t num_imc;
+	uint32_t max_clients;
+	uint32_t discrete;
+	uint64_t period_ns;
+	uint64_t head;
+
+	char device[64];
+	char pci_slot[64];
+	char codename[64];
+
+	struct record_counter freq_req;
+	struct record_counter freq_act;
+	struct record_counter irq;
+	struct record_counter rc6;
+	struct record_counter r_gpu;
+	struct record_counter r_pkg;
+	struct record_counter imc_reads;
+	struct record_counter imc_writes;
+
+	struct record_engine engine[];
+};
+
+struct record_client {
+	uint32_t id;
+	uint32_t pid;
+	char name[24];
+	uint64_t busy[];
+};
+
+struct record_sample {
+	uint64_t seq;
+	uint64_t ts;
+	uint32_t num_clients;
+	uint32_t pad;
+	uint64_t data[];
+};
+
+static size_t record_align(size_t sz, size_t align)
+{
+	return (sz + align - 1) & ~(align - 1);
+}
+
+static struct record_sample *
+record_sample_ptr(const struct record_header *hdr, uint64_t seq)
+{
+	return (struct record_sample *)((char *)hdr + hdr->header_size +
+					(seq % hdr->num_samples) *
+					hdr->sample_size);
+}
+
+static uint64_t *record_val(struct record_sample *s)
+{
+	return s->data;
+}
+
+static uint64_t *record_rapl(const struct record_header *hdr,
+			     struct record_sample *s)
+{
+	return s->data + hdr->num_counters;
+}
+
+static uint64_t *record_imc(const struct record_header *hdr,
+			    struct record_sample *s)
+{
+	return s->data + hdr->num_counters + hdr->num_rapl;
+}
+
+static struct record_client *
+record_client_ptr(const struct record_header *hdr, struct record_sample *s,
+		  unsigned int n)
+{
+	return (struct record_client *)((char *)(record_imc(hdr, s) +
+						 hdr->num_imc) +
+					n * hdr->client_size);
+}
+
+static void
+record_save_counter(struct record_counter *dst, const struct pmu_counter *src)
+{
+	dst->present = src->present;
+	dst->idx = src->idx;
+	dst->scale = src->scale;
+	if (src->units)
+		strncpy(dst->units, src->units, sizeof(dst->units) - 1);
+}
+
+static void
+record_load_counter(struct pmu_counter *dst, const struct record_counter *src)
+{
+	memset(dst, 0, sizeof(*dst));
+	dst->present = src->present;
+	dst->idx = src->idx;
+	dst->scale = src->scale;
+	dst->units = strndup(src->units, sizeof(src->units));
+}
+
+static void record_free_counter(struct pmu_counter *pmu)
+{
+	free((char *)pmu->units);
+	pmu->units = NULL;
+}
+
+static struct record_header *
+record_create(const char *path, struct engines *engines,
+	      const char *pci_slot, const char *codename,
+	      unsigned int period_us, unsigned int num_samples, size_t *size)
+{
+	struct record_header *hdr;
+	size_t header_size, client_size, sample_size;
+	unsigned int i;
+	int fd, ret;
+
+	header_size = record_align(sizeof(*hdr) + engines->num_engines *
+				   sizeof(struct record_engine),
+				   sysconf(_SC_PAGESIZE));
+	client_size = record_align(sizeof(struct record_client) +
+				   engines->num_classes * sizeof(uint64_t),
+				   sizeof(uint64_t));
+	sample_size = sizeof(struct record_sample) +
+		      (engines->num_counters + engines->num_rapl +
+		       engines->num_imc) * sizeof(uint64_t) +
+		      RECORD_MAX_CLIENTS * client_size;
+
+	*size = header_size + (size_t)num_samples * sample_size;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return NULL;
+
+	/* Allocate all blocks now so we never fault on a full filesystem. */
+	ret = posix_fallocate(fd, 0, *size);
+	if (ret) {
+		close(fd);
+		errno = ret;
+		return NULL;
+	}
+
+	hdr = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED)
+		return NULL;
+
+	memcpy(hdr->magic, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+	hdr->version = RECORD_VERSION;
+	hdr->header_size = header_size;
+	hdr->sample_size = sample_size;
+	hdr->client_size = client_size;
+	hdr->num_samples = num_samples;
+	hdr->num_engines = engines->num_engines;
+	hdr->num_classes = engines->num_classes;
+	hdr->num_counters = engines->num_counters;
+	hdr->num_rapl = engines->num_rapl;
+	hdr->num_imc = engines->num_imc;
+	hdr->max_clients = RECORD_MAX_CLIENTS;
+	hdr->discrete = engines->discrete;
+	hdr->period_ns = (uint64_t)period_us * 1000;
+
+	strncpy(hdr->device, engines->device, sizeof(hdr->device) - 1);
+	strncpy(hdr->pci_slot, pci_slot, sizeof(hdr->pci_slot) - 1);
+	if (codename)
+		strncpy(hdr->codename, codename, sizeof(hdr->codename) - 1);
+
+	record_save_counter(&hdr->freq_req, &engines->freq_req);
+	record_save_counter(&hdr->freq_act, &engines->freq_act);
+	record_save_counter(&hdr->irq, &engines->irq);
+	record_save_counter(&hdr->rc6, &engines->rc6);
+	record_save_counter(&hdr->r_gpu, &engines->r_gpu);
+	record_save_counter(&hdr->r_pkg, &engines->r_pkg);
+	record_save_counter(&hdr->imc_reads, &engines->imc_reads);
+	record_save_counter(&hdr->imc_writes, &engines->imc_writes);
+
+	for (i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+		struct record_engine *re = &hdr->engine[i];
+
+		strncpy(re->name, engine->name, sizeof(re->name) - 1);
+		re->class = engine->class;
+		re->instance = engine->instance;
+		record_save_counter(&re->busy, &engine->busy);
+		record_save_counter(&re->wait, &engine->wait);
+		record_save_counter(&re->sema, &engine->sema);
+	}
+
+	return hdr;
+}
+
+static void
+record_sample(struct record_header *hdr, struct engines *engines,
+	      struct clients *clients)
+{
+	uint64_t seq = hdr->head;
+	struct record_sample *s = record_sample_ptr(hdr, seq);
+	unsigned int num = 0;
+
+	/* Invalidate the slot while it is being rewritten. */
+	__atomic_store_n(&s->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	s->ts = pmu_read_all(engines, record_val(s), record_rapl(hdr, s),
+			     record_imc(hdr, s));
+
+	if (clients) {
+		struct client *c;
+		int tmp;
+
+		for_each_client(clients, c, tmp) {
+			struct record_client *rc;
+
+			if (c->status != ALIVE)
+				break; /* Active clients are first in the array. */
+			if (num == hdr->max_clients)
+				break;
+
+			rc = record_client_ptr(hdr, s, num++);
+			rc->id = c->id;
+			rc->pid = c->pid;
+			memcpy(rc->name, c->name, sizeof(rc->name));
+			memcpy(rc->busy, c->last,
+			       hdr->num_classes * sizeof(rc->busy[0]));
+		}
+	}
+	s->num_clients = num;
+
+	__atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&hdr->head, seq + 1, __ATOMIC_RELEASE);
+}
+
+static void timespec_add_ns(struct timespec *ts, uint64_t ns)
+{
+	ns += ts->tv_nsec;
+	ts->tv_sec += ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+}
+
+static int
+record(const char *path, struct engines *engines, struct clients *clients,
+       const char *pci_slot, const char *codename,
+       unsigned int period_us, unsigned int num_samples)
+{
+	unsigned int client_every, n = 0;
+	struct record_header *hdr;
+	struct timespec next;
+	size_t size;
+
+	hdr = record_create(path, engines, pci_slot, codename, period_us,
+			    num_samples, &size);
+	if (!hdr) {
+		fprintf(stderr, "Failed to create recording '%s' - %s!\n",
+			path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	/*
+	 * Walking /proc is by far the most expensive part of sampling so
+	 * clients are rescanned at a lower rate and the latest snapshot is
+	 * stored with every record.
+	 */
+	client_every = RECORD_CLIENT_PERIOD_US / period_us;
+	if (!client_every)
+		client_every = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (!stop_top) {
+		if (clients && n++ % client_every == 0)
+			sort_clients(__scan_clients(clients), client_id_cmp);
+
+		record_sample(hdr, engines, clients);
+
+		timespec_add_ns(&next, (uint64_t)period_us * 1000);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &next, NULL) == EINTR && !stop_top)
+			;
+	}
+
+	fprintf(stderr, "Recorded %"PRIu64" samples to '%s'.\n",
+		hdr->head, path);
+
+	munmap(hdr, size);
+
+	return EXIT_SUCCESS;
+}
+
+static struct engines *replay_engines(const struct record_header *hdr)
+{
+	struct engines *engines;
+	unsigned int i;
+
+	engines = calloc(1, sizeof(struct engines) +
+			    hdr->num_engines * sizeof(struct engine));
+	assert(engines);
+
+	engines->num_engines = hdr->num_engines;
+	engines->num_counters = hdr->num_counters;
+	engines->num_rapl = hdr->num_rapl;
+	engines->num_imc = hdr->num_imc;
+	engines->discrete = hdr->discrete;
+	engines->device = strndup(hdr->device, sizeof(hdr->device));
+	engines->fd = engines->rapl_fd = engines->imc_fd = -1;
+
+	record_load_counter(&engines->freq_req, &hdr->freq_req);
+	record_load_counter(&engines->freq_act, &hdr->freq_act);
+	record_load_counter(&engines->irq, &hdr->irq);
+	record_load_counter(&engines->rc6, &hdr->rc6);
+	record_load_counter(&engines->r_gpu, &hdr->r_gpu);
+	record_load_counter(&engines->r_pkg, &hdr->r_pkg);
+	record_load_counter(&engines->imc_reads, &hdr->imc_reads);
+	record_load_counter(&engines->imc_writes, &hdr->imc_writes);
+
+	for (i = 0; i < hdr->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+		const struct record_engine *re = &hdr->engine[i];
+		int ret;
+
+		engine->name = strndup(re->name, sizeof(re->name));
+		engine->class = re->class;
+		engine->instance = re->instance;
+
+		record_load_counter(&engine->busy, &re->busy);
+		record_load_counter(&engine->wait, &re->wait);
+		record_load_counter(&engine->sema, &re->sema);
+		engine->num_counters = engine->busy.present +
+				       engine->wait.present +
+				       engine->sema.present;
+
+		ret = asprintf(&engine->display_name, "%s/%u",
+			       class_display_name(engine->class),
+			       engine->instance);
+		assert(ret > 0);
+
+		ret = asprintf(&engine->short_name, "%s/%u",
+			       class_short_name(engine->class),
+			       engine->instance);
+		assert(ret > 0);
+	}
+
+	return engines;
+}
+
+static void replay_free_engines(struct engines *engines)
+{
+	unsigned int i;
+
+	for (i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+
+		free((char *)engine->name);
+		free(engine->display_name);
+		free(engine->short_name);
+		record_free_counter(&engine->busy);
+		record_free_counter(&engine->wait);
+		record_free_counter(&engine->sema);
+	}
+
+	record_free_counter(&engines->freq_req);
+	record_free_counter(&engines->freq_act);
+	record_free_counter(&engines->irq);
+	record_free_counter(&engines->rc6);
+	record_free_counter(&engines->r_gpu);
+	record_free_counter(&engines->r_pkg);
+	record_free_counter(&engines->imc_reads);
+	record_free_counter(&engines->imc_writes);
+
+	free(engines->class);
+	free(engines->device);
+	free(engines);
+}
+
+static struct clients *
+replay_clients(const struct record_header *hdr, struct record_sample *s,
+	       struct clients *clients)
+{
+	unsigned int i;
+
+	begin_client_scan(clients);
+
+	for (i = 0; i < s->num_clients; i++) {
+		struct record_client *rc = record_client_ptr(hdr, s, i);
+		struct drm_client_fdinfo info = { .id = rc->id };
+		char name[sizeof(rc->name) + 1] = { };
+
+		memcpy(info.busy, rc->busy,
+		       hdr->num_classes * sizeof(info.busy[0]));
+		memcpy(name, rc->name, sizeof(rc->name));
+
+		client_found(clients, &info, rc->pid, name);
+	}
+
+	end_client_scan(clients);
+
+	return display_clients(clients);
+}
+
+static bool record_counter_valid(const struct record_counter *c,
+				 unsigned int num)
+{
+	return !c->present || c->idx < num;
+}
+
+static bool record_valid(const struct record_header *hdr, size_t size)
+{
+	size_t client_size, sample_size;
+	unsigned int i;
+
+	if (size < sizeof(*hdr) ||
+	    memcmp(hdr->magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) ||
+	    hdr->version != RECORD_VERSION)
+		return false;
+
+	if (!hdr->num_samples ||
+	    hdr->num_classes > DRM_CLIENT_FDINFO_MAX_ENGINES ||
+	    hdr->max_clients > RECORD_MAX_CLIENTS)
+		return false;
+
+	if (hdr->header_size > size ||
+	    hdr->header_size < sizeof(*hdr) + hdr->num_engines *
+			       sizeof(struct record_engine))
+		return false;
+
+	/* Counters index the values of each sample. */
+	if (!record_counter_valid(&hdr->freq_req, hdr->num_counters) ||
+	    !record_counter_valid(&hdr->freq_act, hdr->num_counters) ||
+	    !record_counter_valid(&hdr->irq, hdr->num_counters) ||
+	    !record_counter_valid(&hdr->rc6, hdr->num_counters) ||
+	    !record_counter_valid(&hdr->r_gpu, hdr->num_rapl) ||
+	    !record_counter_valid(&hdr->r_pkg, hdr->num_rapl) ||
+	    !record_counter_valid(&hdr->imc_reads, hdr->num_imc) ||
+	    !record_counter_valid(&hdr->imc_writes, hdr->num_imc))
+		return false;
+
+	for (i = 0; i < hdr->num_engines; i++) {
+		const struct record_engine *re = &hdr->engine[i];
+
+		if (!record_counter_valid(&re->busy, hdr->num_counters) ||
+		    !record_counter_valid(&re->wait, hdr->num_counters) ||
+		    !record_counter_valid(&re->sema, hdr->num_counters))
+			return false;
+	}
+
+	client_size = record_align(sizeof(struct record_client) +
+				   hdr->num_classes * sizeof(uint64_t),
+				   sizeof(uint64_t));
+	sample_size = sizeof(struct record_sample) +
+		      (hdr->num_counters + hdr->num_rapl + hdr->num_imc) *
+		      sizeof(uint64_t) + hdr->max_clients * client_size;
+	if (hdr->client_size != client_size || hdr->sample_size != sample_size)
+		return false;
+
+	return hdr->header_size + (size_t)hdr->num_samples * sample_size <= size;
+}
+
+static int
+replay(const char *path, double from, double to, unsigned int period_us)
+{
+	struct igt_device_card card = { };
+	struct clients *clients = NULL;
+	struct record_header *hdr;
+	uint64_t seq, head, first, t0 = 0, last = 0;
+	struct engines *engines;
+	bool primed = false;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Failed to open recording '%s' - %s!\n",
+			path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED || !record_valid(hdr, st.st_size)) {
+		fprintf(stderr, "'%s' is not a valid recording!\n", path);
+		if (hdr != MAP_FAILED)
+			munmap(hdr, st.st_size);
+		return EXIT_FAILURE;
+	}
+
+	engines = replay_engines(hdr);
 	init_engine_classes(engines);
+	if (engines->num_classes != hdr->num_classes) {
+		fprintf(stderr, "Inconsistent engine classes in '%s'!\n", path);
+		replay_free_engines(engines);
+		munmap(hdr, st.st_size);
+		return EXIT_FAILURE;
+	}
+
+	clients = init_clients(hdr->pci_slot);
 	if (clients) {
 		clients->num_classes = engines->num_classes;
 		clients->class = engines->class;
 	}
 
-	pmu_sample(engines);
-	scan_clients(clients);
-	codename = igt_device_get_pretty_name(&card, false);
+	head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	first = head > hdr->num_samples ? head - hdr->num_samples : 0;
 
-	while (!stop_top) {
+	for (seq = first; seq < head && !stop_top; seq++) {
+		struct record_sample *s = record_sample_ptr(hdr, seq);
 		struct clients *disp_clients;
-		bool consumed = false;
-		int j, lines = 0;
-		struct winsize ws;
-		struct client *c;
 		double t;
 
-		/* Update terminal size. */
-		if (output_mode != INTERACTIVE) {
-			con_w = con_h = INT_MAX;
-		} else if (ioctl(0, TIOCGWINSZ, &ws) != -1) {
-			con_w = ws.ws_col;
-			con_h = ws.ws_row;
-			if (con_w == 0 && con_h == 0) {
-				/* Serial console. */
-				con_w = 80;
-				con_h = 24;
-			}
+		if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != seq + 1)
+			continue; /* Torn or already overwritten. */
+
+		if (!t0)
+			t0 = s->ts;
+
+		t = (double)(s->ts - t0) / 1e9;
+		if (t < from)
+			continue;
+		if (to >= 0 && t > to)
+			break;
+
+		/* Consume records until a full output period has elapsed. */
+		if (primed && s->ts - last < (uint64_t)period_us * 1000)
+			continue;
+
+		pmu_update(engines, s->ts, record_val(s),
+			   record_rapl(hdr, s), record_imc(hdr, s));
+		disp_clients = clients ? replay_clients(hdr, s, clients) : NULL;
+		last = s->ts;
+
+		if (primed) {
+			t = (double)(engines->ts.cur - engines->ts.prev) / 1e9;
+			print_sample(&card, hdr->codename, engines, disp_clients,
+				     t, INT_MAX, INT_MAX, t * 1e6);
 		}
+		primed = true;
 
-		pmu_sample(engines);
-		t = (double)(engines->ts.cur - engines->ts.prev) / 1e9;
+		if (disp_clients != clients)
+			free_clients(disp_clients);
+	}
 
-		disp_clients = scan_clients(clients);
+	if (clients)
+		free_clients(clients);
+	replay_free_engines(engines);
+	munmap(hdr, st.st_size);
 
-		if (stop_top)
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int period_us = DEFAULT_PERIOD_MS * 1000;
+	struct clients *clients = NULL;
+	int con_w = -1, con_h = -1;
+	char *output_path = NULL;
+	struct engines *engines;
+	int ret = 0, ch;
+	bool list_device = false, all_devices = false;
+	char *pmu_device, *opt_device = NULL;
+	struct igt_device_card card;
+	char *codename = NULL;
+	unsigned int record_samples = RECORD_DEFAULT_SAMPLES;
+	char *record_path = NULL, *replay_path = NULL;
+	double replay_from = 0.0, replay_to = -1.0;
+
+	/* Parse options */
+	while ((ch = getopt(argc, argv, "o:s:d:R:N:P:w:AJLlh")) != -1) {
+		switch (ch) {
+		case 'o':
+			output_path = optarg;
+			break;
+		case 'R':
+			record_path = optarg;
+			break;
+		case 'N': {
+			unsigned long val;
+			char *end;
+
+			errno = 0;
+			val = strtoul(optarg, &end, 0);
+			if (errno || end == optarg || *end || *optarg == '-' ||
+			    !val || val > RECORD_MAX_SAMPLES) {
+				fprintf(stderr, "Invalid number of samples '%s'!\n",
+					optarg);
+				exit(1);
+			}
+			record_samples = val;
+			break;
+		}
+		case 'P':
+			replay_path = optarg;
+			break;
+		case 'w':
+			if (sscanf(optarg, "%lf:%lf",
+				   &replay_from, &replay_to) < 1) {
+				fprintf(stderr, "Invalid window '%s'!\n", optarg);
+				exit(1);
+			}
 			break;
+		case 's':
+			period_us = atoi(optarg) * 1000;
+			break;
+		case 'd':
+			opt_device = strdup(optarg);
+			break;
+		case 'J':
+			output_mode = JSON;
+			break;
+		case 'L':
+			list_device = true;
+			break;
+		case 'A':
+			all_devices = true;
+			break;
+		case 'l':
+			output_mode = STDOUT;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(0);
+		default:
+			fprintf(stderr, "Invalid option %c!\n", (char)optopt);
+			usage(argv[0]);
+			exit(1);
+		}
+	}
 
-		while (!consumed) {
-			pops->open_struct(NULL);
+	if (record_path && replay_path) {
+		fprintf(stderr, "Recording and playback are mutually exclusive!\n");
+		exit(1);
+	}
 
-			lines = print_header(&card, codename, engines,
-					     t, lines, con_w, con_h,
-					     &consumed);
+	if (record_path && period_us < 1000) {
+		fprintf(stderr, "Recording needs a period of at least 1ms!\n");
+		exit(1);
+	}
 
-			if (in_help) {
-				show_help_screen();
-				break;
-			}
+	if (output_mode == INTERACTIVE &&
+	    (output_path || record_path || replay_path || isatty(1) != 1))
+		output_mode = STDOUT;
+
+	if (output_path && strcmp(output_path, "-")) {
+		out = fopen(output_path, "w");
+
+		if (!out) {
+			fprintf(stderr, "Failed to open output file - '%s'!\n",
+				strerror(errno));
+			exit(1);
+		}
+	} else {
+		out = stdout;
+	}
 
-			lines = print_imc(engines, t, lines, con_w, con_h);
+	if (signal(SIGINT, sigint_handler) == SIG_ERR)
+		fprintf(stderr, "Failed to install signal handler!\n");
 
-			lines = print_engines(engines, t, lines, con_w, con_h);
+	switch (output_mode) {
+	case INTERACTIVE:
+		pops = &term_pops;
+		interactive_stdin();
+		class_view = true;
+		break;
+	case STDOUT:
+		pops = &stdout_pops;
+		break;
+	case JSON:
+		pops = &json_pops;
+		break;
+	default:
+		assert(0);
+		break;
+	};
 
-			if (disp_clients) {
-				int class_w;
+	if (replay_path)
+		return replay(replay_path, replay_from, replay_to, period_us);
 
-				lines = print_clients_header(disp_clients, lines,
-							     con_w, con_h,
-							     &class_w);
+	igt_devices_scan(false);
 
-				for_each_client(disp_clients, c, j) {
-					assert(c->status != PROBE);
-					if (c->status != ALIVE)
-						break; /* Active clients are first in the array. */
+	if (list_device) {
+		struct igt_devices_print_format fmt = {
+			.type = IGT_PRINT_USER,
+			.option = IGT_PRINT_PCI,
+		};
 
-					if (lines >= con_h)
-						break;
+		igt_devices_print(&fmt);
+		goto exit;
+	}
 
-					lines = print_client(c, engines, t,
-							     lines, con_w,
-							     con_h, period_us,
-							     &class_w);
-				}
+	if (all_devices) {
+		if (opt_device || record_path)
+			fprintf(stderr, "Device filter and recording are ignored when monitoring all devices.\n");
+		free(opt_device);
+		ret = monitor_all(period_us);
+		goto exit;
+	}
 
-				lines = print_clients_footer(disp_clients, t,
-							     lines, con_w,
-							     con_h);
-			}
+	if (opt_device != NULL) {
+		ret = igt_device_card_match_pci(opt_device, &card);
+		if (!ret)
+			fprintf(stderr, "Requested device %s not found!\n", opt_device);
+		free(opt_device);
+	} else {
+		ret = igt_device_find_first_i915_discrete_card(&card);
+		if (!ret)
+			ret = igt_device_find_integrated_card(&card);
+		if (!ret)
+			fprintf(stderr, "No device filter specified and no discrete/integrated i915 devices found\n");
+	}
 
-			pops->close_struct();
-		}
+	if (!ret) {
+		ret = EXIT_FAILURE;
+		goto exit;
+	}
+
+	if (card.pci_slot_name[0] && !is_igpu_pci(card.pci_slot_name))
+		pmu_device = tr_pmu_name(&card);
+	else
+		pmu_device = strdup("i915");
+
+	engines = discover_engines(pmu_device);
+	if (!engines) {
+		fprintf(stderr,
+			"Failed to detect engines! (%s)\n(Kernel 4.16 or newer is required for i915 PMU support.)\n",
+			strerror(errno));
+		ret = EXIT_FAILURE;
+		goto err;
+	}
+
+	ret = pmu_init(engines);
+	if (ret) {
+		fprintf(stderr,
+			"Failed to initialize PMU! (%s)\n", strerror(errno));
+		if (errno == EACCES && geteuid())
+			fprintf(stderr,
+"\n"
+"When running as a normal user CAP_PERFMON is required to access performance\n"
+"monitoring. See \"man 7 capabilities\", \"man 8 setcap\", or contact your\n"
+"distribution vendor for assistance.\n"
+"\n"
+"More information can be found at 'Perf events and tool security' document:\n"
+"https://www.kernel.org/doc/html/latest/admin-guide/perf-security.html\n");
+		ret = EXIT_FAILURE;
+		goto err;
+	}
+
+	ret = EXIT_SUCCESS;
+
+	clients = init_clients(card.pci_slot_name[0] ?
+			       card.pci_slot_name : IGPU_PCI);
+	init_engine_classes(engines);
+	if (clients) {
+		clients->num_classes = engines->num_classes;
+		clients->class = engines->class;
+	}
+
+	codename = igt_device_get_pretty_name(&card, false);
+
+	if (record_path) {
+		ret = record(record_path, engines, clients,
+			     card.pci_slot_name[0] ?
+			     card.pci_slot_name : IGPU_PCI,
+			     codename, period_us, record_samples);
+		goto out;
+	}
+
+	pmu_sample(engines);
+	scan_clients(clients);
+
+	while (!stop_top) {
+		struct clients *disp_clients;
+		double t;
+
+		update_console_size(&con_w, &con_h);
+
+		pmu_sample(engines);
+		t = (double)(engines->ts.cur - engines->ts.prev) / 1e9;
+
+		disp_clients = scan_clients(clients);
+
+		if (stop_top)
+			break;
+
+		print_sample(&card, codename, engines, disp_clients, t,
+			     con_w, con_h, period_us);
 
 		if (stop_top)
 			break;
@@ -2643,6 +3845,7 @@ int main(int argc, char **argv)
 			usleep(period_us);
 	}
 
+out:
 	free(codename);
 err:
 	free(engines);
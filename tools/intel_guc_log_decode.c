@@ -0,0 +1,645 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Offline decoder for the captures written by intel_guc_logger.
+ *
+ * A capture is a sequence of relay subbuffers, each a snapshot of the GuC
+ * log buffer: a page holding the state of the ISR, DPC and crash sections,
+ * followed by the sections themselves. Only the part of every section
+ * between its read and sampled write pointers is new in a given snapshot,
+ * as in i915's guc_read_update_log_buffer().
+ *
+ * The layout of the log entries themselves is firmware defined and not
+ * documented, so only the buffer states are decoded and the new data of
+ * each section is dumped as raw dwords.
+ *
+ * On the first run over a capture every subbuffer is validated in parallel
+ * to build an index of the new data and overflows per section, which is
+ * saved next to the capture. Queries then only visit the sections with new
+ * data in the requested range of subbuffers.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "igt_aux.h"
+
+#define __packed __attribute__((packed))
+
+#ifndef PAGE_SIZE
+  #define PAGE_SIZE 4096
+#endif
+/* Must match the subbuffer size used by intel_guc_logger. */
+#define SUBBUF_SIZE (19*PAGE_SIZE)
+
+enum guc_log_type {
+	GUC_ISR_LOG_BUFFER,
+	GUC_DPC_LOG_BUFFER,
+	GUC_CRASH_DUMP_LOG_BUFFER,
+	GUC_MAX_LOG_BUFFER
+};
+
+static const char *log_type_name[GUC_MAX_LOG_BUFFER] = {
+	[GUC_ISR_LOG_BUFFER] = "isr",
+	[GUC_DPC_LOG_BUFFER] = "dpc",
+	[GUC_CRASH_DUMP_LOG_BUFFER] = "crash",
+};
+
+/* Size of each section, the state page is not included. */
+static const uint32_t log_type_size[GUC_MAX_LOG_BUFFER] = {
+	[GUC_ISR_LOG_BUFFER] = 8 * PAGE_SIZE,
+	[GUC_DPC_LOG_BUFFER] = 8 * PAGE_SIZE,
+	[GUC_CRASH_DUMP_LOG_BUFFER] = 2 * PAGE_SIZE,
+};
+
+struct guc_log_buffer_state {
+	uint32_t marker[2];
+	uint32_t read_ptr;
+	uint32_t write_ptr;
+	uint32_t size;
+	uint32_t sampled_write_ptr;
+	uint32_t flags;
+	uint32_t version;
+} __packed;
+
+#define GUC_LOG_BUFFER_FULL_CNT(flags) (((flags) >> 1) & 0xf)
+
+/* Section flags kept in the index. */
+#define SECTION_BAD_STATE	(1 << 0)
+#define SECTION_CORRUPT		(1 << 1)
+#define SECTION_OVERFLOW	(1 << 2)
+
+struct index_section {
+	uint32_t flags;
+	/* Bytes of new data in the section. */
+	uint32_t bytes;
+};
+
+struct index_entry {
+	struct index_section section[GUC_MAX_LOG_BUFFER];
+};
+
+#define INDEX_MAGIC "IGTGUCIX"
+#define INDEX_VERSION 2
+
+struct index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t subbuf_size;
+	uint64_t file_size;
+	int64_t file_mtime;
+	uint64_t count;
+};
+
+struct capture {
+	const uint8_t *data;
+	size_t size;
+	uint64_t count;
+	struct index_entry *index;
+};
+
+struct cursor {
+	const uint8_t *base;
+	uint32_t size;
+	uint32_t pos;
+	uint32_t left;
+};
+
+static const struct guc_log_buffer_state *
+section_state(const struct capture *cap, uint64_t n, unsigned int type)
+{
+	const struct guc_log_buffer_state *state =
+		(const void *)(cap->data + n * SUBBUF_SIZE);
+
+	return &state[type];
+}
+
+static const uint8_t *
+section_data(const struct capture *cap, uint64_t n, unsigned int type)
+{
+	const uint8_t *ptr = cap->data + n * SUBBUF_SIZE + PAGE_SIZE;
+	unsigned int i;
+
+	for (i = 0; i < type; i++)
+		ptr += log_type_size[i];
+
+	return ptr;
+}
+
+static bool section_valid(const struct guc_log_buffer_state *state,
+			  unsigned int type)
+{
+	uint32_t size = log_type_size[type];
+
+	if (state->size && state->size != size)
+		return false;
+
+	/* The pointers are offsets into the section. */
+	if (state->read_ptr >= size || state->sampled_write_ptr >= size)
+		return false;
+
+	return !(state->read_ptr % 4) && !(state->sampled_write_ptr % 4);
+}
+
+static void cursor_init(struct cursor *c, const struct capture *cap,
+			uint64_t n, unsigned int type)
+{
+	const struct guc_log_buffer_state *state = section_state(cap, n, type);
+
+	c->base = section_data(cap, n, type);
+	c->size = log_type_size[type];
+	c->pos = state->read_ptr;
+	/* The new data may wrap around the end of the section. */
+	if (state->sampled_write_ptr >= state->read_ptr)
+		c->left = state->sampled_write_ptr - state->read_ptr;
+	else
+		c->left = c->size - state->read_ptr + state->sampled_write_ptr;
+}
+
+static uint32_t cursor_dword(struct cursor *c)
+{
+	uint32_t val;
+
+	memcpy(&val, c->base + c->pos, sizeof(val));
+	c->pos = (c->pos + 4) % c->size;
+	c->left -= 4;
+
+	return val;
+}
+
+static void scan_section(const struct capture *cap, uint64_t n,
+			 unsigned int type, struct index_section *s)
+{
+	const struct guc_log_buffer_state *state = section_state(cap, n, type);
+	struct cursor c;
+
+	memset(s, 0, sizeof(*s));
+
+	if (!section_valid(state, type)) {
+		s->flags |= SECTION_BAD_STATE;
+		return;
+	}
+
+	cursor_init(&c, cap, n, type);
+	s->bytes = c.left;
+}
+
+struct index_worker {
+	pthread_t thread;
+	struct capture *cap;
+	atomic_uint_fast64_t *next;
+};
+
+#define INDEX_CHUNK 64
+
+static void *index_thread(void *arg)
+{
+	struct index_worker *w = arg;
+	struct capture *cap = w->cap;
+
+	for (;;) {
+		uint64_t n, end;
+
+		n = atomic_fetch_add(w->next, INDEX_CHUNK);
+		if (n >= cap->count)
+			break;
+
+		end = min(n + INDEX_CHUNK, cap->count);
+		for (; n < end; n++) {
+			unsigned int type;
+
+			for (type = 0; type < GUC_MAX_LOG_BUFFER; type++)
+				scan_section(cap, n, type,
+					     &cap->index[n].section[type]);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * The per subbuffer pass cannot compare the buffer states of consecutive
+ * subbuffers, so flag the sections where the firmware had to drop data
+ * since the previous snapshot in a final sequential pass.
+ */
+static void index_fixup(struct capture *cap)
+{
+	unsigned int type;
+
+	for (type = 0; type < GUC_MAX_LOG_BUFFER; type++) {
+		uint32_t full_cnt = 0;
+		uint64_t n;
+
+		for (n = 0; n < cap->count; n++) {
+			struct index_section *s = &cap->index[n].section[type];
+			const struct guc_log_buffer_state *state =
+				section_state(cap, n, type);
+
+			if (s->flags & SECTION_BAD_STATE)
+				continue;
+
+			if (GUC_LOG_BUFFER_FULL_CNT(state->flags) != full_cnt) {
+				if (n)
+					s->flags |= SECTION_OVERFLOW;
+				full_cnt = GUC_LOG_BUFFER_FULL_CNT(state->flags);
+			}
+		}
+	}
+}
+
+static int build_index(struct capture *cap, unsigned int num_threads)
+{
+	struct index_worker *workers;
+	atomic_uint_fast64_t next = 0;
+	unsigned int i;
+
+	workers = calloc(num_threads, sizeof(*workers));
+	if (!workers)
+		return -ENOMEM;
+
+	for (i = 0; i < num_threads; i++) {
+		workers[i].cap = cap;
+		workers[i].next = &next;
+		if (pthread_create(&workers[i].thread, NULL,
+				   index_thread, &workers[i]))
+			break;
+	}
+
+	/* Whatever threads we got will share the work between them. */
+	if (!i)
+		index_thread(&workers[0]);
+	while (i--)
+		pthread_join(workers[i].thread, NULL);
+
+	free(workers);
+
+	index_fixup(cap);
+
+	return 0;
+}
+
+static char *index_filename(const char *path)
+{
+	char *name;
+
+	if (asprintf(&name, "%s.idx", path) < 0)
+		return NULL;
+
+	return name;
+}
+
+static void index_header_init(struct index_header *h, const struct stat *st,
+			      uint64_t count)
+{
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, INDEX_MAGIC, sizeof(h->magic));
+	h->version = INDEX_VERSION;
+	h->subbuf_size = SUBBUF_SIZE;
+	h->file_size = st->st_size;
+	h->file_mtime = st->st_mtime;
+	h->count = count;
+}
+
+static bool load_index(struct capture *cap, const char *name,
+		       const struct stat *st)
+{
+	struct index_header expected, h;
+	size_t len = cap->count * sizeof(*cap->index);
+	bool ret = false;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f)
+		return false;
+
+	index_header_init(&expected, st, cap->count);
+	if (fread(&h, sizeof(h), 1, f) == 1 &&
+	    !memcmp(&h, &expected, sizeof(h)) &&
+	    fread(cap->index, 1, len, f) == len)
+		ret = true;
+
+	fclose(f);
+
+	return ret;
+}
+
+static void save_index(const struct capture *cap, const char *name,
+		       const struct stat *st)
+{
+	struct index_header h;
+	FILE *f;
+
+	f = fopen(name, "w");
+	if (!f) {
+		fprintf(stderr, "Failed to write index %s! (%s)\n",
+			name, strerror(errno));
+		return;
+	}
+
+	index_header_init(&h, st, cap->count);
+	if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+	    fwrite(cap->index, sizeof(*cap->index), cap->count, f) != cap->count) {
+		fprintf(stderr, "Failed to write index %s!\n", name);
+		fclose(f);
+		unlink(name);
+		return;
+	}
+
+	fclose(f);
+}
+
+static int open_capture(struct capture *cap, const char *path,
+			bool reindex, unsigned int num_threads)
+{
+	struct stat st;
+	char *name;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s! (%s)\n",
+			path, strerror(errno));
+		return -errno;
+	}
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -errno;
+	}
+
+	if (st.st_size % SUBBUF_SIZE)
+		fprintf(stderr,
+			"Warning: ignoring %zu trailing bytes of a partial subbuffer\n",
+			(size_t)(st.st_size % SUBBUF_SIZE));
+
+	cap->size = st.st_size;
+	cap->count = st.st_size / SUBBUF_SIZE;
+	if (!cap->count) {
+		fprintf(stderr, "%s does not contain a complete subbuffer!\n",
+			path);
+		close(fd);
+		return -EINVAL;
+	}
+
+	cap->data = mmap(NULL, cap->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (cap->data == MAP_FAILED) {
+		fprintf(stderr, "Failed to map %s! (%s)\n",
+			path, strerror(errno));
+		return -errno;
+	}
+
+	cap->index = calloc(cap->count, sizeof(*cap->index));
+	if (!cap->index)
+		return -ENOMEM;
+
+	name = index_filename(path);
+	if (!name)
+		return -ENOMEM;
+
+	if (reindex || !load_index(cap, name, &st)) {
+		/* Decoding is done in capture order, help the readahead. */
+		madvise((void *)cap->data, cap->size, MADV_SEQUENTIAL);
+		build_index(cap, num_threads);
+		save_index(cap, name, &st);
+		madvise((void *)cap->data, cap->size, MADV_RANDOM);
+	}
+
+	free(name);
+
+	return 0;
+}
+
+static void close_capture(struct capture *cap)
+{
+	munmap((void *)cap->data, cap->size);
+	free(cap->index);
+}
+
+struct query {
+	uint64_t first, last;
+	unsigned int types;
+};
+
+static void dump_section(const struct capture *cap, uint64_t n,
+			 unsigned int type)
+{
+	const struct guc_log_buffer_state *state = section_state(cap, n, type);
+	unsigned int i = 0;
+	struct cursor c;
+
+	printf("%8" PRIu64 " %-5s read %05x write %05x, %u bytes\n",
+	       n, log_type_name[type], state->read_ptr,
+	       state->sampled_write_ptr, cap->index[n].section[type].bytes);
+
+	cursor_init(&c, cap, n, type);
+	while (c.left) {
+		/* Start a new line where the data wraps to keep the offsets. */
+		if (i % 8 && !c.pos) {
+			putchar('\n');
+			i = 0;
+		}
+		if (!(i % 8))
+			printf("  %05x:", c.pos);
+		printf(" %08x", cursor_dword(&c));
+		if (!(++i % 8) || !c.left)
+			putchar('\n');
+	}
+}
+
+static void query_capture(const struct capture *cap, const struct query *q)
+{
+	uint64_t n;
+
+	for (n = q->first; n <= q->last && n < cap->count; n++) {
+		unsigned int type;
+
+		for (type = 0; type < GUC_MAX_LOG_BUFFER; type++) {
+			const struct index_section *s =
+				&cap->index[n].section[type];
+
+			if (!(q->types & (1 << type)))
+				continue;
+
+			if (s->flags & SECTION_BAD_STATE) {
+				printf("%8" PRIu64 " %-5s <invalid buffer state>\n",
+				       n, log_type_name[type]);
+				continue;
+			}
+
+			if (s->flags & SECTION_OVERFLOW)
+				printf("%8" PRIu64 " %-5s <data lost to overflow>\n",
+				       n, log_type_name[type]);
+
+			if (s->bytes)
+				dump_section(cap, n, type);
+		}
+	}
+}
+
+static void print_summary(const struct capture *cap)
+{
+	unsigned int type;
+
+	printf("%" PRIu64 " subbuffers of %u bytes\n",
+	       cap->count, SUBBUF_SIZE);
+
+	for (type = 0; type < GUC_MAX_LOG_BUFFER; type++) {
+		uint64_t bytes = 0, sections = 0, bad = 0, overflow = 0;
+		uint64_t n;
+
+		for (n = 0; n < cap->count; n++) {
+			const struct index_section *s =
+				&cap->index[n].section[type];
+
+			bad += !!(s->flags & SECTION_BAD_STATE);
+			overflow += !!(s->flags & SECTION_OVERFLOW);
+			sections += !!s->bytes;
+			bytes += s->bytes;
+		}
+
+		printf("%-5s: %" PRIu64 " bytes in %" PRIu64 " snapshots, %"
+		       PRIu64 " invalid, %" PRIu64 " overflowed\n",
+		       log_type_name[type], bytes, sections, bad, overflow);
+	}
+}
+
+static int parse_type(const char *str)
+{
+	unsigned int type;
+
+	for (type = 0; type < GUC_MAX_LOG_BUFFER; type++) {
+		if (!strcmp(str, log_type_name[type]))
+			return type;
+	}
+
+	return -1;
+}
+
+static void usage(const char *appname)
+{
+	printf("Offline decoder for GuC logs captured by intel_guc_logger\n"
+	       "\n"
+	       "Usage: %s [parameters] [guc_log_dump.dat]\n"
+	       "\n"
+	       "\t[-h]            Show this help text.\n"
+	       "\t[-S]            Print a summary of the capture instead of the data.\n"
+	       "\t[-s <n>]        Only show subbuffers from this one onwards.\n"
+	       "\t[-e <n>]        Only show subbuffers up to this one.\n"
+	       "\t[-t <type>]     Only show the isr, dpc or crash section.\n"
+	       "\t                May be given more than once.\n"
+	       "\t[-i]            Rebuild the index even if an up to date one exists.\n"
+	       "\t[-j <threads>]  Number of threads used to build the index.\n"
+	       "\n"
+	       "The new data of each section is dumped as raw dwords, the log\n"
+	       "entries themselves are firmware defined.\n"
+	       "The index is stored next to the capture with an .idx suffix.\n",
+	       appname);
+}
+
+int main(int argc, char **argv)
+{
+	struct query q = { .last = UINT64_MAX };
+	const char *path = "guc_log_dump.dat";
+	unsigned int num_threads;
+	struct capture cap = {};
+	bool summary = false, reindex = false;
+	int ch, ret;
+
+	num_threads = max_t(long, sysconf(_SC_NPROCESSORS_ONLN), 1);
+
+	while ((ch = getopt(argc, argv, "Ss:e:t:ij:h")) != -1) {
+		switch (ch) {
+		case 'S':
+			summary = true;
+			break;
+		case 's':
+			q.first = strtoull(optarg, NULL, 0);
+			break;
+		case 'e':
+			q.last = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			ret = parse_type(optarg);
+			if (ret < 0) {
+				fprintf(stderr, "Unknown log type '%s'!\n",
+					optarg);
+				return EXIT_FAILURE;
+			}
+			q.types |= 1 << ret;
+			break;
+		case 'i':
+			reindex = true;
+			break;
+		case 'j':
+			num_threads = max(atoi(optarg), 1);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			fprintf(stderr, "Invalid option %c!\n", (char)optopt);
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		path = argv[optind];
+
+	if (!q.types)
+		q.types = (1 << GUC_MAX_LOG_BUFFER) - 1;
+
+	if (q.first > q.last) {
+		fprintf(stderr, "Empty range of subbuffers!\n");
+		return EXIT_FAILURE;
+	}
+
+	ret = open_capture(&cap, path, reindex, num_threads);
+	if (ret)
+		return EXIT_FAILURE;
+
+	if (summary)
+		print_summary(&cap);
+	else
+		query_capture(&cap, &q);
+
+	close_capture(&cap);
+
+	return EXIT_SUCCESS;
+}
@@ -37,8 +37,13 @@
 #include <sys/types.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <assert.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <zlib.h>
 
 #include "igt.h"
 
@@ -62,17 +67,33 @@
 
 char *read_buffer;
 char *out_filename;
+char *relay_filename;
 int poll_timeout = 2; /* by default 2ms timeout */
-pthread_mutex_t mutex;
 pthread_t flush_thread;
 int verbosity_level = 3; /* by default capture logs at max verbosity */
-uint32_t produced, consumed;
+/*
+ * Single producer (main thread), single consumer (flusher thread) ring of
+ * subbuffers. Each side only ever writes its own counter, so no lock is
+ * needed; the eventfds are used purely to sleep while the ring is empty or
+ * full.
+ */
+atomic_uint produced, consumed;
+int data_efd = -1, space_efd = -1;
 uint64_t total_bytes_written;
 int num_buffers = NUM_SUBBUFS;
 int relay_fd, outfile_fd = -1;
 uint32_t test_duration, max_filesize;
-pthread_cond_t underflow_cond, overflow_cond;
-bool stop_logging, discard_oldlogs, capturing_stopped;
+uint32_t rotate_size, rotate_time, max_segments;
+bool compress_output;
+bool stop_logging, discard_oldlogs;
+atomic_bool capturing_stopped;
+
+/* Current output segment */
+unsigned int segment;
+uint64_t segment_bytes;
+time_t segment_start;
+z_stream zstream;
+char *zbuffer;
 
 static void guc_log_control(bool enable, uint32_t log_level)
 {
@@ -112,6 +133,196 @@ static void int_sig_handler(int sig)
 	stop_logging = true;
 }
 
+static void notify(int efd)
+{
+	uint64_t one = 1;
+
+	igt_assert(write(efd, &one, sizeof(one)) == sizeof(one));
+}
+
+static void wait_notify(int efd)
+{
+	uint64_t val;
+
+	/* Wakeups are counted, so a notify racing with us is never lost. */
+	while (read(efd, &val, sizeof(val)) < 0)
+		igt_assert_f(errno == EINTR, "failed to wait on eventfd\n");
+}
+
+/*
+ * Read one complete subbuffer. The relay file always hands out complete
+ * subbuffers, but a regular file or a FIFO used in its place may return
+ * short reads.
+ */
+static int read_subbuf(char *ptr)
+{
+	int total = 0;
+
+	do {
+		int ret = read(relay_fd, ptr + total, SUBBUF_SIZE - total);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		igt_assert_f(ret >= 0, "failed to read from the guc log file\n");
+		if (!ret)
+			break;
+
+		total += ret;
+	} while (relay_filename && total < SUBBUF_SIZE);
+
+	igt_assert_f(!total || total == SUBBUF_SIZE,
+		     "invalid read from relay file\n");
+
+	return total;
+}
+
+static char *segment_filename(unsigned int n)
+{
+	const char *base = out_filename ?: DEFAULT_OUTPUT_FILE_NAME;
+	const char *ext = compress_output ? ".gz" : "";
+	char *name;
+	int ret;
+
+	if (rotate_size || rotate_time)
+		ret = asprintf(&name, "%s.%u%s", base, n, ext);
+	else
+		ret = asprintf(&name, "%s%s", base, ext);
+	igt_assert(ret > 0);
+
+	return name;
+}
+
+static void open_output_file(void)
+{
+	char *name = segment_filename(segment);
+	int flags = O_CREAT | O_WRONLY | O_TRUNC;
+
+	/* Use Direct IO mode for the output file, as the data written is not
+	 * supposed to be accessed again, this saves a copy of data from App's
+	 * buffer to kernel buffer (Page cache). Due to no buffering on kernel
+	 * side, data is flushed out to disk faster and more buffering can be
+	 * done on the logger side to hide the disk IO latency.
+	 *
+	 * Compressed output is not a multiple of the block size, so it has to
+	 * go through the page cache.
+	 */
+	outfile_fd = -1;
+	if (!compress_output)
+		outfile_fd = open(name, flags | O_DIRECT, 0440);
+	if (outfile_fd < 0) /* Not all filesystems support O_DIRECT. */
+		outfile_fd = open(name, flags, 0440);
+	igt_assert_f(outfile_fd >= 0, "couldn't open the output file %s\n", name);
+	free(name);
+
+	if (compress_output) {
+		memset(&zstream, 0, sizeof(zstream));
+		/* 16 + MAX_WBITS selects the gzip container. */
+		igt_assert(deflateInit2(&zstream, Z_DEFAULT_COMPRESSION,
+					Z_DEFLATED, 16 + MAX_WBITS, 8,
+					Z_DEFAULT_STRATEGY) == Z_OK);
+	}
+
+	/* Drop the oldest segment once over the retention limit. */
+	if (max_segments && segment >= max_segments) {
+		name = segment_filename(segment - max_segments);
+		unlink(name);
+		free(name);
+	}
+
+	segment_bytes = 0;
+	segment_start = time(NULL);
+}
+
+static void write_out(const void *ptr, size_t len)
+{
+	while (len) {
+		ssize_t ret = write(outfile_fd, ptr, len);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		igt_assert_f(ret > 0, "couldn't dump the logs in a file\n");
+
+		ptr += ret;
+		len -= ret;
+		segment_bytes += ret;
+		total_bytes_written += ret;
+	}
+}
+
+static void deflate_out(int flush)
+{
+	do {
+		zstream.next_out = (Bytef *)zbuffer;
+		zstream.avail_out = SUBBUF_SIZE;
+		igt_assert(deflate(&zstream, flush) != Z_STREAM_ERROR);
+		write_out(zbuffer, SUBBUF_SIZE - zstream.avail_out);
+	} while (!zstream.avail_out);
+}
+
+static void close_output_file(void)
+{
+	if (outfile_fd < 0)
+		return;
+
+	if (compress_output) {
+		deflate_out(Z_FINISH);
+		deflateEnd(&zstream);
+	}
+
+	close(outfile_fd);
+	outfile_fd = -1;
+}
+
+static void write_subbufs(struct iovec *iov, int count)
+{
+	int i;
+
+	if (compress_output) {
+		for (i = 0; i < count; i++) {
+			zstream.next_in = iov[i].iov_base;
+			zstream.avail_in = iov[i].iov_len;
+			deflate_out(Z_NO_FLUSH);
+		}
+	} else {
+		ssize_t len = 0, ret;
+
+		for (i = 0; i < count; i++)
+			len += iov[i].iov_len;
+
+		ret = writev(outfile_fd, iov, count);
+		igt_assert_f(ret >= 0, "couldn't dump the logs in a file\n");
+		segment_bytes += ret;
+		total_bytes_written += ret;
+
+		/* Finish off a short write the slow way. */
+		for (i = 0; i < count && ret < len; i++) {
+			if (ret >= iov[i].iov_len) {
+				ret -= iov[i].iov_len;
+				len -= iov[i].iov_len;
+				continue;
+			}
+
+			write_out(iov[i].iov_base + ret, iov[i].iov_len - ret);
+			len -= iov[i].iov_len;
+			ret = 0;
+		}
+	}
+
+	if (max_filesize && (total_bytes_written > MB(max_filesize))) {
+		igt_debug("reached the target of %" PRIu64 " bytes\n", MB(max_filesize));
+		stop_logging = true;
+	}
+
+	if ((rotate_size && segment_bytes >= MB(rotate_size)) ||
+	    (rotate_time && time(NULL) - segment_start >= rotate_time)) {
+		igt_debug("rotating output after %" PRIu64 " bytes\n",
+			  segment_bytes);
+		close_output_file();
+		segment++;
+		open_output_file();
+	}
+}
+
 static void pull_leftover_data(void)
 {
 	unsigned int bytes_read = 0;
@@ -119,58 +330,55 @@ static void pull_leftover_data(void)
 
 	do {
 		/* Read the logs from relay buffer */
-		ret = read(relay_fd, read_buffer, SUBBUF_SIZE);
+		ret = read_subbuf(read_buffer);
 		if (!ret)
 			break;
 
-		igt_assert_f(ret > 0, "failed to read from the guc log file\n");
-		igt_assert_f(ret == SUBBUF_SIZE, "invalid read from relay file\n");
-
 		bytes_read += ret;
 
 		if (outfile_fd >= 0) {
-			ret = write(outfile_fd, read_buffer, SUBBUF_SIZE);
-			igt_assert_f(ret == SUBBUF_SIZE, "couldn't dump the logs in a file\n");
-			total_bytes_written += ret;
+			struct iovec iov = {
+				.iov_base = read_buffer,
+				.iov_len = SUBBUF_SIZE,
+			};
+
+			write_subbufs(&iov, 1);
 		}
 	} while(1);
 
 	igt_debug("%u bytes flushed\n", bytes_read);
 }
 
-static int num_filled_bufs(void)
+static char *subbuf(unsigned int n)
 {
-	return (produced - consumed);
+	return read_buffer + (n % num_buffers) * SUBBUF_SIZE;
 }
 
 static void pull_data(void)
 {
-	char *ptr;
+	unsigned int head = atomic_load_explicit(&produced,
+						 memory_order_relaxed);
 	int ret;
 
-	pthread_mutex_lock(&mutex);
-	while (num_filled_bufs() >= num_buffers) {
-		igt_debug("overflow, will wait, produced %u, consumed %u\n", produced, consumed);
+	while (head - atomic_load_explicit(&consumed, memory_order_acquire) >=
+	       num_buffers) {
+		igt_debug("overflow, will wait, produced %u, consumed %u\n",
+			  head, atomic_load(&consumed));
 		/* Stall the main thread in case of overflow, as there are no
 		 * buffers available to store the new logs, otherwise there
 		 * could be corruption if both threads work on the same buffer.
 		 */
-		pthread_cond_wait(&overflow_cond, &mutex);
-	};
-	pthread_mutex_unlock(&mutex);
-
-	ptr = read_buffer + (produced % num_buffers) * SUBBUF_SIZE;
+		wait_notify(space_efd);
+	}
 
 	/* Read the logs from relay buffer */
-	ret = read(relay_fd, ptr, SUBBUF_SIZE);
-	igt_assert_f(ret >= 0, "failed to read from the guc log file\n");
-	igt_assert_f(!ret || ret == SUBBUF_SIZE, "invalid read from relay file\n");
-
+	ret = read_subbuf(subbuf(head));
 	if (ret) {
-		pthread_mutex_lock(&mutex);
-		produced++;
-		pthread_cond_signal(&underflow_cond);
-		pthread_mutex_unlock(&mutex);
+		atomic_store_explicit(&produced, head + 1, memory_order_release);
+		notify(data_efd);
+	} else if (relay_filename) {
+		/* End of the file or FIFO standing in for the relay file. */
+		stop_logging = true;
 	} else {
 		/* Occasionally (very rare) read from the relay file returns no
 		 * data, albeit the polling done prior to read call indicated
@@ -182,43 +390,49 @@ static void pull_data(void)
 
 static void *flusher(void *arg)
 {
-	char *ptr;
-	int ret;
+	unsigned int tail = 0;
 
 	igt_debug("execution started of flusher thread\n");
 
 	do {
-		pthread_mutex_lock(&mutex);
-		while (!num_filled_bufs()) {
+		unsigned int head, count, first, run;
+		struct iovec iov[2];
+
+		head = atomic_load_explicit(&produced, memory_order_acquire);
+		if (head == tail) {
 			/* Exit only after completing the flush of all the filled
 			 * buffers as User would expect that all logs captured up
 			 * till the point of interruption/exit are written out to
 			 * the disk file.
 			 */
-			if (capturing_stopped) {
+			if (atomic_load(&capturing_stopped) &&
+			    atomic_load(&produced) == tail) {
 				igt_debug("flusher to exit now\n");
-				pthread_mutex_unlock(&mutex);
 				return NULL;
 			}
-			pthread_cond_wait(&underflow_cond, &mutex);
-		};
-		pthread_mutex_unlock(&mutex);
 
-		ptr = read_buffer + (consumed % num_buffers) * SUBBUF_SIZE;
+			wait_notify(data_efd);
+			continue;
+		}
+
+		/*
+		 * Write out everything which is ready in one go, which is at
+		 * most two runs of subbuffers as the ring may have wrapped.
+		 */
+		count = head - tail;
+		first = tail % num_buffers;
+		run = min(count, num_buffers - first);
 
-		ret = write(outfile_fd, ptr, SUBBUF_SIZE);
-		igt_assert_f(ret == SUBBUF_SIZE, "couldn't dump the logs in a file\n");
+		iov[0].iov_base = subbuf(tail);
+		iov[0].iov_len = run * SUBBUF_SIZE;
+		iov[1].iov_base = subbuf(0);
+		iov[1].iov_len = (count - run) * SUBBUF_SIZE;
 
-		total_bytes_written += ret;
-		if (max_filesize && (total_bytes_written > MB(max_filesize))) {
-			igt_debug("reached the target of %" PRIu64 " bytes\n", MB(max_filesize));
-			stop_logging = true;
-		}
+		write_subbufs(iov, count > run ? 2 : 1);
 
-		pthread_mutex_lock(&mutex);
-		consumed++;
-		pthread_cond_signal(&overflow_cond);
-		pthread_mutex_unlock(&mutex);
+		tail = head;
+		atomic_store_explicit(&consumed, tail, memory_order_release);
+		notify(space_efd);
 	} while(1);
 
 	return NULL;
@@ -230,13 +444,18 @@ static void init_flusher_thread(void)
 	pthread_attr_t		p_attr;
 	int ret;
 
-	pthread_cond_init(&underflow_cond, NULL);
-	pthread_cond_init(&overflow_cond, NULL);
-	pthread_mutex_init(&mutex, NULL);
+	data_efd = eventfd(0, EFD_CLOEXEC);
+	space_efd = eventfd(0, EFD_CLOEXEC);
+	igt_assert_f(data_efd >= 0 && space_efd >= 0,
+		     "couldn't create eventfds\n");
 
 	ret = pthread_attr_init(&p_attr);
 	igt_assert_f(ret == 0, "error obtaining default thread attributes\n");
 
+	/* A stand-in relay file is for testing, don't insist on rt priority. */
+	if (relay_filename)
+		goto create;
+
 	ret = pthread_attr_setinheritsched(&p_attr, PTHREAD_EXPLICIT_SCHED);
 	igt_assert_f(ret == 0, "couldn't set inheritsched\n");
 
@@ -251,6 +470,7 @@ static void init_flusher_thread(void)
 	ret = pthread_attr_setschedparam(&p_attr, &thread_sched);
 	igt_assert_f(ret == 0, "couldn't set thread priority\n");
 
+create:
 	ret = pthread_create(&flush_thread, &p_attr, flusher, NULL);
 	igt_assert_f(ret == 0, "thread creation failed\n");
 
@@ -260,7 +480,10 @@ static void init_flusher_thread(void)
 
 static void open_relay_file(void)
 {
-	relay_fd = igt_debugfs_open(-1, RELAY_FILE_NAME, O_RDONLY);
+	if (relay_filename)
+		relay_fd = open(relay_filename, O_RDONLY);
+	else
+		relay_fd = igt_debugfs_open(-1, RELAY_FILE_NAME, O_RDONLY);
 	igt_assert_f(relay_fd >= 0, "couldn't open the guc log file\n");
 
 	/* Purge the old/boot-time logs from the relay buffer.
@@ -274,22 +497,6 @@ static void open_relay_file(void)
 		pull_leftover_data();
 }
 
-static void open_output_file(void)
-{
-	/* Use Direct IO mode for the output file, as the data written is not
-	 * supposed to be accessed again, this saves a copy of data from App's
-	 * buffer to kernel buffer (Page cache). Due to no buffering on kernel
-	 * side, data is flushed out to disk faster and more buffering can be
-	 * done on the logger side to hide the disk IO latency.
-	 */
-	outfile_fd = open(out_filename ? : DEFAULT_OUTPUT_FILE_NAME,
-			  O_CREAT | O_WRONLY | O_TRUNC | O_DIRECT,
-			  0440);
-	igt_assert_f(outfile_fd >= 0, "couldn't open the output file\n");
-
-	free(out_filename);
-}
-
 static void init_main_thread(void)
 {
 	struct sched_param	thread_sched;
@@ -302,7 +509,7 @@ static void init_main_thread(void)
 	 */
 	thread_sched.sched_priority = 1;
 	ret = sched_setscheduler(getpid(), SCHED_FIFO, &thread_sched);
-	igt_assert_f(ret == 0, "couldn't set the priority\n");
+	igt_assert_f(ret == 0 || relay_filename, "couldn't set the priority\n");
 
 	if (signal(SIGINT, int_sig_handler) == SIG_ERR)
 		igt_assert_f(0, "SIGINT handler registration failed\n");
@@ -316,12 +523,18 @@ static void init_main_thread(void)
 
 	/* Keep the pages locked in RAM, avoid page fault overhead */
 	ret = mlock(read_buffer, num_buffers * SUBBUF_SIZE);
-	igt_assert_f(ret == 0, "failed to lock memory\n");
+	igt_assert_f(ret == 0 || relay_filename, "failed to lock memory\n");
+
+	if (compress_output) {
+		zbuffer = malloc(SUBBUF_SIZE);
+		igt_assert_f(zbuffer, "couldn't allocate the compression buffer\n");
+	}
 
 	/* Enable the logging, it may not have been enabled from boot and so
 	 * the relay file also wouldn't have been created.
 	 */
-	guc_log_control(true, verbosity_level);
+	if (!relay_filename)
+		guc_log_control(true, verbosity_level);
 
 	open_relay_file();
 	open_output_file();
@@ -367,6 +580,30 @@ static int parse_options(int opt, int opt_index, void *data)
 		discard_oldlogs = true;
 		igt_debug("old/boot-time logs will be discarded\n");
 		break;
+	case 'z':
+		compress_output = true;
+		igt_debug("logs will be gzip compressed\n");
+		break;
+	case 'r':
+		rotate_size = atoi(optarg);
+		igt_assert_f(rotate_size > 0, "invalid input for -r option\n");
+		igt_debug("output will be rotated every %d MB\n", rotate_size);
+		break;
+	case 'R':
+		rotate_time = atoi(optarg);
+		igt_assert_f(rotate_time > 0, "invalid input for -R option\n");
+		igt_debug("output will be rotated every %d seconds\n", rotate_time);
+		break;
+	case 'k':
+		max_segments = atoi(optarg);
+		igt_assert_f(max_segments > 0, "invalid input for -k option\n");
+		igt_debug("at most %d output segments will be kept\n", max_segments);
+		break;
+	case 'f':
+		relay_filename = strdup(optarg);
+		igt_assert_f(relay_filename, "Couldn't allocate the relay filename\n");
+		igt_debug("logs to be read from %s\n", relay_filename);
+		break;
 	}
 
 	return 0;
@@ -382,6 +619,11 @@ static void process_command_line(int argc, char **argv)
 		{"polltimeout", required_argument, 0, 'p'},
 		{"size", required_argument, 0, 's'},
 		{"discard", no_argument, 0, 'd'},
+		{"compress", no_argument, 0, 'z'},
+		{"rotate-size", required_argument, 0, 'r'},
+		{"rotate-time", required_argument, 0, 'R'},
+		{"keep", required_argument, 0, 'k'},
+		{"relay-file", required_argument, 0, 'f'},
 		{ 0, 0, 0, 0 }
 	};
 
@@ -392,9 +634,14 @@ static void process_command_line(int argc, char **argv)
 		"  -t --testduration=sec  max duration in seconds for which the logger should run\n"
 		"  -p --polltimeout=ms    polling timeout in ms, -1 == indefinite wait for the new data\n"
 		"  -s --size=MB           max size of output file in MBs after which logging will be stopped\n"
-		"  -d --discard           discard the old/boot-time logs before entering into the capture loop\n";
-
-	igt_simple_init_parse_opts(&argc, argv, "v:o:b:t:p:s:d", long_options,
+		"  -d --discard           discard the old/boot-time logs before entering into the capture loop\n"
+		"  -z --compress          gzip compress the output file(s) while logging\n"
+		"  -r --rotate-size=MB    start a new numbered output file every MB megabytes\n"
+		"  -R --rotate-time=sec   start a new numbered output file every sec seconds\n"
+		"  -k --keep=num          keep only the last num rotated output files\n"
+		"  -f --relay-file=name   read subbuffers from a regular file or FIFO instead of the GuC relay file\n";
+
+	igt_simple_init_parse_opts(&argc, argv, "v:o:b:t:p:s:dzr:R:k:f:", long_options,
 				   help, parse_options, NULL);
 }
 
@@ -453,18 +700,24 @@ int main(int argc, char **argv)
 	} while (!stop_logging);
 
 	/* Pause logging on the GuC side */
-	guc_log_control(false, 0);
+	if (!relay_filename)
+		guc_log_control(false, 0);
 
 	/* Signal flusher thread to make an exit */
-	capturing_stopped = 1;
-	pthread_cond_signal(&underflow_cond);
+	atomic_store(&capturing_stopped, true);
+	notify(data_efd);
 	pthread_join(flush_thread, NULL);
 
 	pull_leftover_data();
+	close_output_file();
 	igt_info("total bytes written %" PRIu64 "\n", total_bytes_written);
 
 	free(read_buffer);
+	free(zbuffer);
+	free(out_filename);
+	free(relay_filename);
 	close(relay_fd);
-	close(outfile_fd);
+	close(data_efd);
+	close(space_efd);
 	igt_exit();
 }
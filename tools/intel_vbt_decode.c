@@ -41,16 +41,8 @@
 #include "intel_io.h"
 #include "intel_chipset.h"
 #include "drmtest.h"
-
-/* kernel types for intel_vbt_defs.h */
-typedef uint8_t u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef uint64_t u64;
-#define __packed __attribute__ ((packed))
-
-#define _INTEL_BIOS_PRIVATE
-#include "intel_vbt_defs.h"
+#include "igt_vbt.h"
+#include "igt_vbt_defs.h"
 
 /* no bother to include "edid.h" */
 #define _H_ACTIVE(x) (x[2] + ((x[4] & 0xF0) << 4))
@@ -76,6 +68,7 @@ struct context {
 	const struct vbt_header *vbt;
 	const struct bdb_header *bdb;
 	int size;
+	struct igt_vbt igt_vbt;
 
 	uint32_t devid;
 	int panel_type;
@@ -83,59 +76,21 @@ struct context {
 	bool hexdump;
 };
 
-/* Get BDB block size given a pointer to Block ID. */
-static uint32_t _get_blocksize(const uint8_t *block_base)
-{
-	/* The MIPI Sequence Block v3+ has a separate size field. */
-	if (*block_base == BDB_MIPI_SEQUENCE && *(block_base + 3) >= 3)
-		return *((const uint32_t *)(block_base + 4));
-	else
-		return *((const uint16_t *)(block_base + 1));
-}
-
-static struct bdb_block *find_section(struct context *context, int section_id)
+static bool find_section(struct context *context, int section_id,
+			 struct bdb_block *block)
 {
-	const struct bdb_header *bdb = context->bdb;
-	int length = context->size;
-	struct bdb_block *block;
-	const uint8_t *base = (const uint8_t *)bdb;
-	int index = 0;
-	uint32_t total, current_size;
-	unsigned char current_id;
-
-	/* skip to first section */
-	index += bdb->header_size;
-	total = bdb->bdb_size;
-	if (total > length)
-		total = length;
-
-	block = malloc(sizeof(*block));
-	if (!block) {
-		fprintf(stderr, "out of memory\n");
-		exit(EXIT_FAILURE);
-	}
-
-	/* walk the sections looking for section_id */
-	while (index + 3 < total) {
-		current_id = *(base + index);
-		current_size = _get_blocksize(base + index);
-		index += 3;
-
-		if (index + current_size > total)
-			return NULL;
+	const void *data;
+	uint32_t size;
 
-		if (current_id == section_id) {
-			block->id = current_id;
-			block->size = current_size;
-			block->data = base + index;
-			return block;
-		}
+	data = igt_vbt_get_block(&context->igt_vbt, section_id, &size);
+	if (!data)
+		return false;
 
-		index += current_size;
-	}
+	block->id = section_id;
+	block->size = size;
+	block->data = data;
 
-	free(block);
-	return NULL;
+	return true;
 }
 
 static void dump_general_features(struct context *context,
@@ -616,7 +571,7 @@ static void dump_lvds_data(struct context *context,
 			   const struct bdb_block *block)
 {
 	const struct bdb_lvds_lfp_data *lvds_data = block->data;
-	struct bdb_block *ptrs_block;
+	struct bdb_block ptrs_block;
 	const struct bdb_lvds_lfp_data_ptrs *ptrs;
 	int num_entries;
 	int i;
@@ -625,19 +580,25 @@ static void dump_lvds_data(struct context *context,
 	float clock;
 	int lfp_data_size, dvo_offset;
 
-	ptrs_block = find_section(context, BDB_LVDS_LFP_DATA_PTRS);
-	if (!ptrs_block) {
+	if (!find_section(context, BDB_LVDS_LFP_DATA_PTRS, &ptrs_block)) {
 		printf("No LVDS ptr block\n");
 		return;
 	}
 
-	ptrs = ptrs_block->data;
+	ptrs = ptrs_block.data;
 
 	lfp_data_size =
 	    ptrs->ptr[1].fp_timing_offset - ptrs->ptr[0].fp_timing_offset;
 	dvo_offset =
 	    ptrs->ptr[0].dvo_timing_offset - ptrs->ptr[0].fp_timing_offset;
 
+	/* each entry holds the fp timing, and the dvo timing at dvo_offset */
+	if (lfp_data_size < (int)sizeof(struct lvds_fp_timing) ||
+	    dvo_offset < 0 || dvo_offset + 18 > lfp_data_size) {
+		printf("Invalid LVDS data pointers\n");
+		return;
+	}
+
 	num_entries = block->size / lfp_data_size;
 
 	printf("  Number of entries: %d (preferred block marked with '*')\n",
@@ -690,8 +651,6 @@ static void dump_lvds_data(struct context *context,
 		       (hsyncend > htotal || vsyncend > vtotal) ?
 		       "BAD!" : "good");
 	}
-
-	free(ptrs_block);
 }
 
 static void dump_driver_feature(struct context *context,
@@ -1093,6 +1052,12 @@ static void dump_mipi_config(struct context *context,
 	const struct mipi_config *config;
 	const struct mipi_pps_data *pps;
 
+	if (context->panel_type >= MAX_MIPI_CONFIGURATIONS) {
+		printf("\tNo MIPI config for panel type %d\n",
+		       context->panel_type);
+		return;
+	}
+
 	config = &start->config[context->panel_type];
 	pps = &start->pps[context->panel_type];
 
@@ -1336,217 +1301,25 @@ static const uint8_t *dump_sequence(const uint8_t *data, uint8_t seq_version)
 	return data;
 }
 
-/* Find the sequence block and size for the given panel. */
-static const uint8_t *
-find_panel_sequence_block(const struct bdb_mipi_sequence *sequence,
-			  uint16_t panel_id, uint32_t total, uint32_t *seq_size)
-{
-	const uint8_t *data = &sequence->data[0];
-	uint8_t current_id;
-	uint32_t current_size;
-	int header_size = sequence->version >= 3 ? 5 : 3;
-	int index = 0;
-	int i;
-
-	/* skip new block size */
-	if (sequence->version >= 3)
-		data += 4;
-
-	for (i = 0; i < MAX_MIPI_CONFIGURATIONS && index < total; i++) {
-		if (index + header_size > total) {
-			fprintf(stderr, "Invalid sequence block (header)\n");
-			return NULL;
-		}
-
-		current_id = *(data + index);
-		if (sequence->version >= 3)
-			current_size = *((const uint32_t *)(data + index + 1));
-		else
-			current_size = *((const uint16_t *)(data + index + 1));
-
-		index += header_size;
-
-		if (index + current_size > total) {
-			fprintf(stderr, "Invalid sequence block\n");
-			return NULL;
-		}
-
-		if (current_id == panel_id) {
-			*seq_size = current_size;
-			return data + index;
-		}
-
-		index += current_size;
-	}
-
-	fprintf(stderr, "Sequence block detected but no valid configuration\n");
-
-	return NULL;
-}
-
-static int goto_next_sequence(const uint8_t *data, int index, int total)
-{
-	uint16_t len;
-
-	/* Skip Sequence Byte. */
-	for (index = index + 1; index < total; index += len) {
-		uint8_t operation_byte = *(data + index);
-		index++;
-
-		switch (operation_byte) {
-		case MIPI_SEQ_ELEM_END:
-			return index;
-		case MIPI_SEQ_ELEM_SEND_PKT:
-			if (index + 4 > total)
-				return 0;
-
-			len = *((const uint16_t *)(data + index + 2)) + 4;
-			break;
-		case MIPI_SEQ_ELEM_DELAY:
-			len = 4;
-			break;
-		case MIPI_SEQ_ELEM_GPIO:
-			len = 2;
-			break;
-		case MIPI_SEQ_ELEM_I2C:
-			if (index + 7 > total)
-				return 0;
-			len = *(data + index + 6) + 7;
-			break;
-		default:
-			fprintf(stderr, "Unknown operation byte\n");
-			return 0;
-		}
-	}
-
-	return 0;
-}
-
-static int goto_next_sequence_v3(const uint8_t *data, int index, int total)
-{
-	int seq_end;
-	uint16_t len;
-	uint32_t size_of_sequence;
-
-	/*
-	 * Could skip sequence based on Size of Sequence alone, but also do some
-	 * checking on the structure.
-	 */
-	if (total < 5) {
-		fprintf(stderr, "Too small sequence size\n");
-		return 0;
-	}
-
-	/* Skip Sequence Byte. */
-	index++;
-
-	/*
-	 * Size of Sequence. Excludes the Sequence Byte and the size itself,
-	 * includes MIPI_SEQ_ELEM_END byte, excludes the final MIPI_SEQ_END
-	 * byte.
-	 */
-	size_of_sequence = *((const uint32_t *)(data + index));
-	index += 4;
-
-	seq_end = index + size_of_sequence;
-	if (seq_end > total) {
-		fprintf(stderr, "Invalid sequence size\n");
-		return 0;
-	}
-
-	for (; index < total; index += len) {
-		uint8_t operation_byte = *(data + index);
-		index++;
-
-		if (operation_byte == MIPI_SEQ_ELEM_END) {
-			if (index != seq_end) {
-				fprintf(stderr, "Invalid element structure\n");
-				return 0;
-			}
-			return index;
-		}
-
-		len = *(data + index);
-		index++;
-
-		/*
-		 * FIXME: Would be nice to check elements like for v1/v2 in
-		 * goto_next_sequence() above.
-		 */
-		switch (operation_byte) {
-		case MIPI_SEQ_ELEM_SEND_PKT:
-		case MIPI_SEQ_ELEM_DELAY:
-		case MIPI_SEQ_ELEM_GPIO:
-		case MIPI_SEQ_ELEM_I2C:
-		case MIPI_SEQ_ELEM_SPI:
-		case MIPI_SEQ_ELEM_PMIC:
-			break;
-		default:
-			fprintf(stderr, "Unknown operation byte %u\n",
-				operation_byte);
-			break;
-		}
-	}
-
-	return 0;
-}
-
 static void dump_mipi_sequence(struct context *context,
 			       const struct bdb_block *block)
 {
-	const struct bdb_mipi_sequence *sequence = block->data;
-	const uint8_t *data;
-	uint32_t seq_size;
-	int index = 0, i;
-	const uint8_t *sequence_ptrs[MIPI_SEQ_MAX] = {};
-
-	/* Check if we have sequence block as well */
-	if (!sequence) {
-		printf("No MIPI Sequence found\n");
-		return;
-	}
-
-	printf("\tSequence block version v%u\n", sequence->version);
+	struct igt_vbt_mipi_sequences seqs;
+	int i;
 
-	/* Fail gracefully for forward incompatible sequence block. */
-	if (sequence->version >= 4) {
-		fprintf(stderr, "Unable to parse MIPI Sequence Block v%u\n",
-			sequence->version);
+	if (!igt_vbt_get_mipi_sequences(&context->igt_vbt, context->panel_type,
+					&seqs)) {
+		fprintf(stderr, "Invalid MIPI sequences for panel type %d\n",
+			context->panel_type);
 		return;
 	}
 
-	data = find_panel_sequence_block(sequence, context->panel_type,
-					 block->size, &seq_size);
-	if (!data)
-		return;
-
-	/* Parse the sequences. Corresponds to VBT parsing in the kernel. */
-	for (;;) {
-		uint8_t seq_id = *(data + index);
-		if (seq_id == MIPI_SEQ_END)
-			break;
-
-		if (seq_id >= MIPI_SEQ_MAX) {
-			fprintf(stderr, "Unknown sequence %u\n", seq_id);
-			return;
-		}
-
-		sequence_ptrs[seq_id] = data + index;
-
-		if (sequence->version >= 3)
-			index = goto_next_sequence_v3(data, index, seq_size);
-		else
-			index = goto_next_sequence(data, index, seq_size);
-		if (!index) {
-			fprintf(stderr, "Invalid sequence %u\n", seq_id);
-			return;
-		}
-	}
+	printf("\tSequence block version v%u\n", seqs.version);
 
 	/* Dump the sequences. Corresponds to sequence execution in kernel. */
-	for (i = 0; i < ARRAY_SIZE(sequence_ptrs); i++)
-		if (sequence_ptrs[i])
-			dump_sequence(sequence_ptrs[i], sequence->version);
+	for (i = 0; i < ARRAY_SIZE(seqs.data); i++)
+		if (seqs.data[i])
+			dump_sequence(seqs.data[i], seqs.version);
 }
 
 #define KB(x) ((x) * 1024)
@@ -1631,25 +1404,6 @@ static void dump_compression_parameters(struct context *context,
 	}
 }
 
-/* get panel type from lvds options block, or -1 if block not found */
-static int get_panel_type(struct context *context)
-{
-	struct bdb_block *block;
-	const struct bdb_lvds_options *options;
-	int panel_type;
-
-	block = find_section(context, BDB_LVDS_OPTIONS);
-	if (!block)
-		return -1;
-
-	options = block->data;
-	panel_type = options->panel_type;
-
-	free(block);
-
-	return panel_type;
-}
-
 static int
 get_device_id(unsigned char *bios, int size)
 {
@@ -1781,37 +1535,49 @@ static void hex_dump_block(const struct bdb_block *block)
 	hex_dump(block->data, block->size);
 }
 
-static bool dump_section(struct context *context, int section_id)
+static struct dumper *find_dumper(int section_id)
 {
-	struct dumper *dumper = NULL;
-	struct bdb_block *block;
 	int i;
 
-	block = find_section(context, section_id);
-	if (!block)
+	for (i = 0; i < ARRAY_SIZE(dumpers); i++)
+		if (section_id == dumpers[i].id)
+			return &dumpers[i];
+
+	return NULL;
+}
+
+static bool dump_section(struct context *context, int section_id)
+{
+	const struct igt_vbt_block *entry;
+	struct dumper *dumper;
+	struct bdb_block block;
+
+	if (section_id < 0 || section_id >= IGT_VBT_NUM_BLOCKS)
 		return false;
 
-	for (i = 0; i < ARRAY_SIZE(dumpers); i++) {
-		if (block->id == dumpers[i].id) {
-			dumper = &dumpers[i];
-			break;
-		}
-	}
+	entry = &context->igt_vbt.blocks[section_id];
+	if (entry->status == IGT_VBT_BLOCK_MISSING)
+		return false;
+
+	block.id = section_id;
+	block.size = entry->size;
+	block.data = entry->data;
 
+	dumper = find_dumper(section_id);
 	if (dumper && dumper->name)
-		printf("BDB block %d - %s:\n", block->id, dumper->name);
+		printf("BDB block %d - %s:\n", block.id, dumper->name);
 	else
 		printf("BDB block %d - Unknown, no decoding available:\n",
-		       block->id);
+		       block.id);
 
 	if (context->hexdump)
-		hex_dump_block(block);
-	if (dumper && dumper->dump)
-		dumper->dump(context, block);
+		hex_dump_block(&block);
+	if (entry->status == IGT_VBT_BLOCK_INVALID)
+		printf("\tInvalid block contents, not decoded\n");
+	else if (dumper && dumper->dump)
+		dumper->dump(context, &block);
 	printf("\n");
 
-	free(block);
-
 	return true;
 }
 
@@ -1877,21 +1643,202 @@ static void dump_headers(struct context *context)
 	printf("\n");
 
 	printf("BDB blocks present:");
-	for (i = 0; i < 256; i++) {
-		struct bdb_block *block;
-
-		block = find_section(context, i);
-		if (!block)
+	for (i = 0; i < IGT_VBT_NUM_BLOCKS; i++) {
+		if (context->igt_vbt.blocks[i].status == IGT_VBT_BLOCK_MISSING)
 			continue;
 
 		if (j++ % 16)
 			printf(" %3d", i);
 		else
 			printf("\n\t%3d", i);
-
-		free(block);
 	}
 	printf("\n\n");
+
+	if (context->igt_vbt.truncated)
+		printf("BDB truncated, a block overruns it\n\n");
+}
+
+static void json_string(const void *str, int len)
+{
+	const uint8_t *p = str;
+
+	putchar('"');
+	for (; len && *p; len--, p++) {
+		if (*p == '"' || *p == '\\')
+			printf("\\%c", *p);
+		else if (*p < 0x20 || *p > 0x7e)
+			printf("\\u%04x", *p);
+		else
+			putchar(*p);
+	}
+	putchar('"');
+}
+
+static const char *block_status_name(enum igt_vbt_block_status status)
+{
+	switch (status) {
+	case IGT_VBT_BLOCK_OK:
+		return "ok";
+	case IGT_VBT_BLOCK_SHORT:
+		return "short";
+	case IGT_VBT_BLOCK_INVALID:
+		return "invalid";
+	default:
+		return "missing";
+	}
+}
+
+static void dump_json_blocks(struct context *context)
+{
+	const struct igt_vbt *vbt = &context->igt_vbt;
+	int i;
+
+	printf("\t\"blocks\": [");
+	for (i = 0; i < vbt->num_blocks; i++) {
+		const struct igt_vbt_block *block = &vbt->blocks[vbt->order[i]];
+		struct dumper *dumper = find_dumper(vbt->order[i]);
+
+		printf("%s\n\t\t{ \"id\": %d, \"name\": ", i ? "," : "",
+		       vbt->order[i]);
+		json_string(dumper && dumper->name ? dumper->name : "Unknown", -1);
+		printf(", \"offset\": %u, \"size\": %u, \"status\": \"%s\" }",
+		       block->offset, block->size,
+		       block_status_name(block->status));
+	}
+	printf("\n\t],\n");
+}
+
+static void dump_json_child_devices(struct context *context)
+{
+	struct igt_vbt_child_device child;
+	int i, j = 0;
+
+	printf("\t\"child_devices\": [");
+	for (i = 0; igt_vbt_get_child_device(&context->igt_vbt, i, &child); i++) {
+		if (!child.device_type)
+			continue;
+
+		printf("%s\n\t\t{\n", j++ ? "," : "");
+		printf("\t\t\t\"handle\": %u,\n", child.handle);
+		printf("\t\t\t\"device_type\": %u,\n", child.device_type);
+		printf("\t\t\t\"device_type_name\": \"%s\",\n",
+		       child_device_type(child.device_type));
+		printf("\t\t\t\"dvo_port\": \"%s\",\n", dvo_port(child.dvo_port));
+		printf("\t\t\t\"i2c_pin\": %u,\n", child.i2c_pin);
+		printf("\t\t\t\"ddc_pin\": %u,\n", child.ddc_pin);
+		printf("\t\t\t\"aux_channel\": %u,\n", child.aux_channel);
+		printf("\t\t\t\"hdmi_support\": %s,\n",
+		       child.hdmi_support ? "true" : "false");
+		printf("\t\t\t\"dp_support\": %s,\n",
+		       child.dp_support ? "true" : "false");
+		printf("\t\t\t\"lane_reversal\": %s,\n",
+		       child.lane_reversal ? "true" : "false");
+		printf("\t\t\t\"lspcon\": %s,\n", child.lspcon ? "true" : "false");
+		printf("\t\t\t\"usb_type_c\": %s,\n",
+		       child.usb_type_c ? "true" : "false");
+		printf("\t\t\t\"tbt\": %s,\n", child.tbt ? "true" : "false");
+		printf("\t\t\t\"hdmi_max_data_rate\": %u,\n",
+		       child.hdmi_max_data_rate);
+		printf("\t\t\t\"dp_max_link_rate\": %u\n", child.dp_max_link_rate);
+		printf("\t\t}");
+	}
+	printf("\n\t],\n");
+}
+
+static void dump_json_panel(struct context *context)
+{
+	const struct igt_vbt *vbt = &context->igt_vbt;
+	struct igt_vbt_mipi_sequences seqs;
+	struct igt_vbt_edp edp;
+	struct igt_vbt_psr psr;
+	int i, j = 0;
+
+	printf("\t\"panel_type\": %d,\n", context->panel_type);
+
+	if (igt_vbt_get_edp(vbt, context->panel_type, &edp)) {
+		printf("\t\"edp\": {\n");
+		printf("\t\t\"t3\": %u, \"t7\": %u, \"t9\": %u, \"t10\": %u, \"t12\": %u,\n",
+		       edp.t3, edp.t7, edp.t9, edp.t10, edp.t12);
+		printf("\t\t\"bpp\": %d,\n", edp.bpp);
+		printf("\t\t\"rate\": %u,\n", edp.rate);
+		printf("\t\t\"lanes\": %u,\n", edp.lanes);
+		printf("\t\t\"preemphasis\": %u,\n", edp.preemphasis);
+		printf("\t\t\"vswing\": %u,\n", edp.vswing);
+		printf("\t\t\"fast_link_training\": %s,\n",
+		       edp.fast_link_training ? "true" : "false");
+		printf("\t\t\"pwm_on_to_backlight_enable\": %u,\n",
+		       edp.pwm_on_to_backlight_enable);
+		printf("\t\t\"backlight_disable_to_pwm_off\": %u\n",
+		       edp.backlight_disable_to_pwm_off);
+		printf("\t},\n");
+	} else {
+		printf("\t\"edp\": null,\n");
+	}
+
+	if (igt_vbt_get_psr(vbt, context->panel_type, &psr)) {
+		printf("\t\"psr\": {\n");
+		printf("\t\t\"full_link\": %s,\n",
+		       psr.full_link ? "true" : "false");
+		printf("\t\t\"require_aux_to_wakeup\": %s,\n",
+		       psr.require_aux_to_wakeup ? "true" : "false");
+		printf("\t\t\"idle_frames\": %d,\n", psr.idle_frames);
+		printf("\t\t\"lines_to_wait\": %d,\n", psr.lines_to_wait);
+		printf("\t\t\"tp1_wakeup_time_us\": %d,\n", psr.tp1_wakeup_time);
+		printf("\t\t\"tp2_tp3_wakeup_time_us\": %d,\n",
+		       psr.tp2_tp3_wakeup_time);
+		printf("\t\t\"psr2_tp2_tp3_wakeup_time_us\": %d\n",
+		       psr.psr2_tp2_tp3_wakeup_time);
+		printf("\t},\n");
+	} else {
+		printf("\t\"psr\": null,\n");
+	}
+
+	if (igt_vbt_get_mipi_sequences(vbt, context->panel_type, &seqs)) {
+		printf("\t\"mipi_sequences\": {\n");
+		printf("\t\t\"version\": %u,\n", seqs.version);
+		printf("\t\t\"sequences\": [");
+		for (i = 0; i < ARRAY_SIZE(seqs.data); i++)
+			if (seqs.data[i])
+				printf("%s\"%s\"", j++ ? ", " : "",
+				       sequence_name(i));
+		printf("]\n");
+		printf("\t}\n");
+	} else {
+		printf("\t\"mipi_sequences\": null\n");
+	}
+}
+
+static void dump_json(struct context *context)
+{
+	const struct vbt_header *vbt = context->vbt;
+	const struct bdb_header *bdb = context->bdb;
+
+	printf("{\n");
+
+	printf("\t\"vbt\": {\n\t\t\"signature\": ");
+	json_string(vbt->signature, sizeof(vbt->signature));
+	printf(",\n\t\t\"version\": %u,\n", vbt->version);
+	printf("\t\t\"header_size\": %u,\n", vbt->header_size);
+	printf("\t\t\"vbt_size\": %u,\n", vbt->vbt_size);
+	printf("\t\t\"checksum\": %u,\n", vbt->vbt_checksum);
+	printf("\t\t\"bdb_offset\": %u\n", vbt->bdb_offset);
+	printf("\t},\n");
+
+	printf("\t\"bdb\": {\n\t\t\"signature\": ");
+	json_string(bdb->signature, sizeof(bdb->signature));
+	printf(",\n\t\t\"version\": %u,\n", bdb->version);
+	printf("\t\t\"header_size\": %u,\n", bdb->header_size);
+	printf("\t\t\"bdb_size\": %u\n", bdb->bdb_size);
+	printf("\t},\n");
+
+	printf("\t\"truncated\": %s,\n",
+	       context->igt_vbt.truncated ? "true" : "false");
+
+	dump_json_blocks(context);
+	dump_json_child_devices(context);
+	dump_json_panel(context);
+
+	printf("}\n");
 }
 
 enum opt {
@@ -1906,6 +1853,7 @@ enum opt {
 	OPT_USAGE,
 	OPT_HEADER,
 	OPT_DESCRIBE,
+	OPT_JSON,
 };
 
 static void usage(const char *toolname)
@@ -1919,6 +1867,7 @@ static void usage(const char *toolname)
 			" [--block=<block_no>]"
 			" [--header]"
 			" [--describe]"
+			" [--json]"
 			" [--help]\n");
 }
 
@@ -1928,8 +1877,7 @@ int main(int argc, char **argv)
 	int index;
 	enum opt opt;
 	int fd;
-	struct vbt_header *vbt = NULL;
-	int vbt_off, bdb_off, i;
+	int i, err;
 	const char *filename = NULL;
 	const char *toolname = argv[0];
 	struct stat finfo;
@@ -1939,7 +1887,7 @@ int main(int argc, char **argv)
 	};
 	char *endp;
 	int block_number = -1;
-	bool header_only = false, describe = false;
+	bool header_only = false, describe = false, json = false;
 
 	static struct option options[] = {
 		{ "file",	required_argument,	NULL,	OPT_FILE },
@@ -1950,6 +1898,7 @@ int main(int argc, char **argv)
 		{ "block",	required_argument,	NULL,	OPT_BLOCK },
 		{ "header",	no_argument,		NULL,	OPT_HEADER },
 		{ "describe",	no_argument,		NULL,	OPT_DESCRIBE },
+		{ "json",	no_argument,		NULL,	OPT_JSON },
 		{ "help",	no_argument,		NULL,	OPT_USAGE },
 		{ 0 }
 	};
@@ -1996,6 +1945,9 @@ int main(int argc, char **argv)
 		case OPT_DESCRIBE:
 			describe = true;
 			break;
+		case OPT_JSON:
+			json = true;
+			break;
 		case OPT_END:
 			break;
 		case OPT_USAGE: /* fall-through */
@@ -2058,28 +2010,20 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* Scour memory looking for the VBT signature */
-	for (i = 0; i + 4 < size; i++) {
-		if (!memcmp(VBIOS + i, "$VBT", 4)) {
-			vbt_off = i;
-			vbt = (struct vbt_header *)(VBIOS + i);
-			break;
-		}
-	}
-
-	if (!vbt) {
+	err = igt_vbt_init(&context.igt_vbt, VBIOS, size);
+	if (err == -ENOENT) {
 		fprintf(stderr, "VBT signature missing\n");
 		return EXIT_FAILURE;
-	}
-
-	bdb_off = vbt_off + vbt->bdb_offset;
-	if (bdb_off >= size - sizeof(struct bdb_header)) {
+	} else if (err == -EINVAL) {
 		fprintf(stderr, "Invalid VBT found, BDB points beyond end of data block\n");
 		return EXIT_FAILURE;
+	} else if (err) {
+		fprintf(stderr, "Failed to parse VBT: %s\n", strerror(-err));
+		return EXIT_FAILURE;
 	}
 
-	context.vbt = vbt;
-	context.bdb = (const struct bdb_header *)(VBIOS + bdb_off);
+	context.vbt = context.igt_vbt.vbt;
+	context.bdb = context.igt_vbt.bdb;
 	context.size = size;
 
 	if (!context.devid) {
@@ -2093,7 +2037,7 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Warning: could not find PCI device ID!\n");
 
 	if (context.panel_type == -1)
-		context.panel_type = get_panel_type(&context);
+		context.panel_type = igt_vbt_panel_type(&context.igt_vbt);
 	if (context.panel_type == -1) {
 		fprintf(stderr, "Warning: panel type not set, using 0\n");
 		context.panel_type = 0;
@@ -2101,6 +2045,8 @@ int main(int argc, char **argv)
 
 	if (describe) {
 		print_description(&context);
+	} else if (json) {
+		dump_json(&context);
 	} else if (header_only) {
 		dump_headers(&context);
 	} else if (block_number != -1) {
@@ -2113,9 +2059,11 @@ int main(int argc, char **argv)
 		dump_headers(&context);
 
 		/* dump all sections  */
-		for (i = 0; i < 256; i++)
+		for (i = 0; i < IGT_VBT_NUM_BLOCKS; i++)
 			dump_section(&context, i);
 	}
 
+	igt_vbt_fini(&context.igt_vbt);
+
 	return 0;
 }
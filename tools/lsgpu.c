@@ -25,6 +25,7 @@
 #include "igt_device_scan.h"
 #include "igt.h"
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
@@ -61,6 +62,9 @@
  *
  * NOTE: When using filters only the first matching device is printed.
  *
+ * With '-w' or '--watch' the device list is printed again every time a drm
+ * device is added or removed, until interrupted.
+ *
  * Additionally lsgpu tries to open the card and render nodes to verify
  * permissions. It also uses IGT variable search order:
  * - use --device first (it overrides IGT_DEVICE and .igtrc Common::Device
@@ -76,12 +80,14 @@ enum {
 	OPT_LIST_VENDORS   = 'v',
 	OPT_LIST_FILTERS   = 'l',
 	OPT_DEVICE         = 'd',
+	OPT_WATCH          = 'w',
 	OPT_HELP           = 'h'
 };
 
 static bool g_show_vendors;
 static bool g_list_filters;
 static bool g_help;
+static bool g_watch;
 static char *igt_device;
 
 static const char *usage_str =
@@ -93,12 +99,33 @@ static const char *usage_str =
 	"  -v, --list-vendors          List recognized vendors\n"
 	"  -l, --list-filter-types     List registered device filters types\n"
 	"  -d, --device filter         Device filter, can be given multiple times\n"
+	"  -w, --watch                 Print the devices again whenever they change\n"
 	"  -h, --help                  Show this help message and exit\n"
 	"\nOptions valid for default print out mode only:\n"
 	"      --drm                   Show DRM filters (default) for each device\n"
 	"      --sysfs                 Show sysfs filters for each device\n"
 	"      --pci                   Show PCI filters for each device\n";
 
+static void watch_devices(const struct igt_devices_print_format *fmt)
+{
+	struct pollfd p = { .events = POLLIN };
+
+	p.fd = igt_devices_monitor();
+	if (p.fd < 0) {
+		fprintf(stderr, "Cannot monitor devices: %s\n", strerror(-p.fd));
+		return;
+	}
+
+	while (poll(&p, 1, -1) > 0) {
+		if (!igt_devices_update())
+			continue;
+
+		printf("\n=== Devices changed ===\n");
+		igt_devices_print(fmt);
+		fflush(stdout);
+	}
+}
+
 static void test_device_open(struct igt_device_card *card)
 {
 	int fd;
@@ -168,6 +195,7 @@ int main(int argc, char *argv[])
 		{"list-vendors",      no_argument,       NULL, OPT_LIST_VENDORS},
 		{"list-filter-types", no_argument,       NULL, OPT_LIST_FILTERS},
 		{"device",            required_argument, NULL, OPT_DEVICE},
+		{"watch",             no_argument,       NULL, OPT_WATCH},
 		{"help",              no_argument,       NULL, OPT_HELP},
 		{0, 0, 0, 0}
 	};
@@ -177,7 +205,7 @@ int main(int argc, char *argv[])
 			.type = IGT_PRINT_USER,
 	};
 
-	while ((c = getopt_long(argc, argv, "nspvld:h",
+	while ((c = getopt_long(argc, argv, "nspvld:wh",
 				long_options, &index)) != -1) {
 		switch(c) {
 
@@ -199,6 +227,9 @@ int main(int argc, char *argv[])
 		case OPT_DEVICE:
 			opt_device = strdup(optarg);
 			break;
+		case OPT_WATCH:
+			g_watch = true;
+			break;
 		case OPT_HELP:
 			g_help = true;
 			break;
@@ -272,6 +303,8 @@ int main(int argc, char *argv[])
 
 	} else {
 		igt_devices_print(&fmt);
+		if (g_watch)
+			watch_devices(&fmt);
 	}
 out:
 	igt_devices_free();
@@ -21,418 +21,308 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+/*
+ * Simulates the gen9+ DDB allocation and watermarks of every combination of
+ * active pipes, modes, plane counts, formats and modifiers, to predict which
+ * display configurations a platform can't drive, or only without its deeper
+ * watermark levels, before the hardware is at hand.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
-#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
-/**
- * container_of - cast a member of a structure out to the containing structure
- * @ptr:	the pointer to the member.
- * @type:	the type of the container struct this is embedded in.
- * @member:	the name of the member within the struct.
- *
- */
-#define container_of(ptr, type, member) ({			\
-	typeof( ((type *)0)->member ) *__mptr = (ptr);	\
-	(type *)( (char *)__mptr - offsetof(type,member) );})
-
-#define div_u64(a, b)	((a) / (b))
+#include "drm_fourcc.h"
+#include "drmtest.h"
+#include "igt_fb.h"
+#include "intel_wm_sim.h"
 
-/*
- * Stub a few defines/structures
- */
-
-#define I915_MAX_PIPES	3
-#define I915_MAX_PLANES	3
-#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
-
-#define for_each_pipe(p) for ((p) = 0; (p) < 3; (p)++)
-#define for_each_plane(pipe, p) for ((p) = 0; (p) < 3; (p)++)
-
-#define for_each_crtc(dev, crtc) \
-	for (int i = 0; i < 3 && (crtc = &crtcs[i].base); i++)
-
-#define for_each_intel_crtc(dev, intel_crtc) \
-	for (int i = 0; i < 3, intel_crtc = &crtcs[i]; i++)
-
-enum pipe {
-	PIPE_A,
-	PIPE_B,
-	PIPE_C,
+static const struct intel_wm_sim_mode modes[] = {
+	{ "1920x1080@60", 148500, 1920, 1080, 2200 },
+	{ "3840x2160@60", 594000, 3840, 2160, 4400 },
+	{ "5120x2880@60", 938250, 5120, 2880, 5280 },
 };
 
-enum plane {
-	PLANE_1,
-	PLANE_2,
-	PLANE_3,
+static const uint32_t formats[] = {
+	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_XRGB16161616F,
+	DRM_FORMAT_NV12,
 };
 
-#define pipe_name(p) ((p) + 'A')
-
-struct drm_device {
-	void *dev_private;
+static const uint64_t modifiers[] = {
+	DRM_FORMAT_MOD_LINEAR,
+	I915_FORMAT_MOD_X_TILED,
+	I915_FORMAT_MOD_Y_TILED,
+	I915_FORMAT_MOD_Yf_TILED,
 };
 
-struct drm_i915_private {
-	struct drm_device *dev;
+static const char * const status_names[] = {
+	[INTEL_WM_SIM_OK] = "ok",
+	[INTEL_WM_SIM_UNSUPPORTED] = "unsupported",
+	[INTEL_WM_SIM_DDB] = "ddb",
+	[INTEL_WM_SIM_BW] = "bw",
 };
 
-struct drm_crtc {
-	struct drm_device *dev;
-	bool active;
-};
-
-static bool intel_crtc_active(struct drm_crtc *crtc)
+static void print_config(const struct intel_wm_sim_platform *platform,
+			 uint64_t n, const struct intel_wm_sim_config *config)
 {
-	return crtc->active;
-}
-
-struct intel_crtc {
-	struct drm_crtc base;
-	enum pipe pipe;
-};
-
-static int intel_num_planes(struct intel_crtc *crtc)
-{
-	return 3;
-}
-
-struct intel_crtc crtcs[I915_MAX_PIPES];
-
-#define to_intel_crtc(x) container_of(x, struct intel_crtc, base)
-
-/*
- * DDB code
- */
-
-struct intel_wm_config {
-	unsigned int num_pipes_active;
-};
+	const struct intel_wm_sim_plane *plane = NULL;
 
-struct intel_plane_wm_parameters {
-	uint32_t horiz_pixels;
-	uint32_t vert_pixels;
-	uint8_t bytes_per_pixel;
-	bool enabled;
-	bool scaled;
-};
-
-struct skl_pipe_wm_parameters {
-	bool active;
-	uint32_t pipe_htotal;
-	uint32_t pixel_rate; /* in KHz */
-	struct intel_plane_wm_parameters plane[I915_MAX_PLANES];
-	struct intel_plane_wm_parameters cursor;
-};
+	for (int pipe = 0; pipe < platform->num_pipes && !plane; pipe++)
+		if (config->pipes[pipe].mode)
+			plane = &config->pipes[pipe].planes[0];
 
-struct skl_ddb_entry {
-	uint16_t start, end;	/* in number of blocks. 'end' is exclusive */
-};
+	printf("%s #%" PRIu64 " %s %s:", platform->name, n,
+	       igt_format_str(plane->format),
+	       igt_fb_modifier_name(plane->modifier));
 
-static inline uint16_t skl_ddb_entry_size(const struct skl_ddb_entry *entry)
-{
-	/* end not set, clearly no allocation here. start can be 0 though */
-	if (entry->end == 0)
-		return 0;
+	for (int pipe = 0; pipe < platform->num_pipes; pipe++) {
+		const struct intel_wm_sim_pipe *p = &config->pipes[pipe];
 
-	return entry->end - entry->start;
+		if (p->mode)
+			printf(" %c %s x%d", 'A' + pipe, p->mode->name,
+			       p->num_planes);
+	}
 }
 
-struct skl_ddb_allocation {
-	struct skl_ddb_entry plane[I915_MAX_PIPES][I915_MAX_PLANES];
-	struct skl_ddb_entry cursor[I915_MAX_PIPES];
-};
-
-/*
- * On gen9, we need to allocate Display Data Buffer (DDB) portions to the
- * different active planes.
- */
-
-#define SKL_DDB_SIZE		896	/* in blocks */
-
-static void
-skl_ddb_get_pipe_allocation_limits(struct drm_device *dev,
-				   struct drm_crtc *for_crtc,
-				   const struct intel_wm_config *config,
-				   const struct skl_pipe_wm_parameters *params,
-				   struct skl_ddb_entry *alloc /* out */)
+static void print_alloc(const struct intel_wm_sim_alloc *alloc)
 {
-	struct drm_crtc *crtc;
-	unsigned int pipe_size, ddb_size;
-	int nth_active_pipe;
+	char name[16];
 
-	if (!params->active) {
-		alloc->start = 0;
-		alloc->end = 0;
-		return;
-	}
+	if (alloc->plane < 0)
+		snprintf(name, sizeof(name), "Cursor");
+	else
+		snprintf(name, sizeof(name), "Plane%d%s", alloc->plane + 1,
+			 alloc->uv ? " uv" : "");
 
-	ddb_size = SKL_DDB_SIZE;
-	ddb_size -= 4; /* 4 blocks for bypass path allocation */
+	printf("  %-13s%8u%8u%8u%8d ", name, alloc->start, alloc->end,
+	       alloc->end - alloc->start, alloc->max_level);
 
-	nth_active_pipe = 0;
-	for_each_crtc(dev, crtc) {
-		if (!intel_crtc_active(crtc))
-			continue;
+	for (int level = 0; level < INTEL_WM_SIM_MAX_LEVELS; level++) {
+		const struct intel_wm_sim_level *wm = &alloc->wm[level];
 
-		if (crtc == for_crtc)
-			break;
-
-		nth_active_pipe++;
+		if (wm->min_ddb_alloc == 0xffff)
+			printf("        -");
+		else
+			printf(" %3u/%2u/%-3u", wm->blocks, wm->lines,
+			       wm->min_ddb_alloc);
 	}
-
-	pipe_size = ddb_size / config->num_pipes_active;
-	alloc->start = nth_active_pipe * ddb_size / config->num_pipes_active;
-	alloc->end = alloc->start + pipe_size;
-}
-
-static unsigned int skl_cursor_allocation(const struct intel_wm_config *config)
-{
-	if (config->num_pipes_active == 1)
-		return 32;
-
-	return 8;
+	printf("\n");
 }
 
-static unsigned int
-skl_plane_relative_data_rate(const struct intel_plane_wm_parameters *p)
+static void dump_config(const struct intel_wm_sim_platform *platform,
+			const struct intel_wm_sim_space *space, uint64_t n)
 {
-	return p->horiz_pixels * p->vert_pixels * p->bytes_per_pixel;
-}
+	struct intel_wm_sim_config config;
+	struct intel_wm_sim_state state;
+	struct intel_wm_sim_result result;
 
-/*
- * We don't overflow 32 bits. Worst case is 3 planes enabled, each fetching
- * a 8192x4096@32bpp framebuffer:
- *   3 * 4096 * 8192  * 4 < 2^32
- */
-static unsigned int
-skl_get_total_relative_data_rate(struct intel_crtc *intel_crtc,
-				 const struct skl_pipe_wm_parameters *params)
-{
-	unsigned int total_data_rate = 0;
-	int plane;
+	intel_wm_sim_space_get(platform, space, n, &config);
+	intel_wm_sim_compute(platform, &config, &state, &result);
 
-	for (plane = 0; plane < intel_num_planes(intel_crtc); plane++) {
-		const struct intel_plane_wm_parameters *p;
+	print_config(platform, n, &config);
 
-		p = &params->plane[plane];
-		if (!p->enabled)
-			continue;
-
-		total_data_rate += skl_plane_relative_data_rate(p);
-	}
-
-	return total_data_rate;
-}
-
-static void
-skl_allocate_pipe_ddb(struct drm_crtc *crtc,
-		      const struct intel_wm_config *config,
-		      const struct skl_pipe_wm_parameters *params,
-		      struct skl_ddb_allocation *ddb /* out */)
-{
-	struct drm_device *dev = crtc->dev;
-	struct intel_crtc *intel_crtc = to_intel_crtc(crtc);
-	enum pipe pipe = intel_crtc->pipe;
-	struct skl_ddb_entry alloc;
-	uint16_t alloc_size, start, cursor_blocks;
-	uint16_t minimum[I915_MAX_PLANES];
-	unsigned int total_data_rate;
-	int plane;
-
-	skl_ddb_get_pipe_allocation_limits(dev, crtc, config, params, &alloc);
-	alloc_size = skl_ddb_entry_size(&alloc);
-	if (alloc_size == 0) {
-		memset(ddb->plane[pipe], 0, sizeof(ddb->plane[pipe]));
-		memset(&ddb->cursor[pipe], 0, sizeof(ddb->cursor[pipe]));
+	/* nothing was allocated */
+	if (result.status == INTEL_WM_SIM_UNSUPPORTED) {
+		printf("\n%s\n", status_names[result.status]);
 		return;
 	}
 
-	cursor_blocks = skl_cursor_allocation(config);
-	ddb->cursor[pipe].start = alloc.end - cursor_blocks;
-	ddb->cursor[pipe].end = alloc.end;
+	printf("\n%s, level %d, %u MB/s of %u\n\n",
+	       status_names[result.status], result.level, result.bw,
+	       platform->max_bw);
 
-	alloc_size -= cursor_blocks;
-	alloc.end -= cursor_blocks;
+	printf("%-15s%8s%8s%8s%8s  %s\n", "", "Start", "End", "Size", "Level",
+	       "blocks/lines/min_ddb_alloc of each level");
 
-	/* 1. Allocate the mininum required blocks for each active plane */
-	for_each_plane(pipe, plane) {
-		const struct intel_plane_wm_parameters *p;
-
-		p = &params->plane[plane];
-		if (!p->enabled)
-			continue;
-
-		minimum[plane] = 8;
-		alloc_size -= minimum[plane];
-	}
+	for (int pipe = 0; pipe < platform->num_pipes; pipe++) {
+		const struct intel_wm_sim_pipe_state *ps = &state.pipes[pipe];
 
-	/*
-	 * 2. Distribute the remaining space in proportion to the amount of
-	 * data each plane needs to fetch from memory.
-	 *
-	 * FIXME: we may not allocate every single block here.
-	 */
-	total_data_rate = skl_get_total_relative_data_rate(intel_crtc, params);
-
-	start = alloc.start;
-	for (plane = 0; plane < intel_num_planes(intel_crtc); plane++) {
-		const struct intel_plane_wm_parameters *p;
-		unsigned int data_rate;
-		uint16_t plane_blocks;
-
-		p = &params->plane[plane];
-		if (!p->enabled)
+		if (!config.pipes[pipe].mode)
 			continue;
 
-		data_rate = skl_plane_relative_data_rate(p);
+		printf("Pipe %c, slices 0x%x, blocks %u-%u\n", 'A' + pipe,
+		       ps->slices, ps->start, ps->end);
 
-		/*
-		 * promote the expression to 64 bits to avoid overflowing, the
-		 * result is < available as data_rate / total_data_rate < 1
-		 */
-		plane_blocks = minimum[plane];
-		plane_blocks += div_u64((uint64_t)alloc_size * data_rate,
-					total_data_rate);
-
-		ddb->plane[pipe][plane].start = start;
-		ddb->plane[pipe][plane].end = start + plane_blocks;
-
-		start += plane_blocks;
+		/* the cursor comes last */
+		for (int i = 0; i <= ps->num_allocs; i++)
+			print_alloc(&ps->allocs[i]);
 	}
-
 }
 
-static void skl_ddb_check_entry(struct skl_ddb_entry *entry, int16_t *cursor)
+static int simulate(const struct intel_wm_sim_platform *platform,
+		    const struct intel_wm_sim_space *space, int num_threads,
+		    bool verbose)
 {
+	uint64_t size = intel_wm_sim_space_size(platform, space);
+	uint64_t status[ARRAY_SIZE(status_names)] = {};
+	uint64_t levels[INTEL_WM_SIM_MAX_LEVELS] = {};
+	struct intel_wm_sim_result *results;
+
+	results = calloc(size, sizeof(*results));
+	if (!results || intel_wm_sim_run(platform, space, num_threads, results)) {
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
 
-	if (skl_ddb_entry_size(entry) == 0)
-		return;
-
-	/* check that ->start is the next available block */
-	if (entry->start < *cursor)
-		printf("error: allocation overlaps previous block\n");
-	else if (entry->start >= *cursor + 1)
-		printf("warning: allocation leaves a hole\n");
-
-	*cursor = entry->end;
-}
-
-static void skl_ddb_check_last_allocation(int16_t cursor)
-{
-	uint16_t last_offset = SKL_DDB_SIZE - 4;
-
-	if (cursor < last_offset)
-		printf("warning: %d blocks not allocated\n",
-		       last_offset - cursor);
-	else if (cursor > last_offset)
-		printf("error: allocation greater than available space\n");
-}
-
-static void skl_ddb_print(struct skl_ddb_allocation *ddb)
-{
-	struct skl_ddb_entry *entry;
-	enum pipe pipe;
-	int plane;
-	int16_t cursor = 0;
-
-	printf("%-15s%8s%8s%8s\n", "", "Start", "End", "Size");
-
-	for_each_pipe(pipe) {
-		printf("Pipe %c\n", pipe_name(pipe));
+	for (uint64_t n = 0; n < size; n++) {
+		const struct intel_wm_sim_result *r = &results[n];
 
-		for_each_plane(pipe, plane) {
-			entry = &ddb->plane[pipe][plane];
+		status[r->status]++;
+		if (r->status == INTEL_WM_SIM_OK)
+			levels[r->level]++;
 
-			printf("  Plane%-8d%8u%8u%8u\n", plane + 1,
-			       entry->start, entry->end,
-			       skl_ddb_entry_size(entry));
+		if (verbose && r->status != INTEL_WM_SIM_OK &&
+		    r->status != INTEL_WM_SIM_UNSUPPORTED) {
+			struct intel_wm_sim_config config;
 
-			skl_ddb_check_entry(entry, &cursor);
+			intel_wm_sim_space_get(platform, space, n, &config);
+			print_config(platform, n, &config);
+			printf(": %s, %u MB/s\n", status_names[r->status], r->bw);
 		}
-
-		entry = &ddb->cursor[pipe];
-		printf("  %-13s%8u%8u%8u\n", "Cursor", entry->start,
-		       entry->end, skl_ddb_entry_size(entry));
-
-		skl_ddb_check_entry(entry, &cursor);
 	}
 
-	skl_ddb_check_last_allocation(cursor);
-}
-
-static struct drm_device drm_device;
-static struct drm_i915_private drm_i915_private;
+	printf("%s: %" PRIu64 " configurations, %d DBuf slices of %d blocks, %u MB/s\n",
+	       platform->name, size, platform->num_slices, platform->slice_size,
+	       platform->max_bw);
+	for (int i = 0; i < ARRAY_SIZE(status_names); i++)
+		printf("  %-12s%12" PRIu64 "\n", status_names[i], status[i]);
+	for (int level = INTEL_WM_SIM_MAX_LEVELS - 1; level >= 0; level--)
+		if (levels[level])
+			printf("  ok, level %d%12" PRIu64 "\n", level,
+			       levels[level]);
 
-static void init_stub(void)
-{
-	int i;
+	free(results);
 
-	drm_device.dev_private = &drm_i915_private;
-	drm_i915_private.dev = &drm_device;
-
-	for (i = 0; i < I915_MAX_PIPES; i++) {
-		crtcs[i].base.dev = &drm_device;
-		crtcs[i].pipe = i;
-	}
+	return EXIT_SUCCESS;
 }
 
-struct wm_input {
-	struct intel_wm_config config;
-	struct skl_pipe_wm_parameters params[I915_MAX_PIPES];
-};
-
-static void wm_input_reset(struct wm_input *in)
+static void usage(const char *name)
 {
-	memset(in, 0, sizeof(*in));
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -p, --platform=NAME      Simulate only NAME (", name);
+	for (int i = 0; i < intel_wm_sim_num_platforms; i++)
+		fprintf(stderr, "%s%s", i ? ", " : "",
+			intel_wm_sim_platforms[i].name);
+	fprintf(stderr,
+		")\n"
+		"  -P, --max-planes=N       At most N planes per pipe\n"
+		"  -l, --latency=L0,...     Watermark latencies in us\n"
+		"  -b, --bandwidth=MB/s     Memory bandwidth of the display\n"
+		"  -j, --threads=N          Simulate on N threads (default: one per CPU)\n"
+		"  -c, --config=N           Show the allocation of configuration N\n"
+		"  -v, --verbose            List the configurations that fail\n"
+		"  -h, --help               This help\n");
 }
 
-static void wm_enable_plane(struct wm_input *in,
-			    enum pipe pipe, enum plane plane,
-			    uint32_t width, uint32_t height, int bpp)
+int main(int argc, char **argv)
 {
-	enum pipe i;
-
-	in->params[pipe].active = 1;
+	static const struct option options[] = {
+		{ "platform",	required_argument,	NULL,	'p' },
+		{ "max-planes",	required_argument,	NULL,	'P' },
+		{ "latency",	required_argument,	NULL,	'l' },
+		{ "bandwidth",	required_argument,	NULL,	'b' },
+		{ "threads",	required_argument,	NULL,	'j' },
+		{ "config",	required_argument,	NULL,	'c' },
+		{ "verbose",	no_argument,		NULL,	'v' },
+		{ "help",	no_argument,		NULL,	'h' },
+		{ 0 }
+	};
+	struct intel_wm_sim_space space = {
+		.modes = modes,
+		.num_modes = ARRAY_SIZE(modes),
+		.formats = formats,
+		.num_formats = ARRAY_SIZE(formats),
+		.modifiers = modifiers,
+		.num_modifiers = ARRAY_SIZE(modifiers),
+	};
+	const struct intel_wm_sim_platform *only = NULL;
+	struct intel_wm_sim_platform platform;
+	const char *latency = NULL;
+	unsigned int bandwidth = 0;
+	int num_threads = 0, c, ret = EXIT_SUCCESS;
+	int64_t config = -1;
+	bool verbose = false;
+
+	while ((c = getopt_long(argc, argv, "p:P:l:b:j:c:vh", options,
+				NULL)) != -1) {
+		switch (c) {
+		case 'p':
+			only = intel_wm_sim_find_platform(optarg);
+			if (!only) {
+				fprintf(stderr, "Unknown platform '%s'\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'P':
+			space.max_planes = atoi(optarg);
+			break;
+		case 'l':
+			latency = optarg;
+			break;
+		case 'b':
+			bandwidth = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			num_threads = atoi(optarg);
+			break;
+		case 'c':
+			config = strtoll(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
 
-	in->config.num_pipes_active = 0;
-	for_each_pipe(i)
-		if (in->params[i].active)
-			in->config.num_pipes_active++;
+	if ((config >= 0 || latency || bandwidth) && !only) {
+		fprintf(stderr, "--config, --latency and --bandwidth need a --platform\n");
+		return EXIT_FAILURE;
+	}
 
-	in->params[pipe].plane[plane].horiz_pixels = width;
-	in->params[pipe].plane[plane].vert_pixels = height;
-	in->params[pipe].plane[plane].bytes_per_pixel = bpp;
-	in->params[pipe].plane[plane].enabled = true;
-}
+	for (int i = 0; i < intel_wm_sim_num_platforms; i++) {
+		if (only && only != &intel_wm_sim_platforms[i])
+			continue;
 
-static void skl_ddb_allocate(struct wm_input *in,
-			     struct skl_ddb_allocation *out)
-{
-	struct drm_crtc *crtc;
+		platform = intel_wm_sim_platforms[i];
 
-	for_each_crtc(, crtc) {
-		enum pipe pipe = to_intel_crtc(crtc)->pipe;
+		if (latency) {
+			char *s = (char *)latency, *end;
 
-		skl_allocate_pipe_ddb(crtc,
-				      &in->config, &in->params[pipe], out);
-	}
-}
+			memset(platform.latency, 0, sizeof(platform.latency));
+			for (int level = 0; level < INTEL_WM_SIM_MAX_LEVELS; level++) {
+				platform.latency[level] = strtoul(s, &end, 0);
+				if (*end != ',')
+					break;
+				s = end + 1;
+			}
+		}
+		if (bandwidth)
+			platform.max_bw = bandwidth;
 
-int main(int argc, char **argv)
-{
-	struct wm_input in;
-	static struct skl_ddb_allocation ddb;
+		if (config >= 0) {
+			if (config >= intel_wm_sim_space_size(&platform, &space)) {
+				fprintf(stderr, "No configuration %" PRId64 "\n",
+					config);
+				return EXIT_FAILURE;
+			}
 
-	init_stub();
+			dump_config(&platform, &space, config);
+			continue;
+		}
 
-	wm_input_reset(&in);
-	wm_enable_plane(&in, PIPE_A, PLANE_1, 1280, 1024, 4);
-	wm_enable_plane(&in, PIPE_A, PLANE_2,  100,  100, 4);
-	skl_ddb_allocate(&in, &ddb);
-	skl_ddb_print(&ddb);
+		ret = simulate(&platform, &space, num_threads, verbose);
+		if (ret)
+			break;
+	}
 
-	return 0;
+	return ret;
 }